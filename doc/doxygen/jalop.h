@@ -75,14 +75,20 @@
  * the database and sending records to the JALoP Local Store.
  *  - \p jalp_test: This is a development tool that can send journal, audit, or
  *  log data to a local store. It is primarily used to test the JPL.
+ *  - \p jalp_audit_bench: This is a development tool that measures how many
+ *  audit records per second the JPL can validate and digest.
  *  - \p jal_dump: This is a tool used to retrieve
  *     specific sections of one or more JAL records. 
  *  - \p jal_purge: This utility can be used to remove records
  *  from the database.
  *  - \p jaldb_tail: The  jaldb_tail  tool is similar to the
  *     UNIX tail utility.
+ *  - \p jaldb_upgrade: This utility upgrades an existing database to the
+ *     current layout version, rebuilds its indices, and can move the journal
+ *     files into a new directory layout.
  *
- *  With the exception of \p jalp_test (since this is really a development tool),
+ *  With the exception of \p jalp_test and \p jalp_audit_bench (since these are
+ *  really development tools),
  *  *NIX man pages are provided for the various utilities and configuration files.
  *  They can be accessed in the source under doc/man/, or post-installation under
  *  PREFIX/share/man/.
@@ -29,19 +29,35 @@
 
 #define __STDC_FORMAT_MACROS
 
+#include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <jalop/jal_status.h>
 #include <inttypes.h> // For PRIu64
+#include <limits.h>
 #include <list>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sstream>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 #include "jal_alloc.h"
+#include "jal_byteswap.h"
 #include "jal_error_callback_internal.h"
 #include "jal_asprintf_internal.h"
+#include "jal_fs_utils.h"
 
 #include "jaldb_context.hpp"
+#include "jaldb_datetime.h"
 #include "jaldb_record.h"
 #include "jaldb_record_dbs.h"
 #include "jaldb_record_xml.h"
@@ -56,15 +72,123 @@ using namespace std;
 
 #define DEFAULT_DB_ROOT "/var/lib/jalop/db"
 #define DEFAULT_SCHEMAS_ROOT "/usr/local/share/jalop-v1.0/schemas"
+#define UUID_STR_LEN 37
 
 static enum jaldb_status jaldb_remove_record_from_db(jaldb_context *ctx, jaldb_record_dbs *rdbs, const char *nonce);
+static void jaldb_disable_group_commit(jaldb_context *ctx);
+static void jaldb_destroy_journal_pool(jaldb_context *ctx);
+static void jaldb_remove_stale_journal_pools(const char *journal_root);
 
 jaldb_context *jaldb_context_create()
 {
 	jaldb_context *context = (jaldb_context *)jal_calloc(1, sizeof(*context));
+	pthread_mutex_init(&context->notify_lock, NULL);
+	pthread_cond_init(&context->notify_cond, NULL);
+	context->notify_fd = -1;
+	context->journal_fanout = JALDB_JOURNAL_FANOUT_DEFAULT;
 	return context;
 }
 
+/**
+ * Check that the records of one type are at the current layout version.
+ * jaldb_upgrade converts records in key order, so looking at the first and
+ * the last record also catches an upgrade that was interrupted.
+ *
+ * @param[in] env The DB environment.
+ * @param[in] prefix The prefix of the record type's DBs.
+ *
+ * @return JALDB_OK if there are no records or they are current,
+ * JALDB_E_LAYOUT_VERSION_UNKNOWN if the DB must be upgraded, or another
+ * error code.
+ */
+static enum jaldb_status jaldb_check_layout_version(DB_ENV *env, const char *prefix)
+{
+	enum jaldb_status ret = JALDB_E_DB;
+	const uint32_t positions[] = { DB_FIRST, DB_LAST };
+	char *name = NULL;
+	DB *db = NULL;
+	DBC *cursor = NULL;
+	int byte_swap = 0;
+	uint16_t version;
+	int db_ret;
+	DBT key;
+	DBT val;
+
+	memset(&key, 0, sizeof(key));
+	memset(&val, 0, sizeof(val));
+	key.flags = DB_DBT_REALLOC;
+	// Only the version (the first field of the headers) is read.
+	val.data = &version;
+	val.ulen = sizeof(version);
+	val.dlen = sizeof(version);
+	val.doff = 0;
+	val.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
+
+	if (-1 == jal_asprintf(&name, "%s_records.db", prefix)) {
+		return JALDB_E_NO_MEM;
+	}
+
+	db_ret = db_create(&db, env, 0);
+	if (0 != db_ret) {
+		db = NULL;
+		goto out;
+	}
+	db_ret = db->set_bt_compare(db, jaldb_nonce_compare);
+	if (0 != db_ret) {
+		JALDB_DB_ERR(db, db_ret);
+		goto out;
+	}
+	db_ret = db->open(db, NULL, name, NULL, DB_BTREE, DB_THREAD | DB_RDONLY, 0);
+	if (ENOENT == db_ret) {
+		// A new DB.
+		ret = JALDB_OK;
+		goto out;
+	} else if (0 != db_ret) {
+		JALDB_DB_ERR(db, db_ret);
+		goto out;
+	}
+	db_ret = db->get_byteswapped(db, &byte_swap);
+	if (0 != db_ret) {
+		goto out;
+	}
+	db_ret = db->cursor(db, NULL, &cursor, 0);
+	if (0 != db_ret) {
+		JALDB_DB_ERR(db, db_ret);
+		goto out;
+	}
+
+	for (size_t i = 0; i < sizeof(positions) / sizeof(positions[0]); i++) {
+		db_ret = cursor->c_get(cursor, &key, &val, positions[i]);
+		if (DB_NOTFOUND == db_ret) {
+			break;
+		} else if (0 != db_ret) {
+			JALDB_DB_ERR(db, db_ret);
+			goto out;
+		}
+		if (byte_swap) {
+			version = jal_bswap_16(version);
+		}
+		if (JALDB_DB_LAYOUT_VERSION != version) {
+			env->errx(env, "%s has records at layout version %u, "
+					"run jaldb_upgrade to convert them to version %u",
+					name, version, JALDB_DB_LAYOUT_VERSION);
+			ret = JALDB_E_LAYOUT_VERSION_UNKNOWN;
+			goto out;
+		}
+	}
+	ret = JALDB_OK;
+out:
+	if (cursor) {
+		cursor->c_close(cursor);
+	}
+	if (db) {
+		db->close(db, 0);
+	}
+	free(key.data);
+	free(name);
+	return ret;
+}
+
 enum jaldb_status jaldb_context_init(
 	jaldb_context *ctx,
 	const char *db_root,
@@ -93,6 +217,10 @@ enum jaldb_status jaldb_context_init(
 		return JALDB_E_NO_MEM;
 	}
 
+	if (-1 == jal_asprintf(&ctx->notify_path, "%s%s", db_root, JALDB_NOTIFY_FILE_NAME)) {
+		return JALDB_E_NO_MEM;
+	}
+
 	// set readonly flag if specified
 	ctx->db_read_only = db_rdonly_flag;
 
@@ -123,6 +251,17 @@ enum jaldb_status jaldb_context_init(
 		return JALDB_E_INVAL;
 	}
 
+	// Records in an older layout can't be read, refuse to open the DB
+	// until it is upgraded.
+	const char *prefixes[] = { "log", "audit", "journal" };
+	for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+		enum jaldb_status check_ret = jaldb_check_layout_version(env, prefixes[i]);
+		if (JALDB_OK != check_ret) {
+			env->close(env, 0);
+			return check_ret;
+		}
+	}
+
 	DB_TXN *db_txn = NULL;
 
 	db_err = env->txn_begin(env, NULL, &db_txn, DB_DIRTY_READ);
@@ -200,10 +339,19 @@ enum jaldb_status jaldb_context_init(
 	db_txn->commit(db_txn, 0);
 	ctx->env = env;
 
+	if (!db_rdonly_flag) {
+		jaldb_remove_stale_journal_pools(ctx->journal_root);
+	}
+
 	ctx->seen_journal_records = new std::set<string>();
 	ctx->seen_audit_records = new std::set<string>();
 	ctx->seen_log_records = new std::set<string>();
 
+	if (!db_rdonly_flag) {
+		// Not fatal, readers in other processes fall back to polling.
+		ctx->notify_fd = open(ctx->notify_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	}
+
 	return JALDB_OK;
 }
 
@@ -214,8 +362,17 @@ void jaldb_context_destroy(jaldb_context **ctx)
 	}
 	jaldb_context *ctxp = *ctx;
 
+	jaldb_disable_group_commit(ctxp);
+	jaldb_destroy_journal_pool(ctxp);
+
 	free(ctxp->journal_root);
 	free(ctxp->schemas_root);
+	free(ctxp->notify_path);
+	if (ctxp->notify_fd >= 0) {
+		close(ctxp->notify_fd);
+	}
+	pthread_cond_destroy(&ctxp->notify_cond);
+	pthread_mutex_destroy(&ctxp->notify_lock);
 
 	if (ctxp->journal_conf_db) {
 		(*ctx)->journal_conf_db->close((*ctx)->journal_conf_db, 0);
@@ -1229,38 +1386,106 @@ out:
 	return ret;
 }
 
-enum jaldb_status jaldb_insert_record(jaldb_context *ctx, struct jaldb_record *rec, int confirmed, char **local_nonce)
+/**
+ * Generate the system metadata document for a record that does not have one
+ * and attach it to the record.
+ *
+ * @param[in,out] rec The record.
+ *
+ * @return JALDB_OK on success, or an error code.
+ */
+static enum jaldb_status jaldb_generate_system_metadata(struct jaldb_record *rec)
 {
-	int byte_swap;
+	char *doc = NULL;
+	size_t doc_len = 0;
 	enum jaldb_status ret;
-	size_t buf_size = 0;
-	struct jaldb_record_dbs *rdbs = NULL;
-	uint8_t* buffer = NULL;
-	int db_ret;
-	int update_network_nonce = 0;
-	DBT key;
-	DBT val;
-	DB_TXN *txn;
 
-	if (!ctx || !rec || !local_nonce || *local_nonce) {
-		return JALDB_E_INVAL;
+	ret = jaldb_record_to_system_metadata_doc(rec, NULL, NULL, 0, NULL, NULL, 0, NULL, &doc, &doc_len);
+	if (ret != JALDB_OK) {
+		return ret;
 	}
+	rec->sys_meta = jaldb_create_segment();
+	rec->sys_meta->payload = (uint8_t*)doc;
+	rec->sys_meta->length = doc_len;
+	return JALDB_OK;
+}
+
+/**
+ * Fill in defaults for a record about to be inserted and check that it is
+ * valid.
+ *
+ * Records without system metadata get a document generated from the record
+ * fields, so it is stored with the record and does not have to be built
+ * again every time the record is sent.
+ *
+ * @param[in,out] rec The record to prepare.
+ * @param[in] confirmed Whether or not to mark this record as confirmed.
+ * @param[out] update_network_nonce Set to 1 if the network nonce of \p rec
+ * should be set to the primary key it is stored under.
+ *
+ * @return JALDB_OK if the record may be inserted, or an error code.
+ */
+static enum jaldb_status jaldb_prepare_record_for_insert(struct jaldb_record *rec,
+		int confirmed, int *update_network_nonce)
+{
 	if (!rec->source) {
 		rec->source = jal_strdup("localhost");
 	}
-	if (!rec->network_nonce) {
-		update_network_nonce = 1;
-	}
+	*update_network_nonce = rec->network_nonce ? 0 : 1;
 
-	memset(&key, 0, sizeof(key));
-	memset(&val, 0, sizeof(val));	
-
-	ret = jaldb_record_sanity_check(rec);
+	enum jaldb_status ret = jaldb_record_sanity_check(rec);
 	if (ret != JALDB_OK) {
-		goto out;
+		return ret;
+	}
+
+	if (!rec->sys_meta) {
+		ret = jaldb_generate_system_metadata(rec);
+		if (ret != JALDB_OK) {
+			return ret;
+		}
 	}
 
 	rec->confirmed = confirmed ? 1 : 0;
+	return JALDB_OK;
+}
+
+/**
+ * Store a single record in the primary database as part of \p txn.
+ *
+ * A new primary key is generated if the first one collides with an
+ * existing record.
+ *
+ * @param[in] ctx The context.
+ * @param[in] txn The transaction to insert the record under.
+ * @param[in] rec The record, previously passed to
+ * jaldb_prepare_record_for_insert().
+ * @param[in] update_network_nonce Whether or not to set the network nonce of
+ * \p rec to its primary key.
+ * @param[out] local_nonce On success, the primary key of the record.
+ * @param[out] db_err_out The Berkeley DB error code, if any.
+ *
+ * @return JALDB_OK on success, JALDB_E_DB if Berkeley DB returned an error
+ * (see \p db_err_out), or another error code.
+ */
+static enum jaldb_status jaldb_put_record(jaldb_context *ctx,
+		DB_TXN *txn,
+		struct jaldb_record *rec,
+		int update_network_nonce,
+		char **local_nonce,
+		int *db_err_out)
+{
+	int byte_swap;
+	enum jaldb_status ret;
+	size_t buf_size = 0;
+	struct jaldb_record_dbs *rdbs = NULL;
+	uint8_t *buffer = NULL;
+	int db_ret;
+	DBT key;
+	DBT val;
+
+	memset(&key, 0, sizeof(key));
+	memset(&val, 0, sizeof(val));
+	*db_err_out = 0;
 
 	switch(rec->type) {
 	case JALDB_RTYPE_JOURNAL:
@@ -1273,21 +1498,18 @@ enum jaldb_status jaldb_insert_record(jaldb_context *ctx, struct jaldb_record *r
 		rdbs = ctx->log_dbs;
 		break;
 	default:
-		ret = JALDB_E_INVAL;
-		goto out;
+		return JALDB_E_INVAL;
 	}
 
 	db_ret = rdbs->primary_db->get_byteswapped(rdbs->primary_db, &byte_swap);
 	if (0 != db_ret) {
-		ret = JALDB_E_INVAL;
-		goto out;
+		return JALDB_E_INVAL;
 	}
 
-	while (1) {
-		db_ret = ctx->env->txn_begin(ctx->env, NULL, &txn, 0);
-		if (0 != db_ret) {
-			break;
-		}
+	do {
+		free(key.data);
+		free(buffer);
+		buffer = NULL;
 
 		char *primary_key = jaldb_gen_primary_key(rec->uuid);
 		if (NULL == primary_key) {
@@ -1312,131 +1534,1003 @@ enum jaldb_status jaldb_insert_record(jaldb_context *ctx, struct jaldb_record *r
 		val.size = buf_size;
 
 		db_ret = rdbs->primary_db->put(rdbs->primary_db, txn, &key, &val, DB_NOOVERWRITE);
-		if (0 == db_ret) {
-			db_ret = txn->commit(txn, 0);
-		} else {
-			txn->abort(txn);
-		}
-		if (0 == db_ret) {
-			ret = JALDB_OK;
-			break;
-		}
-		if (DB_LOCK_DEADLOCK == db_ret || DB_KEYEXIST == db_ret) {
-			free(buffer);
-			buffer = NULL;
-			continue;
-		} else {
-			ret = JALDB_E_DB;
-			break;
-		}
+	} while (DB_KEYEXIST == db_ret);
+
+	if (0 != db_ret) {
+		*db_err_out = db_ret;
+		ret = JALDB_E_DB;
+		goto out;
 	}
 
-out:
 	*local_nonce = (char *)key.data;
-	free(val.data);
+	key.data = NULL;
+	ret = JALDB_OK;
+out:
+	free(key.data);
+	free(buffer);
 	return ret;
 }
 
+/**
+ * Wake everything waiting for new records: waiters on this context through
+ * the condition variable, and waiters in other processes by writing to the
+ * notification file they watch.
+ */
+static void jaldb_notify_record_waiters(jaldb_context *ctx)
+{
+	pthread_mutex_lock(&ctx->notify_lock);
+	ctx->insert_seq++;
+	pthread_cond_broadcast(&ctx->notify_cond);
+	pthread_mutex_unlock(&ctx->notify_lock);
 
+	if (ctx->notify_fd >= 0) {
+		// Only the modification event matters. If the write fails, readers
+		// in other processes find the record when their wait times out.
+		ssize_t written = pwrite(ctx->notify_fd, "", 1, 0);
+		(void) written;
+	}
+}
 
-enum jaldb_status jaldb_get_record(jaldb_context *ctx,
-		enum jaldb_rec_type type,
-		char *nonce,
-		struct jaldb_record **recpp)
+/**
+ * Insert previously prepared records in a single transaction, retrying the
+ * whole transaction if Berkeley DB detects a deadlock.
+ */
+static enum jaldb_status jaldb_commit_records(jaldb_context *ctx,
+		struct jaldb_record **recs,
+		const int *update_network_nonce,
+		size_t count,
+		char **local_nonces)
 {
-	struct jaldb_record *rec = NULL;
-	int byte_swap;
 	enum jaldb_status ret;
-	struct jaldb_record_dbs *rdbs = NULL;
 	int db_ret;
-	DB_TXN *txn = NULL;
-	DBT key;
-	DBT val;
+	DB_TXN *txn;
+	size_t i;
 
-	if (!ctx || !nonce || !recpp || *recpp) {
-		return JALDB_E_INVAL;
-	}
+	while (1) {
+		db_ret = ctx->env->txn_begin(ctx->env, NULL, &txn, 0);
+		if (0 != db_ret) {
+			return JALDB_E_DB;
+		}
 
-	memset(&key, 0, sizeof(key));
-	memset(&val, 0, sizeof(val));
+		ret = JALDB_OK;
+		for (i = 0; i < count && JALDB_OK == ret; i++) {
+			ret = jaldb_put_record(ctx, txn, recs[i], update_network_nonce[i],
+					&local_nonces[i], &db_ret);
+		}
+		if (JALDB_OK == ret) {
+			db_ret = txn->commit(txn, 0);
+			if (0 == db_ret) {
+				jaldb_notify_record_waiters(ctx);
+				return JALDB_OK;
+			}
+			ret = JALDB_E_DB;
+		} else {
+			txn->abort(txn);
+		}
 
-	switch(type) {
-	case JALDB_RTYPE_JOURNAL:
-		rdbs = ctx->journal_dbs;
-		break;
-	case JALDB_RTYPE_AUDIT:
-		rdbs = ctx->audit_dbs;
-		break;
-	case JALDB_RTYPE_LOG:
-		rdbs = ctx->log_dbs;
-		break;
-	default:
-		ret = JALDB_E_INVAL;
-		goto out;
+		for (i = 0; i < count; i++) {
+			free(local_nonces[i]);
+			local_nonces[i] = NULL;
+		}
+		if (JALDB_E_DB != ret || DB_LOCK_DEADLOCK != db_ret) {
+			return ret;
+		}
 	}
+}
 
-	if (!rdbs || !rdbs->primary_db) {
-		ret = JALDB_E_INVAL;
-		goto out;
+/**
+ * A record waiting for the group commit thread.
+ */
+struct jaldb_group_commit_entry {
+	struct jaldb_record *rec;	//!< The record to insert.
+	int update_network_nonce;	//!< Whether to set the network nonce to the primary key.
+	char *local_nonce;		//!< The primary key, once committed.
+	enum jaldb_status status;	//!< The result of the insert.
+	int done;			//!< Set once the group commit thread is done with this entry.
+};
+
+struct jaldb_group_commit {
+	pthread_t committer;					//!< The group commit thread.
+	pthread_mutex_t lock;					//!< Protects every other member.
+	pthread_cond_t pending_cond;				//!< Signaled when records are queued or on shutdown.
+	pthread_cond_t done_cond;				//!< Signaled when a batch has been committed.
+	std::list<jaldb_group_commit_entry *> pending;		//!< Records waiting to be committed.
+	size_t max_records;					//!< Maximum number of records per transaction.
+	uint64_t max_delay_usec;				//!< Longest time to wait for a batch to fill.
+	int shutdown;						//!< Set to stop the group commit thread.
+};
+
+/**
+ * Commit a batch from the group commit queue. If the batch as a whole
+ * cannot be committed, each record is retried on its own so that one bad
+ * record does not fail the records of unrelated producers.
+ */
+static void jaldb_group_commit_flush(jaldb_context *ctx,
+		std::vector<jaldb_group_commit_entry *> &batch)
+{
+	size_t count = batch.size();
+	std::vector<struct jaldb_record *> recs(count);
+	std::vector<int> update_network_nonce(count);
+	std::vector<char *> local_nonces(count, (char *)NULL);
+	enum jaldb_status ret;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		recs[i] = batch[i]->rec;
+		update_network_nonce[i] = batch[i]->update_network_nonce;
 	}
 
-	key.flags = DB_DBT_REALLOC;
-	key.size = strlen(nonce)+1;
-	key.data = jal_strdup(nonce);
+	ret = jaldb_commit_records(ctx, &recs[0], &update_network_nonce[0], count,
+			&local_nonces[0]);
+	if (JALDB_OK == ret) {
+		for (i = 0; i < count; i++) {
+			batch[i]->status = JALDB_OK;
+			batch[i]->local_nonce = local_nonces[i];
+		}
+		return;
+	}
 
-	db_ret = rdbs->primary_db->get_byteswapped(rdbs->primary_db, &byte_swap);
-	if (0 != db_ret) {
-		ret = JALDB_E_INVAL;
-		goto out;
+	for (i = 0; i < count; i++) {
+		batch[i]->status = jaldb_commit_records(ctx, &recs[i],
+				&update_network_nonce[i], 1, &batch[i]->local_nonce);
 	}
+}
 
-	val.flags = DB_DBT_REALLOC;
+static void *jaldb_group_commit_thread(void *arg)
+{
+	jaldb_context *ctx = (jaldb_context *)arg;
+	struct jaldb_group_commit *gc = ctx->group_commit;
+	std::vector<jaldb_group_commit_entry *> batch;
 
+	pthread_mutex_lock(&gc->lock);
 	while (1) {
-		db_ret = ctx->env->txn_begin(ctx->env, NULL, &txn, 0);
-		if (0 != db_ret) {
-			ret = JALDB_E_DB;
-			goto out;
+		while (gc->pending.empty() && !gc->shutdown) {
+			pthread_cond_wait(&gc->pending_cond, &gc->lock);
 		}
-
-		db_ret = rdbs->primary_db->get(rdbs->primary_db, txn, &key, &val, DB_DEGREE_2);
-		if (0 == db_ret) {
-			txn->commit(txn, 0);
+		if (gc->pending.empty()) {
 			break;
 		}
 
-		txn->abort(txn);
-		if (DB_LOCK_DEADLOCK == db_ret) {
-			continue;
-		} else if (DB_NOTFOUND == db_ret) {
-			ret = JALDB_E_NOT_FOUND;
-			goto out;
+		// Give other handler threads a chance to add to this batch.
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		uint64_t nsec = deadline.tv_nsec + gc->max_delay_usec * 1000;
+		deadline.tv_sec += nsec / 1000000000;
+		deadline.tv_nsec = nsec % 1000000000;
+		while (gc->pending.size() < gc->max_records && !gc->shutdown) {
+			if (ETIMEDOUT == pthread_cond_timedwait(&gc->pending_cond,
+						&gc->lock, &deadline)) {
+				break;
+			}
 		}
-		// some other error
-		ret = JALDB_E_DB;
-		goto out;
-	}
-	ret = jaldb_deserialize_record(byte_swap, (uint8_t*) val.data, val.size, &rec);
-	if (ret != JALDB_OK) {
-		goto out;
-	}
-	rec->type = type;
-	if (!rec->sys_meta) {
-		rec->sys_meta = jaldb_create_segment();
-		char *doc = NULL;
-		size_t doc_len = 0;
-		ret = jaldb_record_to_system_metadata_doc(rec, NULL, NULL, 0, NULL, NULL, 0, NULL, &doc, &doc_len);
-		if (ret != JALDB_OK) {
-			goto out;
+
+		batch.clear();
+		while (!gc->pending.empty() && batch.size() < gc->max_records) {
+			batch.push_back(gc->pending.front());
+			gc->pending.pop_front();
 		}
-		rec->sys_meta->payload = (uint8_t*)doc;
-		rec->sys_meta->length = doc_len;
+		pthread_mutex_unlock(&gc->lock);
+
+		jaldb_group_commit_flush(ctx, batch);
+
+		pthread_mutex_lock(&gc->lock);
+		for (size_t i = 0; i < batch.size(); i++) {
+			batch[i]->done = 1;
+		}
+		pthread_cond_broadcast(&gc->done_cond);
 	}
+	pthread_mutex_unlock(&gc->lock);
+	return NULL;
+}
 
-	*recpp = rec;
-	rec = NULL;
-	ret = JALDB_OK;
-out:
+enum jaldb_status jaldb_enable_group_commit(jaldb_context *ctx,
+		size_t max_records,
+		uint64_t max_delay_usec)
+{
+	if (!ctx || !ctx->env || ctx->db_read_only || ctx->group_commit
+			|| 0 == max_records) {
+		return JALDB_E_INVAL;
+	}
+
+	struct jaldb_group_commit *gc = new jaldb_group_commit();
+	gc->max_records = max_records;
+	gc->max_delay_usec = max_delay_usec;
+	gc->shutdown = 0;
+	pthread_mutex_init(&gc->lock, NULL);
+	pthread_cond_init(&gc->pending_cond, NULL);
+	pthread_cond_init(&gc->done_cond, NULL);
+
+	ctx->group_commit = gc;
+	if (0 != pthread_create(&gc->committer, NULL, jaldb_group_commit_thread, ctx)) {
+		ctx->group_commit = NULL;
+		pthread_cond_destroy(&gc->done_cond);
+		pthread_cond_destroy(&gc->pending_cond);
+		pthread_mutex_destroy(&gc->lock);
+		delete gc;
+		return JALDB_E_UNKNOWN;
+	}
+	return JALDB_OK;
+}
+
+/**
+ * Stop the group commit thread, after it commits any queued records.
+ */
+static void jaldb_disable_group_commit(jaldb_context *ctx)
+{
+	struct jaldb_group_commit *gc = ctx->group_commit;
+	if (!gc) {
+		return;
+	}
+
+	pthread_mutex_lock(&gc->lock);
+	gc->shutdown = 1;
+	pthread_cond_signal(&gc->pending_cond);
+	pthread_mutex_unlock(&gc->lock);
+	pthread_join(gc->committer, NULL);
+
+	ctx->group_commit = NULL;
+	pthread_cond_destroy(&gc->done_cond);
+	pthread_cond_destroy(&gc->pending_cond);
+	pthread_mutex_destroy(&gc->lock);
+	delete gc;
+}
+
+/**
+ * Hand a prepared record to the group commit thread and wait until the
+ * transaction containing it has been committed.
+ */
+static enum jaldb_status jaldb_group_commit_insert(struct jaldb_group_commit *gc,
+		struct jaldb_record *rec,
+		int update_network_nonce,
+		char **local_nonce)
+{
+	struct jaldb_group_commit_entry entry;
+	entry.rec = rec;
+	entry.update_network_nonce = update_network_nonce;
+	entry.local_nonce = NULL;
+	entry.status = JALDB_E_UNKNOWN;
+	entry.done = 0;
+
+	pthread_mutex_lock(&gc->lock);
+	if (gc->shutdown) {
+		pthread_mutex_unlock(&gc->lock);
+		return JALDB_E_INVAL;
+	}
+	gc->pending.push_back(&entry);
+	if (1 == gc->pending.size() || gc->pending.size() >= gc->max_records) {
+		pthread_cond_signal(&gc->pending_cond);
+	}
+	while (!entry.done) {
+		pthread_cond_wait(&gc->done_cond, &gc->lock);
+	}
+	pthread_mutex_unlock(&gc->lock);
+
+	*local_nonce = entry.local_nonce;
+	return entry.status;
+}
+
+enum jaldb_status jaldb_insert_record(jaldb_context *ctx, struct jaldb_record *rec, int confirmed, char **local_nonce)
+{
+	int update_network_nonce;
+	enum jaldb_status ret;
+
+	if (!ctx || !rec || !local_nonce || *local_nonce) {
+		return JALDB_E_INVAL;
+	}
+
+	ret = jaldb_prepare_record_for_insert(rec, confirmed, &update_network_nonce);
+	if (ret != JALDB_OK) {
+		return ret;
+	}
+
+	if (ctx->group_commit) {
+		return jaldb_group_commit_insert(ctx->group_commit, rec,
+				update_network_nonce, local_nonce);
+	}
+
+	return jaldb_commit_records(ctx, &rec, &update_network_nonce, 1, local_nonce);
+}
+
+enum jaldb_status jaldb_insert_records(jaldb_context *ctx,
+		struct jaldb_record **recs,
+		size_t count,
+		int confirmed,
+		char **local_nonces)
+{
+	enum jaldb_status ret;
+	size_t i;
+
+	if (!ctx || !recs || 0 == count || !local_nonces) {
+		return JALDB_E_INVAL;
+	}
+	for (i = 0; i < count; i++) {
+		if (!recs[i] || local_nonces[i]) {
+			return JALDB_E_INVAL;
+		}
+	}
+
+	std::vector<int> update_network_nonce(count);
+	for (i = 0; i < count; i++) {
+		ret = jaldb_prepare_record_for_insert(recs[i], confirmed,
+				&update_network_nonce[i]);
+		if (ret != JALDB_OK) {
+			return ret;
+		}
+	}
+
+	return jaldb_commit_records(ctx, recs, &update_network_nonce[0], count,
+			local_nonces);
+}
+
+/**
+ * A journal file created ahead of time. Until it is handed out, the file is
+ * kept in the pool's own directory, so one left behind by a process that
+ * did not exit cleanly can't be mistaken for the payload of a record.
+ */
+struct jaldb_pooled_file {
+	char *path;		//!< The path the file is moved to, relative to the journal root.
+	char *pool_path;	//!< The full path of the file while it is in the pool.
+	int fd;			//!< The open file.
+};
+
+struct jaldb_file_pool {
+	pthread_t creator;					//!< The thread that fills the pool.
+	pthread_mutex_t lock;					//!< Protects every other member.
+	pthread_cond_t cond;					//!< Signaled when a file is taken or on shutdown.
+	std::list<jaldb_pooled_file> files;			//!< Files ready to be handed out.
+	size_t size;						//!< Number of files to keep ready.
+	int shutdown;						//!< Set to stop the thread.
+	char *dir;						//!< The directory of this process's pooled files.
+};
+
+// How long to wait before trying again when a file could not be created,
+// e.g. because the disk is full.
+#define JALDB_FILE_POOL_RETRY_SEC 1
+
+/**
+ * Create a file for the pool. The directories of the path it will be moved
+ * to are created as well, so handing it out is a single rename.
+ */
+static enum jaldb_status jaldb_create_pooled_file(jaldb_context *ctx,
+		struct jaldb_file_pool *pool, jaldb_pooled_file *file)
+{
+	enum jaldb_status ret;
+	char uuid_str[UUID_STR_LEN];
+	char rel_path[JALDB_REL_PATH_MAX];
+	char *full_path = NULL;
+	uuid_t uuid;
+
+	uuid_generate(uuid);
+	uuid_unparse(uuid, uuid_str);
+	ret = jaldb_build_rel_path(rel_path, sizeof(rel_path), ctx->journal_fanout,
+			uuid_str, JALDB_RTYPE_JOURNAL, JALDB_DTYPE_PAYLOAD);
+	if (JALDB_OK != ret) {
+		return ret;
+	}
+
+	ret = JALDB_E_INTERNAL_ERROR;
+	if (-1 == jal_asprintf(&full_path, "%s%s", ctx->journal_root, rel_path) ||
+			JAL_OK != jal_create_dirs(full_path)) {
+		goto out;
+	}
+	if (-1 == jal_asprintf(&file->pool_path, "%s%s", pool->dir, strrchr(rel_path, '/') + 1)) {
+		file->pool_path = NULL;
+		goto out;
+	}
+	file->fd = open(file->pool_path, O_RDWR | O_CREAT | O_EXCL, S_IRUSR|S_IWUSR);
+	if (-1 == file->fd) {
+		free(file->pool_path);
+		file->pool_path = NULL;
+		goto out;
+	}
+	file->path = jal_strdup(rel_path);
+	ret = JALDB_OK;
+out:
+	free(full_path);
+	return ret;
+}
+
+/**
+ * Move a file taken from the pool to its path under the journal root.
+ */
+static enum jaldb_status jaldb_place_pooled_file(jaldb_context *ctx, jaldb_pooled_file *file)
+{
+	enum jaldb_status ret = JALDB_E_INTERNAL_ERROR;
+	char *full_path = NULL;
+
+	if (-1 == jal_asprintf(&full_path, "%s%s", ctx->journal_root, file->path)) {
+		return JALDB_E_NO_MEM;
+	}
+	// The directories were created along with the file, but may have
+	// been removed since.
+	if (0 != rename(file->pool_path, full_path) &&
+			(ENOENT != errno || JAL_OK != jal_create_dirs(full_path) ||
+			 0 != rename(file->pool_path, full_path))) {
+		goto out;
+	}
+	ret = JALDB_OK;
+out:
+	free(full_path);
+	return ret;
+}
+
+/**
+ * Remove a file that is still in the pool.
+ */
+static void jaldb_discard_pooled_file(jaldb_pooled_file *file)
+{
+	close(file->fd);
+	unlink(file->pool_path);
+	free(file->pool_path);
+	free(file->path);
+}
+
+/**
+ * Remove a directory of pooled files and the files in it.
+ */
+static void jaldb_remove_pool_dir(const char *dir_path)
+{
+	DIR *dir = opendir(dir_path);
+	struct dirent *entry;
+	if (!dir) {
+		return;
+	}
+	while (NULL != (entry = readdir(dir))) {
+		char *path = NULL;
+		if (0 == strcmp(".", entry->d_name) || 0 == strcmp("..", entry->d_name)) {
+			continue;
+		}
+		if (-1 != jal_asprintf(&path, "%s%s", dir_path, entry->d_name)) {
+			unlink(path);
+		}
+		free(path);
+	}
+	closedir(dir);
+	rmdir(dir_path);
+}
+
+/**
+ * Remove the pooled journal files left by processes that did not exit
+ * cleanly. Each process keeps its pool in a directory named by its PID, so
+ * the pools of processes that are still running are left alone.
+ */
+static void jaldb_remove_stale_journal_pools(const char *journal_root)
+{
+	char *pools_path = NULL;
+	DIR *dir = NULL;
+	struct dirent *entry;
+
+	if (-1 == jal_asprintf(&pools_path, "%s%s", journal_root, JALDB_JOURNAL_POOL_DIR_NAME)) {
+		return;
+	}
+	dir = opendir(pools_path);
+	if (!dir) {
+		goto out;
+	}
+	while (NULL != (entry = readdir(dir))) {
+		char *end = NULL;
+		char *pool_path = NULL;
+		long pid = strtol(entry->d_name, &end, 10);
+		if (end == entry->d_name || '\0' != *end || 0 >= pid) {
+			continue;
+		}
+		if (getpid() == (pid_t) pid || 0 == kill((pid_t) pid, 0) || ESRCH != errno) {
+			continue;
+		}
+		if (-1 != jal_asprintf(&pool_path, "%s%s/", pools_path, entry->d_name)) {
+			jaldb_remove_pool_dir(pool_path);
+		}
+		free(pool_path);
+	}
+	closedir(dir);
+out:
+	free(pools_path);
+}
+
+static void *jaldb_file_pool_thread(void *arg)
+{
+	jaldb_context *ctx = (jaldb_context *)arg;
+	struct jaldb_file_pool *pool = ctx->journal_pool;
+
+	pthread_mutex_lock(&pool->lock);
+	while (1) {
+		while (pool->files.size() >= pool->size && !pool->shutdown) {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		}
+		if (pool->shutdown) {
+			break;
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		jaldb_pooled_file file;
+		file.path = NULL;
+		file.pool_path = NULL;
+		file.fd = -1;
+		enum jaldb_status ret = jaldb_create_pooled_file(ctx, pool, &file);
+
+		pthread_mutex_lock(&pool->lock);
+		if (JALDB_OK == ret) {
+			pool->files.push_back(file);
+			continue;
+		}
+		// Callers create their own files in the meantime.
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += JALDB_FILE_POOL_RETRY_SEC;
+		while (!pool->shutdown && ETIMEDOUT != pthread_cond_timedwait(&pool->cond,
+					&pool->lock, &deadline)) {
+			// Keep waiting until the deadline.
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+enum jaldb_status jaldb_set_journal_layout(jaldb_context *ctx,
+		int fanout,
+		size_t pool_size)
+{
+	if (!ctx || !ctx->env || ctx->db_read_only || ctx->journal_pool
+			|| fanout < 1 || fanout > JALDB_FANOUT_MAX) {
+		return JALDB_E_INVAL;
+	}
+
+	ctx->journal_fanout = fanout;
+	if (0 == pool_size) {
+		return JALDB_OK;
+	}
+
+	struct jaldb_file_pool *pool = new jaldb_file_pool();
+	pool->size = pool_size;
+	pool->shutdown = 0;
+	pool->dir = NULL;
+	if (-1 == jal_asprintf(&pool->dir, "%s%s%d/", ctx->journal_root,
+				JALDB_JOURNAL_POOL_DIR_NAME, (int) getpid()) ||
+			JAL_OK != jal_create_dirs(pool->dir)) {
+		free(pool->dir);
+		delete pool;
+		return JALDB_E_UNKNOWN;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+
+	ctx->journal_pool = pool;
+	if (0 != pthread_create(&pool->creator, NULL, jaldb_file_pool_thread, ctx)) {
+		ctx->journal_pool = NULL;
+		pthread_cond_destroy(&pool->cond);
+		pthread_mutex_destroy(&pool->lock);
+		rmdir(pool->dir);
+		free(pool->dir);
+		delete pool;
+		return JALDB_E_UNKNOWN;
+	}
+	return JALDB_OK;
+}
+
+/**
+ * Stop the thread that fills the pool, and remove the files that were never
+ * handed out.
+ */
+static void jaldb_destroy_journal_pool(jaldb_context *ctx)
+{
+	struct jaldb_file_pool *pool = ctx->journal_pool;
+	if (!pool) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = 1;
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+	pthread_join(pool->creator, NULL);
+
+	for (std::list<jaldb_pooled_file>::iterator it = pool->files.begin();
+			it != pool->files.end(); ++it) {
+		jaldb_discard_pooled_file(&(*it));
+	}
+	rmdir(pool->dir);
+
+	ctx->journal_pool = NULL;
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->dir);
+	delete pool;
+}
+
+enum jaldb_status jaldb_create_journal_file(jaldb_context *ctx,
+		uint64_t expected_len,
+		char **path,
+		int *fd)
+{
+	enum jaldb_status ret;
+
+	if (!ctx || !ctx->journal_root || !path || *path || !fd) {
+		return JALDB_E_INVAL;
+	}
+
+	struct jaldb_file_pool *pool = ctx->journal_pool;
+	int taken = 0;
+	if (pool) {
+		jaldb_pooled_file file;
+		pthread_mutex_lock(&pool->lock);
+		if (!pool->files.empty()) {
+			file = pool->files.front();
+			pool->files.pop_front();
+			taken = 1;
+		}
+		pthread_cond_signal(&pool->cond);
+		pthread_mutex_unlock(&pool->lock);
+
+		if (taken && JALDB_OK != jaldb_place_pooled_file(ctx, &file)) {
+			// Create a new file instead.
+			jaldb_discard_pooled_file(&file);
+			taken = 0;
+		} else if (taken) {
+			*path = file.path;
+			*fd = file.fd;
+			free(file.pool_path);
+		}
+	}
+
+	if (!taken) {
+		uuid_t uuid;
+		uuid_generate(uuid);
+		ret = jaldb_create_file_with_fanout(ctx->journal_root, ctx->journal_fanout,
+				path, fd, uuid, JALDB_RTYPE_JOURNAL, JALDB_DTYPE_PAYLOAD);
+		if (JALDB_OK != ret) {
+			return ret;
+		}
+	}
+
+#ifdef FALLOC_FL_KEEP_SIZE
+	if (0 < expected_len) {
+		// Not all file systems support this, and the write itself
+		// reports a full disk, so the result is ignored.
+		(void) fallocate(*fd, FALLOC_FL_KEEP_SIZE, 0, (off_t) expected_len);
+	}
+#else
+	(void) expected_len;
+#endif
+	return JALDB_OK;
+}
+
+struct jaldb_record_waiter {
+	jaldb_context *ctx;	//!< The context records are inserted through.
+	uint64_t seen_seq;	//!< The value of insert_seq at the last wakeup.
+	int inotify_fd;		//!< Watches the notification file, -1 if not available.
+};
+
+jaldb_record_waiter *jaldb_record_waiter_create(jaldb_context *ctx)
+{
+	if (!ctx || !ctx->env || !ctx->notify_path) {
+		return NULL;
+	}
+
+	jaldb_record_waiter *waiter = (jaldb_record_waiter *)jal_calloc(1, sizeof(*waiter));
+	waiter->ctx = ctx;
+	waiter->inotify_fd = -1;
+
+	pthread_mutex_lock(&ctx->notify_lock);
+	waiter->seen_seq = ctx->insert_seq;
+	pthread_mutex_unlock(&ctx->notify_lock);
+
+#ifdef __linux__
+	// Inserts through this context also write the notification file, so
+	// the watch covers both. If this process could not open the file for
+	// writing, its own inserts are still seen by the check made before each
+	// wait, which is all the publisher needs.
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd >= 0 && 0 > inotify_add_watch(fd, ctx->notify_path, IN_MODIFY)) {
+		close(fd);
+		fd = -1;
+	}
+	waiter->inotify_fd = fd;
+#endif
+	return waiter;
+}
+
+void jaldb_record_waiter_destroy(jaldb_record_waiter **waiter)
+{
+	if (!waiter || !*waiter) {
+		return;
+	}
+	if ((*waiter)->inotify_fd >= 0) {
+		close((*waiter)->inotify_fd);
+	}
+	free(*waiter);
+	*waiter = NULL;
+}
+
+enum jaldb_status jaldb_wait_for_record(jaldb_record_waiter *waiter,
+		long timeout_ms)
+{
+	if (!waiter || timeout_ms < 0) {
+		return JALDB_E_INVAL;
+	}
+	jaldb_context *ctx = waiter->ctx;
+	int notified = 0;
+
+	if (waiter->inotify_fd >= 0) {
+		struct pollfd pfd;
+		pfd.fd = waiter->inotify_fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		pthread_mutex_lock(&ctx->notify_lock);
+		notified = (waiter->seen_seq != ctx->insert_seq);
+		pthread_mutex_unlock(&ctx->notify_lock);
+
+		int poll_ms = (timeout_ms > INT_MAX) ? INT_MAX : (int)timeout_ms;
+		if (notified || 0 < poll(&pfd, 1, poll_ms)) {
+			// Drain every queued event, one wakeup covers all of them.
+			char buf[4096];
+			while (0 < read(waiter->inotify_fd, buf, sizeof(buf))) {
+				continue;
+			}
+			notified = 1;
+		}
+
+		pthread_mutex_lock(&ctx->notify_lock);
+		waiter->seen_seq = ctx->insert_seq;
+		pthread_mutex_unlock(&ctx->notify_lock);
+		return notified ? JALDB_OK : JALDB_E_NOT_FOUND;
+	}
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	uint64_t nsec = deadline.tv_nsec + (uint64_t)(timeout_ms % 1000) * 1000000;
+	deadline.tv_sec += timeout_ms / 1000 + nsec / 1000000000;
+	deadline.tv_nsec = nsec % 1000000000;
+
+	pthread_mutex_lock(&ctx->notify_lock);
+	while (waiter->seen_seq == ctx->insert_seq) {
+		if (ETIMEDOUT == pthread_cond_timedwait(&ctx->notify_cond,
+					&ctx->notify_lock, &deadline)) {
+			break;
+		}
+	}
+	notified = (waiter->seen_seq != ctx->insert_seq);
+	waiter->seen_seq = ctx->insert_seq;
+	pthread_mutex_unlock(&ctx->notify_lock);
+
+	return notified ? JALDB_OK : JALDB_E_NOT_FOUND;
+}
+
+/**
+ * Store a system metadata document generated for a record that was inserted
+ * without one.
+ *
+ * The record is read again under a write lock and left alone if another
+ * thread stored a document in the meantime. The flags of the stored record
+ * are carried over as they are, since not all combinations survive a trip
+ * through struct jaldb_record.
+ *
+ * @param[in] ctx The context.
+ * @param[in] rdbs The databases the record is stored in.
+ * @param[in] byte_swap Whether or not the primary database is byte swapped.
+ * @param[in] nonce The primary key of the record.
+ * @param[in] sys_meta The system metadata document.
+ *
+ * @return JALDB_OK on success, or an error code.
+ */
+static enum jaldb_status jaldb_store_system_metadata(jaldb_context *ctx,
+		struct jaldb_record_dbs *rdbs,
+		int byte_swap,
+		const char *nonce,
+		const struct jaldb_segment *sys_meta)
+{
+	enum jaldb_status ret = JALDB_E_DB;
+	struct jaldb_record *stored = NULL;
+	struct jaldb_record_view view;
+	struct jaldb_serialize_record_headers *headers;
+	uint8_t *buffer = NULL;
+	size_t buf_size = 0;
+	DB_TXN *txn = NULL;
+	int db_ret;
+	DBT key;
+	DBT val;
+
+	memset(&key, 0, sizeof(key));
+	memset(&val, 0, sizeof(val));
+
+	key.flags = DB_DBT_REALLOC;
+	key.size = strlen(nonce) + 1;
+	key.data = jal_strdup(nonce);
+	val.flags = DB_DBT_REALLOC;
+
+	while (1) {
+		free(buffer);
+		buffer = NULL;
+		jaldb_destroy_record(&stored);
+
+		db_ret = ctx->env->txn_begin(ctx->env, NULL, &txn, 0);
+		if (0 != db_ret) {
+			ret = JALDB_E_DB;
+			goto out;
+		}
+
+		db_ret = rdbs->primary_db->get(rdbs->primary_db, txn, &key, &val, DB_RMW);
+		if (0 == db_ret) {
+			ret = jaldb_record_view_init(&view, byte_swap, (uint8_t*) val.data, val.size);
+			if (ret != JALDB_OK || (view.flags & JALDB_RFLAGS_HAVE_SYS_META)) {
+				txn->abort(txn);
+				goto out;
+			}
+			ret = jaldb_record_from_view(&view, &stored);
+			if (ret != JALDB_OK) {
+				txn->abort(txn);
+				goto out;
+			}
+
+			stored->sys_meta = jaldb_create_segment();
+			stored->sys_meta->payload = (uint8_t*) jal_memdup((char*) sys_meta->payload, sys_meta->length);
+			stored->sys_meta->length = sys_meta->length;
+
+			ret = jaldb_serialize_record(byte_swap, stored, &buffer, &buf_size);
+			if (ret != JALDB_OK) {
+				txn->abort(txn);
+				goto out;
+			}
+			headers = (struct jaldb_serialize_record_headers *) buffer;
+			headers->flags |= ((struct jaldb_serialize_record_headers *) val.data)->flags;
+
+			free(val.data);
+			val.data = buffer;
+			val.size = buf_size;
+			buffer = NULL;
+
+			db_ret = rdbs->primary_db->put(rdbs->primary_db, txn, &key, &val, 0);
+			if (0 == db_ret) {
+				db_ret = txn->commit(txn, 0);
+				ret = (0 == db_ret) ? JALDB_OK : JALDB_E_DB;
+				goto out;
+			}
+		}
+
+		txn->abort(txn);
+		if (DB_LOCK_DEADLOCK == db_ret) {
+			continue;
+		}
+		ret = (DB_NOTFOUND == db_ret) ? JALDB_E_NOT_FOUND : JALDB_E_DB;
+		goto out;
+	}
+
+out:
+	jaldb_destroy_record(&stored);
+	free(buffer);
+	free(key.data);
+	free(val.data);
+	return ret;
+}
+
+/**
+ * Make sure a record read from the database has system metadata.
+ *
+ * Records inserted without system metadata by older versions get a document
+ * generated from the record fields. The document is written back to the
+ * database so it is only generated once; this is best effort, a record that
+ * cannot be updated is still returned with the generated document.
+ *
+ * @param[in] ctx The context.
+ * @param[in] rdbs The databases the record is stored in.
+ * @param[in] byte_swap Whether or not the primary database is byte swapped.
+ * @param[in] nonce The primary key of the record.
+ * @param[in,out] rec The record.
+ *
+ * @return JALDB_OK on success, or an error code.
+ */
+static enum jaldb_status jaldb_load_system_metadata(jaldb_context *ctx,
+		struct jaldb_record_dbs *rdbs,
+		int byte_swap,
+		const char *nonce,
+		struct jaldb_record *rec)
+{
+	enum jaldb_status ret;
+
+	if (rec->sys_meta) {
+		return JALDB_OK;
+	}
+	ret = jaldb_generate_system_metadata(rec);
+	if (ret != JALDB_OK) {
+		return ret;
+	}
+	if (!ctx->db_read_only) {
+		jaldb_store_system_metadata(ctx, rdbs, byte_swap, nonce, rec->sys_meta);
+	}
+	return JALDB_OK;
+}
+
+enum jaldb_status jaldb_get_record(jaldb_context *ctx,
+		enum jaldb_rec_type type,
+		char *nonce,
+		struct jaldb_record **recpp)
+{
+	struct jaldb_record *rec = NULL;
+	int byte_swap;
+	enum jaldb_status ret;
+	struct jaldb_record_dbs *rdbs = NULL;
+	int db_ret;
+	DB_TXN *txn = NULL;
+	DBT key;
+	DBT val;
+
+	if (!ctx || !nonce || !recpp || *recpp) {
+		return JALDB_E_INVAL;
+	}
+
+	memset(&key, 0, sizeof(key));
+	memset(&val, 0, sizeof(val));
+
+	switch(type) {
+	case JALDB_RTYPE_JOURNAL:
+		rdbs = ctx->journal_dbs;
+		break;
+	case JALDB_RTYPE_AUDIT:
+		rdbs = ctx->audit_dbs;
+		break;
+	case JALDB_RTYPE_LOG:
+		rdbs = ctx->log_dbs;
+		break;
+	default:
+		ret = JALDB_E_INVAL;
+		goto out;
+	}
+
+	if (!rdbs || !rdbs->primary_db) {
+		ret = JALDB_E_INVAL;
+		goto out;
+	}
+
+	key.flags = DB_DBT_REALLOC;
+	key.size = strlen(nonce)+1;
+	key.data = jal_strdup(nonce);
+
+	db_ret = rdbs->primary_db->get_byteswapped(rdbs->primary_db, &byte_swap);
+	if (0 != db_ret) {
+		ret = JALDB_E_INVAL;
+		goto out;
+	}
+
+	val.flags = DB_DBT_REALLOC;
+
+	while (1) {
+		db_ret = ctx->env->txn_begin(ctx->env, NULL, &txn, 0);
+		if (0 != db_ret) {
+			ret = JALDB_E_DB;
+			goto out;
+		}
+
+		db_ret = rdbs->primary_db->get(rdbs->primary_db, txn, &key, &val, DB_DEGREE_2);
+		if (0 == db_ret) {
+			txn->commit(txn, 0);
+			break;
+		}
+
+		txn->abort(txn);
+		if (DB_LOCK_DEADLOCK == db_ret) {
+			continue;
+		} else if (DB_NOTFOUND == db_ret) {
+			ret = JALDB_E_NOT_FOUND;
+			goto out;
+		}
+		// some other error
+		ret = JALDB_E_DB;
+		goto out;
+	}
+	ret = jaldb_deserialize_record(byte_swap, (uint8_t*) val.data, val.size, &rec);
+	if (ret != JALDB_OK) {
+		goto out;
+	}
+	rec->type = type;
+	ret = jaldb_load_system_metadata(ctx, rdbs, byte_swap, nonce, rec);
+	if (ret != JALDB_OK) {
+		goto out;
+	}
+
+	*recpp = rec;
+	rec = NULL;
+	ret = JALDB_OK;
+out:
 	jaldb_destroy_record(&rec);
 	free(key.data);
 	free(val.data);
@@ -1529,16 +2623,9 @@ enum jaldb_status jaldb_get_record_by_uuid(jaldb_context *ctx,
 		goto out;
 	}
 	rec->type = type;
-	if (!rec->sys_meta) {
-		rec->sys_meta = jaldb_create_segment();
-		char *doc = NULL;
-		size_t doc_len = 0;
-		ret = jaldb_record_to_system_metadata_doc(rec, NULL, NULL, 0, NULL, NULL, 0, NULL, &doc, &doc_len);
-		if (ret != JALDB_OK) {
-			goto out;
-		}
-		rec->sys_meta->payload = (uint8_t*)doc;
-		rec->sys_meta->length = doc_len;
+	ret = jaldb_load_system_metadata(ctx, rdbs, byte_swap, (char*) pkey.data, rec);
+	if (ret != JALDB_OK) {
+		goto out;
 	}
 
 	*nonce = (char*)pkey.data;
@@ -1792,7 +2879,7 @@ enum jaldb_status jaldb_next_unsynced_record(
 	enum jaldb_status ret = JALDB_E_INVAL;
 	struct jaldb_record *rec = NULL;
 	int byte_swap;
-	struct jaldb_serialize_record_headers *headers = NULL;
+	struct jaldb_record_view view;
 	struct jaldb_record_dbs *rdbs = NULL;
 	int db_ret;
 	DBT skey;
@@ -1832,11 +2919,7 @@ enum jaldb_status jaldb_next_unsynced_record(
 	*((uint32_t*)(skey.data)) = JALDB_RFLAGS_CONFIRMED;
 	skey.flags = DB_DBT_REALLOC;
 
-	val.flags = DB_DBT_REALLOC | DB_DBT_PARTIAL;
-	val.dlen = sizeof(*headers);
-	val.size = sizeof(*headers);
-	val.doff = 0;
-	val.data = jal_malloc(val.size);
+	val.flags = DB_DBT_REALLOC;
 
 	pkey.flags = DB_DBT_REALLOC;
 
@@ -1847,11 +2930,7 @@ enum jaldb_status jaldb_next_unsynced_record(
 	}
 
 	while (1) {
-		
-		val.flags = DB_DBT_REALLOC | DB_DBT_PARTIAL;
 		db_ret = rdbs->record_sent_db->pget(rdbs->record_sent_db, NULL, &skey, &pkey, &val, 0);
-		val.flags = DB_DBT_REALLOC;
-		
 		if (DB_NOTFOUND == db_ret) {
 			ret = JALDB_E_NOT_FOUND;
 			goto out;
@@ -1863,44 +2942,21 @@ enum jaldb_status jaldb_next_unsynced_record(
 			goto out;
 		}
 
-		headers = ((struct jaldb_serialize_record_headers *)val.data);
-
-		val.flags = DB_DBT_REALLOC;
-		val.dlen = 0;
-		db_ret = rdbs->record_sent_db->pget(rdbs->record_sent_db, NULL, &skey, &pkey, &val, 0);
-		if (DB_LOCK_DEADLOCK == db_ret) {
-			continue;
-		}
-
-		if (0 != db_ret) {
-			JALDB_DB_ERR(rdbs->primary_db, db_ret);
-			ret = JALDB_E_DB;
-			goto out;
-		}
-
 		break;
 	}
 
-	if (db_ret != 0) {
-		ret = JALDB_E_DB;
+	ret = jaldb_record_view_init(&view, byte_swap, (uint8_t*) val.data, val.size);
+	if (ret != JALDB_OK) {
 		goto out;
 	}
-
-	ret = jaldb_deserialize_record(byte_swap, (uint8_t*) val.data, val.size, &rec);
+	ret = jaldb_record_from_view(&view, &rec);
 	if (ret != JALDB_OK) {
 		goto out;
 	}
 	rec->type = type;
-	if (!rec->sys_meta) {
-		rec->sys_meta = jaldb_create_segment();
-		char *doc = NULL;
-		size_t doc_len = 0;
-		ret = jaldb_record_to_system_metadata_doc(rec, NULL, NULL, 0, NULL, NULL, 0, NULL, &doc, &doc_len);
-		if (ret != JALDB_OK) {
-			goto out;
-		}
-		rec->sys_meta->payload = (uint8_t*)doc;
-		rec->sys_meta->length = doc_len;
+	ret = jaldb_load_system_metadata(ctx, rdbs, byte_swap, (char*) pkey.data, rec);
+	if (ret != JALDB_OK) {
+		goto out;
 	}
 
 	*network_nonce = jal_strdup(rec->network_nonce);
@@ -1930,10 +2986,8 @@ enum jaldb_status jaldb_next_chronological_record(
 {
 	enum jaldb_status ret = JALDB_E_INVAL;
 	struct jaldb_record *rec = NULL;
-	struct tm search_time, current_time;
-	int search_microseconds, cur_microseconds;
-	memset(&search_time,0,sizeof(search_time));
-	memset(&current_time,0,sizeof(current_time));
+	struct jaldb_record_view view;
+	uint8_t search_key[JALDB_DATETIME_KEY_LEN];
 	int byte_swap;
 	struct jaldb_record_dbs *rdbs = NULL;
 	int db_ret;
@@ -1947,16 +3001,17 @@ enum jaldb_status jaldb_next_chronological_record(
 	memset(&pkey, 0, sizeof(pkey));
 	memset(&val, 0, sizeof(val));
 	key.flags = DB_DBT_REALLOC;
-	val.flags = DB_DBT_REALLOC;
-
-	char *end_timestamp = strptime(*timestamp, "%Y-%m-%dT%H:%M:%S", &search_time);
+	pkey.flags = DB_DBT_REALLOC;
+	// Records already seen at this timestamp are skipped on the key alone,
+	// the record itself is only read once a match is found.
+	val.flags = DB_DBT_REALLOC | DB_DBT_PARTIAL;
 
-	if (!end_timestamp) {
+	if (!timestamp || !*timestamp) {
 		ret = JALDB_E_INVAL;
 		goto out;
 	}
 
-	if (!sscanf(end_timestamp,".%d-%*d:%*d",&search_microseconds)) {
+	if (JALDB_OK != jaldb_datetime_to_key(*timestamp, strlen(*timestamp), search_key)) {
 		ret = JALDB_E_INVAL;
 		goto out;
 	}
@@ -1989,8 +3044,9 @@ enum jaldb_status jaldb_next_chronological_record(
 		goto out;
 	}
 
-	key.size = strlen(*timestamp) + 1;
-	key.data = jal_strdup(*timestamp);
+	key.size = JALDB_DATETIME_KEY_LEN;
+	key.data = jal_malloc(JALDB_DATETIME_KEY_LEN);
+	memcpy(key.data, search_key, JALDB_DATETIME_KEY_LEN);
 
 	db_ret = rdbs->nonce_timestamp_db->get_byteswapped(rdbs->nonce_timestamp_db, &byte_swap);
 	if (0 != db_ret) {
@@ -2014,22 +3070,10 @@ enum jaldb_status jaldb_next_chronological_record(
 		goto out;
 	}
 
-	end_timestamp = strptime((char*) key.data, "%Y-%m-%dT%H:%M:%S", &current_time);
-
-	if (!end_timestamp) {
-		ret = JALDB_E_INVAL;
-		goto out;
-	}
-
-	if (!sscanf(end_timestamp,".%d-%*d:%*d",&cur_microseconds)) {
-		ret = JALDB_E_INVAL;
-		goto out;
-	}
-
 	nonce_string = (char *)pkey.data;
 
-	while (difftime(mktime(&search_time), mktime(&current_time)) == 0 &&
-			search_microseconds == cur_microseconds) {
+	while (JALDB_DATETIME_KEY_LEN == key.size &&
+			0 == memcmp(key.data, search_key, JALDB_DATETIME_KEY_LEN)) {
 		// Check to see if we already got a record at this time
 		if (seen_records->count(nonce_string) == 0) {
 			//Haven't seen it
@@ -2047,42 +3091,50 @@ enum jaldb_status jaldb_next_chronological_record(
 			}
 			nonce_string = (char *)pkey.data;
 		}
-		end_timestamp = strptime((char*) key.data, "%Y-%m-%dT%H:%M:%S", &current_time);
-		if (!end_timestamp) {
-			ret = JALDB_E_INVAL;
-			goto out;
-		}
-		if (!sscanf(end_timestamp,".%d-%*d:%*d",&cur_microseconds)) {
-			ret = JALDB_E_INVAL;
-			goto out;
-		}
 	}
 
-	if (difftime(mktime(&search_time), mktime(&current_time)) != 0 ||
-			search_microseconds != cur_microseconds) {
+	if (JALDB_DATETIME_KEY_LEN != key.size ||
+			0 != memcmp(key.data, search_key, JALDB_DATETIME_KEY_LEN)) {
+		char *new_timestamp = NULL;
+		ret = jaldb_key_to_datetime((uint8_t*) key.data, key.size, &new_timestamp);
+		if (JALDB_OK != ret) {
+			goto out;
+		}
 		free(*timestamp);
-		*timestamp = (char*)key.data;
-		key.data = NULL;
+		*timestamp = new_timestamp;
 		seen_records->clear();
 		seen_records->insert(nonce_string);
 	}
 
-	ret = jaldb_deserialize_record(byte_swap, (uint8_t*) val.data, val.size, &rec);
+	val.flags = DB_DBT_REALLOC;
+	db_ret = cursor->c_pget(cursor, &key, &pkey, &val, DB_CURRENT);
+	if (0 != db_ret) {
+		if (DB_NOTFOUND == db_ret || DB_KEYEMPTY == db_ret) {
+			ret = JALDB_E_NOT_FOUND;
+		} else {
+			JALDB_DB_ERR(rdbs->nonce_timestamp_db, db_ret);
+		}
+		goto out;
+	}
+
+	ret = jaldb_record_view_init(&view, byte_swap, (uint8_t*) val.data, val.size);
 	if (ret != JALDB_OK) {
 		goto out;
 	}
+	ret = jaldb_record_from_view(&view, &rec);
+	if (ret != JALDB_OK) {
+		goto out;
+	}
+
+	// The cursor still holds a lock on the record, which has to be released
+	// before the system metadata may be stored with it.
+	cursor->c_close(cursor);
+	cursor = NULL;
 
 	rec->type = type;
-	if (!rec->sys_meta) {
-		rec->sys_meta = jaldb_create_segment();
-		char *doc = NULL;
-		size_t doc_len = 0;
-		ret = jaldb_record_to_system_metadata_doc(rec, NULL, NULL, 0, NULL, NULL, 0, NULL, &doc, &doc_len);
-		if (ret != JALDB_OK) {
-			goto out;
-		}
-		rec->sys_meta->payload = (uint8_t*)doc;
-		rec->sys_meta->length = doc_len;
+	ret = jaldb_load_system_metadata(ctx, rdbs, byte_swap, (char*) pkey.data, rec);
+	if (ret != JALDB_OK) {
+		goto out;
 	}
 
 	*network_nonce = jal_strdup(rec->network_nonce);
@@ -2101,6 +3153,7 @@ out:
 	}
 
 	free(key.data);
+	free(pkey.data);
 	free(val.data);
 	jaldb_destroy_record(&rec);
 	return ret;
@@ -61,8 +61,10 @@ jaldb_context *jaldb_context_create();
  * @param[in] db_rdonly_flag A flag which indicates whether DB_RDONLY should
  * be passed to the DB open function.
  *
- * @return JAL_OK if the function succeeds or a JAL error code if the function
- * fails.
+ * @return JAL_OK if the function succeeds, JALDB_E_LAYOUT_VERSION_UNKNOWN if
+ * the DB holds records in an older layout and must first be converted with
+ * jaldb_upgrade (see jaldb_upgrade_db_layout()), or another JAL error code if
+ * the function fails.
  */
 enum jaldb_status jaldb_context_init(
 	jaldb_context *ctx,
@@ -203,7 +205,7 @@ enum jaldb_status jaldb_next_unsynced_record(
  * @param[out] nonce The nonce for the returned record.
  * @param[out] rec The record from the DB.
  * @param[in/out] timestamp The timestamp of the last sent record.
- * 		Overwritten to the new timestamp when a record is returned
+ * 		Overwritten to the new timestamp (in UTC) when a record is returned
  * 		Calling with a timestamp less than a previous timestamp
  * 		may result in records being sent multiple times.
  *
@@ -227,6 +229,153 @@ enum jaldb_status jaldb_next_chronological_record(
  */
 enum jaldb_status jaldb_insert_record(jaldb_context *ctx, struct jaldb_record *rec, int confirmed, char **local_nonce);
 
+/**
+ * Insert several JALoP records in a single transaction. Either all of the
+ * records are inserted, or none are.
+ * @param[in] ctx the DB context.
+ * @param[in] recs The records to insert.
+ * @param[in] count The number of records in \p recs.
+ * @param[in] confirmed Whether or not to mark these records as confirmed.
+ * @param[out] local_nonces An array of \p count pointers, all NULL. On
+ * success, each will be set to the nonce assigned to the corresponding
+ * record by the DB.
+ *
+ * @return JALDB_OK on success, or an error code.
+ */
+enum jaldb_status jaldb_insert_records(jaldb_context *ctx,
+		struct jaldb_record **recs,
+		size_t count,
+		int confirmed,
+		char **local_nonces);
+
+/**
+ * Enable group commit for this context.
+ *
+ * Once enabled, jaldb_insert_record() queues the record and blocks until a
+ * dedicated thread has committed it. That thread commits up to
+ * \p max_records queued records in one transaction, waiting at most
+ * \p max_delay_usec microseconds for a batch to fill, so concurrent callers
+ * share the cost of each commit. Group commit stays enabled until
+ * jaldb_context_destroy(), which commits any records still queued.
+ *
+ * @param[in] ctx The context, which must be initialized and writable.
+ * @param[in] max_records The most records to commit in one transaction.
+ * @param[in] max_delay_usec The longest time a record waits for others to
+ * join its batch.
+ *
+ * @return JALDB_OK on success, JALDB_E_INVAL if the context is not
+ * initialized, is read only, already has group commit enabled, or
+ * \p max_records is 0, or JALDB_E_UNKNOWN if the thread could not be started.
+ */
+enum jaldb_status jaldb_enable_group_commit(jaldb_context *ctx,
+		size_t max_records,
+		uint64_t max_delay_usec);
+
+/**
+ * The number of directory levels journal files are put in by default. Two
+ * levels of 256 directories keep each directory small even for stores that
+ * hold tens of millions of journal records.
+ */
+#define JALDB_JOURNAL_FANOUT_DEFAULT 2
+
+/**
+ * Configure how new journal files are laid out.
+ *
+ * Journal files are put in \p fanout levels of directories, each named by
+ * the next two hexadecimal characters of the file's UUID. Files that already
+ * exist keep their path, since each record stores the path of its file; use
+ * jaldb_upgrade to move them into the new layout.
+ *
+ * If \p pool_size is not 0, a thread creates up to \p pool_size empty
+ * journal files, including any missing directories, ahead of
+ * jaldb_create_journal_file(), so a record does not have to wait for it.
+ * The files are kept in a directory of their own until they are handed out.
+ * Files still in the pool are removed by jaldb_context_destroy(), and those
+ * left by a process that exited without destroying its context are removed
+ * when the database is next opened for writing.
+ *
+ * @param[in] ctx The context, which must be initialized and writable.
+ * @param[in] fanout The number of directory levels, from 1 to 4.
+ * @param[in] pool_size The number of files to create ahead of time, or 0.
+ *
+ * @return JALDB_OK on success, JALDB_E_INVAL if the context is not
+ * initialized, is read only, already has a pool of files, or \p fanout is
+ * out of range, or JALDB_E_UNKNOWN if the pool's directory could not be
+ * created or the thread could not be started.
+ */
+enum jaldb_status jaldb_set_journal_layout(jaldb_context *ctx,
+		int fanout,
+		size_t pool_size);
+
+/**
+ * Get a new, empty file to store the payload of a journal record in. The
+ * file is taken from the pool set up by jaldb_set_journal_layout(), or
+ * created when the pool is empty or disabled.
+ *
+ * If \p expected_len is not 0, space for that many bytes is reserved for
+ * the file, without changing its size, so the payload is stored
+ * contiguously. Failing to reserve the space is not an error.
+ *
+ * @param[in] ctx The context.
+ * @param[in] expected_len The length of the payload, or 0 if not known.
+ * @param[out] path On success, the path of the file, relative to the journal
+ * root. It must be NULL when called, and should be released with free().
+ * @param[out] fd On success, a file descriptor for the file, open for
+ * reading and writing.
+ *
+ * @return JALDB_OK on success, JALDB_E_INVAL if a parameter is invalid, or
+ * JALDB_E_INTERNAL_ERROR if the file could not be created.
+ */
+enum jaldb_status jaldb_create_journal_file(jaldb_context *ctx,
+		uint64_t expected_len,
+		char **path,
+		int *fd);
+
+struct jaldb_record_waiter;
+typedef struct jaldb_record_waiter jaldb_record_waiter;
+
+/**
+ * Create a waiter that can block until new records are inserted.
+ *
+ * Inserts made through \p ctx wake the waiter directly. On Linux, inserts
+ * made by other processes sharing the same DB root (i.e. the local store)
+ * are also seen, through inotify on a notification file in the DB root.
+ * Elsewhere, records from other processes are only picked up when the wait
+ * times out.
+ *
+ * Notifications are latched: a record committed after the waiter is created,
+ * or after the last call to jaldb_wait_for_record() returned, makes the next
+ * call return immediately. Create the waiter before looking for records to
+ * avoid missing one inserted in between.
+ *
+ * @param[in] ctx The context, which must be initialized.
+ *
+ * @return The new waiter, or NULL if \p ctx is not initialized.
+ */
+jaldb_record_waiter *jaldb_record_waiter_create(jaldb_context *ctx);
+
+/**
+ * Release a waiter created with jaldb_record_waiter_create().
+ *
+ * @param[in,out] waiter The waiter to destroy. *waiter will be set to NULL.
+ */
+void jaldb_record_waiter_destroy(jaldb_record_waiter **waiter);
+
+/**
+ * Block until a record has been inserted or \p timeout_ms milliseconds have
+ * passed. This may return JALDB_OK without a new record being available, so
+ * callers must check the database again either way.
+ *
+ * @param[in] waiter The waiter.
+ * @param[in] timeout_ms The longest time to wait, in milliseconds.
+ *
+ * @return JALDB_OK if a record may have been inserted, JALDB_E_NOT_FOUND if
+ * the wait timed out, or JALDB_E_INVAL if \p waiter is NULL or
+ * \p timeout_ms is negative.
+ */
+enum jaldb_status jaldb_wait_for_record(jaldb_record_waiter *waiter,
+		long timeout_ms);
+
 /**
  * Open a segment on disk for reading.
  *
@@ -34,9 +34,13 @@
 #include <set>
 #include <string>
 #include <db.h>
+#include <pthread.h>
+#include <stdint.h>
 #include "jaldb_context.h"
 
 struct jaldb_record_dbs;
+struct jaldb_group_commit;
+struct jaldb_file_pool;
 
 struct jaldb_context_t {
 	char *journal_root; 				//!< The journal record root path.
@@ -52,6 +56,14 @@ struct jaldb_context_t {
 	std::set<std::string> *seen_journal_records;	//<! Journal records already seen in live mode
 	std::set<std::string> *seen_audit_records;	//<! Audit records already seen in live mode
 	std::set<std::string> *seen_log_records;	//<! Log records already seen in live mode
+	struct jaldb_group_commit *group_commit;	//<! Batches inserts from concurrent threads, NULL if disabled
+	pthread_mutex_t notify_lock;			//!< Protects insert_seq.
+	pthread_cond_t notify_cond;			//!< Signaled whenever records are committed.
+	uint64_t insert_seq;				//!< Number of committed inserts made through this context.
+	char *notify_path;				//!< File touched on every commit to wake other processes.
+	int notify_fd;					//!< Write handle for notify_path, -1 if not open.
+	int journal_fanout;				//!< Number of directory levels for new journal files.
+	struct jaldb_file_pool *journal_pool;		//!< Journal files created ahead of time, NULL if disabled.
 };
 
 /**
@@ -29,16 +29,299 @@
 
 #include <stdio.h>
 #include <ctype.h>
+#include <inttypes.h>
 #include <libxml/xmlschemastypes.h>
 #include <jalop/jal_status.h>
 #include <string.h>
 
 #include "jal_alloc.h"
+#include "jal_asprintf_internal.h"
 #include "jal_error_callback_internal.h"
 
 #include "jaldb_datetime.h"
 #include "jaldb_serialize_record.h"
 
+#define JALDB_DT_USECS_PER_SEC 1000000LL
+#define JALDB_DT_SECS_PER_DAY 86400LL
+#define JALDB_DT_SIGN_BIT (((uint64_t) 1) << 63)
+#define JALDB_DT_MICROS_OFFSET 0
+#define JALDB_DT_PICOS_OFFSET 8
+// Anything beyond 5 digit years will overflow the 64-bit microsecond count.
+#define JALDB_DT_MAX_YEAR_DIGITS 5
+
+static int jaldb_dt_days_in_month(int64_t year, int month)
+{
+	static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	if (2 == month && (0 == year % 4) && ((0 != year % 100) || (0 == year % 400))) {
+		return 29;
+	}
+	return days[month - 1];
+}
+
+/*
+ * Number of days between 1970-01-01 and the given (proleptic Gregorian) date.
+ */
+static int64_t jaldb_dt_days_from_civil(int64_t year, int month, int day)
+{
+	year -= (month <= 2);
+	int64_t era = (year >= 0 ? year : year - 399) / 400;
+	int64_t yoe = year - era * 400;
+	int64_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+/*
+ * Inverse of jaldb_dt_days_from_civil.
+ */
+static void jaldb_dt_civil_from_days(int64_t days, int64_t *year, int *month, int *day)
+{
+	days += 719468;
+	int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+	int64_t doe = days - era * 146097;
+	int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	int64_t mp = (5 * doy + 2) / 153;
+	*day = (int) (doy - (153 * mp + 2) / 5 + 1);
+	*month = (int) (mp < 10 ? mp + 3 : mp - 9);
+	*year = yoe + era * 400 + (*month <= 2);
+}
+
+/*
+ * Parse exactly \p n decimal digits from \p *p, advancing \p *p.
+ */
+static int jaldb_dt_parse_digits(const char **p, const char *end, int n, int64_t *out)
+{
+	int64_t val = 0;
+	const char *c = *p;
+	if ((end - c) < n) {
+		return -1;
+	}
+	for (int i = 0; i < n; i++, c++) {
+		if (!isdigit((unsigned char) *c)) {
+			return -1;
+		}
+		val = (val * 10) + (*c - '0');
+	}
+	*p = c;
+	*out = val;
+	return 0;
+}
+
+static int jaldb_dt_expect(const char **p, const char *end, char c)
+{
+	if (*p >= end || **p != c) {
+		return -1;
+	}
+	*p += 1;
+	return 0;
+}
+
+static void jaldb_dt_put_be(uint8_t *buf, uint64_t val, int nbytes)
+{
+	for (int i = nbytes - 1; i >= 0; i--) {
+		buf[i] = (uint8_t) (val & 0xff);
+		val >>= 8;
+	}
+}
+
+static uint64_t jaldb_dt_get_be(const uint8_t *buf, int nbytes)
+{
+	uint64_t val = 0;
+	for (int i = 0; i < nbytes; i++) {
+		val = (val << 8) | buf[i];
+	}
+	return val;
+}
+
+enum jaldb_status jaldb_datetime_to_key(const char *dt, size_t dt_len, uint8_t *key)
+{
+	const char *p = dt;
+	const char *end;
+	int negative_year = 0;
+	int year_digits = 0;
+	int64_t year = 0;
+	int64_t month;
+	int64_t day;
+	int64_t hour;
+	int64_t minute;
+	int64_t second;
+	int64_t micros = 0;
+	int64_t picos = 0;
+	int64_t tz_minutes = 0;
+	int64_t tmp;
+
+	if (!dt || !key) {
+		return JALDB_E_INVAL;
+	}
+	end = dt + dt_len;
+
+	if (p < end && '-' == *p) {
+		negative_year = 1;
+		p++;
+	}
+	while (p < end && isdigit((unsigned char) *p)) {
+		if (++year_digits > JALDB_DT_MAX_YEAR_DIGITS) {
+			return JALDB_E_INVAL_TIMESTAMP;
+		}
+		year = (year * 10) + (*p - '0');
+		p++;
+	}
+	if (year_digits < 4) {
+		return JALDB_E_INVAL_TIMESTAMP;
+	}
+	if (negative_year) {
+		year = -year;
+	}
+
+	if (jaldb_dt_expect(&p, end, '-') ||
+			jaldb_dt_parse_digits(&p, end, 2, &month) ||
+			jaldb_dt_expect(&p, end, '-') ||
+			jaldb_dt_parse_digits(&p, end, 2, &day) ||
+			jaldb_dt_expect(&p, end, 'T') ||
+			jaldb_dt_parse_digits(&p, end, 2, &hour) ||
+			jaldb_dt_expect(&p, end, ':') ||
+			jaldb_dt_parse_digits(&p, end, 2, &minute) ||
+			jaldb_dt_expect(&p, end, ':') ||
+			jaldb_dt_parse_digits(&p, end, 2, &second)) {
+		return JALDB_E_INVAL_TIMESTAMP;
+	}
+
+	if (p < end && '.' == *p) {
+		int digits = 0;
+		p++;
+		while (p < end && isdigit((unsigned char) *p)) {
+			if (digits < 6) {
+				micros = (micros * 10) + (*p - '0');
+			} else if (digits < 12) {
+				picos = (picos * 10) + (*p - '0');
+			}
+			// Precision beyond picoseconds is truncated.
+			digits++;
+			p++;
+		}
+		if (0 == digits) {
+			return JALDB_E_INVAL_TIMESTAMP;
+		}
+		for (; digits < 6; digits++) {
+			micros *= 10;
+		}
+		for (; digits < 12; digits++) {
+			picos *= 10;
+		}
+	}
+
+	if (p < end && 'Z' == *p) {
+		p++;
+	} else if (p < end && ('+' == *p || '-' == *p)) {
+		int tz_negative = ('-' == *p);
+		int64_t tz_hour;
+		int64_t tz_min;
+		p++;
+		if (jaldb_dt_parse_digits(&p, end, 2, &tz_hour) ||
+				jaldb_dt_expect(&p, end, ':') ||
+				jaldb_dt_parse_digits(&p, end, 2, &tz_min)) {
+			return JALDB_E_INVAL_TIMESTAMP;
+		}
+		if (tz_hour > 14 || tz_min > 59 || (14 == tz_hour && 0 != tz_min)) {
+			return JALDB_E_INVAL_TIMESTAMP;
+		}
+		tz_minutes = (tz_hour * 60) + tz_min;
+		if (tz_negative) {
+			tz_minutes = -tz_minutes;
+		}
+	}
+
+	if (p != end) {
+		return JALDB_E_INVAL_TIMESTAMP;
+	}
+
+	if (month < 1 || month > 12 ||
+			day < 1 || day > jaldb_dt_days_in_month(year, (int) month) ||
+			minute > 59 || second > 59) {
+		return JALDB_E_INVAL_TIMESTAMP;
+	}
+	// 24:00:00 is allowed, and refers to the first instant of the next day.
+	if (hour > 24 || (24 == hour && (minute || second || micros || picos))) {
+		return JALDB_E_INVAL_TIMESTAMP;
+	}
+
+	tmp = jaldb_dt_days_from_civil(year, (int) month, (int) day) * JALDB_DT_SECS_PER_DAY;
+	tmp += (hour * 3600) + (minute * 60) + second - (tz_minutes * 60);
+	tmp = (tmp * JALDB_DT_USECS_PER_SEC) + micros;
+
+	jaldb_dt_put_be(key + JALDB_DT_MICROS_OFFSET, ((uint64_t) tmp) ^ JALDB_DT_SIGN_BIT, 8);
+	jaldb_dt_put_be(key + JALDB_DT_PICOS_OFFSET, (uint64_t) picos, 4);
+
+	return JALDB_OK;
+}
+
+enum jaldb_status jaldb_key_to_datetime(const uint8_t *key, size_t key_len, char **dt)
+{
+	int64_t micros;
+	int64_t secs;
+	int64_t days;
+	int64_t usecs;
+	int64_t picos;
+	int64_t year;
+	int month;
+	int day;
+	int ret;
+
+	if (!key || JALDB_DATETIME_KEY_LEN != key_len || !dt || *dt) {
+		return JALDB_E_INVAL;
+	}
+
+	micros = (int64_t) (jaldb_dt_get_be(key + JALDB_DT_MICROS_OFFSET, 8) ^ JALDB_DT_SIGN_BIT);
+	picos = (int64_t) jaldb_dt_get_be(key + JALDB_DT_PICOS_OFFSET, 4);
+
+	secs = micros / JALDB_DT_USECS_PER_SEC;
+	usecs = micros % JALDB_DT_USECS_PER_SEC;
+	if (usecs < 0) {
+		usecs += JALDB_DT_USECS_PER_SEC;
+		secs -= 1;
+	}
+	days = secs / JALDB_DT_SECS_PER_DAY;
+	secs = secs % JALDB_DT_SECS_PER_DAY;
+	if (secs < 0) {
+		secs += JALDB_DT_SECS_PER_DAY;
+		days -= 1;
+	}
+	jaldb_dt_civil_from_days(days, &year, &month, &day);
+
+	if (picos) {
+		ret = jal_asprintf(dt, "%s%04" PRId64 "-%02d-%02dT%02d:%02d:%02d.%06" PRId64 "%06" PRId64 "Z",
+				year < 0 ? "-" : "", year < 0 ? -year : year, month, day,
+				(int) (secs / 3600), (int) ((secs % 3600) / 60), (int) (secs % 60),
+				usecs, picos);
+	} else {
+		ret = jal_asprintf(dt, "%s%04" PRId64 "-%02d-%02dT%02d:%02d:%02d.%06" PRId64 "Z",
+				year < 0 ? "-" : "", year < 0 ? -year : year, month, day,
+				(int) (secs / 3600), (int) ((secs % 3600) / 60), (int) (secs % 60),
+				usecs);
+	}
+	if (-1 == ret) {
+		return JALDB_E_NO_MEM;
+	}
+	return JALDB_OK;
+}
+
+int jaldb_datetime_key_compare(DB *db, const DBT *dbt1, const DBT *dbt2)
+{
+	u_int32_t len = dbt1->size < dbt2->size ? dbt1->size : dbt2->size;
+	int ret = memcmp(dbt1->data, dbt2->data, len);
+	if (0 != ret) {
+		return ret;
+	}
+	if (dbt1->size < dbt2->size) {
+		return -1;
+	}
+	if (dbt1->size > dbt2->size) {
+		return 1;
+	}
+	return 0;
+}
+
 int jaldb_xml_datetime_compare(DB *db, const DBT *dbt1, const DBT *dbt2)
 {
 	int xml_ret;
@@ -79,55 +362,49 @@ int jaldb_xml_datetime_compare(DB *db, const DBT *dbt1, const DBT *dbt2)
 	return 0;
 }
 
-enum jaldb_status jaldb_extract_datetime_key_common(
+static enum jaldb_status jaldb_extract_datetime_key_internal(
 		const uint8_t* buffer,
 		char **dtString,
-		size_t *dtLen)
+		size_t *dtLen,
+		uint8_t *key)
 {
-	enum jaldb_status ret = JALDB_E_INVAL;
+	enum jaldb_status ret;
 	struct jaldb_serialize_record_headers *headers = NULL;
 	char *stmp;
 	size_t slen;
-	int xml_ret;
 
 	if (!buffer || !dtString || *dtString || !dtLen) {
 		return JALDB_E_INVAL;
 	}
 
 	headers = (struct jaldb_serialize_record_headers*)buffer;
-	xmlSchemaValPtr dt = NULL;
-	xmlSchemaTypePtr xs_datetime = NULL;
-
-	xs_datetime = xmlSchemaGetBuiltInType(XML_SCHEMAS_DATETIME);
-	if (NULL == xs_datetime) {
-		ret = JALDB_E_INVAL;
-		goto out;
-	}
 
 	// TODO: Need BOM for this to work correctly
 	if (headers->version != JALDB_DB_LAYOUT_VERSION) {
-		ret = JALDB_E_CORRUPTED;
-		goto out;
+		return JALDB_E_CORRUPTED;
 	}
 
 	buffer += sizeof(*headers);
 	stmp = (char*)buffer;
 	slen = strlen(stmp);
 
-	xml_ret = xmlSchemaValidatePredefinedType(xs_datetime, (const xmlChar*) buffer, &dt);
-	if (0 != xml_ret) {
-		ret = JALDB_E_INVAL;
-		goto out;
+	ret = jaldb_datetime_to_key(stmp, slen, key);
+	if (JALDB_OK != ret) {
+		return JALDB_E_INVAL;
 	}
 
-	ret = JALDB_OK;
 	*dtString = stmp;
 	*dtLen = slen;
-out:
-	if (dt) {
-		xmlSchemaFreeValue(dt);
-	}
-	return ret;
+	return JALDB_OK;
+}
+
+enum jaldb_status jaldb_extract_datetime_key_common(
+		const uint8_t* buffer,
+		char **dtString,
+		size_t *dtLen)
+{
+	uint8_t key[JALDB_DATETIME_KEY_LEN];
+	return jaldb_extract_datetime_key_internal(buffer, dtString, dtLen, key);
 }
 
 
@@ -136,13 +413,15 @@ int jaldb_extract_datetime_key(DB *secondary, const DBT *key, const DBT *data, D
 	enum jaldb_status ret;
 	char *dtString = NULL;
 	size_t dtLen = 0;
+	uint8_t *dt_key = (uint8_t*) jal_malloc(JALDB_DATETIME_KEY_LEN);
 
-	ret = jaldb_extract_datetime_key_common(data->data, &dtString, &dtLen);
+	ret = jaldb_extract_datetime_key_internal(data->data, &dtString, &dtLen, dt_key);
 	if (ret != JALDB_OK) {
+		free(dt_key);
 		return -1;
 	}
-	result->data = jal_strdup(dtString);
-	result->size = dtLen + 1; // keep the null terminator
+	result->data = dt_key;
+	result->size = JALDB_DATETIME_KEY_LEN;
 	result->flags = DB_DBT_APPMALLOC;
 	return 0;
 }
@@ -158,12 +437,14 @@ int jaldb_extract_nonce_timestamp_key(DB *secondary, const DBT *key, const DBT *
 	if (!timestamp_end) {
 		return DB_DONOTINDEX;
 	}
-	size_t string_len = timestamp_end - timestamp;
-	result->data = jal_malloc(string_len + 1);
-	memset(result->data,0,string_len+1);
-	result->size = string_len + 1;
+	uint8_t *dt_key = (uint8_t*) jal_malloc(JALDB_DATETIME_KEY_LEN);
+	if (JALDB_OK != jaldb_datetime_to_key(timestamp, timestamp_end - timestamp, dt_key)) {
+		free(dt_key);
+		return DB_DONOTINDEX;
+	}
+	result->data = dt_key;
+	result->size = JALDB_DATETIME_KEY_LEN;
 	result->flags = DB_DBT_APPMALLOC;
-	strncpy((char*)result->data, timestamp, string_len);
 
 	return 0;
 }
@@ -31,11 +31,73 @@
 #define _JALDB_DATETIME_H_
 
 #include <db.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jaldb_status.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * Size, in bytes, of a binary DateTime key.
+ *
+ * Binary DateTime keys are used for the timestamp indices as of
+ * layout version 2. The first 8 bytes hold the number of microseconds since
+ * the epoch (UTC) as a big-endian integer with the sign bit flipped, the next
+ * 4 bytes hold the remaining sub-microsecond fraction (in picoseconds) as a
+ * big-endian integer. This allows keys to be ordered with memcmp().
+ */
+#define JALDB_DATETIME_KEY_LEN 12
+
+/**
+ * Convert an XML Schema DateTime string to a binary DateTime key.
+ *
+ * The DateTime is normalized to UTC. A DateTime without a timezone is assumed
+ * to already be in UTC time.
+ *
+ * @param[in] dt The DateTime string to convert.
+ * @param[in] dt_len The number of characters in \p dt to consider.
+ * @param[out] key Buffer of at least JALDB_DATETIME_KEY_LEN bytes to receive
+ * the key.
+ *
+ * @return JALDB_OK on success, JALDB_E_INVAL_TIMESTAMP if \p dt is not a
+ * valid DateTime, or JALDB_E_INVAL for bad parameters.
+ */
+enum jaldb_status jaldb_datetime_to_key(const char *dt, size_t dt_len, uint8_t *key);
+
+/**
+ * Convert a binary DateTime key back to an XML Schema DateTime string.
+ *
+ * The string is always in UTC, i.e. 'YYYY-MM-DDThh:mm:ss.ffffffZ'. Additional
+ * fractional digits are only included when the key carries sub-microsecond
+ * precision.
+ *
+ * @param[in] key The key to convert.
+ * @param[in] key_len The size of \p key, must be JALDB_DATETIME_KEY_LEN.
+ * @param[out] dt On success, a newly allocated string that must be released
+ * with free().
+ *
+ * @return JALDB_OK on success, or an error code.
+ */
+enum jaldb_status jaldb_key_to_datetime(const uint8_t *key, size_t key_len, char **dt);
+
+/**
+ * B-Tree Comparison function for binary DateTime keys.
+ *
+ * The keys are created by jaldb_datetime_to_key(), and can be compared
+ * byte-wise.
+ *
+ * @param[in] db The Berkeley DB that contains the keys, this is unused.
+ * @param[in] dbt1 The DBT that represents the application provided key (i.e.
+ * key to search for).
+ * @param[in] dbt2 The DBT that represents the current key from the tree.
+ *
+ * @return < 0 if <tt>(db1 < dbt2)</tt>, 0 if <tt>(dbt1 == dbt1)</tt>, > 0 if <tt>(dbt1 > dbt2)</tt>
+ */
+int jaldb_datetime_key_compare(DB *db, const DBT *dbt1, const DBT *dbt2);
+
 /**
  * B-Tree Comparison function for XML DateTime strings.
  *
@@ -49,6 +111,9 @@ extern "C" {
  * If there is any sort of parse error on the keys, or the values are
  * indeterminate, then jal_error_handler is called.
  *
+ * This was used for the timestamp indices prior to layout version 2, which
+ * use binary keys and jaldb_datetime_key_compare() instead.
+ *
  * @param[in] db The Berkeley DB that contains the keys, this is unused.
  * @param[in] dbt1 The DBT that represents the application provided key (i.e.
  * key to search for).
@@ -61,15 +126,13 @@ int jaldb_xml_datetime_compare(DB *db, const DBT *dbt1, const DBT *dbt2);
 
 
 /**
- * Function to extract the Timestamp as a secondary key if it does NOT have a
- * timezone component.
+ * Function to extract the Timestamp as a secondary key.
  *
- * This function extracts the XML DateTime timestamp from JALoP Record, creates
- * a copy, and stores it in \p result for use as a secondary index. If the
- * timestamp contains a timezone, this function returns DB_DONOTINDEX to
- * prevent indexing on the timestamp.
+ * This function extracts the XML DateTime timestamp from JALoP Record,
+ * converts it to a binary DateTime key, and stores it in \p result for use as
+ * a secondary index.
  *
- * @see jaldb_xml_datetime_compare
+ * @see jaldb_datetime_key_compare
  *
  * @param[in] secondary Pointer to the secondary DB that is getting modified,
  * this is only checked to see if the record is byte-swapped.
@@ -77,7 +140,7 @@ int jaldb_xml_datetime_compare(DB *db, const DBT *dbt1, const DBT *dbt2);
  * @param[in] data The data for the record
  * @param[out] result the DBT object to fill in for the datetime secondary key.
  *
- * @return -1 if <tt>(db1 < dbt2)</tt>, 0 if <tt>(dbt1 == dbt1)</tt>, 1 if <tt>(dbt1 > dbt2)</tt>
+ * @return 0 on success, -1 on error
  */
 int jaldb_extract_datetime_key(DB *secondary, const DBT *key, const DBT *data, DBT *result);
 
@@ -86,7 +149,7 @@ int jaldb_extract_datetime_key(DB *secondary, const DBT *key, const DBT *data, D
  * Helper function to extract the timestamp from a JALoP Record.
  *
  * This function extracts the timestamp from an in-memory JALoP record and
- * determines if the timestamp value has a timezone component or not.
+ * verifies that it is a valid XML Schema DateTime.
  *
  * @param[in] buffer the in-memory buffer that contains a JALoP record. This is
  * assumed to be large enough to contain a complete JALoP Record.
@@ -105,10 +168,11 @@ enum jaldb_status jaldb_extract_datetime_key_common(
 /**
  * Function to extract the nonce timestamp as a secondary key.
  *
- * This function extracts the XML DateTime timestamp from the nonce, creates
- * a copy, and stores it in \p result for use as a secondary index.
+ * This function extracts the XML DateTime timestamp from the nonce, converts
+ * it to a binary DateTime key, and stores it in \p result for use as a
+ * secondary index.
  *
- * @see jaldb_xml_datetime_compare
+ * @see jaldb_datetime_key_compare
  *
  * @param[in] secondary Pointer to the secondary DB that is getting modified,
  * this is only checked to see if the record is byte-swapped.
@@ -0,0 +1,1083 @@
+/**
+ * @file jaldb_delivery.cpp This file implements tracking which records have
+ * been delivered to each subscriber.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <db.h>
+#include <errno.h>
+#include <string.h>
+#include <string>
+#include <sys/time.h>
+#include <time.h>
+#include <vector>
+
+#include "jal_alloc.h"
+#include "jal_byteswap.h"
+
+#include "jaldb_context.hpp"
+#include "jaldb_datetime.h"
+#include "jaldb_delivery.h"
+#include "jaldb_record_dbs.h"
+#include "jaldb_serialize_record.h"
+#include "jaldb_utils.h"
+
+/*
+ * Each subscriber has a state entry in the delivery DB, keyed by its host
+ * name and a NUL, holding the high-water mark, the position of the last
+ * record sent in order, and the number of records sent since the mark last
+ * moved.
+ *
+ * Every record sent to the subscriber that is either still in flight or at
+ * or after the high-water mark has an entry keyed by the host name, a NUL,
+ * one of the JALDB_DELIVERY_* states, the nonce timestamp key, and the
+ * nonce. The entries for a subscriber and state are contiguous and in
+ * insertion order, and updating one never touches the record itself.
+ *
+ * jaldb_delivery_seed() stores a state and synced entries under the empty
+ * host name for DBs that predate the delivery DB. A subscriber without a
+ * state starts from a copy of them.
+ */
+#define JALDB_DELIVERY_IN_FLIGHT 'S'	//!< Sent, waiting for a sync.
+#define JALDB_DELIVERY_RESEND 'R'	//!< Waiting to be sent again.
+#define JALDB_DELIVERY_SYNCED 'D'	//!< Synced, kept until it falls behind the high-water mark.
+
+/** Records sent in order before the high-water mark is moved while busy. */
+#define JALDB_DELIVERY_RESCAN_INTERVAL 1024
+
+/** The host name the seed state is stored under. */
+#define JALDB_DELIVERY_SEED_HOST ""
+
+struct jaldb_delivery_state {
+	uint8_t hwm[JALDB_DATETIME_KEY_LEN];	//!< Every record before this was sent or is tracked.
+	uint8_t pos[JALDB_DATETIME_KEY_LEN];	//!< Timestamp key of the last record sent in order.
+	uint32_t since_rescan;			//!< Records sent since the high-water mark moved.
+	std::string pos_nonce;			//!< Nonce of the last record sent in order.
+};
+
+struct jaldb_delivery_op {
+	struct jaldb_record_dbs *rdbs;		//!< The DBs for the record type.
+	const char *host;			//!< The subscriber.
+	std::string nonce;			//!< The record being updated, or the record found.
+	uint8_t ts[JALDB_DATETIME_KEY_LEN];	//!< Nonce timestamp key of \p nonce.
+};
+
+typedef int (*jaldb_delivery_op_fn)(DB_TXN *txn, struct jaldb_delivery_op *op);
+
+static struct jaldb_record_dbs *jaldb_delivery_get_dbs(jaldb_context *ctx,
+		enum jaldb_rec_type type)
+{
+	switch (type) {
+	case JALDB_RTYPE_JOURNAL:
+		return ctx->journal_dbs;
+	case JALDB_RTYPE_AUDIT:
+		return ctx->audit_dbs;
+	case JALDB_RTYPE_LOG:
+		return ctx->log_dbs;
+	default:
+		return NULL;
+	}
+}
+
+static std::string jaldb_delivery_state_key(const char *host)
+{
+	std::string key(host);
+	key.push_back('\0');
+	return key;
+}
+
+static std::string jaldb_delivery_entry_key(const char *host, char state,
+		const uint8_t *ts, const std::string &nonce)
+{
+	std::string key = jaldb_delivery_state_key(host);
+	key.push_back(state);
+	key.append((const char *)ts, JALDB_DATETIME_KEY_LEN);
+	key.append(nonce);
+	return key;
+}
+
+static void jaldb_delivery_set_dbt(DBT *dbt, const std::string &str)
+{
+	memset(dbt, 0, sizeof(*dbt));
+	dbt->data = (void *)str.data();
+	dbt->size = str.size();
+}
+
+/**
+ * Get the nonce timestamp key of a nonce, i.e. the key the record is stored
+ * under in the nonce timestamp DB.
+ */
+static enum jaldb_status jaldb_delivery_nonce_ts(const char *nonce, uint8_t *ts)
+{
+	DBT key;
+	DBT result;
+	memset(&key, 0, sizeof(key));
+	memset(&result, 0, sizeof(result));
+	key.data = (void *)nonce;
+	key.size = strlen(nonce) + 1;
+
+	if (0 != jaldb_extract_nonce_timestamp_key(NULL, &key, NULL, &result)) {
+		return JALDB_E_INVAL;
+	}
+	memcpy(ts, result.data, JALDB_DATETIME_KEY_LEN);
+	free(result.data);
+	return JALDB_OK;
+}
+
+/**
+ * Get the nonce timestamp key for JALDB_DELIVERY_SETTLE_SECS ago.
+ */
+static int jaldb_delivery_settle_key(uint8_t *key)
+{
+	struct timeval tv;
+	struct tm tm;
+	char buf[64];
+
+	if (0 != gettimeofday(&tv, NULL)) {
+		return errno;
+	}
+	time_t secs = tv.tv_sec - JALDB_DELIVERY_SETTLE_SECS;
+	if (!gmtime_r(&secs, &tm)) {
+		return EINVAL;
+	}
+	size_t len = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+	snprintf(buf + len, sizeof(buf) - len, ".%06ld", (long)tv.tv_usec);
+
+	if (JALDB_OK != jaldb_datetime_to_key(buf, strlen(buf), key)) {
+		return EINVAL;
+	}
+	return 0;
+}
+
+/**
+ * Read the state of a subscriber.
+ *
+ * @return 0, DB_NOTFOUND if \p host has no state, or a Berkeley DB error.
+ */
+static int jaldb_delivery_get_state(DB *db, DB_TXN *txn, const char *host,
+		struct jaldb_delivery_state *state)
+{
+	const size_t fixed_len = 2 * JALDB_DATETIME_KEY_LEN + sizeof(state->since_rescan);
+	std::string k = jaldb_delivery_state_key(host);
+	DBT key;
+	DBT val;
+	jaldb_delivery_set_dbt(&key, k);
+	memset(&val, 0, sizeof(val));
+	val.flags = DB_DBT_MALLOC;
+
+	memset(state->hwm, 0, sizeof(state->hwm));
+	memset(state->pos, 0, sizeof(state->pos));
+	state->since_rescan = 0;
+	state->pos_nonce.clear();
+
+	int db_ret = db->get(db, txn, &key, &val, DB_RMW);
+	if (0 != db_ret) {
+		return db_ret;
+	}
+
+	uint8_t *buf = (uint8_t *)val.data;
+	if (val.size > fixed_len) {
+		memcpy(state->hwm, buf, JALDB_DATETIME_KEY_LEN);
+		memcpy(state->pos, buf + JALDB_DATETIME_KEY_LEN, JALDB_DATETIME_KEY_LEN);
+		memcpy(&state->since_rescan, buf + 2 * JALDB_DATETIME_KEY_LEN,
+				sizeof(state->since_rescan));
+		state->pos_nonce.assign((char *)buf + fixed_len,
+				strnlen((char *)buf + fixed_len, val.size - fixed_len));
+	}
+	free(val.data);
+	return 0;
+}
+
+static std::string jaldb_delivery_serialize_state(const struct jaldb_delivery_state *state)
+{
+	std::string buf;
+	buf.append((const char *)state->hwm, JALDB_DATETIME_KEY_LEN);
+	buf.append((const char *)state->pos, JALDB_DATETIME_KEY_LEN);
+	buf.append((const char *)&state->since_rescan, sizeof(state->since_rescan));
+	buf.append(state->pos_nonce);
+	buf.push_back('\0');
+	return buf;
+}
+
+static int jaldb_delivery_store_state(DB *db, DB_TXN *txn, const char *host,
+		const struct jaldb_delivery_state *state)
+{
+	std::string k = jaldb_delivery_state_key(host);
+	std::string v = jaldb_delivery_serialize_state(state);
+	DBT key;
+	DBT val;
+	jaldb_delivery_set_dbt(&key, k);
+	jaldb_delivery_set_dbt(&val, v);
+	return db->put(db, txn, &key, &val, 0);
+}
+
+/**
+ * Look up the entry for a record.
+ *
+ * @return 0 with \p state_out set to the JALDB_DELIVERY_* state of the
+ * record, DB_NOTFOUND if the record has no entry, or a Berkeley DB error.
+ */
+static int jaldb_delivery_find(DB *db, DB_TXN *txn, const char *host,
+		const uint8_t *ts, const std::string &nonce, char *state_out)
+{
+	static const char states[] = { JALDB_DELIVERY_IN_FLIGHT,
+		JALDB_DELIVERY_RESEND, JALDB_DELIVERY_SYNCED };
+	DBT key;
+	DBT val;
+
+	for (size_t i = 0; i < sizeof(states); i++) {
+		std::string k = jaldb_delivery_entry_key(host, states[i], ts, nonce);
+		jaldb_delivery_set_dbt(&key, k);
+		memset(&val, 0, sizeof(val));
+		val.flags = DB_DBT_PARTIAL;
+
+		int db_ret = db->get(db, txn, &key, &val, DB_RMW);
+		if (0 == db_ret) {
+			*state_out = states[i];
+			return 0;
+		}
+		if (DB_NOTFOUND != db_ret) {
+			return db_ret;
+		}
+	}
+	return DB_NOTFOUND;
+}
+
+static int jaldb_delivery_put(DB *db, DB_TXN *txn, const char *host, char state,
+		const uint8_t *ts, const std::string &nonce)
+{
+	std::string k = jaldb_delivery_entry_key(host, state, ts, nonce);
+	DBT key;
+	DBT val;
+	jaldb_delivery_set_dbt(&key, k);
+	memset(&val, 0, sizeof(val));
+	return db->put(db, txn, &key, &val, 0);
+}
+
+/**
+ * Give a new subscriber a copy of the seed state and synced entries, so it
+ * isn't sent what an earlier version already delivered.
+ *
+ * @return 0, DB_NOTFOUND if there is no seed, or a Berkeley DB error.
+ */
+static int jaldb_delivery_adopt_seed(DB *db, DB_TXN *txn, const char *host,
+		struct jaldb_delivery_state *state)
+{
+	std::string prefix = jaldb_delivery_state_key(JALDB_DELIVERY_SEED_HOST);
+	prefix.push_back(JALDB_DELIVERY_SYNCED);
+	DBC *cursor = NULL;
+	DBT key;
+	DBT val;
+	memset(&key, 0, sizeof(key));
+	memset(&val, 0, sizeof(val));
+	key.flags = DB_DBT_REALLOC;
+	key.size = prefix.size();
+	key.data = jal_malloc(key.size);
+	memcpy(key.data, prefix.data(), key.size);
+	val.flags = DB_DBT_PARTIAL;
+
+	int db_ret = jaldb_delivery_get_state(db, txn, JALDB_DELIVERY_SEED_HOST, state);
+	if (0 != db_ret) {
+		goto out;
+	}
+	db_ret = db->cursor(db, txn, &cursor, 0);
+	if (0 != db_ret) {
+		goto out;
+	}
+	db_ret = cursor->c_get(cursor, &key, &val, DB_SET_RANGE);
+	while (0 == db_ret && key.size > prefix.size() + JALDB_DATETIME_KEY_LEN &&
+			0 == memcmp(key.data, prefix.data(), prefix.size())) {
+		std::string nonce((char *)key.data + prefix.size() + JALDB_DATETIME_KEY_LEN,
+				key.size - prefix.size() - JALDB_DATETIME_KEY_LEN);
+		db_ret = jaldb_delivery_put(db, txn, host, JALDB_DELIVERY_SYNCED,
+				(uint8_t *)key.data + prefix.size(), nonce);
+		if (0 == db_ret) {
+			db_ret = cursor->c_get(cursor, &key, &val, DB_NEXT);
+		}
+	}
+	if (0 != db_ret && DB_NOTFOUND != db_ret) {
+		goto out;
+	}
+	db_ret = jaldb_delivery_store_state(db, txn, host, state);
+out:
+	if (cursor) {
+		cursor->c_close(cursor);
+	}
+	free(key.data);
+	return db_ret;
+}
+
+static int jaldb_delivery_load_state(DB *db, DB_TXN *txn, const char *host,
+		struct jaldb_delivery_state *state)
+{
+	int db_ret = jaldb_delivery_get_state(db, txn, host, state);
+	if (DB_NOTFOUND == db_ret && *host) {
+		db_ret = jaldb_delivery_adopt_seed(db, txn, host, state);
+	}
+	if (DB_NOTFOUND == db_ret) {
+		// A new subscriber starts with the oldest record.
+		return 0;
+	}
+	return db_ret;
+}
+
+static int jaldb_delivery_del(DB *db, DB_TXN *txn, const char *host, char state,
+		const uint8_t *ts, const std::string &nonce)
+{
+	std::string k = jaldb_delivery_entry_key(host, state, ts, nonce);
+	DBT key;
+	jaldb_delivery_set_dbt(&key, k);
+	return db->del(db, txn, &key, 0);
+}
+
+/**
+ * Move a record from one state to another.
+ */
+static int jaldb_delivery_move(DB *db, DB_TXN *txn, const char *host,
+		char from, char to, const uint8_t *ts, const std::string &nonce)
+{
+	int db_ret = jaldb_delivery_del(db, txn, host, from, ts, nonce);
+	if (0 != db_ret) {
+		return db_ret;
+	}
+	return jaldb_delivery_put(db, txn, host, to, ts, nonce);
+}
+
+/**
+ * Take the oldest record waiting to be resent and mark it as in flight.
+ */
+static int jaldb_delivery_pop_resend(DB *db, DB_TXN *txn,
+		struct jaldb_delivery_op *op)
+{
+	std::string prefix = jaldb_delivery_state_key(op->host);
+	prefix.push_back(JALDB_DELIVERY_RESEND);
+	DBC *cursor = NULL;
+	DBT key;
+	DBT val;
+	memset(&key, 0, sizeof(key));
+	memset(&val, 0, sizeof(val));
+	key.flags = DB_DBT_REALLOC;
+	key.size = prefix.size();
+	key.data = jal_malloc(key.size);
+	memcpy(key.data, prefix.data(), key.size);
+	val.flags = DB_DBT_PARTIAL;
+
+	int db_ret = db->cursor(db, txn, &cursor, 0);
+	if (0 != db_ret) {
+		goto out;
+	}
+	db_ret = cursor->c_get(cursor, &key, &val, DB_SET_RANGE | DB_RMW);
+	if (0 != db_ret) {
+		goto out;
+	}
+	if (key.size <= prefix.size() + JALDB_DATETIME_KEY_LEN ||
+			0 != memcmp(key.data, prefix.data(), prefix.size())) {
+		db_ret = DB_NOTFOUND;
+		goto out;
+	}
+
+	memcpy(op->ts, (uint8_t *)key.data + prefix.size(), JALDB_DATETIME_KEY_LEN);
+	op->nonce.assign((char *)key.data + prefix.size() + JALDB_DATETIME_KEY_LEN,
+			key.size - prefix.size() - JALDB_DATETIME_KEY_LEN);
+	db_ret = cursor->c_del(cursor, 0);
+	if (0 != db_ret) {
+		goto out;
+	}
+	db_ret = jaldb_delivery_put(db, txn, op->host, JALDB_DELIVERY_IN_FLIGHT,
+			op->ts, op->nonce);
+out:
+	if (cursor) {
+		cursor->c_close(cursor);
+	}
+	free(key.data);
+	return db_ret;
+}
+
+/**
+ * Send the next record in insertion order after the last one sent. Records
+ * that aren't confirmed yet are passed over; the high-water mark stays
+ * behind them, so a rescan queues them once they are confirmed.
+ */
+static int jaldb_delivery_scan(DB_TXN *txn, struct jaldb_delivery_op *op,
+		struct jaldb_delivery_state *state)
+{
+	DB *db = op->rdbs->delivery_db;
+	struct jaldb_serialize_record_headers *headers = NULL;
+	DBC *cursor = NULL;
+	char found;
+	DBT key;
+	DBT pkey;
+	DBT val;
+	memset(&key, 0, sizeof(key));
+	memset(&pkey, 0, sizeof(pkey));
+	memset(&val, 0, sizeof(val));
+	key.flags = DB_DBT_REALLOC;
+	key.size = JALDB_DATETIME_KEY_LEN;
+	key.data = jal_malloc(key.size);
+	memcpy(key.data, state->pos, key.size);
+	pkey.flags = DB_DBT_REALLOC;
+	val.flags = DB_DBT_REALLOC | DB_DBT_PARTIAL;
+	val.dlen = sizeof(*headers);
+
+	int db_ret = op->rdbs->nonce_timestamp_db->cursor(op->rdbs->nonce_timestamp_db,
+			txn, &cursor, 0);
+	if (0 != db_ret) {
+		goto out;
+	}
+
+	db_ret = cursor->c_pget(cursor, &key, &pkey, &val, DB_SET_RANGE);
+	while (0 == db_ret) {
+		std::string nonce((char *)pkey.data);
+		headers = (struct jaldb_serialize_record_headers *)val.data;
+
+		if (0 == memcmp(key.data, state->pos, JALDB_DATETIME_KEY_LEN) &&
+				nonce <= state->pos_nonce) {
+			// Already sent in order.
+		} else {
+			db_ret = jaldb_delivery_find(db, txn, op->host,
+					(uint8_t *)key.data, nonce, &found);
+			if (DB_NOTFOUND != db_ret) {
+				if (0 != db_ret) {
+					goto out;
+				}
+			} else if (!(headers->flags & JALDB_RFLAGS_CONFIRMED)) {
+				// Still being inserted, or in flight from a
+				// remote store.
+			} else {
+				db_ret = jaldb_delivery_put(db, txn, op->host,
+						JALDB_DELIVERY_IN_FLIGHT,
+						(uint8_t *)key.data, nonce);
+				if (0 == db_ret) {
+					memcpy(state->pos, key.data, JALDB_DATETIME_KEY_LEN);
+					memcpy(op->ts, key.data, JALDB_DATETIME_KEY_LEN);
+					state->pos_nonce = nonce;
+					state->since_rescan++;
+					op->nonce = nonce;
+				}
+				goto out;
+			}
+		}
+		db_ret = cursor->c_pget(cursor, &key, &pkey, &val, DB_NEXT);
+	}
+out:
+	if (cursor) {
+		cursor->c_close(cursor);
+	}
+	free(key.data);
+	free(pkey.data);
+	free(val.data);
+	return db_ret;
+}
+
+/**
+ * Move the high-water mark up to the last record sent in order, but no
+ * closer than JALDB_DELIVERY_SETTLE_SECS to the present. Records between the
+ * old and new mark that were never sent committed late, so they are queued
+ * to be sent. Synced entries that fall behind the new mark are dropped.
+ */
+static int jaldb_delivery_rescan(DB_TXN *txn, struct jaldb_delivery_op *op,
+		struct jaldb_delivery_state *state)
+{
+	DB *db = op->rdbs->delivery_db;
+	struct jaldb_serialize_record_headers *headers = NULL;
+	uint8_t limit[JALDB_DATETIME_KEY_LEN];
+	uint8_t hold[JALDB_DATETIME_KEY_LEN];
+	bool held = false;
+	std::string prefix = jaldb_delivery_state_key(op->host);
+	prefix.push_back(JALDB_DELIVERY_SYNCED);
+	DBC *cursor = NULL;
+	char found;
+	DBT key;
+	DBT pkey;
+	DBT val;
+	memset(&key, 0, sizeof(key));
+	memset(&pkey, 0, sizeof(pkey));
+	memset(&val, 0, sizeof(val));
+	key.flags = DB_DBT_REALLOC;
+	key.size = JALDB_DATETIME_KEY_LEN;
+	key.data = jal_malloc(key.size);
+	memcpy(key.data, state->hwm, key.size);
+	pkey.flags = DB_DBT_REALLOC;
+	val.flags = DB_DBT_REALLOC | DB_DBT_PARTIAL;
+	val.dlen = sizeof(*headers);
+
+	int db_ret = jaldb_delivery_settle_key(limit);
+	if (0 != db_ret) {
+		goto out;
+	}
+	if (0 < memcmp(limit, state->pos, JALDB_DATETIME_KEY_LEN)) {
+		memcpy(limit, state->pos, JALDB_DATETIME_KEY_LEN);
+	}
+	if (0 > memcmp(limit, state->hwm, JALDB_DATETIME_KEY_LEN)) {
+		// The clock went backwards, never lower the mark.
+		memcpy(limit, state->hwm, JALDB_DATETIME_KEY_LEN);
+	}
+
+	db_ret = op->rdbs->nonce_timestamp_db->cursor(op->rdbs->nonce_timestamp_db,
+			txn, &cursor, 0);
+	if (0 != db_ret) {
+		goto out;
+	}
+	db_ret = cursor->c_pget(cursor, &key, &pkey, &val, DB_SET_RANGE);
+	while (0 == db_ret && 0 > memcmp(key.data, limit, JALDB_DATETIME_KEY_LEN)) {
+		std::string nonce((char *)pkey.data);
+		headers = (struct jaldb_serialize_record_headers *)val.data;
+
+		db_ret = jaldb_delivery_find(db, txn, op->host, (uint8_t *)key.data,
+				nonce, &found);
+		if (DB_NOTFOUND == db_ret) {
+			if (!(headers->flags & JALDB_RFLAGS_CONFIRMED)) {
+				// Keep the mark behind it until it is confirmed,
+				// but still queue the records after it.
+				if (!held) {
+					memcpy(hold, key.data, JALDB_DATETIME_KEY_LEN);
+					held = true;
+				}
+				db_ret = 0;
+			} else {
+				db_ret = jaldb_delivery_put(db, txn, op->host,
+						JALDB_DELIVERY_RESEND, (uint8_t *)key.data, nonce);
+			}
+		}
+		if (0 != db_ret) {
+			goto out;
+		}
+		db_ret = cursor->c_pget(cursor, &key, &pkey, &val, DB_NEXT);
+	}
+	if (0 != db_ret && DB_NOTFOUND != db_ret) {
+		goto out;
+	}
+	if (held) {
+		memcpy(limit, hold, JALDB_DATETIME_KEY_LEN);
+	}
+	cursor->c_close(cursor);
+	cursor = NULL;
+
+	db_ret = db->cursor(db, txn, &cursor, 0);
+	if (0 != db_ret) {
+		goto out;
+	}
+	key.size = prefix.size();
+	key.data = jal_realloc(key.data, key.size);
+	memcpy(key.data, prefix.data(), key.size);
+	free(val.data);
+	memset(&val, 0, sizeof(val));
+	val.flags = DB_DBT_PARTIAL;
+
+	db_ret = cursor->c_get(cursor, &key, &val, DB_SET_RANGE | DB_RMW);
+	while (0 == db_ret && key.size > prefix.size() + JALDB_DATETIME_KEY_LEN &&
+			0 == memcmp(key.data, prefix.data(), prefix.size()) &&
+			0 > memcmp((uint8_t *)key.data + prefix.size(), limit,
+				JALDB_DATETIME_KEY_LEN)) {
+		db_ret = cursor->c_del(cursor, 0);
+		if (0 == db_ret) {
+			db_ret = cursor->c_get(cursor, &key, &val, DB_NEXT | DB_RMW);
+		}
+	}
+	if (0 != db_ret && DB_NOTFOUND != db_ret) {
+		goto out;
+	}
+
+	memcpy(state->hwm, limit, JALDB_DATETIME_KEY_LEN);
+	state->since_rescan = 0;
+	db_ret = 0;
+out:
+	if (cursor) {
+		cursor->c_close(cursor);
+	}
+	free(key.data);
+	free(pkey.data);
+	free(val.data);
+	return db_ret;
+}
+
+static int jaldb_delivery_op_next(DB_TXN *txn, struct jaldb_delivery_op *op)
+{
+	DB *db = op->rdbs->delivery_db;
+	struct jaldb_delivery_state state;
+
+	int db_ret = jaldb_delivery_load_state(db, txn, op->host, &state);
+	if (0 != db_ret) {
+		return db_ret;
+	}
+	std::string before = jaldb_delivery_serialize_state(&state);
+
+	db_ret = jaldb_delivery_pop_resend(db, txn, op);
+	if (DB_NOTFOUND == db_ret) {
+		if (JALDB_DELIVERY_RESCAN_INTERVAL <= state.since_rescan) {
+			db_ret = jaldb_delivery_rescan(txn, op, &state);
+			if (0 == db_ret) {
+				db_ret = jaldb_delivery_pop_resend(db, txn, op);
+			}
+		}
+	}
+	if (DB_NOTFOUND == db_ret) {
+		db_ret = jaldb_delivery_scan(txn, op, &state);
+	}
+	if (DB_NOTFOUND == db_ret) {
+		// Caught up, a good time to look for records that committed late.
+		db_ret = jaldb_delivery_rescan(txn, op, &state);
+		if (0 == db_ret) {
+			db_ret = jaldb_delivery_pop_resend(db, txn, op);
+		}
+	}
+	if (0 != db_ret && DB_NOTFOUND != db_ret) {
+		return db_ret;
+	}
+
+	if (before != jaldb_delivery_serialize_state(&state)) {
+		int store_ret = jaldb_delivery_store_state(db, txn, op->host, &state);
+		if (0 != store_ret) {
+			return store_ret;
+		}
+	}
+	return db_ret;
+}
+
+static int jaldb_delivery_op_mark_sent(DB_TXN *txn, struct jaldb_delivery_op *op)
+{
+	DB *db = op->rdbs->delivery_db;
+	char found;
+
+	int db_ret = jaldb_delivery_find(db, txn, op->host, op->ts, op->nonce, &found);
+	if (DB_NOTFOUND == db_ret) {
+		return jaldb_delivery_put(db, txn, op->host, JALDB_DELIVERY_IN_FLIGHT,
+				op->ts, op->nonce);
+	}
+	if (0 != db_ret || JALDB_DELIVERY_IN_FLIGHT == found) {
+		return db_ret;
+	}
+	return jaldb_delivery_move(db, txn, op->host, found, JALDB_DELIVERY_IN_FLIGHT,
+			op->ts, op->nonce);
+}
+
+static int jaldb_delivery_op_mark_unsent(DB_TXN *txn, struct jaldb_delivery_op *op)
+{
+	DB *db = op->rdbs->delivery_db;
+	char found;
+
+	int db_ret = jaldb_delivery_find(db, txn, op->host, op->ts, op->nonce, &found);
+	if (0 != db_ret || JALDB_DELIVERY_RESEND == found) {
+		return db_ret;
+	}
+	if (JALDB_DELIVERY_SYNCED == found) {
+		return DB_NOTFOUND;
+	}
+	return jaldb_delivery_move(db, txn, op->host, found, JALDB_DELIVERY_RESEND,
+			op->ts, op->nonce);
+}
+
+/**
+ * Set the sent and synced flags of a record the first time any subscriber
+ * syncs it, so the purge tools know it was delivered. Only the headers are
+ * read and written, and a record that already has the flags is left alone.
+ */
+static int jaldb_delivery_flag_synced(DB_TXN *txn, struct jaldb_delivery_op *op)
+{
+	DB *db = op->rdbs->primary_db;
+	struct jaldb_serialize_record_headers headers;
+	uint32_t flags = JALDB_RFLAGS_SENT | JALDB_RFLAGS_SYNCED;
+	int byte_swap = 0;
+	DBT key;
+	DBT val;
+	memset(&key, 0, sizeof(key));
+	memset(&val, 0, sizeof(val));
+	key.data = (void *)op->nonce.c_str();
+	key.size = op->nonce.size() + 1;
+	val.data = &headers;
+	val.ulen = sizeof(headers);
+	val.dlen = sizeof(headers);
+	val.doff = 0;
+	val.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
+
+	int db_ret = db->get_byteswapped(db, &byte_swap);
+	if (0 != db_ret) {
+		return db_ret;
+	}
+	if (byte_swap) {
+		flags = jal_bswap_32(flags);
+	}
+
+	db_ret = db->get(db, txn, &key, &val, DB_RMW);
+	if (DB_NOTFOUND == db_ret) {
+		// The record was removed.
+		return 0;
+	}
+	if (0 != db_ret || val.size < sizeof(headers) ||
+			flags == (headers.flags & flags)) {
+		return db_ret;
+	}
+	headers.flags |= flags;
+	return db->put(db, txn, &key, &val, 0);
+}
+
+static int jaldb_delivery_op_mark_synced(DB_TXN *txn, struct jaldb_delivery_op *op)
+{
+	DB *db = op->rdbs->delivery_db;
+	struct jaldb_delivery_state state;
+	char found;
+
+	int db_ret = jaldb_delivery_find(db, txn, op->host, op->ts, op->nonce, &found);
+	if (0 != db_ret || JALDB_DELIVERY_SYNCED == found) {
+		return db_ret;
+	}
+	db_ret = jaldb_delivery_del(db, txn, op->host, found, op->ts, op->nonce);
+	if (0 == db_ret) {
+		db_ret = jaldb_delivery_flag_synced(txn, op);
+	}
+	if (0 != db_ret) {
+		return db_ret;
+	}
+
+	// Only records the in order scan may still reach need to be remembered.
+	db_ret = jaldb_delivery_load_state(db, txn, op->host, &state);
+	if (0 != db_ret || 0 > memcmp(op->ts, state.hwm, JALDB_DATETIME_KEY_LEN)) {
+		return db_ret;
+	}
+	return jaldb_delivery_put(db, txn, op->host, JALDB_DELIVERY_SYNCED,
+			op->ts, op->nonce);
+}
+
+static int jaldb_delivery_op_reset(DB_TXN *txn, struct jaldb_delivery_op *op)
+{
+	DB *db = op->rdbs->delivery_db;
+	std::string prefix = jaldb_delivery_state_key(op->host);
+	prefix.push_back(JALDB_DELIVERY_IN_FLIGHT);
+	std::vector<std::string> in_flight;
+	DBC *cursor = NULL;
+	DBT key;
+	DBT val;
+	memset(&key, 0, sizeof(key));
+	memset(&val, 0, sizeof(val));
+	key.flags = DB_DBT_REALLOC;
+	key.size = prefix.size();
+	key.data = jal_malloc(key.size);
+	memcpy(key.data, prefix.data(), key.size);
+	val.flags = DB_DBT_PARTIAL;
+
+	int db_ret = db->cursor(db, txn, &cursor, 0);
+	if (0 != db_ret) {
+		goto out;
+	}
+	db_ret = cursor->c_get(cursor, &key, &val, DB_SET_RANGE | DB_RMW);
+	while (0 == db_ret && key.size > prefix.size() &&
+			0 == memcmp(key.data, prefix.data(), prefix.size())) {
+		in_flight.push_back(std::string((char *)key.data, key.size));
+		db_ret = cursor->c_del(cursor, 0);
+		if (0 == db_ret) {
+			db_ret = cursor->c_get(cursor, &key, &val, DB_NEXT | DB_RMW);
+		}
+	}
+	if (0 != db_ret && DB_NOTFOUND != db_ret) {
+		goto out;
+	}
+	cursor->c_close(cursor);
+	cursor = NULL;
+
+	db_ret = 0;
+	for (size_t i = 0; i < in_flight.size() && 0 == db_ret; i++) {
+		in_flight[i][prefix.size() - 1] = JALDB_DELIVERY_RESEND;
+		DBT rkey;
+		DBT rval;
+		jaldb_delivery_set_dbt(&rkey, in_flight[i]);
+		memset(&rval, 0, sizeof(rval));
+		db_ret = db->put(db, txn, &rkey, &rval, 0);
+	}
+out:
+	if (cursor) {
+		cursor->c_close(cursor);
+	}
+	free(key.data);
+	return db_ret;
+}
+
+static int jaldb_delivery_op_seed(DB_TXN *txn, struct jaldb_delivery_op *op)
+{
+	DB *db = op->rdbs->delivery_db;
+	struct jaldb_serialize_record_headers *headers = NULL;
+	struct jaldb_delivery_state state;
+	uint32_t synced = JALDB_RFLAGS_SYNCED;
+	int byte_swap = 0;
+	bool in_order = true;
+	bool any = false;
+	DBC *cursor = NULL;
+	DBT key;
+	DBT pkey;
+	DBT val;
+	memset(&key, 0, sizeof(key));
+	memset(&pkey, 0, sizeof(pkey));
+	memset(&val, 0, sizeof(val));
+	key.flags = DB_DBT_REALLOC;
+	pkey.flags = DB_DBT_REALLOC;
+	val.flags = DB_DBT_REALLOC | DB_DBT_PARTIAL;
+	val.dlen = sizeof(*headers);
+
+	memset(state.hwm, 0, sizeof(state.hwm));
+	memset(state.pos, 0, sizeof(state.pos));
+	state.since_rescan = 0;
+
+	int db_ret = op->rdbs->primary_db->get_byteswapped(op->rdbs->primary_db, &byte_swap);
+	if (0 != db_ret) {
+		goto out;
+	}
+	if (byte_swap) {
+		synced = jal_bswap_32(synced);
+	}
+
+	// Subscribers already have state, or this was seeded before.
+	db_ret = db->cursor(db, txn, &cursor, 0);
+	if (0 != db_ret) {
+		goto out;
+	}
+	db_ret = cursor->c_get(cursor, &key, &val, DB_FIRST);
+	if (DB_NOTFOUND != db_ret) {
+		goto out;
+	}
+	cursor->c_close(cursor);
+	cursor = NULL;
+
+	db_ret = op->rdbs->nonce_timestamp_db->cursor(op->rdbs->nonce_timestamp_db,
+			txn, &cursor, 0);
+	if (0 != db_ret) {
+		goto out;
+	}
+	db_ret = cursor->c_pget(cursor, &key, &pkey, &val, DB_FIRST);
+	while (0 == db_ret) {
+		std::string nonce((char *)pkey.data);
+		headers = (struct jaldb_serialize_record_headers *)val.data;
+
+		if (!(headers->flags & synced)) {
+			// Sent but not synced records are simply sent again.
+			in_order = false;
+		} else if (in_order) {
+			memcpy(state.pos, key.data, JALDB_DATETIME_KEY_LEN);
+			state.pos_nonce = nonce;
+			any = true;
+		} else {
+			db_ret = jaldb_delivery_put(db, txn, JALDB_DELIVERY_SEED_HOST,
+					JALDB_DELIVERY_SYNCED, (uint8_t *)key.data, nonce);
+			if (0 != db_ret) {
+				goto out;
+			}
+			any = true;
+		}
+		db_ret = cursor->c_pget(cursor, &key, &pkey, &val, DB_NEXT);
+	}
+	if (DB_NOTFOUND != db_ret) {
+		goto out;
+	}
+
+	db_ret = 0;
+	if (any) {
+		memcpy(state.hwm, state.pos, JALDB_DATETIME_KEY_LEN);
+		db_ret = jaldb_delivery_store_state(db, txn, JALDB_DELIVERY_SEED_HOST, &state);
+	}
+out:
+	if (cursor) {
+		cursor->c_close(cursor);
+	}
+	free(key.data);
+	free(pkey.data);
+	free(val.data);
+	return db_ret;
+}
+
+/**
+ * Run \p fn in a transaction, retrying on deadlock. The transaction is
+ * committed if \p fn returns 0 or DB_NOTFOUND.
+ */
+static enum jaldb_status jaldb_delivery_run(DB_ENV *env,
+		jaldb_delivery_op_fn fn, struct jaldb_delivery_op *op)
+{
+	DB_TXN *txn = NULL;
+	int db_ret;
+
+	while (1) {
+		db_ret = env->txn_begin(env, NULL, &txn, 0);
+		if (0 != db_ret) {
+			return JALDB_E_DB;
+		}
+
+		db_ret = fn(txn, op);
+		if (0 == db_ret || DB_NOTFOUND == db_ret) {
+			int commit_ret = txn->commit(txn, 0);
+			if (0 != commit_ret) {
+				JALDB_DB_ERR(op->rdbs->delivery_db, commit_ret);
+				return JALDB_E_DB;
+			}
+			return (0 == db_ret) ? JALDB_OK : JALDB_E_NOT_FOUND;
+		}
+
+		txn->abort(txn);
+		if (DB_LOCK_DEADLOCK != db_ret) {
+			JALDB_DB_ERR(op->rdbs->delivery_db, db_ret);
+			return JALDB_E_DB;
+		}
+	}
+}
+
+/**
+ * Validate the arguments shared by every delivery function and fill in
+ * \p op.
+ */
+static enum jaldb_status jaldb_delivery_prepare(jaldb_context *ctx,
+		enum jaldb_rec_type type,
+		const char *remote_host,
+		const char *nonce,
+		struct jaldb_delivery_op *op)
+{
+	if (!ctx || !ctx->env || !remote_host || !*remote_host) {
+		return JALDB_E_INVAL;
+	}
+	op->rdbs = jaldb_delivery_get_dbs(ctx, type);
+	if (!op->rdbs || !op->rdbs->primary_db || !op->rdbs->delivery_db ||
+			!op->rdbs->nonce_timestamp_db) {
+		return JALDB_E_INVAL;
+	}
+	op->host = remote_host;
+	if (nonce) {
+		if (JALDB_OK != jaldb_delivery_nonce_ts(nonce, op->ts)) {
+			return JALDB_E_NOT_FOUND;
+		}
+		op->nonce = nonce;
+	}
+	return JALDB_OK;
+}
+
+enum jaldb_status jaldb_delivery_next_record(jaldb_context *ctx,
+		enum jaldb_rec_type type,
+		const char *remote_host,
+		char **nonce,
+		struct jaldb_record **rec)
+{
+	struct jaldb_delivery_op op;
+	enum jaldb_status ret;
+
+	if (!nonce || *nonce || !rec || *rec) {
+		return JALDB_E_INVAL;
+	}
+	ret = jaldb_delivery_prepare(ctx, type, remote_host, NULL, &op);
+	if (JALDB_OK != ret) {
+		return ret;
+	}
+
+	while (1) {
+		ret = jaldb_delivery_run(ctx->env, jaldb_delivery_op_next, &op);
+		if (JALDB_OK != ret) {
+			return ret;
+		}
+		ret = jaldb_get_record(ctx, type, (char *)op.nonce.c_str(), rec);
+		if (JALDB_E_NOT_FOUND != ret) {
+			break;
+		}
+		// The record was removed after it was picked, forget about it.
+		ret = jaldb_delivery_run(ctx->env, jaldb_delivery_op_mark_synced, &op);
+		if (JALDB_OK != ret) {
+			return ret;
+		}
+	}
+	if (JALDB_OK != ret) {
+		return ret;
+	}
+
+	*nonce = jal_strdup(op.nonce.c_str());
+	return JALDB_OK;
+}
+
+enum jaldb_status jaldb_delivery_mark_sent(jaldb_context *ctx,
+		enum jaldb_rec_type type,
+		const char *remote_host,
+		const char *nonce)
+{
+	struct jaldb_delivery_op op;
+	if (!nonce) {
+		return JALDB_E_INVAL;
+	}
+	enum jaldb_status ret = jaldb_delivery_prepare(ctx, type, remote_host, nonce, &op);
+	if (JALDB_OK != ret) {
+		return ret;
+	}
+	return jaldb_delivery_run(ctx->env, jaldb_delivery_op_mark_sent, &op);
+}
+
+enum jaldb_status jaldb_delivery_mark_unsent(jaldb_context *ctx,
+		enum jaldb_rec_type type,
+		const char *remote_host,
+		const char *nonce)
+{
+	struct jaldb_delivery_op op;
+	if (!nonce) {
+		return JALDB_E_INVAL;
+	}
+	enum jaldb_status ret = jaldb_delivery_prepare(ctx, type, remote_host, nonce, &op);
+	if (JALDB_OK != ret) {
+		return ret;
+	}
+	return jaldb_delivery_run(ctx->env, jaldb_delivery_op_mark_unsent, &op);
+}
+
+enum jaldb_status jaldb_delivery_mark_synced(jaldb_context *ctx,
+		enum jaldb_rec_type type,
+		const char *remote_host,
+		const char *nonce)
+{
+	struct jaldb_delivery_op op;
+	if (!nonce) {
+		return JALDB_E_INVAL;
+	}
+	enum jaldb_status ret = jaldb_delivery_prepare(ctx, type, remote_host, nonce, &op);
+	if (JALDB_OK != ret) {
+		return ret;
+	}
+	return jaldb_delivery_run(ctx->env, jaldb_delivery_op_mark_synced, &op);
+}
+
+enum jaldb_status jaldb_delivery_reset(jaldb_context *ctx,
+		enum jaldb_rec_type type,
+		const char *remote_host)
+{
+	struct jaldb_delivery_op op;
+	enum jaldb_status ret = jaldb_delivery_prepare(ctx, type, remote_host, NULL, &op);
+	if (JALDB_OK != ret) {
+		return ret;
+	}
+	ret = jaldb_delivery_run(ctx->env, jaldb_delivery_op_reset, &op);
+	return (JALDB_E_NOT_FOUND == ret) ? JALDB_OK : ret;
+}
+
+enum jaldb_status jaldb_delivery_seed(DB_ENV *env, struct jaldb_record_dbs *rdbs)
+{
+	struct jaldb_delivery_op op;
+
+	if (!env || !rdbs || !rdbs->primary_db || !rdbs->delivery_db ||
+			!rdbs->nonce_timestamp_db) {
+		return JALDB_E_INVAL;
+	}
+	op.rdbs = rdbs;
+	op.host = JALDB_DELIVERY_SEED_HOST;
+	enum jaldb_status ret = jaldb_delivery_run(env, jaldb_delivery_op_seed, &op);
+	return (JALDB_E_NOT_FOUND == ret) ? JALDB_OK : ret;
+}
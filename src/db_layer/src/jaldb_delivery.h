@@ -0,0 +1,168 @@
+/**
+ * @file jaldb_delivery.h This file defines functions for tracking which records
+ * have been delivered to each subscriber.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _JALDB_DELIVERY_H_
+#define _JALDB_DELIVERY_H_
+
+#include "jaldb_context.h"
+#include "jaldb_record.h"
+#include "jaldb_record_dbs.h"
+#include "jaldb_status.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Seconds a record has to commit after its nonce is generated. Records are
+ * ordered by the insertion time embedded in their nonce, but concurrent
+ * inserts may commit out of order. The delivery high-water mark trails the
+ * current time by this much so late commits are still found.
+ */
+#define JALDB_DELIVERY_SETTLE_SECS 10
+
+/**
+ * Get the next record to send to a subscriber in archive mode, and mark it
+ * as in flight for that subscriber.
+ *
+ * Every subscriber (i.e. remote host) has its own delivery state for each
+ * record type, so several subscribers each receive every record. Records
+ * waiting to be resent (see jaldb_delivery_mark_unsent() and
+ * jaldb_delivery_reset()) come first, followed by confirmed records in
+ * insertion order. Only the first sync of a record modifies it (see
+ * jaldb_delivery_mark_synced()).
+ *
+ * @param[in] ctx The context.
+ * @param[in] type The type of record to get.
+ * @param[in] remote_host The subscriber.
+ * @param[out] nonce Set to a copy of the nonce the record is stored under.
+ * This is the nonce to pass to the other jaldb_delivery functions.
+ * @param[out] rec Set to the record.
+ *
+ * @return JALDB_OK on success, JALDB_E_NOT_FOUND if there is nothing to
+ * send, JALDB_E_INVAL on bad input or if the DB was opened read-only
+ * before delivery tracking existed, or another error code.
+ */
+enum jaldb_status jaldb_delivery_next_record(jaldb_context *ctx,
+		enum jaldb_rec_type type,
+		const char *remote_host,
+		char **nonce,
+		struct jaldb_record **rec);
+
+/**
+ * Mark a record as in flight for a subscriber. This is only needed for
+ * records that were not returned by jaldb_delivery_next_record(), i.e. a
+ * journal record being resumed.
+ *
+ * @param[in] ctx The context.
+ * @param[in] type The type of the record.
+ * @param[in] remote_host The subscriber.
+ * @param[in] nonce The nonce the record is stored under.
+ *
+ * @return JALDB_OK on success, or an error code.
+ */
+enum jaldb_status jaldb_delivery_mark_sent(jaldb_context *ctx,
+		enum jaldb_rec_type type,
+		const char *remote_host,
+		const char *nonce);
+
+/**
+ * Queue an in flight record to be sent to a subscriber again, for
+ * instance because the digests did not match.
+ *
+ * @param[in] ctx The context.
+ * @param[in] type The type of the record.
+ * @param[in] remote_host The subscriber.
+ * @param[in] nonce The nonce the record is stored under.
+ *
+ * @return JALDB_OK on success, JALDB_E_NOT_FOUND if the record is not in
+ * flight for \p remote_host, or another error code.
+ */
+enum jaldb_status jaldb_delivery_mark_unsent(jaldb_context *ctx,
+		enum jaldb_rec_type type,
+		const char *remote_host,
+		const char *nonce);
+
+/**
+ * Record that a subscriber has synced a record. The subscriber will not be
+ * sent the record again.
+ *
+ * The first time any subscriber syncs the record, this also sets its sent
+ * and synced flags, which the purge tools look at. That only writes the
+ * record headers, and later syncs leave the record alone.
+ *
+ * @param[in] ctx The context.
+ * @param[in] type The type of the record.
+ * @param[in] remote_host The subscriber.
+ * @param[in] nonce The nonce the record is stored under.
+ *
+ * @return JALDB_OK on success, JALDB_E_NOT_FOUND if the record was not sent
+ * to \p remote_host, or another error code.
+ */
+enum jaldb_status jaldb_delivery_mark_synced(jaldb_context *ctx,
+		enum jaldb_rec_type type,
+		const char *remote_host,
+		const char *nonce);
+
+/**
+ * Queue every record that is in flight for a subscriber to be sent again.
+ * Call this when a subscriber (re)connects in archive mode, since anything
+ * sent on an earlier connection and not synced may not have arrived.
+ *
+ * @param[in] ctx The context.
+ * @param[in] type The type of record.
+ * @param[in] remote_host The subscriber.
+ *
+ * @return JALDB_OK on success, or an error code.
+ */
+enum jaldb_status jaldb_delivery_reset(jaldb_context *ctx,
+		enum jaldb_rec_type type,
+		const char *remote_host);
+
+/**
+ * Seed the delivery state of a DB created before the delivery DB existed,
+ * so subscribers aren't sent every record again. A subscriber with no state
+ * of its own is treated as having synced every record with the synced flag
+ * set. Records that were sent but never synced are sent again.
+ *
+ * This does nothing if any subscriber already has a state, so it may be
+ * re-run.
+ *
+ * @param[in] env The DB environment.
+ * @param[in] rdbs The DBs for one type of record.
+ *
+ * @return JALDB_OK on success, or an error code.
+ */
+enum jaldb_status jaldb_delivery_seed(DB_ENV *env, struct jaldb_record_dbs *rdbs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -69,7 +69,7 @@ enum jaldb_status jaldb_record_sanity_check(struct jaldb_record *rec)
 	if (rec == NULL) {
 		return JALDB_E_INVAL;
 	}
-	if (rec->version != JALDB_DB_LAYOUT_VERSION) {
+	if (rec->version != JALDB_RECORD_VERSION) {
 		return JALDB_E_INVAL;
 	}
 	if (!rec->source) {
@@ -28,6 +28,7 @@
  */
 
 #include <db.h>
+#include <errno.h>
 
 #include "jal_alloc.h"
 #include "jal_asprintf_internal.h"
@@ -80,6 +81,9 @@ void jaldb_destroy_record_dbs(struct jaldb_record_dbs **record_dbs)
 	if (rdbs->metadata_db) {
 		rdbs->metadata_db->close(rdbs->metadata_db, 0);
 	}
+	if (rdbs->delivery_db) {
+		rdbs->delivery_db->close(rdbs->delivery_db, 0);
+	}
 	free(rdbs);
 	*record_dbs = NULL;
 }
@@ -97,6 +101,7 @@ enum jaldb_status jaldb_create_primary_dbs_with_indices(
 
 	int db_ret;
 	enum jaldb_status ret;
+	u_int32_t assoc_flags = 0;
 	char *primary_name =  NULL;
 	char *timestamp_name = NULL;
 	char *nonce_timestamp_name = NULL;
@@ -106,6 +111,7 @@ enum jaldb_status jaldb_create_primary_dbs_with_indices(
 	char *nonce_name = NULL;
 	char *network_nonce_name = NULL;
 	char *metadata_name = NULL;
+	char *delivery_name = NULL;
 
 	struct jaldb_record_dbs *rdbs = jaldb_create_record_dbs();
 
@@ -119,6 +125,7 @@ enum jaldb_status jaldb_create_primary_dbs_with_indices(
 		jal_asprintf(&nonce_name, "%s_nonce.db", prefix);
 		jal_asprintf(&network_nonce_name, "%s_network_nonce_idx.db", prefix);
 		jal_asprintf(&metadata_name, "%s_metadata.db", prefix);
+		jal_asprintf(&delivery_name, "%s_delivery.db", prefix);
 	}
 
 	// Open the Primary DB. The Primary DB keys are nonces
@@ -143,9 +150,9 @@ enum jaldb_status jaldb_create_primary_dbs_with_indices(
 		goto err_out;
 	}
 
-	// Open the 'Timestamp' DB. The Primary DB keys are XML DateTime
-	// strings. The timestamp DB is is used as a secondary index for the
-	// primary DB.
+	// Open the 'Timestamp' DB. The keys are binary DateTime keys (see
+	// jaldb_datetime_to_key). The timestamp DB is is used as a secondary
+	// index for the primary DB.
 
 	db_ret = db_create(&(rdbs->timestamp_idx_db), env, 0);
 	if (db_ret != 0) {
@@ -161,7 +168,7 @@ enum jaldb_status jaldb_create_primary_dbs_with_indices(
 	}
 
 	db_ret = rdbs->timestamp_idx_db->set_bt_compare(rdbs->timestamp_idx_db,
-			jaldb_xml_datetime_compare);
+			jaldb_datetime_key_compare);
 	if (db_ret != 0) {
 		JALDB_DB_ERR((rdbs->timestamp_idx_db), db_ret);
 		ret = JALDB_E_DB;
@@ -176,9 +183,9 @@ enum jaldb_status jaldb_create_primary_dbs_with_indices(
 		goto err_out;
 	}
 
-	// Open the 'Nonce timestamp' DB. The Primary DB keys are XML DateTime
-	// strings. The nonce timestamp DB is is used as a secondary index for the
-	// primary DB.
+	// Open the 'Nonce timestamp' DB. The keys are binary DateTime keys (see
+	// jaldb_datetime_to_key). The nonce timestamp DB is is used as a
+	// secondary index for the primary DB.
 
 	db_ret = db_create(&(rdbs->nonce_timestamp_db), env, 0);
 	if (db_ret != 0) {
@@ -194,7 +201,7 @@ enum jaldb_status jaldb_create_primary_dbs_with_indices(
 	}
 
 	db_ret = rdbs->nonce_timestamp_db->set_bt_compare(rdbs->nonce_timestamp_db,
-			jaldb_xml_datetime_compare);
+			jaldb_datetime_key_compare);
 	if (db_ret != 0) {
 		JALDB_DB_ERR((rdbs->nonce_timestamp_db), db_ret);
 		ret = JALDB_E_DB;
@@ -317,10 +324,36 @@ enum jaldb_status jaldb_create_primary_dbs_with_indices(
                 ret = JALDB_E_DB;
                 goto err_out;
         }
- 
-	// Associate the databases for secondary keys.
+
+	// Open the delivery DB. This tracks which records have been sent to
+	// and synced by each subscriber and is *NOT* a secondary index. DBs
+	// created before it existed don't have it, which only matters to
+	// read-only users that never publish records.
+	db_ret = db_create(&(rdbs->delivery_db), env, 0);
+	if (db_ret != 0) {
+		ret = JALDB_E_DB;
+		goto err_out;
+	}
+	db_ret = rdbs->delivery_db->open(rdbs->delivery_db, txn,
+			delivery_name, NULL, DB_BTREE, db_flags, 0);
+	if (ENOENT == db_ret && (db_flags & DB_RDONLY)) {
+		rdbs->delivery_db->close(rdbs->delivery_db, 0);
+		rdbs->delivery_db = NULL;
+	} else if (db_ret != 0) {
+		JALDB_DB_ERR((rdbs->delivery_db), db_ret);
+		ret = JALDB_E_DB;
+		goto err_out;
+	}
+
+	// Associate the databases for secondary keys. When creating, any
+	// secondary index that is empty (i.e. one that was removed by
+	// jaldb_upgrade_db_layout) is rebuilt from the primary DB.
+	if (db_flags & DB_CREATE) {
+		assoc_flags = DB_CREATE;
+	}
+
 	db_ret = rdbs->primary_db->associate(rdbs->primary_db, txn, rdbs->timestamp_idx_db,
-			jaldb_extract_datetime_key, 0);
+			jaldb_extract_datetime_key, assoc_flags);
 	if (db_ret != 0) {
 		JALDB_DB_ERR((rdbs->primary_db), db_ret);
 		ret = JALDB_E_DB;
@@ -328,7 +361,7 @@ enum jaldb_status jaldb_create_primary_dbs_with_indices(
 	}
 
 	db_ret = rdbs->primary_db->associate(rdbs->primary_db, txn, rdbs->nonce_timestamp_db,
-			jaldb_extract_nonce_timestamp_key, 0);
+			jaldb_extract_nonce_timestamp_key, assoc_flags);
 	if (db_ret != 0) {
 		JALDB_DB_ERR((rdbs->primary_db), db_ret);
 		ret = JALDB_E_DB;
@@ -336,7 +369,7 @@ enum jaldb_status jaldb_create_primary_dbs_with_indices(
 	}
 
 	db_ret = rdbs->primary_db->associate(rdbs->primary_db, txn, rdbs->record_id_idx_db,
-			jaldb_extract_record_uuid, 0);
+			jaldb_extract_record_uuid, assoc_flags);
 	if (db_ret != 0) {
 		JALDB_DB_ERR((rdbs->primary_db), db_ret);
 		ret = JALDB_E_DB;
@@ -344,7 +377,7 @@ enum jaldb_status jaldb_create_primary_dbs_with_indices(
 	}
 
 	db_ret = rdbs->primary_db->associate(rdbs->primary_db, txn, rdbs->record_sent_db,
-			jaldb_extract_record_sent_flag, 0);
+			jaldb_extract_record_sent_flag, assoc_flags);
 	if (db_ret != 0) {
 		JALDB_DB_ERR((rdbs->primary_db), db_ret);
 		ret = JALDB_E_DB;
@@ -352,7 +385,7 @@ enum jaldb_status jaldb_create_primary_dbs_with_indices(
 	}
 
 	db_ret = rdbs->primary_db->associate(rdbs->primary_db, txn, rdbs->network_nonce_idx_db,
-			jaldb_extract_record_network_nonce, 0);
+			jaldb_extract_record_network_nonce, assoc_flags);
 	if (db_ret != 0) {
 		JALDB_DB_ERR((rdbs->primary_db), db_ret);
 		ret = JALDB_E_DB;
@@ -361,7 +394,7 @@ enum jaldb_status jaldb_create_primary_dbs_with_indices(
 
 
 	db_ret = rdbs->primary_db->associate(rdbs->primary_db, txn, rdbs->record_confirmed_db,
-			jaldb_extract_record_confirmed_flag, 0);
+			jaldb_extract_record_confirmed_flag, assoc_flags);
 	if (db_ret != 0) {
 		JALDB_DB_ERR((rdbs->primary_db), db_ret);
 		ret = JALDB_E_DB;
@@ -383,6 +416,7 @@ out:
 	free(record_confirmed_name);
 	free(nonce_name);
 	free(metadata_name);
+	free(delivery_name);
 	return ret;
 }
 
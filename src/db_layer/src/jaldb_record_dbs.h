@@ -53,6 +53,7 @@ struct jaldb_record_dbs {
 	DB *metadata_db;            //<! The database to use for storing metadata about unconfirmed records
 	DB *network_nonce_idx_db;   //<! The database to use for network nonce indices
 	DB *record_confirmed_db;    //<! The database to use for record confirmed flag indices.
+	DB *delivery_db;            //<! The database tracking delivery to each subscriber, NULL if unavailable
 };
 
 /**
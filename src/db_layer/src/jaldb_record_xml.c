@@ -40,6 +40,7 @@
 #include "jaldb_record.h"
 #include "jaldb_record_xml.h"
 #include "jal_xml_utils.h"
+#include "jal_xml_writer.h"
 
 #define JALDB_XSI_NS         "http://www.w3.org/2001/XMLSchema-instance"
 #define JALDB_JID            "JID"
@@ -52,11 +53,9 @@
 #define JALDB_PROCESS_ID_TAG "ProcessID"
 #define JALDB_USER_TAG       "User"
 #define JALDB_USERNAME_PROP  "name"
+#define JALDB_XSI_NIL        "xsi:nil"
 #define JALDB_SEC_LABEL_TAG  "SecurityLabel"
-#define JALDB_MANIFEST_START "<ds:Manifest xmlns='http://www.w3.org/2000/09/xmldsig#'>"
-#define JALDB_REF_START      "<ds:Reference URI='jalop:payload'>"
-#define JALDB_DGST_METH_TAG  "<ds:DigestMethod Algorithm='http://www.w3.org/2001/04/xmlenc#sha256'/>"
-#define JALDB_DGST_VAL_TAG   "<ds:DigestValue>%s</DigestValue>"
+#define JALDB_MANIFEST_TAG   "Manifest"
 #define JALDB_JOURNAL "journal"
 #define JALDB_AUDIT "audit"
 #define JALDB_LOG "log"
@@ -66,6 +65,58 @@
 #define PID_STR_MAX_LEN 10
 #define UID_STR_MAX_LEN 22
 
+/**
+ * Add an enveloped signature to the system metadata document in \p writer.
+ * xmlsec needs a tree to sign, so the document is parsed back with libxml2.
+ * The signature goes in front of the manifest, if there is one.
+ */
+static enum jaldb_status jaldb_sign_system_metadata(RSA *signing_key,
+		struct jal_xml_writer *writer, const char *jid,
+		char **doc, size_t *dsize)
+{
+	enum jaldb_status ret = JALDB_E_INVAL;
+	enum jal_status jal_ret;
+	xmlDocPtr xml_doc = NULL;
+	xmlNodePtr root_node;
+	xmlNodePtr last_node;
+	xmlAttrPtr attr;
+	xmlChar *res = NULL;
+
+	xml_doc = xmlReadMemory(writer->buf, writer->len, NULL, NULL, XML_PARSE_NOBLANKS | XML_PARSE_NONET);
+	if (!xml_doc) {
+		goto out;
+	}
+	root_node = xmlDocGetRootElement(xml_doc);
+	attr = xmlHasProp(root_node, (xmlChar *) JALDB_JID);
+	if (!attr || !attr->children) {
+		goto out;
+	}
+	xmlAddID(NULL, xml_doc, (xmlChar *) jid, attr);
+
+	last_node = xmlLastElementChild(root_node);
+	if (last_node && 0 != xmlStrcmp(last_node->name, (xmlChar *) JALDB_MANIFEST_TAG)) {
+		last_node = NULL;
+	}
+
+	jal_ret = jal_add_signature_block(signing_key, NULL, xml_doc, last_node, jid);
+	if (jal_ret != JAL_OK) {
+		ret = (enum jaldb_status) jal_ret;
+		goto out;
+	}
+
+	jal_ret = jal_xml_output(xml_doc, &res, dsize);
+	if (jal_ret != JAL_OK) {
+		ret = (enum jaldb_status) jal_ret;
+		free(res);
+		goto out;
+	}
+	*doc = (char *) res;
+	ret = JALDB_OK;
+out:
+	xmlFreeDoc(xml_doc);
+	return ret;
+}
+
 enum jaldb_status jaldb_record_to_system_metadata_doc(struct jaldb_record *rec,
 						RSA* signing_key,
 						uint8_t *app_meta_dgst, size_t app_meta_dgst_len, const char *app_meta_algorithm_uri,
@@ -78,12 +129,10 @@ enum jaldb_status jaldb_record_to_system_metadata_doc(struct jaldb_record *rec,
 	char host_uuid_str[UUID_STR_LEN];
 	char pid_str[PID_STR_MAX_LEN];
 	char uid_str[UID_STR_MAX_LEN];
-	xmlChar *res = NULL;
 	char *type_str;
-	xmlDocPtr xmlDoc = NULL;
-	xmlNodePtr root_node = NULL;
+	struct jal_xml_writer writer = { NULL, 0, 0 };
 
-	if (!rec || !doc || *doc) {
+	if (!rec || !doc || *doc || !dsize) {
 		return JALDB_E_INVAL;
 	}
 
@@ -119,92 +168,69 @@ enum jaldb_status jaldb_record_to_system_metadata_doc(struct jaldb_record *rec,
 		}
 	}
 
-	xmlDoc = xmlNewDoc((xmlChar *) "1.0");
-	root_node = xmlNewDocNode(xmlDoc, NULL, (xmlChar *) JALDB_RECORD_TAG, NULL);
-	xmlSetProp(root_node, (xmlChar *) JALDB_JID, (xmlChar *) uuid_str_with_prefix);
-
-	xmlNsPtr ns = xmlNewNs(root_node, (xmlChar *) JAL_SYS_META_NAMESPACE_URI, NULL);
-	xmlSetNs(root_node, ns);
-
-	xmlDocSetRootElement(xmlDoc, root_node);
+	// The document is laid out exactly the way xmlDocDumpFormatMemory()
+	// would write the equivalent DOM.
+	jal_xml_write_str(&writer, JAL_XML_DECLARATION);
+	jal_xml_write_start_tag(&writer, 0, JALDB_RECORD_TAG, JAL_SYS_META_NAMESPACE_URI);
+	jal_xml_write_attr(&writer, JALDB_JID, uuid_str_with_prefix);
+	jal_xml_write_str(&writer, ">\n");
 
-	xmlAttrPtr attr = xmlHasProp(root_node, (xmlChar *)JALDB_JID);
-	if (!attr || !attr->children) {
-		xmlFreeDoc(xmlDoc);
-		return JALDB_E_INVAL;
-	}
-	xmlAddID(NULL, xmlDoc, (xmlChar *)uuid_str_with_prefix, attr);
-
-	xmlNewChild(root_node, NULL, (xmlChar *) JALDB_DATA_TYPE_TAG, (xmlChar *) type_str);
-	xmlNewChild(root_node, NULL, (xmlChar *) JALDB_RECORD_ID_TAG, (xmlChar *) uuid_str);
-	xmlNewChild(root_node, NULL, (xmlChar *) JALDB_HOSTNAME_TAG, (xmlChar *) rec->hostname);
-	xmlNewChild(root_node, NULL, (xmlChar *) JALDB_HOST_UUID_TAG, (xmlChar *) host_uuid_str);
-	xmlNewChild(root_node, NULL, (xmlChar *) JALDB_TIMESTAMP_TAG, (xmlChar *) rec->timestamp);
-	xmlNewChild(root_node, NULL, (xmlChar *) JALDB_PROCESS_ID_TAG, (xmlChar *) pid_str);
-	xmlNodePtr last_node = xmlNewChild(root_node, NULL, (xmlChar *) JALDB_USER_TAG, NULL);
-	xmlSetProp(last_node, (xmlChar *) JALDB_USERNAME_PROP, (xmlChar *) rec->username);
+	jal_xml_write_text_element(&writer, 1, JALDB_DATA_TYPE_TAG, NULL, type_str);
+	jal_xml_write_text_element(&writer, 1, JALDB_RECORD_ID_TAG, NULL, uuid_str);
+	jal_xml_write_text_element(&writer, 1, JALDB_HOSTNAME_TAG, NULL, rec->hostname);
+	jal_xml_write_text_element(&writer, 1, JALDB_HOST_UUID_TAG, NULL, host_uuid_str);
+	jal_xml_write_text_element(&writer, 1, JALDB_TIMESTAMP_TAG, NULL, rec->timestamp);
+	jal_xml_write_text_element(&writer, 1, JALDB_PROCESS_ID_TAG, NULL, pid_str);
 
 	if (rec->have_uid) {
-		xmlNodeSetContent(last_node, (xmlChar *) uid_str);
+		jal_xml_write_start_tag(&writer, 1, JALDB_USER_TAG, NULL);
+		jal_xml_write_attr(&writer, JALDB_USERNAME_PROP, rec->username);
+		jal_xml_write_close_text(&writer, JALDB_USER_TAG, uid_str);
 	} else {
-		// TODO
-		ns = xmlNewNs(last_node, (xmlChar *) JALDB_XSI_NS, (xmlChar*) "xsi");
-		xmlNewNsProp(last_node, ns, (xmlChar *) "nil", (xmlChar *) "true");
+		jal_xml_write_start_tag(&writer, 1, JALDB_USER_TAG, NULL);
+		jal_xml_write_attr(&writer, "xmlns:xsi", JALDB_XSI_NS);
+		jal_xml_write_attr(&writer, JALDB_USERNAME_PROP, rec->username);
+		jal_xml_write_attr(&writer, JALDB_XSI_NIL, "true");
+		jal_xml_write_str(&writer, "/>\n");
 	}
 
 	if (rec->sec_lbl) {
-		last_node = xmlNewChild(root_node, NULL, (xmlChar *) JALDB_SEC_LABEL_TAG, (xmlChar *) rec->sec_lbl);
+		jal_xml_write_text_element(&writer, 1, JALDB_SEC_LABEL_TAG, NULL, rec->sec_lbl);
 	}
 
 	if (payload_dgst || app_meta_dgst) {
-		xmlNodePtr manifest = xmlNewDocNode(xmlDoc, NULL, (xmlChar *)"Manifest", NULL);
-		xmlChar *namespace_uri = (xmlChar *)JAL_XMLDSIG_URI;
-		ns = xmlNewNs(manifest, namespace_uri, NULL);
-		xmlSetNs(manifest, ns);
-		xmlAddChild(root_node, manifest);
-
-		xmlNodePtr reference_elem = NULL;
+		jal_xml_write_start_tag(&writer, 1, JALDB_MANIFEST_TAG, JAL_XMLDSIG_URI);
+		jal_xml_write_str(&writer, ">\n");
 		if (payload_dgst) {
-			ret = jal_create_reference_elem(JAL_PAYLOAD_URI, payload_algorithm_uri, payload_dgst, payload_dgst_len, xmlDoc, &reference_elem);
-			if (ret != JAL_OK) {
-				xmlFreeDoc(xmlDoc);
-				return ret;
+			if (JAL_OK != jal_xml_write_reference(&writer, 2, JAL_PAYLOAD_URI,
+					payload_algorithm_uri, payload_dgst, payload_dgst_len, 0)) {
+				ret = JALDB_E_INVAL;
+				goto out;
 			}
-
-			xmlAddChild(manifest, reference_elem);
 		}
 		if (app_meta_dgst) {
-			reference_elem = NULL;
-			ret = jal_create_reference_elem(JAL_APP_META_URI, app_meta_algorithm_uri, app_meta_dgst, app_meta_dgst_len, xmlDoc, &reference_elem);
-			if (ret != JAL_OK) {
-				xmlFreeDoc(xmlDoc);
-				return ret;
+			if (JAL_OK != jal_xml_write_reference(&writer, 2, JAL_APP_META_URI,
+					app_meta_algorithm_uri, app_meta_dgst, app_meta_dgst_len, 0)) {
+				ret = JALDB_E_INVAL;
+				goto out;
 			}
-
-			xmlAddChild(manifest, reference_elem);
-
 		}
-		last_node = manifest;
-	} else {
-		last_node = NULL;
-	} 
+		jal_xml_write_end_tag(&writer, 1, JALDB_MANIFEST_TAG);
+	}
+
+	jal_xml_write_end_tag(&writer, 0, JALDB_RECORD_TAG);
 
 	if (signing_key) {
-		ret = jal_add_signature_block(signing_key, NULL, xmlDoc, last_node, uuid_str_with_prefix);
-		if (ret != JAL_OK) {
-			xmlFreeDoc(xmlDoc);
-			return ret;
-		}
+		ret = jaldb_sign_system_metadata(signing_key, &writer, uuid_str_with_prefix, doc, dsize);
+		goto out;
 	}
 
-	ret = jal_xml_output(xmlDoc, &res, dsize);
-	if (ret != JAL_OK) {
-		free(res);
-		xmlFreeDoc(xmlDoc);
-		return ret;
-	}
-	*doc = (char *) res;
-	xmlFreeDoc(xmlDoc);
+	*doc = writer.buf;
+	*dsize = writer.len;
+	writer.buf = NULL;
+	ret = JALDB_OK;
+out:
+	jal_xml_writer_free(&writer);
 	return ret;
 }
 
@@ -281,18 +307,27 @@ void jaldb_start_element(void *user_data,
 	sp_user_data->chars = NULL;
 }
 
-static void handle_type(struct sax_parse_user_data *sp_user_data,
-		const char *name,
-		int len)
+static enum jaldb_rec_type jaldb_rec_type_from_chars(const char *name, size_t len)
 {
+	if (!name || 0 == len) {
+		return JALDB_RTYPE_UNKNOWN;
+	}
 	if (0 == strncmp(name, JALDB_JOURNAL, len)) {
-		sp_user_data->sys_meta->type = JALDB_RTYPE_JOURNAL;
+		return JALDB_RTYPE_JOURNAL;
 	} else if (0 == strncmp(name, JALDB_AUDIT, len)) {
-		sp_user_data->sys_meta->type = JALDB_RTYPE_AUDIT;
+		return JALDB_RTYPE_AUDIT;
 	} else if (0 == strncmp(name, JALDB_LOG, len)) {
-		sp_user_data->sys_meta->type = JALDB_RTYPE_LOG;
-	} else {
-		sp_user_data->sys_meta->type = JALDB_RTYPE_UNKNOWN;
+		return JALDB_RTYPE_LOG;
+	}
+	return JALDB_RTYPE_UNKNOWN;
+}
+
+static void handle_type(struct sax_parse_user_data *sp_user_data,
+		const char *name,
+		int len)
+{
+	sp_user_data->sys_meta->type = jaldb_rec_type_from_chars(name, len);
+	if (JALDB_RTYPE_UNKNOWN == sp_user_data->sys_meta->type) {
 		sp_user_data->ret = JALDB_E_INVAL;
 	}
 }
@@ -322,27 +357,31 @@ void jaldb_end_element(void *user_data,
 	} else if (0 == strcmp((char *)name, JALDB_DATA_TYPE_TAG)) {
 		handle_type(sp_user_data,sp_user_data->chars,sp_user_data->chars_len);
 	} else if (0 == strcmp((char *)name, JALDB_RECORD_ID_TAG)) {
-		if (-1 == uuid_parse(sp_user_data->chars,sp_user_data->sys_meta->uuid)) {
+		if (!sp_user_data->chars || -1 == uuid_parse(sp_user_data->chars,sp_user_data->sys_meta->uuid)) {
 			sp_user_data->ret = JALDB_E_INVAL;
 		}
 	} else if (0 == strcmp((char *)name, JALDB_HOSTNAME_TAG)) {
 		sp_user_data->sys_meta->hostname = sp_user_data->chars;
 		sp_user_data->chars = NULL;
 	} else if (0 == strcmp((char *)name, JALDB_HOST_UUID_TAG)) {
-		if (-1 == uuid_parse(sp_user_data->chars,sp_user_data->sys_meta->host_uuid)) {
+		if (!sp_user_data->chars || -1 == uuid_parse(sp_user_data->chars,sp_user_data->sys_meta->host_uuid)) {
 			sp_user_data->ret = JALDB_E_INVAL;
 		}
 	} else if (0 == strcmp((char *)name, JALDB_TIMESTAMP_TAG)) {
 		sp_user_data->sys_meta->timestamp = sp_user_data->chars;
 		sp_user_data->chars = NULL;
 	} else if (0 == strcmp((char *)name, JALDB_PROCESS_ID_TAG)) {
-		errno=0;
-		uint64_t pid = (uint64_t)strtoul((const char *)sp_user_data->chars,NULL,0);
-		if (errno != 0) {
+		if (!sp_user_data->chars) {
 			sp_user_data->ret = JALDB_E_INVAL;
+		} else {
+			errno=0;
+			uint64_t pid = (uint64_t)strtoul((const char *)sp_user_data->chars,NULL,0);
+			if (errno != 0) {
+				sp_user_data->ret = JALDB_E_INVAL;
+			}
+			sp_user_data->sys_meta->pid = pid;
 		}
-		sp_user_data->sys_meta->pid = pid;
-	} else if (0 == strcmp((char *)sp_user_data->tag_name, JALDB_USER_TAG)) {
+	} else if (sp_user_data->tag_name && 0 == strcmp((char *)sp_user_data->tag_name, JALDB_USER_TAG)) {
 		errno=0;
 		if (sp_user_data->chars != NULL) {
 			uint64_t uid = (uint64_t)strtoul((const char *)sp_user_data->chars,NULL,0);
@@ -351,7 +390,7 @@ void jaldb_end_element(void *user_data,
 			}
 			sp_user_data->sys_meta->uid = uid;
 		}
-	} else if (0 == strcmp((char *)sp_user_data->tag_name, JALDB_SEC_LABEL_TAG)) {
+	} else if (sp_user_data->tag_name && 0 == strcmp((char *)sp_user_data->tag_name, JALDB_SEC_LABEL_TAG)) {
 		sp_user_data->sys_meta->sec_lbl = sp_user_data->chars;
 		sp_user_data->chars = NULL;
 	}
@@ -372,7 +411,7 @@ void jaldb_xml_error(void *user_data,const char * msg, ...)
 	sp_user_data->ret = JALDB_E_INVAL;
 }
 
-enum jal_status jaldb_xml_to_sys_metadata(uint8_t *xml, size_t xml_len, struct jaldb_record **sys_meta)
+enum jal_status jaldb_parse_sys_metadata_xml(uint8_t *xml, size_t xml_len, struct jaldb_record **sys_meta)
 {
 	struct sax_parse_user_data *sp_user_data = (struct sax_parse_user_data *)jal_calloc(1,sizeof(struct sax_parse_user_data));
 	*sys_meta = jaldb_create_record();
@@ -390,10 +429,479 @@ enum jal_status jaldb_xml_to_sys_metadata(uint8_t *xml, size_t xml_len, struct j
 	sys_meta_handler.fatalError = &jaldb_xml_error;
 	sys_meta_handler.cdataBlock = &jaldb_cdata_handler;
 
-	xmlSAXUserParseMemory(&sys_meta_handler,sp_user_data,(char*)xml,(int)xml_len);
+	if (0 != xmlSAXUserParseMemory(&sys_meta_handler,sp_user_data,(char*)xml,(int)xml_len)) {
+		// Not every error gets to the callbacks, e.g. an empty buffer.
+		sp_user_data->ret = JALDB_E_INVAL;
+	}
 
 	enum jal_status ret;
 	ret = sp_user_data->ret;
+	if (JAL_OK != ret) {
+		// Usually already destroyed at the end of the document.
+		jaldb_destroy_record(&sp_user_data->sys_meta);
+		*sys_meta = NULL;
+	}
+	// A document that stops with an error leaves its text behind.
+	free(sp_user_data->chars);
 	free(sp_user_data);
 	return ret;
 }
+
+/*
+ * The system metadata is first read with a plain scan of the buffer, which
+ * needs no libxml2 callbacks and copies only the fields it keeps. It handles
+ * the layout JALoP writes: an ASCII document without references, comments,
+ * CDATA sections or processing instructions, with the fields as text-only
+ * children of the root element. Anything else is left to the SAX parser.
+ */
+#define JALDB_SCAN_MAX_DEPTH 32
+#define JALDB_SCAN_MAX_ATTRS 8
+#define JALDB_SCAN_NUM_STR_MAX_LEN 32
+
+enum jaldb_scan_field {
+	JALDB_SCAN_DATA_TYPE,
+	JALDB_SCAN_RECORD_ID,
+	JALDB_SCAN_HOSTNAME,
+	JALDB_SCAN_HOST_UUID,
+	JALDB_SCAN_TIMESTAMP,
+	JALDB_SCAN_PROCESS_ID,
+	JALDB_SCAN_USER,
+	JALDB_SCAN_SEC_LABEL,
+	JALDB_SCAN_NUM_FIELDS
+};
+
+static const char *jaldb_scan_field_tags[JALDB_SCAN_NUM_FIELDS] = {
+	JALDB_DATA_TYPE_TAG,
+	JALDB_RECORD_ID_TAG,
+	JALDB_HOSTNAME_TAG,
+	JALDB_HOST_UUID_TAG,
+	JALDB_TIMESTAMP_TAG,
+	JALDB_PROCESS_ID_TAG,
+	JALDB_USER_TAG,
+	JALDB_SEC_LABEL_TAG
+};
+
+struct jaldb_scan_str {
+	const char *str;
+	size_t len;
+};
+
+struct jaldb_scan_tag {
+	struct jaldb_scan_str name;
+	struct jaldb_scan_str attr_names[JALDB_SCAN_MAX_ATTRS];
+	struct jaldb_scan_str attr_values[JALDB_SCAN_MAX_ATTRS];
+	int num_attrs;
+	int empty;
+};
+
+static int jaldb_scan_is_space(char c)
+{
+	return ' ' == c || '\t' == c || '\n' == c || '\r' == c;
+}
+
+static int jaldb_scan_is_name_start(char c)
+{
+	return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || '_' == c || ':' == c;
+}
+
+static int jaldb_scan_is_name_char(char c)
+{
+	return jaldb_scan_is_name_start(c) || ('0' <= c && c <= '9') || '-' == c || '.' == c;
+}
+
+static const char *jaldb_scan_skip_space(const char *pos, const char *end)
+{
+	while (pos < end && jaldb_scan_is_space(*pos)) {
+		pos++;
+	}
+	return pos;
+}
+
+static int jaldb_scan_str_equals(const struct jaldb_scan_str *a, const char *b)
+{
+	return a->len == strlen(b) && 0 == memcmp(a->str, b, a->len);
+}
+
+static int jaldb_scan_str_same(const struct jaldb_scan_str *a, const struct jaldb_scan_str *b)
+{
+	return a->len == b->len && 0 == memcmp(a->str, b->str, a->len);
+}
+
+/*
+ * Check that \p len bytes at \p s are character data that reads the same
+ * without an XML parser: ASCII, without markup or references, and without
+ * any of the characters in \p reject.
+ */
+static int jaldb_scan_check_text(const char *s, size_t len, const char *reject)
+{
+	size_t i;
+	for (i = 0; i < len; i++) {
+		unsigned char c = (unsigned char) s[i];
+		if (0x20 < c && 0x80 > c && '<' != c && '&' != c && '>' != c) {
+			continue;
+		}
+		if (0x80 <= c || '<' == c || '&' == c) {
+			return -1;
+		}
+		if ('>' == c) {
+			if (2 <= i && ']' == s[i - 1] && ']' == s[i - 2]) {
+				return -1;
+			}
+		} else if (' ' != c && (!jaldb_scan_is_space(c) || strchr(reject, c))) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static const char *jaldb_scan_name(const char *pos, const char *end,
+		struct jaldb_scan_str *name)
+{
+	const char *start = pos;
+	if (pos == end || !jaldb_scan_is_name_start(*pos)) {
+		return NULL;
+	}
+	while (++pos < end && jaldb_scan_is_name_char(*pos));
+	name->str = start;
+	name->len = pos - start;
+	return pos;
+}
+
+/*
+ * Scan the attributes of a tag up to the first character that does not
+ * belong to one, and return the position of that character.
+ */
+static const char *jaldb_scan_attrs(const char *pos, const char *end,
+		struct jaldb_scan_tag *tag)
+{
+	tag->num_attrs = 0;
+	while (1) {
+		const char *next = jaldb_scan_skip_space(pos, end);
+		const char *close;
+		int i = tag->num_attrs;
+		int j;
+		if (next == end || !jaldb_scan_is_name_start(*next)) {
+			return next;
+		}
+		if (next == pos || JALDB_SCAN_MAX_ATTRS == i) {
+			return NULL;
+		}
+		pos = jaldb_scan_name(next, end, &tag->attr_names[i]);
+		pos = jaldb_scan_skip_space(pos, end);
+		if (pos == end || '=' != *pos) {
+			return NULL;
+		}
+		pos = jaldb_scan_skip_space(pos + 1, end);
+		if (pos == end || ('"' != *pos && '\'' != *pos)) {
+			return NULL;
+		}
+		close = memchr(pos + 1, *pos, end - pos - 1);
+		if (!close) {
+			return NULL;
+		}
+		tag->attr_values[i].str = pos + 1;
+		tag->attr_values[i].len = close - pos - 1;
+		// A parser normalizes whitespace in an attribute value.
+		if (jaldb_scan_check_text(tag->attr_values[i].str, tag->attr_values[i].len, "\t\n\r")) {
+			return NULL;
+		}
+		for (j = 0; j < i; j++) {
+			if (jaldb_scan_str_same(&tag->attr_names[i], &tag->attr_names[j])) {
+				return NULL;
+			}
+		}
+		tag->num_attrs++;
+		pos = close + 1;
+	}
+}
+
+/* Scan a start tag, \p pos is just past the '<'. */
+static const char *jaldb_scan_start_tag(const char *pos, const char *end,
+		struct jaldb_scan_tag *tag)
+{
+	pos = jaldb_scan_name(pos, end, &tag->name);
+	if (!pos) {
+		return NULL;
+	}
+	pos = jaldb_scan_attrs(pos, end, tag);
+	if (!pos || pos == end) {
+		return NULL;
+	}
+	tag->empty = 0;
+	if ('/' == *pos) {
+		tag->empty = 1;
+		if (++pos == end) {
+			return NULL;
+		}
+	}
+	if ('>' != *pos) {
+		return NULL;
+	}
+	return pos + 1;
+}
+
+/* Scan the end tag for \p name, \p pos is just past the "</". */
+static const char *jaldb_scan_end_tag(const char *pos, const char *end,
+		const struct jaldb_scan_str *name)
+{
+	struct jaldb_scan_str end_name;
+	pos = jaldb_scan_name(pos, end, &end_name);
+	if (!pos || !jaldb_scan_str_same(&end_name, name)) {
+		return NULL;
+	}
+	pos = jaldb_scan_skip_space(pos, end);
+	if (pos == end || '>' != *pos) {
+		return NULL;
+	}
+	return pos + 1;
+}
+
+/* Scan an XML declaration for UTF-8, \p pos is at the "<?xml". */
+static const char *jaldb_scan_xml_decl(const char *pos, const char *end)
+{
+	static const char *names[] = { "version", "encoding", "standalone" };
+	struct jaldb_scan_tag decl;
+	int next = 0;
+	int i;
+	pos = jaldb_scan_attrs(pos + strlen("<?xml"), end, &decl);
+	if (!pos || 2 > end - pos || 0 != memcmp(pos, "?>", 2) || 0 == decl.num_attrs) {
+		return NULL;
+	}
+	for (i = 0; i < decl.num_attrs; i++) {
+		struct jaldb_scan_str *value = &decl.attr_values[i];
+		while (next < 3 && !jaldb_scan_str_equals(&decl.attr_names[i], names[next])) {
+			next++;
+		}
+		if (3 == next || (0 == i && 0 != next)) {
+			return NULL;
+		}
+		if ((0 == next && !jaldb_scan_str_equals(value, "1.0")) ||
+				(1 == next && (5 != value->len || 0 != strncasecmp(value->str, "UTF-8", 5))) ||
+				(2 == next && !jaldb_scan_str_equals(value, "yes") && !jaldb_scan_str_equals(value, "no"))) {
+			return NULL;
+		}
+		next++;
+	}
+	return pos + 2;
+}
+
+/*
+ * Parse a number or UUID the way the SAX parser does, from a copy of the
+ * field as a string.
+ */
+static int jaldb_scan_parse_uuid(const struct jaldb_scan_str *field, uuid_t uuid)
+{
+	char buf[UUID_STR_LEN];
+	if (0 == field->len) {
+		return -1;
+	}
+	memcpy(buf, field->str, field->len);
+	buf[field->len] = '\0';
+	return uuid_parse(buf, uuid);
+}
+
+static int jaldb_scan_parse_num(const struct jaldb_scan_str *field, uint64_t *num)
+{
+	char buf[JALDB_SCAN_NUM_STR_MAX_LEN + 1];
+	if (0 == field->len) {
+		return -1;
+	}
+	memcpy(buf, field->str, field->len);
+	buf[field->len] = '\0';
+	errno = 0;
+	*num = (uint64_t) strtoul(buf, NULL, 0);
+	return (0 != errno) ? -1 : 0;
+}
+
+/*
+ * Fill in a record from the fields found by jaldb_scan_sys_metadata(), with
+ * the same checks the SAX parser makes.
+ */
+static enum jaldb_status jaldb_scan_fields_to_record(const struct jaldb_scan_str *fields,
+		const int *found, const struct jaldb_scan_str *username,
+		struct jaldb_record **sys_meta)
+{
+	enum jaldb_status ret = JALDB_E_NOT_IMPL;
+	struct jaldb_record *rec = NULL;
+
+	// Leave fields too long to be a UUID or number to the SAX parser.
+	if (fields[JALDB_SCAN_RECORD_ID].len >= UUID_STR_LEN ||
+			fields[JALDB_SCAN_HOST_UUID].len >= UUID_STR_LEN ||
+			fields[JALDB_SCAN_PROCESS_ID].len > JALDB_SCAN_NUM_STR_MAX_LEN ||
+			fields[JALDB_SCAN_USER].len > JALDB_SCAN_NUM_STR_MAX_LEN) {
+		goto out;
+	}
+
+	rec = jaldb_create_record();
+	ret = JALDB_E_INVAL;
+	if (found[JALDB_SCAN_DATA_TYPE]) {
+		rec->type = jaldb_rec_type_from_chars(fields[JALDB_SCAN_DATA_TYPE].str,
+				fields[JALDB_SCAN_DATA_TYPE].len);
+		if (JALDB_RTYPE_UNKNOWN == rec->type) {
+			goto out;
+		}
+	}
+	if (found[JALDB_SCAN_RECORD_ID] &&
+			0 != jaldb_scan_parse_uuid(&fields[JALDB_SCAN_RECORD_ID], rec->uuid)) {
+		goto out;
+	}
+	if (found[JALDB_SCAN_HOST_UUID] &&
+			0 != jaldb_scan_parse_uuid(&fields[JALDB_SCAN_HOST_UUID], rec->host_uuid)) {
+		goto out;
+	}
+	if (found[JALDB_SCAN_PROCESS_ID] &&
+			0 != jaldb_scan_parse_num(&fields[JALDB_SCAN_PROCESS_ID], &rec->pid)) {
+		goto out;
+	}
+	// An empty User element leaves the UID alone.
+	if (fields[JALDB_SCAN_USER].len &&
+			0 != jaldb_scan_parse_num(&fields[JALDB_SCAN_USER], &rec->uid)) {
+		goto out;
+	}
+	if (fields[JALDB_SCAN_HOSTNAME].len) {
+		rec->hostname = jal_strndup(fields[JALDB_SCAN_HOSTNAME].str, fields[JALDB_SCAN_HOSTNAME].len);
+	}
+	if (fields[JALDB_SCAN_TIMESTAMP].len) {
+		rec->timestamp = jal_strndup(fields[JALDB_SCAN_TIMESTAMP].str, fields[JALDB_SCAN_TIMESTAMP].len);
+	}
+	if (fields[JALDB_SCAN_SEC_LABEL].len) {
+		rec->sec_lbl = jal_strndup(fields[JALDB_SCAN_SEC_LABEL].str, fields[JALDB_SCAN_SEC_LABEL].len);
+	}
+	if (username) {
+		rec->username = jal_strndup(username->str, username->len);
+	}
+	if (!rec->hostname || !rec->timestamp || !rec->username) {
+		goto out;
+	}
+	*sys_meta = rec;
+	rec = NULL;
+	ret = JALDB_OK;
+out:
+	jaldb_destroy_record(&rec);
+	return ret;
+}
+
+enum jaldb_status jaldb_scan_sys_metadata(const uint8_t *xml, size_t xml_len,
+		struct jaldb_record **sys_meta)
+{
+	enum jaldb_status ret = JALDB_E_NOT_IMPL;
+	const char *pos = (const char *) xml;
+	const char *end = pos + xml_len;
+	struct jaldb_scan_str stack[JALDB_SCAN_MAX_DEPTH];
+	struct jaldb_scan_str fields[JALDB_SCAN_NUM_FIELDS];
+	int found[JALDB_SCAN_NUM_FIELDS];
+	struct jaldb_scan_str username;
+	int have_username = 0;
+	struct jaldb_scan_tag tag;
+	int depth = 0;
+
+	if (!xml || !sys_meta) {
+		goto out;
+	}
+	memset(fields, 0, sizeof(fields));
+	memset(found, 0, sizeof(found));
+
+	if (5 < xml_len && 0 == memcmp(pos, "<?xml", 5) && jaldb_scan_is_space(pos[5])) {
+		pos = jaldb_scan_xml_decl(pos, end);
+		if (!pos) {
+			goto out;
+		}
+	}
+	while (1) {
+		const char *lt = memchr(pos, '<', end - pos);
+		int field;
+		if (!lt || jaldb_scan_check_text(pos, lt - pos, "")) {
+			goto out;
+		}
+		if (0 == depth && jaldb_scan_skip_space(pos, lt) != lt) {
+			goto out;
+		}
+		pos = lt + 1;
+		if (pos == end) {
+			goto out;
+		}
+		if ('/' == *pos) {
+			if (0 == depth) {
+				goto out;
+			}
+			pos = jaldb_scan_end_tag(pos + 1, end, &stack[depth - 1]);
+			if (!pos) {
+				goto out;
+			}
+			if (0 == --depth) {
+				break;
+			}
+			continue;
+		}
+		pos = jaldb_scan_start_tag(pos, end, &tag);
+		if (!pos) {
+			goto out;
+		}
+		if (0 == depth) {
+			if (tag.empty || !jaldb_scan_str_equals(&tag.name, JALDB_RECORD_TAG)) {
+				goto out;
+			}
+			stack[depth++] = tag.name;
+			continue;
+		}
+		for (field = 0; field < JALDB_SCAN_NUM_FIELDS; field++) {
+			if (jaldb_scan_str_equals(&tag.name, jaldb_scan_field_tags[field])) {
+				break;
+			}
+		}
+		if (JALDB_SCAN_NUM_FIELDS == field) {
+			if (!tag.empty) {
+				if (JALDB_SCAN_MAX_DEPTH == depth) {
+					goto out;
+				}
+				stack[depth++] = tag.name;
+			}
+			continue;
+		}
+		if (1 != depth || found[field]) {
+			goto out;
+		}
+		found[field] = 1;
+		if (JALDB_SCAN_USER == field) {
+			int i;
+			for (i = 0; i < tag.num_attrs; i++) {
+				if (jaldb_scan_str_equals(&tag.attr_names[i], JALDB_USERNAME_PROP)) {
+					username = tag.attr_values[i];
+					have_username = 1;
+				}
+			}
+		}
+		if (tag.empty) {
+			continue;
+		}
+		// A field has to be text only, followed by its end tag.
+		lt = memchr(pos, '<', end - pos);
+		if (!lt || 2 > end - lt || '/' != lt[1] || jaldb_scan_check_text(pos, lt - pos, "\r")) {
+			goto out;
+		}
+		fields[field].str = pos;
+		fields[field].len = lt - pos;
+		pos = jaldb_scan_end_tag(lt + 2, end, &tag.name);
+		if (!pos) {
+			goto out;
+		}
+	}
+	if (jaldb_scan_skip_space(pos, end) != end) {
+		goto out;
+	}
+	ret = jaldb_scan_fields_to_record(fields, found, have_username ? &username : NULL, sys_meta);
+out:
+	return ret;
+}
+
+enum jal_status jaldb_xml_to_sys_metadata(uint8_t *xml, size_t xml_len, struct jaldb_record **sys_meta)
+{
+	enum jaldb_status ret = jaldb_scan_sys_metadata(xml, xml_len, sys_meta);
+	if (JALDB_E_NOT_IMPL != ret) {
+		if (JALDB_OK != ret) {
+			*sys_meta = NULL;
+		}
+		return (enum jal_status) ret;
+	}
+	return jaldb_parse_sys_metadata_xml(xml, xml_len, sys_meta);
+}
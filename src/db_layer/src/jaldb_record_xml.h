@@ -44,6 +44,8 @@ struct jaldb_record;
 
 /**
  * Generate a XML document for the system meta-data.
+ * The document is written out directly rather than built as a DOM; it is
+ * only parsed with libxml2 when it has to be signed.
  * Note that although the returned buffer is NULL terminated, the length
  * returned in \p dsize, will be the number of characters in the
  * buffer, not including the NULL terminator.
@@ -71,12 +73,42 @@ enum jaldb_status jaldb_record_to_system_metadata_doc(struct jaldb_record *rec,
 
 /*
  * Function to parse sys metadata xml into a jaldb_record structure
+ * The document is read with jaldb_scan_sys_metadata(), or with
+ * jaldb_parse_sys_metadata_xml() if it uses XML the scan does not handle.
  * @param xml [in] buffer containing the xml to parse
  * @param xml_len [in] Length of buffer
  * @param sys_meta [out] The populated structure
  */
 enum jal_status jaldb_xml_to_sys_metadata(uint8_t *xml, size_t xml_len, struct jaldb_record **sys_meta);
 
+/*
+ * Parse sys metadata xml into a jaldb_record structure with the libxml2 SAX
+ * parser.
+ * @param xml [in] buffer containing the xml to parse
+ * @param xml_len [in] Length of buffer
+ * @param sys_meta [out] The populated structure
+ */
+enum jal_status jaldb_parse_sys_metadata_xml(uint8_t *xml, size_t xml_len, struct jaldb_record **sys_meta);
+
+/**
+ * Read sys metadata xml into a jaldb_record structure with a scan of the
+ * buffer, without an XML parser. Only the layout JALoP writes is handled:
+ * an ASCII document without entity or character references, comments, CDATA
+ * sections or processing instructions, with the fields as text-only children
+ * of the root element. The result is the same as from
+ * jaldb_parse_sys_metadata_xml().
+ *
+ * @param [in] xml The buffer containing the xml.
+ * @param [in] xml_len The length of \p xml.
+ * @param [out] sys_meta The populated structure.
+ *
+ * @return JALDB_OK on success, JALDB_E_INVAL if the document is not valid
+ * system metadata, or JALDB_E_NOT_IMPL if the document has to be read with
+ * jaldb_parse_sys_metadata_xml().
+ */
+enum jaldb_status jaldb_scan_sys_metadata(const uint8_t *xml, size_t xml_len,
+		struct jaldb_record **sys_meta);
+
 
 
 #ifdef __cplusplus
@@ -401,20 +401,37 @@ enum jaldb_status jaldb_deserialize_record(
 					size_t bsize,
 					struct jaldb_record **record)
 {
-	struct jaldb_serialize_record_headers *headers = NULL;
-	struct jaldb_record *res = NULL;
-	enum jaldb_status ret = JALDB_E_UNKNOWN;
+	struct jaldb_record_view view;
+	enum jaldb_status ret;
+
+	if (!buffer || !record || *record) {
+		return JALDB_E_INVAL;
+	}
+
+	ret = jaldb_record_view_init(&view, byte_swap, buffer, bsize);
+	if (ret != JALDB_OK) {
+		return ret;
+	}
+	return jaldb_record_from_view(&view, record);
+}
+
+enum jaldb_status jaldb_record_view_init(struct jaldb_record_view *view,
+					const char byte_swap,
+					const uint8_t *buffer,
+					size_t bsize)
+{
+	struct jaldb_serialize_record_headers headers;
 	bs16_func bs16 = NULL;
 	bs32_func bs32 = NULL;
 	bs64_func bs64 = NULL;
-	if (!buffer || !record || *record) {
-		ret = JALDB_E_INVAL;
-		goto err_out;
+
+	if (!view || !buffer) {
+		return JALDB_E_INVAL;
 	}
+	memset(view, 0, sizeof(*view));
 
-	if (bsize < sizeof(*headers)) {
-		ret = JALDB_E_INVAL;
-		goto err_out;
+	if (bsize < sizeof(headers)) {
+		return JALDB_E_INVAL;
 	}
 
 	if (byte_swap) {
@@ -427,98 +444,221 @@ enum jaldb_status jaldb_deserialize_record(
 		bs64 = jaldb_bs64_nop;
 	}
 
-	headers = (struct jaldb_serialize_record_headers*) buffer;
-	res = jaldb_create_record();
-
-	headers->version = bs16(headers->version);
-	if (headers->version != JALDB_DB_LAYOUT_VERSION) {
-		ret = JALDB_E_LAYOUT_VERSION_UNKNOWN;
-		goto err_out;
+	// The buffer may come straight from the DB, so it is neither aligned
+	// nor ours to byte-swap in place.
+	memcpy(&headers, buffer, sizeof(headers));
+	if (bs16(headers.version) != JALDB_DB_LAYOUT_VERSION) {
+		return JALDB_E_LAYOUT_VERSION_UNKNOWN;
 	}
-	headers->flags = bs32(headers->flags);
 
-	res->version = JALDB_DB_LAYOUT_VERSION;
-	res->type = JALDB_RTYPE_UNKNOWN;
-	if (headers->flags & JALDB_RFLAGS_SENT && headers->flags & JALDB_RFLAGS_SYNCED) {
-		res->synced = JALDB_SYNCED; // Record sent and synced.
-	} else if (!(headers->flags & JALDB_RFLAGS_SYNCED) && headers->flags & JALDB_RFLAGS_SENT) {
-		res->synced = JALDB_SENT; // Record sent but not synced.
+	view->buffer = buffer;
+	view->size = bsize;
+	view->byte_swap = byte_swap;
+	view->flags = bs32(headers.flags);
+	if (view->flags & JALDB_RFLAGS_SENT && view->flags & JALDB_RFLAGS_SYNCED) {
+		view->synced = JALDB_SYNCED; // Record sent and synced.
+	} else if (!(view->flags & JALDB_RFLAGS_SYNCED) && view->flags & JALDB_RFLAGS_SENT) {
+		view->synced = JALDB_SENT; // Record sent but not synced.
 	} else {
-		res->synced = JALDB_NOT_SENT; // Record not sent.
+		view->synced = JALDB_NOT_SENT; // Record not sent.
+	}
+	view->have_uid = view->flags & JALDB_RFLAGS_HAVE_UID ? 1 : 0;
+	view->confirmed = view->flags & JALDB_RFLAGS_CONFIRMED ? 1 : 0;
+	view->pid = bs64(headers.pid);
+	view->uid = bs64(headers.uid);
+	view->sys_meta.length = bs64(headers.sys_meta_sz);
+	view->app_meta.length = bs64(headers.app_meta_sz);
+	view->payload.length = bs64(headers.payload_sz);
+	uuid_copy(view->host_uuid, headers.host_uuid);
+	uuid_copy(view->uuid, headers.record_uuid);
+
+	return JALDB_OK;
+}
+
+/**
+ * Locate a null terminated string in a serialized record without copying it.
+ * Empty strings are returned as NULL.
+ *
+ * @param[in,out] buffer The position in the buffer, advanced past the string.
+ * @param[in,out] size The number of bytes remaining in \p buffer.
+ * @param[in] str_size The fixed length reserved for the string, or 0 if the
+ * string is variable length.
+ * @param[out] str The string.
+ *
+ * @return JALDB_OK on success, or JALDB_E_INVAL if the string overruns the
+ * buffer.
+ */
+static enum jaldb_status jaldb_view_string(const uint8_t **buffer,
+		size_t *size,
+		size_t str_size,
+		const char **str)
+{
+	const uint8_t *end = (const uint8_t*) memchr(*buffer, '\0', *size);
+	size_t s_len;
+	size_t consumed;
+
+	if (!end) {
+		return JALDB_E_INVAL;
+	}
+	s_len = end - *buffer;
+	consumed = s_len + 1;
+	if (str_size) {
+		if (s_len > str_size || str_size >= *size) {
+			return JALDB_E_INVAL;
+		}
+		consumed = str_size + 1;
+	}
+
+	*str = s_len ? (const char*) *buffer : NULL;
+	*buffer += consumed;
+	*size -= consumed;
+	return JALDB_OK;
+}
+
+static enum jaldb_status jaldb_view_segment(char on_disk,
+		const uint8_t **buffer,
+		size_t *size,
+		struct jaldb_segment_view *segment)
+{
+	segment->on_disk = on_disk;
+	if (on_disk) {
+		return jaldb_view_string(buffer, size, 0,
+				(const char**) &segment->payload);
+	}
+	if (segment->length > *size) {
+		return JALDB_E_INVAL;
+	}
+	segment->payload = *buffer;
+	*buffer += segment->length;
+	*size -= segment->length;
+	return JALDB_OK;
+}
+
+enum jaldb_status jaldb_record_view_decode(struct jaldb_record_view *view)
+{
+	const uint8_t *buffer;
+	size_t size;
+	enum jaldb_status ret;
+
+	if (!view || !view->buffer) {
+		return JALDB_E_INVAL;
+	}
+	if (view->decoded) {
+		return JALDB_OK;
 	}
-	res->have_uid = headers->flags & JALDB_RFLAGS_HAVE_UID ? 1 : 0;
-	res->confirmed = headers->flags & JALDB_RFLAGS_CONFIRMED ? 1 : 0;
-	res->pid = bs64(headers->pid);
-	res->uid = bs64(headers->uid);
-	uuid_copy(res->host_uuid, headers->host_uuid);
-	uuid_copy(res->uuid, headers->record_uuid);
 
-	buffer += sizeof(*headers);
-	bsize -= sizeof(*headers);
+	buffer = view->buffer + sizeof(struct jaldb_serialize_record_headers);
+	size = view->size - sizeof(struct jaldb_serialize_record_headers);
 
-	ret = jaldb_deserialize_string(&buffer, &bsize, &res->timestamp);
+	ret = jaldb_view_string(&buffer, &size, 0, &view->timestamp);
 	if (ret != JALDB_OK) {
-		goto err_out;
+		return ret;
 	}
-	ret = jaldb_deserialize_fixed_string(&buffer, &bsize, JALDB_MAX_NETWORK_NONCE_LENGTH, &res->network_nonce);
+	ret = jaldb_view_string(&buffer, &size, JALDB_MAX_NETWORK_NONCE_LENGTH, &view->network_nonce);
 	if (ret != JALDB_OK) {
-		goto err_out;
+		return ret;
 	}
-	ret = jaldb_deserialize_string(&buffer, &bsize, &res->source);
+	ret = jaldb_view_string(&buffer, &size, 0, &view->source);
 	if (ret != JALDB_OK) {
-		goto err_out;
+		return ret;
 	}
-	ret = jaldb_deserialize_string(&buffer, &bsize, &res->sec_lbl);
+	ret = jaldb_view_string(&buffer, &size, 0, &view->sec_lbl);
 	if (ret != JALDB_OK) {
-		goto err_out;
+		return ret;
 	}
-	ret = jaldb_deserialize_string(&buffer, &bsize, &res->hostname);
+	ret = jaldb_view_string(&buffer, &size, 0, &view->hostname);
 	if (ret != JALDB_OK) {
-		goto err_out;
+		return ret;
 	}
-	ret = jaldb_deserialize_string(&buffer, &bsize, &res->username);
+	ret = jaldb_view_string(&buffer, &size, 0, &view->username);
 	if (ret != JALDB_OK) {
-		goto err_out;
+		return ret;
 	}
 
-	if (headers->flags & JALDB_RFLAGS_HAVE_SYS_META) {
-		ret = jaldb_deserialize_segment(headers->flags & JALDB_RFLAGS_SYS_META_ON_DISK ? 1 : 0,
-				headers->sys_meta_sz,
-				&buffer,
-				&bsize,
-				&res->sys_meta);
+	if (view->flags & JALDB_RFLAGS_HAVE_SYS_META) {
+		ret = jaldb_view_segment(view->flags & JALDB_RFLAGS_SYS_META_ON_DISK ? 1 : 0,
+				&buffer, &size, &view->sys_meta);
 		if (ret != JALDB_OK) {
-			goto err_out;
+			return ret;
 		}
 	}
-
-	if (headers->flags & JALDB_RFLAGS_HAVE_APP_META) {
-		ret = jaldb_deserialize_segment(headers->flags & JALDB_RFLAGS_APP_META_ON_DISK ? 1 : 0,
-				headers->app_meta_sz,
-				&buffer,
-				&bsize,
-				&res->app_meta);
+	if (view->flags & JALDB_RFLAGS_HAVE_APP_META) {
+		ret = jaldb_view_segment(view->flags & JALDB_RFLAGS_APP_META_ON_DISK ? 1 : 0,
+				&buffer, &size, &view->app_meta);
 		if (ret != JALDB_OK) {
-			goto err_out;
+			return ret;
 		}
 	}
-	if (headers->flags & JALDB_RFLAGS_HAVE_PAYLOAD) {
-		ret = jaldb_deserialize_segment(headers->flags & JALDB_RFLAGS_PAYLOAD_ON_DISK ? 1 : 0,
-				headers->payload_sz,
-				&buffer,
-				&bsize,
-				&res->payload);
+	if (view->flags & JALDB_RFLAGS_HAVE_PAYLOAD) {
+		ret = jaldb_view_segment(view->flags & JALDB_RFLAGS_PAYLOAD_ON_DISK ? 1 : 0,
+				&buffer, &size, &view->payload);
 		if (ret != JALDB_OK) {
-			goto err_out;
+			return ret;
 		}
 	}
 
+	view->decoded = 1;
+	return JALDB_OK;
+}
+
+static struct jaldb_segment *jaldb_segment_from_view(const struct jaldb_segment_view *view)
+{
+	struct jaldb_segment *seg = jaldb_create_segment();
+	seg->length = view->length;
+	seg->on_disk = view->on_disk;
+	if (view->on_disk) {
+		seg->payload = (uint8_t*) jal_strdup((const char*) view->payload);
+	} else {
+		seg->payload = (uint8_t*) jal_malloc(view->length);
+		memcpy(seg->payload, view->payload, view->length);
+	}
+	return seg;
+}
+
+enum jaldb_status jaldb_record_from_view(struct jaldb_record_view *view,
+					struct jaldb_record **record)
+{
+	struct jaldb_record *res = NULL;
+	enum jaldb_status ret;
+
+	if (!view || !record || *record) {
+		return JALDB_E_INVAL;
+	}
+	ret = jaldb_record_view_decode(view);
+	if (ret != JALDB_OK) {
+		return ret;
+	}
+
+	res = jaldb_create_record();
+	res->version = JALDB_RECORD_VERSION;
+	res->type = JALDB_RTYPE_UNKNOWN;
+	res->synced = view->synced;
+	res->have_uid = view->have_uid;
+	res->confirmed = view->confirmed;
+	res->pid = view->pid;
+	res->uid = view->uid;
+	uuid_copy(res->host_uuid, view->host_uuid);
+	uuid_copy(res->uuid, view->uuid);
+
+	res->timestamp = jal_strdup(view->timestamp);
+	res->network_nonce = jal_strdup(view->network_nonce);
+	res->source = jal_strdup(view->source);
+	res->sec_lbl = jal_strdup(view->sec_lbl);
+	res->hostname = jal_strdup(view->hostname);
+	res->username = jal_strdup(view->username);
+
+	if (view->flags & JALDB_RFLAGS_HAVE_SYS_META) {
+		res->sys_meta = jaldb_segment_from_view(&view->sys_meta);
+	}
+	if (view->flags & JALDB_RFLAGS_HAVE_APP_META) {
+		res->app_meta = jaldb_segment_from_view(&view->app_meta);
+	}
+	if (view->flags & JALDB_RFLAGS_HAVE_PAYLOAD) {
+		res->payload = jaldb_segment_from_view(&view->payload);
+	}
+
 	*record = res;
-	goto out;
-err_out:
-	jaldb_destroy_record(&res);
-out:
-	return ret;
+	return JALDB_OK;
 }
 
 enum jaldb_status jaldb_deserialize_string(uint8_t **buffer, size_t *size, char** str)
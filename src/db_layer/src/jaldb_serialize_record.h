@@ -37,7 +37,11 @@
 extern "C" {
 #endif
 
-#define JALDB_DB_LAYOUT_VERSION 1
+/* Version 1 used XML DateTime strings as the keys for the timestamp indices,
+ * version 2 uses binary DateTime keys (see jaldb_datetime.h). Databases
+ * created with version 1 must be upgraded with jaldb_upgrade_db_layout(). */
+#define JALDB_DB_LAYOUT_VERSION_1 1
+#define JALDB_DB_LAYOUT_VERSION 2
 #define JALDB_RFLAGS_HAVE_SYS_META    (1 << 0)
 #define JALDB_RFLAGS_HAVE_APP_META    (1 << 1)
 #define JALDB_RFLAGS_HAVE_PAYLOAD     (1 << 2)
@@ -190,6 +194,91 @@ enum jaldb_status jaldb_deserialize_record(
 					size_t bsize,
 					struct jaldb_record **record);
 
+/**
+ * A data segment of a serialized record, pointing into the serialized buffer.
+ */
+struct jaldb_segment_view {
+	const uint8_t *payload; //!< The data, the relative path on disk, or NULL if absent.
+	uint64_t length;        //!< The size of the data.
+	char on_disk;           //!< Indicates if \p payload is a path to the data.
+};
+
+/**
+ * Read-only view of a serialized record.
+ *
+ * A view points directly into the buffer it was created from, so nothing is
+ * copied or allocated. The buffer must not be modified or freed while the
+ * view is in use. The fixed size headers are decoded by
+ * jaldb_record_view_init(). The strings and segments are only located when
+ * jaldb_record_view_decode() is called, which callers that only need the
+ * headers can skip.
+ */
+struct jaldb_record_view {
+	const uint8_t *buffer;  //!< The serialized record.
+	size_t size;            //!< The size (in bytes) of \p buffer.
+	char byte_swap;         //!< Whether the integer fields in \p buffer are byte-swapped.
+	uint32_t flags;         //!< Bitmask of JALDB_RFLAGS_* flags.
+	int synced;             //!< One of JALDB_NOT_SENT, JALDB_SENT or JALDB_SYNCED.
+	int confirmed;          //!< Indicates if the record is confirmed.
+	int have_uid;           //!< Indicates if \p uid is valid.
+	uint64_t pid;           //!< The process ID.
+	uint64_t uid;           //!< The user ID.
+	uuid_t host_uuid;       //!< The UUID of the host machine that generated the record.
+	uuid_t uuid;            //!< The UUID of the record.
+
+	// Only valid once jaldb_record_view_decode() succeeds. Strings that
+	// are empty in the buffer are NULL, as in jaldb_deserialize_record().
+	char decoded;                        //!< Indicates the fields below are set.
+	const char *timestamp;               //!< The record's timestamp.
+	const char *network_nonce;           //!< The network nonce.
+	const char *source;                  //!< The source of the record.
+	const char *sec_lbl;                 //!< The security label.
+	const char *hostname;                //!< The hostname.
+	const char *username;                //!< The username.
+	struct jaldb_segment_view sys_meta;  //!< The system meta-data.
+	struct jaldb_segment_view app_meta;  //!< The application meta-data.
+	struct jaldb_segment_view payload;   //!< The payload.
+};
+
+/**
+ * Create a view of a serialized record and decode its headers.
+ *
+ * @param[out] view The view to initialize.
+ * @param[in] byte_swap Flag to control whether or not integer fields need to
+ * be byte-swapped.
+ * @param[in] buffer The serialized record. It is not modified.
+ * @param[in] bsize The size (in bytes) of \p buffer.
+ *
+ * @return JALDB_OK on success, JALDB_E_LAYOUT_VERSION_UNKNOWN if the record
+ * was written with a different layout, or JALDB_E_INVAL.
+ */
+enum jaldb_status jaldb_record_view_init(struct jaldb_record_view *view,
+					const char byte_swap,
+					const uint8_t *buffer,
+					size_t bsize);
+
+/**
+ * Locate the strings and segments of a record view. Does nothing if the view
+ * is already decoded.
+ *
+ * @param[in,out] view The view to decode.
+ *
+ * @return JALDB_OK on success, or JALDB_E_INVAL if the buffer is malformed.
+ */
+enum jaldb_status jaldb_record_view_decode(struct jaldb_record_view *view);
+
+/**
+ * Copy a record view into a newly allocated \p jaldb_record.
+ *
+ * @param[in,out] view The view to copy, decoded if needed.
+ * @param[out] record On success, a copy of the record which must be released
+ * with jaldb_destroy_record().
+ *
+ * @return JALDB_OK on success, or an error code.
+ */
+enum jaldb_status jaldb_record_from_view(struct jaldb_record_view *view,
+					struct jaldb_record **record);
+
 /**
  * Extract the next string from the memory buffer.
  * This functions scans \p *buffer for a \p null terminator to construct a
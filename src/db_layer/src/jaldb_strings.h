@@ -34,10 +34,12 @@
 
 #define JALDB_LOG_DB_NAME "log.db"
 #define JALDB_JOURNAL_ROOT_NAME "/journal/"
+#define JALDB_JOURNAL_POOL_DIR_NAME "pool/"
 #define JALDB_CONF_DB "conf.db"
 #define JALDB_JOURNAL_CONF_NAME "conf_journal"
 #define JALDB_AUDIT_CONF_NAME "conf_audit"
 #define JALDB_LOG_CONF_NAME "conf_log"
+#define JALDB_NOTIFY_FILE_NAME "/__record_notify"
 
 #define JALDB_INITIAL_NONCE "0"
 #define JALDB_DEFAULT_OFFSET "0"
@@ -34,52 +34,78 @@
 #include "jal_asprintf_internal.h"
 
 #include "jaldb_context.hpp"
+#include "jaldb_datetime.h"
 #include "jaldb_record_dbs.h"
+#include "jaldb_segment.h"
 #include "jaldb_serialize_record.h"
 #include "jaldb_traverse.h"
 #include "jaldb_utils.h"
 
+static enum jaldb_status jaldb_remove_view_segment_from_disk(jaldb_context *ctx,
+		const struct jaldb_segment_view *view)
+{
+	struct jaldb_segment segment;
+	if (!view->on_disk || !view->payload) {
+		return JALDB_OK;
+	}
+	memset(&segment, 0, sizeof(segment));
+	segment.length = view->length;
+	segment.payload = (uint8_t*) view->payload;
+	segment.on_disk = view->on_disk;
+	segment.fd = -1;
+	return jaldb_remove_segment_from_disk(ctx, &segment);
+}
+
+static enum jaldb_status jaldb_remove_view_segments_from_disk(jaldb_context *ctx,
+		const struct jaldb_record_view *view)
+{
+	enum jaldb_status ret = JALDB_OK;
+	enum jaldb_status tmp = JALDB_OK;
+	tmp = jaldb_remove_view_segment_from_disk(ctx, &view->sys_meta);
+	if (tmp != JALDB_OK) {
+		ret = tmp;
+	}
+	tmp = jaldb_remove_view_segment_from_disk(ctx, &view->app_meta);
+	if (tmp != JALDB_OK) {
+		ret = tmp;
+	}
+	tmp = jaldb_remove_view_segment_from_disk(ctx, &view->payload);
+	if (tmp != JALDB_OK) {
+		ret = tmp;
+	}
+	return ret;
+}
+
 enum jaldb_status jaldb_iterate_by_timestamp(jaldb_context *ctx,
 		enum jaldb_rec_type type,
 		const char *timestamp,
 		jaldb_iter_cb cb, void *up)
 {
 	enum jaldb_status ret = JALDB_E_INVAL;
-	struct tm target_time, record_time;
-	memset(&target_time, 0, sizeof(target_time));
-	memset(&record_time, 0, sizeof(record_time));
-	int target_ms = 0;
-	int record_ms = 0;
-	char *tmp_time = NULL;
-	struct jaldb_record *rec = NULL;
+	uint8_t target_key[JALDB_DATETIME_KEY_LEN];
+	struct jaldb_record_view view;
 	int byte_swap = 0;
 	struct jaldb_record_dbs *rdbs = NULL;
 	int db_ret = 0;
 	DBT key;
 	DBT pkey;
 	DBT val;
+	DBT target;
 	DBC *cursor = NULL;
 	memset(&key, 0, sizeof(key));
 	memset(&pkey, 0, sizeof(pkey));
 	memset(&val, 0, sizeof(val));
+	memset(&target, 0, sizeof(target));
 	key.flags = DB_DBT_REALLOC;
 	val.flags = DB_DBT_REALLOC;
-	time_t target_secs = 0;
-
-	tmp_time = strptime(timestamp, "%Y-%m-%dT%H:%M:%S", &target_time);
-	if (!tmp_time) {
-		fprintf(stderr, "ERROR: Invalid time format specified.\n");
-		ret = JALDB_E_INVAL_TIMESTAMP;
-		goto out;
-	}
 
-	if (!sscanf(tmp_time,".%d-%*d:%*d", &target_ms)) {
+	if (!timestamp || JALDB_OK != jaldb_datetime_to_key(timestamp, strlen(timestamp), target_key)) {
 		fprintf(stderr, "ERROR: Invalid time format specified.\n");
 		ret = JALDB_E_INVAL_TIMESTAMP;
 		goto out;
 	}
-	// Calculate the target time in secs once before we start looping
-	target_secs = mktime(&target_time);
+	target.data = target_key;
+	target.size = JALDB_DATETIME_KEY_LEN;
 
 	if (!ctx || !cb) {
 		ret = JALDB_E_UNINITIALIZED;
@@ -132,49 +158,34 @@ enum jaldb_status jaldb_iterate_by_timestamp(jaldb_context *ctx,
 			goto out;
 		}
 
-		// mktime() like to set things like timezone to system timezone - need to clean out the tm struct before each call
-		memset(&record_time, 0, sizeof(record_time));
-
-		tmp_time = strptime((char*) key.data, "%Y-%m-%dT%H:%M:%S", &record_time);
-		if (!tmp_time) {
-			fprintf(stderr, "ERROR: Cannot get strptime from record\n");
-			ret = JALDB_E_INVAL_TIMESTAMP;
-			goto out;
-		}
-
-		if (!sscanf(tmp_time,".%d-%*d:%*d", &record_ms)) {
-			ret = JALDB_E_INVAL_TIMESTAMP;
-			goto out;
-		}
-
-		double delta = difftime(target_secs,mktime(&record_time));
-		if (delta < 0) {
+		if (jaldb_datetime_key_compare(NULL, &key, &target) > 0) {
 			// record_time is > target_time, so break out
-			goto out; 
-		}
-		
-		if (delta == 0) {
-			if (record_ms > target_ms) {
-				goto out;
-			}
+			goto out;
 		}
 
-		ret = jaldb_deserialize_record(byte_swap, (uint8_t*) val.data, val.size, &rec);
+		ret = jaldb_record_view_init(&view, byte_swap, (uint8_t*) val.data, val.size);
 		if (ret != JALDB_OK) {
 			goto out;
 		}
 
-		switch (cb((char*) pkey.data, rec, up)) {
+		switch (cb((char*) pkey.data, &view, up)) {
 		case JALDB_ITER_CONT:
 			break;
 		case JALDB_ITER_REM:
+			// The segment paths point into val, which stays valid
+			// after the cursor is closed.
+			ret = jaldb_record_view_decode(&view);
+			if (ret != JALDB_OK) {
+				goto out;
+			}
+
 			// Need to close cursor before removing record
 			cursor->c_close(cursor);
 			cursor = NULL;
 
 			ret = jaldb_remove_record(ctx, type, (char*) pkey.data);
 			if (JALDB_OK == ret) {
-				ret = jaldb_remove_segments_from_disk(ctx, rec);
+				ret = jaldb_remove_view_segments_from_disk(ctx, &view);
 			}
 			if (ret != JALDB_OK) {
 				// something went wrong...
@@ -191,8 +202,6 @@ enum jaldb_status jaldb_iterate_by_timestamp(jaldb_context *ctx,
 		default:
 			goto out;
 		}
-
-		jaldb_destroy_record(&rec);
 	}
 
 out:
@@ -200,8 +209,6 @@ out:
 		cursor->c_close(cursor);
 	}
 
-	jaldb_destroy_record(&rec);
-
 	free(key.data);
 	free(val.data);
 	return ret;
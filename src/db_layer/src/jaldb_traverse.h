@@ -32,6 +32,7 @@
 
 #include "jaldb_context.h"
 #include "jaldb_record.h"
+#include "jaldb_serialize_record.h"
 #include "jaldb_status.h"
 
 #ifdef __cplusplus
@@ -52,8 +53,9 @@ enum jaldb_iter_status {
  * database in a variety of ways. The return of this function is used to
  * determine what (if anything) should happen.
  *
- * In most instances, the \p rec should not be modified (or at least, any
- * modifications are not written to the DB).
+ * \p rec is a view into the buffer read from the DB, so it is only valid
+ * until the callback returns. Call jaldb_record_view_decode() before using
+ * the strings or segments, or jaldb_record_from_view() to keep a copy.
  *
  * @param[in] nonce The nonce as a hex string (starting with '0x')
  * @param[in] rec The current record
@@ -61,7 +63,7 @@ enum jaldb_iter_status {
  *               function, it can be used to store some state information,
  *               etc.
  */
-typedef enum jaldb_iter_status (*jaldb_iter_cb)(const char *nonce, struct jaldb_record *rec, void *up);
+typedef enum jaldb_iter_status (*jaldb_iter_cb)(const char *nonce, struct jaldb_record_view *rec, void *up);
 
 /**
  * Utility function to iterate over the records in a DB in order by timestamp.
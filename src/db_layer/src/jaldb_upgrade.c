@@ -0,0 +1,589 @@
+/**
+ * @file jaldb_upgrade.c This file implements functions to upgrade an existing
+ * JALoP database to the current layout version.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#include <db.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <uuid/uuid.h>
+
+#include "jal_alloc.h"
+#include "jal_asprintf_internal.h"
+#include "jal_byteswap.h"
+#include "jal_fs_utils.h"
+
+#include "jaldb_delivery.h"
+#include "jaldb_nonce.h"
+#include "jaldb_record.h"
+#include "jaldb_record_dbs.h"
+#include "jaldb_segment.h"
+#include "jaldb_serialize_record.h"
+#include "jaldb_strings.h"
+#include "jaldb_upgrade.h"
+#include "jaldb_utils.h"
+
+#define JALDB_UPGRADE_DEFAULT_DB_ROOT "/var/lib/jalop/db"
+
+// Number of records to update in a single transaction.
+#define JALDB_UPGRADE_BATCH_SIZE 1000
+
+// Rebuilding an index is done in a single transaction, so make sure there
+// is plenty of room in the lock table.
+#define JALDB_UPGRADE_MAX_LOCKS 1000000
+
+// The length of a UUID as a string, not including the NULL terminator.
+#define JALDB_UPGRADE_UUID_LEN 36
+
+static const char *jaldb_upgrade_prefixes[] = { "journal", "audit", "log" };
+
+static enum jaldb_status jaldb_upgrade_open_env(const char *db_root, DB_ENV **env_out)
+{
+	DB_ENV *env = NULL;
+	int db_ret;
+
+	uint32_t env_flags = DB_CREATE |
+		DB_INIT_LOCK |
+		DB_INIT_LOG |
+		DB_INIT_MPOOL |
+		DB_INIT_TXN |
+		DB_THREAD;
+
+	db_ret = db_env_create(&env, 0);
+	if (0 != db_ret) {
+		return JALDB_E_INVAL;
+	}
+
+	db_ret = env->set_lk_max_locks(env, JALDB_UPGRADE_MAX_LOCKS);
+	if (0 != db_ret) {
+		goto err_out;
+	}
+	db_ret = env->set_lk_max_objects(env, JALDB_UPGRADE_MAX_LOCKS);
+	if (0 != db_ret) {
+		goto err_out;
+	}
+
+	db_ret = env->open(env, db_root, env_flags, 0);
+	if (0 != db_ret) {
+		env->close(env, 0);
+		return JALDB_E_INVAL;
+	}
+
+	*env_out = env;
+	return JALDB_OK;
+err_out:
+	env->close(env, 0);
+	return JALDB_E_DB;
+}
+
+static enum jaldb_status jaldb_upgrade_remove_db(DB_ENV *env, const char *prefix, const char *suffix)
+{
+	char *name = NULL;
+	int db_ret;
+
+	if (-1 == jal_asprintf(&name, "%s%s", prefix, suffix)) {
+		return JALDB_E_NO_MEM;
+	}
+	db_ret = env->dbremove(env, NULL, name, NULL, DB_AUTO_COMMIT);
+	free(name);
+	if (0 != db_ret && ENOENT != db_ret) {
+		env->err(env, db_ret, "Failed to remove %s%s", prefix, suffix);
+		return JALDB_E_DB;
+	}
+	return JALDB_OK;
+}
+
+static enum jaldb_status jaldb_upgrade_primary_db(DB_ENV *env, const char *prefix, uint64_t *count)
+{
+	enum jaldb_status ret = JALDB_E_DB;
+	char *name = NULL;
+	DB *db = NULL;
+	DB_TXN *txn = NULL;
+	DBC *cursor = NULL;
+	int byte_swap = 0;
+	int db_ret;
+	int done = 0;
+	uint16_t old_version = JALDB_DB_LAYOUT_VERSION_1;
+	uint16_t new_version = JALDB_DB_LAYOUT_VERSION;
+	uint16_t version;
+	DBT key;
+	DBT val;
+
+	memset(&key, 0, sizeof(key));
+	memset(&val, 0, sizeof(val));
+	key.flags = DB_DBT_REALLOC;
+
+	// Only the version (the first field of the headers) is read & written.
+	val.data = &version;
+	val.ulen = sizeof(version);
+	val.dlen = sizeof(version);
+	val.doff = 0;
+	val.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
+
+	if (-1 == jal_asprintf(&name, "%s_records.db", prefix)) {
+		return JALDB_E_NO_MEM;
+	}
+
+	db_ret = db_create(&db, env, 0);
+	if (0 != db_ret) {
+		goto out;
+	}
+
+	db_ret = db->set_bt_compare(db, jaldb_nonce_compare);
+	if (0 != db_ret) {
+		JALDB_DB_ERR(db, db_ret);
+		goto out;
+	}
+
+	db_ret = db->open(db, NULL, name, NULL, DB_BTREE, DB_THREAD | DB_AUTO_COMMIT, 0);
+	if (ENOENT == db_ret) {
+		// Nothing to upgrade
+		ret = JALDB_OK;
+		goto out;
+	} else if (0 != db_ret) {
+		JALDB_DB_ERR(db, db_ret);
+		goto out;
+	}
+
+	db_ret = db->get_byteswapped(db, &byte_swap);
+	if (0 != db_ret) {
+		goto out;
+	}
+	if (byte_swap) {
+		old_version = jal_bswap_16(old_version);
+		new_version = jal_bswap_16(new_version);
+	}
+
+	while (!done) {
+		int batch = 0;
+
+		db_ret = env->txn_begin(env, NULL, &txn, 0);
+		if (0 != db_ret) {
+			goto out;
+		}
+
+		db_ret = db->cursor(db, txn, &cursor, 0);
+		if (0 != db_ret) {
+			JALDB_DB_ERR(db, db_ret);
+			goto err_abort;
+		}
+
+		// Pick up where the previous batch left off.
+		if (key.data) {
+			db_ret = cursor->c_get(cursor, &key, &val, DB_SET_RANGE | DB_RMW);
+		} else {
+			db_ret = cursor->c_get(cursor, &key, &val, DB_FIRST | DB_RMW);
+		}
+
+		while (0 == db_ret && batch < JALDB_UPGRADE_BATCH_SIZE) {
+			if (old_version == version) {
+				version = new_version;
+				val.size = sizeof(version);
+				db_ret = cursor->c_put(cursor, &key, &val, DB_CURRENT);
+				if (0 != db_ret) {
+					break;
+				}
+				*count += 1;
+			}
+			batch++;
+			db_ret = cursor->c_get(cursor, &key, &val, DB_NEXT | DB_RMW);
+		}
+
+		if (DB_NOTFOUND == db_ret) {
+			done = 1;
+		} else if (0 != db_ret) {
+			if (DB_LOCK_DEADLOCK != db_ret) {
+				JALDB_DB_ERR(db, db_ret);
+			}
+			goto err_abort;
+		}
+
+		cursor->c_close(cursor);
+		cursor = NULL;
+		db_ret = txn->commit(txn, 0);
+		txn = NULL;
+		if (0 != db_ret) {
+			goto out;
+		}
+	}
+
+	ret = JALDB_OK;
+	goto out;
+
+err_abort:
+	if (cursor) {
+		cursor->c_close(cursor);
+		cursor = NULL;
+	}
+	txn->abort(txn);
+out:
+	if (db) {
+		db->close(db, 0);
+	}
+	free(key.data);
+	free(name);
+	return ret;
+}
+
+enum jaldb_status jaldb_upgrade_db_layout(const char *db_root, uint64_t *upgraded_count)
+{
+	enum jaldb_status ret = JALDB_E_DB;
+	uint64_t count = 0;
+	DB_ENV *env = NULL;
+	DB_TXN *txn = NULL;
+	struct jaldb_record_dbs *rdbs = NULL;
+	size_t i;
+	int db_ret;
+
+	if (!db_root) {
+		db_root = JALDB_UPGRADE_DEFAULT_DB_ROOT;
+	}
+
+	ret = jaldb_upgrade_open_env(db_root, &env);
+	if (JALDB_OK != ret) {
+		goto out;
+	}
+
+	for (i = 0; i < sizeof(jaldb_upgrade_prefixes) / sizeof(jaldb_upgrade_prefixes[0]); i++) {
+		const char *prefix = jaldb_upgrade_prefixes[i];
+
+		// The timestamp indices must be removed before touching the
+		// primary DB. Both will be rebuilt with binary keys below.
+		ret = jaldb_upgrade_remove_db(env, prefix, "_timestamp_idx.db");
+		if (JALDB_OK != ret) {
+			goto out;
+		}
+		ret = jaldb_upgrade_remove_db(env, prefix, "_nonce_timestamp.db");
+		if (JALDB_OK != ret) {
+			goto out;
+		}
+
+		ret = jaldb_upgrade_primary_db(env, prefix, &count);
+		if (JALDB_OK != ret) {
+			goto out;
+		}
+
+		// Opening the DBs rebuilds any index that is missing.
+		db_ret = env->txn_begin(env, NULL, &txn, 0);
+		if (0 != db_ret) {
+			ret = JALDB_E_DB;
+			goto out;
+		}
+		ret = jaldb_create_primary_dbs_with_indices(env, txn, prefix,
+				DB_THREAD | DB_CREATE, &rdbs);
+		if (JALDB_OK != ret) {
+			txn->abort(txn);
+			goto out;
+		}
+		db_ret = txn->commit(txn, 0);
+		if (0 != db_ret) {
+			jaldb_destroy_record_dbs(&rdbs);
+			ret = JALDB_E_DB;
+			goto out;
+		}
+
+		// Carry over what earlier versions recorded as synced.
+		ret = jaldb_delivery_seed(env, rdbs);
+		jaldb_destroy_record_dbs(&rdbs);
+		if (JALDB_OK != ret) {
+			goto out;
+		}
+	}
+
+	db_ret = env->txn_checkpoint(env, 0, 0, 0);
+	if (0 != db_ret) {
+		ret = JALDB_E_DB;
+		goto out;
+	}
+
+	ret = JALDB_OK;
+out:
+	if (upgraded_count) {
+		*upgraded_count = count;
+	}
+	if (env) {
+		env->close(env, 0);
+	}
+	return ret;
+}
+
+/**
+ * Link the payload file of \p rec at its path in the new layout, and point
+ * the record at it.
+ *
+ * @param[in] journal_root The root of the journal files, with a trailing '/'.
+ * @param[in] fanout The number of directory levels.
+ * @param[in,out] rec The record.
+ * @param[out] old_full_path Set to the old path of the file, which the caller
+ * removes once the record is committed, or left NULL if the file is already
+ * in place or is not named by a UUID.
+ * @param[out] new_full_path Set to the new path of the file, which the
+ * caller removes if the record is not committed.
+ *
+ * @return JALDB_OK on success, or an error code.
+ */
+static enum jaldb_status jaldb_upgrade_link_payload(const char *journal_root, int fanout,
+		struct jaldb_record *rec, char **old_full_path, char **new_full_path)
+{
+	char new_path[JALDB_REL_PATH_MAX];
+	const char *old_path;
+	const char *uuid_str;
+	uuid_t uuid;
+
+	if (!rec->payload || !rec->payload->on_disk || !rec->payload->payload) {
+		return JALDB_OK;
+	}
+	old_path = (const char *) rec->payload->payload;
+
+	// The file name ends with the UUID the directories are named by.
+	if (strlen(old_path) < JALDB_UPGRADE_UUID_LEN) {
+		return JALDB_OK;
+	}
+	uuid_str = old_path + strlen(old_path) - (JALDB_UPGRADE_UUID_LEN);
+	if (0 != uuid_parse(uuid_str, uuid)) {
+		return JALDB_OK;
+	}
+	if (JALDB_OK != jaldb_build_rel_path(new_path, sizeof(new_path), fanout,
+				uuid_str, JALDB_RTYPE_JOURNAL, JALDB_DTYPE_PAYLOAD)) {
+		return JALDB_OK;
+	}
+	if (0 == strcmp(old_path, new_path)) {
+		return JALDB_OK;
+	}
+
+	if (-1 == jal_asprintf(old_full_path, "%s%s", journal_root, old_path) ||
+			-1 == jal_asprintf(new_full_path, "%s%s", journal_root, new_path)) {
+		return JALDB_E_NO_MEM;
+	}
+	if (JAL_OK != jal_create_dirs(*new_full_path)) {
+		return JALDB_E_INTERNAL_ERROR;
+	}
+	// A link left by an interrupted run is replaced.
+	if (0 != link(*old_full_path, *new_full_path) &&
+			(EEXIST != errno || 0 != unlink(*new_full_path) ||
+			 0 != link(*old_full_path, *new_full_path))) {
+		free(*new_full_path);
+		*new_full_path = NULL;
+		return JALDB_E_INTERNAL_ERROR;
+	}
+
+	free(rec->payload->payload);
+	rec->payload->payload = (uint8_t *) jal_strdup(new_path);
+	return JALDB_OK;
+}
+
+enum jaldb_status jaldb_upgrade_journal_fanout(const char *db_root, int fanout,
+		uint64_t *moved_count)
+{
+	enum jaldb_status ret = JALDB_E_DB;
+	uint64_t count = 0;
+	char *journal_root = NULL;
+	char *old_paths[JALDB_UPGRADE_BATCH_SIZE];
+	char *new_paths[JALDB_UPGRADE_BATCH_SIZE];
+	int moved = 0;
+	DB_ENV *env = NULL;
+	DB *db = NULL;
+	DB_TXN *txn = NULL;
+	DBC *cursor = NULL;
+	int byte_swap = 0;
+	int db_ret;
+	int done = 0;
+	int i;
+	DBT key;
+	DBT val;
+
+	if (fanout < 1 || fanout > JALDB_FANOUT_MAX) {
+		return JALDB_E_INVAL;
+	}
+	if (!db_root) {
+		db_root = JALDB_UPGRADE_DEFAULT_DB_ROOT;
+	}
+
+	memset(&key, 0, sizeof(key));
+	memset(&val, 0, sizeof(val));
+	key.flags = DB_DBT_REALLOC;
+	val.flags = DB_DBT_REALLOC;
+
+	if (-1 == jal_asprintf(&journal_root, "%s%s", db_root, JALDB_JOURNAL_ROOT_NAME)) {
+		return JALDB_E_NO_MEM;
+	}
+
+	ret = jaldb_upgrade_open_env(db_root, &env);
+	if (JALDB_OK != ret) {
+		goto out;
+	}
+	ret = JALDB_E_DB;
+
+	db_ret = db_create(&db, env, 0);
+	if (0 != db_ret) {
+		goto out;
+	}
+
+	db_ret = db->set_bt_compare(db, jaldb_nonce_compare);
+	if (0 != db_ret) {
+		JALDB_DB_ERR(db, db_ret);
+		goto out;
+	}
+
+	db_ret = db->open(db, NULL, "journal_records.db", NULL, DB_BTREE, DB_THREAD | DB_AUTO_COMMIT, 0);
+	if (ENOENT == db_ret) {
+		// Nothing to move
+		ret = JALDB_OK;
+		goto out;
+	} else if (0 != db_ret) {
+		JALDB_DB_ERR(db, db_ret);
+		goto out;
+	}
+
+	db_ret = db->get_byteswapped(db, &byte_swap);
+	if (0 != db_ret) {
+		goto out;
+	}
+
+	while (!done) {
+		int batch = 0;
+
+		db_ret = env->txn_begin(env, NULL, &txn, 0);
+		if (0 != db_ret) {
+			goto out;
+		}
+
+		db_ret = db->cursor(db, txn, &cursor, 0);
+		if (0 != db_ret) {
+			JALDB_DB_ERR(db, db_ret);
+			goto err_abort;
+		}
+
+		// Pick up where the previous batch left off.
+		if (key.data) {
+			db_ret = cursor->c_get(cursor, &key, &val, DB_SET_RANGE | DB_RMW);
+		} else {
+			db_ret = cursor->c_get(cursor, &key, &val, DB_FIRST | DB_RMW);
+		}
+
+		while (0 == db_ret && batch < JALDB_UPGRADE_BATCH_SIZE) {
+			struct jaldb_record *rec = NULL;
+			uint8_t *buf = NULL;
+			size_t buf_size = 0;
+
+			ret = jaldb_deserialize_record(byte_swap, (uint8_t *) val.data, val.size, &rec);
+			if (JALDB_OK != ret) {
+				goto err_abort;
+			}
+			char *old_full_path = NULL;
+			char *new_full_path = NULL;
+			ret = jaldb_upgrade_link_payload(journal_root, fanout, rec,
+					&old_full_path, &new_full_path);
+			if (new_full_path) {
+				old_paths[moved] = old_full_path;
+				new_paths[moved] = new_full_path;
+				moved++;
+			} else {
+				free(old_full_path);
+			}
+			if (JALDB_OK == ret && new_full_path) {
+				ret = jaldb_serialize_record(byte_swap, rec, &buf, &buf_size);
+			}
+			jaldb_destroy_record(&rec);
+			if (JALDB_OK != ret) {
+				free(buf);
+				goto err_abort;
+			}
+			if (buf) {
+				DBT new_val;
+				memset(&new_val, 0, sizeof(new_val));
+				new_val.data = buf;
+				new_val.size = buf_size;
+				db_ret = cursor->c_put(cursor, &key, &new_val, DB_CURRENT);
+				free(buf);
+				if (0 != db_ret) {
+					break;
+				}
+			}
+			batch++;
+			db_ret = cursor->c_get(cursor, &key, &val, DB_NEXT | DB_RMW);
+		}
+
+		ret = JALDB_E_DB;
+		if (DB_NOTFOUND == db_ret) {
+			done = 1;
+		} else if (0 != db_ret) {
+			if (DB_LOCK_DEADLOCK != db_ret) {
+				JALDB_DB_ERR(db, db_ret);
+			}
+			goto err_abort;
+		}
+
+		cursor->c_close(cursor);
+		cursor = NULL;
+		db_ret = txn->commit(txn, 0);
+		txn = NULL;
+		if (0 != db_ret) {
+			goto out;
+		}
+
+		// The records now point to the new links.
+		for (i = 0; i < moved; i++) {
+			unlink(old_paths[i]);
+			free(old_paths[i]);
+			free(new_paths[i]);
+		}
+		count += moved;
+		moved = 0;
+	}
+
+	ret = JALDB_OK;
+	goto out;
+
+err_abort:
+	if (cursor) {
+		cursor->c_close(cursor);
+		cursor = NULL;
+	}
+	txn->abort(txn);
+out:
+	// The records still point to the old paths.
+	for (i = 0; i < moved; i++) {
+		unlink(new_paths[i]);
+		free(old_paths[i]);
+		free(new_paths[i]);
+	}
+	if (moved_count) {
+		*moved_count = count;
+	}
+	if (db) {
+		db->close(db, 0);
+	}
+	if (env) {
+		env->close(env, 0);
+	}
+	free(key.data);
+	free(val.data);
+	free(journal_root);
+	return ret;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file jaldb_upgrade.h This file declares functions to upgrade an existing
+ * JALoP database to the current layout version.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#ifndef _JALDB_UPGRADE_H_
+#define _JALDB_UPGRADE_H_
+
+#include <stdint.h>
+#include "jaldb_status.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Upgrade a JALoP database to the current layout version
+ * (JALDB_DB_LAYOUT_VERSION).
+ *
+ * For each record type, this removes the timestamp indices, updates the
+ * layout version of every record in the primary database, rebuilds the
+ * secondary indices from the primary database, and then seeds the delivery
+ * state from the synced flag of each record (see jaldb_delivery_seed()).
+ * Records are updated in batches, and each step can safely be re-run, so if
+ * the upgrade is interrupted, it may simply be started again.
+ *
+ * No other process may have the database open while it is being upgraded.
+ *
+ * @param[in] db_root The root path of the DB Layer's files. If db_root is
+ * NULL, then the default is /var/lib/jalop/db.
+ * @param[out] upgraded_count If not NULL, this is set to the number of records
+ * whose layout version was updated.
+ *
+ * @return JALDB_OK on success, or an error code.
+ */
+enum jaldb_status jaldb_upgrade_db_layout(const char *db_root, uint64_t *upgraded_count);
+
+/**
+ * Move the payload files of journal records into \p fanout levels of
+ * directories (see jaldb_build_rel_path()), and update the path stored in
+ * each record.
+ *
+ * Each file is linked at its new path before the record is updated, and the
+ * old path is only removed once the update is committed, so a record always
+ * points to its file. If this is interrupted, it may simply be started
+ * again; at worst, a file is left with an extra link at its old path.
+ *
+ * No other process may have the database open while it is being upgraded,
+ * and the database must already be at the current layout version.
+ *
+ * @param[in] db_root The root path of the DB Layer's files. If db_root is
+ * NULL, then the default is /var/lib/jalop/db.
+ * @param[in] fanout The number of directory levels, from 1 to
+ * JALDB_FANOUT_MAX.
+ * @param[out] moved_count If not NULL, this is set to the number of files
+ * that were moved.
+ *
+ * @return JALDB_OK on success, or an error code.
+ */
+enum jaldb_status jaldb_upgrade_journal_fanout(const char *db_root, int fanout,
+		uint64_t *moved_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _JALDB_UPGRADE_H_
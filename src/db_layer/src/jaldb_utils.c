@@ -115,6 +115,68 @@ int jaldb_nonce_cmp(const char *nonce1, size_t s1_len, const char* nonce2, size_
 	return strcmp(nonce1, nonce2);
 }
 
+enum jaldb_status jaldb_build_rel_path(
+	char *buf,
+	size_t buf_len,
+	int fanout,
+	const char *uuid_str,
+	enum jaldb_rec_type rtype,
+	enum jaldb_data_type dtype)
+{
+	const char *type_name;
+	const char *data_name;
+	size_t pos = 0;
+	int i;
+	int len;
+
+	if (!buf || !uuid_str || fanout < 1 || fanout > JALDB_FANOUT_MAX
+			|| strlen(uuid_str) < 2 * (size_t) fanout) {
+		return JALDB_E_INVAL;
+	}
+
+	switch (rtype) {
+	case JALDB_RTYPE_JOURNAL:
+		type_name = "journal";
+		break;
+	case JALDB_RTYPE_AUDIT:
+		type_name = "audit";
+		break;
+	case JALDB_RTYPE_LOG:
+		type_name = "log";
+		break;
+	default:
+		return JALDB_E_INVAL;
+	}
+
+	switch (dtype) {
+	case JALDB_DTYPE_SYS_META:
+		data_name = "sys_meta";
+		break;
+	case JALDB_DTYPE_APP_META:
+		data_name = "app_meta";
+		break;
+	case JALDB_DTYPE_PAYLOAD:
+		data_name = "payload";
+		break;
+	default:
+		return JALDB_E_INVAL;
+	}
+
+	if (buf_len < 3 * (size_t) fanout) {
+		return JALDB_E_INVAL;
+	}
+	for (i = 0; i < fanout; i++) {
+		buf[pos++] = uuid_str[2 * i];
+		buf[pos++] = uuid_str[2 * i + 1];
+		buf[pos++] = '/';
+	}
+	len = snprintf(buf + pos, buf_len - pos, "%s_%s_%s", type_name, data_name, uuid_str);
+	if (len < 0 || (size_t) len >= buf_len - pos) {
+		return JALDB_E_INVAL;
+	}
+	return JALDB_OK;
+}
+
 enum jaldb_status jaldb_create_file(
 	const char *db_root,
 	char **relative_path_out,
@@ -122,113 +184,59 @@ enum jaldb_status jaldb_create_file(
 	uuid_t uuid,
 	enum jaldb_rec_type rtype,
 	enum jaldb_data_type dtype)
+{
+	return jaldb_create_file_with_fanout(db_root, JALDB_FANOUT_LEGACY,
+			relative_path_out, fd, uuid, rtype, dtype);
+}
+
+enum jaldb_status jaldb_create_file_with_fanout(
+	const char *db_root,
+	int fanout,
+	char **relative_path_out,
+	int *fd,
+	uuid_t uuid,
+	enum jaldb_rec_type rtype,
+	enum jaldb_data_type dtype)
 {
 	if (!db_root || !relative_path_out || *relative_path_out || !fd || uuid_is_null(uuid) || rtype == JALDB_RTYPE_UNKNOWN) {
 		return JALDB_E_INVAL;
 	}
 
-	#define UUID_STRING_REP_LEN 37
-
-	// First two hexidecimal characters of UUID as directory + /
-	#define DIRPATH_LEN 3
-
-	//TYPE_LEN is long enough to hold "_journal_sys_meta", which is the longest type name
-	#define TYPE_LEN 17
-
-	#define FILENAME_LEN UUID_STRING_REP_LEN + TYPE_LEN + 1
-
-	#define REL_PATH_LEN DIRPATH_LEN + FILENAME_LEN
-
-	enum jaldb_status ret = JALDB_E_INTERNAL_ERROR;
-	enum jal_status jal_ret = JAL_E_INVAL;
-
+	enum jaldb_status ret;
+	char uuid_string[UUID_STR_LEN];
+	char rel_path[JALDB_REL_PATH_MAX];
 	char *full_path = NULL;
-	char *suffix = NULL;
-	int root_len = -1;
 	int lfd = -1;
-	char *uuid_string = jal_calloc(UUID_STRING_REP_LEN,sizeof(char));
-	uuid_unparse(uuid,uuid_string);
 
-	root_len = strlen(db_root);
-
-	full_path = (char *) jal_calloc(root_len+REL_PATH_LEN,sizeof(char));
-
-	strcpy(full_path,db_root);
-
-	int path_pos = root_len;
-
-	// Grab the first two digits of the uuid for the directory to create
-	full_path[path_pos++] = uuid_string[0];
-	full_path[path_pos++] = uuid_string[1];
-	full_path[path_pos++] = '/';
-
-	suffix = jal_calloc(FILENAME_LEN,sizeof(char));
-
-	
-	if (rtype == JALDB_RTYPE_JOURNAL)
-	{
-		strcpy(suffix,"journal");
-	}
-	else if (rtype == JALDB_RTYPE_AUDIT)
-	{
-		strcpy(suffix,"audit");
-	}
-	else if (rtype == JALDB_RTYPE_LOG)
-	{
-		strcpy(suffix,"log");
-	}
-	else
-	{
-		ret = JALDB_E_INVAL;
-		goto error_out;
-	}
-
-	if (dtype == JALDB_DTYPE_SYS_META)
-	{
-		strcat(suffix,"_sys_meta_");
-	}
-	else if (dtype == JALDB_DTYPE_APP_META)
-	{
-		strcat(suffix,"_app_meta_");
-	}
-	else if (dtype == JALDB_DTYPE_PAYLOAD)
-	{
-		strcat(suffix,"_payload_");
-	}
-	else
-	{
-		ret = JALDB_E_INVAL;
-		goto error_out;
+	uuid_unparse(uuid, uuid_string);
+	ret = jaldb_build_rel_path(rel_path, sizeof(rel_path), fanout, uuid_string, rtype, dtype);
+	if (JALDB_OK != ret) {
+		goto out;
 	}
-	strcat(suffix,uuid_string);
 
-	jal_ret = jal_create_dirs(full_path);
-	if (JAL_OK != jal_ret) {
-		goto error_out;
+	ret = JALDB_E_INTERNAL_ERROR;
+	if (-1 == jal_asprintf(&full_path, "%s%s", db_root, rel_path)) {
+		goto out;
 	}
 
-	strcat(full_path,suffix);
-
-	// Create the file as read/write with permission mode set to owner read/write
+	// Create the file as read/write with permission mode set to owner read/write.
+	// Almost every directory already exists, so only try to create them
+	// when the open fails because one is missing.
 	lfd = open(full_path, O_RDWR | O_CREAT, S_IRUSR|S_IWUSR);
+	if (lfd == -1 && ENOENT == errno) {
+		if (JAL_OK != jal_create_dirs(full_path)) {
+			goto out;
+		}
+		lfd = open(full_path, O_RDWR | O_CREAT, S_IRUSR|S_IWUSR);
+	}
 	if (lfd == -1) {
-		goto error_out;
+		goto out;
 	}
 
 	ret = JALDB_OK;
-	*relative_path_out = jal_calloc(REL_PATH_LEN,sizeof(char));
-	memcpy(*relative_path_out, full_path + root_len, REL_PATH_LEN);
-	goto out;
-
-error_out:
-	if (lfd > -1) {
-		close(lfd);
-		lfd = -1;
-	}
+	*relative_path_out = jal_strdup(rel_path);
 out:
 	free(full_path);
-	free(uuid_string);
-	free(suffix);
 	*fd = lfd;
 	return ret;
 }
@@ -86,7 +86,54 @@ enum jaldb_status jaldb_store_confed_nonce(DB *db, DB_TXN *txn, const char *remo
 int jaldb_nonce_cmp(const char *nonce1, size_t s1_len, const char* nonce2, size_t s2_len);
 
 /**
- * Helper function to create a file in the databse.
+ * The number of directory levels jaldb_create_file() puts files in. This is
+ * the layout of stores created before the fan-out could be configured.
+ */
+#define JALDB_FANOUT_LEGACY 1
+
+/**
+ * The most directory levels a file may be put in. Each level is named by the
+ * next two hexadecimal characters of the UUID, and only the first 8
+ * characters of a UUID come before a '-'.
+ */
+#define JALDB_FANOUT_MAX 4
+
+/**
+ * The buffer size needed for any relative path built by
+ * jaldb_build_rel_path(), including the NULL terminator: 3 characters for
+ * each directory level, the longest type name ("journal_sys_meta_") and the
+ * UUID.
+ */
+#define JALDB_REL_PATH_MAX (3 * JALDB_FANOUT_MAX + 17 + 37)
+
+/**
+ * Build the path, relative to the root of the store, of the file for a
+ * segment of a record. The file is named <type>_<data type>_<uuid> and put
+ * in \p fanout levels of directories, each named by the next two characters
+ * of the UUID, e.g. "01/23/journal_payload_0123..." for 2 levels.
+ *
+ * @param[out] buf The buffer for the path, of at least JALDB_REL_PATH_MAX
+ * bytes.
+ * @param[in] buf_len The size of \p buf.
+ * @param[in] fanout The number of directory levels, from 1 to
+ * JALDB_FANOUT_MAX.
+ * @param[in] uuid_str The UUID of the file, as a string.
+ * @param[in] rtype The type of record.
+ * @param[in] dtype The type of data that is stored in the file.
+ *
+ * @return JALDB_OK on success, or JALDB_E_INVAL if a parameter is invalid.
+ */
+enum jaldb_status jaldb_build_rel_path(
+	char *buf,
+	size_t buf_len,
+	int fanout,
+	const char *uuid_str,
+	enum jaldb_rec_type rtype,
+	enum jaldb_data_type dtype);
+
+/**
+ * Helper function to create a file in the databse, in the layout of
+ * JALDB_FANOUT_LEGACY.
  * @param[in] db_root The root to create the file at
  * @param[out] path The path (relative to \p db_root) of the new file.
  * @param[out] fd An open file descriptor for this file.
@@ -101,6 +148,34 @@ enum jaldb_status jaldb_create_file(
 	enum jaldb_rec_type rtype,
 	enum jaldb_data_type dtype);
 
+/**
+ * Create a file in the database, in \p fanout levels of directories (see
+ * jaldb_build_rel_path()). The directories are only created when opening the
+ * file finds they are missing.
+ *
+ * @param[in] db_root The root to create the file at
+ * @param[in] fanout The number of directory levels, from 1 to
+ * JALDB_FANOUT_MAX.
+ * @param[out] path The path (relative to \p db_root) of the new file.
+ * @param[out] fd An open file descriptor for this file.
+ * @param[in] uuid The UUID to name the file by.
+ * @param[in] rtype The type of record.
+ * @param[in] dtype The type of data that is stored in the file.
+ *
+ * @return
+ *  - JALDB_OK on success
+ *  - JALDB_E_INVAL if a parameter is invalid
+ *  - JALDB_E_INTERNAL_ERROR if the file could not be created
+ */
+enum jaldb_status jaldb_create_file_with_fanout(
+	const char *db_root,
+	int fanout,
+	char **path,
+	int *fd,
+	uuid_t uuid,
+	enum jaldb_rec_type rtype,
+	enum jaldb_data_type dtype);
+
 /**
  * Create a timestamp for the Current time in the XML DateTime format.
  *
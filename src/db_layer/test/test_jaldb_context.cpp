@@ -45,15 +45,23 @@ extern "C" {
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <ftw.h>
 #include <libxml/xmlschemastypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include "jal_alloc.h"
+#include "jal_asprintf_internal.h"
+#include "jal_fs_utils.h"
 #include "jaldb_context.hpp"
+#include "jaldb_record_dbs.h"
+#include "jaldb_serialize_record.h"
 #include "jaldb_strings.h"
 #include "jaldb_segment.h"
 #include "jaldb_utils.h"
@@ -795,6 +803,443 @@ extern "C" void test_jaldb_mark_confirmed_returns_error_when_record_not_found()
 	jaldb_destroy_record(&temp_rec);
 }
 
+extern "C" void test_insert_records_works()
+{
+	struct jaldb_record *rec = NULL;
+	char *nonces[ITEMS_IN_DB] = { NULL, NULL, NULL, NULL };
+
+	assert_equals(JALDB_OK, jaldb_insert_records(context, records, ITEMS_IN_DB, 1, nonces));
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		assert_not_equals((void *)NULL, nonces[i]);
+		assert_equals(JALDB_OK, jaldb_get_record(context, JALDB_RTYPE_LOG, nonces[i], &rec));
+		assert_string_equals(records[i]->hostname, rec->hostname);
+		assert_equals(1, rec->confirmed);
+		jaldb_destroy_record(&rec);
+		free(nonces[i]);
+	}
+}
+
+extern "C" void test_insert_records_inserts_nothing_when_a_record_is_invalid()
+{
+	struct jaldb_record *rec = NULL;
+	char *nonces[ITEMS_IN_DB] = { NULL, NULL, NULL, NULL };
+	uuid_clear(records[2]->uuid);
+
+	assert_not_equals(JALDB_OK, jaldb_insert_records(context, records, ITEMS_IN_DB, 1, nonces));
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		assert_equals((void *)NULL, nonces[i]);
+	}
+	assert_equals(JALDB_E_NOT_FOUND, jaldb_next_unsynced_record(context, JALDB_RTYPE_LOG, &nonces[0], &rec));
+}
+
+static int count_stored_records(DB *db)
+{
+	DBC *cursor = NULL;
+	DBT key;
+	DBT val;
+	int count = 0;
+
+	memset(&key, 0, sizeof(key));
+	memset(&val, 0, sizeof(val));
+	key.flags = DB_DBT_REALLOC;
+	val.flags = DB_DBT_REALLOC;
+
+	assert_equals(0, db->cursor(db, NULL, &cursor, 0));
+	while (0 == cursor->c_get(cursor, &key, &val, DB_NEXT)) {
+		count++;
+	}
+	cursor->c_close(cursor);
+	free(key.data);
+	free(val.data);
+	return count;
+}
+
+extern "C" void test_insert_records_inserts_nothing_when_a_put_fails()
+{
+	struct jaldb_record *rec = NULL;
+	char *nonces[ITEMS_IN_DB] = { NULL, NULL, NULL, NULL };
+
+	// The timestamp is only parsed when the timestamp index is updated, so
+	// the first two records are already in the transaction when the put of
+	// the third one fails.
+	free(records[2]->timestamp);
+	records[2]->timestamp = jal_strdup("not a timestamp");
+
+	assert_not_equals(JALDB_OK, jaldb_insert_records(context, records, ITEMS_IN_DB, 1, nonces));
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		assert_equals((void *)NULL, nonces[i]);
+	}
+	assert_equals(0, count_stored_records(context->log_dbs->primary_db));
+	assert_equals(0, count_stored_records(context->log_dbs->timestamp_idx_db));
+	assert_equals(JALDB_E_NOT_FOUND, jaldb_next_unsynced_record(context, JALDB_RTYPE_LOG, &nonces[0], &rec));
+}
+
+extern "C" void test_insert_records_fails_with_invalid_input()
+{
+	char *nonces[ITEMS_IN_DB] = { NULL, NULL, NULL, NULL };
+
+	assert_equals(JALDB_E_INVAL, jaldb_insert_records(NULL, records, ITEMS_IN_DB, 1, nonces));
+	assert_equals(JALDB_E_INVAL, jaldb_insert_records(context, NULL, ITEMS_IN_DB, 1, nonces));
+	assert_equals(JALDB_E_INVAL, jaldb_insert_records(context, records, 0, 1, nonces));
+	assert_equals(JALDB_E_INVAL, jaldb_insert_records(context, records, ITEMS_IN_DB, 1, NULL));
+
+	nonces[1] = (char *)FAKE_NONCE;
+	assert_equals(JALDB_E_INVAL, jaldb_insert_records(context, records, ITEMS_IN_DB, 1, nonces));
+}
+
+static uint32_t stored_record_flags(const char *nonce)
+{
+	struct jaldb_record_view view;
+	int byte_swap;
+	DB *db = context->log_dbs->primary_db;
+	DBT key;
+	DBT val;
+
+	memset(&key, 0, sizeof(key));
+	memset(&val, 0, sizeof(val));
+	key.data = (void *)nonce;
+	key.size = strlen(nonce) + 1;
+	val.flags = DB_DBT_MALLOC;
+
+	assert_equals(0, db->get_byteswapped(db, &byte_swap));
+	assert_equals(0, db->get(db, NULL, &key, &val, 0));
+	assert_equals(JALDB_OK, jaldb_record_view_init(&view, byte_swap, (uint8_t *)val.data, val.size));
+	free(val.data);
+	return view.flags;
+}
+
+extern "C" void test_insert_record_stores_system_metadata()
+{
+	struct jaldb_record *rec = NULL;
+	char *nonce = NULL;
+
+	assert_equals((void *)NULL, records[0]->sys_meta);
+	assert_equals(JALDB_OK, jaldb_insert_record(context, records[0], 1, &nonce));
+	assert_not_equals((void *)NULL, records[0]->sys_meta);
+	assert_not_equals(0, stored_record_flags(nonce) & JALDB_RFLAGS_HAVE_SYS_META);
+
+	assert_equals(JALDB_OK, jaldb_get_record(context, JALDB_RTYPE_LOG, nonce, &rec));
+	assert_not_equals((void *)NULL, rec->sys_meta);
+	assert_equals(records[0]->sys_meta->length, rec->sys_meta->length);
+	assert_equals(0, memcmp(records[0]->sys_meta->payload, rec->sys_meta->payload, rec->sys_meta->length));
+	jaldb_destroy_record(&rec);
+	free(nonce);
+}
+
+extern "C" void test_get_record_stores_system_metadata_generated_for_old_records()
+{
+	struct jaldb_record *rec = NULL;
+	struct jaldb_segment *sys_meta = NULL;
+	uint8_t *buffer = NULL;
+	size_t buf_size = 0;
+	int byte_swap;
+	DB *db = context->log_dbs->primary_db;
+	DB_TXN *txn = NULL;
+	DBT key;
+	DBT val;
+
+	// Store a record the way older versions did, without system metadata.
+	records[0]->network_nonce = jal_strdup(FAKE_NONCE);
+	records[0]->confirmed = 1;
+	assert_equals(0, db->get_byteswapped(db, &byte_swap));
+	assert_equals(JALDB_OK, jaldb_serialize_record(byte_swap, records[0], &buffer, &buf_size));
+	memset(&key, 0, sizeof(key));
+	memset(&val, 0, sizeof(val));
+	key.data = (void *)FAKE_NONCE;
+	key.size = strlen(FAKE_NONCE) + 1;
+	val.data = buffer;
+	val.size = buf_size;
+	assert_equals(0, context->env->txn_begin(context->env, NULL, &txn, 0));
+	assert_equals(0, db->put(db, txn, &key, &val, DB_NOOVERWRITE));
+	assert_equals(0, txn->commit(txn, 0));
+	free(buffer);
+	assert_equals(0, stored_record_flags(FAKE_NONCE) & JALDB_RFLAGS_HAVE_SYS_META);
+
+	assert_equals(JALDB_OK, jaldb_get_record(context, JALDB_RTYPE_LOG, (char *)FAKE_NONCE, &rec));
+	assert_not_equals((void *)NULL, rec->sys_meta);
+	sys_meta = rec->sys_meta;
+	rec->sys_meta = NULL;
+	jaldb_destroy_record(&rec);
+	assert_not_equals(0, stored_record_flags(FAKE_NONCE) & JALDB_RFLAGS_HAVE_SYS_META);
+	assert_not_equals(0, stored_record_flags(FAKE_NONCE) & JALDB_RFLAGS_CONFIRMED);
+
+	assert_equals(JALDB_OK, jaldb_get_record(context, JALDB_RTYPE_LOG, (char *)FAKE_NONCE, &rec));
+	assert_equals(sys_meta->length, rec->sys_meta->length);
+	assert_equals(0, memcmp(sys_meta->payload, rec->sys_meta->payload, sys_meta->length));
+	jaldb_destroy_record(&rec);
+	jaldb_destroy_segment(&sys_meta);
+}
+
+extern "C" void test_enable_group_commit_fails_with_invalid_input()
+{
+	jaldb_context *ctx = jaldb_context_create();
+	assert_equals(JALDB_E_INVAL, jaldb_enable_group_commit(NULL, 10, 1000));
+	assert_equals(JALDB_E_INVAL, jaldb_enable_group_commit(ctx, 10, 1000));
+	assert_equals(JALDB_E_INVAL, jaldb_enable_group_commit(context, 0, 1000));
+	assert_equals(JALDB_OK, jaldb_enable_group_commit(context, 10, 1000));
+	assert_equals(JALDB_E_INVAL, jaldb_enable_group_commit(context, 10, 1000));
+	jaldb_context_destroy(&ctx);
+}
+
+extern "C" void test_insert_record_works_with_group_commit()
+{
+	struct jaldb_record *rec = NULL;
+	char *nonce = NULL;
+
+	// A long delay would only be reached if the batch never filled.
+	assert_equals(JALDB_OK, jaldb_enable_group_commit(context, 1, 60 * 1000000));
+	assert_equals(JALDB_OK, jaldb_insert_record(context, records[0], 1, &nonce));
+	assert_equals(JALDB_OK, jaldb_get_record(context, JALDB_RTYPE_LOG, nonce, &rec));
+	assert_string_equals(records[0]->hostname, rec->hostname);
+	jaldb_destroy_record(&rec);
+	free(nonce);
+}
+
+extern "C" void test_set_journal_layout_fails_with_invalid_input()
+{
+	jaldb_context *ctx = jaldb_context_create();
+	assert_equals(JALDB_E_INVAL, jaldb_set_journal_layout(NULL, 2, 0));
+	assert_equals(JALDB_E_INVAL, jaldb_set_journal_layout(ctx, 2, 0));
+	assert_equals(JALDB_E_INVAL, jaldb_set_journal_layout(context, 0, 0));
+	assert_equals(JALDB_E_INVAL, jaldb_set_journal_layout(context, JALDB_FANOUT_MAX + 1, 0));
+	assert_equals(JALDB_OK, jaldb_set_journal_layout(context, 3, 4));
+	assert_equals(JALDB_E_INVAL, jaldb_set_journal_layout(context, 3, 4));
+	jaldb_context_destroy(&ctx);
+}
+
+static int journal_file_count;
+
+static int count_journal_file(const char *path, const struct stat *st, int type,
+		struct FTW *ftw)
+{
+	if (FTW_F == type) {
+		journal_file_count++;
+	}
+	return 0;
+}
+
+extern "C" void test_create_journal_file_uses_fanout()
+{
+	char *path = NULL;
+	char *full_path = NULL;
+	int fd = -1;
+
+	assert_equals(JALDB_OK, jaldb_set_journal_layout(context, 3, 0));
+	assert_equals(JALDB_OK, jaldb_create_journal_file(context, strlen(PAYLOAD), &path, &fd));
+	assert_not_equals(-1, fd);
+	assert_equals('/', path[2]);
+	assert_equals('/', path[5]);
+	assert_equals('/', path[8]);
+	assert_equals(0, strncmp(path + 9, "journal_payload_", strlen("journal_payload_")));
+	assert_equals(0, strncmp(path, path + 25, 2));
+
+	assert_equals((ssize_t) strlen(PAYLOAD), write(fd, PAYLOAD, strlen(PAYLOAD)));
+	assert_not_equals(-1, jal_asprintf(&full_path, "%s%s", context->journal_root, path));
+	struct stat st;
+	assert_equals(0, stat(full_path, &st));
+	assert_equals((off_t) strlen(PAYLOAD), st.st_size);
+
+	close(fd);
+	free(full_path);
+	free(path);
+}
+
+extern "C" void test_create_journal_file_removes_unused_pool_files()
+{
+	char *paths[8];
+	int fd = -1;
+	char *journal_root = jal_strdup(context->journal_root);
+
+	assert_equals(JALDB_OK, jaldb_set_journal_layout(context, 2, 4));
+	for (int i = 0; i < 8; i++) {
+		paths[i] = NULL;
+		assert_equals(JALDB_OK, jaldb_create_journal_file(context, 0, &paths[i], &fd));
+		assert_not_equals(-1, fd);
+		close(fd);
+		for (int j = 0; j < i; j++) {
+			assert_not_equals(0, strcmp(paths[i], paths[j]));
+		}
+	}
+
+	// Only the files that were handed out are left.
+	jaldb_context_destroy(&context);
+	journal_file_count = 0;
+	assert_equals(0, nftw(journal_root, count_journal_file, 16, FTW_PHYS));
+	assert_equals(8, journal_file_count);
+
+	for (int i = 0; i < 8; i++) {
+		free(paths[i]);
+	}
+	free(journal_root);
+}
+
+/**
+ * Create a pooled file in the pool directory of process \p pid, and return
+ * its path.
+ */
+static char *create_pool_file(pid_t pid)
+{
+	char *path = NULL;
+	assert_not_equals(-1, jal_asprintf(&path, "%s%s%d/journal_payload_leftover",
+				context->journal_root, JALDB_JOURNAL_POOL_DIR_NAME, (int) pid));
+	assert_equals(JAL_OK, jal_create_dirs(path));
+	int fd = open(path, O_RDWR | O_CREAT, S_IRUSR|S_IWUSR);
+	assert_not_equals(-1, fd);
+	close(fd);
+	return path;
+}
+
+extern "C" void test_context_init_removes_pool_files_of_exited_processes()
+{
+	pid_t pid = fork();
+	if (0 == pid) {
+		_exit(0);
+	}
+	assert_equals(pid, waitpid(pid, NULL, 0));
+
+	char *exited_path = create_pool_file(pid);
+	char *running_path = create_pool_file(getppid());
+
+	jaldb_context_destroy(&context);
+	context = jaldb_context_create();
+	assert_equals(JALDB_OK, jaldb_context_init(context, OTHER_DB_ROOT, OTHER_SCHEMA_ROOT, false));
+
+	assert_equals(-1, access(exited_path, F_OK));
+	*strrchr(exited_path, '/') = '\0';
+	assert_equals(-1, access(exited_path, F_OK));
+	assert_equals(0, access(running_path, F_OK));
+
+	free(exited_path);
+	free(running_path);
+}
+
+struct group_commit_insert_args {
+	struct jaldb_record *rec;
+	char *nonce;
+	enum jaldb_status ret;
+};
+
+static void *group_commit_insert(void *arg)
+{
+	struct group_commit_insert_args *args = (struct group_commit_insert_args *)arg;
+	args->ret = jaldb_insert_record(context, args->rec, 1, &args->nonce);
+	return NULL;
+}
+
+extern "C" void test_group_commit_batches_concurrent_inserts()
+{
+	struct jaldb_record *rec = NULL;
+	pthread_t threads[ITEMS_IN_DB];
+	struct group_commit_insert_args args[ITEMS_IN_DB];
+
+	assert_equals(JALDB_OK, jaldb_enable_group_commit(context, ITEMS_IN_DB, 1000));
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		args[i].rec = records[i];
+		args[i].nonce = NULL;
+		args[i].ret = JALDB_E_UNKNOWN;
+		assert_equals(0, pthread_create(&threads[i], NULL, group_commit_insert, &args[i]));
+	}
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		assert_equals(0, pthread_join(threads[i], NULL));
+	}
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		assert_equals(JALDB_OK, args[i].ret);
+		assert_equals(JALDB_OK, jaldb_get_record(context, JALDB_RTYPE_LOG, args[i].nonce, &rec));
+		assert_string_equals(records[i]->hostname, rec->hostname);
+		jaldb_destroy_record(&rec);
+		free(args[i].nonce);
+	}
+}
+
+extern "C" void test_group_commit_does_not_fail_valid_records_in_batch()
+{
+	pthread_t threads[2];
+	struct group_commit_insert_args args[2];
+
+	// Bypass the sanity check to get an unserializable record into the batch.
+	records[1]->type = (enum jaldb_rec_type)42;
+
+	assert_equals(JALDB_OK, jaldb_enable_group_commit(context, 2, 1000000));
+	for (int i = 0; i < 2; i++) {
+		args[i].rec = records[i];
+		args[i].nonce = NULL;
+		args[i].ret = JALDB_E_UNKNOWN;
+		assert_equals(0, pthread_create(&threads[i], NULL, group_commit_insert, &args[i]));
+	}
+	for (int i = 0; i < 2; i++) {
+		assert_equals(0, pthread_join(threads[i], NULL));
+	}
+	assert_equals(JALDB_OK, args[0].ret);
+	assert_not_equals(JALDB_OK, args[1].ret);
+	assert_equals((void *)NULL, args[1].nonce);
+	free(args[0].nonce);
+}
+
+extern "C" void test_record_waiter_create_fails_with_invalid_input()
+{
+	jaldb_context *ctx = jaldb_context_create();
+	assert_equals((void *)NULL, jaldb_record_waiter_create(NULL));
+	assert_equals((void *)NULL, jaldb_record_waiter_create(ctx));
+	jaldb_context_destroy(&ctx);
+
+	assert_equals(JALDB_E_INVAL, jaldb_wait_for_record(NULL, 0));
+
+	jaldb_record_waiter *waiter = jaldb_record_waiter_create(context);
+	assert_not_equals((void *)NULL, waiter);
+	assert_equals(JALDB_E_INVAL, jaldb_wait_for_record(waiter, -1));
+	jaldb_record_waiter_destroy(&waiter);
+	assert_equals((void *)NULL, waiter);
+	jaldb_record_waiter_destroy(&waiter);
+	jaldb_record_waiter_destroy(NULL);
+}
+
+extern "C" void test_wait_for_record_times_out_without_inserts()
+{
+	jaldb_record_waiter *waiter = jaldb_record_waiter_create(context);
+	assert_equals(JALDB_E_NOT_FOUND, jaldb_wait_for_record(waiter, 10));
+	jaldb_record_waiter_destroy(&waiter);
+}
+
+extern "C" void test_wait_for_record_returns_after_insert()
+{
+	char *nonce = NULL;
+	jaldb_record_waiter *waiter = jaldb_record_waiter_create(context);
+
+	// The insert happens before the wait, it must not be missed.
+	assert_equals(JALDB_OK, jaldb_insert_record(context, records[0], 1, &nonce));
+	assert_equals(JALDB_OK, jaldb_wait_for_record(waiter, 60 * 1000));
+	assert_equals(JALDB_E_NOT_FOUND, jaldb_wait_for_record(waiter, 0));
+
+	jaldb_record_waiter_destroy(&waiter);
+	free(nonce);
+}
+
+static void *delayed_insert(void *arg)
+{
+	struct group_commit_insert_args *args = (struct group_commit_insert_args *)arg;
+	usleep(10000);
+	args->ret = jaldb_insert_record(context, args->rec, 1, &args->nonce);
+	return NULL;
+}
+
+extern "C" void test_wait_for_record_wakes_on_insert_from_other_thread()
+{
+	pthread_t thread;
+	struct group_commit_insert_args args;
+	args.rec = records[0];
+	args.nonce = NULL;
+	args.ret = JALDB_E_UNKNOWN;
+
+	jaldb_record_waiter *waiter = jaldb_record_waiter_create(context);
+	assert_equals(0, pthread_create(&thread, NULL, delayed_insert, &args));
+	assert_equals(JALDB_OK, jaldb_wait_for_record(waiter, 60 * 1000));
+	assert_equals(0, pthread_join(thread, NULL));
+	assert_equals(JALDB_OK, args.ret);
+
+	jaldb_record_waiter_destroy(&waiter);
+	free(args.nonce);
+}
+
 // Disabling tests for now
 #if 0
 extern "C" void test_db_destroy_does_not_crash()
@@ -187,19 +187,6 @@ void test_extract_datetime_common_calls_error_handler_on_bad_parse()
 	assert_not_equals(JALDB_OK, ret);
 }
 
-void test_extract_datetime_fails_with_bad_schema_type()
-{
-	replace_function(xmlSchemaGetBuiltInType, mock_xmlSchemaGetBuiltInType);
-
-	enum jaldb_status ret;
-	char *dtString = NULL;
-	size_t dtLen = 0;
-
-	ret = jaldb_extract_datetime_key_common(buffer, &dtString, &dtLen);
-	assert_not_equals(JALDB_OK, ret);
-
-}
-
 void test_extract_datetime_fails_for_bad_input()
 {
 	enum jaldb_status ret;
@@ -251,12 +238,166 @@ void test_extract_datetime_key_works()
 	DBT result;
 	memset(&result, 0, sizeof(result));
 
+	uint8_t expected[JALDB_DATETIME_KEY_LEN];
+
 	strcpy(datetime_in_buffer, DT8);
 	ret = jaldb_extract_datetime_key(NULL, NULL, &dbt_record, &result);
 
 	assert_equals(0, ret);
 	assert_not_equals((void*) NULL, result.data);
-	assert_equals(strlen(DT8) + 1, result.size);
-	assert_equals(0, strcmp(result.data, DT8));
+	assert_equals(JALDB_DATETIME_KEY_LEN, result.size);
+	assert_equals(JALDB_OK, jaldb_datetime_to_key(DT8, strlen(DT8), expected));
+	assert_equals(0, memcmp(result.data, expected, JALDB_DATETIME_KEY_LEN));
 	free(result.data);
 }
+
+void test_extract_datetime_key_fails_on_bad_datetime()
+{
+	int ret;
+	DBT result;
+	memset(&result, 0, sizeof(result));
+
+	strcpy(datetime_in_buffer, BAD_DATETIME);
+	ret = jaldb_extract_datetime_key(NULL, NULL, &dbt_record, &result);
+	assert_not_equals(0, ret);
+}
+
+void test_extract_nonce_timestamp_key_works()
+{
+	int ret;
+	DBT key;
+	DBT result;
+	uint8_t expected[JALDB_DATETIME_KEY_LEN];
+	char nonce[] = "00000000-0000-0000-0000-000000000001_" DT8 "_123_456";
+	memset(&key, 0, sizeof(key));
+	memset(&result, 0, sizeof(result));
+	key.data = nonce;
+	key.size = strlen(nonce) + 1;
+
+	ret = jaldb_extract_nonce_timestamp_key(NULL, &key, NULL, &result);
+	assert_equals(0, ret);
+	assert_equals(JALDB_DATETIME_KEY_LEN, result.size);
+	assert_equals(JALDB_OK, jaldb_datetime_to_key(DT8, strlen(DT8), expected));
+	assert_equals(0, memcmp(result.data, expected, JALDB_DATETIME_KEY_LEN));
+	free(result.data);
+}
+
+void test_extract_nonce_timestamp_key_does_not_index_bad_nonce()
+{
+	DBT key;
+	DBT result;
+	char nonce[] = "no_timestamp_here";
+	memset(&key, 0, sizeof(key));
+	memset(&result, 0, sizeof(result));
+	key.data = nonce;
+	key.size = strlen(nonce) + 1;
+
+	assert_equals(DB_DONOTINDEX, jaldb_extract_nonce_timestamp_key(NULL, &key, NULL, &result));
+}
+
+/////////////////////////////////////////////////////
+// Unit tests for binary DateTime keys
+/////////////////////////////////////////////////////
+static int compare_datetimes(const char *dt1, const char *dt2)
+{
+	uint8_t key1[JALDB_DATETIME_KEY_LEN];
+	uint8_t key2[JALDB_DATETIME_KEY_LEN];
+	DBT k1;
+	DBT k2;
+	memset(&k1, 0, sizeof(k1));
+	memset(&k2, 0, sizeof(k2));
+	assert_equals(JALDB_OK, jaldb_datetime_to_key(dt1, strlen(dt1), key1));
+	assert_equals(JALDB_OK, jaldb_datetime_to_key(dt2, strlen(dt2), key2));
+	k1.data = key1;
+	k1.size = sizeof(key1);
+	k2.data = key2;
+	k2.size = sizeof(key2);
+	int ret = jaldb_datetime_key_compare(NULL, &k1, &k2);
+	return (ret < 0) ? -1 : ((ret > 0) ? 1 : 0);
+}
+
+void test_datetime_key_compare_matches_xml_datetime_compare()
+{
+	assert_equals(-1, compare_datetimes(DT1, DT2));
+	assert_equals( 1, compare_datetimes(DT2, DT1));
+	assert_equals( 0, compare_datetimes(DT1, DT1));
+
+	assert_equals(-1, compare_datetimes(DT3, DT4));
+	assert_equals( 0, compare_datetimes(DT5, DT5));
+	assert_equals(-1, compare_datetimes(DT5, DT7));
+	assert_equals(-1, compare_datetimes(DT5, DT6));
+	assert_equals(-1, compare_datetimes(DT6, DT7));
+	assert_equals( 1, compare_datetimes(DT7, DT6));
+	assert_equals( 1, compare_datetimes(DT7, DT5));
+	assert_equals( 1, compare_datetimes(DT6, DT5));
+}
+
+void test_datetime_key_normalizes_timezones()
+{
+	assert_equals(0, compare_datetimes("2012-12-12T09:00:00Z", "2012-12-12T04:00:00-05:00"));
+	assert_equals(0, compare_datetimes("2012-12-31T23:30:00-01:00", "2013-01-01T00:30:00Z"));
+	assert_equals(0, compare_datetimes("2012-12-12T09:00:00", "2012-12-12T09:00:00Z"));
+	assert_equals(0, compare_datetimes("2012-12-12T24:00:00Z", "2012-12-13T00:00:00Z"));
+}
+
+void test_datetime_key_orders_fractional_seconds()
+{
+	assert_equals(0, compare_datetimes("2012-12-12T09:00:00.1Z", "2012-12-12T09:00:00.100000Z"));
+	assert_equals(-1, compare_datetimes("2012-12-12T09:00:00.9Z", "2012-12-12T09:00:01Z"));
+	assert_equals(-1, compare_datetimes("2012-12-12T09:00:00.0000001Z", "2012-12-12T09:00:00.0000002Z"));
+	assert_equals(-1, compare_datetimes("1969-12-31T23:59:59.999999Z", "1970-01-01T00:00:00Z"));
+	assert_equals(-1, compare_datetimes("-0001-01-01T00:00:00Z", "0001-01-01T00:00:00Z"));
+}
+
+void test_datetime_to_key_rejects_bad_datetimes()
+{
+	uint8_t key[JALDB_DATETIME_KEY_LEN];
+	const char *bad[] = {
+		BAD_DATETIME,
+		"2012-12-12T09:00:0",
+		"2012-12-12 09:00:00",
+		"2012-13-12T09:00:00",
+		"2013-02-29T09:00:00",
+		"2012-12-12T25:00:00",
+		"2012-12-12T24:00:01",
+		"2012-12-12T09:60:00",
+		"2012-12-12T09:00:00.",
+		"2012-12-12T09:00:00+15:00",
+		"2012-12-12T09:00:00Zjunk",
+		"12-12-12T09:00:00",
+	};
+	for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		assert_equals(JALDB_E_INVAL_TIMESTAMP, jaldb_datetime_to_key(bad[i], strlen(bad[i]), key));
+	}
+	assert_equals(JALDB_OK, jaldb_datetime_to_key("2012-02-29T09:00:00", strlen("2012-02-29T09:00:00"), key));
+	assert_equals(JALDB_E_INVAL, jaldb_datetime_to_key(NULL, 0, key));
+	assert_equals(JALDB_E_INVAL, jaldb_datetime_to_key(DT1, strlen(DT1), NULL));
+}
+
+void test_key_to_datetime_round_trips()
+{
+	uint8_t key[JALDB_DATETIME_KEY_LEN];
+	char *dt = NULL;
+
+	assert_equals(JALDB_OK, jaldb_datetime_to_key(DT8, strlen(DT8), key));
+	assert_equals(JALDB_OK, jaldb_key_to_datetime(key, sizeof(key), &dt));
+	assert_string_equals("2012-12-12T09:00:00.000010Z", dt);
+	free(dt);
+	dt = NULL;
+
+	assert_equals(JALDB_OK, jaldb_datetime_to_key(DT5, strlen(DT5), key));
+	assert_equals(JALDB_OK, jaldb_key_to_datetime(key, sizeof(key), &dt));
+	assert_string_equals("2012-12-12T16:59:59.999990Z", dt);
+	free(dt);
+	dt = NULL;
+
+	assert_equals(JALDB_OK, jaldb_datetime_to_key("1969-12-31T23:59:59.0000005Z", strlen("1969-12-31T23:59:59.0000005Z"), key));
+	assert_equals(JALDB_OK, jaldb_key_to_datetime(key, sizeof(key), &dt));
+	assert_string_equals("1969-12-31T23:59:59.000000500000Z", dt);
+	free(dt);
+	dt = NULL;
+
+	assert_equals(JALDB_E_INVAL, jaldb_key_to_datetime(key, sizeof(key) - 1, &dt));
+	assert_equals(JALDB_E_INVAL, jaldb_key_to_datetime(NULL, sizeof(key), &dt));
+	assert_equals(JALDB_E_INVAL, jaldb_key_to_datetime(key, sizeof(key), NULL));
+}
@@ -0,0 +1,289 @@
+/**
+ * @file test_jaldb_delivery.cpp This file contains functions to test
+ * jaldb_delivery.cpp.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The test-dept code doesn't work very well in C++ when __STRICT_ANSI__ is
+// not defined. It tries to use some gcc extensions that don't work well with
+// C++.
+
+#ifndef __STRICT_ANSI__
+#define __STRICT_ANSI__
+#endif
+
+extern "C" {
+#include <test-dept.h>
+}
+
+#include "test_utils.h"
+#include <db.h>
+#include <libxml/xmlschemastypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "jal_alloc.h"
+#include "jaldb_context.hpp"
+#include "jaldb_delivery.h"
+#include "jaldb_record.h"
+#include "jaldb_segment.h"
+
+#define OTHER_DB_ROOT "./testdb/"
+#define OTHER_SCHEMA_ROOT "./schemas/"
+#define HOST_A "subscriber_a"
+#define HOST_B "subscriber_b"
+
+#define DT1 "2012-12-12T09:00:00.00000"
+#define HN1 "somehost"
+#define UN1 "someuser"
+#define S1 "source1"
+
+#define EXPECTED_RECORD_VERSION 1
+
+static const char *uuids[] = {
+	"11234567-89AB-CDEF-0123-456789ABCDEF",
+	"21234567-89AB-CDEF-0123-456789ABCDEF",
+	"31234567-89AB-CDEF-0123-456789ABCDEF",
+	"41234567-89AB-CDEF-0123-456789ABCDEF",
+};
+#define UUID_5 "51234567-89AB-CDEF-0123-456789ABCDEF"
+#define UUID_6 "61234567-89AB-CDEF-0123-456789ABCDEF"
+
+#define ITEMS_IN_DB 4
+static jaldb_context *context = NULL;
+static char *nonces[ITEMS_IN_DB];
+
+static char *next_nonce(const char *host)
+{
+	char *nonce = NULL;
+	struct jaldb_record *rec = NULL;
+	enum jaldb_status ret;
+
+	ret = jaldb_delivery_next_record(context, JALDB_RTYPE_LOG, host, &nonce, &rec);
+	if (JALDB_OK != ret) {
+		return NULL;
+	}
+	assert_not_equals((void*) NULL, rec);
+	jaldb_destroy_record(&rec);
+	return nonce;
+}
+
+static void assert_next_nonce(const char *host, const char *expected)
+{
+	char *nonce = next_nonce(host);
+	if (expected) {
+		assert_string_equals(expected, nonce);
+	} else {
+		assert_pointer_equals((void*) NULL, nonce);
+	}
+	free(nonce);
+}
+
+static char *insert_record(const char *uuid, int confirmed)
+{
+	char *nonce = NULL;
+	struct jaldb_record *rec = jaldb_create_record();
+	rec->version = EXPECTED_RECORD_VERSION;
+	rec->type = JALDB_RTYPE_LOG;
+	rec->timestamp = jal_strdup(DT1);
+	rec->hostname = jal_strdup(HN1);
+	rec->source = jal_strdup(S1);
+	rec->username = jal_strdup(UN1);
+	rec->payload = jaldb_create_segment();
+	assert_equals(0, uuid_parse(uuid, rec->uuid));
+
+	assert_equals(JALDB_OK, jaldb_insert_record(context, rec, confirmed, &nonce));
+	jaldb_destroy_record(&rec);
+	return nonce;
+}
+
+extern "C" void setup()
+{
+	dir_cleanup(OTHER_DB_ROOT);
+	mkdir(OTHER_DB_ROOT, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+
+	context = jaldb_context_create();
+	assert_equals(JALDB_OK, jaldb_context_init(context, OTHER_DB_ROOT, OTHER_SCHEMA_ROOT, false));
+
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		nonces[i] = insert_record(uuids[i], 1);
+	}
+}
+
+extern "C" void teardown()
+{
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		free(nonces[i]);
+		nonces[i] = NULL;
+	}
+	jaldb_context_destroy(&context);
+	dir_cleanup(OTHER_DB_ROOT);
+	xmlSchemaCleanupTypes();
+}
+
+extern "C" void test_next_record_returns_error_on_invalid_input()
+{
+	char *nonce = NULL;
+	struct jaldb_record *rec = NULL;
+
+	assert_equals(JALDB_E_INVAL, jaldb_delivery_next_record(NULL, JALDB_RTYPE_LOG, HOST_A, &nonce, &rec));
+	assert_equals(JALDB_E_INVAL, jaldb_delivery_next_record(context, JALDB_RTYPE_UNKNOWN, HOST_A, &nonce, &rec));
+	assert_equals(JALDB_E_INVAL, jaldb_delivery_next_record(context, JALDB_RTYPE_LOG, NULL, &nonce, &rec));
+	assert_equals(JALDB_E_INVAL, jaldb_delivery_next_record(context, JALDB_RTYPE_LOG, HOST_A, NULL, &rec));
+	assert_equals(JALDB_E_INVAL, jaldb_delivery_next_record(context, JALDB_RTYPE_LOG, HOST_A, &nonce, NULL));
+	assert_pointer_equals((void*) NULL, nonce);
+	assert_pointer_equals((void*) NULL, rec);
+}
+
+extern "C" void test_each_subscriber_gets_every_record_in_order()
+{
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		assert_next_nonce(HOST_A, nonces[i]);
+	}
+	assert_next_nonce(HOST_A, NULL);
+
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		assert_next_nonce(HOST_B, nonces[i]);
+	}
+	assert_next_nonce(HOST_B, NULL);
+}
+
+extern "C" void test_reset_resends_only_unsynced_records()
+{
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		assert_next_nonce(HOST_A, nonces[i]);
+	}
+	assert_equals(JALDB_OK, jaldb_delivery_mark_synced(context, JALDB_RTYPE_LOG, HOST_A, nonces[0]));
+	assert_equals(JALDB_OK, jaldb_delivery_mark_synced(context, JALDB_RTYPE_LOG, HOST_A, nonces[2]));
+
+	assert_equals(JALDB_OK, jaldb_delivery_reset(context, JALDB_RTYPE_LOG, HOST_A));
+	assert_next_nonce(HOST_A, nonces[1]);
+	assert_next_nonce(HOST_A, nonces[3]);
+	assert_next_nonce(HOST_A, NULL);
+}
+
+extern "C" void test_reset_does_not_affect_other_subscribers()
+{
+	assert_next_nonce(HOST_A, nonces[0]);
+	assert_next_nonce(HOST_B, nonces[0]);
+
+	assert_equals(JALDB_OK, jaldb_delivery_reset(context, JALDB_RTYPE_LOG, HOST_A));
+	assert_next_nonce(HOST_A, nonces[0]);
+	assert_next_nonce(HOST_B, nonces[1]);
+}
+
+extern "C" void test_reset_works_for_unknown_subscriber()
+{
+	assert_equals(JALDB_OK, jaldb_delivery_reset(context, JALDB_RTYPE_LOG, HOST_A));
+	assert_next_nonce(HOST_A, nonces[0]);
+}
+
+extern "C" void test_mark_unsent_resends_record()
+{
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		assert_next_nonce(HOST_A, nonces[i]);
+	}
+	assert_equals(JALDB_OK, jaldb_delivery_mark_unsent(context, JALDB_RTYPE_LOG, HOST_A, nonces[1]));
+	assert_next_nonce(HOST_A, nonces[1]);
+	assert_next_nonce(HOST_A, NULL);
+}
+
+extern "C" void test_mark_synced_returns_not_found_for_unsent_record()
+{
+	assert_next_nonce(HOST_A, nonces[0]);
+	assert_equals(JALDB_E_NOT_FOUND, jaldb_delivery_mark_synced(context, JALDB_RTYPE_LOG, HOST_B, nonces[0]));
+	assert_equals(JALDB_E_NOT_FOUND, jaldb_delivery_mark_unsent(context, JALDB_RTYPE_LOG, HOST_B, nonces[0]));
+}
+
+extern "C" void test_mark_synced_flags_record_as_synced()
+{
+	struct jaldb_record *rec = NULL;
+
+	assert_next_nonce(HOST_A, nonces[0]);
+	assert_next_nonce(HOST_B, nonces[0]);
+	assert_equals(JALDB_OK, jaldb_delivery_mark_synced(context, JALDB_RTYPE_LOG, HOST_A, nonces[0]));
+	assert_equals(JALDB_OK, jaldb_delivery_mark_synced(context, JALDB_RTYPE_LOG, HOST_B, nonces[0]));
+
+	assert_equals(JALDB_OK, jaldb_get_record(context, JALDB_RTYPE_LOG, nonces[0], &rec));
+	assert_equals(JALDB_SYNCED, rec->synced);
+	jaldb_destroy_record(&rec);
+
+	assert_equals(JALDB_OK, jaldb_get_record(context, JALDB_RTYPE_LOG, nonces[1], &rec));
+	assert_equals(JALDB_NOT_SENT, rec->synced);
+	jaldb_destroy_record(&rec);
+}
+
+extern "C" void test_next_record_skips_unconfirmed_records()
+{
+	char *unconfirmed = insert_record(UUID_5, 0);
+	char *confirmed = insert_record(UUID_6, 1);
+
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		assert_next_nonce(HOST_A, nonces[i]);
+	}
+	assert_next_nonce(HOST_A, confirmed);
+	assert_next_nonce(HOST_A, NULL);
+
+	free(unconfirmed);
+	free(confirmed);
+}
+
+extern "C" void test_seed_skips_records_synced_before_upgrade()
+{
+	assert_equals(JALDB_OK, jaldb_mark_synced(context, JALDB_RTYPE_LOG, nonces[0]));
+	assert_equals(JALDB_OK, jaldb_mark_synced(context, JALDB_RTYPE_LOG, nonces[2]));
+
+	assert_equals(JALDB_OK, jaldb_delivery_seed(context->env, context->log_dbs));
+	assert_next_nonce(HOST_A, nonces[1]);
+	assert_next_nonce(HOST_A, nonces[3]);
+	assert_next_nonce(HOST_A, NULL);
+
+	assert_next_nonce(HOST_B, nonces[1]);
+	assert_next_nonce(HOST_B, nonces[3]);
+	assert_next_nonce(HOST_B, NULL);
+}
+
+extern "C" void test_seed_does_nothing_once_subscribers_have_state()
+{
+	assert_next_nonce(HOST_A, nonces[0]);
+	assert_equals(JALDB_OK, jaldb_mark_synced(context, JALDB_RTYPE_LOG, nonces[0]));
+
+	assert_equals(JALDB_OK, jaldb_delivery_seed(context->env, context->log_dbs));
+	assert_next_nonce(HOST_B, nonces[0]);
+}
+
+extern "C" void test_seed_returns_error_on_invalid_input()
+{
+	assert_equals(JALDB_E_INVAL, jaldb_delivery_seed(NULL, context->log_dbs));
+	assert_equals(JALDB_E_INVAL, jaldb_delivery_seed(context->env, NULL));
+}
+
+extern "C" void test_next_record_skips_removed_records()
+{
+	assert_equals(JALDB_OK, jaldb_remove_record(context, JALDB_RTYPE_LOG, nonces[0]));
+	assert_next_nonce(HOST_A, nonces[1]);
+}
@@ -64,6 +64,7 @@ RSA *key;
 #define GOOD_SYS_META "./test-input/system-metadata.xml"
 #define GOOD_SYS_META_CDATA "./test-input/system-metadata-with-cdata.xml"
 #define MALFORMED_SYS_META "./test-input/system-metadata-malformed.xml"
+#define JAL_SHA256_ALGORITHM_URI "http://www.w3.org/2001/04/xmlenc#sha256"
 #define SIGNATURE "tOpBqUbWFLwxN/IEQVv3VOkzGnuNywqZE1F1ahnbO6SE3hNkeEGofQd9xxcj+uy8\nLOh4FIh0WHpZx8Wz5y29TA=="
 
 void setup()
@@ -244,6 +245,92 @@ void test_to_system_works_with_signing_key()
 	VERIFY_DOC(log, 1, 1, 1);
 }
 
+void test_to_system_escapes_special_characters()
+{
+	enum jaldb_status ret;
+	struct jaldb_record *parsed = NULL;
+	char *dbuf = NULL;
+	size_t dbufsz = 0;
+
+	rec.type = JALDB_RTYPE_AUDIT;
+	rec.hostname = "host & <name> \"quoted\" caf\xc3\xa9";
+	rec.username = "user \"<name>\"\ttab";
+	rec.sec_lbl = "label & <more>";
+
+	ret = jaldb_record_to_system_metadata_doc(&rec, NULL, NULL, 0, NULL, NULL, 0, NULL, &dbuf, &dbufsz);
+	assert_equals(JALDB_OK, ret);
+	assert_equals(strlen(dbuf), dbufsz);
+
+	assert_equals(JAL_OK, jaldb_xml_to_sys_metadata((uint8_t *)dbuf, dbufsz, &parsed));
+	assert_not_equals((void *)NULL, parsed);
+	assert_string_equals(rec.hostname, parsed->hostname);
+	assert_string_equals(rec.username, parsed->username);
+	assert_string_equals(rec.sec_lbl, parsed->sec_lbl);
+	assert_string_equals(rec.timestamp, parsed->timestamp);
+	assert_equals(JALDB_RTYPE_AUDIT, parsed->type);
+	assert_equals(rec.pid, parsed->pid);
+	assert_equals(rec.uid, parsed->uid);
+	assert_equals(0, uuid_compare(rec.uuid, parsed->uuid));
+	assert_equals(0, uuid_compare(rec.host_uuid, parsed->host_uuid));
+
+	jaldb_destroy_record(&parsed);
+	free(dbuf);
+}
+
+void test_to_system_adds_manifest()
+{
+	enum jaldb_status ret;
+	uint8_t payload_dgst[32];
+	uint8_t app_meta_dgst[32];
+	char *dbuf = NULL;
+	size_t dbufsz = 0;
+	xmlDocPtr doc;
+	xmlXPathContextPtr ctx;
+	xmlXPathObjectPtr obj;
+
+	memset(payload_dgst, 0xab, sizeof(payload_dgst));
+	memset(app_meta_dgst, 0xcd, sizeof(app_meta_dgst));
+	rec.type = JALDB_RTYPE_LOG;
+
+	ret = jaldb_record_to_system_metadata_doc(&rec, NULL,
+			app_meta_dgst, sizeof(app_meta_dgst), JAL_SHA256_ALGORITHM_URI,
+			payload_dgst, sizeof(payload_dgst), JAL_SHA256_ALGORITHM_URI,
+			&dbuf, &dbufsz);
+	assert_equals(JALDB_OK, ret);
+
+	doc = xmlReadMemory(dbuf, dbufsz, "sys_meta.xml", NULL, 0);
+	assert_not_equals((void*) NULL, doc);
+	assert_equals(0, validate(doc, "sys_meta.xml", TEST_XML_SYS_META_SCHEMA, 0));
+	ctx = xmlXPathNewContext(doc);
+	assert_not_equals((void*) NULL, ctx);
+	assert_equals(0, xmlXPathRegisterNs(ctx, BAD_CAST "j", BAD_CAST JAL_SYS_META_NAMESPACE_URI));
+	assert_equals(0, xmlXPathRegisterNs(ctx, BAD_CAST "d", BAD_CAST JAL_XMLDSIG_URI));
+
+	obj = xmlXPathEvalExpression(BAD_CAST "count(//j:JALRecord/d:Manifest/d:Reference)=2", ctx);
+	assert_not_equals((void*)NULL, obj);
+	assert_true(obj->boolval);
+	xmlXPathFreeObject(obj);
+
+	obj = xmlXPathEvalExpression(BAD_CAST "//d:Reference[1]/@URI='"JAL_PAYLOAD_URI"'", ctx);
+	assert_not_equals((void*)NULL, obj);
+	assert_true(obj->boolval);
+	xmlXPathFreeObject(obj);
+
+	obj = xmlXPathEvalExpression(BAD_CAST "//d:Reference[@URI='"JAL_APP_META_URI"']/d:DigestMethod/@Algorithm='"JAL_SHA256_ALGORITHM_URI"'", ctx);
+	assert_not_equals((void*)NULL, obj);
+	assert_true(obj->boolval);
+	xmlXPathFreeObject(obj);
+
+	obj = xmlXPathEvalExpression(BAD_CAST "//d:Reference[@URI='"JAL_PAYLOAD_URI"']/d:DigestValue='q6urq6urq6urq6urq6urq6urq6urq6urq6urq6urq6s='", ctx);
+	assert_not_equals((void*)NULL, obj);
+	assert_true(obj->boolval);
+	xmlXPathFreeObject(obj);
+
+	xmlXPathFreeContext(ctx);
+	xmlFreeDoc(doc);
+	free(dbuf);
+}
+
 void test_to_system_fails_with_bad_input()
 {
 	enum jaldb_status ret;
@@ -342,3 +429,161 @@ void test_jaldb_xml_to_sys_metadata_returns_error_on_malformed_data()
 	fclose(fd);
 	free(buf);
 }
+
+static char *read_test_file(const char *path, size_t *len)
+{
+	FILE *fd = fopen(path, "r");
+	assert_not_equals(NULL, fd);
+	assert_equals(0, fseek(fd, 0L, SEEK_END));
+	long bufsize = ftell(fd);
+	assert_true(0 < bufsize);
+	char *buf = jal_malloc(bufsize);
+	assert_equals(0, fseek(fd, 0L, SEEK_SET));
+	assert_equals(bufsize, fread(buf, sizeof(char), bufsize, fd));
+	fclose(fd);
+	*len = bufsize;
+	return buf;
+}
+
+static void assert_same_string(const char *expected, const char *actual)
+{
+	if (!expected || !actual) {
+		assert_pointer_equals((void *) expected, (void *) actual);
+	} else {
+		assert_string_equals(expected, actual);
+	}
+}
+
+/* Check that \p buf reads the same as with the SAX parser alone. */
+static void assert_same_as_sax_parser(char *buf, size_t len)
+{
+	struct jaldb_record *expected = NULL;
+	struct jaldb_record *actual = NULL;
+	enum jal_status expected_ret = jaldb_parse_sys_metadata_xml((uint8_t *) buf, len, &expected);
+	enum jal_status ret = jaldb_xml_to_sys_metadata((uint8_t *) buf, len, &actual);
+
+	assert_equals(expected_ret, ret);
+	if (JAL_OK != ret) {
+		return;
+	}
+	assert_equals(expected->type, actual->type);
+	assert_equals(expected->pid, actual->pid);
+	assert_equals(expected->uid, actual->uid);
+	assert_equals(0, uuid_compare(expected->uuid, actual->uuid));
+	assert_equals(0, uuid_compare(expected->host_uuid, actual->host_uuid));
+	assert_same_string(expected->hostname, actual->hostname);
+	assert_same_string(expected->timestamp, actual->timestamp);
+	assert_same_string(expected->username, actual->username);
+	assert_same_string(expected->sec_lbl, actual->sec_lbl);
+	jaldb_destroy_record(&expected);
+	jaldb_destroy_record(&actual);
+}
+
+void test_scan_sys_metadata_reads_the_layout_jalop_writes()
+{
+	struct jaldb_record *sys_meta = NULL;
+	size_t len;
+	char *buf = read_test_file(GOOD_SYS_META, &len);
+
+	assert_equals(JALDB_OK, jaldb_scan_sys_metadata((uint8_t *) buf, len, &sys_meta));
+	assert_equals(JALDB_RTYPE_JOURNAL, sys_meta->type);
+	assert_string_equals("test.jalop.com", sys_meta->hostname);
+	assert_string_equals("2011-11-10T04:09:55-05:00", sys_meta->timestamp);
+	assert_string_equals("root", sys_meta->username);
+	assert_string_equals("unconfined_u:unconfined_r:unconfined_t:s0-s0:c0.c1023", sys_meta->sec_lbl);
+	jaldb_destroy_record(&sys_meta);
+	free(buf);
+}
+
+void test_scan_sys_metadata_leaves_cdata_to_sax_parser()
+{
+	struct jaldb_record *sys_meta = NULL;
+	size_t len;
+	char *buf = read_test_file(GOOD_SYS_META_CDATA, &len);
+
+	assert_equals(JALDB_E_NOT_IMPL, jaldb_scan_sys_metadata((uint8_t *) buf, len, &sys_meta));
+	assert_pointer_equals((void *) NULL, sys_meta);
+	free(buf);
+}
+
+void test_xml_to_sys_metadata_matches_sax_parser_for_test_input()
+{
+	const char *files[] = { GOOD_SYS_META, GOOD_SYS_META_CDATA, MALFORMED_SYS_META };
+	unsigned int i;
+	for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+		size_t len;
+		char *buf = read_test_file(files[i], &len);
+		assert_same_as_sax_parser(buf, len);
+		free(buf);
+	}
+}
+
+void test_xml_to_sys_metadata_matches_sax_parser_for_generated_docs()
+{
+	enum jaldb_rec_type types[] = { JALDB_RTYPE_JOURNAL, JALDB_RTYPE_AUDIT, JALDB_RTYPE_LOG };
+	uint8_t dgst[32];
+	unsigned int i;
+	int variant;
+	memset(dgst, 0xab, sizeof(dgst));
+
+	for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		for (variant = 0; variant < 4; variant++) {
+			char *dbuf = NULL;
+			size_t dbufsz = 0;
+			rec.type = types[i];
+			rec.sec_lbl = (variant & 1) ? NULL : SEC_LABEL;
+			rec.hostname = (variant & 2) ? "host & <name>" : HOSTNAME;
+			assert_equals(JALDB_OK, jaldb_record_to_system_metadata_doc(&rec, NULL,
+					dgst, sizeof(dgst), JAL_SHA256_ALGORITHM_URI,
+					dgst, sizeof(dgst), JAL_SHA256_ALGORITHM_URI,
+					&dbuf, &dbufsz));
+			assert_same_as_sax_parser(dbuf, dbufsz);
+			free(dbuf);
+		}
+	}
+}
+
+void test_xml_to_sys_metadata_matches_sax_parser_for_mutated_docs()
+{
+	const char replacements[] = { '<', '>', '/', '"', '&', ' ', 'x', '0' };
+	size_t len;
+	size_t off;
+	unsigned int i;
+	char *orig = read_test_file(GOOD_SYS_META, &len);
+	char *buf = jal_malloc(len);
+
+	for (off = 0; off < len; off++) {
+		// Truncated
+		memcpy(buf, orig, len);
+		assert_same_as_sax_parser(buf, off);
+		// One byte left out
+		memcpy(buf + off, orig + off + 1, len - off - 1);
+		assert_same_as_sax_parser(buf, len - 1);
+		// One byte replaced
+		for (i = 0; i < sizeof(replacements); i++) {
+			memcpy(buf, orig, len);
+			buf[off] = replacements[i];
+			assert_same_as_sax_parser(buf, len);
+		}
+	}
+	free(buf);
+	free(orig);
+}
+
+void test_jaldb_xml_to_sys_metadata_fails_with_empty_process_id()
+{
+	struct jaldb_record *sys_meta = NULL;
+	size_t len;
+	char *buf = read_test_file(GOOD_SYS_META, &len);
+	char *pid = strstr(buf, "<ProcessID>0<");
+	assert_not_equals(NULL, pid);
+	// Drop the "0", for both the scan and the SAX parser.
+	memmove(pid + strlen("<ProcessID>"), pid + strlen("<ProcessID>0"),
+			len - (pid - buf) - strlen("<ProcessID>0"));
+	len--;
+
+	assert_equals(JALDB_E_INVAL, jaldb_xml_to_sys_metadata((uint8_t *) buf, len, &sys_meta));
+	assert_equals(JALDB_E_INVAL, jaldb_parse_sys_metadata_xml((uint8_t *) buf, len, &sys_meta));
+	assert_pointer_equals((void *) NULL, sys_meta);
+	free(buf);
+}
@@ -907,3 +907,141 @@ void test_serialize_deserialize_record_works_when_not_synced()
 
 	jaldb_destroy_record(&dsr);
 }
+
+void test_serialize_deserialize_record_works_with_byte_swap()
+{
+	size_t res_size = 0;
+	struct jaldb_record *dsr = NULL;
+	rec.sys_meta = &sys_meta_on_disk_sgmt;
+	rec.app_meta = &app_meta_in_ram_sgmt;
+	rec.payload = &payload_in_ram_sgmt;
+
+	enum jaldb_status ret;
+	ret = jaldb_serialize_record(1, &rec, &buffer, &res_size);
+	assert_equals(JALDB_OK, ret);
+
+	ret = jaldb_deserialize_record(1, buffer, res_size, &dsr);
+	assert_equals(JALDB_OK, ret);
+
+	assert_equals(rec.pid, dsr->pid);
+	assert_equals(rec.uid, dsr->uid);
+	assert_equals(1, dsr->synced);
+	assert_equals(SYS_META_ON_DISK_LENGTH, dsr->sys_meta->length);
+	assert_equals(APP_META_IN_RAM_LENGTH, dsr->app_meta->length);
+	assert_equals(0, memcmp(APP_META_IN_RAM_PAYLOAD, (char*)dsr->app_meta->payload, APP_META_IN_RAM_LENGTH));
+	assert_equals(PAYLOAD_IN_RAM_LENGTH, dsr->payload->length);
+	assert_equals(0, memcmp(PAYLOAD_IN_RAM_PAYLOAD, (char*)dsr->payload->payload, PAYLOAD_IN_RAM_LENGTH));
+
+	jaldb_destroy_record(&dsr);
+}
+
+void test_record_view_points_into_buffer()
+{
+	size_t res_size = 0;
+	struct jaldb_record_view view;
+	rec.sys_meta = &sys_meta_on_disk_sgmt;
+	rec.app_meta = &app_meta_in_ram_sgmt;
+	rec.payload = &payload_in_ram_sgmt;
+
+	enum jaldb_status ret;
+	ret = jaldb_serialize_record(0, &rec, &buffer, &res_size);
+	assert_equals(JALDB_OK, ret);
+
+	ret = jaldb_record_view_init(&view, 0, buffer, res_size);
+	assert_equals(JALDB_OK, ret);
+	assert_equals(rec.pid, view.pid);
+	assert_equals(rec.uid, view.uid);
+	assert_equals(1, view.synced);
+	assert_equals(1, view.have_uid);
+	assert_equals(0, uuid_compare(uuid, view.uuid));
+	assert_equals(0, uuid_compare(host_uuid, view.host_uuid));
+	assert_equals(0, view.decoded);
+	assert_pointer_equals((void*) NULL, view.timestamp);
+
+	ret = jaldb_record_view_decode(&view);
+	assert_equals(JALDB_OK, ret);
+	assert_equals(1, view.decoded);
+	assert_true((const uint8_t*) view.source > buffer);
+	assert_true((const uint8_t*) view.source < buffer + res_size);
+	assert_string_equals(rec.source, view.source);
+	assert_string_equals(rec.hostname, view.hostname);
+	assert_string_equals(rec.timestamp, view.timestamp);
+	assert_string_equals(rec.username, view.username);
+	assert_string_equals(rec.sec_lbl, view.sec_lbl);
+	assert_pointer_equals((void*) NULL, view.network_nonce);
+
+	assert_equals(1, view.sys_meta.on_disk);
+	assert_equals(SYS_META_ON_DISK_LENGTH, view.sys_meta.length);
+	assert_string_equals(SYS_META_ON_DISK_PAYLOAD, (const char*) view.sys_meta.payload);
+	assert_equals(0, view.app_meta.on_disk);
+	assert_equals(APP_META_IN_RAM_LENGTH, view.app_meta.length);
+	assert_equals(0, memcmp(APP_META_IN_RAM_PAYLOAD, view.app_meta.payload, APP_META_IN_RAM_LENGTH));
+	assert_equals(PAYLOAD_IN_RAM_LENGTH, view.payload.length);
+	assert_pointer_equals(buffer + res_size - PAYLOAD_IN_RAM_LENGTH, view.payload.payload);
+}
+
+void test_record_view_does_not_modify_buffer()
+{
+	size_t res_size = 0;
+	struct jaldb_record_view view;
+	struct jaldb_record *dsr = NULL;
+	uint8_t *copy = NULL;
+	rec.payload = &payload_in_ram_sgmt;
+
+	enum jaldb_status ret;
+	ret = jaldb_serialize_record(1, &rec, &buffer, &res_size);
+	assert_equals(JALDB_OK, ret);
+	copy = (uint8_t*) malloc(res_size);
+	memcpy(copy, buffer, res_size);
+
+	ret = jaldb_record_view_init(&view, 1, buffer, res_size);
+	assert_equals(JALDB_OK, ret);
+	ret = jaldb_record_from_view(&view, &dsr);
+	assert_equals(JALDB_OK, ret);
+	assert_equals(0, memcmp(copy, buffer, res_size));
+
+	// A second pass must see the same data.
+	jaldb_destroy_record(&dsr);
+	ret = jaldb_deserialize_record(1, buffer, res_size, &dsr);
+	assert_equals(JALDB_OK, ret);
+	assert_equals(rec.pid, dsr->pid);
+
+	jaldb_destroy_record(&dsr);
+	free(copy);
+}
+
+void test_record_view_init_fails_on_bad_input()
+{
+	size_t res_size = 0;
+	struct jaldb_record_view view;
+
+	enum jaldb_status ret;
+	ret = jaldb_serialize_record(0, &rec, &buffer, &res_size);
+	assert_equals(JALDB_OK, ret);
+
+	assert_equals(JALDB_E_INVAL, jaldb_record_view_init(NULL, 0, buffer, res_size));
+	assert_equals(JALDB_E_INVAL, jaldb_record_view_init(&view, 0, NULL, res_size));
+	assert_equals(JALDB_E_INVAL, jaldb_record_view_init(&view, 0, buffer,
+				sizeof(struct jaldb_serialize_record_headers) - 1));
+	assert_equals(JALDB_E_LAYOUT_VERSION_UNKNOWN, jaldb_record_view_init(&view, 1, buffer, res_size));
+}
+
+void test_record_view_decode_fails_on_truncated_buffer()
+{
+	size_t res_size = 0;
+	struct jaldb_record_view view;
+	rec.payload = &payload_in_ram_sgmt;
+
+	enum jaldb_status ret;
+	ret = jaldb_serialize_record(0, &rec, &buffer, &res_size);
+	assert_equals(JALDB_OK, ret);
+
+	ret = jaldb_record_view_init(&view, 0, buffer, res_size - 1);
+	assert_equals(JALDB_OK, ret);
+	assert_equals(JALDB_E_INVAL, jaldb_record_view_decode(&view));
+
+	ret = jaldb_record_view_init(&view, 0, buffer, sizeof(struct jaldb_serialize_record_headers) + 4);
+	assert_equals(JALDB_OK, ret);
+	assert_equals(JALDB_E_INVAL, jaldb_record_view_decode(&view));
+	assert_equals(0, view.decoded);
+}
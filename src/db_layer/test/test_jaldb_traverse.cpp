@@ -94,7 +94,7 @@ static int iter_call_cnt;
 
 struct jaldb_record *records[4] = { NULL, NULL, NULL, NULL };
 
-extern "C" enum jaldb_iter_status iter_cb(const char *hex_nonce, struct jaldb_record *rec, void *up)
+extern "C" enum jaldb_iter_status iter_cb(const char *hex_nonce, struct jaldb_record_view *rec, void *up)
 {
 	char *failure = (char*)up;
 	enum jaldb_iter_status ret = JALDB_ITER_CONT;
@@ -277,7 +277,7 @@ extern "C" void test_iterate_by_works_with_limits()
 	assert_equals(2, iter_call_cnt);
 }
 
-extern "C" enum jaldb_iter_status iter_cb_for_gap_test(const char *hex_nonce, struct jaldb_record *rec, void *up)
+extern "C" enum jaldb_iter_status iter_cb_for_gap_test(const char *hex_nonce, struct jaldb_record_view *rec, void *up)
 {
 	char *failure = (char*)up;
 	enum jaldb_iter_status ret = JALDB_ITER_CONT;
@@ -327,7 +327,7 @@ extern "C" void test_iterate_by_works_with_limits_and_gaps()
 	assert_equals(2, iter_call_cnt);
 }
 
-extern "C" enum jaldb_iter_status iter_cb_delete(const char *hex_nonce, struct jaldb_record *rec, void *up)
+extern "C" enum jaldb_iter_status iter_cb_delete(const char *hex_nonce, struct jaldb_record_view *rec, void *up)
 {
 	char *failure = (char*)up;
 	enum jaldb_iter_status ret = JALDB_ITER_CONT;
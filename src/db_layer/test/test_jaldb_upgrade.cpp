@@ -0,0 +1,329 @@
+/**
+ * @file test_jaldb_upgrade.cpp This file contains functions to test
+ * jaldb_upgrade.c.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The test-dept code doesn't work very well in C++ when __STRICT_ANSI__ is
+// not defined. It tries to use some gcc extensions that don't work well with
+// C++.
+
+#ifndef __STRICT_ANSI__
+#define __STRICT_ANSI__
+#endif
+
+extern "C" {
+#include <test-dept.h>
+}
+
+#include "test_utils.h"
+#include <db.h>
+#include <libxml/xmlschemastypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "jal_alloc.h"
+#include "jal_asprintf_internal.h"
+#include "jaldb_context.hpp"
+#include "jaldb_nonce.h"
+#include "jaldb_record.h"
+#include "jaldb_segment.h"
+#include "jaldb_serialize_record.h"
+#include "jaldb_upgrade.h"
+#include "jaldb_utils.h"
+
+#define OTHER_DB_ROOT "./testdb/"
+#define OTHER_SCHEMA_ROOT "./schemas/"
+
+#define DT1 "2012-12-12T09:00:00.00000"
+#define HN1 "somehost"
+#define UN1 "someuser"
+#define S1 "source1"
+#define PAYLOAD "journal payload"
+
+#define EXPECTED_RECORD_VERSION 1
+
+static const char *uuids[] = {
+	"11234567-89AB-CDEF-0123-456789ABCDEF",
+	"21234567-89AB-CDEF-0123-456789ABCDEF",
+	"31234567-89AB-CDEF-0123-456789ABCDEF",
+};
+
+static const char *journal_uuids[] = {
+	"a1234567-89ab-cdef-0123-456789abcdef",
+	"b2234567-89ab-cdef-0123-456789abcdef",
+	"c3234567-89ab-cdef-0123-456789abcdef",
+};
+
+#define ITEMS_IN_DB 3
+static jaldb_context *context = NULL;
+static char *nonces[ITEMS_IN_DB];
+static char *journal_nonces[ITEMS_IN_DB];
+static char *journal_paths[ITEMS_IN_DB];
+static char *start_time = NULL;
+
+/**
+ * Set the layout version of the log records back to version 1, the way
+ * they were stored before the timestamp indices used binary keys. Only
+ * the last \p cnt records are changed, to mimic an interrupted upgrade.
+ */
+static void set_log_records_to_version_1(int cnt)
+{
+	DB_ENV *env = NULL;
+	DB *db = NULL;
+	DB_TXN *txn = NULL;
+	DBC *cursor = NULL;
+	uint16_t version;
+	DBT key;
+	DBT val;
+
+	memset(&key, 0, sizeof(key));
+	memset(&val, 0, sizeof(val));
+	key.flags = DB_DBT_REALLOC;
+	val.data = &version;
+	val.ulen = sizeof(version);
+	val.dlen = sizeof(version);
+	val.doff = 0;
+	val.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
+
+	assert_equals(0, db_env_create(&env, 0));
+	assert_equals(0, env->open(env, OTHER_DB_ROOT, DB_CREATE | DB_INIT_LOCK |
+				DB_INIT_LOG | DB_INIT_MPOOL | DB_INIT_TXN | DB_THREAD, 0));
+	assert_equals(0, db_create(&db, env, 0));
+	assert_equals(0, db->set_bt_compare(db, jaldb_nonce_compare));
+	assert_equals(0, db->open(db, NULL, "log_records.db", NULL, DB_BTREE,
+				DB_THREAD | DB_AUTO_COMMIT, 0));
+
+	assert_equals(0, env->txn_begin(env, NULL, &txn, 0));
+	assert_equals(0, db->cursor(db, txn, &cursor, 0));
+	int db_ret = cursor->c_get(cursor, &key, &val, DB_LAST | DB_RMW);
+	for (int i = 0; i < cnt && 0 == db_ret; i++) {
+		version = JALDB_DB_LAYOUT_VERSION_1;
+		val.size = sizeof(version);
+		assert_equals(0, cursor->c_put(cursor, &key, &val, DB_CURRENT));
+		db_ret = cursor->c_get(cursor, &key, &val, DB_PREV | DB_RMW);
+	}
+	cursor->c_close(cursor);
+	assert_equals(0, txn->commit(txn, 0));
+
+	free(key.data);
+	db->close(db, 0);
+	env->close(env, 0);
+}
+
+static void open_context(enum jaldb_status expected)
+{
+	context = jaldb_context_create();
+	assert_equals(expected, jaldb_context_init(context, OTHER_DB_ROOT, OTHER_SCHEMA_ROOT, false));
+}
+
+/**
+ * Insert journal records whose payload files are in the flat layout, one
+ * level of directories, the way they were stored before the fanout could be
+ * configured.
+ */
+static void insert_journal_records_in_flat_layout()
+{
+	open_context(JALDB_OK);
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		struct jaldb_record *rec = jaldb_create_record();
+		int fd = -1;
+
+		rec->version = EXPECTED_RECORD_VERSION;
+		rec->type = JALDB_RTYPE_JOURNAL;
+		rec->timestamp = jal_strdup(DT1);
+		rec->hostname = jal_strdup(HN1);
+		rec->source = jal_strdup(S1);
+		rec->username = jal_strdup(UN1);
+		assert_equals(0, uuid_parse(journal_uuids[i], rec->uuid));
+
+		journal_paths[i] = NULL;
+		assert_equals(JALDB_OK, jaldb_create_file(context->journal_root, &journal_paths[i], &fd,
+					rec->uuid, JALDB_RTYPE_JOURNAL, JALDB_DTYPE_PAYLOAD));
+		assert_equals('/', journal_paths[i][2]);
+		assert_equals((ssize_t) strlen(PAYLOAD), write(fd, PAYLOAD, strlen(PAYLOAD)));
+		close(fd);
+
+		rec->payload = jaldb_create_segment();
+		rec->payload->on_disk = 1;
+		rec->payload->length = strlen(PAYLOAD);
+		rec->payload->payload = (uint8_t *) jal_strdup(journal_paths[i]);
+
+		journal_nonces[i] = NULL;
+		assert_equals(JALDB_OK, jaldb_insert_record(context, rec, 1, &journal_nonces[i]));
+		jaldb_destroy_record(&rec);
+	}
+	jaldb_context_destroy(&context);
+}
+
+extern "C" void setup()
+{
+	dir_cleanup(OTHER_DB_ROOT);
+	mkdir(OTHER_DB_ROOT, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+
+	start_time = jaldb_gen_timestamp();
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		journal_nonces[i] = NULL;
+		journal_paths[i] = NULL;
+	}
+	open_context(JALDB_OK);
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		struct jaldb_record *rec = jaldb_create_record();
+		rec->version = EXPECTED_RECORD_VERSION;
+		rec->type = JALDB_RTYPE_LOG;
+		rec->timestamp = jal_strdup(DT1);
+		rec->hostname = jal_strdup(HN1);
+		rec->source = jal_strdup(S1);
+		rec->username = jal_strdup(UN1);
+		rec->payload = jaldb_create_segment();
+		assert_equals(0, uuid_parse(uuids[i], rec->uuid));
+
+		nonces[i] = NULL;
+		assert_equals(JALDB_OK, jaldb_insert_record(context, rec, 1, &nonces[i]));
+		jaldb_destroy_record(&rec);
+	}
+	jaldb_context_destroy(&context);
+}
+
+extern "C" void teardown()
+{
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		free(nonces[i]);
+		nonces[i] = NULL;
+		free(journal_nonces[i]);
+		journal_nonces[i] = NULL;
+		free(journal_paths[i]);
+		journal_paths[i] = NULL;
+	}
+	free(start_time);
+	start_time = NULL;
+	jaldb_context_destroy(&context);
+	dir_cleanup(OTHER_DB_ROOT);
+	xmlSchemaCleanupTypes();
+}
+
+extern "C" void test_context_init_fails_for_version_1_records()
+{
+	set_log_records_to_version_1(ITEMS_IN_DB);
+	open_context(JALDB_E_LAYOUT_VERSION_UNKNOWN);
+}
+
+extern "C" void test_context_init_fails_after_interrupted_upgrade()
+{
+	set_log_records_to_version_1(1);
+	open_context(JALDB_E_LAYOUT_VERSION_UNKNOWN);
+}
+
+extern "C" void test_upgrade_db_layout_converts_version_1_records()
+{
+	uint64_t count = 0;
+
+	set_log_records_to_version_1(ITEMS_IN_DB);
+	assert_equals(JALDB_OK, jaldb_upgrade_db_layout(OTHER_DB_ROOT, &count));
+	assert_equals(ITEMS_IN_DB, count);
+
+	open_context(JALDB_OK);
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		struct jaldb_record *rec = NULL;
+		uuid_t uuid;
+
+		assert_equals(JALDB_OK, jaldb_get_record(context, JALDB_RTYPE_LOG, nonces[i], &rec));
+		assert_equals(0, uuid_parse(uuids[i], uuid));
+		assert_equals(0, uuid_compare(uuid, rec->uuid));
+		assert_string_equals(S1, rec->source);
+		jaldb_destroy_record(&rec);
+	}
+
+	// The rebuilt timestamp index finds every record.
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		struct jaldb_record *rec = NULL;
+		char *nonce = NULL;
+
+		assert_equals(JALDB_OK, jaldb_next_chronological_record(context, JALDB_RTYPE_LOG,
+					&nonce, &rec, &start_time));
+		assert_string_equals(nonces[i], nonce);
+		jaldb_destroy_record(&rec);
+		free(nonce);
+	}
+}
+
+extern "C" void test_upgrade_db_layout_can_be_rerun()
+{
+	uint64_t count = 0;
+
+	set_log_records_to_version_1(ITEMS_IN_DB);
+	assert_equals(JALDB_OK, jaldb_upgrade_db_layout(OTHER_DB_ROOT, &count));
+	assert_equals(JALDB_OK, jaldb_upgrade_db_layout(OTHER_DB_ROOT, &count));
+	assert_equals(0, count);
+	open_context(JALDB_OK);
+}
+
+extern "C" void test_upgrade_journal_fanout_moves_flat_layout()
+{
+	uint64_t count = 0;
+
+	insert_journal_records_in_flat_layout();
+	assert_equals(JALDB_OK, jaldb_upgrade_journal_fanout(OTHER_DB_ROOT, 2, &count));
+	assert_equals(ITEMS_IN_DB, count);
+
+	open_context(JALDB_OK);
+	for (int i = 0; i < ITEMS_IN_DB; i++) {
+		struct jaldb_record *rec = NULL;
+		char *old_path = NULL;
+		char buf[sizeof(PAYLOAD)];
+		const char *path;
+
+		assert_equals(JALDB_OK, jaldb_get_record(context, JALDB_RTYPE_JOURNAL, journal_nonces[i], &rec));
+		path = (const char *) rec->payload->payload;
+		assert_equals('/', path[2]);
+		assert_equals('/', path[5]);
+		assert_equals(0, strncmp(path, journal_uuids[i], 2));
+		assert_equals(0, strncmp(path + 3, journal_uuids[i] + 2, 2));
+		assert_equals(0, strcmp(path + 6, journal_paths[i] + 3));
+
+		// The record's path resolves to the file, and the old one is gone.
+		assert_equals(JALDB_OK, jaldb_open_segment_for_read(context, rec->payload));
+		assert_equals((ssize_t) strlen(PAYLOAD), read(rec->payload->fd, buf, sizeof(buf)));
+		assert_equals(0, memcmp(PAYLOAD, buf, strlen(PAYLOAD)));
+		assert_not_equals(-1, jal_asprintf(&old_path, "%s%s", context->journal_root, journal_paths[i]));
+		assert_equals(-1, access(old_path, F_OK));
+
+		free(old_path);
+		jaldb_destroy_record(&rec);
+	}
+}
+
+extern "C" void test_upgrade_journal_fanout_can_be_rerun()
+{
+	uint64_t count = 0;
+
+	insert_journal_records_in_flat_layout();
+	assert_equals(JALDB_OK, jaldb_upgrade_journal_fanout(OTHER_DB_ROOT, 2, &count));
+	assert_equals(JALDB_OK, jaldb_upgrade_journal_fanout(OTHER_DB_ROOT, 2, &count));
+	assert_equals(0, count);
+}
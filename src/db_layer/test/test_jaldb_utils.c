@@ -287,6 +287,87 @@ void test_jaldb_create_file_works()
 	free(path);
 }
 
+void test_jaldb_create_file_with_fanout_creates_directories()
+{
+	char *path = NULL;
+	char *full_path = NULL;
+	char uuid_str[37];
+	int fd = -1;
+	uuid_t uuid;
+	uuid_generate(uuid);
+	uuid_unparse(uuid, uuid_str);
+
+	enum jaldb_status ret = jaldb_create_file_with_fanout(OTHER_DB_ROOT, 4, &path, &fd,
+			uuid, JALDB_RTYPE_JOURNAL, JALDB_DTYPE_PAYLOAD);
+	assert_equals(JALDB_OK, ret);
+	assert_not_equals(-1, fd);
+	assert_equals(0, strncmp(path, uuid_str, 2));
+	assert_equals(0, strncmp(path + 3, uuid_str + 2, 2));
+	assert_equals(0, strncmp(path + 6, uuid_str + 4, 2));
+	assert_equals(0, strncmp(path + 9, uuid_str + 6, 2));
+	assert_equals(0, strncmp(path + 12, "journal_payload_", strlen("journal_payload_")));
+
+	full_path = jal_calloc(strlen(OTHER_DB_ROOT) + strlen(path) + 1, sizeof(char));
+	sprintf(full_path, "%s%s", OTHER_DB_ROOT, path);
+	assert_equals(0, access(full_path, F_OK));
+
+	close(fd);
+	free(full_path);
+	free(path);
+}
+
+void test_jaldb_create_file_with_fanout_fails_with_bad_fanout()
+{
+	char *path = NULL;
+	int fd = -1;
+	uuid_t uuid;
+	uuid_generate(uuid);
+
+	assert_equals(JALDB_E_INVAL, jaldb_create_file_with_fanout(OTHER_DB_ROOT, 0, &path, &fd,
+			uuid, JALDB_RTYPE_JOURNAL, JALDB_DTYPE_PAYLOAD));
+	assert_equals(JALDB_E_INVAL, jaldb_create_file_with_fanout(OTHER_DB_ROOT, JALDB_FANOUT_MAX + 1,
+			&path, &fd, uuid, JALDB_RTYPE_JOURNAL, JALDB_DTYPE_PAYLOAD));
+	assert_pointer_equals((void*) NULL, path);
+	assert_equals(-1, fd);
+}
+
+void test_jaldb_build_rel_path_works()
+{
+	char buf[JALDB_REL_PATH_MAX];
+	const char *uuid_str = "0123abcd-89ab-cdef-0123-456789abcdef";
+
+	assert_equals(JALDB_OK, jaldb_build_rel_path(buf, sizeof(buf), 1, uuid_str,
+			JALDB_RTYPE_AUDIT, JALDB_DTYPE_SYS_META));
+	assert_string_equals("01/audit_sys_meta_0123abcd-89ab-cdef-0123-456789abcdef", buf);
+
+	assert_equals(JALDB_OK, jaldb_build_rel_path(buf, sizeof(buf), 2, uuid_str,
+			JALDB_RTYPE_LOG, JALDB_DTYPE_APP_META));
+	assert_string_equals("01/23/log_app_meta_0123abcd-89ab-cdef-0123-456789abcdef", buf);
+
+	assert_equals(JALDB_OK, jaldb_build_rel_path(buf, sizeof(buf), JALDB_FANOUT_MAX, uuid_str,
+			JALDB_RTYPE_JOURNAL, JALDB_DTYPE_SYS_META));
+	assert_string_equals("01/23/ab/cd/journal_sys_meta_0123abcd-89ab-cdef-0123-456789abcdef", buf);
+}
+
+void test_jaldb_build_rel_path_fails_with_bad_input()
+{
+	char buf[JALDB_REL_PATH_MAX];
+	const char *uuid_str = "0123abcd-89ab-cdef-0123-456789abcdef";
+
+	assert_equals(JALDB_E_INVAL, jaldb_build_rel_path(NULL, sizeof(buf), 1, uuid_str,
+			JALDB_RTYPE_LOG, JALDB_DTYPE_PAYLOAD));
+	assert_equals(JALDB_E_INVAL, jaldb_build_rel_path(buf, sizeof(buf), 1, NULL,
+			JALDB_RTYPE_LOG, JALDB_DTYPE_PAYLOAD));
+	assert_equals(JALDB_E_INVAL, jaldb_build_rel_path(buf, sizeof(buf), 1, uuid_str,
+			JALDB_RTYPE_UNKNOWN, JALDB_DTYPE_PAYLOAD));
+	assert_equals(JALDB_E_INVAL, jaldb_build_rel_path(buf, sizeof(buf), 1, uuid_str,
+			JALDB_RTYPE_LOG, (enum jaldb_data_type) 42));
+	assert_equals(JALDB_E_INVAL, jaldb_build_rel_path(buf, sizeof(buf), JALDB_FANOUT_MAX + 1,
+			uuid_str, JALDB_RTYPE_LOG, JALDB_DTYPE_PAYLOAD));
+	assert_equals(JALDB_E_INVAL, jaldb_build_rel_path(buf, 10, 1, uuid_str,
+			JALDB_RTYPE_LOG, JALDB_DTYPE_PAYLOAD));
+}
+
 void test_jaldb_gen_timestamp_works()
 {
 	char *timestamp = jaldb_gen_timestamp();
@@ -0,0 +1,87 @@
+/**
+ * @file jalu_bench.c This file contains helpers shared by the benchmark
+ * utilities.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jalu_bench.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void jalu_bench_start(struct timespec *start)
+{
+	clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+double jalu_bench_elapsed(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return jalu_bench_diff(start, &now);
+}
+
+double jalu_bench_diff(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+void jalu_bench_report(const char *name, long count, const char *unit,
+		double secs, const char *extra_fmt, ...)
+{
+	va_list ap;
+
+	printf("%-24s %8ld %s in %8.3f s: %12.1f %s/s", name, count, unit, secs,
+		count / secs, unit);
+	if (extra_fmt) {
+		va_start(ap, extra_fmt);
+		vprintf(extra_fmt, ap);
+		va_end(ap);
+	}
+	printf("\n");
+}
+
+int jalu_bench_parse_count(const char *what, const char *arg, long *count)
+{
+	char *end = NULL;
+	long val;
+
+	errno = 0;
+	val = strtol(arg, &end, 10);
+	if (0 != errno || end == arg || '\0' != *end || val <= 0) {
+		fprintf(stderr, "Error: invalid %s: %s\n", what, arg);
+		return -1;
+	}
+	*count = val;
+	return 0;
+}
+
+void jalu_bench_usage(const char *synopsis, const char *options)
+{
+	printf("Usage: %s\n%s\t-h, --help\tPrint this message.\n\n", synopsis, options);
+}
@@ -0,0 +1,106 @@
+/**
+ * @file jalu_bench.h This file contains helpers shared by the benchmark
+ * utilities.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _JALU_BENCH_H_
+#define _JALU_BENCH_H_
+
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Start timing a run.
+ *
+ * The time is taken from CLOCK_MONOTONIC, so changes to the system clock
+ * while a benchmark runs do not affect the result.
+ *
+ * @param[out] start Set to the current time.
+ */
+void jalu_bench_start(struct timespec *start);
+
+/**
+ * @param[in] start The time set by jalu_bench_start().
+ *
+ * @return The number of seconds since \p start.
+ */
+double jalu_bench_elapsed(const struct timespec *start);
+
+/**
+ * @param[in] start A time taken from CLOCK_MONOTONIC, for example by
+ * jalu_bench_start().
+ * @param[in] end A later time taken from CLOCK_MONOTONIC.
+ *
+ * @return The number of seconds from \p start to \p end.
+ */
+double jalu_bench_diff(const struct timespec *start, const struct timespec *end);
+
+/**
+ * Print the result of a run as a line of the form
+ * "name    count unit in secs s: rate unit/s", followed by anything given in
+ * \p extra_fmt.
+ *
+ * @param[in] name The name of the run.
+ * @param[in] count The number of items processed.
+ * @param[in] unit What was counted, for example "records".
+ * @param[in] secs The duration of the run.
+ * @param[in] extra_fmt A printf format for anything to add to the line, or
+ * NULL.
+ */
+void jalu_bench_report(const char *name, long count, const char *unit,
+		double secs, const char *extra_fmt, ...)
+	__attribute__((format(printf, 5, 6)));
+
+/**
+ * Parse a count given on the command line.
+ *
+ * @param[in] what What is counted, for the error message.
+ * @param[in] arg The argument to parse.
+ * @param[out] count Set to the parsed value.
+ *
+ * @return 0 on success, or -1 after printing an error if \p arg is not a
+ * positive number.
+ */
+int jalu_bench_parse_count(const char *what, const char *arg, long *count);
+
+/**
+ * Print the usage of a benchmark.
+ *
+ * @param[in] synopsis The command line, after "Usage: ".
+ * @param[in] options The description of the options, one per line. The
+ * --help option is added after them.
+ */
+void jalu_bench_usage(const char *synopsis, const char *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _JALU_BENCH_H_
@@ -63,6 +63,7 @@ enum jal_status {
 	JAL_E_BAD_FD,
 	JAL_E_PARSE,
 	JAL_E_COMM,
+	JAL_E_QUEUE_FULL,
 	JAL_OK = 0,
 };
 
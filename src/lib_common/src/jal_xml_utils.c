@@ -40,6 +40,7 @@
 #include <xmlsec/xmlsec.h>
 #include <xmlsec/bn.h>
 #include <xmlsec/xmltree.h>
+#include <xmlsec/strings.h>
 #include <xmlsec/xmldsig.h>
 #include <xmlsec/templates.h>
 #include <xmlsec/crypto.h>
@@ -338,147 +339,373 @@ xmlNodePtr jal_get_first_element_child(xmlNodePtr elem)
  */
 static pthread_mutex_t xmlsec_sign_lock = PTHREAD_MUTEX_INITIALIZER;
 
-enum jal_status jal_add_signature_block(
-		RSA *rsa,
-		X509 *x509,
-		xmlDocPtr doc,
-		xmlNodePtr last,
-		const char *id)
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define X509_up_ref(x509) CRYPTO_add(&(x509)->references, 1, CRYPTO_LOCK_X509)
+#endif
+
+/**
+ * Everything jal_add_signature_block() needs to sign documents with one
+ * RSA key and certificate. Each thread keeps the context for the key it used
+ * last, so signing many records with the same key only sets up xmlsec once.
+ */
+struct jal_signing_cache {
+	RSA *rsa;                     /**< The key the context is for. A reference is held so the address can't be reused. */
+	X509 *x509;                   /**< The certificate the context is for, may be NULL. A reference is held as well. */
+	xmlSecKeyPtr key;             /**< The xmlsec key, with the certificate loaded. */
+	xmlDocPtr tmpl_doc;           /**< The document holding the signature template. */
+	xmlNodePtr tmpl;              /**< The signature template, without a reference URI. */
+	xmlSecDSigCtxPtr dsig_ctx;    /**< A signature context, ready to sign. */
+	struct jal_signing_cache *prev;
+	struct jal_signing_cache *next;
+};
+
+static pthread_once_t signing_cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t signing_cache_key;
+/* Protects signing_caches, the list of the contexts of all threads. */
+static pthread_mutex_t signing_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct jal_signing_cache *signing_caches;
+
+/**
+ * Release everything held by \p cache, leaving it empty.
+ */
+static void jal_signing_cache_clear(struct jal_signing_cache *cache)
 {
-	if (!doc || !rsa || !id) {
-		return JAL_E_INVAL;
+	if (cache->dsig_ctx) {
+		cache->dsig_ctx->signKey = NULL;
+		xmlSecDSigCtxDestroy(cache->dsig_ctx);
+		cache->dsig_ctx = NULL;
+	}
+	if (cache->key) {
+		xmlSecKeyDestroy(cache->key);
+		cache->key = NULL;
+	}
+	if (cache->tmpl_doc) {
+		xmlFreeDoc(cache->tmpl_doc);
+		cache->tmpl_doc = NULL;
+		cache->tmpl = NULL;
+	}
+	RSA_free(cache->rsa);
+	cache->rsa = NULL;
+	X509_free(cache->x509);
+	cache->x509 = NULL;
+}
+
+static void jal_signing_cache_destroy(void *ptr)
+{
+	struct jal_signing_cache *cache = (struct jal_signing_cache *) ptr;
+
+	pthread_mutex_lock(&signing_cache_lock);
+	if (cache->prev) {
+		cache->prev->next = cache->next;
+	} else {
+		signing_caches = cache->next;
 	}
+	if (cache->next) {
+		cache->next->prev = cache->prev;
+	}
+	pthread_mutex_unlock(&signing_cache_lock);
 
-	xmlNodePtr signNode = NULL;
-	xmlNodePtr refNode = NULL;
-	xmlNodePtr keyInfoNode = NULL;
-	xmlNodePtr x509DataNode = NULL;
-	xmlNodePtr x509IssuerSerialNode = NULL;
-	xmlSecDSigCtxPtr dsigCtx = NULL;
+	jal_signing_cache_clear(cache);
+	free(cache);
+}
+
+static void jal_signing_cache_key_create(void)
+{
+	pthread_key_create(&signing_cache_key, jal_signing_cache_destroy);
+}
+
+void jal_signing_cache_cleanup(void)
+{
+	struct jal_signing_cache *cache;
+
+	pthread_once(&signing_cache_once, jal_signing_cache_key_create);
+
+	// Other threads free their (now empty) context when they exit.
+	pthread_mutex_lock(&signing_cache_lock);
+	for (cache = signing_caches; cache; cache = cache->next) {
+		jal_signing_cache_clear(cache);
+	}
+	pthread_mutex_unlock(&signing_cache_lock);
+
+	cache = (struct jal_signing_cache *) pthread_getspecific(signing_cache_key);
+	if (cache) {
+		pthread_setspecific(signing_cache_key, NULL);
+		jal_signing_cache_destroy(cache);
+	}
+}
+
+/**
+ * Create the xmlsec key for \p rsa and \p x509.
+ */
+static xmlSecKeyPtr jal_create_signing_key(RSA *rsa, X509 *x509)
+{
+	xmlSecKeyPtr key = NULL;
+	xmlSecKeyDataPtr key_data = NULL;
+	BIO *bio = NULL;
 
 	RSA *new_rsa = RSAPrivateKey_dup(rsa);
 	if (!new_rsa) {
-		return JAL_E_INVAL;
+		goto err_out;
+	}
+
+	key_data = xmlSecKeyDataCreate(xmlSecKeyDataRsaId);
+	if (!key_data) {
+		goto err_out;
+	}
+
+	if (0 != xmlSecOpenSSLKeyDataRsaAdoptRsa(key_data, new_rsa)) {
+		goto err_out;
+	}
+	new_rsa = NULL;
+
+	key = xmlSecKeyCreate();
+	if (!key) {
+		goto err_out;
 	}
 
-	enum jal_status ret = JAL_E_INVAL;
+	if (0 != xmlSecKeySetValue(key, key_data)) {
+		goto err_out;
+	}
+	key_data = NULL;
+
+	if (x509) {
+		bio = BIO_new(BIO_s_mem());
+		if (!bio || !PEM_write_bio_X509(bio, x509)) {
+			goto err_out;
+		}
+		if (0 > xmlSecOpenSSLAppKeyCertLoadBIO(key,
+						bio,
+						xmlSecKeyDataFormatCertPem)) {
+			goto err_out;
+		}
+		BIO_free(bio);
+	}
+
+	return key;
+
+err_out:
+	if (bio) {
+		BIO_free(bio);
+	}
+	if (key) {
+		xmlSecKeyDestroy(key);
+	}
+	if (key_data) {
+		xmlSecKeyDataDestroy(key_data);
+	}
+	if (new_rsa) {
+		RSA_free(new_rsa);
+	}
+	return NULL;
+}
+
+/**
+ * Create the signature template, i.e. the Signature element
+ * jal_add_signature_block() adds, without the URI of the reference.
+ */
+static xmlNodePtr jal_create_signature_template(xmlDocPtr doc, int with_x509)
+{
+	xmlNodePtr signNode = NULL;
+	xmlNodePtr refNode = NULL;
+	xmlNodePtr keyInfoNode = NULL;
+	xmlNodePtr x509DataNode = NULL;
 
 	signNode = xmlSecTmplSignatureCreate(
 				doc,
 				xmlSecTransformInclC14NWithCommentsId,
 				xmlSecOpenSSLTransformRsaSha256Id,
 				NULL);
-
 	if (!signNode) {
-		goto done;
-	}
-
-	if (last) {
-		xmlAddPrevSibling(last, signNode);
-	} else {
-		xmlAddChild(xmlDocGetRootElement(doc), signNode);
+		return NULL;
 	}
+	xmlDocSetRootElement(doc, signNode);
 
-	int beg_len = xmlStrlen((xmlChar *)JAL_XML_XPOINTER_ID_BEG);
-	int end_len = xmlStrlen((xmlChar *)JAL_XML_XPOINTER_ID_END);
-	int id_len = xmlStrlen((xmlChar *)id);
-	int ref_len = beg_len + id_len + end_len + 1;
-
-	char *reference_uri = jal_calloc(ref_len, sizeof(xmlChar));
-	strncat(reference_uri, JAL_XML_XPOINTER_ID_BEG, beg_len);
-	strncat(reference_uri, id, id_len);
-	strncat(reference_uri, JAL_XML_XPOINTER_ID_END, end_len);
-	
 	refNode = xmlSecTmplSignatureAddReference(signNode,
 						xmlSecOpenSSLTransformSha256Id,
 						NULL, // id
-						(xmlChar *)reference_uri, // uri
+						NULL, // uri, set for each document
 						NULL);// type
-	free(reference_uri);
 	if (!refNode) {
-		ret = JAL_E_INVAL;
-		goto done;
+		return NULL;
 	}
 
 	if (!xmlSecTmplReferenceAddTransform(refNode, xmlSecTransformEnvelopedId)) {
-		goto done;
+		return NULL;
 	}
-	
+
 	keyInfoNode = xmlSecTmplSignatureEnsureKeyInfo(signNode, NULL);
 	if (!keyInfoNode) {
-		goto done;
+		return NULL;
 	}
 
 	if (!xmlSecTmplKeyInfoAddKeyValue(keyInfoNode)) {
-		goto done;
-	}
-
-	xmlSecKeyDataPtr pKeyData = NULL;
-	pKeyData = xmlSecKeyDataCreate(xmlSecKeyDataRsaId);
-
-	if (0 != xmlSecOpenSSLKeyDataRsaAdoptRsa(pKeyData, new_rsa)) {
-		goto done;
-	}
-
-	xmlSecKeyPtr pSecKey = xmlSecKeyCreate();
-	if (!pSecKey) {
-		goto done;
-	}
-	
-	if (0 != xmlSecKeySetValue(pSecKey, pKeyData)) {
-		goto done;
+		return NULL;
 	}
 
-    	dsigCtx = xmlSecDSigCtxCreate(NULL);
-    	if (!dsigCtx) {
-		goto done;
-    	}
-	
-	dsigCtx->signKey = pSecKey;
-
 	// add certificate information, if available
-	if (x509) {
+	if (with_x509) {
 		x509DataNode = xmlSecTmplKeyInfoAddX509Data(keyInfoNode);
 		if (!x509DataNode) {
-			goto done;
+			return NULL;
 		}
 
 		if (!xmlSecTmplX509DataAddSubjectName(x509DataNode)) {
-			goto done;
+			return NULL;
 		}
 
-		x509IssuerSerialNode = xmlSecTmplX509DataAddIssuerSerial(x509DataNode);
-		if (!x509IssuerSerialNode) {
-			goto done;
+		if (!xmlSecTmplX509DataAddIssuerSerial(x509DataNode)) {
+			return NULL;
 		}
 
 		if (!xmlSecTmplX509DataAddCertificate(x509DataNode)) {
-			goto done;
+			return NULL;
 		}
+	}
 
-		BIO *bio = BIO_new(BIO_s_mem());
-		PEM_write_bio_X509(bio, x509);
-		if (0 > xmlSecOpenSSLAppKeyCertLoadBIO(dsigCtx->signKey,
-						bio,
-						xmlSecKeyDataFormatCertPem)) {
-			goto done;
+	return signNode;
+}
+
+/**
+ * Get the signing context of the calling thread for \p rsa and \p x509,
+ * setting it up if the thread last signed with a different key.
+ *
+ * @return the context, or NULL on error.
+ */
+static struct jal_signing_cache *jal_get_signing_cache(RSA *rsa, X509 *x509)
+{
+	struct jal_signing_cache *cache;
+
+	pthread_once(&signing_cache_once, jal_signing_cache_key_create);
+
+	cache = (struct jal_signing_cache *) pthread_getspecific(signing_cache_key);
+	if (!cache) {
+		cache = jal_calloc(1, sizeof(*cache));
+		if (0 != pthread_setspecific(signing_cache_key, cache)) {
+			free(cache);
+			return NULL;
 		}
-		BIO_free(bio);
+		pthread_mutex_lock(&signing_cache_lock);
+		cache->next = signing_caches;
+		if (signing_caches) {
+			signing_caches->prev = cache;
+		}
+		signing_caches = cache;
+		pthread_mutex_unlock(&signing_cache_lock);
 	}
 
-	pthread_mutex_lock(&xmlsec_sign_lock);
-	if (0 > xmlSecDSigCtxSign(dsigCtx, signNode)) {
-		pthread_mutex_unlock(&xmlsec_sign_lock);
-		goto done;
+	if (cache->rsa == rsa && cache->x509 == x509 && cache->dsig_ctx) {
+		return cache;
+	}
+
+	jal_signing_cache_clear(cache);
+
+	cache->key = jal_create_signing_key(rsa, x509);
+	if (!cache->key) {
+		goto err_out;
+	}
+
+	cache->tmpl_doc = xmlNewDoc((xmlChar *)"1.0");
+	cache->tmpl = jal_create_signature_template(cache->tmpl_doc, x509 != NULL);
+	if (!cache->tmpl) {
+		goto err_out;
+	}
+
+	cache->dsig_ctx = xmlSecDSigCtxCreate(NULL);
+	if (!cache->dsig_ctx) {
+		goto err_out;
+	}
+
+	RSA_up_ref(rsa);
+	cache->rsa = rsa;
+	if (x509) {
+		X509_up_ref(x509);
+		cache->x509 = x509;
+	}
+	return cache;
+
+err_out:
+	jal_signing_cache_clear(cache);
+	return NULL;
+}
+
+/**
+ * Get the signature context of \p cache ready to sign another document.
+ *
+ * @return 0 on success, or -1 if the context had to be discarded.
+ */
+static int jal_signing_cache_reset_ctx(struct jal_signing_cache *cache)
+{
+	// The key belongs to the cache, so don't let xmlsec destroy it.
+	cache->dsig_ctx->signKey = NULL;
+	xmlSecDSigCtxFinalize(cache->dsig_ctx);
+	if (0 != xmlSecDSigCtxInitialize(cache->dsig_ctx, NULL)) {
+		xmlSecDSigCtxDestroy(cache->dsig_ctx);
+		cache->dsig_ctx = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+enum jal_status jal_add_signature_block(
+		RSA *rsa,
+		X509 *x509,
+		xmlDocPtr doc,
+		xmlNodePtr last,
+		const char *id)
+{
+	if (!doc || !rsa || !id) {
+		return JAL_E_INVAL;
 	}
+
+	xmlNodePtr signNode = NULL;
+	xmlNodePtr refNode = NULL;
+	struct jal_signing_cache *cache = NULL;
+	int sign_ret;
+
+	cache = jal_get_signing_cache(rsa, x509);
+	if (!cache) {
+		return JAL_E_INVAL;
+	}
+
+	signNode = xmlDocCopyNode(cache->tmpl, doc, 1);
+	if (!signNode) {
+		return JAL_E_INVAL;
+	}
+
+	if (last) {
+		xmlAddPrevSibling(last, signNode);
+	} else {
+		xmlAddChild(xmlDocGetRootElement(doc), signNode);
+	}
+
+	int beg_len = xmlStrlen((xmlChar *)JAL_XML_XPOINTER_ID_BEG);
+	int end_len = xmlStrlen((xmlChar *)JAL_XML_XPOINTER_ID_END);
+	int id_len = xmlStrlen((xmlChar *)id);
+	int ref_len = beg_len + id_len + end_len + 1;
+
+	char *reference_uri = jal_calloc(ref_len, sizeof(xmlChar));
+	strncat(reference_uri, JAL_XML_XPOINTER_ID_BEG, beg_len);
+	strncat(reference_uri, id, id_len);
+	strncat(reference_uri, JAL_XML_XPOINTER_ID_END, end_len);
+
+	refNode = xmlSecFindNode(signNode, xmlSecNodeReference, xmlSecDSigNs);
+	if (refNode) {
+		xmlSetProp(refNode, (xmlChar *)URI, (xmlChar *)reference_uri);
+	}
+	free(reference_uri);
+	if (!refNode) {
+		return JAL_E_INVAL;
+	}
+
+	cache->dsig_ctx->signKey = cache->key;
+
+	pthread_mutex_lock(&xmlsec_sign_lock);
+	sign_ret = xmlSecDSigCtxSign(cache->dsig_ctx, signNode);
 	pthread_mutex_unlock(&xmlsec_sign_lock);
 
-	ret = JAL_OK;
-done:
-	/* cleanup */
-	if (dsigCtx != NULL) {
-		xmlSecDSigCtxDestroy(dsigCtx);
+	if (0 != jal_signing_cache_reset_ctx(cache) || 0 > sign_ret) {
+		return JAL_E_INVAL;
 	}
 
-	return ret;
+	return JAL_OK;
 }
@@ -196,6 +196,18 @@ enum jal_status jal_add_signature_block(
 		xmlNodePtr last,
 		const char *id);
 
+/**
+ * Release the signing contexts jal_add_signature_block() keeps.
+ *
+ * Each thread that signs a document keeps a context for the last key and
+ * certificate it used, so signing many documents with the same key doesn't
+ * set up xmlsec again for every one of them. The context holds a reference to
+ * the key and certificate, and is released when the thread exits or signs
+ * with a different key. This function releases the contexts of all threads,
+ * and must be called before shutting down xmlsec, while no thread is signing.
+ */
+void jal_signing_cache_cleanup(void);
+
 /** @} */
 #ifdef __cplusplus
 }
@@ -0,0 +1,301 @@
+/**
+ * @file jal_xml_writer.c This file contains functions for writing XML
+ * documents straight into a memory buffer.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libxml/uri.h>
+
+#include <jalop/jal_namespaces.h>
+#include <jalop/jal_status.h>
+
+#include "jal_alloc.h"
+#include "jal_base64_internal.h"
+#include "jal_xml_writer.h"
+
+#define JAL_XML_WRITER_INIT_SIZE 1024
+#define JAL_XML_INDENT "  "
+
+#define JAL_XML_WITH_COMMENTS "http://www.w3.org/2006/12/xml-c14n11#WithComments"
+
+void jal_xml_writer_reset(struct jal_xml_writer *writer)
+{
+	if (!writer) {
+		return;
+	}
+	writer->len = 0;
+	if (writer->buf) {
+		writer->buf[0] = '\0';
+	}
+}
+
+void jal_xml_writer_free(struct jal_xml_writer *writer)
+{
+	if (!writer) {
+		return;
+	}
+	free(writer->buf);
+	writer->buf = NULL;
+	writer->len = 0;
+	writer->size = 0;
+}
+
+void jal_xml_write(struct jal_xml_writer *writer, const char *str, size_t len)
+{
+	if (writer->len + len + 1 > writer->size) {
+		if (!writer->size) {
+			writer->size = JAL_XML_WRITER_INIT_SIZE;
+		}
+		while (writer->len + len + 1 > writer->size) {
+			writer->size *= 2;
+		}
+		writer->buf = (char *) jal_realloc(writer->buf, writer->size);
+	}
+	memcpy(writer->buf + writer->len, str, len);
+	writer->len += len;
+	writer->buf[writer->len] = '\0';
+}
+
+void jal_xml_write_str(struct jal_xml_writer *writer, const char *str)
+{
+	jal_xml_write(writer, str, strlen(str));
+}
+
+/**
+ * Decode the UTF-8 sequence at \p str. A byte that does not start a valid
+ * sequence is returned as is, i.e. treated as ISO-8859-1, which is what
+ * libxml2 does when it serializes a string that is not valid UTF-8.
+ *
+ * @param [in] str The sequence to decode.
+ * @param [out] code_point The decoded character.
+ *
+ * @return the number of bytes consumed.
+ */
+static int jal_utf8_decode(const unsigned char *str, uint32_t *code_point)
+{
+	uint32_t c = str[0];
+	int len;
+	int i;
+
+	if ((c & 0xE0) == 0xC0) {
+		len = 2;
+		c &= 0x1F;
+	} else if ((c & 0xF0) == 0xE0) {
+		len = 3;
+		c &= 0x0F;
+	} else if ((c & 0xF8) == 0xF0) {
+		len = 4;
+		c &= 0x07;
+	} else {
+		goto invalid;
+	}
+	for (i = 1; i < len; i++) {
+		// This also stops at the NULL terminator.
+		if ((str[i] & 0xC0) != 0x80) {
+			goto invalid;
+		}
+		c = (c << 6) | (str[i] & 0x3F);
+	}
+	*code_point = c;
+	return len;
+invalid:
+	*code_point = str[0];
+	return 1;
+}
+
+/**
+ * Append \p str, escaped the way libxml2 serializes text content, or an
+ * attribute value if \p attr is non-zero.
+ */
+static void jal_xml_write_escaped(struct jal_xml_writer *writer, const char *str, int attr)
+{
+	const unsigned char *cur = (const unsigned char *) str;
+	const unsigned char *run = cur;
+	char char_ref[16];
+
+	while (*cur) {
+		const char *esc = NULL;
+		uint32_t code_point;
+		int len = 1;
+
+		switch (*cur) {
+		case '<':
+			esc = "&lt;";
+			break;
+		case '>':
+			esc = "&gt;";
+			break;
+		case '&':
+			esc = "&amp;";
+			break;
+		case '"':
+			esc = attr ? "&quot;" : NULL;
+			break;
+		case '\n':
+			esc = attr ? "&#10;" : NULL;
+			break;
+		case '\t':
+			esc = attr ? "&#9;" : NULL;
+			break;
+		case '\r':
+			esc = attr ? "&#13;" : "&#xD;";
+			break;
+		default:
+			if (*cur >= 0x80) {
+				len = jal_utf8_decode(cur, &code_point);
+				snprintf(char_ref, sizeof(char_ref), "&#x%"PRIX32";", code_point);
+				esc = char_ref;
+			}
+			break;
+		}
+		if (!esc) {
+			cur++;
+			continue;
+		}
+		jal_xml_write(writer, (const char *) run, cur - run);
+		jal_xml_write_str(writer, esc);
+		cur += len;
+		run = cur;
+	}
+	jal_xml_write(writer, (const char *) run, cur - run);
+}
+
+void jal_xml_write_text(struct jal_xml_writer *writer, const char *str)
+{
+	jal_xml_write_escaped(writer, str, 0);
+}
+
+void jal_xml_write_attr(struct jal_xml_writer *writer, const char *name, const char *value)
+{
+	jal_xml_write_str(writer, " ");
+	jal_xml_write_str(writer, name);
+	jal_xml_write_str(writer, "=\"");
+	jal_xml_write_escaped(writer, value, 1);
+	jal_xml_write_str(writer, "\"");
+}
+
+static void jal_xml_write_indent(struct jal_xml_writer *writer, int depth)
+{
+	int i;
+	for (i = 0; i < depth; i++) {
+		jal_xml_write(writer, JAL_XML_INDENT, sizeof(JAL_XML_INDENT) - 1);
+	}
+}
+
+void jal_xml_write_start_tag(struct jal_xml_writer *writer, int depth,
+		const char *name, const char *namespace_uri)
+{
+	jal_xml_write_indent(writer, depth);
+	jal_xml_write_str(writer, "<");
+	jal_xml_write_str(writer, name);
+	if (namespace_uri) {
+		jal_xml_write_attr(writer, "xmlns", namespace_uri);
+	}
+}
+
+void jal_xml_write_close_text(struct jal_xml_writer *writer, const char *name,
+		const char *content)
+{
+	if (!content || !*content) {
+		jal_xml_write_str(writer, "/>\n");
+		return;
+	}
+	jal_xml_write_str(writer, ">");
+	jal_xml_write_escaped(writer, content, 0);
+	jal_xml_write_str(writer, "</");
+	jal_xml_write_str(writer, name);
+	jal_xml_write_str(writer, ">\n");
+}
+
+void jal_xml_write_end_tag(struct jal_xml_writer *writer, int depth, const char *name)
+{
+	jal_xml_write_indent(writer, depth);
+	jal_xml_write_str(writer, "</");
+	jal_xml_write_str(writer, name);
+	jal_xml_write_str(writer, ">\n");
+}
+
+void jal_xml_write_text_element(struct jal_xml_writer *writer, int depth,
+		const char *name, const char *namespace_uri, const char *content)
+{
+	jal_xml_write_start_tag(writer, depth, name, namespace_uri);
+	jal_xml_write_close_text(writer, name, content);
+}
+
+enum jal_status jal_xml_write_reference(struct jal_xml_writer *writer, int depth,
+		const char *reference_uri,
+		const char *digest_method,
+		const uint8_t *digest_buf,
+		uint64_t len,
+		int audit_transforms)
+{
+	char *b64 = NULL;
+
+	if (!writer || !digest_method || !digest_buf || 0 == len) {
+		return JAL_E_XML_CONVERSION;
+	}
+
+	if (reference_uri) {
+		xmlURIPtr uri = xmlParseURI(reference_uri);
+		if (!uri) {
+			return JAL_E_INVAL_URI;
+		}
+		xmlFreeURI(uri);
+	}
+
+	b64 = jal_base64_enc(digest_buf, len);
+	if (!b64) {
+		return JAL_E_XML_CONVERSION;
+	}
+
+	jal_xml_write_start_tag(writer, depth, "Reference", NULL);
+	if (reference_uri) {
+		jal_xml_write_attr(writer, "URI", reference_uri);
+	}
+	jal_xml_write_str(writer, ">\n");
+
+	if (audit_transforms) {
+		jal_xml_write_start_tag(writer, depth + 1, "Transforms", JAL_XMLDSIG_URI);
+		jal_xml_write_str(writer, ">\n");
+		jal_xml_write_start_tag(writer, depth + 2, "Transform", NULL);
+		jal_xml_write_attr(writer, "Algorithm", JAL_XML_WITH_COMMENTS);
+		jal_xml_write_str(writer, "/>\n");
+		jal_xml_write_end_tag(writer, depth + 1, "Transforms");
+	}
+
+	jal_xml_write_start_tag(writer, depth + 1, "DigestMethod", NULL);
+	jal_xml_write_attr(writer, "Algorithm", digest_method);
+	jal_xml_write_str(writer, "/>\n");
+	jal_xml_write_text_element(writer, depth + 1, "DigestValue", JAL_XMLDSIG_URI, b64);
+	jal_xml_write_end_tag(writer, depth, "Reference");
+
+	free(b64);
+	return JAL_OK;
+}
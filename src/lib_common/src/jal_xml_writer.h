@@ -0,0 +1,156 @@
+/**
+ * @file jal_xml_writer.h This file defines helper functions for writing XML
+ * documents straight into a memory buffer, without building a DOM first.
+ *
+ * The output matches what xmlDocDumpFormatMemory() writes for the equivalent
+ * DOM: elements are indented by two spaces per level, and text and attribute
+ * values are escaped the same way, with any character outside of ASCII
+ * written as a character reference.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _JAL_XML_WRITER_H_
+#define _JAL_XML_WRITER_H_
+
+#include <jalop/jal_status.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The XML declaration libxml2 writes for a document without an encoding. */
+#define JAL_XML_DECLARATION "<?xml version=\"1.0\"?>\n"
+
+/**
+ * A growable buffer to write an XML document into. A zeroed structure is an
+ * empty writer. The buffer is kept when the writer is reset, so a writer may
+ * be reused for many documents without allocating memory for each one.
+ */
+struct jal_xml_writer {
+	char *buf;   /**< The document written so far, always NULL terminated once anything is written. */
+	size_t len;  /**< The length of the document, not including the NULL terminator. */
+	size_t size; /**< The number of bytes allocated for \p buf. */
+};
+
+/**
+ * Discard the document written so far, but keep the buffer.
+ *
+ * @param[in] writer The writer to reset.
+ */
+void jal_xml_writer_reset(struct jal_xml_writer *writer);
+
+/**
+ * Release the buffer of a writer and reset it.
+ *
+ * @param[in] writer The writer to clean up.
+ */
+void jal_xml_writer_free(struct jal_xml_writer *writer);
+
+/**
+ * Append \p len bytes of \p str, as is.
+ */
+void jal_xml_write(struct jal_xml_writer *writer, const char *str, size_t len);
+
+/**
+ * Append the NULL terminated string \p str, as is.
+ */
+void jal_xml_write_str(struct jal_xml_writer *writer, const char *str);
+
+/**
+ * Append \p str, escaped for use as text content.
+ */
+void jal_xml_write_text(struct jal_xml_writer *writer, const char *str);
+
+/**
+ * Append an attribute, i.e. a space, \p name, and \p value escaped and in
+ * double quotes.
+ */
+void jal_xml_write_attr(struct jal_xml_writer *writer, const char *name, const char *value);
+
+/**
+ * Start a new line for an element at \p depth and open its start tag. The tag
+ * is left open so attributes may be added; it must be finished with
+ * jal_xml_write_close_text(), or by writing ">\n" or "/>\n".
+ *
+ * @param[in] writer The writer.
+ * @param[in] depth The nesting level of the element, 0 for the root.
+ * @param[in] name The name of the element.
+ * @param[in] namespace_uri If not NULL, the element declares this URI as the
+ * default namespace.
+ */
+void jal_xml_write_start_tag(struct jal_xml_writer *writer, int depth,
+		const char *name, const char *namespace_uri);
+
+/**
+ * Finish an open start tag with \p content as the only content of the
+ * element, and close the element. The element is written as an empty element
+ * if \p content is NULL or empty.
+ */
+void jal_xml_write_close_text(struct jal_xml_writer *writer, const char *name,
+		const char *content);
+
+/**
+ * Write the end tag of an element at \p depth on its own line.
+ */
+void jal_xml_write_end_tag(struct jal_xml_writer *writer, int depth, const char *name);
+
+/**
+ * Write an element that only contains text.
+ * This is the same as calling jal_xml_write_start_tag() and
+ * jal_xml_write_close_text().
+ */
+void jal_xml_write_text_element(struct jal_xml_writer *writer, int depth,
+		const char *name, const char *namespace_uri, const char *content);
+
+/**
+ * Write a ds:Reference element, in the form jal_create_reference_elem()
+ * creates it, for use inside a ds:Manifest.
+ *
+ * @param[in] writer The writer.
+ * @param[in] depth The nesting level of the Reference element.
+ * @param[in] reference_uri The URI of the reference, or NULL.
+ * @param[in] digest_method The URI of the digest algorithm.
+ * @param[in] digest_buf The digest.
+ * @param[in] len The length of the digest.
+ * @param[in] audit_transforms Whether or not to add the transforms
+ * jal_create_audit_transforms_elem() creates, as done for audit records.
+ *
+ * @return JAL_OK on success, or JAL_E_XML_CONVERSION if the digest is
+ * missing.
+ */
+enum jal_status jal_xml_write_reference(struct jal_xml_writer *writer, int depth,
+		const char *reference_uri,
+		const char *digest_method,
+		const uint8_t *digest_buf,
+		uint64_t len,
+		int audit_transforms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _JAL_XML_WRITER_H_
@@ -174,6 +174,7 @@ void teardown()
 {
 	xmlFreeDoc(doc);
 
+	jal_signing_cache_cleanup();
 	xmlSecCryptoShutdown();
 	xmlSecCryptoAppShutdown();
 	xmlSecShutdown();
@@ -803,6 +804,53 @@ void test_add_signature_block_works_with_prev()
 	assert_content_equals("17415892367561384562", x509_number);
 }
 
+static xmlChar *sign_new_doc(RSA *rsa, X509 *x509)
+{
+	xmlChar *buf = NULL;
+	size_t bsize = 0;
+
+	xmlFreeDoc(doc);
+	doc = xmlNewDoc((xmlChar *)"1.0");
+	build_dom_for_signing();
+	assert_equals(JAL_OK, jal_add_signature_block(rsa, x509, doc, NULL, id_val));
+	assert_equals(JAL_OK, jal_xml_output(doc, &buf, &bsize));
+	return buf;
+}
+
+void test_add_signature_block_gives_same_result_when_signing_again()
+{
+	load_key_and_cert();
+
+	xmlChar *first = sign_new_doc(key, cert);
+	xmlChar *second = sign_new_doc(key, cert);
+	assert_string_equals((char *)first, (char *)second);
+
+	jal_signing_cache_cleanup();
+	xmlChar *third = sign_new_doc(key, cert);
+	assert_string_equals((char *)first, (char *)third);
+
+	xmlFree(first);
+	xmlFree(second);
+	xmlFree(third);
+}
+
+void test_add_signature_block_follows_key_changes()
+{
+	load_key_and_cert();
+
+	xmlChar *with_cert = sign_new_doc(key, cert);
+	xmlChar *without_cert = sign_new_doc(key, NULL);
+	assert_not_equals((void *) NULL, strstr((char *)with_cert, "X509Data"));
+	assert_equals((void *) NULL, strstr((char *)without_cert, "X509Data"));
+
+	xmlChar *again = sign_new_doc(key, cert);
+	assert_string_equals((char *)with_cert, (char *)again);
+
+	xmlFree(with_cert);
+	xmlFree(without_cert);
+	xmlFree(again);
+}
+
 void test_add_signature_fails_with_bad_input()
 {
 	enum jal_status ret;
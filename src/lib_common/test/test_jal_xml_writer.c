@@ -0,0 +1,196 @@
+/**
+ * @file test_jal_xml_writer.c This file contains functions to test
+ * jal_xml_writer.c.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <test-dept.h>
+
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+#include <jalop/jal_namespaces.h>
+#include <jalop/jal_status.h>
+
+#include "jal_xml_utils.h"
+#include "jal_xml_writer.h"
+
+#define DIGEST_ALG "http://www.w3.org/2001/04/xmlenc#sha256"
+
+static struct jal_xml_writer writer;
+static uint8_t digest[] = { 0xde, 0xad, 0xbe, 0xef };
+
+void setup()
+{
+	memset(&writer, 0, sizeof(writer));
+}
+
+void teardown()
+{
+	jal_xml_writer_free(&writer);
+}
+
+/* Serialize \p elem as the root of a new document, the way the producer
+ * library does. */
+static char *dump_as_root(xmlDocPtr doc, xmlNodePtr elem)
+{
+	xmlChar *out = NULL;
+	size_t out_len = 0;
+	xmlDocSetRootElement(doc, elem);
+	assert_equals(JAL_OK, jal_xml_output(doc, &out, &out_len));
+	return (char *) out;
+}
+
+void test_reset_keeps_buffer()
+{
+	jal_xml_write_str(&writer, "<a/>");
+	assert_string_equals("<a/>", writer.buf);
+	char *buf = writer.buf;
+	size_t size = writer.size;
+
+	jal_xml_writer_reset(&writer);
+	assert_equals(0, writer.len);
+	assert_string_equals("", writer.buf);
+	assert_pointer_equals(buf, writer.buf);
+	assert_equals(size, writer.size);
+}
+
+void test_free_releases_buffer()
+{
+	jal_xml_write_str(&writer, "<a/>");
+	jal_xml_writer_free(&writer);
+	assert_pointer_equals((void *) NULL, writer.buf);
+	assert_equals(0, writer.len);
+	assert_equals(0, writer.size);
+}
+
+void test_write_grows_buffer()
+{
+	int i;
+	for (i = 0; i < 1000; i++) {
+		jal_xml_write_str(&writer, "0123456789");
+	}
+	assert_equals(10000, writer.len);
+	assert_true(writer.size > writer.len);
+	assert_equals('\0', writer.buf[writer.len]);
+}
+
+void test_text_element_escapes_content()
+{
+	jal_xml_write_text_element(&writer, 1, "a", NULL, "x < y & \"z\" > \r\xc3\xa9");
+	assert_string_equals("  <a>x &lt; y &amp; \"z\" &gt; &#xD;&#xE9;</a>\n", writer.buf);
+}
+
+void test_text_element_with_no_content_is_empty_element()
+{
+	jal_xml_write_text_element(&writer, 0, "a", "urn:a", NULL);
+	jal_xml_write_text_element(&writer, 0, "b", NULL, "");
+	assert_string_equals("<a xmlns=\"urn:a\"/>\n<b/>\n", writer.buf);
+}
+
+void test_attr_escapes_value()
+{
+	jal_xml_write_start_tag(&writer, 0, "a", NULL);
+	jal_xml_write_attr(&writer, "b", "<&\"\n\t\r>");
+	jal_xml_write_str(&writer, "/>\n");
+	assert_string_equals("<a b=\"&lt;&amp;&quot;&#10;&#9;&#13;&gt;\"/>\n", writer.buf);
+}
+
+void test_output_matches_libxml2()
+{
+	const char *text = "tab\there & <there> \"quoted\"\r\n\xe2\x82\xac";
+	xmlDocPtr doc = xmlNewDoc((xmlChar *) "1.0");
+	xmlNodePtr root = xmlNewDocNode(doc, NULL, (xmlChar *) "Root", NULL);
+	xmlSetNs(root, xmlNewNs(root, (xmlChar *) "urn:root", NULL));
+	xmlSetProp(root, (xmlChar *) "Attr", (xmlChar *) text);
+	xmlNodePtr child = xmlNewChild(root, NULL, (xmlChar *) "Child", NULL);
+	xmlNodeAddContent(child, (xmlChar *) text);
+	xmlNewChild(root, NULL, (xmlChar *) "Empty", NULL);
+	char *expected = dump_as_root(doc, root);
+
+	jal_xml_write_str(&writer, JAL_XML_DECLARATION);
+	jal_xml_write_start_tag(&writer, 0, "Root", "urn:root");
+	jal_xml_write_attr(&writer, "Attr", text);
+	jal_xml_write_str(&writer, ">\n");
+	jal_xml_write_text_element(&writer, 1, "Child", NULL, text);
+	jal_xml_write_text_element(&writer, 1, "Empty", NULL, NULL);
+	jal_xml_write_end_tag(&writer, 0, "Root");
+
+	assert_string_equals(expected, writer.buf);
+	free(expected);
+	xmlFreeDoc(doc);
+}
+
+void test_reference_matches_reference_elem()
+{
+	xmlDocPtr doc = xmlNewDoc((xmlChar *) "1.0");
+	xmlNodePtr reference = NULL;
+	assert_equals(JAL_OK, jal_create_reference_elem(JAL_PAYLOAD_URI, DIGEST_ALG,
+			digest, sizeof(digest), doc, &reference));
+	char *expected = dump_as_root(doc, reference);
+
+	jal_xml_write_str(&writer, JAL_XML_DECLARATION);
+	assert_equals(JAL_OK, jal_xml_write_reference(&writer, 0, JAL_PAYLOAD_URI,
+			DIGEST_ALG, digest, sizeof(digest), 0));
+
+	assert_string_equals(expected, writer.buf);
+	free(expected);
+	xmlFreeDoc(doc);
+}
+
+void test_reference_with_audit_transforms_matches_dom()
+{
+	xmlDocPtr doc = xmlNewDoc((xmlChar *) "1.0");
+	xmlNodePtr reference = NULL;
+	xmlNodePtr transforms = NULL;
+	assert_equals(JAL_OK, jal_create_reference_elem(JAL_PAYLOAD_URI, DIGEST_ALG,
+			digest, sizeof(digest), doc, &reference));
+	assert_equals(JAL_OK, jal_create_audit_transforms_elem(doc, &transforms));
+	xmlAddPrevSibling(jal_get_first_element_child(reference), transforms);
+	char *expected = dump_as_root(doc, reference);
+
+	jal_xml_write_str(&writer, JAL_XML_DECLARATION);
+	assert_equals(JAL_OK, jal_xml_write_reference(&writer, 0, JAL_PAYLOAD_URI,
+			DIGEST_ALG, digest, sizeof(digest), 1));
+
+	assert_string_equals(expected, writer.buf);
+	free(expected);
+	xmlFreeDoc(doc);
+}
+
+void test_reference_fails_with_bad_input()
+{
+	assert_equals(JAL_E_XML_CONVERSION, jal_xml_write_reference(&writer, 0, JAL_PAYLOAD_URI,
+			NULL, digest, sizeof(digest), 0));
+	assert_equals(JAL_E_XML_CONVERSION, jal_xml_write_reference(&writer, 0, JAL_PAYLOAD_URI,
+			DIGEST_ALG, NULL, sizeof(digest), 0));
+	assert_equals(JAL_E_XML_CONVERSION, jal_xml_write_reference(&writer, 0, JAL_PAYLOAD_URI,
+			DIGEST_ALG, digest, 0, 0));
+	assert_equals(JAL_E_INVAL_URI, jal_xml_write_reference(&writer, 0, "bad uri%",
+			DIGEST_ALG, digest, sizeof(digest), 0));
+	assert_equals(0, writer.len);
+}
@@ -67,6 +67,7 @@
 #include "jalls_handler.h"
 #include "jalls_msg.h"
 #include "jalls_init.h"
+#include "jalls_record_utils.h"
 #include "jal_alloc.h"
 
 #define JALLS_LISTEN_BACKLOG 20
@@ -112,6 +113,7 @@ int main(int argc, char **argv) {
 		goto err_out;
 	}
 	jalls_ctx->debug = debug;
+	jalls_set_uid_cache_ttl(jalls_ctx->uid_cache_ttl);
 
 	jal_err = jal_create_dirs(jalls_ctx->db_root);
 	if (JAL_OK != jal_err) {
@@ -244,10 +246,47 @@ int main(int argc, char **argv) {
 		}
 	}
 
+	// The group commit thread must be started after daemonizing, since
+	// threads do not survive the fork.
+	if (jalls_ctx->db_group_commit_records > 1) {
+		jal_err = jaldb_enable_group_commit(db_ctx,
+				jalls_ctx->db_group_commit_records,
+				jalls_ctx->db_group_commit_usec);
+		if (jal_err != JAL_OK) {
+			fprintf(stderr, "failed to enable group commit\n");
+			goto err_out;
+		}
+	}
+
+	// Like group commit, the thread that fills the pool of journal files
+	// must be started after daemonizing.
+	jal_err = jaldb_set_journal_layout(db_ctx, jalls_ctx->journal_fanout,
+			jalls_ctx->journal_file_pool);
+	if (jal_err != JAL_OK) {
+		fprintf(stderr, "failed to configure the journal layout\n");
+		goto err_out;
+	}
+
 	if (jalls_ctx->debug) {
 		fprintf(stderr, "Ready to accept connections\n");
 	}
 
+	if (jalls_ctx->worker_threads > 0) {
+		struct jalls_thread_context base_ctx;
+		memset(&base_ctx, 0, sizeof(base_ctx));
+		base_ctx.fd = -1;
+		base_ctx.signing_key = key;
+		base_ctx.signing_cert = cert;
+		base_ctx.db_ctx = db_ctx;
+		base_ctx.ctx = jalls_ctx;
+		err = jalls_event_loop(sock, &base_ctx, jalls_ctx->worker_threads,
+				jalls_ctx->worker_queue_size);
+		if (err < 0) {
+			fprintf(stderr, "failed to run the worker pool\n");
+		}
+		goto err_out;
+	}
+
 	struct sockaddr_un peer_addr;
 	unsigned int peer_addr_size = sizeof(peer_addr);
 	while (!should_exit) {
@@ -285,6 +324,7 @@ err_out:
 
 	RSA_free(key);
 	X509_free(cert);
+	jalls_clear_uid_cache();
 	jalls_shutdown();
 
 	jaldb_context_destroy(&db_ctx);
@@ -35,9 +35,12 @@
 #include <uuid/uuid.h>
 
 #include "jal_alloc.h"
+#include "jaldb_context.h"
+#include "jaldb_utils.h"
 #include "jalu_config.h"
 #include "jalls_config.h"
 #include "jalls_context.h"
+#include "jalls_record_utils.h"
 
 int jalls_parse_config(const char *config_file_path, struct jalls_context **jalls_ctx) {
 
@@ -63,6 +66,14 @@ int jalls_parse_config(const char *config_file_path, struct jalls_context **jall
 	char **socket = &((*jalls_ctx)->socket);
 	int *sign_sys_meta = &((*jalls_ctx)->sign_sys_meta);
 	int *manifest_sys_meta = &((*jalls_ctx)->manifest_sys_meta);
+	long long int *db_group_commit_records = &((*jalls_ctx)->db_group_commit_records);
+	long long int *db_group_commit_usec = &((*jalls_ctx)->db_group_commit_usec);
+	long long int *worker_threads = &((*jalls_ctx)->worker_threads);
+	long long int *worker_queue_size = &((*jalls_ctx)->worker_queue_size);
+	long long int *worker_recv_timeout = &((*jalls_ctx)->worker_recv_timeout);
+	long long int *uid_cache_ttl = &((*jalls_ctx)->uid_cache_ttl);
+	long long int *journal_fanout = &((*jalls_ctx)->journal_fanout);
+	long long int *journal_file_pool = &((*jalls_ctx)->journal_file_pool);
 
 	config_t jalls_config;
 	config_init(&jalls_config);
@@ -142,6 +153,68 @@ int jalls_parse_config(const char *config_file_path, struct jalls_context **jall
 
 	config_setting_lookup_bool(root, JALLS_CFG_MANIFEST, manifest_sys_meta);
 
+	config_setting_lookup_int64(root, JALLS_CFG_DB_GROUP_COMMIT_RECORDS, db_group_commit_records);
+	if (*db_group_commit_records < 0) {
+		ret = -1;
+		fprintf(stderr, "Error: %s must not be negative\n", JALLS_CFG_DB_GROUP_COMMIT_RECORDS);
+		goto err_out;
+	}
+
+	*db_group_commit_usec = JALLS_CFG_DB_GROUP_COMMIT_USEC_DEFAULT;
+	config_setting_lookup_int64(root, JALLS_CFG_DB_GROUP_COMMIT_USEC, db_group_commit_usec);
+	if (*db_group_commit_usec < 0) {
+		ret = -1;
+		fprintf(stderr, "Error: %s must not be negative\n", JALLS_CFG_DB_GROUP_COMMIT_USEC);
+		goto err_out;
+	}
+
+	config_setting_lookup_int64(root, JALLS_CFG_WORKER_THREADS, worker_threads);
+	if (*worker_threads < 0 || *worker_threads > INT_MAX) {
+		ret = -1;
+		fprintf(stderr, "Error: invalid value for %s\n", JALLS_CFG_WORKER_THREADS);
+		goto err_out;
+	}
+
+	*worker_queue_size = *worker_threads * JALLS_CFG_WORKER_QUEUE_PER_THREAD_DEFAULT;
+	config_setting_lookup_int64(root, JALLS_CFG_WORKER_QUEUE_SIZE, worker_queue_size);
+	if (*worker_threads > 0 && (*worker_queue_size <= 0 || *worker_queue_size > INT_MAX)) {
+		ret = -1;
+		fprintf(stderr, "Error: invalid value for %s\n", JALLS_CFG_WORKER_QUEUE_SIZE);
+		goto err_out;
+	}
+
+	*worker_recv_timeout = JALLS_CFG_WORKER_RECV_TIMEOUT_DEFAULT;
+	config_setting_lookup_int64(root, JALLS_CFG_WORKER_RECV_TIMEOUT, worker_recv_timeout);
+	if (*worker_recv_timeout < 0) {
+		ret = -1;
+		fprintf(stderr, "Error: %s must not be negative\n", JALLS_CFG_WORKER_RECV_TIMEOUT);
+		goto err_out;
+	}
+
+	*uid_cache_ttl = JALLS_UID_CACHE_TTL_DEFAULT;
+	config_setting_lookup_int64(root, JALLS_CFG_UID_CACHE_TTL, uid_cache_ttl);
+	if (*uid_cache_ttl < 0) {
+		ret = -1;
+		fprintf(stderr, "Error: %s must not be negative\n", JALLS_CFG_UID_CACHE_TTL);
+		goto err_out;
+	}
+
+	*journal_fanout = JALDB_JOURNAL_FANOUT_DEFAULT;
+	config_setting_lookup_int64(root, JALLS_CFG_JOURNAL_FANOUT, journal_fanout);
+	if (*journal_fanout < 1 || *journal_fanout > JALDB_FANOUT_MAX) {
+		ret = -1;
+		fprintf(stderr, "Error: %s must be between 1 and %d\n", JALLS_CFG_JOURNAL_FANOUT,
+				JALDB_FANOUT_MAX);
+		goto err_out;
+	}
+
+	config_setting_lookup_int64(root, JALLS_CFG_JOURNAL_FILE_POOL, journal_file_pool);
+	if (*journal_file_pool < 0) {
+		ret = -1;
+		fprintf(stderr, "Error: %s must not be negative\n", JALLS_CFG_JOURNAL_FILE_POOL);
+		goto err_out;
+	}
+
 	if (*hostname == NULL) {
 		char name[_POSIX_HOST_NAME_MAX+1];
 		if (gethostname(name, sizeof(name)) == 0) {
@@ -36,6 +36,9 @@
 
 #define JALLS_CFG_DB_DEFAULT "/var/lib/jalop/db"
 #define JALLS_CFG_SOCKET_DEFAULT "/var/run/jalop/jalop.sock"
+#define JALLS_CFG_DB_GROUP_COMMIT_USEC_DEFAULT 1000
+#define JALLS_CFG_WORKER_QUEUE_PER_THREAD_DEFAULT 4
+#define JALLS_CFG_WORKER_RECV_TIMEOUT_DEFAULT 30
 
 #define JALLS_CFG_PRIVATE_KEY_FILE "private_key_file"
 #define JALLS_CFG_PUBLIC_CERT_FILE "public_cert_file"
@@ -48,6 +51,14 @@
 #define JALLS_CFG_SCHEMAS_ROOT "schemas_root"
 #define JALLS_CFG_PID_FILE "pid_file"
 #define JALLS_CFG_LOG_DIR "log_dir"
+#define JALLS_CFG_DB_GROUP_COMMIT_RECORDS "db_group_commit_records"
+#define JALLS_CFG_DB_GROUP_COMMIT_USEC "db_group_commit_usec"
+#define JALLS_CFG_WORKER_THREADS "worker_threads"
+#define JALLS_CFG_WORKER_QUEUE_SIZE "worker_queue_size"
+#define JALLS_CFG_WORKER_RECV_TIMEOUT "worker_recv_timeout"
+#define JALLS_CFG_UID_CACHE_TTL "uid_cache_ttl"
+#define JALLS_CFG_JOURNAL_FANOUT "journal_fanout"
+#define JALLS_CFG_JOURNAL_FILE_POOL "journal_file_pool"
 
 /**
  * Parses the config file and fills out the jalls_context struct.
@@ -70,6 +70,22 @@ struct jalls_context {
 	char *pid_file;
 	/** Absolute path to directory where stdout and stderr logs will be written if run as a daemon. */
 	char *log_dir;
+	/** The most records to commit to the database in one transaction. 0 or 1 commits each record on its own. */
+	long long int db_group_commit_records;
+	/** The longest time, in microseconds, a record waits for others to join its transaction. */
+	long long int db_group_commit_usec;
+	/** The number of threads in the worker pool. 0 creates a thread for each connection instead. */
+	long long int worker_threads;
+	/** The number of readable connections that may wait for a free worker. */
+	long long int worker_queue_size;
+	/** How long, in seconds, a worker waits for the rest of a message before closing the connection. 0 waits forever. */
+	long long int worker_recv_timeout;
+	/** How long, in seconds, a username looked up for a UID is used for other connections. 0 looks up the name for every connection. */
+	long long int uid_cache_ttl;
+	/** The number of directory levels new journal files are put in. */
+	long long int journal_fanout;
+	/** The number of empty journal files to create ahead of time. 0 creates each file when it is needed. */
+	long long int journal_file_pool;
 };
 
 struct jalls_thread_context { /* the worker thread should never write to or free any of the jalls_thread_context fields */
@@ -83,6 +99,12 @@ struct jalls_thread_context { /* the worker thread should never write to or free
 	pid_t peer_pid;
 	/** The uid of the peer that sent the record. This will be gathered by the thread and stored in the system metadata */
 	uid_t peer_uid;
+	/** Whether peer_pid, peer_uid and peer_sec_lbl were gathered yet. They can't change while the socket is connected, so this is done for the first message only. */
+	int have_peer_info;
+	/** The username of peer_uid, looked up for the first record of the connection. Freed when the connection is closed. */
+	char *peer_username;
+	/** The security label of the peer, or NULL. Freed when the connection is closed. */
+	char *peer_sec_lbl;
 	/** The RSA private key to use when signing system metadata*/
 	RSA *signing_key;
 	/** The certificate used for signing the system metadata */
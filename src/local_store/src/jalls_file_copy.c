@@ -0,0 +1,295 @@
+/**
+ * @file jalls_file_copy.c This file contains a helper function to
+ * copy and digest journal files for the jal local store.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#endif
+
+#include <jalop/jal_status.h>
+
+#include "jal_alloc.h"
+
+#include "jalls_file_copy.h"
+
+#define JALLS_COPY_BUF_LEN (256 * 1024)
+#define JALLS_COPY_CHUNK_LEN (1 << 30)
+#define JALLS_DIGEST_WINDOW_LEN (64 * 1024 * 1024)
+
+static size_t jalls_chunk_len(uint64_t remaining, size_t max)
+{
+	return (remaining < (uint64_t)max) ? (size_t)remaining : max;
+}
+
+static int jalls_write_all(int fd, const uint8_t *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t bytes_written = write(fd, buf, len);
+		if (bytes_written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (bytes_written <= 0) {
+			return -1;
+		}
+		buf += bytes_written;
+		len -= (size_t)bytes_written;
+	}
+	return 0;
+}
+
+/**
+ * Copy \p len bytes from the start of \p src_fd to \p dst_fd without
+ * passing them through user space where the kernel allows it. Whatever the
+ * kernel can't copy goes through a read()/write() loop.
+ */
+static int jalls_copy_data(int src_fd, int dst_fd, uint64_t len, int debug)
+{
+	uint8_t *buf = NULL;
+	uint64_t remaining = len;
+	off_t offset = 0;
+	ssize_t bytes_read;
+	int ret = -1;
+
+#ifdef __linux__
+#ifdef FICLONE
+	// A reflink shares the source's blocks, so it only fits when the
+	// whole source is the payload and the destination is still empty.
+	struct stat src_st;
+	struct stat dst_st;
+	if (len > 0 && 0 == fstat(src_fd, &src_st) && S_ISREG(src_st.st_mode) &&
+			(uint64_t)src_st.st_size == len &&
+			0 == fstat(dst_fd, &dst_st) && 0 == dst_st.st_size &&
+			0 == ioctl(dst_fd, FICLONE, src_fd)) {
+		if ((off_t) -1 == lseek(dst_fd, 0, SEEK_END)) {
+			if (debug) {
+				fprintf(stderr, "failed to seek to the end of the cloned journal\n");
+			}
+			return -1;
+		}
+		return 0;
+	}
+#endif /* FICLONE */
+
+#ifdef __NR_copy_file_range
+	// Any failure here, including filesystems that report 0 bytes
+	// copied, just means the remaining data goes through one of the
+	// slower paths below.
+	loff_t in_off = 0;
+	while (remaining > 0) {
+		ssize_t copied = syscall(__NR_copy_file_range, src_fd, &in_off,
+				dst_fd, NULL, jalls_chunk_len(remaining, JALLS_COPY_CHUNK_LEN), 0);
+		if (copied <= 0) {
+			break;
+		}
+		remaining -= (uint64_t)copied;
+	}
+	offset = (off_t)in_off;
+#endif /* __NR_copy_file_range */
+
+	while (remaining > 0) {
+		ssize_t copied = sendfile(dst_fd, src_fd, &offset,
+				jalls_chunk_len(remaining, JALLS_COPY_CHUNK_LEN));
+		if (copied <= 0) {
+			break;
+		}
+		remaining -= (uint64_t)copied;
+	}
+#endif /* __linux__ */
+
+	if (remaining == 0) {
+		return 0;
+	}
+
+	// Pipes can't be seeked and are read from wherever they are, so only
+	// insist on it once part of the file has already been copied.
+	if ((off_t) -1 == lseek(src_fd, offset, SEEK_SET) && offset != 0) {
+		if (debug) {
+			fprintf(stderr, "failed to seek in the journal file\n");
+		}
+		return -1;
+	}
+	buf = (uint8_t *)jal_malloc(JALLS_COPY_BUF_LEN);
+	while (remaining > 0) {
+		bytes_read = read(src_fd, buf, jalls_chunk_len(remaining, JALLS_COPY_BUF_LEN));
+		if (bytes_read < 0 && errno == EINTR) {
+			continue;
+		}
+		if (bytes_read <= 0) {
+			if (debug) {
+				fprintf(stderr, "failed to read from file descriptor\n");
+			}
+			goto out;
+		}
+		if (0 != jalls_write_all(dst_fd, buf, (size_t)bytes_read)) {
+			if (debug) {
+				fprintf(stderr, "could not write journal to file\n");
+			}
+			goto out;
+		}
+		remaining -= (uint64_t)bytes_read;
+	}
+	ret = 0;
+out:
+	free(buf);
+	return ret;
+}
+
+static int jalls_digest_data_read(struct jal_digest_ctx *digest_ctx,
+		void *instance, int fd, off_t offset, uint64_t remaining)
+{
+	uint8_t *buf = (uint8_t *)jal_malloc(JALLS_COPY_BUF_LEN);
+	ssize_t bytes_read;
+	int ret = -1;
+
+	while (remaining > 0) {
+		bytes_read = pread(fd, buf, jalls_chunk_len(remaining, JALLS_COPY_BUF_LEN), offset);
+		if (bytes_read < 0 && errno == EINTR) {
+			continue;
+		}
+		if (bytes_read <= 0) {
+			goto out;
+		}
+		if (JAL_OK != digest_ctx->update(instance, buf, bytes_read)) {
+			goto out;
+		}
+		offset += bytes_read;
+		remaining -= (uint64_t)bytes_read;
+	}
+	ret = 0;
+out:
+	free(buf);
+	return ret;
+}
+
+/**
+ * Digest \p len bytes of \p fd starting at \p offset, mapping the file a
+ * window at a time, and reading it if it can't be mapped.
+ */
+static int jalls_digest_data(struct jal_digest_ctx *digest_ctx, void *instance,
+		int fd, off_t offset, uint64_t len)
+{
+	uint64_t remaining = len;
+	long page_size = sysconf(_SC_PAGESIZE);
+	// mmap() needs a page aligned offset, so map from the start of the
+	// page and skip what comes before the data.
+	off_t map_offset = (page_size > 0) ? offset - (offset % page_size) : 0;
+	size_t skip = (size_t)(offset - map_offset);
+
+	while (remaining > 0) {
+		size_t window = jalls_chunk_len(remaining, JALLS_DIGEST_WINDOW_LEN);
+		void *map = mmap(NULL, skip + window, PROT_READ, MAP_SHARED, fd, map_offset);
+		if (MAP_FAILED == map) {
+			return jalls_digest_data_read(digest_ctx, instance, fd,
+					map_offset + (off_t)skip, remaining);
+		}
+		madvise(map, skip + window, MADV_SEQUENTIAL);
+		enum jal_status jal_err = digest_ctx->update(instance,
+				(uint8_t *)map + skip, window);
+		munmap(map, skip + window);
+		if (JAL_OK != jal_err) {
+			return -1;
+		}
+		map_offset += (off_t)(skip + window);
+		skip = 0;
+		remaining -= window;
+	}
+	return 0;
+}
+
+int jalls_copy_file(int src_fd, int dst_fd, uint64_t len,
+		struct jal_digest_ctx *digest_ctx, uint8_t *digest, int debug)
+{
+	void *instance = NULL;
+	off_t dst_start;
+	struct stat st;
+	size_t digest_len;
+	int ret = -1;
+
+	if (src_fd < 0 || dst_fd < 0 || !digest_ctx || !digest) {
+		return -1;
+	}
+
+	dst_start = lseek(dst_fd, 0, SEEK_CUR);
+	if ((off_t) -1 == dst_start) {
+		if (debug) {
+			fprintf(stderr, "failed to find the offset in the journal file\n");
+		}
+		return -1;
+	}
+
+	if (0 != jalls_copy_data(src_fd, dst_fd, len, debug)) {
+		return -1;
+	}
+
+	// Mapping past the end of the file would fault, so make sure the
+	// copy really is as long as expected.
+	if (0 != fstat(dst_fd, &st) || (uint64_t)st.st_size < (uint64_t)dst_start + len) {
+		if (debug) {
+			fprintf(stderr, "journal file is shorter than expected\n");
+		}
+		return -1;
+	}
+
+	instance = digest_ctx->create();
+	if (!instance || JAL_OK != digest_ctx->init(instance)) {
+		if (debug) {
+			fprintf(stderr, "could not init digest context\n");
+		}
+		goto out;
+	}
+	if (0 != jalls_digest_data(digest_ctx, instance, dst_fd, dst_start, len)) {
+		if (debug) {
+			fprintf(stderr, "could not digest the journal data\n");
+		}
+		goto out;
+	}
+	digest_len = digest_ctx->len;
+	if (JAL_OK != digest_ctx->final(instance, digest, &digest_len)) {
+		if (debug) {
+			fprintf(stderr, "could not digest the journal\n");
+		}
+		goto out;
+	}
+	ret = 0;
+out:
+	if (instance) {
+		digest_ctx->destroy(instance);
+	}
+	return ret;
+}
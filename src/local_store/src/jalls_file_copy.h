@@ -0,0 +1,76 @@
+/**
+ * @file jalls_file_copy.h This file contains helper functions to copy
+ * and digest journal files for the jal local store.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _JALLS_FILE_COPY_H_
+#define _JALLS_FILE_COPY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <jalop/jal_digest.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Copy the first \p len bytes of \p src_fd to the current offset of
+ * \p dst_fd, and digest the copy.
+ *
+ * The data is copied in the kernel where possible: with a FICLONE reflink
+ * when \p src_fd is a regular file of exactly \p len bytes and \p dst_fd
+ * is empty, then with copy_file_range(), then with sendfile(). Whatever is
+ * left, for example when \p src_fd is a pipe, goes through a read()/write()
+ * loop. \p src_fd is read from its start if it can be seeked, and from
+ * wherever it is otherwise.
+ *
+ * The digest is then taken over the copy in \p dst_fd, mapped a window at a
+ * time, so it covers exactly the bytes that were stored, whatever the
+ * producer does with its own file afterwards.
+ *
+ * @param[in] src_fd The file descriptor to copy from.
+ * @param[in] dst_fd The file descriptor to copy to, open for reading and
+ * writing. This should be a newly created, empty file.
+ * @param[in] len The number of bytes to copy.
+ * @param[in] digest_ctx The digest algorithm to use.
+ * @param[out] digest A buffer of at least digest_ctx->len bytes to hold the
+ * digest.
+ * @param[in] debug A flag to indicate whether to print debug messages to stderr.
+ *
+ * @return 0 on success, or -1 on error, including if fewer than \p len bytes
+ * could be copied.
+ */
+int jalls_copy_file(int src_fd, int dst_fd, uint64_t len,
+		struct jal_digest_ctx *digest_ctx, uint8_t *digest, int debug);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _JALLS_FILE_COPY_H_
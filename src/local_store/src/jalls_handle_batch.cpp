@@ -0,0 +1,360 @@
+/**
+ * @file jalls_handle_batch.cpp This file contains functions to handle a
+ * batch of log and audit records sent to the jal local store.
+ *
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <jalop/jal_digest.h>
+#include <jalop/jal_status.h>
+
+#include "jal_alloc.h"
+
+#include "jaldb_context.hpp"
+#include "jaldb_record.h"
+#include "jaldb_record_xml.h"
+#include "jaldb_segment.h"
+
+#include "jalls_context.h"
+#include "jalls_msg.h"
+#include "jalls_handle_batch.hpp"
+#include "jalls_handler.h"
+#include "jalls_record_utils.h"
+
+/* The protocol version, message type, data length and metadata length. */
+#define JALLS_BATCH_ENTRY_HDR_LEN (2 * sizeof(uint16_t) + 2 * sizeof(uint64_t))
+
+static struct jaldb_segment *jalls_batch_segment(const uint8_t *buf, uint64_t len)
+{
+	struct jaldb_segment *seg = jaldb_create_segment();
+	seg->length = len;
+	seg->payload = (uint8_t *)jal_malloc(len);
+	memcpy(seg->payload, buf, len);
+	seg->on_disk = 0;
+	return seg;
+}
+
+/**
+ * Create a record for one entry of a batch, the same way jalls_handle_log()
+ * and jalls_handle_audit() do for a single record, including its system
+ * metadata.
+ */
+static int jalls_batch_create_record(struct jalls_thread_context *thread_ctx,
+		enum jaldb_rec_type type,
+		const uint8_t *data, uint64_t data_len,
+		const uint8_t *meta, uint64_t meta_len,
+		struct jaldb_record **prec)
+{
+	struct jal_digest_ctx *digest_ctx = NULL;
+	struct jaldb_record *rec = NULL;
+	int debug = thread_ctx->ctx->debug;
+	int ret = -1;
+	int err;
+
+	enum jaldb_status db_err;
+	uint8_t *payload_digest = NULL;
+	int payload_digest_len = 0;
+	char *payload_alg = NULL;
+	uint8_t *app_meta_digest = NULL;
+	int app_meta_digest_len = 0;
+	char *app_meta_alg = NULL;
+
+	RSA *signing_key = NULL;
+
+	if (thread_ctx->ctx->sign_sys_meta) {
+		signing_key = thread_ctx->signing_key;
+	}
+
+	err = jalls_create_record(type, thread_ctx, &rec);
+	if (err < 0) {
+		if (debug) {
+			fprintf(stderr, "failed to create record struct\n");
+		}
+		goto out;
+	}
+
+	if (meta_len) {
+		rec->app_meta = jalls_batch_segment(meta, meta_len);
+	}
+
+	if (data_len > 0) {
+		rec->payload = jalls_batch_segment(data, data_len);
+	}
+
+	// Needed to generate system metadata
+	rec->source = jal_strdup("localhost");
+
+	if (thread_ctx->ctx->manifest_sys_meta) {
+		digest_ctx = jal_sha256_ctx_create();
+		if (rec->payload) {
+			err = jal_digest_buffer(digest_ctx, rec->payload->payload, rec->payload->length, &payload_digest);
+			if (JAL_OK != err) {
+				if (debug) {
+					fprintf(stderr, "Failed to calculate digest for record payload\n");
+				}
+				goto out;
+			}
+			payload_digest_len = digest_ctx->len;
+			payload_alg = jal_strdup(digest_ctx->algorithm_uri);
+		}
+
+		if (rec->app_meta) {
+			err = jal_digest_buffer(digest_ctx, rec->app_meta->payload, rec->app_meta->length, &app_meta_digest);
+			if (JAL_OK != err) {
+				if (debug) {
+					fprintf(stderr, "Failed to calculate digest for record Application Metadata\n");
+				}
+				goto out;
+			}
+			app_meta_digest_len = digest_ctx->len;
+			app_meta_alg = jal_strdup(digest_ctx->algorithm_uri);
+		}
+	}
+
+	rec->sys_meta = jaldb_create_segment();
+	db_err = jaldb_record_to_system_metadata_doc(rec,
+						signing_key,
+						app_meta_digest,
+						app_meta_digest_len,
+						app_meta_alg,
+						payload_digest,
+						payload_digest_len,
+						payload_alg,
+						(char **) &(rec->sys_meta->payload),
+						&(rec->sys_meta->length));
+	if (JALDB_OK != db_err) {
+		if (debug) {
+			fprintf(stderr, "Failed to generate system metadata for record\n");
+		}
+		goto out;
+	}
+
+	*prec = rec;
+	rec = NULL;
+	ret = 0;
+
+out:
+	if (digest_ctx) {
+		jal_digest_ctx_destroy(&digest_ctx);
+	}
+	free(payload_digest);
+	free(app_meta_digest);
+	free(payload_alg);
+	free(app_meta_alg);
+	jaldb_destroy_record(&rec);
+	return ret;
+}
+
+/**
+ * Take \p len bytes from the part of the batch at \p *cur that is not parsed
+ * yet, with \p *remaining bytes left.
+ *
+ * @return a pointer to the bytes, or NULL if the batch is too short.
+ */
+static const uint8_t *jalls_batch_take(const uint8_t **cur, uint64_t *remaining, uint64_t len)
+{
+	const uint8_t *taken = *cur;
+	if (len > *remaining) {
+		return NULL;
+	}
+	*cur += len;
+	*remaining -= len;
+	return taken;
+}
+
+/**
+ * Parse the next entry of a batch, which has the same layout as a version 1
+ * log or audit message, and create a record for it.
+ */
+static int jalls_batch_parse_entry(struct jalls_thread_context *thread_ctx,
+		const uint8_t **cur, uint64_t *remaining,
+		struct jaldb_record **prec)
+{
+	int debug = thread_ctx->ctx->debug;
+	const uint8_t *hdr;
+	const uint8_t *data;
+	const uint8_t *meta;
+	const uint8_t *brk;
+	uint16_t protocol_version;
+	uint16_t message_type;
+	uint64_t data_len;
+	uint64_t meta_len;
+	enum jaldb_rec_type type;
+
+	hdr = jalls_batch_take(cur, remaining, JALLS_BATCH_ENTRY_HDR_LEN);
+	if (!hdr) {
+		if (debug) {
+			fprintf(stderr, "batch ends in the middle of a record header\n");
+		}
+		return -1;
+	}
+	memcpy(&protocol_version, hdr, sizeof(protocol_version));
+	hdr += sizeof(protocol_version);
+	memcpy(&message_type, hdr, sizeof(message_type));
+	hdr += sizeof(message_type);
+	memcpy(&data_len, hdr, sizeof(data_len));
+	hdr += sizeof(data_len);
+	memcpy(&meta_len, hdr, sizeof(meta_len));
+
+	if (protocol_version != JALLS_PROTOCOL_VERSION) {
+		if (debug) {
+			fprintf(stderr, "record in batch has protocol version != 1\n");
+		}
+		return -1;
+	}
+	switch (message_type) {
+		case JALLS_LOG_MSG:
+			type = JALDB_RTYPE_LOG;
+			break;
+		case JALLS_AUDIT_MSG:
+			type = JALDB_RTYPE_AUDIT;
+			break;
+		default:
+			if (debug) {
+				fprintf(stderr, "only log and audit records may be batched\n");
+			}
+			return -1;
+	}
+
+	data = jalls_batch_take(cur, remaining, data_len);
+	brk = data ? jalls_batch_take(cur, remaining, JALLS_BREAK_LEN) : NULL;
+	if (!brk || 0 != memcmp(brk, JALLS_BREAK_STRING, JALLS_BREAK_LEN)) {
+		if (debug) {
+			fprintf(stderr, "could not find first BREAK of record in batch\n");
+		}
+		return -1;
+	}
+	meta = jalls_batch_take(cur, remaining, meta_len);
+	brk = meta ? jalls_batch_take(cur, remaining, JALLS_BREAK_LEN) : NULL;
+	if (!brk || 0 != memcmp(brk, JALLS_BREAK_STRING, JALLS_BREAK_LEN)) {
+		if (debug) {
+			fprintf(stderr, "could not find second BREAK of record in batch\n");
+		}
+		return -1;
+	}
+
+	return jalls_batch_create_record(thread_ctx, type, data, data_len,
+			meta, meta_len, prec);
+}
+
+extern "C" int jalls_handle_batch(struct jalls_thread_context *thread_ctx, uint64_t record_cnt, uint64_t batch_len)
+{
+	if (!thread_ctx || !(thread_ctx->ctx)) {
+		return -1; //should never happen.
+	}
+
+	int debug = thread_ctx->ctx->debug;
+	int ret = -1;
+	uint8_t *batch_buf = NULL;
+	struct jaldb_record **recs = NULL;
+	char **nonces = NULL;
+	const uint8_t *cur;
+	uint64_t remaining;
+	uint64_t i;
+	enum jaldb_status db_err;
+
+	if (0 == record_cnt || JALLS_MAX_BATCH_RECORDS < record_cnt ||
+			JALLS_MAX_BATCH_BYTES < batch_len ||
+			batch_len < record_cnt * (JALLS_BATCH_ENTRY_HDR_LEN + 2 * JALLS_BREAK_LEN)) {
+		if (debug) {
+			fprintf(stderr, "invalid batch of %" PRIu64 " records in %" PRIu64 " bytes\n",
+					record_cnt, batch_len);
+		}
+		return -1;
+	}
+
+	// Read the whole batch at once; the records are only inserted once
+	// all of them are known to be valid.
+	batch_buf = (uint8_t *)jal_malloc(batch_len);
+
+	struct iovec iov[1];
+	iov[0].iov_base = batch_buf;
+	iov[0].iov_len = batch_len;
+
+	struct msghdr msgh;
+	memset(&msgh, 0, sizeof(msgh));
+	msgh.msg_iov = iov;
+	msgh.msg_iovlen = 1;
+
+	if (0 >= jalls_recvmsg_helper(thread_ctx->fd, &msgh, debug)) {
+		if (debug) {
+			fprintf(stderr, "could not receive the batch\n");
+		}
+		goto out;
+	}
+
+	recs = (struct jaldb_record **)jal_calloc(record_cnt, sizeof(*recs));
+	nonces = (char **)jal_calloc(record_cnt, sizeof(*nonces));
+
+	cur = batch_buf;
+	remaining = batch_len;
+	for (i = 0; i < record_cnt; i++) {
+		if (0 > jalls_batch_parse_entry(thread_ctx, &cur, &remaining, &recs[i])) {
+			goto out;
+		}
+	}
+	if (0 != remaining) {
+		if (debug) {
+			fprintf(stderr, "batch has %" PRIu64 " bytes after the last record\n", remaining);
+		}
+		goto out;
+	}
+
+	db_err = jaldb_insert_records(thread_ctx->db_ctx, recs, record_cnt, 1, nonces);
+	if (JALDB_OK != db_err) {
+		if (debug) {
+			fprintf(stderr, "failed to insert batch of records\n");
+			switch (db_err) {
+				case JALDB_E_REJECT:
+					fprintf(stderr, "a record was too large and the batch was rejected\n");
+					break;
+				default:
+					break;
+			}
+		}
+		goto out;
+	}
+	ret = 0;
+
+out:
+	if (recs) {
+		for (i = 0; i < record_cnt; i++) {
+			jaldb_destroy_record(&recs[i]);
+			free(nonces[i]);
+		}
+	}
+	free(recs);
+	free(nonces);
+	free(batch_buf);
+	return ret;
+}
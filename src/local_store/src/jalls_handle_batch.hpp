@@ -0,0 +1,70 @@
+/**
+ * @file jalls_handle_batch.hpp This file contains functions to handle a
+ * batch of log and audit records sent to the jal local store.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _JALLS_HANDLE_BATCH_H_
+#define _JALLS_HANDLE_BATCH_H_
+
+#include <stdint.h>
+
+#include "jalls_context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The largest number of records a producer may send in a single batch. */
+#define JALLS_MAX_BATCH_RECORDS 1024
+
+/**
+ * The largest batch, in bytes, a producer may send. This matches the limit
+ * the producer library batches up to, and is checked before the batch is
+ * read into memory.
+ */
+#define JALLS_MAX_BATCH_BYTES (1024 * 1024)
+
+/**
+ * Receive a batch of log and audit records and insert all of them into the
+ * database in a single transaction. If any record of the batch is invalid,
+ * none of the records are inserted.
+ *
+ * @param[in] thread_ctx The context for the connection to read from.
+ * @param[in] record_cnt The number of records in the batch, the data length
+ * of the message header.
+ * @param[in] batch_len The length of the records, the metadata length of the
+ * message header.
+ *
+ * @return 0 on success, or -1 on error.
+ */
+int jalls_handle_batch(struct jalls_thread_context *thread_ctx, uint64_t record_cnt, uint64_t batch_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _JALLS_HANDLE_BATCH_H_
@@ -93,10 +93,8 @@ extern "C" int jalls_handle_journal(struct jalls_thread_context *thread_ctx, uin
 	}
 
 	//get a file from the db layer to write the journal data to.
-	uuid_t uuid;
-	uuid_generate(uuid);
-	db_err = jaldb_create_file(thread_ctx->db_ctx->journal_root, &db_payload_path,
-			&db_payload_fd, uuid, JALDB_RTYPE_JOURNAL, JALDB_DTYPE_PAYLOAD);
+	db_err = jaldb_create_journal_file(thread_ctx->db_ctx, data_len, &db_payload_path,
+			&db_payload_fd);
 	if (db_err != JALDB_OK) {
 		if (debug) {
 			fprintf(stderr, "could not create a file to store journal data\n");
@@ -150,7 +148,7 @@ extern "C" int jalls_handle_journal(struct jalls_thread_context *thread_ctx, uin
 			goto err_out;
 		}
 		bytes_written = write(db_payload_fd, data_buf, bytes_received);
-		if (bytes_written < 0) {
+		if (bytes_written != bytes_received) {
 			if (debug) {
 				fprintf(stderr, "could not write journal to file\n");
 			}
@@ -234,21 +232,13 @@ extern "C" int jalls_handle_journal(struct jalls_thread_context *thread_ctx, uin
 	rec->source = jal_strdup("localhost");
 
 	if (thread_ctx->ctx->manifest_sys_meta) {
-		if (rec->payload) {
-			if (rec->payload->on_disk) {
-				err = jal_digest_fd(digest_ctx, rec->payload->fd, &payload_digest);
-			} else {
-				err = jal_digest_buffer(digest_ctx, rec->payload->payload, rec->payload->length, &payload_digest);
-			}
-			if (JAL_OK != err) {
-				if (debug) {
-					fprintf(stderr, "Failed to calculate digest for record payload\n");
-				}
-				goto err_out;
-			}
-			payload_digest_len = digest_ctx->len;
-			payload_alg = jal_strdup(digest_ctx->algorithm_uri); 
-		}
+		// The payload was already run through the digest while it was
+		// written to disk, so hand that digest off rather than reading
+		// the whole file back in.
+		payload_digest = digest;
+		digest = NULL;
+		payload_digest_len = digest_length;
+		payload_alg = jal_strdup(digest_ctx->algorithm_uri);
 
 		if (rec->app_meta) {
 			err = jal_digest_buffer(digest_ctx, rec->app_meta->payload, rec->app_meta->length, &app_meta_digest);
@@ -30,7 +30,6 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/types.h>
-#include <sys/socket.h>
 #include <unistd.h>
 
 #include <jalop/jal_status.h>
@@ -43,14 +42,13 @@
 #include "jaldb_utils.h"
 
 #include "jalls_context.h"
+#include "jalls_file_copy.h"
 #include "jalls_msg.h"
 #include "jalls_handle_journal_fd.hpp"
 #include "jalls_handler.h"
 #include "jalls_record_utils.h"
 #include "jaldb_record_xml.h"
 
-#define JALLS_JOURNAL_BUF_LEN 8192
-
 extern "C" int jalls_handle_journal_fd(struct jalls_thread_context *thread_ctx, uint64_t data_len, uint64_t meta_len, int journal_fd)
 {
 	if (!thread_ctx || !(thread_ctx->ctx)) {
@@ -76,29 +74,6 @@ extern "C" int jalls_handle_journal_fd(struct jalls_thread_context *thread_ctx,
 	int app_meta_digest_len = 0;
 	char *app_meta_alg = NULL;
 
-	void *sha256_instance = NULL;
-
-	//get the payload, write it to the db file.
-	char data_buf[JALLS_JOURNAL_BUF_LEN];
-	memset(data_buf, 0, JALLS_JOURNAL_BUF_LEN);
-
-	struct iovec iov[1];
-	iov[0].iov_base = data_buf;
-	iov[0].iov_len = JALLS_JOURNAL_BUF_LEN;
-
-	struct msghdr msgh;
-	memset(&msgh, 0, sizeof(msgh));
-
-	msgh.msg_iov = iov;
-	msgh.msg_iovlen = 1;
-
-	//data_len should be the size of the file, and there should be no
-	//data or first break string
-	uint64_t bytes_remaining = data_len;
-	size_t bytes_to_read = JALLS_JOURNAL_BUF_LEN;
-	int bytes_written;
-	ssize_t bytes_read = 0;
-
 	int db_payload_fd = -1;
 	char *db_payload_path = NULL;
 	char *nonce = NULL;
@@ -110,10 +85,8 @@ extern "C" int jalls_handle_journal_fd(struct jalls_thread_context *thread_ctx,
 	}
 
 	//get a file from the db layer to write the journal data to.
-	uuid_t uuid;
-	uuid_generate(uuid);
-	jal_err = (enum jal_status)jaldb_create_file(thread_ctx->db_ctx->journal_root,
-			&db_payload_path, &db_payload_fd, uuid, JALDB_RTYPE_JOURNAL, JALDB_DTYPE_PAYLOAD);
+	jal_err = (enum jal_status)jaldb_create_journal_file(thread_ctx->db_ctx, data_len,
+			&db_payload_path, &db_payload_fd);
 	if (jal_err != JAL_OK) {
 		if (debug) {
 			fprintf(stderr, "could not create a file to store journal data\n");
@@ -121,58 +94,20 @@ extern "C" int jalls_handle_journal_fd(struct jalls_thread_context *thread_ctx,
 		goto err_out;
 	}
 
-	//digest and write the file
+	//copy the file into the db, digesting each chunk as it is written.
+	//data_len should be the size of the file, and there should be no
+	//data or first break string
 	digest_ctx = jal_sha256_ctx_create();
-	sha256_instance = digest_ctx->create();
 	digest = (uint8_t *)jal_malloc(digest_ctx->len);
-	jal_err = digest_ctx->init(sha256_instance);
-	if(jal_err != JAL_OK) {
+	if (0 != jalls_copy_file(journal_fd, db_payload_fd, data_len, digest_ctx,
+				digest, debug)) {
 		if (debug) {
-			fprintf(stderr, "could not init sha256 digest context\n");
+			fprintf(stderr, "could not copy journal to file\n");
 		}
 		goto err_out;
 	}
-
-	if ((off_t) -1 == lseek(journal_fd, 0, SEEK_SET)) {
-		if (debug) {
-			fprintf(stderr, "failed to reset journal file to the beginning\n");
-		}
-	}
-	while (bytes_remaining > 0) {
-		bytes_to_read = (bytes_remaining < JALLS_JOURNAL_BUF_LEN) ? bytes_remaining : JALLS_JOURNAL_BUF_LEN;
-		bytes_read = read(journal_fd, data_buf, bytes_to_read);
-		if (bytes_read < 0) {
-			if (debug) {
-				fprintf(stderr, "failed to read from file descriptor\n");
-			}
-			goto err_out;
-		}
-		jal_err = digest_ctx->update(sha256_instance, (uint8_t *)data_buf, bytes_read);
-		if (jal_err != JAL_OK) {
-			if (debug) {
-				fprintf(stderr, "could not digest the journal data\n");
-			}
-			goto err_out;
-		}
-		bytes_written = write(db_payload_fd, data_buf, bytes_read);
-		if (bytes_written < 0) {
-			if (debug) {
-				fprintf(stderr, "could not write journal to file");
-			}
-			goto err_out;
-		}
-		bytes_remaining -= (uint64_t)bytes_read;
-	}
-
 	size_t digest_length;
 	digest_length = digest_ctx->len;
-	jal_err = digest_ctx->final(sha256_instance, digest, &digest_length);
-	if(jal_err != JAL_OK) {
-		if (debug) {
-			fprintf(stderr, "could not digest the journal\n");
-		}
-		goto err_out;
-	}
 
 	//get the app_metadata
 	if (meta_len) {
@@ -222,21 +157,13 @@ extern "C" int jalls_handle_journal_fd(struct jalls_thread_context *thread_ctx,
 	rec->source = jal_strdup("localhost");
 
 	if (thread_ctx->ctx->manifest_sys_meta) {
-		if (rec->payload) {
-			if (rec->payload->on_disk) {
-				err = jal_digest_fd(digest_ctx, rec->payload->fd, &payload_digest);
-			} else {
-				err = jal_digest_buffer(digest_ctx, rec->payload->payload, rec->payload->length, &payload_digest);
-			}
-			if (JAL_OK != err) {
-				if (debug) {
-					fprintf(stderr, "Failed to calculate digest for record payload\n");
-				}
-				goto err_out;
-			}
-			payload_digest_len = digest_ctx->len;
-			payload_alg = jal_strdup(digest_ctx->algorithm_uri); 
-		}
+		// The payload was already run through the digest while it was
+		// written to disk, so hand that digest off rather than reading
+		// the whole file back in.
+		payload_digest = digest;
+		digest = NULL;
+		payload_digest_len = digest_length;
+		payload_alg = jal_strdup(digest_ctx->algorithm_uri);
 
 		if (rec->app_meta) {
 			err = jal_digest_buffer(digest_ctx, rec->app_meta->payload, rec->app_meta->length, &app_meta_digest);
@@ -291,10 +218,7 @@ err_out:
 	nonce = NULL;
 	close(journal_fd);
 	free(app_meta_buf);
-	if (digest_ctx) {
-		digest_ctx->destroy(sha256_instance);
-		jal_digest_ctx_destroy(&digest_ctx);
-	}
+	jal_digest_ctx_destroy(&digest_ctx);
 	free(digest);
 	jaldb_destroy_record(&rec);
 	free(app_meta_digest);
@@ -33,6 +33,7 @@
 #include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
@@ -42,23 +43,249 @@
 #include <ucred.h>
 #endif
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
 #include "jal_alloc.h"
 #include "jalls_msg.h"
 #include "jalls_handler.h"
 #include "jalls_handle_journal.hpp"
 #include "jalls_handle_log.hpp"
 #include "jalls_handle_audit.hpp"
+#include "jalls_handle_batch.hpp"
 #include "jalls_handle_journal_fd.hpp"
+#include "jalls_record_utils.h"
 
-#define JALLS_LOG_MSG 1
-#define JALLS_AUDIT_MSG 2
-#define JALLS_JOURNAL_MSG 3
-#define JALLS_JOURNAL_FD_MSG 4
-#define JALLS_BREAK_STRING "BREAK"
-#define JALLS_BREAK_LEN 5
+#define JALLS_MAX_EVENTS 64
 
 volatile int should_exit;
 
+/**
+ * Read the credentials and security label of the peer of a connection.
+ * These can't change while the socket is connected, so this is only done
+ * for the first message.
+ */
+static void jalls_get_peer_info(struct jalls_thread_context *thread_ctx, int debug)
+{
+	pid_t *pid = NULL;
+	uid_t *uid = NULL;
+
+#ifdef SO_PEERCRED
+	struct ucred cred;
+	memset(&cred, 0, sizeof(cred));
+	pid = &cred.pid;
+	uid = &cred.uid;
+	*pid = -1;
+	*uid = 0;
+	socklen_t cred_len = sizeof(cred);
+	if (-1 == getsockopt(thread_ctx->fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len)) {
+		if (debug) {
+			fprintf(stderr, "failed receiving peer crendentials\n");
+		}
+	}
+#endif
+#ifdef SCM_UCRED
+	ucred_t *cred = NULL;
+	pid_t tmp_pid = -1;
+	uid_t tmp_uid = 0;
+	pid = &tmp_pid;
+	uid = &tmp_uid;
+	if (-1 == getpeerucred(thread_ctx->fd, &cred)) {
+		if (debug) {
+			fprintf(stderr, "failed receiving peer credentials\n");
+		}
+	} else {
+		tmp_pid = ucred_getpid(cred);
+		tmp_uid = ucred_geteuid(cred);
+		ucred_free(cred);
+	}
+#endif
+
+	thread_ctx->peer_pid = *pid;
+	thread_ctx->peer_uid = *uid;
+	if (debug && *pid == -1) {
+		thread_ctx->peer_pid = 0;
+		thread_ctx->peer_uid = 0;
+
+		fprintf(stderr, "Did not receive credentials\n");
+	}
+	thread_ctx->peer_sec_lbl = jalls_get_security_label(thread_ctx->fd);
+	thread_ctx->have_peer_info = 1;
+}
+
+static void jalls_close_connection(struct jalls_thread_context *thread_ctx)
+{
+	close(thread_ctx->fd);
+	free(thread_ctx->peer_username);
+	free(thread_ctx->peer_sec_lbl);
+	free(thread_ctx);
+}
+
+/**
+ * Take the fd sent with a message header from the ancillary data of \p msgh.
+ *
+ * @return 0 on success, or -1 if the ancillary data is not a single fd.
+ */
+static int jalls_recv_fd(struct msghdr *msgh, int *msg_fd, int debug)
+{
+	struct cmsghdr *cmsg;
+	cmsg = CMSG_FIRSTHDR(msgh);
+	while (cmsg != NULL) {
+		if (cmsg->cmsg_level == SOL_SOCKET) {
+			if (cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(*msg_fd))) {
+				void *tmp_fd = CMSG_DATA(cmsg);
+				if (debug && *msg_fd != -1) {
+					fprintf(stderr, "received duplicate ancillary data: overwrote the fd\n");
+				}
+				*msg_fd = *((int *)tmp_fd);
+				if (*msg_fd < 0) {
+					if (debug) {
+						fprintf(stderr, "received an fd < 0\n");
+					}
+					return -1;
+				}
+			} else {
+				if (debug) {
+					fprintf(stderr, "received unrecognized ancillary data\n");
+				}
+				return -1;
+			}
+		}
+		cmsg = CMSG_NXTHDR(msgh, cmsg);
+	}
+	return 0;
+}
+
+/**
+ * Handle a message whose header was already received: call handle_audit()
+ * handle_log(), handle_journal(), handle_journal_fd(), or handle_batch(),
+ * depending on the message type.
+ */
+static int jalls_dispatch_message(struct jalls_thread_context *thread_ctx,
+		uint16_t protocol_version, uint16_t message_type,
+		uint64_t data_len, uint64_t meta_len, int msg_fd)
+{
+	int debug = thread_ctx->ctx->debug;
+	int err;
+
+	if (msg_fd >= 0 && message_type != JALLS_JOURNAL_FD_MSG) {
+		if (debug) {
+			fprintf(stderr, "received an fd for a message type that was not journal_fd\n");
+		}
+		return -1;
+	}
+
+	if (!thread_ctx->have_peer_info) {
+		jalls_get_peer_info(thread_ctx, debug);
+	}
+
+	if (protocol_version == JALLS_BATCH_PROTOCOL_VERSION) {
+		if (message_type != JALLS_BATCH_MSG) {
+			if (debug) {
+				fprintf(stderr, "received a version 2 message that is not a batch\n");
+			}
+			return -1;
+		}
+		err = jalls_handle_batch(thread_ctx, data_len, meta_len);
+		return (err < 0) ? -1 : 0;
+	}
+
+	if (protocol_version != JALLS_PROTOCOL_VERSION) {
+		if (debug) {
+			fprintf(stderr, "received protocol version != 1\n");
+		}
+		return -1;
+	}
+
+	//call appropriate handler
+	switch (message_type) {
+		case JALLS_LOG_MSG:
+			err = jalls_handle_log(thread_ctx, data_len, meta_len);
+			break;
+		case JALLS_AUDIT_MSG:
+			err = jalls_handle_audit(thread_ctx, data_len, meta_len);
+			break;
+		case JALLS_JOURNAL_MSG:
+			err = jalls_handle_journal(thread_ctx, data_len, meta_len);
+			break;
+		case JALLS_JOURNAL_FD_MSG:
+			if (msg_fd < 0) {
+				if (debug) {
+					fprintf(stderr, "Message type is journal_fd, but no fd was received\n");
+				}
+				return -1;
+			}
+			err = jalls_handle_journal_fd(thread_ctx, data_len, meta_len, msg_fd);
+			break;
+		default:
+			if (debug) {
+				fprintf(stderr, "Message type is not legal.\n");
+			}
+			return -1;
+	}
+	if (err < 0) {
+		return -1;
+	}
+	return 0;
+}
+
+int jalls_handle_message(struct jalls_thread_context *thread_ctx)
+{
+	int debug = thread_ctx->ctx->debug;
+
+	// read protocol version, message type, data length,
+	// metadata length and possible fd.
+	uint16_t protocol_version;
+	uint16_t message_type;
+	uint64_t data_len;
+	uint64_t meta_len;
+	int msg_fd = -1;
+
+	struct msghdr msgh;
+	memset(&msgh, 0, sizeof(msgh));
+
+	struct iovec iov[4];
+	iov[0].iov_base = &protocol_version;
+	iov[0].iov_len = sizeof(protocol_version);
+	iov[1].iov_base = &message_type;
+	iov[1].iov_len = sizeof(message_type);
+	iov[2].iov_base = &data_len;
+	iov[2].iov_len = sizeof(data_len);
+	iov[3].iov_base = &meta_len;
+	iov[3].iov_len = sizeof(meta_len);
+
+	msgh.msg_iov = iov;
+	msgh.msg_iovlen = 4;
+
+	char msg_control_buffer[CMSG_SPACE(sizeof(msg_fd))];
+
+	msgh.msg_control = msg_control_buffer;
+	msgh.msg_controllen = sizeof(msg_control_buffer);
+
+	ssize_t bytes_recv = jalls_recvmsg_helper(thread_ctx->fd, &msgh, debug);
+	if (bytes_recv < 0) {
+		if (debug) {
+			fprintf(stderr, "Failed to receive the message header\n");
+		}
+		return -1;
+	}
+	if (bytes_recv == 0) {
+		if (debug) {
+			fprintf(stderr, "The peer has shutdown\n");
+		}
+		return -1;
+	}
+
+	//receive fd
+	if (0 != jalls_recv_fd(&msgh, &msg_fd, debug)) {
+		return -1;
+	}
+
+	return jalls_dispatch_message(thread_ctx, protocol_version, message_type,
+			data_len, meta_len, msg_fd);
+}
+
 void *jalls_handler(void *thread_ctx_p) {
 	if (!thread_ctx_p) {
 		return NULL; //should never happen.
@@ -66,8 +293,6 @@ void *jalls_handler(void *thread_ctx_p) {
 
 	struct jalls_thread_context *thread_ctx = NULL;
 	thread_ctx = thread_ctx_p;
-	pid_t *pid = NULL;
-	uid_t *uid = NULL;
 	int debug = thread_ctx->ctx->debug;
 	int err = pthread_detach(pthread_self());
 	if (err < 0) {
@@ -78,166 +303,371 @@ void *jalls_handler(void *thread_ctx_p) {
 	}
 
 	while (!should_exit) {
+		if (0 != jalls_handle_message(thread_ctx)) {
+			goto out;
+		}
+	}
 
-		// read protocol version, message type, data length,
-		// metadata length and possible fd.
-		uint16_t protocol_version;
-		uint16_t message_type;
-		uint64_t data_len;
-		uint64_t meta_len;
-		int msg_fd = -1;
+out:
+	jalls_close_connection(thread_ctx);
+	return NULL;
+}
 
-		struct msghdr msgh;
-		memset(&msgh, 0, sizeof(msgh));
+#ifdef __linux__
+/** The size of a message header: the protocol version, the message type,
+ * the data length and the metadata length. */
+#define JALLS_HEADER_LEN (2 * sizeof(uint16_t) + 2 * sizeof(uint64_t))
+
+/**
+ * A connection handled by the worker pool. The event loop reads the message
+ * header into \p hdr without blocking, and only hands the connection to a
+ * worker once all of it has arrived, so a producer that stalls part way
+ * through a header does not hold a worker.
+ */
+struct jalls_connection {
+	struct jalls_thread_context *thread_ctx;
+	uint8_t hdr[JALLS_HEADER_LEN];		//!< The part of the header received so far.
+	size_t hdr_len;				//!< The number of bytes in hdr.
+	int msg_fd;				//!< The fd sent with the header, or -1.
+	struct jalls_connection *prev;
+	struct jalls_connection *next;
+};
+
+/** A bounded queue of connections with a complete message header waiting. */
+struct jalls_worker_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	struct jalls_connection **queue;
+	size_t queue_size;
+	size_t head;
+	size_t count;
+	struct jalls_connection *conns;		//!< Every open connection, to close at shutdown.
+	pthread_t *workers;
+	int num_workers;
+	int epoll_fd;
+	int shutdown;
+};
+
+static void jalls_worker_pool_push(struct jalls_worker_pool *pool,
+		struct jalls_connection *conn)
+{
+	pthread_mutex_lock(&pool->lock);
+	// Block the event loop when every worker is busy and the queue is
+	// full. New connections then back up in the listen queue and data from
+	// producers backs up in the socket buffers.
+	while (pool->count == pool->queue_size && !pool->shutdown) {
+		pthread_cond_wait(&pool->not_full, &pool->lock);
+	}
+	if (!pool->shutdown) {
+		pool->queue[(pool->head + pool->count) % pool->queue_size] = conn;
+		pool->count++;
+		pthread_cond_signal(&pool->not_empty);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
 
-		struct iovec iov[4];
-		iov[0].iov_base = &protocol_version;
-		iov[0].iov_len = sizeof(protocol_version);
-		iov[1].iov_base = &message_type;
-		iov[1].iov_len = sizeof(message_type);
-		iov[2].iov_base = &data_len;
-		iov[2].iov_len = sizeof(data_len);
-		iov[3].iov_base = &meta_len;
-		iov[3].iov_len = sizeof(meta_len);
+static struct jalls_connection *jalls_worker_pool_pop(struct jalls_worker_pool *pool)
+{
+	struct jalls_connection *conn = NULL;
+	pthread_mutex_lock(&pool->lock);
+	while (pool->count == 0 && !pool->shutdown) {
+		pthread_cond_wait(&pool->not_empty, &pool->lock);
+	}
+	if (pool->count > 0 && !pool->shutdown) {
+		conn = pool->queue[pool->head];
+		pool->head = (pool->head + 1) % pool->queue_size;
+		pool->count--;
+		pthread_cond_signal(&pool->not_full);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return conn;
+}
 
-		msgh.msg_iov = iov;
-		msgh.msg_iovlen = 4;
+static int jalls_watch_connection(int epoll_fd, struct jalls_connection *conn, int op)
+{
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	// One shot, so that only one thread at a time handles a connection.
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.ptr = conn;
+	return epoll_ctl(epoll_fd, op, conn->thread_ctx->fd, &ev);
+}
+
+static void jalls_pool_add_connection(struct jalls_worker_pool *pool,
+		struct jalls_connection *conn)
+{
+	pthread_mutex_lock(&pool->lock);
+	conn->next = pool->conns;
+	if (pool->conns) {
+		pool->conns->prev = conn;
+	}
+	pool->conns = conn;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void jalls_pool_close_connection(struct jalls_worker_pool *pool,
+		struct jalls_connection *conn)
+{
+	pthread_mutex_lock(&pool->lock);
+	if (conn->prev) {
+		conn->prev->next = conn->next;
+	} else {
+		pool->conns = conn->next;
+	}
+	if (conn->next) {
+		conn->next->prev = conn->prev;
+	}
+	pthread_mutex_unlock(&pool->lock);
+	if (conn->msg_fd >= 0) {
+		close(conn->msg_fd);
+	}
+	jalls_close_connection(conn->thread_ctx);
+	free(conn);
+}
 
-		char msg_control_buffer[CMSG_SPACE(sizeof(msg_fd))];
+/**
+ * Read as much of the next message header from \p conn as is available,
+ * without blocking.
+ *
+ * @return 1 if the header is complete, 0 if more of it has yet to arrive,
+ * or -1 if the peer shut down or an error occurred.
+ */
+static int jalls_read_header(struct jalls_connection *conn, int debug)
+{
+	while (conn->hdr_len < JALLS_HEADER_LEN) {
+		struct msghdr msgh;
+		struct iovec iov;
+		char msg_control_buffer[CMSG_SPACE(sizeof(conn->msg_fd))];
 
+		memset(&msgh, 0, sizeof(msgh));
+		iov.iov_base = conn->hdr + conn->hdr_len;
+		iov.iov_len = JALLS_HEADER_LEN - conn->hdr_len;
+		msgh.msg_iov = &iov;
+		msgh.msg_iovlen = 1;
 		msgh.msg_control = msg_control_buffer;
 		msgh.msg_controllen = sizeof(msg_control_buffer);
 
-#ifdef SO_PEERCRED
-		struct ucred cred;
-		memset(&cred, 0, sizeof(cred));
-		pid = &cred.pid;
-		uid = &cred.uid;
-		*pid = -1;
-		*uid = 0;
-		socklen_t cred_len = sizeof(cred);
-		if (-1 == getsockopt(thread_ctx->fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len)) {
-			if (debug) {
-				fprintf(stderr, "failed receiving peer crendentials\n");
+		ssize_t bytes_recv = recvmsg(conn->thread_ctx->fd, &msgh, MSG_DONTWAIT);
+		if (bytes_recv < 0) {
+			if (EINTR == errno) {
+				continue;
 			}
-		}
-#endif
-#ifdef SCM_UCRED
-		ucred_t *cred = NULL;
-		pid_t tmp_pid = -1;
-		uid_t tmp_uid = 0;
-		pid = &tmp_pid;
-		uid = &tmp_uid;
-		if (-1 == getpeerucred(thread_ctx->fd, &cred)) {
-			if (debug) {
-				fprintf(stderr, "failed receiving peer credentials\n");
+			if ((EAGAIN == errno) || (EWOULDBLOCK == errno)) {
+				return 0;
 			}
-		} else {
-			tmp_pid = ucred_getpid(cred);
-			tmp_uid = ucred_geteuid(cred);
-			ucred_free(cred);
-		}
-#endif
-		
-		ssize_t bytes_recv = jalls_recvmsg_helper(thread_ctx->fd, &msgh, debug);
-		if (bytes_recv < 0) {
 			if (debug) {
-				fprintf(stderr, "Failed to receive the message header\n");
+				fprintf(stderr, "Failed to receive the message header: %s\n",
+					strerror(errno));
 			}
-			goto out;
+			return -1;
 		}
 		if (bytes_recv == 0) {
 			if (debug) {
 				fprintf(stderr, "The peer has shutdown\n");
 			}
-			goto out;
+			return -1;
 		}
+		if (0 != jalls_recv_fd(&msgh, &conn->msg_fd, debug)) {
+			return -1;
+		}
+		conn->hdr_len += bytes_recv;
+	}
+	return 1;
+}
 
-		//receive fd
-		struct cmsghdr *cmsg;
-		cmsg = CMSG_FIRSTHDR(&msgh);
-		while (cmsg != NULL) {
-			if (cmsg->cmsg_level == SOL_SOCKET) {
-				if (cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(msg_fd))) {
-					if (message_type != JALLS_JOURNAL_FD_MSG) {
-						if (debug) {
-							fprintf(stderr, "received an fd for a message type that was not journal_fd\n");
-						}
-						goto out;
-					}
-					void *tmp_fd = CMSG_DATA(cmsg);
-					if (debug && msg_fd != -1) {
-						fprintf(stderr, "received duplicate ancillary data: overwrote the fd\n");
-					}
-					msg_fd = *((int *)tmp_fd);
-					if (msg_fd < 0) {
-						if (debug) {
-							fprintf(stderr, "received an fd < 0\n");
-						}
-						goto out;
-					}
-				} else {
-					if (debug) {
-						fprintf(stderr, "received unrecognized ancillary data\n");
-					}
-					goto out;
-				}
-			}
-			cmsg = CMSG_NXTHDR(&msgh, cmsg);
+static void *jalls_worker(void *pool_p)
+{
+	struct jalls_worker_pool *pool = pool_p;
+	struct jalls_connection *conn;
+
+	while ((conn = jalls_worker_pool_pop(pool))) {
+		uint16_t protocol_version;
+		uint16_t message_type;
+		uint64_t data_len;
+		uint64_t meta_len;
+		uint8_t *cur = conn->hdr;
+		int msg_fd = conn->msg_fd;
+
+		memcpy(&protocol_version, cur, sizeof(protocol_version));
+		cur += sizeof(protocol_version);
+		memcpy(&message_type, cur, sizeof(message_type));
+		cur += sizeof(message_type);
+		memcpy(&data_len, cur, sizeof(data_len));
+		cur += sizeof(data_len);
+		memcpy(&meta_len, cur, sizeof(meta_len));
+		conn->hdr_len = 0;
+		conn->msg_fd = -1;
+
+		if (0 != jalls_dispatch_message(conn->thread_ctx, protocol_version,
+					message_type, data_len, meta_len, msg_fd) ||
+				0 != jalls_watch_connection(pool->epoll_fd, conn, EPOLL_CTL_MOD)) {
+			jalls_pool_close_connection(pool, conn);
+		}
+	}
+	return NULL;
+}
+
+static void jalls_worker_pool_destroy(struct jalls_worker_pool *pool)
+{
+	struct jalls_connection *conn;
+	int i;
+
+	// Wake up workers that are blocked reading from a producer, and any
+	// that are waiting for work, and wait for them to finish.
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = 1;
+	for (conn = pool->conns; conn; conn = conn->next) {
+		shutdown(conn->thread_ctx->fd, SHUT_RDWR);
+	}
+	pthread_cond_broadcast(&pool->not_empty);
+	pthread_cond_broadcast(&pool->not_full);
+	pthread_mutex_unlock(&pool->lock);
+	for (i = 0; i < pool->num_workers; i++) {
+		pthread_join(pool->workers[i], NULL);
+	}
+
+	if (pool->epoll_fd >= 0) {
+		close(pool->epoll_fd);
+	}
+	while (pool->conns) {
+		jalls_pool_close_connection(pool, pool->conns);
+	}
+	pthread_cond_destroy(&pool->not_full);
+	pthread_cond_destroy(&pool->not_empty);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->workers);
+	free(pool->queue);
+	free(pool);
+}
+
+int jalls_event_loop(int sock, const struct jalls_thread_context *base_ctx,
+		int num_workers, int queue_size)
+{
+	struct epoll_event events[JALLS_MAX_EVENTS];
+	struct jalls_worker_pool *pool = NULL;
+	int debug;
+	int ret = -1;
+	int i;
+
+	if (sock < 0 || !base_ctx || !base_ctx->ctx || num_workers <= 0 || queue_size <= 0) {
+		return -1;
+	}
+	debug = base_ctx->ctx->debug;
+
+	pool = jal_calloc(1, sizeof(*pool));
+	pool->queue = jal_calloc(queue_size, sizeof(*pool->queue));
+	pool->queue_size = queue_size;
+	pool->workers = jal_calloc(num_workers, sizeof(*pool->workers));
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->not_empty, NULL);
+	pthread_cond_init(&pool->not_full, NULL);
+
+	pool->epoll_fd = epoll_create(JALLS_MAX_EVENTS);
+	if (pool->epoll_fd < 0) {
+		if (debug) {
+			fprintf(stderr, "Failed to create epoll fd: %s\n", strerror(errno));
 		}
+		goto out;
+	}
 
-		thread_ctx->peer_pid = *pid;
-		thread_ctx->peer_uid = *uid;
-		if (debug && *pid == -1) {
-			thread_ctx->peer_pid = 0;
-			thread_ctx->peer_uid = 0;
+	struct epoll_event listen_ev;
+	memset(&listen_ev, 0, sizeof(listen_ev));
+	listen_ev.events = EPOLLIN;
+	listen_ev.data.ptr = NULL;
+	if (0 != epoll_ctl(pool->epoll_fd, EPOLL_CTL_ADD, sock, &listen_ev)) {
+		if (debug) {
+			fprintf(stderr, "Failed to watch the socket: %s\n", strerror(errno));
+		}
+		goto out;
+	}
 
-			fprintf(stderr, "Did not receive credentials\n");
+	for (i = 0; i < num_workers; i++) {
+		if (0 != pthread_create(&pool->workers[i], NULL, jalls_worker, pool)) {
+			if (debug) {
+				fprintf(stderr, "Failed to create worker thread\n");
+			}
+			goto out;
 		}
+		pool->num_workers++;
+	}
 
-		if (protocol_version != 1) {
+	while (!should_exit) {
+		int n = epoll_wait(pool->epoll_fd, events, JALLS_MAX_EVENTS, -1);
+		if (n < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
 			if (debug) {
-				fprintf(stderr, "received protocol version != 1\n");
+				fprintf(stderr, "epoll_wait failed: %s\n", strerror(errno));
 			}
-			return NULL;
+			goto out;
 		}
+		for (i = 0; i < n; i++) {
+			struct jalls_connection *conn = events[i].data.ptr;
+			if (conn) {
+				int rc = jalls_read_header(conn, debug);
+				if (1 == rc) {
+					jalls_worker_pool_push(pool, conn);
+				} else if (0 != rc ||
+						0 != jalls_watch_connection(pool->epoll_fd, conn, EPOLL_CTL_MOD)) {
+					jalls_pool_close_connection(pool, conn);
+				}
+				continue;
+			}
 
-		//call appropriate handler
-		switch (message_type) {
-			case JALLS_LOG_MSG:
-				err = jalls_handle_log(thread_ctx, data_len, meta_len);
-				break;
-			case JALLS_AUDIT_MSG:
-				err = jalls_handle_audit(thread_ctx, data_len, meta_len);
-				break;
-			case JALLS_JOURNAL_MSG:
-				err = jalls_handle_journal(thread_ctx, data_len, meta_len);
-				break;
-			case JALLS_JOURNAL_FD_MSG:
-				if (msg_fd < 0) {
-					if (debug) {
-						fprintf(stderr, "Message type is journal_fd, but no fd was received\n");
-					}
-					goto out;
+			int fd = accept(sock, NULL, NULL);
+			if (fd < 0) {
+				if (debug) {
+					fprintf(stderr, "Failed to accept: %s\n", strerror(errno));
+				}
+				continue;
+			}
+			// Once a worker has the header, it blocks reading the
+			// rest of the message. Limit how long a producer that
+			// stalls can hold it.
+			if (base_ctx->ctx->worker_recv_timeout > 0) {
+				struct timeval tv;
+				tv.tv_sec = base_ctx->ctx->worker_recv_timeout;
+				tv.tv_usec = 0;
+				if (0 != setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) && debug) {
+					fprintf(stderr, "Failed to set the receive timeout: %s\n", strerror(errno));
 				}
-				err = jalls_handle_journal_fd(thread_ctx, data_len, meta_len, msg_fd);
-				break;
-			default:
+			}
+			conn = jal_calloc(1, sizeof(*conn));
+			conn->msg_fd = -1;
+			conn->thread_ctx = jal_malloc(sizeof(*conn->thread_ctx));
+			memcpy(conn->thread_ctx, base_ctx, sizeof(*conn->thread_ctx));
+			conn->thread_ctx->fd = fd;
+			jalls_pool_add_connection(pool, conn);
+			if (0 != jalls_watch_connection(pool->epoll_fd, conn, EPOLL_CTL_ADD)) {
 				if (debug) {
-					fprintf(stderr, "Message type is not legal.\n");
+					fprintf(stderr, "Failed to watch connection: %s\n", strerror(errno));
 				}
-				goto out;
-		}
-		if (err < 0) {
-			goto out;
+				jalls_pool_close_connection(pool, conn);
+			}
 		}
 	}
+	ret = 0;
 
 out:
-	close(thread_ctx->fd);
-	free(thread_ctx);
-	return NULL;
+	// Stop the workers before returning, so the caller may destroy the
+	// DB context they use.
+	jalls_worker_pool_destroy(pool);
+	return ret;
+}
+#else /* no __linux__ */
+int jalls_event_loop(__attribute__((unused)) int sock,
+		const struct jalls_thread_context *base_ctx,
+		__attribute__((unused)) int num_workers,
+		__attribute__((unused)) int queue_size)
+{
+	if (base_ctx->ctx->debug) {
+		fprintf(stderr, "A fixed worker pool is not supported on this platform\n");
+	}
+	return -1;
 }
+#endif /* __linux__ */
 
 int jalls_handle_app_meta(uint8_t **app_meta_buf, size_t app_meta_len, int fd, int debug) {
 
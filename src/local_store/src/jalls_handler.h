@@ -38,6 +38,31 @@
 extern "C" {
 #endif
 
+/**
+ * The version of the protocol for a single record. A producer sends a
+ * header of the protocol version, the message type, the data length and
+ * the metadata length, then the data, a BREAK, the application metadata
+ * and another BREAK.
+ */
+#define JALLS_PROTOCOL_VERSION 1
+
+/**
+ * The version of the protocol for a batch of records. The header is the
+ * same as for a single record, with JALLS_BATCH_MSG as the message type,
+ * the number of records as the data length and the length of the rest of
+ * the message as the metadata length. Each record follows as a complete
+ * version 1 log or audit message.
+ */
+#define JALLS_BATCH_PROTOCOL_VERSION 2
+
+#define JALLS_LOG_MSG 1
+#define JALLS_AUDIT_MSG 2
+#define JALLS_JOURNAL_MSG 3
+#define JALLS_JOURNAL_FD_MSG 4
+#define JALLS_BATCH_MSG 5
+#define JALLS_BREAK_STRING "BREAK"
+#define JALLS_BREAK_LEN 5
+
 /**
  * Waits for data to become available on the domain socket. When data appears,
  * calls handle_audit() handle_log(), handle_journal(), or handle_journal_fd(),
@@ -49,6 +74,46 @@ extern "C" {
 */
 void *jalls_handler(void *thread_ctx);
 
+/**
+ * Receive and handle a single message from a producer: read the message
+ * header, then call handle_audit() handle_log(), handle_journal(),
+ * handle_journal_fd(), or handle_batch(), depending on the message type.
+ *
+ * @param[in] thread_ctx The context for the connection to read from.
+ *
+ * @return 0 if the message was handled and the connection may be used for
+ * another message, or -1 if the peer shut down or an error occurred and the
+ * connection should be closed.
+ */
+int jalls_handle_message(struct jalls_thread_context *thread_ctx);
+
+/**
+ * Accept connections on \p sock and handle their messages with a fixed pool
+ * of worker threads, instead of a thread per connection.
+ *
+ * An epoll loop waits for connections to become readable and reads the
+ * message headers without blocking. Once the whole header of a message has
+ * arrived, the connection is queued for the workers, which receive and
+ * handle the rest of the message. A worker gives up on a producer that sends
+ * nothing for worker_recv_timeout seconds. When all workers are busy and
+ * \p queue_size connections are waiting, the loop stops reading from the
+ * socket until a worker frees up.
+ *
+ * Returns once should_exit is set, after the workers have stopped and every
+ * connection has been closed.
+ *
+ * @param[in] sock The listening socket.
+ * @param[in] base_ctx The keys, configuration and DB context to copy into
+ * the context of each accepted connection.
+ * @param[in] num_workers The number of worker threads.
+ * @param[in] queue_size The number of ready connections that may wait for a
+ * worker.
+ *
+ * @return 0 on a clean shutdown, -1 on error.
+ */
+int jalls_event_loop(int sock, const struct jalls_thread_context *base_ctx,
+		int num_workers, int queue_size);
+
 int jalls_handle_app_meta(uint8_t **app_meta_buf, size_t app_meta_len, int fd, int debug);
 
 int jalls_handle_break(int fd);
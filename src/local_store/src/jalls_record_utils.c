@@ -31,15 +31,60 @@
 #include "jalls_record_utils.h"
 #include "jaldb_utils.h"
 
+#include <pthread.h>
 #include <pwd.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #ifdef __HAVE_SELINUX
 #include <selinux/selinux.h>
 #endif
 
-char *jalls_get_user_id_str(uid_t uid)
+/* The number of usernames jalls_get_user_id_str() remembers. */
+#define JALLS_UID_CACHE_SIZE 256
+
+/*
+ * The username cache is direct mapped: a UID can only be in the slot at
+ * uid % JALLS_UID_CACHE_SIZE, and replaces whatever was there.
+ */
+struct jalls_uid_cache_entry {
+	uid_t uid;
+	char *name;      // NULL if the slot is unused
+	time_t expires;  // in seconds of CLOCK_MONOTONIC
+};
+
+static struct jalls_uid_cache_entry uid_cache[JALLS_UID_CACHE_SIZE];
+static pthread_mutex_t uid_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static long long int uid_cache_ttl = JALLS_UID_CACHE_TTL_DEFAULT;
+
+static time_t jalls_uid_cache_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec;
+}
+
+void jalls_set_uid_cache_ttl(long long int ttl)
+{
+	pthread_mutex_lock(&uid_cache_lock);
+	uid_cache_ttl = (ttl < 0) ? 0 : ttl;
+	pthread_mutex_unlock(&uid_cache_lock);
+	jalls_clear_uid_cache();
+}
+
+void jalls_clear_uid_cache(void)
+{
+	int i;
+	pthread_mutex_lock(&uid_cache_lock);
+	for (i = 0; i < JALLS_UID_CACHE_SIZE; i++) {
+		free(uid_cache[i].name);
+		uid_cache[i].name = NULL;
+	}
+	pthread_mutex_unlock(&uid_cache_lock);
+}
+
+static char *jalls_lookup_user_id_str(uid_t uid)
 {
 	char *ret = NULL;
 	char *pwd_buf = NULL;
@@ -64,6 +109,42 @@ cleanup:
 	return ret;
 }
 
+char *jalls_get_user_id_str(uid_t uid)
+{
+	struct jalls_uid_cache_entry *entry = &uid_cache[uid % JALLS_UID_CACHE_SIZE];
+	char *ret = NULL;
+	time_t now;
+	long long int ttl;
+
+	pthread_mutex_lock(&uid_cache_lock);
+	now = jalls_uid_cache_now();
+	ttl = uid_cache_ttl;
+	if (entry->name && entry->uid == uid && now < entry->expires) {
+		ret = jal_strdup(entry->name);
+	}
+	pthread_mutex_unlock(&uid_cache_lock);
+	if (ret) {
+		return ret;
+	}
+
+	// The lookup may block for a while, so it is done without the lock.
+	// Failures aren't cached; the next record tries again.
+	ret = jalls_lookup_user_id_str(uid);
+	if (!ret || 0 == ttl) {
+		return ret;
+	}
+
+	pthread_mutex_lock(&uid_cache_lock);
+	if (0 != uid_cache_ttl) {
+		free(entry->name);
+		entry->uid = uid;
+		entry->name = jal_strdup(ret);
+		entry->expires = now + uid_cache_ttl;
+	}
+	pthread_mutex_unlock(&uid_cache_lock);
+	return ret;
+}
+
 char *jalls_get_security_label(int socketFd)
 {
 #ifdef __HAVE_SELINUX
@@ -102,14 +183,19 @@ int jalls_create_record(enum jaldb_rec_type rec_type, struct jalls_thread_contex
 	rec->uid = thread_ctx->peer_uid;
 	rec->hostname = jal_strdup(thread_ctx->ctx->hostname);
 	rec->timestamp = timestamp;
-	rec->username = jalls_get_user_id_str(thread_ctx->peer_uid);
-	rec->sec_lbl = jalls_get_security_label(thread_ctx->fd);
-	uuid_copy(rec->host_uuid, thread_ctx->ctx->system_uuid);
-	uuid_generate(rec->uuid);
-	if (rec->username == NULL) {
+	if (!thread_ctx->peer_username) {
+		thread_ctx->peer_username = jalls_get_user_id_str(thread_ctx->peer_uid);
+	}
+	if (thread_ctx->peer_username == NULL) {
 		jaldb_destroy_record(&rec);
-		return -1;	
+		return -1;
+	}
+	rec->username = jal_strdup(thread_ctx->peer_username);
+	if (thread_ctx->peer_sec_lbl) {
+		rec->sec_lbl = jal_strdup(thread_ctx->peer_sec_lbl);
 	}
+	uuid_copy(rec->host_uuid, thread_ctx->ctx->system_uuid);
+	uuid_generate(rec->uuid);
 
 	*prec = rec;
 	return 0;
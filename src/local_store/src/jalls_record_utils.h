@@ -38,26 +38,50 @@
 extern "C" {
 #endif
 
+/**
+ * How long, in seconds, jalls_get_user_id_str() remembers the username of a
+ * UID by default.
+ */
+#define JALLS_UID_CACHE_TTL_DEFAULT 300
+
 /**
  * Helper utility to obtain the username for a given UID.
  *
+ * Usernames are cached for the whole process, so most calls don't have to
+ * go to the name service, which may be a remote directory. The cache holds
+ * a bounded number of entries, and each is looked up again once it is
+ * older than the TTL set with jalls_set_uid_cache_ttl().
+ *
  * @return NULL if an error occurred, a string otherwise. The caller is
  * responsible for freeing the returned string.
  */
 char *jalls_get_user_id_str(uid_t uid);
 
-#ifdef __HAVE_SELINUX
 /**
- * Retrieve the platform specific security label.
+ * Set how long jalls_get_user_id_str() may use a cached username.
+ *
+ * @param[in] ttl The time in seconds; 0 turns off the cache.
+ */
+void jalls_set_uid_cache_ttl(long long int ttl);
+
+/**
+ * Empty the cache of jalls_get_user_id_str().
+ */
+void jalls_clear_uid_cache(void);
+
+/**
+ * Retrieve the platform specific security label. This always returns NULL
+ * if SELinux support is not compiled in.
  * @param[in] socketFd the file descriptor to use when obtaining the security
  * label.
  */
 char *jalls_get_security_label(int socketFd);
-#endif
 
 /**
  * Helper utility to create a record.
  *
+ * The username of the peer is looked up for the first record of a
+ * connection and kept in \p thread_ctx for the ones after it.
  */
 int jalls_create_record(enum jaldb_rec_type rec_type,
 			struct jalls_thread_context *thread_ctx,
@@ -0,0 +1,238 @@
+/**
+ * @file test_jalls_file_copy.c This file contains tests for the function that
+ * copy and digest journal files for the jal local store.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <test-dept.h>
+
+#include <jalop/jal_digest.h>
+
+#include "jal_alloc.h"
+#include "jalls_file_copy.h"
+
+#define TEST_DATA_LEN ((3 * 256 * 1024) + 17)
+
+static uint8_t *test_data;
+static int src_fd;
+static int dst_fd;
+static struct jal_digest_ctx *digest_ctx;
+static uint8_t *digest;
+
+static int make_temp_file(void)
+{
+	char path[] = "/tmp/test_jalls_file_copy.XXXXXX";
+	int fd = mkstemp(path);
+	unlink(path);
+	return fd;
+}
+
+static uint8_t *read_file(int fd, size_t len)
+{
+	uint8_t *buf = (uint8_t *)jal_malloc(len + 1);
+	ssize_t bytes = pread(fd, buf, len + 1, 0);
+	if (bytes != (ssize_t)len) {
+		free(buf);
+		return NULL;
+	}
+	return buf;
+}
+
+static void assert_copied(int fd, size_t len)
+{
+	uint8_t *expected = NULL;
+	uint8_t *copy = read_file(fd, len);
+	assert_not_equals((void *)NULL, copy);
+	assert_equals(0, memcmp(test_data, copy, len));
+	free(copy);
+
+	assert_equals(JAL_OK, jal_digest_buffer(digest_ctx, test_data, len, &expected));
+	assert_equals(0, memcmp(expected, digest, digest_ctx->len));
+	free(expected);
+}
+
+static ssize_t read_one_byte_short(int fd, void *buf, size_t count)
+{
+	// Force reads to come back short, the way pipes and sockets do.
+	return (count > 1) ? read(fd, buf, count - 1) : read(fd, buf, count);
+}
+
+static int fail_ioctl(__attribute__((unused)) int fd,
+		__attribute__((unused)) unsigned long request, ...)
+{
+	errno = EOPNOTSUPP;
+	return -1;
+}
+
+static long fail_syscall(__attribute__((unused)) long number, ...)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+static ssize_t fail_sendfile(__attribute__((unused)) int out_fd,
+		__attribute__((unused)) int in_fd,
+		__attribute__((unused)) off_t *offset,
+		__attribute__((unused)) size_t count)
+{
+	errno = EINVAL;
+	return -1;
+}
+
+static int sendfile_calls;
+static ssize_t sendfile_once(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+	// Copy part of the file, then fail the way a filesystem without
+	// support for it would.
+	if (sendfile_calls++ > 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	return sendfile(out_fd, in_fd, offset, (count > 1000) ? 1000 : count);
+}
+
+static void disable_kernel_copy(void)
+{
+	replace_function(ioctl, fail_ioctl);
+	replace_function(syscall, fail_syscall);
+	replace_function(sendfile, fail_sendfile);
+}
+
+void setup()
+{
+	size_t i;
+	test_data = (uint8_t *)jal_malloc(TEST_DATA_LEN);
+	for (i = 0; i < TEST_DATA_LEN; i++) {
+		test_data[i] = (uint8_t)(i * 31);
+	}
+	src_fd = make_temp_file();
+	dst_fd = make_temp_file();
+	assert_equals(TEST_DATA_LEN, write(src_fd, test_data, TEST_DATA_LEN));
+	digest_ctx = jal_sha256_ctx_create();
+	digest = (uint8_t *)jal_malloc(digest_ctx->len);
+	sendfile_calls = 0;
+}
+
+void teardown()
+{
+	restore_function(read);
+	restore_function(ioctl);
+	restore_function(syscall);
+	restore_function(sendfile);
+	close(src_fd);
+	close(dst_fd);
+	free(test_data);
+	free(digest);
+	jal_digest_ctx_destroy(&digest_ctx);
+}
+
+void test_jalls_copy_file_copies_and_digests_whole_file()
+{
+	assert_equals(0, jalls_copy_file(src_fd, dst_fd, TEST_DATA_LEN, digest_ctx, digest, 0));
+	assert_equals(TEST_DATA_LEN, lseek(dst_fd, 0, SEEK_CUR));
+	assert_copied(dst_fd, TEST_DATA_LEN);
+}
+
+void test_jalls_copy_file_copies_leading_part_of_file()
+{
+	assert_equals(0, jalls_copy_file(src_fd, dst_fd, TEST_DATA_LEN - 17, digest_ctx, digest, 0));
+	assert_copied(dst_fd, TEST_DATA_LEN - 17);
+}
+
+void test_jalls_copy_file_copies_without_kernel_copy()
+{
+	disable_kernel_copy();
+	assert_equals(0, jalls_copy_file(src_fd, dst_fd, TEST_DATA_LEN, digest_ctx, digest, 0));
+	assert_equals(TEST_DATA_LEN, lseek(dst_fd, 0, SEEK_CUR));
+	assert_copied(dst_fd, TEST_DATA_LEN);
+}
+
+void test_jalls_copy_file_finishes_partial_kernel_copy()
+{
+	replace_function(ioctl, fail_ioctl);
+	replace_function(syscall, fail_syscall);
+	replace_function(sendfile, sendfile_once);
+	assert_equals(0, jalls_copy_file(src_fd, dst_fd, TEST_DATA_LEN, digest_ctx, digest, 0));
+	assert_equals(2, sendfile_calls);
+	assert_copied(dst_fd, TEST_DATA_LEN);
+}
+
+void test_jalls_copy_file_digests_only_the_copied_part_of_destination()
+{
+	uint8_t *expected = NULL;
+	uint8_t *copy = NULL;
+	// Not page aligned, so the digest can't map the copy from its start.
+	assert_equals(5, write(dst_fd, "xxxxx", 5));
+	assert_equals(0, jalls_copy_file(src_fd, dst_fd, TEST_DATA_LEN, digest_ctx, digest, 0));
+
+	copy = read_file(dst_fd, TEST_DATA_LEN + 5);
+	assert_not_equals((void *)NULL, copy);
+	assert_equals(0, memcmp(test_data, copy + 5, TEST_DATA_LEN));
+	free(copy);
+	assert_equals(JAL_OK, jal_digest_buffer(digest_ctx, test_data, TEST_DATA_LEN, &expected));
+	assert_equals(0, memcmp(expected, digest, digest_ctx->len));
+	free(expected);
+}
+
+void test_jalls_copy_file_handles_short_reads()
+{
+	disable_kernel_copy();
+	replace_function(read, read_one_byte_short);
+	assert_equals(0, jalls_copy_file(src_fd, dst_fd, TEST_DATA_LEN, digest_ctx, digest, 0));
+	assert_copied(dst_fd, TEST_DATA_LEN);
+}
+
+void test_jalls_copy_file_copies_from_pipe()
+{
+	int pipe_fds[2];
+	assert_equals(0, pipe(pipe_fds));
+	assert_equals(100, write(pipe_fds[1], test_data, 100));
+	close(pipe_fds[1]);
+	assert_equals(0, jalls_copy_file(pipe_fds[0], dst_fd, 100, digest_ctx, digest, 0));
+	close(pipe_fds[0]);
+	assert_copied(dst_fd, 100);
+}
+
+void test_jalls_copy_file_fails_when_source_is_too_short()
+{
+	assert_equals(-1, jalls_copy_file(src_fd, dst_fd, TEST_DATA_LEN + 1, digest_ctx, digest, 0));
+}
+
+void test_jalls_copy_file_fails_with_bad_input()
+{
+	assert_equals(-1, jalls_copy_file(-1, dst_fd, TEST_DATA_LEN, digest_ctx, digest, 0));
+	assert_equals(-1, jalls_copy_file(src_fd, -1, TEST_DATA_LEN, digest_ctx, digest, 0));
+	assert_equals(-1, jalls_copy_file(src_fd, dst_fd, TEST_DATA_LEN, NULL, digest, 0));
+	assert_equals(-1, jalls_copy_file(src_fd, dst_fd, TEST_DATA_LEN, digest_ctx, NULL, 0));
+}
@@ -34,16 +34,21 @@
 #include <sys/socket.h>
 #include <string.h>
 #include <errno.h>
+#include <stddef.h>
 #include <unistd.h>
+#include <sys/un.h>
 #include <test-dept.h>
 #include "jal_alloc.h"
 #include "jalls_init.h"
 #include "jalls_msg.h"
 #include "jalls_handler.h"
+#include "jalls_handle_batch.hpp"
 #include "jalls_handle_log.hpp"
 
 #define FAKE_MSG_SIZE 128
 
+extern volatile int should_exit;
+
 static int pthread_detach_always_fails(__attribute__((unused)) pthread_t thread)
 {
 	return -1;
@@ -177,6 +182,74 @@ static int recvmsg_returns_non_null_cmsg_len_zero(__attribute__((unused)) int fd
 	return FAKE_MSG_SIZE;
 }
 
+static int recvmsg_returns_batch_msg(__attribute__((unused)) int fd,
+					struct msghdr *msg,
+					__attribute__((unused)) int flags)
+{
+	*(uint16_t *)msg->msg_iov[0].iov_base = 2;
+	*(uint16_t *)msg->msg_iov[1].iov_base = 5;
+	*(uint64_t *)msg->msg_iov[2].iov_base = 2;
+	*(uint64_t *)msg->msg_iov[3].iov_base = 128;
+
+	msg->msg_control = NULL;
+
+	return FAKE_MSG_SIZE;
+}
+
+static int recvmsg_returns_version_2_log_msg(__attribute__((unused)) int fd,
+					struct msghdr *msg,
+					__attribute__((unused)) int flags)
+{
+	*(uint16_t *)msg->msg_iov[0].iov_base = 2;
+	*(uint16_t *)msg->msg_iov[1].iov_base = 1;
+	*(uint64_t *)msg->msg_iov[2].iov_base = 0;
+	*(uint64_t *)msg->msg_iov[3].iov_base = 0;
+
+	msg->msg_control = NULL;
+
+	return FAKE_MSG_SIZE;
+}
+
+/* The body of a batch, as returned by recvmsg_returns_batch_body(). */
+static uint8_t batch_body[256];
+static size_t batch_body_len;
+
+static void add_batch_entry(uint16_t version, uint16_t type, const char *data, const char *meta)
+{
+	uint64_t data_len = strlen(data);
+	uint64_t meta_len = strlen(meta);
+	uint8_t *cur = batch_body + batch_body_len;
+
+	memcpy(cur, &version, sizeof(version));
+	cur += sizeof(version);
+	memcpy(cur, &type, sizeof(type));
+	cur += sizeof(type);
+	memcpy(cur, &data_len, sizeof(data_len));
+	cur += sizeof(data_len);
+	memcpy(cur, &meta_len, sizeof(meta_len));
+	cur += sizeof(meta_len);
+	memcpy(cur, data, data_len);
+	cur += data_len;
+	memcpy(cur, "BREAK", 5);
+	cur += 5;
+	memcpy(cur, meta, meta_len);
+	cur += meta_len;
+	memcpy(cur, "BREAK", 5);
+	cur += 5;
+	batch_body_len = cur - batch_body;
+}
+
+static int recvmsg_returns_batch_body(__attribute__((unused)) int fd,
+					struct msghdr *msg,
+					__attribute__((unused)) int flags)
+{
+	if (msg->msg_iov[0].iov_len != batch_body_len) {
+		return -1;
+	}
+	memcpy(msg->msg_iov[0].iov_base, batch_body, batch_body_len);
+	return batch_body_len;
+}
+
 static int recvmsg_always_fails(__attribute__((unused)) int fd,
 			__attribute__((unused)) struct msghdr *msg,
 			__attribute__((unused)) int flags)
@@ -207,6 +280,8 @@ void setup()
 	thread_ctx->ctx = jalls_ctx;
 	thread_ctx->db_ctx = db_ctx;
 
+	batch_body_len = 0;
+
 	replace_function(pthread_self, fake_pthread_self);
 	replace_function(pthread_detach, fake_pthread_detach);
 
@@ -294,3 +369,222 @@ void test_jalls_handler_exits_cleanly_when_cmsg_len_zero_and_cmsg_not_null()
 	assert_equals((void *) NULL, ret);
 
 }
+
+static int fake_jalls_handle_log_succeeds(__attribute__((unused)) struct jalls_thread_context *ctx,
+				__attribute__((unused)) uint64_t data_len,
+				__attribute__((unused)) uint64_t meta_len)
+{
+	return 0;
+}
+
+void test_jalls_handle_message_returns_zero_when_message_handled()
+{
+	replace_function(jalls_recvmsg_helper, recvmsg_returns_msg_type_jalls_log_msg);
+	replace_function(jalls_handle_log, fake_jalls_handle_log_succeeds);
+	assert_equals(0, jalls_handle_message(thread_ctx));
+	restore_function(jalls_handle_log);
+	free(thread_ctx);
+}
+
+void test_jalls_handle_message_returns_error_when_handler_fails()
+{
+	replace_function(jalls_recvmsg_helper, recvmsg_returns_msg_type_jalls_log_msg);
+	replace_function(jalls_handle_log, fake_jalls_handle_log);
+	assert_equals(-1, jalls_handle_message(thread_ctx));
+	restore_function(jalls_handle_log);
+	free(thread_ctx);
+}
+
+void test_jalls_handle_message_returns_error_when_recvmsg_fails()
+{
+	replace_function(jalls_recvmsg_helper, recvmsg_always_fails);
+	assert_equals(-1, jalls_handle_message(thread_ctx));
+	free(thread_ctx);
+}
+
+void test_jalls_handle_message_returns_error_for_bad_protocol_version()
+{
+	replace_function(jalls_recvmsg_helper, recvmsg_returns_protocol_zero);
+	assert_equals(-1, jalls_handle_message(thread_ctx));
+	free(thread_ctx);
+}
+
+void test_jalls_handle_message_returns_error_for_bad_msg_type()
+{
+	replace_function(jalls_recvmsg_helper, recvmsg_returns_msg_type_zero);
+	assert_equals(-1, jalls_handle_message(thread_ctx));
+	free(thread_ctx);
+}
+
+void test_jalls_event_loop_fails_with_invalid_input()
+{
+	assert_equals(-1, jalls_event_loop(-1, thread_ctx, 1, 1));
+	assert_equals(-1, jalls_event_loop(0, thread_ctx, 0, 1));
+	assert_equals(-1, jalls_event_loop(0, thread_ctx, 1, 0));
+	free(thread_ctx);
+}
+
+static volatile int logs_handled;
+static int event_loop_ret;
+
+static int fake_jalls_handle_log_counts(__attribute__((unused)) struct jalls_thread_context *ctx,
+				__attribute__((unused)) uint64_t data_len,
+				__attribute__((unused)) uint64_t meta_len)
+{
+	__sync_add_and_fetch(&logs_handled, 1);
+	return 0;
+}
+
+static void *run_event_loop(void *sock_p)
+{
+	event_loop_ret = jalls_event_loop(*(int *) sock_p, thread_ctx, 1, 1);
+	return NULL;
+}
+
+static int connect_to(struct sockaddr_un *addr, socklen_t addr_len)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	assert_true(fd >= 0);
+	assert_equals(0, connect(fd, (struct sockaddr *) addr, addr_len));
+	return fd;
+}
+
+void test_jalls_event_loop_partial_header_does_not_block_other_connections()
+{
+	struct sockaddr_un addr;
+	pthread_t loop;
+	uint16_t version = JALLS_PROTOCOL_VERSION;
+	uint16_t type = JALLS_LOG_MSG;
+	uint64_t len = 0;
+	int i;
+
+	// An abstract socket, so there is no file to clean up.
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1, "jalls_test_%d", getpid());
+	socklen_t addr_len = offsetof(struct sockaddr_un, sun_path) + 1 + strlen(addr.sun_path + 1);
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	assert_equals(0, bind(sock, (struct sockaddr *) &addr, addr_len));
+	assert_equals(0, listen(sock, 8));
+
+	replace_function(jalls_handle_log, fake_jalls_handle_log_counts);
+	logs_handled = 0;
+	should_exit = 0;
+	assert_equals(0, pthread_create(&loop, NULL, run_event_loop, &sock));
+
+	// A producer sends the start of a header and stalls. With a single
+	// worker, this must not keep the other producer's message waiting.
+	int slow = connect_to(&addr, addr_len);
+	assert_equals((ssize_t) sizeof(version), send(slow, &version, sizeof(version), 0));
+
+	int fast = connect_to(&addr, addr_len);
+	assert_equals((ssize_t) sizeof(version), send(fast, &version, sizeof(version), 0));
+	assert_equals((ssize_t) sizeof(type), send(fast, &type, sizeof(type), 0));
+	assert_equals((ssize_t) sizeof(len), send(fast, &len, sizeof(len), 0));
+	assert_equals((ssize_t) sizeof(len), send(fast, &len, sizeof(len), 0));
+
+	for (i = 0; i < 500 && 0 == logs_handled; i++) {
+		usleep(10000);
+	}
+	assert_equals(1, logs_handled);
+
+	// Wake the loop up with another connection, so it sees should_exit.
+	should_exit = 1;
+	close(connect_to(&addr, addr_len));
+	assert_equals(0, pthread_join(loop, NULL));
+	assert_equals(0, event_loop_ret);
+
+	restore_function(jalls_handle_log);
+	should_exit = 0;
+	close(slow);
+	close(fast);
+	close(sock);
+	free(thread_ctx);
+}
+
+static int fake_jalls_handle_batch_succeeds(__attribute__((unused)) struct jalls_thread_context *ctx,
+				uint64_t record_cnt,
+				uint64_t batch_len)
+{
+	return (record_cnt == 2 && batch_len == 128) ? 0 : -1;
+}
+
+void test_jalls_handle_message_handles_batch()
+{
+	replace_function(jalls_recvmsg_helper, recvmsg_returns_batch_msg);
+	replace_function(jalls_handle_batch, fake_jalls_handle_batch_succeeds);
+	assert_equals(0, jalls_handle_message(thread_ctx));
+	restore_function(jalls_handle_batch);
+	free(thread_ctx);
+}
+
+void test_jalls_handle_message_returns_error_for_version_2_record()
+{
+	replace_function(jalls_recvmsg_helper, recvmsg_returns_version_2_log_msg);
+	replace_function(jalls_handle_log, fake_jalls_handle_log_succeeds);
+	assert_equals(-1, jalls_handle_message(thread_ctx));
+	restore_function(jalls_handle_log);
+	free(thread_ctx);
+}
+
+void test_jalls_handle_batch_fails_with_bad_record_count()
+{
+	add_batch_entry(1, 1, "log", "meta");
+	replace_function(jalls_recvmsg_helper, recvmsg_returns_batch_body);
+	assert_equals(-1, jalls_handle_batch(thread_ctx, 0, batch_body_len));
+	assert_equals(-1, jalls_handle_batch(thread_ctx, JALLS_MAX_BATCH_RECORDS + 1, batch_body_len));
+	assert_equals(-1, jalls_handle_batch(thread_ctx, 2, batch_body_len));
+	free(thread_ctx);
+}
+
+void test_jalls_handle_batch_fails_with_oversized_batch()
+{
+	add_batch_entry(1, 1, "log", "meta");
+	replace_function(jalls_recvmsg_helper, recvmsg_returns_batch_body);
+	assert_equals(-1, jalls_handle_batch(thread_ctx, 1, JALLS_MAX_BATCH_BYTES + 1));
+	assert_equals(-1, jalls_handle_batch(thread_ctx, 1, UINT64_MAX));
+	free(thread_ctx);
+}
+
+void test_jalls_handle_batch_fails_when_recvmsg_fails()
+{
+	add_batch_entry(1, 1, "log", "meta");
+	replace_function(jalls_recvmsg_helper, recvmsg_always_fails);
+	assert_equals(-1, jalls_handle_batch(thread_ctx, 1, batch_body_len));
+	free(thread_ctx);
+}
+
+void test_jalls_handle_batch_fails_with_journal_record()
+{
+	add_batch_entry(1, 3, "journal", "meta");
+	replace_function(jalls_recvmsg_helper, recvmsg_returns_batch_body);
+	assert_equals(-1, jalls_handle_batch(thread_ctx, 1, batch_body_len));
+	free(thread_ctx);
+}
+
+void test_jalls_handle_batch_fails_with_bad_record_version()
+{
+	add_batch_entry(2, 1, "log", "meta");
+	replace_function(jalls_recvmsg_helper, recvmsg_returns_batch_body);
+	assert_equals(-1, jalls_handle_batch(thread_ctx, 1, batch_body_len));
+	free(thread_ctx);
+}
+
+void test_jalls_handle_batch_fails_with_missing_break()
+{
+	add_batch_entry(1, 1, "log", "meta");
+	memcpy(batch_body + batch_body_len - 5, "BRAKE", 5);
+	replace_function(jalls_recvmsg_helper, recvmsg_returns_batch_body);
+	assert_equals(-1, jalls_handle_batch(thread_ctx, 1, batch_body_len));
+	free(thread_ctx);
+}
+
+void test_jalls_handle_batch_fails_when_record_is_truncated()
+{
+	uint64_t data_len = 1000;
+	add_batch_entry(1, 1, "log", "meta");
+	memcpy(batch_body + 2 * sizeof(uint16_t), &data_len, sizeof(data_len));
+	replace_function(jalls_recvmsg_helper, recvmsg_returns_batch_body);
+	assert_equals(-1, jalls_handle_batch(thread_ctx, 1, batch_body_len));
+	free(thread_ctx);
+}
@@ -0,0 +1,196 @@
+/**
+ * @file test_jalls_record_utils.c This file contains tests for
+ * jalls_record_utils functions.
+ *
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <test-dept.h>
+
+#include "jal_alloc.h"
+#include "jaldb_record.h"
+#include "jalls_context.h"
+#include "jalls_record_utils.h"
+
+#define UID 1000
+
+static int lookup_cnt;
+static time_t now;
+static struct jalls_context ctx;
+static struct jalls_thread_context thread_ctx;
+
+static int fake_getpwuid_r(uid_t uid, struct passwd *pwd, char *buf,
+		size_t buflen, struct passwd **result)
+{
+	lookup_cnt++;
+	memset(pwd, 0, sizeof(*pwd));
+	snprintf(buf, buflen, "user%u", (unsigned) uid);
+	pwd->pw_name = buf;
+	pwd->pw_uid = uid;
+	*result = pwd;
+	return 0;
+}
+
+static int getpwuid_r_finds_nothing(__attribute__((unused)) uid_t uid,
+		__attribute__((unused)) struct passwd *pwd,
+		__attribute__((unused)) char *buf,
+		__attribute__((unused)) size_t buflen,
+		struct passwd **result)
+{
+	lookup_cnt++;
+	*result = NULL;
+	return ENOENT;
+}
+
+static int fake_clock_gettime(__attribute__((unused)) clockid_t clk_id, struct timespec *tp)
+{
+	tp->tv_sec = now;
+	tp->tv_nsec = 0;
+	return 0;
+}
+
+void setup()
+{
+	lookup_cnt = 0;
+	now = 1000;
+	replace_function(getpwuid_r, fake_getpwuid_r);
+	replace_function(clock_gettime, fake_clock_gettime);
+	jalls_set_uid_cache_ttl(JALLS_UID_CACHE_TTL_DEFAULT);
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.hostname = "host";
+	memset(&thread_ctx, 0, sizeof(thread_ctx));
+	thread_ctx.fd = -1;
+	thread_ctx.ctx = &ctx;
+	thread_ctx.peer_uid = UID;
+	thread_ctx.have_peer_info = 1;
+}
+
+void teardown()
+{
+	restore_function(getpwuid_r);
+	restore_function(clock_gettime);
+	jalls_clear_uid_cache();
+	free(thread_ctx.peer_username);
+}
+
+void test_get_user_id_str_caches_names()
+{
+	char *name1 = jalls_get_user_id_str(UID);
+	char *name2 = jalls_get_user_id_str(UID);
+	assert_string_equals("user1000", name1);
+	assert_string_equals("user1000", name2);
+	assert_not_equals(name1, name2);
+	assert_equals(1, lookup_cnt);
+	free(name1);
+	free(name2);
+}
+
+void test_get_user_id_str_looks_up_name_again_after_ttl()
+{
+	free(jalls_get_user_id_str(UID));
+	now += JALLS_UID_CACHE_TTL_DEFAULT - 1;
+	free(jalls_get_user_id_str(UID));
+	assert_equals(1, lookup_cnt);
+	now += 1;
+	free(jalls_get_user_id_str(UID));
+	assert_equals(2, lookup_cnt);
+}
+
+void test_get_user_id_str_does_not_cache_with_ttl_zero()
+{
+	jalls_set_uid_cache_ttl(0);
+	free(jalls_get_user_id_str(UID));
+	free(jalls_get_user_id_str(UID));
+	assert_equals(2, lookup_cnt);
+}
+
+void test_get_user_id_str_does_not_cache_failures()
+{
+	replace_function(getpwuid_r, getpwuid_r_finds_nothing);
+	assert_pointer_equals((void *) NULL, jalls_get_user_id_str(UID));
+	replace_function(getpwuid_r, fake_getpwuid_r);
+	char *name = jalls_get_user_id_str(UID);
+	assert_string_equals("user1000", name);
+	assert_equals(2, lookup_cnt);
+	free(name);
+}
+
+void test_get_user_id_str_keeps_a_bounded_number_of_names()
+{
+	int i;
+	char *name;
+	for (i = 0; i < 10000; i++) {
+		free(jalls_get_user_id_str(i));
+	}
+	assert_equals(10000, lookup_cnt);
+
+	// the most recent names are still cached, the first ones were replaced
+	name = jalls_get_user_id_str(9999);
+	assert_string_equals("user9999", name);
+	assert_equals(10000, lookup_cnt);
+	free(name);
+	name = jalls_get_user_id_str(0);
+	assert_string_equals("user0", name);
+	assert_equals(10001, lookup_cnt);
+	free(name);
+}
+
+void test_create_record_looks_up_username_once_per_connection()
+{
+	struct jaldb_record *rec1 = NULL;
+	struct jaldb_record *rec2 = NULL;
+
+	thread_ctx.peer_sec_lbl = "system_u:system_r:producer_t:s0";
+	jalls_set_uid_cache_ttl(0);
+	assert_equals(0, jalls_create_record(JALDB_RTYPE_LOG, &thread_ctx, &rec1));
+	assert_equals(0, jalls_create_record(JALDB_RTYPE_LOG, &thread_ctx, &rec2));
+	assert_equals(1, lookup_cnt);
+
+	assert_string_equals("user1000", rec1->username);
+	assert_string_equals("user1000", rec2->username);
+	assert_not_equals(rec1->username, rec2->username);
+	assert_string_equals(thread_ctx.peer_sec_lbl, rec2->sec_lbl);
+	assert_not_equals(thread_ctx.peer_sec_lbl, rec2->sec_lbl);
+	assert_equals(UID, rec2->uid);
+
+	jaldb_destroy_record(&rec1);
+	jaldb_destroy_record(&rec2);
+}
+
+void test_create_record_fails_without_username()
+{
+	struct jaldb_record *rec = NULL;
+	replace_function(getpwuid_r, getpwuid_r_finds_nothing);
+	assert_equals(-1, jalls_create_record(JALDB_RTYPE_LOG, &thread_ctx, &rec));
+	assert_pointer_equals((void *) NULL, rec);
+}
@@ -162,6 +162,70 @@ enum jal_status jaln_register_publisher_callbacks(jaln_context *jaln_ctx,
 enum jal_status jaln_register_digest_algorithm(jaln_context *jal_ctx,
 				struct jal_digest_ctx *digest_ctx);
 
+/**
+ * Set the number of records a publisher may have queued on a session before
+ * jaln_send_journal(), jaln_send_audit() and jaln_send_log() block.
+ *
+ * By default the window is 1, and each of those functions returns only once
+ * the record has been handed to the network. With a larger window, up to \p
+ * window records are queued per session so that the link does not sit idle
+ * for a full round trip between records. In this case:
+ *  - The system metadata, application metadata, and (for audit and log
+ *    records) the payload are copied, so the caller may still release its
+ *    buffers as soon as the send function returns.
+ *  - The jaln_payload_feeder passed to jaln_send_journal(), and any data it
+ *    refers to, must remain valid until jaln_publisher_callbacks::on_record_complete
+ *    is called for that record.
+ *  - jaln_publisher_callbacks::on_record_complete is still called once per
+ *    record, in the order the records were sent.
+ *  - jaln_finish() waits for all queued records to be sent.
+ *
+ * The window is read when a session sends its first record, so this should be
+ * called before connecting.
+ *
+ * @param[in] jaln_ctx The jaln_context to configure.
+ * @param[in] window The maximum number of records in flight per session.
+ *
+ * @return JAL_OK on success, or JAL_E_INVAL if \p window is less than 1.
+ */
+enum jal_status jaln_set_send_window(jaln_context *jaln_ctx, int window);
+
+/**
+ * Configure when a subscriber sends 'digest' messages to the publisher.
+ *
+ * Digests of received records are collected and sent together in a single
+ * 'digest' message when any of the following is reached:
+ *  - \p max_records records are waiting to be confirmed,
+ *  - the waiting records total \p max_bytes bytes or more,
+ *  - the oldest waiting record was received \p max_age_ms milliseconds ago.
+ *
+ * When \p adaptive is non-zero, the record limit is tuned from the rate at
+ * which records arrive: it is set to the number of records expected in half
+ * of \p max_age_ms, between 1 and \p max_records. A slow trickle of
+ * records is confirmed one at a time, while a fast stream is confirmed in
+ * large batches.
+ *
+ * By default a 'digest' message is sent for every record. The settings are
+ * read when a subscriber session is created, so this should be called before
+ * connecting.
+ *
+ * @param[in] jaln_ctx The jaln_context to configure.
+ * @param[in] max_records The maximum number of records per 'digest' message.
+ * @param[in] max_bytes The maximum number of record bytes to receive before
+ * sending a 'digest' message, or 0 for no limit.
+ * @param[in] max_age_ms The longest time to hold on to a digest, in
+ * milliseconds.
+ * @param[in] adaptive Non-zero to tune the record limit from the record rate.
+ *
+ * @return JAL_OK on success, or JAL_E_INVAL if \p max_records or \p
+ * max_age_ms is less than 1.
+ */
+enum jal_status jaln_set_digest_batching(jaln_context *jaln_ctx,
+		int max_records,
+		uint64_t max_bytes,
+		long max_age_ms,
+		int adaptive);
+
 /**
  * Register the JALoP profile and start listening for connections. Once this
  * function is called, the \p jaln_ctx cannot be used to with calls to
@@ -304,6 +368,17 @@ enum jal_status jaln_shutdown(struct jaln_connection *jal_conn);
  */
 enum jal_status jaln_session_is_ok(jaln_session *sess);
 
+/**
+ * Get the user data for a session. This is the pointer that was passed to
+ * jaln_subscribe() or jaln_listen() for the connection the session belongs
+ * to, and that is passed to most of the callbacks.
+ *
+ * @param[in] sess The session.
+ *
+ * @return The user data, or NULL if \p sess is NULL.
+ */
+void *jaln_session_get_user_data(jaln_session *sess);
+
 /**
  * Send the journal record to the awaiting subscriber.
  *
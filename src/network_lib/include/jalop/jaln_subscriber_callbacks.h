@@ -120,7 +120,7 @@ struct jaln_subscriber_callbacks {
 
 	/**
 	 * The JNL calls this function to deliver the entire contents of the
-	 * audit entry.
+	 * audit entry. It may be NULL if \p on_audit_chunk is set.
 	 *
 	 * @param[in] session The jaln_session.
 	 * @param[in] ch_info Information about the connection
@@ -145,7 +145,7 @@ struct jaln_subscriber_callbacks {
 
 	/**
 	 * The JNL calls this function to deliver the entire contents of a log
-	 * entry.
+	 * entry. It may be NULL if \p on_log_chunk is set.
 	 *
 	 * @param[in] session The jaln_session.
 	 * @param[in] ch_info Information about the connection
@@ -186,8 +186,9 @@ struct jaln_subscriber_callbacks {
 	 * @param[in] user_data A pointer to user data that was passed into
 	 * \p jaln_listen, \p jaln_publish, or \p jaln_subscribe.
 	 *
-	 * @return JAL_OK to continue receiving data, anything else will cause
-	 * the JNL ignore any more messages for journal records.
+	 * @return JAL_OK to continue receiving data. Anything else stops the
+	 * delivery of journal records: the session is closed, and no digest is
+	 * sent for this record or any other record not yet confirmed.
 	 */
 	int (*on_journal)(
 			jaln_session *session,
@@ -309,6 +310,70 @@ struct jaln_subscriber_callbacks {
 			const char *nonce,
 			struct jaln_payload_feeder *feeder,
 			void *user_data);
+
+	/**
+	 * Optional. If set, the JNL calls this function instead of \p on_audit,
+	 * to deliver the audit entry as it arrives, without first buffering
+	 * the whole entry in memory. It is called the same way as \p
+	 * on_journal: once for each block of data with \p more set to 1, and
+	 * a final time with a NULL \p buffer, a \p cnt of 0 and \p more set to
+	 * 0 once the entire entry was received.
+	 *
+	 * @param[in] session The jaln_session.
+	 * @param[in] ch_info Information about the connection
+	 * @param[in] nonce The previously provided nonce of this record
+	 * @param[in] buffer A buffer containing bytes of the audit entry, after
+	 * this application returns from this call they must not access buffer.
+	 * @param[in] cnt The number of bytes contained in buffer
+	 * @param[in] offset The offset into the audit entry.
+	 * @param[in] more Boolean flag to indicate if there is more data
+	 * expected, this is set to 1 if there are more bytes expected, and 0 otherwise
+	 * @param[in] user_data A pointer to user data that was passed into
+	 * \p jaln_listen, \p jaln_publish, or \p jaln_subscribe.
+	 *
+	 * @return JAL_OK to continue receiving data. Anything else stops the
+	 * delivery of audit records: the session is closed, and no digest is
+	 * sent for this record or any other record not yet confirmed.
+	 */
+	int (*on_audit_chunk)(
+			jaln_session *session,
+			const struct jaln_channel_info *ch_info,
+			const char *nonce,
+			const uint8_t *buffer,
+			const uint32_t cnt,
+			const uint64_t offset,
+			const int more,
+			void *user_data);
+
+	/**
+	 * Optional. If set, the JNL calls this function instead of \p on_log,
+	 * to deliver the log entry as it arrives. See \p on_audit_chunk.
+	 *
+	 * @param[in] session The jaln_session.
+	 * @param[in] ch_info Information about the connection
+	 * @param[in] nonce The previously provided nonce of this record
+	 * @param[in] buffer A buffer containing bytes of the log entry, after
+	 * this application returns from this call they must not access buffer.
+	 * @param[in] cnt The number of bytes contained in buffer
+	 * @param[in] offset The offset into the log entry.
+	 * @param[in] more Boolean flag to indicate if there is more data
+	 * expected, this is set to 1 if there are more bytes expected, and 0 otherwise
+	 * @param[in] user_data A pointer to user data that was passed into
+	 * \p jaln_listen, \p jaln_publish, or \p jaln_subscribe.
+	 *
+	 * @return JAL_OK to continue receiving data. Anything else stops the
+	 * delivery of log records: the session is closed, and no digest is
+	 * sent for this record or any other record not yet confirmed.
+	 */
+	int (*on_log_chunk)(
+			jaln_session *session,
+			const struct jaln_channel_info *ch_info,
+			const char *nonce,
+			const uint8_t *buffer,
+			const uint32_t cnt,
+			const uint64_t offset,
+			const int more,
+			void *user_data);
 };
 
 /**
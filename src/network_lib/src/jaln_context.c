@@ -51,6 +51,9 @@ jaln_context *jaln_context_create(void)
 	}
 
 	ctx->ref_cnt = 1;
+	ctx->send_window = JALN_DEFAULT_SEND_WINDOW;
+	ctx->dgst_max_records = JALN_SESSION_DEFAULT_DGST_LIST_MAX;
+	ctx->dgst_max_age = JALN_SESSION_DEFAULT_DGST_TIMEOUT_MICROS;
 	ctx->sha256_digest = jal_sha256_ctx_create();
 	free(ctx->sha256_digest->algorithm_uri);
 	ctx->sha256_digest->algorithm_uri = jal_strdup(JALN_DGST_SHA256);
@@ -194,6 +197,39 @@ enum jal_status jaln_register_digest_algorithm(jaln_context *ctx,
 	return JAL_OK;
 }
 
+enum jal_status jaln_set_send_window(jaln_context *ctx, int window)
+{
+	if (!ctx || 0 >= window) {
+		return JAL_E_INVAL;
+	}
+
+	vortex_mutex_lock(&ctx->lock);
+	ctx->send_window = window;
+	vortex_mutex_unlock(&ctx->lock);
+
+	return JAL_OK;
+}
+
+enum jal_status jaln_set_digest_batching(jaln_context *ctx,
+		int max_records,
+		uint64_t max_bytes,
+		long max_age_ms,
+		int adaptive)
+{
+	if (!ctx || 0 >= max_records || 0 >= max_age_ms) {
+		return JAL_E_INVAL;
+	}
+
+	vortex_mutex_lock(&ctx->lock);
+	ctx->dgst_max_records = max_records;
+	ctx->dgst_max_bytes = max_bytes;
+	ctx->dgst_max_age = max_age_ms * 1000;
+	ctx->dgst_adaptive = adaptive ? axl_true : axl_false;
+	vortex_mutex_unlock(&ctx->lock);
+
+	return JAL_OK;
+}
+
 void jaln_ctx_ref(jaln_context *ctx)
 {
 	if (!ctx) {
@@ -40,6 +40,8 @@ extern "C" {
 
 #include "jaln_strings.h"
 
+#define JALN_DEFAULT_SEND_WINDOW 1
+
 struct jaln_context_t {
 	VortexMutex lock;
 	int ref_cnt;
@@ -56,6 +58,11 @@ struct jaln_context_t {
 	char *peer_certs;
 	char *public_cert;
 	char *private_key;
+	int send_window;
+	int dgst_max_records;
+	uint64_t dgst_max_bytes;
+	long dgst_max_age;
+	axl_bool dgst_adaptive;
 	void *user_data;
 };
 
@@ -39,18 +39,25 @@
 // to a different file.
 #include "jaln_subscriber_state_machine.h"
 
-axl_bool jaln_pub_feeder_get_size(jaln_session *sess, int *size)
+axl_bool jaln_pub_feeder_get_size(struct jaln_pub_data *pd, int *size)
 {
 	// expect that the pub_data is already filled out...
-	*size = sess->pub_data->vortex_feeder_sz;
+	// Vortex asks for the size again before every frame and only needs
+	// the number of bytes still pending, so a record of any size can be
+	// sent by reporting at most INT_MAX until the rest fits in an int.
+	uint64_t pending = 0;
+	if (pd->vortex_feeder_sz > pd->vortex_feeder_off) {
+		pending = pd->vortex_feeder_sz - pd->vortex_feeder_off;
+	}
+	*size = (pending > INT_MAX) ? INT_MAX : (int) pending;
 	return axl_true;
 }
 
-axl_bool jaln_pub_feeder_fill_buffer(jaln_session *sess, char *b, int *size)
+axl_bool jaln_pub_feeder_fill_buffer(struct jaln_pub_data *pd, char *b, int *size)
 {
 	uint64_t dst_sz = *size;
 	uint64_t dst_off = 0;
-	struct jaln_pub_data *pd = sess->pub_data;
+	jaln_session *sess = pd->sess;
 	struct jaln_publisher_callbacks *cbs = sess->jaln_ctx->pub_callbacks;
 	struct jaln_channel_info *ch_info = sess->ch_info;
 	void *ud = sess->jaln_ctx->user_data;
@@ -91,6 +98,9 @@ axl_bool jaln_pub_feeder_fill_buffer(jaln_session *sess, char *b, int *size)
 		jaln_copy_buffer(buffer, dst_sz, &dst_off, pd->app_meta, pd->app_meta_sz, &pd->app_meta_off, axl_true);
 		if (pd->app_meta_off == pd->app_meta_sz) {
 			pd->finished_app_meta = axl_true;
+			// The sizes are cleared along with the buffers, but the
+			// digest list still needs the size of the whole record.
+			pd->rec_sz = pd->sys_meta_sz + pd->app_meta_sz;
 			pd->sys_meta = NULL;
 			pd->sys_meta_off = 0;
 			pd->sys_meta_sz = 0;
@@ -118,24 +128,32 @@ axl_bool jaln_pub_feeder_fill_buffer(jaln_session *sess, char *b, int *size)
 			break;
 		}
 		case JALN_RTYPE_JOURNAL: {
-			uint64_t left_in_buffer = dst_sz - dst_off;
-			uint64_t bytes_acquired = left_in_buffer;
-
-			ret = pd->journal_feeder.get_bytes(pd->payload_off,
-							buffer + dst_off,
-							&bytes_acquired,
-							pd->journal_feeder.feeder_data);
-			if (ret != JAL_OK || (bytes_acquired > left_in_buffer)) {
-				return axl_false;
-			}
-
-			ret = sess->dgst->update(pd->dgst_inst, buffer + dst_off, bytes_acquired);
-			if (JAL_OK != ret) {
-				return axl_false;
+			// Keep reading until the frame is full, so a short read
+			// doesn't result in a small frame.
+			while ((dst_sz > dst_off) && (pd->payload_sz > pd->payload_off)) {
+				uint64_t left_in_buffer = dst_sz - dst_off;
+				uint64_t left_in_payload = pd->payload_sz - pd->payload_off;
+				uint64_t to_read = (left_in_buffer < left_in_payload) ? left_in_buffer : left_in_payload;
+				uint64_t bytes_acquired = to_read;
+
+				ret = pd->journal_feeder.get_bytes(pd->payload_off,
+								buffer + dst_off,
+								&bytes_acquired,
+								pd->journal_feeder.feeder_data);
+				if (ret != JAL_OK || (0 == bytes_acquired) || (bytes_acquired > to_read)) {
+					return axl_false;
+				}
+
+				// The digest runs over the whole payload, across
+				// every frame of the message.
+				ret = sess->dgst->update(pd->dgst_inst, buffer + dst_off, bytes_acquired);
+				if (JAL_OK != ret) {
+					return axl_false;
+				}
+
+				dst_off += bytes_acquired;
+				pd->payload_off += bytes_acquired;
 			}
-
-			dst_off += bytes_acquired;
-			pd->payload_off += bytes_acquired;
 			break;
 		}
 		default:
@@ -148,7 +166,8 @@ axl_bool jaln_pub_feeder_fill_buffer(jaln_session *sess, char *b, int *size)
 				return axl_false;
 			}
 
-			jaln_session_add_to_dgst_list(sess, pd->nonce, pd->dgst, dgst_len);
+			pd->rec_sz += pd->payload_sz;
+			jaln_session_add_to_dgst_list(sess, pd->nonce, pd->dgst, dgst_len, pd->rec_sz);
 			cbs->notify_digest(sess, ch_info, ch_info->type, pd->nonce, pd->dgst, dgst_len, ud);
 			pd->payload = NULL;
 		}
@@ -161,13 +180,14 @@ axl_bool jaln_pub_feeder_fill_buffer(jaln_session *sess, char *b, int *size)
 			pd->break_off = 0;
 		}
 	}
+	pd->vortex_feeder_off += dst_off;
 	*size = dst_off;
 	return axl_true;
 }
 
-axl_bool jaln_pub_feeder_is_finished(jaln_session *sess, int *finished)
+axl_bool jaln_pub_feeder_is_finished(struct jaln_pub_data *pd, int *finished)
 {
-	*finished = sess->errored || sess->pub_data->finished_payload_break;
+	*finished = pd->sess->errored || pd->finished_payload_break;
 	return *finished;
 }
 
@@ -179,7 +199,7 @@ axl_bool jaln_pub_feeder_handler(
 		axlPointer param2,
 		axlPointer user_data)
 {
-	jaln_session *sess = (jaln_session*) user_data;
+	struct jaln_pub_data *pd = (struct jaln_pub_data*) user_data;
 
 	int *size = param1;
 	char *buffer = param2;
@@ -187,14 +207,14 @@ axl_bool jaln_pub_feeder_handler(
 	switch (op_type) {
 	case PAYLOAD_FEEDER_GET_SIZE:
 		// should return the 'full' size, which may not be storable in
-		// an int...
-		return jaln_pub_feeder_get_size(sess, size);
+		// an int, so this reports what is left, capped at INT_MAX.
+		return jaln_pub_feeder_get_size(pd, size);
 		break;
 	case PAYLOAD_FEEDER_GET_CONTENT:
-		return jaln_pub_feeder_fill_buffer(sess, buffer, size);
+		return jaln_pub_feeder_fill_buffer(pd, buffer, size);
 		break;
 	case PAYLOAD_FEEDER_IS_FINISHED:
-		return jaln_pub_feeder_is_finished(sess, size);
+		return jaln_pub_feeder_is_finished(pd, size);
 		break;
 	case PAYLOAD_FEEDER_RELEASE:
 		// nothing really to do here.
@@ -220,6 +240,8 @@ void jaln_pub_feeder_reset_state(jaln_session *sess)
 	pd->app_meta = NULL;
 	pd->payload = NULL;
 	pd->vortex_feeder_sz = 0;
+	pd->vortex_feeder_off = 0;
+	pd->rec_sz = 0;
 	pd->headers_off = 0;
 	pd->sys_meta_off = 0;
 	pd->app_meta_off = 0;
@@ -263,33 +285,122 @@ void jaln_pub_feeder_calculate_size_for_vortex(jaln_session *sess)
 	}
 	struct jaln_pub_data *pd = sess->pub_data;
 	pd->vortex_feeder_sz = 0;
-	if (!jaln_pub_feeder_safe_add_size(&pd->vortex_feeder_sz, pd->payload_sz)) {
+	pd->vortex_feeder_off = 0;
+	if (!jaln_safe_add_size(&pd->vortex_feeder_sz, pd->payload_sz) ||
+			!jaln_safe_add_size(&pd->vortex_feeder_sz, pd->app_meta_sz) ||
+			!jaln_safe_add_size(&pd->vortex_feeder_sz, pd->sys_meta_sz) ||
+			!jaln_safe_add_size(&pd->vortex_feeder_sz, pd->headers_sz) ||
+			!jaln_safe_add_size(&pd->vortex_feeder_sz, 3 * strlen(JALN_STR_BREAK))) {
+		pd->vortex_feeder_sz = UINT64_MAX;
+	}
+}
+
+void jaln_pub_feeder_release_buffers(struct jaln_pub_data *pd)
+{
+	if (!pd) {
 		return;
 	}
-	if (!jaln_pub_feeder_safe_add_size(&pd->vortex_feeder_sz, pd->app_meta_sz)) {
+	free(pd->buf_copy);
+	pd->buf_copy = NULL;
+	pd->sys_meta = NULL;
+	pd->app_meta = NULL;
+	pd->payload = NULL;
+	pd->sys_meta_sz = 0;
+	pd->app_meta_sz = 0;
+	pd->payload_sz = 0;
+}
+
+void jaln_pub_feeder_copy_buffers(struct jaln_pub_data *pd, enum jaln_record_type type)
+{
+	if (!pd) {
 		return;
 	}
-	if (!jaln_pub_feeder_safe_add_size(&pd->vortex_feeder_sz, pd->sys_meta_sz)) {
+	uint64_t payload_sz = 0;
+	if (JALN_RTYPE_JOURNAL != type) {
+		payload_sz = pd->payload_sz;
+	}
+
+	free(pd->buf_copy);
+	pd->buf_copy = jal_malloc(pd->sys_meta_sz + pd->app_meta_sz + payload_sz + 1);
+
+	uint8_t *cur = pd->buf_copy;
+	if (pd->sys_meta_sz) {
+		memcpy(cur, pd->sys_meta, pd->sys_meta_sz);
+	}
+	pd->sys_meta = cur;
+	cur += pd->sys_meta_sz;
+
+	if (pd->app_meta_sz) {
+		memcpy(cur, pd->app_meta, pd->app_meta_sz);
+	}
+	pd->app_meta = cur;
+	cur += pd->app_meta_sz;
+
+	if (payload_sz) {
+		memcpy(cur, pd->payload, payload_sz);
+		pd->payload = cur;
+	}
+}
+
+void jaln_pub_feeder_create_window(jaln_session *sess)
+{
+	if (!sess || !sess->pub_data || sess->pub_window) {
 		return;
 	}
-	if (!jaln_pub_feeder_safe_add_size(&pd->vortex_feeder_sz, pd->headers_sz)) {
+	int window = sess->jaln_ctx ? sess->jaln_ctx->send_window : JALN_DEFAULT_SEND_WINDOW;
+	if (0 >= window) {
+		window = JALN_DEFAULT_SEND_WINDOW;
+	}
+	sess->pub_window = jal_calloc(window, sizeof(*sess->pub_window));
+	sess->pub_window_sz = window;
+	sess->pub_window_head = 0;
+	sess->pub_window_cnt = 0;
+	sess->pub_window[0] = sess->pub_data;
+}
+
+void jaln_pub_feeder_report_finished_no_lock(jaln_session *sess)
+{
+	if (!sess || !sess->pub_window || sess->pub_window_draining) {
+		// Another thread is already reporting records, it will pick
+		// up any that finished in the meantime.
 		return;
 	}
-	jaln_pub_feeder_safe_add_size(&pd->vortex_feeder_sz, 3 * strlen(JALN_STR_BREAK));
+	struct jaln_channel_info *ch_info = sess->ch_info;
+	struct jaln_publisher_callbacks *pub_cbs = sess->jaln_ctx->pub_callbacks;
+
+	sess->pub_window_draining = axl_true;
+	while (0 < sess->pub_window_cnt) {
+		struct jaln_pub_data *pd = sess->pub_window[sess->pub_window_head];
+		if (!pd->finished) {
+			break;
+		}
+
+		// Don't hold the lock while calling into the application,
+		// the slot isn't reused until it is removed from the ring.
+		vortex_mutex_unlock(&sess->wait_lock);
+		pub_cbs->on_record_complete(sess, ch_info, ch_info->type, pd->nonce, sess->jaln_ctx->user_data);
+		vortex_mutex_lock(&sess->wait_lock);
+
+		jaln_pub_feeder_release_buffers(pd);
+		pd->payload_off = 0;
+		pd->finished = axl_false;
+		sess->pub_window_head = (sess->pub_window_head + 1) % sess->pub_window_sz;
+		sess->pub_window_cnt--;
+		vortex_cond_broadcast(&sess->wait);
+	}
+	sess->pub_window_draining = axl_false;
 }
 
-axl_bool jaln_pub_feeder_safe_add_size(int *cnt, const uint64_t to_add)
+void jaln_pub_feeder_wait_for_records(jaln_session *sess)
 {
-	if (INT_MAX < to_add) {
-		*cnt = INT_MAX;
-		return axl_false;
+	if (!sess) {
+		return;
 	}
-	if ((INT_MAX - to_add) < (uint64_t) *cnt) {
-		*cnt = INT_MAX;
-		return axl_false;
+	vortex_mutex_lock(&sess->wait_lock);
+	while (sess->pub_window && 0 < sess->pub_window_cnt) {
+		vortex_cond_wait(&sess->wait, &sess->wait_lock);
 	}
-	*cnt += to_add;
-	return axl_true;
+	vortex_mutex_unlock(&sess->wait_lock);
 }
 
 enum jal_status jaln_pub_begin_next_record_ans(jaln_session *sess,
@@ -309,16 +420,38 @@ enum jal_status jaln_pub_begin_next_record_ans(jaln_session *sess,
 
 	jaln_pub_feeder_calculate_size_for_vortex(sess);
 
-	jaln_session_ref(sess);
+	vortex_mutex_lock(&sess->wait_lock);
+
+	jaln_pub_feeder_create_window(sess);
+	if (1 < sess->pub_window_sz) {
+		// The caller's buffers may be gone before this record is sent.
+		jaln_pub_feeder_copy_buffers(pd, sess->ch_info->type);
+	}
+	pd->sess = sess;
+	pd->finished = axl_false;
+	sess->pub_window_cnt++;
 
-	VortexPayloadFeeder *feeder = vortex_payload_feeder_new(jaln_pub_feeder_handler, sess);
-	vortex_payload_feeder_set_on_finished(feeder, jaln_pub_feeder_on_finished, sess);
+	jaln_session_ref(sess);
 
-	vortex_mutex_lock(&sess->wait_lock);
+	VortexPayloadFeeder *feeder = vortex_payload_feeder_new(jaln_pub_feeder_handler, pd);
+	vortex_payload_feeder_set_on_finished(feeder, jaln_pub_feeder_on_finished, pd);
 
+	// Vortex sends the replies queued on a channel in order, so the
+	// subscriber still sees the records one after another.
 	vortex_channel_send_ans_rpy_from_feeder(sess->rec_chan, feeder, pd->msg_no);
 
-	vortex_cond_wait(&sess->wait, &sess->wait_lock);
+	while (sess->pub_window_cnt >= sess->pub_window_sz) {
+		vortex_cond_wait(&sess->wait, &sess->wait_lock);
+	}
+
+	// Stage the next record in the first free slot.
+	int next = (sess->pub_window_head + sess->pub_window_cnt) % sess->pub_window_sz;
+	if (!sess->pub_window[next]) {
+		sess->pub_window[next] = jaln_pub_data_create();
+	}
+	sess->pub_window[next]->msg_no = pd->msg_no;
+	sess->pub_data = sess->pub_window[next];
+
 	vortex_mutex_unlock(&sess->wait_lock);
 out:
 	return ret;
@@ -328,29 +461,20 @@ void jaln_pub_feeder_on_finished(VortexChannel *chan,
 		__attribute__((unused)) VortexPayloadFeeder *feeder,
 		axlPointer user_data)
 {
-	jaln_session *sess = (jaln_session*) user_data;
-	struct jaln_channel_info *ch_info = sess->ch_info;
-	enum jaln_record_type type = ch_info->type;
-	struct jaln_pub_data *pd = sess->pub_data;
-	struct jaln_publisher_callbacks *pub_cbs = sess->jaln_ctx->pub_callbacks;
-
-	pub_cbs->on_record_complete(sess, ch_info, type, pd->nonce, sess->jaln_ctx->user_data);
-	pd->payload_off = 0;
+	struct jaln_pub_data *pd = (struct jaln_pub_data*) user_data;
+	jaln_session *sess = pd->sess;
 
 	if (!sess->errored) {
 		if (sess->closing) {
-			goto err_out;
+			jaln_session_set_errored(sess);
+			vortex_channel_finalize_ans_rpy(chan, pd->msg_no);
 		}
 	}
-	goto out;
 
-err_out:
-	jaln_session_set_errored(sess);
-	vortex_channel_finalize_ans_rpy(chan, sess->pub_data->msg_no);
-out:
 	vortex_mutex_lock(&sess->wait_lock);
+	pd->finished = axl_true;
+	jaln_pub_feeder_report_finished_no_lock(sess);
 	vortex_mutex_unlock(&sess->wait_lock);
 	jaln_session_unref(sess);
-	vortex_cond_signal(&sess->wait);
 	return;
 }
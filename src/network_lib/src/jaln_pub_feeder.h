@@ -36,21 +36,21 @@
 /**
  * function for Vortex to return the 'size' of the record.
  *
- * @param[in] sess The session to operate on.
- * @param[out] size The size (in bytes). The size returned may not be accruate,
- * but vortex only uses it as an estimate. Vortex will continue to try and send
- * data until 'jaln_pub_feeder_is_finished' returns true.
+ * @param[in] pd The record to operate on.
+ * @param[out] size The number of bytes of the record that have not been sent
+ * yet, or INT_MAX if more than INT_MAX bytes are left. Vortex will continue
+ * to try and send data until 'jaln_pub_feeder_is_finished' returns true.
  *
  * @return axl_true on success, axl_false otherwise.
  */
 axl_bool jaln_pub_feeder_get_size(
-		jaln_session *sess,
+		struct jaln_pub_data *pd,
 		int *size);
 
 /**
  * function for vortex to fill a buffer to send data.
  *
- * @param[in] sess The session to operate on.
+ * @param[in] pd The record to operate on.
  * @param[in] buffer A buffer to fill.
  * @param[in,out] size The size of the buffer. This will be set to the actual
  * number of bytes copied into the buffer.
@@ -58,7 +58,7 @@ axl_bool jaln_pub_feeder_get_size(
  * @return axl_true on success, axl_false otherwise.
  */
 axl_bool jaln_pub_feeder_fill_buffer(
-		jaln_session *sess,
+		struct jaln_pub_data *pd,
 		char *buffer,
 		int *size);
 
@@ -66,7 +66,7 @@ axl_bool jaln_pub_feeder_fill_buffer(
  * Function used to report to vortex if there is more data available, or if we
  * are finished sending this record.
  *
- * @param[in] sess The session to operate on
+ * @param[in] pd The record to operate on
  * @param[out] finished This will be set to axl_true if all bytes were sent or
  * there was an error,
  * axl_false otherwise.
@@ -74,7 +74,7 @@ axl_bool jaln_pub_feeder_fill_buffer(
  * @return axl_true on success, or axl_false if there was an error.
  */
 axl_bool jaln_pub_feeder_is_finished(
-		jaln_session *sess,
+		struct jaln_pub_data *pd,
 		int *finished);
 
 /**
@@ -88,7 +88,7 @@ axl_bool jaln_pub_feeder_is_finished(
  * @param[in] op_type the operation
  * @param[in] param1 The first parameter (the type depends on the op)
  * @param[in] param2 The second parameter (the type depends on the op)
- * @param[in] user_data Expected to be the jaln_session
+ * @param[in] user_data Expected to be the jaln_pub_data for the record.
  *
  * @return axl_true on success, axl_false otherwise.
  */
@@ -108,52 +108,90 @@ axl_bool jaln_pub_feeder_handler(VortexCtx *ctx,
 void jaln_pub_feeder_reset_state(jaln_session *sess);
 
 /**
- * Helper function that determines a size for the message.
- * This fudges the numbers slightly since BEEP essentially allows any sized
- * data to be sent. Vortex requests the size as an int, but only uses this to
- * determine the initial window size to allocate for the feeder. Vortex will
- * not stop sending data until we report there is no more data to send.
+ * Helper function that determines the full size of the message.
+ * Vortex requests the size as an int before each frame it sends, so the full
+ * size is kept as a 64-bit value and jaln_pub_feeder_get_size() reports the
+ * number of bytes that are left, capped at INT_MAX. Vortex will not stop
+ * sending data until we report there is no more data to send, which allows
+ * records larger than INT_MAX bytes to be sent as a single reply.
  *
- * This sets the jaln_session::pub_data::vortex_feeder_sz.
+ * This sets the jaln_session::pub_data::vortex_feeder_sz and resets
+ * jaln_session::pub_data::vortex_feeder_off.
  *
  * @param[in] sess The jaln_session to operate on
  */
 void jaln_pub_feeder_calculate_size_for_vortex(jaln_session *sess);
 
-/**
- * Helper utility for calculating the 'size' for vortex.
- * This function adds \p to_add to \p cnt, while detecting integer overflow.
- * If the results of the addition would overflow an integer, then \p is set to
- * INT_MAX and axl_false is returned.
- *
- * @param[in,out] cnt The value to add to.
- * @param[in] to_add The value to add
- *
- * @return 
- *   - axl_true if the addition was performed successfull
- *   - axl_false if the addtion would result in integer overflow.
- */
-axl_bool jaln_pub_feeder_safe_add_size(int *cnt, const uint64_t to_add);
-
 /**
  * Callback executed by vortex when the payload feeder is finished sending a
- * record. This function gets the next record from the user, and gets a new
- * payload feeder primed to send the next record.
+ * record. This marks the record as finished and reports every finished record
+ * at the front of the session's send window to the application, in the order
+ * the records were queued.
  *
- * If the next record cannot be obtained for any reason, then the answer stream
- * is finalized.
+ * If the session is closing, then the answer stream is finalized.
  *
  * @param[in] chan The channel used for the feeder.
  * @param[in] feeder The vortex payload feeder.
- * @param[in] user_data This is expected to be a jaln_session pointer.
+ * @param[in] user_data This is expected to be the jaln_pub_data for the record.
  */
 void jaln_pub_feeder_on_finished(VortexChannel *chan,
 		VortexPayloadFeeder *feeder,
 		axlPointer user_data);
 
+/**
+ * Drop the references a record holds to the system metadata, application
+ * metadata, and payload buffers, freeing jaln_pub_data::buf_copy if the
+ * buffers were copied.
+ *
+ * @param[in] pd The record to operate on.
+ */
+void jaln_pub_feeder_release_buffers(struct jaln_pub_data *pd);
+
+/**
+ * Copy the system metadata, application metadata, and, for audit and log
+ * records, the payload into a single buffer owned by the record. This is used
+ * when the record may still be in flight after the caller's send function
+ * returns.
+ *
+ * @param[in] pd The record to operate on.
+ * @param[in] type The type of the record.
+ */
+void jaln_pub_feeder_copy_buffers(struct jaln_pub_data *pd, enum jaln_record_type type);
+
+/**
+ * Create the send window for a publisher session, sized from
+ * jaln_context::send_window. The current jaln_session::pub_data becomes the
+ * first slot. This does nothing if the window already exists.
+ *
+ * @param[in] sess The session to operate on.
+ */
+void jaln_pub_feeder_create_window(jaln_session *sess);
+
+/**
+ * Report finished records at the front of the send window to the application
+ * via jaln_publisher_callbacks::on_record_complete, and remove them from the
+ * window. The jaln_session::wait_lock must be held by the caller, it is
+ * released while calling into the application.
+ *
+ * @param[in] sess The session to operate on.
+ */
+void jaln_pub_feeder_report_finished_no_lock(jaln_session *sess);
+
+/**
+ * Block until every record queued on the session has been sent and reported
+ * to the application.
+ *
+ * @param[in] sess The session to operate on.
+ */
+void jaln_pub_feeder_wait_for_records(jaln_session *sess);
+
 /**
  * Helper function to start the next record.
  *
+ * The record in jaln_session::pub_data is queued for sending. This blocks
+ * until there is room in the session's send window for another record, and
+ * then points jaln_session::pub_data at the free slot.
+ *
  * @param[in] sess The session to operate on.
  * @param[in] journal_offset The offset where to begin sending journal data
  * from. For audit and log data, this is ignored.
@@ -48,6 +48,27 @@
 #include "jaln_sync_msg_handler.h"
 #include "jaln_subscribe_msg_handler.h"
 
+/**
+ * Helper to index the entries in \p calc_dgsts by nonce. If a nonce appears
+ * more than once, only the first (oldest) entry is indexed.
+ */
+static axlHash *jaln_pub_index_digests(axlList *calc_dgsts)
+{
+	axlHash *calc_index = axl_hash_new(axl_hash_string, axl_hash_equal_string);
+	axlListCursor *cursor = axl_list_cursor_new(calc_dgsts);
+
+	axl_list_cursor_first(cursor);
+	while(axl_list_cursor_has_item(cursor)) {
+		struct jaln_digest_info *tmp = (struct jaln_digest_info*) axl_list_cursor_get(cursor);
+		if (tmp && !axl_hash_exists(calc_index, tmp->nonce)) {
+			axl_hash_insert(calc_index, tmp->nonce, tmp);
+		}
+		axl_list_cursor_next(cursor);
+	}
+	axl_list_cursor_free(cursor);
+	return calc_index;
+}
+
 void jaln_pub_notify_digests_and_create_digest_response(
 		jaln_session *sess,
 		axlList *calc_dgsts,
@@ -62,6 +83,10 @@ void jaln_pub_notify_digests_and_create_digest_response(
 	}
 
 	axlList *resps = jaln_digest_resp_list_create();
+	// Entries matched through calc_index are parked here until the end so
+	// the nonces used as keys stay valid.
+	axlList *matched = jaln_digest_info_list_create();
+	axlHash *calc_index = NULL;
 
 	axlListCursor *calc_cursor = axl_list_cursor_new(calc_dgsts);
 	axlListCursor *peer_cursor = axl_list_cursor_new(peer_dgsts);
@@ -71,15 +96,24 @@ void jaln_pub_notify_digests_and_create_digest_response(
 		struct jaln_digest_info *peer_di = (struct jaln_digest_info*) axl_list_cursor_get(peer_cursor);
 		struct jaln_digest_info *calc_di = NULL;
 
-		axl_list_cursor_first(calc_cursor);
-		while(axl_list_cursor_has_item(calc_cursor)) {
+		if (!calc_index) {
+			// The peer normally reports digests in the order the records
+			// were sent, so try the oldest calculated digest first and
+			// only index the list once that stops working.
+			axl_list_cursor_first(calc_cursor);
 			struct jaln_digest_info *tmp = (struct jaln_digest_info*) axl_list_cursor_get(calc_cursor);
 			if (tmp && (0 == strcmp(peer_di->nonce, tmp->nonce))) {
 				calc_di = tmp;
 				axl_list_cursor_unlink(calc_cursor);
-				break;
+			} else if (tmp) {
+				calc_index = jaln_pub_index_digests(calc_dgsts);
+			}
+		}
+		if (calc_index) {
+			calc_di = (struct jaln_digest_info*) axl_hash_get(calc_index, peer_di->nonce);
+			if (calc_di) {
+				axl_hash_remove(calc_index, peer_di->nonce);
 			}
-			axl_list_cursor_next(calc_cursor);
 		}
 
 		struct jaln_digest_resp_info *resp_info = NULL;
@@ -110,12 +144,35 @@ void jaln_pub_notify_digests_and_create_digest_response(
 		}
 		axl_list_append(resps, resp_info);
 
-		jaln_digest_info_destroy(&calc_di);
+		if (!calc_index) {
+			jaln_digest_info_destroy(&calc_di);
+		}
 
 		axl_list_cursor_next(peer_cursor);
 	}
+
+	if (calc_index) {
+		// Drop the entries matched through calc_index in a single pass,
+		// leaving the unmatched ones in their original order. An entry was
+		// matched if it is the first one seen for its nonce and the nonce
+		// is no longer indexed; later entries with the same nonce are kept.
+		axl_list_cursor_first(calc_cursor);
+		while(axl_list_cursor_has_item(calc_cursor)) {
+			struct jaln_digest_info *tmp = (struct jaln_digest_info*) axl_list_cursor_get(calc_cursor);
+			if (tmp && !axl_hash_exists(calc_index, tmp->nonce)) {
+				axl_hash_insert(calc_index, tmp->nonce, NULL);
+				axl_list_cursor_unlink(calc_cursor);
+				axl_list_append(matched, tmp);
+				continue;
+			}
+			axl_list_cursor_next(calc_cursor);
+		}
+		axl_hash_free(calc_index);
+	}
+
 	axl_list_cursor_free(peer_cursor);
 	axl_list_cursor_free(calc_cursor);
+	axl_list_free(matched);
 	*dgst_resp_infos = resps;
 }
 
@@ -46,7 +46,14 @@ extern "C" {
  * jaln_digest_info from \p peer_dgsts to one contained in \p calc_dgsts. For
  * each jaln_digest_info in \p peer_dgsts, it creates a corresponding
  * jaln_digest_resp_info and adds it to a list. As nonces are matched in \p
- * calc_dgsts, they are removed from the list.
+ * calc_dgsts, they are removed from the list. Unmatched entries are left in
+ * \p calc_dgsts in their original order.
+ *
+ * While \p peer_dgsts lists the nonces in the same order as \p calc_dgsts,
+ * each one is matched against the head of \p calc_dgsts. After the first
+ * mismatch, \p calc_dgsts is indexed by nonce, so the cost stays linear in
+ * the size of both lists. If \p calc_dgsts contains the same nonce more
+ * than once, only the oldest entry is considered for each match.
  *
  * @param[in] sess The session related to the digests.
  * @param[in] calc_dgsts An axlList of jlan_digest_info structures. This is the
@@ -146,13 +146,11 @@ enum jal_status jaln_send_record(
 	ret = jaln_pub_begin_next_record_ans(sess, &rec_info);
 out:
 	// The library does not assume ownership of the buffers.
-	// Make sure there are no lingering pointers to them.
-	pub_data->sys_meta = NULL;
-	pub_data->app_meta = NULL;
-	pub_data->payload = NULL;
-	pub_data->sys_meta_sz = 0;
-	pub_data->app_meta_sz = 0;
-	pub_data->payload_sz = 0;
+	// Make sure there are no lingering pointers to them. Once the
+	// record is queued, this is done when it finishes sending.
+	if (JAL_OK != ret) {
+		jaln_pub_feeder_release_buffers(sess->pub_data);
+	}
 	return ret;
 }
 
@@ -242,11 +240,11 @@ enum jal_status jaln_send_record_feeder(
 	ret = jaln_pub_begin_next_record_ans(sess, &rec_info); 
 out:
 	// The library does not assume ownership of the buffers.
-	// Make sure there are no lingering pointers to them.
-	pub_data->sys_meta = NULL;
-	pub_data->app_meta = NULL;
-	pub_data->sys_meta_sz = 0;
-	pub_data->app_meta_sz = 0;
+	// Make sure there are no lingering pointers to them. Once the
+	// record is queued, this is done when it finishes sending.
+	if (JAL_OK != ret) {
+		jaln_pub_feeder_release_buffers(sess->pub_data);
+	}
 	return ret;
 }
 
@@ -330,6 +328,9 @@ enum jal_status jaln_finish(jaln_session *sess)
 		return JAL_E_INVAL_PARAM;
 	}
 
+	// Any records still queued have to go out before the final reply.
+	jaln_pub_feeder_wait_for_records(sess);
+
 	axl_bool ans_rpy_sent = vortex_channel_finalize_ans_rpy(sess->rec_chan, sess->pub_data->msg_no);
 	if (!ans_rpy_sent) {
 		return JAL_E_COMM;
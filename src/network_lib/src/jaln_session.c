@@ -64,6 +64,7 @@ jaln_session *jaln_session_create()
 		jal_error_handler(JAL_E_NO_MEM);
 	}
 	sess->dgst_list_max = JALN_SESSION_DEFAULT_DGST_LIST_MAX;
+	sess->dgst_list_thresh = JALN_SESSION_DEFAULT_DGST_LIST_MAX;
 	sess->dgst_timeout = JALN_SESSION_DEFAULT_DGST_TIMEOUT_MICROS;
 	sess->errored = axl_false;
 	return sess;
@@ -139,6 +140,7 @@ void jaln_session_set_dgst_max(jaln_session *sess, int max)
 	}
 	vortex_mutex_lock(&sess->lock);
 	sess->dgst_list_max = max;
+	sess->dgst_list_thresh = max;
 	vortex_mutex_unlock(&sess->lock);
 }
 
@@ -152,6 +154,17 @@ void jaln_session_destroy(jaln_session **psession) {
 			sess->dgst->destroy(sess->sub_data->sm->dgst_inst);
 		}
 		jaln_sub_data_destroy(&sess->sub_data);
+	} else if (sess->pub_window) {
+		// jaln_session::pub_data is one of the slots in the window.
+		int i;
+		for (i = 0; i < sess->pub_window_sz; i++) {
+			if (sess->pub_window[i] && sess->pub_window[i]->dgst_inst && sess->dgst) {
+				sess->dgst->destroy(sess->pub_window[i]->dgst_inst);
+			}
+			jaln_pub_data_destroy(&sess->pub_window[i]);
+		}
+		free(sess->pub_window);
+		sess->pub_data = NULL;
 	} else {
 		if (sess->pub_data && sess->pub_data->dgst_inst) {
 			if (sess->dgst) {
@@ -202,10 +215,22 @@ void jaln_pub_data_destroy(struct jaln_pub_data **ppub_data) {
 	struct jaln_pub_data *pub_data = *ppub_data;
 	free(pub_data->nonce);
 	free(pub_data->dgst);
+	free(pub_data->buf_copy);
 	free(pub_data);
 	*ppub_data = NULL;
 }
 
+/**
+ * Wake the digest thread of a subscriber session so it notices the session
+ * is closing without waiting for its timeout.
+ */
+static void jaln_session_wake_dgst_thread_no_lock(jaln_session *sess)
+{
+	if ((JALN_ROLE_SUBSCRIBER == sess->role) && sess->sub_data) {
+		vortex_cond_broadcast(&sess->sub_data->dgst_list_cond);
+	}
+}
+
 axl_bool jaln_session_on_close_channel(int channel_num,
 		__attribute__((unused)) VortexConnection *connection,
 		axlPointer user_data)
@@ -229,6 +254,7 @@ axl_bool jaln_session_on_close_channel(int channel_num,
 		vortex_mutex_unlock(&sess->lock);
 		return axl_true;
 	}
+	jaln_session_wake_dgst_thread_no_lock(sess);
 	if (!sess->rec_chan && !sess->dgst_chan) {
 		jaln_context *ctx = sess->jaln_ctx;
 		if (ctx && ctx->conn_callbacks) {
@@ -271,6 +297,7 @@ void jaln_session_notify_close(
 		vortex_mutex_unlock(&sess->lock);
 		return;
 	}
+	jaln_session_wake_dgst_thread_no_lock(sess);
 	if (!sess->rec_chan && !sess->dgst_chan) {
 		jaln_context *ctx = sess->jaln_ctx;
 		if (ctx && ctx->conn_callbacks) {
@@ -304,6 +331,7 @@ void jaln_session_notify_unclean_channel_close(VortexChannel *channel,
 		vortex_mutex_unlock(&sess->lock);
 		return;
 	}
+	jaln_session_wake_dgst_thread_no_lock(sess);
 	if (!sess->rec_chan && !sess->dgst_chan) {
 		jaln_context *ctx = sess->jaln_ctx;
 		if (ctx && ctx->conn_callbacks) {
@@ -316,7 +344,11 @@ void jaln_session_notify_unclean_channel_close(VortexChannel *channel,
 	jaln_session_unref(sess);
 }
 
-enum jal_status jaln_session_add_to_dgst_list(jaln_session *sess, char *nonce, uint8_t *dgst_buf, uint64_t dgst_len)
+enum jal_status jaln_session_add_to_dgst_list(jaln_session *sess,
+		char *nonce,
+		uint8_t *dgst_buf,
+		uint64_t dgst_len,
+		uint64_t rec_sz)
 {
 	if (!sess || !nonce || !dgst_buf || (0 == dgst_len)) {
 		return JAL_E_INVAL;
@@ -326,11 +358,17 @@ enum jal_status jaln_session_add_to_dgst_list(jaln_session *sess, char *nonce, u
 	vortex_mutex_lock(&sess->lock);
 	axl_list_append(sess->dgst_list, dgst_info);
 	if (JALN_ROLE_SUBSCRIBER == sess->role) {
-		axl_bool notify = axl_false;
-		if (axl_list_length(sess->dgst_list) >= sess->dgst_list_max) {
-			notify = axl_true;
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		if (1 == axl_list_length(sess->dgst_list)) {
+			sess->dgst_list_oldest = now;
 		}
-		if (notify) {
+		sess->dgst_list_bytes += rec_sz;
+		jaln_session_update_dgst_thresh_no_lock(sess, &now);
+
+		if ((axl_list_length(sess->dgst_list) >= sess->dgst_list_thresh) ||
+				(sess->dgst_max_bytes && (sess->dgst_list_bytes >= sess->dgst_max_bytes))) {
+			sess->dgst_flush_pending = axl_true;
 			// wake up the thread that is supposed to be sending
 			// digest/sync messages
 			vortex_cond_signal(&sess->sub_data->dgst_list_cond);
@@ -340,6 +378,73 @@ enum jal_status jaln_session_add_to_dgst_list(jaln_session *sess, char *nonce, u
 	return JAL_OK;
 }
 
+void jaln_session_update_dgst_thresh_no_lock(jaln_session *sess,
+		const struct timeval *now)
+{
+	if (!sess || !now) {
+		return;
+	}
+	if (sess->dgst_last_add.tv_sec || sess->dgst_last_add.tv_usec) {
+		double elapsed = (now->tv_sec - sess->dgst_last_add.tv_sec) +
+			(now->tv_usec - sess->dgst_last_add.tv_usec) / 1000000.0;
+		// Anything faster than the clock resolution is treated as
+		// arriving 1 microsecond apart.
+		if (elapsed < 0.000001) {
+			elapsed = 0.000001;
+		}
+		double rate = 1.0 / elapsed;
+		if (0 == sess->dgst_rec_rate) {
+			sess->dgst_rec_rate = rate;
+		} else {
+			sess->dgst_rec_rate += (rate - sess->dgst_rec_rate) / JALN_SESSION_DGST_RATE_WEIGHT;
+		}
+	}
+	sess->dgst_last_add = *now;
+
+	if (!sess->dgst_adaptive) {
+		sess->dgst_list_thresh = sess->dgst_list_max;
+		return;
+	}
+	double expected = sess->dgst_rec_rate * (sess->dgst_timeout / 2) / 1000000.0;
+	if (expected < 1) {
+		sess->dgst_list_thresh = 1;
+	} else if (expected >= sess->dgst_list_max) {
+		sess->dgst_list_thresh = sess->dgst_list_max;
+	} else {
+		sess->dgst_list_thresh = (int) expected;
+	}
+}
+
+axlList *jaln_session_take_dgst_list_no_lock(jaln_session *sess)
+{
+	if (!sess) {
+		return NULL;
+	}
+	axlList *dgst_list = sess->dgst_list;
+	sess->dgst_list =
+		axl_list_new(jaln_axl_equals_func_digest_info_nonce, jaln_axl_destroy_digest_info);
+	if (!sess->dgst_list) {
+		jal_error_handler(JAL_E_NO_MEM);
+	}
+	sess->dgst_list_bytes = 0;
+	sess->dgst_flush_pending = axl_false;
+	return dgst_list;
+}
+
+long jaln_session_dgst_wait_time_no_lock(jaln_session *sess,
+		const struct timeval *now)
+{
+	if (!sess || !now || (0 == axl_list_length(sess->dgst_list))) {
+		return sess ? sess->dgst_timeout : 0;
+	}
+	long age = (now->tv_sec - sess->dgst_list_oldest.tv_sec) * 1000000L +
+		(now->tv_usec - sess->dgst_list_oldest.tv_usec);
+	if (age >= sess->dgst_timeout) {
+		return 0;
+	}
+	return sess->dgst_timeout - age;
+}
+
 int jaln_ptrs_equal(axlPointer a, axlPointer b)
 {
 	// this function is used only for storing jaln_session objects
@@ -405,3 +510,11 @@ enum jal_status jaln_session_is_ok(jaln_session *sess)
 	}
 	return JAL_OK;
 }
+
+void *jaln_session_get_user_data(jaln_session *sess)
+{
+	if (!sess || !sess->jaln_ctx) {
+		return NULL;
+	}
+	return sess->jaln_ctx->user_data;
+}
@@ -34,6 +34,7 @@
 #include <jalop/jal_digest.h>
 #include <jalop/jaln_network.h>
 #include <jalop/jaln_network_types.h>
+#include <sys/time.h>
 #include <vortex.h>
 
 #ifdef __cplusplus
@@ -43,7 +44,11 @@ extern "C" {
 #define JALN_SESSION_DEFAULT_DGST_LIST_MAX 1
 
 // 30 minute timeout
-#define JALN_SESSION_DEFAULT_DGST_TIMEOUT_MICROS (30 * 60 * 100000)
+#define JALN_SESSION_DEFAULT_DGST_TIMEOUT_MICROS (30L * 60 * 1000000)
+
+// Smoothing for the moving average of the record rate, each new sample
+// contributes 1/JALN_SESSION_DGST_RATE_WEIGHT of the result.
+#define JALN_SESSION_DGST_RATE_WEIGHT 8
 
 struct jaln_sub_state_machine;
 struct jaln_sub_data;
@@ -74,10 +79,23 @@ struct jaln_session_t {
 	enum jaln_role role;                 //!< The role this context is performing (subscriber or publisher)
 	int dgst_list_max;                   //!< The maximum number of digest entries to keep as a subscriber
 	long dgst_timeout;                   //!< The maximum amount of time to wait before sending a 'digest' message
+	uint64_t dgst_max_bytes;             //!< The maximum number of record bytes to cover with pending digests as a subscriber, or 0 for no limit
+	axl_bool dgst_adaptive;              //!< Whether to derive jaln_session::dgst_list_thresh from the observed record rate
+	int dgst_list_thresh;                //!< The number of digest entries that triggers a 'digest' message, at most jaln_session::dgst_list_max
+	uint64_t dgst_list_bytes;            //!< The number of record bytes covered by the entries in jaln_session::dgst_list
+	struct timeval dgst_list_oldest;     //!< When the oldest entry in jaln_session::dgst_list was added
+	struct timeval dgst_last_add;        //!< When the most recent entry was added to jaln_session::dgst_list
+	double dgst_rec_rate;                //!< Moving average of the records received per second
+	axl_bool dgst_flush_pending;         //!< Set when a threshold is reached and a 'digest' message should be sent
 	union {
 		struct jaln_sub_data* sub_data;   //!< Data specific to a subscriber
 		struct jaln_pub_data* pub_data;   //!< Data specific to a publisher
 	};
+	struct jaln_pub_data **pub_window;   //!< Ring of records queued for sending as a publisher, jaln_session::pub_data is the next free slot.
+	int pub_window_sz;                   //!< The number of slots in jaln_session::pub_window
+	int pub_window_head;                 //!< The index of the oldest record in jaln_session::pub_window
+	int pub_window_cnt;                  //!< The number of records in jaln_session::pub_window that are queued or being sent
+	axl_bool pub_window_draining;        //!< Indicates a thread is reporting finished records to the application
 };
 
 
@@ -95,8 +113,10 @@ struct jaln_sub_data {
  * Data related to a publisher session
  */
 struct jaln_pub_data {
+	jaln_session *sess;                         //!< The session this record is sent over.
 	struct jaln_payload_feeder journal_feeder;  //!< the jaln_payload_feeder for sending a journal record.
-	int vortex_feeder_sz;                       //!< The size (as reported to the Vortex engine) of this message.
+	uint64_t vortex_feeder_sz;                  //!< The full size of this message, which may be more than fits in an int.
+	uint64_t vortex_feeder_off;                 //!< The number of bytes of this message given to the Vortex engine so far.
 	int msg_no;                                 //!< The message number we are replying to
 
 	char *nonce;                            //!< The nonce of the last record sent.
@@ -105,11 +125,13 @@ struct jaln_pub_data {
 	uint8_t *sys_meta;                          //!< A buffer to hold the system metadata for the current record.
 	uint8_t *app_meta;                          //!< A buffer to hold the application metadata for the current record.
 	uint8_t *payload;                           //!< A buffer to hold the data for the payload (if this is an audit or log record
+	uint8_t *buf_copy;                          //!< A copy of the application's buffers, used when more than one record may be in flight.
 
 	uint64_t headers_sz;                          //!< The size of jaln_pub_data::headers
 	uint64_t sys_meta_sz;                         //!< The size of jaln_pub_data::sys_meta
 	uint64_t app_meta_sz;                         //!< The size of jaln_pub_data::app_meta
 	uint64_t payload_sz;                        //!< The size of jaln_pub_data::payload, or the size of the journal record.
+	uint64_t rec_sz;                            //!< The size of the metadata and payload, kept for the digest list once the buffers are released.
 
 	uint64_t headers_off;                         //!< The current offset into jaln_pub_data::headers
 	uint64_t sys_meta_off;                        //!< The current offset into jaln_pub_data::sys_meta
@@ -124,6 +146,7 @@ struct jaln_pub_data {
 	axl_bool finished_app_meta_break;           //!< Indicates the "BREAK" following the system metadata has been sent.
 	axl_bool finished_payload;                  //!< Indicates the payload has been sent
 	axl_bool finished_payload_break;            //!< Indicates the "BREAK" following the payload has been sent.
+	axl_bool finished;                          //!< Indicates vortex is done with this record, but the application has not been told yet.
 
 	void *dgst_inst;                            //!< An instance of a digest_ctx for a particular record.
 	uint8_t *dgst;                              //!< A buffer to hold the final contents of a digest
@@ -205,16 +228,62 @@ void jaln_pub_data_destroy(struct jaln_pub_data **pub_data);
 /**
  * Cache the calculations of a digest to be sent at a later time.
  *
+ * As a subscriber, this wakes up the thread sending 'digest' messages when
+ * the number of pending digests reaches jaln_session::dgst_list_thresh, or
+ * the records they cover reach jaln_session::dgst_max_bytes.
+ *
  * @param[in] session The session that the digests are associated with.
  * @param[in] nonce The nonce of the record
  * @param[in] dgst_len The length of the digest (in bytes).
+ * @param[in] rec_sz The total size of the record (in bytes).
  *
  * @return JAL_OK on success or an error.
  */
 enum jal_status jaln_session_add_to_dgst_list(jaln_session *sess,
 		char *nonce,
 		uint8_t *dgst_buf,
-		uint64_t dgst_len);
+		uint64_t dgst_len,
+		uint64_t rec_sz);
+
+/**
+ * Update the moving average of the record rate and, if adaptive batching
+ * is enabled, recompute jaln_session::dgst_list_thresh.
+ *
+ * The threshold is the number of records expected to arrive in half of
+ * jaln_session::dgst_timeout, clamped between 1 and
+ * jaln_session::dgst_list_max. A slow trickle of records is confirmed one
+ * at a time, while a fast stream is confirmed in large batches.
+ *
+ * @param[in] sess The session to update, the caller must hold
+ * jaln_session::lock.
+ * @param[in] now The time the latest record arrived.
+ */
+void jaln_session_update_dgst_thresh_no_lock(jaln_session *sess,
+		const struct timeval *now);
+
+/**
+ * Detach the pending digests from the session so they can be sent in a
+ * 'digest' message, and reset the batching state.
+ *
+ * @param[in] sess The session, the caller must hold jaln_session::lock.
+ *
+ * @return The list of jaln_digest_info structures that were pending. The
+ * caller is responsible for freeing it.
+ */
+axlList *jaln_session_take_dgst_list_no_lock(jaln_session *sess);
+
+/**
+ * Determine how long the thread sending 'digest' messages should wait before
+ * the oldest pending digest reaches jaln_session::dgst_timeout.
+ *
+ * @param[in] sess The session, the caller must hold jaln_session::lock.
+ * @param[in] now The current time.
+ *
+ * @return The number of microseconds to wait, jaln_session::dgst_timeout
+ * if there are no pending digests, or 0 if the deadline has passed.
+ */
+long jaln_session_dgst_wait_time_no_lock(jaln_session *sess,
+		const struct timeval *now);
 
 /**
  * Flag this session as 'errored'
@@ -27,6 +27,8 @@
  * limitations under the License.
  */
 
+#include <sys/time.h>
+
 #include "jaln_sub_dgst_channel.h"
 
 #include "jaln_message_helpers.h"
@@ -43,14 +45,34 @@ axlPointer jaln_sub_dgst_wait_thread(axlPointer user_data) {
 
 	vortex_mutex_lock(&sess->lock);
 	while (!sess->errored || !sess->closing) {
-		if (!vortex_cond_timedwait(&sess->sub_data->dgst_list_cond, &sess->lock, sess->dgst_timeout)) {
-			// wait failed? now what... I guess try again?
-			continue;
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		long wait_time = jaln_session_dgst_wait_time_no_lock(sess, &now);
+		// Wait until a count or byte threshold is hit, or until the
+		// oldest pending digest is due.
+		if (!sess->dgst_flush_pending && (0 < wait_time)) {
+			vortex_cond_timedwait(&sess->sub_data->dgst_list_cond, &sess->lock, wait_time);
+			gettimeofday(&now, NULL);
+			if (!sess->dgst_flush_pending && !sess->errored && !sess->closing &&
+					(0 < jaln_session_dgst_wait_time_no_lock(sess, &now))) {
+				continue;
+			}
 		}
 		if (sess->errored || sess->closing) {
+			// On a clean close, the publisher is still waiting on
+			// the digests received so far, so send them first.
+			if (!sess->errored && sess->dgst_chan &&
+					(axl_list_length(sess->dgst_list) > 0)) {
+				axlList *dgst_list = jaln_session_take_dgst_list_no_lock(sess);
+				jaln_send_digest_and_sync_no_lock(sess, dgst_list);
+				axl_list_free(dgst_list);
+			}
 			// try to close the channel;
 			if (sess->dgst_chan) {
 				vortex_channel_close_full(sess->dgst_chan, jaln_session_notify_close, sess);
+				// wait for the channel to go away before
+				// checking again.
+				vortex_cond_timedwait(&sess->sub_data->dgst_list_cond, &sess->lock, sess->dgst_timeout);
 				continue;
 			} else {
 				vortex_mutex_unlock(&sess->lock);
@@ -59,9 +81,7 @@ axlPointer jaln_sub_dgst_wait_thread(axlPointer user_data) {
 		}
 		// no point sending empty digest/sync messages
 		if (axl_list_length(sess->dgst_list) > 0) {
-			axlList *dgst_list = sess->dgst_list;
-			sess->dgst_list =
-				axl_list_new(jaln_axl_equals_func_digest_info_nonce, jaln_axl_destroy_digest_info);
+			axlList *dgst_list = jaln_session_take_dgst_list_no_lock(sess);
 			jaln_send_digest_and_sync_no_lock(sess, dgst_list);
 			axl_list_free(dgst_list);
 		}
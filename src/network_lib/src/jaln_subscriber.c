@@ -285,15 +285,33 @@ enum jal_status jaln_configure_sub_session_no_lock(VortexChannel *chan, jaln_ses
 	if (!session->sub_data) {
 		session->sub_data = jaln_sub_data_create();
 	}
+	struct jaln_subscriber_callbacks *sub_cbs = NULL;
+	if (session->jaln_ctx) {
+		jaln_context *ctx = session->jaln_ctx;
+		sub_cbs = ctx->sub_callbacks;
+		session->dgst_list_max = ctx->dgst_max_records;
+		session->dgst_list_thresh = ctx->dgst_max_records;
+		session->dgst_max_bytes = ctx->dgst_max_bytes;
+		session->dgst_timeout = ctx->dgst_max_age;
+		session->dgst_adaptive = ctx->dgst_adaptive;
+	}
 	switch (session->ch_info->type) {
 	case (JALN_RTYPE_JOURNAL):
 		session->sub_data->sm = jaln_sub_state_create_journal_machine();
 		break;
 	case (JALN_RTYPE_AUDIT):
-		session->sub_data->sm = jaln_sub_state_create_audit_machine();
+		if (sub_cbs && sub_cbs->on_audit_chunk) {
+			session->sub_data->sm = jaln_sub_state_create_audit_chunk_machine();
+		} else {
+			session->sub_data->sm = jaln_sub_state_create_audit_machine();
+		}
 		break;
 	case (JALN_RTYPE_LOG):
-		session->sub_data->sm = jaln_sub_state_create_log_machine();
+		if (sub_cbs && sub_cbs->on_log_chunk) {
+			session->sub_data->sm = jaln_sub_state_create_log_chunk_machine();
+		} else {
+			session->sub_data->sm = jaln_sub_state_create_log_machine();
+		}
 		break;
 	}
 	jaln_sub_state_reset(session);
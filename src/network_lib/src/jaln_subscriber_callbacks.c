@@ -55,8 +55,8 @@ int jaln_subscriber_callbacks_is_valid(struct jaln_subscriber_callbacks *subscri
 	if (!subscriber_callbacks ||
 			!subscriber_callbacks->get_subscribe_request ||
 			!subscriber_callbacks->on_record_info ||
-			!subscriber_callbacks->on_audit ||
-			!subscriber_callbacks->on_log ||
+			(!subscriber_callbacks->on_audit && !subscriber_callbacks->on_audit_chunk) ||
+			(!subscriber_callbacks->on_log && !subscriber_callbacks->on_log_chunk) ||
 			!subscriber_callbacks->on_journal ||
 			!subscriber_callbacks->notify_digest ||
 			!subscriber_callbacks->on_digest_response ||
@@ -27,6 +27,8 @@
  * limitations under the License.
  */
 
+#include <limits.h>
+#include <string.h>
 #include <vortex_frame_factory.h>
 #include "jal_alloc.h"
 #include "jaln_context.h"
@@ -36,30 +38,47 @@
 #include "jaln_string_utils.h"
 #include "jaln_subscriber_state_machine.h"
 
+#define JALN_SUB_MIME_BUF_INIT_SZ 4096
+
 axl_bool jaln_sub_wait_for_mime(jaln_session *session, VortexFrame *frame,
 		__attribute__((unused)) uint64_t frame_off, axl_bool more)
 {
 	if (!session || !session->ch_info || !session->dgst || !session->sub_data->sm || !frame) {
 		goto err_out;
 	}
-	int copied = 0;
-	if (session->sub_data->sm->cached_frame) {
-		jaln_sub_state_append_frame(session, frame);
-		frame = session->sub_data->sm->cached_frame;
-		copied = 1;
-	}
-	if (!vortex_frame_mime_process(frame)) {
-		if (more) {
-			// haven't received the full response, so cache this
-			// frame and wait for more...
-			if (!copied  && !jaln_sub_state_append_frame(session, frame)) {
-				goto err_out;
+	struct jaln_sub_state_machine *sm = session->sub_data->sm;
+	if (sm->mime_buf_len || !vortex_frame_mime_process(frame)) {
+		// The MIME headers span more than one frame, so collect the
+		// frames until an empty line ends the headers, and only then
+		// parse them, once, from a single frame.
+		if (!jaln_sub_state_append_frame(session, frame)) {
+			goto err_out;
+		}
+		if (!jaln_sub_state_mime_headers_complete(sm)) {
+			if (more) {
+				return axl_true;
 			}
-			return axl_true;
+			// no more data expected for this ANS, and couldn't
+			// find the end of the MIME headers, consider it an
+			// error
+			goto err_out;
+		}
+		sm->cached_frame = vortex_frame_create(vortex_frame_get_ctx(frame),
+				vortex_frame_get_type(frame),
+				vortex_frame_get_channel(frame),
+				vortex_frame_get_msgno(frame),
+				vortex_frame_get_more_flag(frame),
+				vortex_frame_get_seqno(frame),
+				(int) sm->mime_buf_len,
+				vortex_frame_get_ansno(frame),
+				sm->mime_buf);
+		if (!sm->cached_frame) {
+			goto err_out;
+		}
+		frame = sm->cached_frame;
+		if (!vortex_frame_mime_process(frame)) {
+			goto err_out;
 		}
-		// no more data expected for this ANS, and couldn't process the
-		// MIME headers, consider it an error
-		goto err_out;
 	}
 	if (!jaln_check_content_type_and_txfr_encoding_are_valid(frame)) {
 		goto err_out;
@@ -109,8 +128,9 @@ axl_bool jaln_sub_wait_for_mime(jaln_session *session, VortexFrame *frame,
 	session->sub_data->sm->app_meta_buf = jal_malloc(session->sub_data->sm->app_meta_sz);
 	session->sub_data->sm->app_meta_off = 0;
 
-	if ((session->ch_info->type == JALN_RTYPE_LOG) ||
-		(session->ch_info->type == JALN_RTYPE_AUDIT)) {
+	if (!session->sub_data->sm->payload_chunks &&
+		((session->ch_info->type == JALN_RTYPE_LOG) ||
+		(session->ch_info->type == JALN_RTYPE_AUDIT))) {
 		session->sub_data->sm->payload_buf = jal_malloc(session->sub_data->sm->payload_sz);
 	}
 
@@ -131,8 +151,7 @@ axl_bool jaln_sub_wait_for_mime(jaln_session *session, VortexFrame *frame,
 
 	jaln_sub_state_transition(session->sub_data->sm, session->sub_data->sm->wait_for_sys_meta);
 	axl_bool ret = session->sub_data->sm->curr_state->frame_handler(session, frame, 0, more);
-	vortex_frame_unref(session->sub_data->sm->cached_frame);
-	session->sub_data->sm->cached_frame = NULL;
+	jaln_sub_state_clear_cached_frames(session->sub_data->sm);
 	return ret;
 err_out:
 	jaln_sub_state_transition(session->sub_data->sm, session->sub_data->sm->error_state);
@@ -225,7 +244,50 @@ axl_bool jaln_copy_buffer(uint8_t *dst, const uint64_t dst_sz, uint64_t *pdst_of
 	return axl_true;
 }
 
-axl_bool jaln_sub_wait_for_journal_payload(jaln_session *session, VortexFrame *frame, uint64_t frame_off, axl_bool more)
+/**
+ * Hand a block of the payload to the callback that takes the payload of \p type
+ * records as it arrives.
+ *
+ * If the callback returns anything other than JAL_OK, the session is marked
+ * as errored so no more records are delivered and no digests are sent for
+ * the records that are still pending.
+ *
+ * @return JAL_OK if the callback accepted the data, or an error otherwise.
+ */
+static enum jal_status jaln_sub_deliver_payload_chunk(jaln_session *session, enum jaln_record_type type,
+		const uint8_t *buf, uint32_t cnt, uint64_t offset, int more)
+{
+	struct jaln_subscriber_callbacks *cbs = session->jaln_ctx->sub_callbacks;
+	int ret = JAL_OK;
+	switch (type) {
+	case JALN_RTYPE_JOURNAL:
+		if (cbs->on_journal) {
+			ret = cbs->on_journal(session, session->ch_info, session->sub_data->sm->nonce,
+					buf, cnt, offset, more, session->jaln_ctx->user_data);
+		}
+		break;
+	case JALN_RTYPE_AUDIT:
+		if (cbs->on_audit_chunk) {
+			ret = cbs->on_audit_chunk(session, session->ch_info, session->sub_data->sm->nonce,
+					buf, cnt, offset, more, session->jaln_ctx->user_data);
+		}
+		break;
+	case JALN_RTYPE_LOG:
+		if (cbs->on_log_chunk) {
+			ret = cbs->on_log_chunk(session, session->ch_info, session->sub_data->sm->nonce,
+					buf, cnt, offset, more, session->jaln_ctx->user_data);
+		}
+		break;
+	}
+	if (JAL_OK != ret) {
+		jaln_session_set_errored(session);
+		return JAL_E_INVAL;
+	}
+	return JAL_OK;
+}
+
+axl_bool jaln_sub_wait_for_payload_chunks(jaln_session *session, VortexFrame *frame, uint64_t frame_off, axl_bool more,
+		enum jaln_record_type type)
 {
 	if (!session || !session->dgst || !session->sub_data->sm || !session->sub_data->sm->dgst_inst || !session->jaln_ctx ||
 			!session->jaln_ctx->sub_callbacks || !frame) {
@@ -252,12 +314,13 @@ axl_bool jaln_sub_wait_for_journal_payload(jaln_session *session, VortexFrame *f
 		goto err_out;
 	}
 
-	session->jaln_ctx->sub_callbacks->on_journal(session, session->ch_info, session->sub_data->sm->nonce,
+	if (JAL_OK != jaln_sub_deliver_payload_chunk(session, type,
 			payload + frame_off,
 			bytes_to_send,
 			session->sub_data->sm->payload_off,
-			1,
-			session->jaln_ctx->user_data);
+			1)) {
+		goto err_out;
+	}
 	if (JAL_OK != session->dgst->update(session->sub_data->sm->dgst_inst, payload + frame_off, bytes_to_send)) {
 		goto err_out;
 	}
@@ -274,6 +337,21 @@ err_out:
 	return axl_false;
 }
 
+axl_bool jaln_sub_wait_for_journal_payload(jaln_session *session, VortexFrame *frame, uint64_t frame_off, axl_bool more)
+{
+	return jaln_sub_wait_for_payload_chunks(session, frame, frame_off, more, JALN_RTYPE_JOURNAL);
+}
+
+axl_bool jaln_sub_wait_for_audit_payload_chunks(jaln_session *session, VortexFrame *frame, uint64_t frame_off, axl_bool more)
+{
+	return jaln_sub_wait_for_payload_chunks(session, frame, frame_off, more, JALN_RTYPE_AUDIT);
+}
+
+axl_bool jaln_sub_wait_for_log_payload_chunks(jaln_session *session, VortexFrame *frame, uint64_t frame_off, axl_bool more)
+{
+	return jaln_sub_wait_for_payload_chunks(session, frame, frame_off, more, JALN_RTYPE_LOG);
+}
+
 axl_bool jaln_sub_wait_for_break_common(jaln_session *session, VortexFrame *frame,
 		uint64_t *frame_off, axl_bool more, axl_bool *break_valid)
 {
@@ -318,19 +396,82 @@ axl_bool jaln_sub_state_append_frame(jaln_session *session, VortexFrame *frame)
 	if (!session || !session->sub_data->sm || !frame) {
 		return axl_false;
 	}
-	if (!session->sub_data->sm->cached_frame) {
-		session->sub_data->sm->cached_frame = frame;
-		vortex_frame_ref(frame);
-		return axl_true;
+	const uint8_t *payload = (const uint8_t*) vortex_frame_get_payload(frame);
+	int payload_sz = vortex_frame_get_payload_size(frame);
+	if (payload_sz < 0 || (!payload && payload_sz)) {
+		return axl_false;
 	}
-	VortexFrame *new_frame = vortex_frame_join(session->sub_data->sm->cached_frame, frame);
-	if (!new_frame) {
+	return jaln_sub_state_append_data(session->sub_data->sm, payload, payload_sz);
+}
+
+axl_bool jaln_sub_state_append_data(struct jaln_sub_state_machine *sm, const uint8_t *data, uint64_t len)
+{
+	if (!sm || (!data && len)) {
 		return axl_false;
 	}
-	vortex_frame_unref(session->sub_data->sm->cached_frame);
-	session->sub_data->sm->cached_frame = new_frame;
+	// The collected data is handed to vortex as a single frame.
+	if (len > (uint64_t) INT_MAX - sm->mime_buf_len) {
+		return axl_false;
+	}
+	uint64_t needed = sm->mime_buf_len + len;
+	if (needed > sm->mime_buf_sz) {
+		uint64_t new_sz = sm->mime_buf_sz ? sm->mime_buf_sz : JALN_SUB_MIME_BUF_INIT_SZ;
+		while (new_sz < needed) {
+			new_sz *= 2;
+		}
+		sm->mime_buf = jal_realloc(sm->mime_buf, new_sz);
+		sm->mime_buf_sz = new_sz;
+	}
+	if (len) {
+		memcpy(sm->mime_buf + sm->mime_buf_len, data, len);
+	}
+	sm->mime_buf_len = needed;
 	return axl_true;
 }
+
+axl_bool jaln_sub_state_mime_headers_complete(struct jaln_sub_state_machine *sm)
+{
+	if (!sm) {
+		return axl_false;
+	}
+	const uint8_t *buf = sm->mime_buf;
+	uint64_t len = sm->mime_buf_len;
+	uint64_t line = sm->mime_scan_off;
+
+	while (line < len) {
+		if ('\n' == buf[line]) {
+			return axl_true;
+		}
+		if ('\r' == buf[line]) {
+			if (line + 1 == len) {
+				// Wait to see if this is a CRLF.
+				break;
+			}
+			if ('\n' == buf[line + 1]) {
+				return axl_true;
+			}
+		}
+		const uint8_t *eol = memchr(buf + line, '\n', len - line);
+		if (!eol) {
+			break;
+		}
+		line = (eol - buf) + 1;
+	}
+	sm->mime_scan_off = line;
+	return axl_false;
+}
+
+void jaln_sub_state_clear_cached_frames(struct jaln_sub_state_machine *sm)
+{
+	if (!sm) {
+		return;
+	}
+	vortex_frame_unref(sm->cached_frame);
+	sm->cached_frame = NULL;
+	sm->mime_buf_len = 0;
+	sm->mime_scan_off = 0;
+}
+
 axl_bool jaln_sub_audit_record_complete(jaln_session *session, VortexFrame *frame, uint64_t frame_off, axl_bool more)
 {
 	if (!session || !session->dgst || !session->jaln_ctx ||
@@ -358,7 +499,9 @@ axl_bool jaln_sub_audit_record_complete(jaln_session *session, VortexFrame *fram
 	session->jaln_ctx->sub_callbacks->notify_digest(session, session->ch_info, session->ch_info->type,
 			session->sub_data->sm->nonce, session->sub_data->sm->dgst, dgst_len, session->jaln_ctx->user_data);
 	vortex_mutex_unlock(&session->lock);
-	jaln_session_add_to_dgst_list(session, session->sub_data->sm->nonce, session->sub_data->sm->dgst, dgst_len);
+	jaln_session_add_to_dgst_list(session, session->sub_data->sm->nonce, session->sub_data->sm->dgst, dgst_len,
+			session->sub_data->sm->sys_meta_sz + session->sub_data->sm->app_meta_sz +
+			session->sub_data->sm->payload_sz);
 	session->jaln_ctx->sub_callbacks->message_complete(session, session->ch_info, session->ch_info->type, session->jaln_ctx->user_data);
 	jaln_sub_state_reset(session);
 	jaln_sub_state_transition(session->sub_data->sm, session->sub_data->sm->wait_for_mime);
@@ -393,7 +536,9 @@ axl_bool jaln_sub_log_record_complete(jaln_session *session, VortexFrame *frame,
 	session->jaln_ctx->sub_callbacks->notify_digest(session, session->ch_info, session->ch_info->type,
 			session->sub_data->sm->nonce, session->sub_data->sm->dgst, dgst_len, session->jaln_ctx->user_data);
 	vortex_mutex_unlock(&session->lock);
-	jaln_session_add_to_dgst_list(session, session->sub_data->sm->nonce, session->sub_data->sm->dgst, dgst_len);
+	jaln_session_add_to_dgst_list(session, session->sub_data->sm->nonce, session->sub_data->sm->dgst, dgst_len,
+			session->sub_data->sm->sys_meta_sz + session->sub_data->sm->app_meta_sz +
+			session->sub_data->sm->payload_sz);
 	session->jaln_ctx->sub_callbacks->message_complete(session, session->ch_info, session->ch_info->type, session->jaln_ctx->user_data);
 	jaln_sub_state_reset(session);
 	jaln_sub_state_transition(session->sub_data->sm, session->sub_data->sm->wait_for_mime);
@@ -402,7 +547,8 @@ err_out:
 	jaln_sub_state_transition(session->sub_data->sm, session->sub_data->sm->error_state);
 	return axl_false;
 }
-axl_bool jaln_sub_journal_record_complete(jaln_session *session, VortexFrame *frame, uint64_t frame_off, axl_bool more)
+axl_bool jaln_sub_chunked_record_complete(jaln_session *session, VortexFrame *frame, uint64_t frame_off, axl_bool more,
+		enum jaln_record_type type)
 {
 	if (!session || !session->dgst || !session->jaln_ctx || !session->jaln_ctx->sub_callbacks || !session->sub_data->sm) {
 		goto err_out;
@@ -412,7 +558,9 @@ axl_bool jaln_sub_journal_record_complete(jaln_session *session, VortexFrame *fr
 	}
 
 	size_t dgst_len = session->dgst->len;
-	session->jaln_ctx->sub_callbacks->on_journal(session, session->ch_info, session->sub_data->sm->nonce, NULL, 0, 0, 0, session->jaln_ctx->user_data);
+	if (JAL_OK != jaln_sub_deliver_payload_chunk(session, type, NULL, 0, 0, 0)) {
+		goto err_out;
+	}
 	if (JAL_OK != session->dgst->final(session->sub_data->sm->dgst_inst, session->sub_data->sm->dgst, &dgst_len)) {
 		goto err_out;
 	}
@@ -420,7 +568,9 @@ axl_bool jaln_sub_journal_record_complete(jaln_session *session, VortexFrame *fr
 	session->jaln_ctx->sub_callbacks->notify_digest(session, session->ch_info, session->ch_info->type, session->sub_data->sm->nonce,
 			session->sub_data->sm->dgst, dgst_len, session->jaln_ctx->user_data);
 	vortex_mutex_unlock(&session->lock);
-	jaln_session_add_to_dgst_list(session, session->sub_data->sm->nonce, session->sub_data->sm->dgst, dgst_len);
+	jaln_session_add_to_dgst_list(session, session->sub_data->sm->nonce, session->sub_data->sm->dgst, dgst_len,
+			session->sub_data->sm->sys_meta_sz + session->sub_data->sm->app_meta_sz +
+			session->sub_data->sm->payload_sz);
 	session->jaln_ctx->sub_callbacks->message_complete(session, session->ch_info, session->ch_info->type, session->jaln_ctx->user_data);
 	jaln_sub_state_reset(session);
 	jaln_sub_state_transition(session->sub_data->sm, session->sub_data->sm->wait_for_mime);
@@ -429,6 +579,21 @@ err_out:
 	jaln_sub_state_transition(session->sub_data->sm, session->sub_data->sm->error_state);
 	return axl_false;
 }
+
+axl_bool jaln_sub_journal_record_complete(jaln_session *session, VortexFrame *frame, uint64_t frame_off, axl_bool more)
+{
+	return jaln_sub_chunked_record_complete(session, frame, frame_off, more, JALN_RTYPE_JOURNAL);
+}
+
+axl_bool jaln_sub_audit_chunks_record_complete(jaln_session *session, VortexFrame *frame, uint64_t frame_off, axl_bool more)
+{
+	return jaln_sub_chunked_record_complete(session, frame, frame_off, more, JALN_RTYPE_AUDIT);
+}
+
+axl_bool jaln_sub_log_chunks_record_complete(jaln_session *session, VortexFrame *frame, uint64_t frame_off, axl_bool more)
+{
+	return jaln_sub_chunked_record_complete(session, frame, frame_off, more, JALN_RTYPE_LOG);
+}
 axl_bool jaln_sub_rec_complete_sanity_check(jaln_session *session, VortexFrame *frame, uint64_t frame_off, axl_bool more)
 {
 	if (!session || !session->sub_data->sm || !frame) {
@@ -601,8 +766,7 @@ void jaln_sub_state_reset(jaln_session *session)
 	sm->payload_off = 0;
 	memset(sm->break_buf, 0, sm->break_sz);
 	sm->break_off = 0;
-	vortex_frame_unref(sm->cached_frame);
-	sm->cached_frame = NULL;
+	jaln_sub_state_clear_cached_frames(sm);
 	if (session->sub_data->sm->dgst_inst) {
 		session->dgst->destroy(sm->dgst_inst);
 	}
@@ -655,6 +819,36 @@ struct jaln_sub_state_machine *jaln_sub_state_create_log_machine()
 	sm->record_complete->frame_handler = jaln_sub_log_record_complete;
 	return sm;
 }
+struct jaln_sub_state_machine *jaln_sub_state_create_audit_chunk_machine()
+{
+	struct jaln_sub_state_machine *sm = jaln_sub_state_machine_create_common(JALN_MSG_AUDIT, JALN_HDRS_AUDIT_LEN);
+
+	sm->wait_for_payload = jaln_sub_state_create();
+	sm->wait_for_payload->name = jal_strdup("WaitForAuditPayloadChunks");
+	sm->wait_for_payload->frame_handler = jaln_sub_wait_for_audit_payload_chunks;
+
+	sm->record_complete = jaln_sub_state_create();
+	sm->record_complete->name = jal_strdup("AuditComplete");
+	sm->record_complete->frame_handler = jaln_sub_audit_chunks_record_complete;
+
+	sm->payload_chunks = axl_true;
+	return sm;
+}
+struct jaln_sub_state_machine *jaln_sub_state_create_log_chunk_machine()
+{
+	struct jaln_sub_state_machine *sm = jaln_sub_state_machine_create_common(JALN_MSG_LOG, JALN_HDRS_LOG_LEN);
+
+	sm->wait_for_payload = jaln_sub_state_create();
+	sm->wait_for_payload->name = jal_strdup("WaitForLogPayloadChunks");
+	sm->wait_for_payload->frame_handler = jaln_sub_wait_for_log_payload_chunks;
+
+	sm->record_complete = jaln_sub_state_create();
+	sm->record_complete->name = jal_strdup("LogComplete");
+	sm->record_complete->frame_handler = jaln_sub_log_chunks_record_complete;
+
+	sm->payload_chunks = axl_true;
+	return sm;
+}
 struct jaln_sub_state_machine *jaln_sub_state_machine_create_common(const char *expected_msg, const char *payload_len_hdr)
 {
 	if (!expected_msg || !payload_len_hdr) {
@@ -716,6 +910,7 @@ void jaln_sub_state_machine_destroy(struct jaln_sub_state_machine **psm)
 	free(sm->payload_buf);
 	free(sm->break_buf);
 	free(sm->dgst);
+	free(sm->mime_buf);
 
 	vortex_frame_unref(sm->cached_frame);
 
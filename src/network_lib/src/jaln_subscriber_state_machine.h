@@ -83,7 +83,12 @@ struct jaln_sub_state_machine {
 	uint8_t *break_buf;                //!< bufer to hold the break string between data segments
 	uint64_t break_sz;                 //!< size of the break string
 	uint64_t break_off;                //!< offset into the bufer to begin writing the next hunk of data
-	VortexFrame *cached_frame;         //!< used to collect frames until the complete MIME headers are available.
+	uint8_t *mime_buf;                 //!< used to collect the payload of frames until the complete MIME headers are available.
+	uint64_t mime_buf_sz;              //!< the allocated size of mime_buf
+	uint64_t mime_buf_len;             //!< the number of bytes collected in mime_buf
+	uint64_t mime_scan_off;            //!< the start of the first line in mime_buf that is not known to be complete
+	VortexFrame *cached_frame;         //!< a single frame holding the contents of mime_buf, once the complete MIME headers are available.
+	axl_bool payload_chunks;           //!< Indicates the payload is handed to the application as it arrives, rather than collected in payload_buf.
 	void *dgst_inst;                   //!< An instance of a digest_ctx for a particular record.
 	uint8_t *dgst;                     //!< A buffer to hold the final contents of a digest
 
@@ -182,6 +187,27 @@ axl_bool jaln_sub_wait_for_app_meta_break(jaln_session *session, VortexFrame *fr
  */
 axl_bool jaln_sub_wait_for_journal_payload(jaln_session *session, VortexFrame *frame, uint64_t payload_offset, axl_bool more);
 
+/**
+ * Frame handler for processing the payload of a record as it arrives. Each
+ * hunk of data is handed to the \p on_journal, \p on_audit_chunk or \p
+ * on_log_chunk callback, depending on \p type.
+ * @see jaln_sub_state::frame_handler
+ */
+axl_bool jaln_sub_wait_for_payload_chunks(jaln_session *session, VortexFrame *frame, uint64_t payload_offset, axl_bool more,
+		enum jaln_record_type type);
+
+/**
+ * Frame handler for processing an audit record payload as it arrives.
+ * @see jaln_sub_wait_for_payload_chunks
+ */
+axl_bool jaln_sub_wait_for_audit_payload_chunks(jaln_session *session, VortexFrame *frame, uint64_t payload_offset, axl_bool more);
+
+/**
+ * Frame handler for processing a log record payload as it arrives.
+ * @see jaln_sub_wait_for_payload_chunks
+ */
+axl_bool jaln_sub_wait_for_log_payload_chunks(jaln_session *session, VortexFrame *frame, uint64_t payload_offset, axl_bool more);
+
 /**
  * Helper function for processing the 'BREAK' strings
  * @param[in] session The jaln_session
@@ -211,12 +237,36 @@ axl_bool jaln_sub_wait_for_break_common(jaln_session *session, VortexFrame *fram
  */
 axl_bool jaln_sub_rec_complete_sanity_check(jaln_session *session, VortexFrame *frame, uint64_t payload_offset, axl_bool more);
 
+/**
+ * The frame handler for finalizing a record whose payload was handed to the
+ * application as it arrived, see jaln_sub_wait_for_payload_chunks(). The
+ * callback for \p type is called a final time, with no data and \p more set
+ * to 0.
+ * @see jaln_sub_state::frame_handler
+ */
+axl_bool jaln_sub_chunked_record_complete(jaln_session *session, VortexFrame *frame, uint64_t payload_offset, axl_bool more,
+		enum jaln_record_type type);
+
 /**
  * The frame handler for finalizing a journal record
  * @see jaln_sub_state::frame_handler
  */
 axl_bool jaln_sub_journal_record_complete(jaln_session *session, VortexFrame *frame, uint64_t payload_offset, axl_bool more);
 
+/**
+ * The frame handler for finalizing an audit record received with
+ * jaln_sub_wait_for_audit_payload_chunks()
+ * @see jaln_sub_state::frame_handler
+ */
+axl_bool jaln_sub_audit_chunks_record_complete(jaln_session *session, VortexFrame *frame, uint64_t payload_offset, axl_bool more);
+
+/**
+ * The frame handler for finalizing a log record received with
+ * jaln_sub_wait_for_log_payload_chunks()
+ * @see jaln_sub_state::frame_handler
+ */
+axl_bool jaln_sub_log_chunks_record_complete(jaln_session *session, VortexFrame *frame, uint64_t payload_offset, axl_bool more);
+
 /**
  * The frame handler for finalizing an audit record.
  * @see jaln_sub_state::frame_handler
@@ -245,12 +295,53 @@ axl_bool jaln_sub_state_error_state(jaln_session *session, VortexFrame *frame, u
 void jaln_sub_state_reset(jaln_session *session);
 
 /**
- * Helper function to cache a frame within the state machine.
+ * Helper function to cache the payload of a frame within the state machine,
+ * until the complete MIME headers are available.
+ *
+ * The payload is appended to jaln_sub_state_machine::mime_buf, which grows
+ * geometrically, so collecting headers that span many frames takes time
+ * linear in their size instead of copying everything received so far for
+ * each frame.
  *
  * @param[in] session The session to cache the frame on.
+ * @param[in] frame The frame to cache.
+ *
+ * @return axl_true on success, axl_false otherwise.
  */
 axl_bool jaln_sub_state_append_frame(jaln_session *session, VortexFrame *frame);
 
+/**
+ * Helper function to append data to jaln_sub_state_machine::mime_buf.
+ *
+ * @param[in] sm The state machine.
+ * @param[in] data The data to append.
+ * @param[in] len The number of bytes to append.
+ *
+ * @return axl_true on success, axl_false if the cached data would be too
+ * large to fit in a single frame.
+ */
+axl_bool jaln_sub_state_append_data(struct jaln_sub_state_machine *sm, const uint8_t *data, uint64_t len);
+
+/**
+ * Helper function to check whether the data cached in
+ * jaln_sub_state_machine::mime_buf contains the complete MIME headers, i.e.
+ * an empty line terminated by CRLF or LF. Lines already scanned by a previous
+ * call are not scanned again.
+ *
+ * @param[in] sm The state machine.
+ *
+ * @return axl_true if the MIME headers are complete, axl_false otherwise.
+ */
+axl_bool jaln_sub_state_mime_headers_complete(struct jaln_sub_state_machine *sm);
+
+/**
+ * Helper function to discard the data collected while waiting for the MIME
+ * headers. The buffer is kept for the next record.
+ *
+ * @param[in] sm The state machine.
+ */
+void jaln_sub_state_clear_cached_frames(struct jaln_sub_state_machine *sm);
+
 /**
  * Helper function to safely copy data between 2 buffers. Note that the buffers
  * must not overlap, and calling this function with overlapping buffers is
@@ -301,6 +392,21 @@ struct jaln_sub_state_machine *jaln_sub_state_create_audit_machine();
  */
 struct jaln_sub_state_machine *jaln_sub_state_create_log_machine();
 
+/**
+ * Utility to create a state machine for processing audit records that hands
+ * the payload to the \p on_audit_chunk callback as it arrives, instead of
+ * collecting the whole record in memory.
+ * @return A jaln_sub_state_machine for processing audit records.
+ */
+struct jaln_sub_state_machine *jaln_sub_state_create_audit_chunk_machine();
+
+/**
+ * Utility to create a state machine for processing log records that hands
+ * the payload to the \p on_log_chunk callback as it arrives.
+ * @return A jaln_sub_state_machine for processing log records.
+ */
+struct jaln_sub_state_machine *jaln_sub_state_create_log_chunk_machine();
+
 /**
  * Clean up all resources of a jaln_sub_state_machine
  * @param[in,out] sm The jaln_sub_state_machine to destroy, this will be set to
@@ -75,6 +75,43 @@ void test_context_create()
 	assert_false(ctx->is_connected);
 }
 
+void test_set_send_window()
+{
+	assert_equals(JALN_DEFAULT_SEND_WINDOW, ctx->send_window);
+	assert_equals(JAL_OK, jaln_set_send_window(ctx, 4));
+	assert_equals(4, ctx->send_window);
+}
+
+void test_set_send_window_fails_with_bad_input()
+{
+	assert_equals(JAL_E_INVAL, jaln_set_send_window(NULL, 4));
+	assert_equals(JAL_E_INVAL, jaln_set_send_window(ctx, 0));
+	assert_equals(JAL_E_INVAL, jaln_set_send_window(ctx, -1));
+	assert_equals(JALN_DEFAULT_SEND_WINDOW, ctx->send_window);
+}
+
+void test_set_digest_batching()
+{
+	assert_equals(JALN_SESSION_DEFAULT_DGST_LIST_MAX, ctx->dgst_max_records);
+	assert_equals(0, ctx->dgst_max_bytes);
+	assert_equals(JALN_SESSION_DEFAULT_DGST_TIMEOUT_MICROS, ctx->dgst_max_age);
+	assert_false(ctx->dgst_adaptive);
+
+	assert_equals(JAL_OK, jaln_set_digest_batching(ctx, 100, 4096, 250, 1));
+	assert_equals(100, ctx->dgst_max_records);
+	assert_equals(4096, ctx->dgst_max_bytes);
+	assert_equals(250000, ctx->dgst_max_age);
+	assert_true(ctx->dgst_adaptive);
+}
+
+void test_set_digest_batching_fails_with_bad_input()
+{
+	assert_equals(JAL_E_INVAL, jaln_set_digest_batching(NULL, 100, 0, 250, 0));
+	assert_equals(JAL_E_INVAL, jaln_set_digest_batching(ctx, 0, 0, 250, 0));
+	assert_equals(JAL_E_INVAL, jaln_set_digest_batching(ctx, 100, 0, 0, 0));
+	assert_equals(JALN_SESSION_DEFAULT_DGST_LIST_MAX, ctx->dgst_max_records);
+}
+
 void test_context_destroy_does_not_crash()
 {
 	struct jaln_context_t *ctx = NULL;
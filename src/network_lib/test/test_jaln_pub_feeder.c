@@ -55,6 +55,8 @@
 #define EXPECTED_MSG HEADERS SYS_META "BREAK" APP_META "BREAK" PAYLOAD "BREAK"
 
 static axl_bool finalized_called;
+static int records_completed;
+static char *completed_nonces[4];
 
 static VortexPayloadFeeder *fake_vortex_payload_feeder_new (
 		__attribute__((unused)) VortexPayloadFeederHandler handler,
@@ -96,12 +98,16 @@ axl_bool fake_send_ans_rpy_from_feeder(
 	return axl_true;
 }
 
+static uint64_t dgst_list_rec_sz;
+
 enum jal_status fake_add_to_dgst_list(
 		__attribute__((unused)) jaln_session *sess,
 		__attribute__((unused)) char *nonce,
 		__attribute__((unused)) uint8_t *dgst_buf,
-		__attribute__((unused)) uint64_t dgst_len)
+		__attribute__((unused)) uint64_t dgst_len,
+		uint64_t rec_sz)
 {
+	dgst_list_rec_sz = rec_sz;
 	return JAL_OK;
 }
 
@@ -149,9 +155,13 @@ enum jal_status my_on_record_complete(
 		__attribute__((unused)) jaln_session *sess,
 		__attribute__((unused)) const struct jaln_channel_info *ch_info,
 		__attribute__((unused)) enum jaln_record_type type,
-		__attribute__((unused)) char *nonce,
+		char *nonce,
 		__attribute__((unused)) void *user_data)
 {
+	if (records_completed < 4) {
+		completed_nonces[records_completed] = nonce;
+	}
+	records_completed++;
 	return JAL_OK;
 }
 
@@ -208,6 +218,7 @@ void setup()
 	sess->ch_info->type = JALN_RTYPE_LOG;
 	sess->dgst = sess->jaln_ctx->sha256_digest;
 	sess->pub_data = jaln_pub_data_create();
+	sess->pub_data->sess = sess;
 	sess->role = JALN_ROLE_PUBLISHER;
 	sess->pub_data->headers_sz = strlen(HEADERS);
 	sess->pub_data->sys_meta_sz = strlen(SYS_META);
@@ -225,6 +236,9 @@ void setup()
 	sess->jaln_ctx->pub_callbacks = pub_cbs;
 
 	finalized_called = axl_false;
+	records_completed = 0;
+	dgst_list_rec_sz = 0;
+	memset(completed_nonces, 0, sizeof(completed_nonces));
 }
 
 void teardown()
@@ -236,7 +250,7 @@ void test_pub_feeder_is_finished_returns_true_if_errored()
 {
 	int fin = 0;
 	sess->errored = axl_true;
-	assert_true(jaln_pub_feeder_is_finished(sess, &fin));
+	assert_true(jaln_pub_feeder_is_finished(sess->pub_data, &fin));
 	assert_true(fin);
 }
 
@@ -244,7 +258,7 @@ void test_pub_feeder_is_finished_returns_true_after_payload_break_is_written()
 {
 	int fin = 0;
 	sess->pub_data->finished_payload_break = axl_true;
-	assert_true(jaln_pub_feeder_is_finished(sess, &fin));
+	assert_true(jaln_pub_feeder_is_finished(sess->pub_data, &fin));
 	assert_true(fin);
 }
 
@@ -252,7 +266,7 @@ void test_pub_feeder_is_finished_returns_false_before_payload_break_is_written()
 {
 	int fin = 1;
 	sess->pub_data->finished_payload_break = axl_false;
-	assert_false(jaln_pub_feeder_is_finished(sess, &fin));
+	assert_false(jaln_pub_feeder_is_finished(sess->pub_data, &fin));
 	assert_false(fin);
 }
 
@@ -261,10 +275,33 @@ void test_pub_feeder_get_size_returns_cached_size()
 	int sz = 0;
 	sess->pub_data->vortex_feeder_sz = 24;
 	sess->pub_data->finished_payload_break = axl_false;
-	assert_true(jaln_pub_feeder_get_size(sess, &sz));
+	assert_true(jaln_pub_feeder_get_size(sess->pub_data, &sz));
 	assert_equals(24, sz);
 }
 
+void test_pub_feeder_get_size_returns_bytes_left()
+{
+	int sz = 0;
+	sess->pub_data->vortex_feeder_sz = 24;
+	sess->pub_data->vortex_feeder_off = 10;
+	assert_true(jaln_pub_feeder_get_size(sess->pub_data, &sz));
+	assert_equals(14, sz);
+}
+
+void test_pub_feeder_get_size_caps_large_records_at_int_max()
+{
+	int sz = 0;
+	struct jaln_pub_data *pd = sess->pub_data;
+	pd->vortex_feeder_sz = 3 * (uint64_t) INT_MAX;
+	pd->vortex_feeder_off = 0;
+	assert_true(jaln_pub_feeder_get_size(pd, &sz));
+	assert_equals(INT_MAX, sz);
+
+	pd->vortex_feeder_off = 2 * (uint64_t) INT_MAX + 5;
+	assert_true(jaln_pub_feeder_get_size(pd, &sz));
+	assert_equals(INT_MAX - 5, sz);
+}
+
 void test_pub_feeder_calculate_size_works_correctly()
 {
 	struct jaln_pub_data *pd = sess->pub_data;
@@ -272,50 +309,103 @@ void test_pub_feeder_calculate_size_works_correctly()
 	pd->app_meta_sz = 20;
 	pd->payload_sz = 30;
 	pd->headers_sz = 40;
-	pd->vortex_feeder_sz = -1;
+	pd->vortex_feeder_sz = 1;
+	pd->vortex_feeder_off = 1;
 	jaln_pub_feeder_calculate_size_for_vortex(sess);
 	// The size is the length of all the data sections, headers, and the
 	// intervening "BREAK" strings
 	assert_equals(10 + 20 + 30 + 40 + (strlen("BREAK") * 3), pd->vortex_feeder_sz);
+	assert_equals(0, pd->vortex_feeder_off);
 }
 
-void test_pub_feeder_calculate_size_returns_int_max_on_overflow()
+void test_pub_feeder_calculate_size_works_for_records_over_int_max()
 {
 	struct jaln_pub_data *pd = sess->pub_data;
 	pd->sys_meta_sz = INT_MAX;
 	pd->app_meta_sz = 1;
-	pd->payload_sz = 1;
+	pd->payload_sz = 5 * (uint64_t) INT_MAX;
 	pd->headers_sz = 1;
-	pd->vortex_feeder_sz = -1;
 	jaln_pub_feeder_calculate_size_for_vortex(sess);
-	// The size is the length of all the data sections, headers, and the
-	// intervening "BREAK" strings
-	assert_equals(INT_MAX, pd->vortex_feeder_sz);
+	assert_true((6 * (uint64_t) INT_MAX + 2 + (strlen("BREAK") * 3)) == pd->vortex_feeder_sz);
 }
 
-void test_safe_add_works()
+void test_pub_feeder_calculate_size_returns_uint64_max_on_overflow()
 {
-	int cnt = 0;
-	assert_true(jaln_pub_feeder_safe_add_size(&cnt, 1));
-	assert_equals(1, cnt);
+	struct jaln_pub_data *pd = sess->pub_data;
+	pd->sys_meta_sz = 1;
+	pd->app_meta_sz = 1;
+	pd->payload_sz = UINT64_MAX;
+	pd->headers_sz = 1;
+	jaln_pub_feeder_calculate_size_for_vortex(sess);
+	assert_true(UINT64_MAX == pd->vortex_feeder_sz);
+}
+
+void test_fill_buffer_sends_journal_record_across_frames()
+{
+	struct jaln_pub_data *pd = sess->pub_data;
+	char buf[sizeof(EXPECTED_MSG)];
+	char frame[8];
+	size_t total = 0;
+	int sz = 0;
+	int fin = 0;
+	uint8_t expected_dgst[32];
+	size_t dgst_len = sizeof(expected_dgst);
 
-	assert_true(jaln_pub_feeder_safe_add_size(&cnt, 200));
-	assert_equals(201, cnt);
+	sess->ch_info->type = JALN_RTYPE_JOURNAL;
+	jaln_pub_feeder_reset_state(sess);
+	pd->headers = jal_strdup(HEADERS);
+	pd->sys_meta = (uint8_t*) SYS_META;
+	pd->app_meta = (uint8_t*) APP_META;
+	pd->journal_feeder.get_bytes = journal_get_bytes;
+	jaln_pub_feeder_calculate_size_for_vortex(sess);
+
+	while (!jaln_pub_feeder_is_finished(pd, &fin)) {
+		assert_true(jaln_pub_feeder_get_size(pd, &sz));
+		assert_equals((int) (VORTEX_SZ - total), sz);
+		sz = sizeof(frame);
+		assert_true(jaln_pub_feeder_fill_buffer(pd, frame, &sz));
+		assert_true(0 < sz);
+		memcpy(buf + total, frame, sz);
+		total += sz;
+	}
+	assert_equals(VORTEX_SZ, total);
+	assert_equals(0, memcmp(EXPECTED_MSG, buf, total));
+
+	// The digest covers the whole payload, not just the last frame.
+	void *inst = sess->dgst->create();
+	sess->dgst->init(inst);
+	sess->dgst->update(inst, (uint8_t*) PAYLOAD, strlen(PAYLOAD));
+	sess->dgst->final(inst, expected_dgst, &dgst_len);
+	sess->dgst->destroy(inst);
+	assert_equals(0, memcmp(expected_dgst, pd->dgst, dgst_len));
+	assert_equals(strlen(SYS_META) + strlen(APP_META) + strlen(PAYLOAD), dgst_list_rec_sz);
 }
 
-void test_safe_add_returns_false_on_overflow()
+void test_fill_buffer_fails_when_journal_is_short()
 {
-	int cnt = 1;
-	assert_false(jaln_pub_feeder_safe_add_size(&cnt, INT_MAX));
-	assert_equals(INT_MAX, cnt);
+	struct jaln_pub_data *pd = sess->pub_data;
+	char buf[sizeof(EXPECTED_MSG) + 16];
+	int sz = sizeof(buf);
+
+	sess->ch_info->type = JALN_RTYPE_JOURNAL;
+	jaln_pub_feeder_reset_state(sess);
+	pd->headers = jal_strdup(HEADERS);
+	pd->sys_meta = (uint8_t*) SYS_META;
+	pd->app_meta = (uint8_t*) APP_META;
+	pd->payload_sz = strlen(PAYLOAD) + 10;
+	pd->journal_feeder.get_bytes = journal_get_bytes;
+	jaln_pub_feeder_calculate_size_for_vortex(sess);
 
+	assert_false(jaln_pub_feeder_fill_buffer(pd, buf, &sz));
 }
 
 void test_reset_state_clears_all_variables()
 {
-	sess->pub_data->vortex_feeder_sz = -1;
+	sess->pub_data->vortex_feeder_sz = 100;
+	sess->pub_data->vortex_feeder_off = 50;
 	jaln_pub_feeder_reset_state(sess);
 	assert_equals(0, sess->pub_data->vortex_feeder_sz);
+	assert_equals(0, sess->pub_data->vortex_feeder_off);
 	assert_equals(0, sess->pub_data->headers_off);
 	assert_equals(0, sess->pub_data->sys_meta_off);
 	assert_equals(0, sess->pub_data->payload_off);
@@ -337,3 +427,141 @@ void test_reset_state_does_not_leak()
 	jaln_pub_feeder_reset_state(sess);
 	jaln_pub_feeder_reset_state(sess);
 }
+
+void test_create_window_uses_context_send_window()
+{
+	struct jaln_pub_data *pd = sess->pub_data;
+	sess->jaln_ctx->send_window = 3;
+	jaln_pub_feeder_create_window(sess);
+	assert_not_equals((void*)NULL, sess->pub_window);
+	assert_equals(3, sess->pub_window_sz);
+	assert_equals(0, sess->pub_window_head);
+	assert_equals(0, sess->pub_window_cnt);
+	assert_pointer_equals(pd, sess->pub_window[0]);
+	assert_pointer_equals((void*)NULL, sess->pub_window[1]);
+	assert_pointer_equals(pd, sess->pub_data);
+}
+
+void test_copy_buffers_copies_audit_and_log_data()
+{
+	uint8_t sys_meta[] = SYS_META;
+	uint8_t app_meta[] = APP_META;
+	uint8_t payload[] = PAYLOAD;
+	struct jaln_pub_data *pd = sess->pub_data;
+	pd->sys_meta = sys_meta;
+	pd->app_meta = app_meta;
+	pd->payload = payload;
+
+	jaln_pub_feeder_copy_buffers(pd, JALN_RTYPE_LOG);
+
+	assert_not_equals((void*)NULL, pd->buf_copy);
+	assert_not_equals((void*)sys_meta, pd->sys_meta);
+	assert_not_equals((void*)app_meta, pd->app_meta);
+	assert_not_equals((void*)payload, pd->payload);
+	assert_equals(0, memcmp(SYS_META, pd->sys_meta, strlen(SYS_META)));
+	assert_equals(0, memcmp(APP_META, pd->app_meta, strlen(APP_META)));
+	assert_equals(0, memcmp(PAYLOAD, pd->payload, strlen(PAYLOAD)));
+	assert_equals(strlen(SYS_META), pd->sys_meta_sz);
+	assert_equals(strlen(APP_META), pd->app_meta_sz);
+	assert_equals(strlen(PAYLOAD), pd->payload_sz);
+}
+
+void test_copy_buffers_does_not_copy_journal_payload()
+{
+	uint8_t sys_meta[] = SYS_META;
+	uint8_t app_meta[] = APP_META;
+	struct jaln_pub_data *pd = sess->pub_data;
+	pd->sys_meta = sys_meta;
+	pd->app_meta = app_meta;
+	pd->payload = NULL;
+	pd->payload_sz = 1024 * 1024 * 1024;
+
+	jaln_pub_feeder_copy_buffers(pd, JALN_RTYPE_JOURNAL);
+
+	assert_not_equals((void*)NULL, pd->buf_copy);
+	assert_equals(0, memcmp(SYS_META, pd->sys_meta, strlen(SYS_META)));
+	assert_equals(0, memcmp(APP_META, pd->app_meta, strlen(APP_META)));
+	assert_pointer_equals((void*)NULL, pd->payload);
+}
+
+void test_release_buffers_clears_pointers_and_sizes()
+{
+	uint8_t sys_meta[] = SYS_META;
+	uint8_t app_meta[] = APP_META;
+	uint8_t payload[] = PAYLOAD;
+	struct jaln_pub_data *pd = sess->pub_data;
+	pd->sys_meta = sys_meta;
+	pd->app_meta = app_meta;
+	pd->payload = payload;
+	jaln_pub_feeder_copy_buffers(pd, JALN_RTYPE_AUDIT);
+
+	// run under valgrind to make sure the copy is freed
+	jaln_pub_feeder_release_buffers(pd);
+	assert_pointer_equals((void*)NULL, pd->buf_copy);
+	assert_pointer_equals((void*)NULL, pd->sys_meta);
+	assert_pointer_equals((void*)NULL, pd->app_meta);
+	assert_pointer_equals((void*)NULL, pd->payload);
+	assert_equals(0, pd->sys_meta_sz);
+	assert_equals(0, pd->app_meta_sz);
+	assert_equals(0, pd->payload_sz);
+}
+
+void test_begin_next_record_moves_to_next_slot_when_window_has_room()
+{
+	uint8_t sys_meta[] = SYS_META;
+	uint8_t app_meta[] = APP_META;
+	uint8_t payload[] = PAYLOAD;
+	struct jaln_record_info rec_info;
+	memset(&rec_info, 0, sizeof(rec_info));
+	struct jaln_pub_data *first = sess->pub_data;
+	first->sys_meta = sys_meta;
+	first->app_meta = app_meta;
+	first->payload = payload;
+	first->msg_no = 7;
+	sess->jaln_ctx->send_window = 2;
+
+	assert_equals(JAL_OK, jaln_pub_begin_next_record_ans(sess, &rec_info));
+
+	assert_equals(2, sess->pub_window_sz);
+	assert_equals(1, sess->pub_window_cnt);
+	assert_pointer_equals(sess, first->sess);
+	assert_not_equals((void*)NULL, first->buf_copy);
+	assert_not_equals((void*)first, sess->pub_data);
+	assert_pointer_equals(sess->pub_window[1], sess->pub_data);
+	assert_equals(7, sess->pub_data->msg_no);
+
+	// drop the reference taken for the queued record
+	jaln_session_unref(sess);
+}
+
+void test_report_finished_reports_records_in_order()
+{
+	struct jaln_pub_data *first = sess->pub_data;
+	struct jaln_pub_data *second = jaln_pub_data_create();
+	first->nonce = jal_strdup("first");
+	second->nonce = jal_strdup("second");
+	sess->jaln_ctx->send_window = 2;
+	jaln_pub_feeder_create_window(sess);
+	sess->pub_window[1] = second;
+	sess->pub_window_cnt = 2;
+
+	// The second record finishing first must not be reported ahead of
+	// the first one.
+	second->finished = axl_true;
+	vortex_mutex_lock(&sess->wait_lock);
+	jaln_pub_feeder_report_finished_no_lock(sess);
+	vortex_mutex_unlock(&sess->wait_lock);
+	assert_equals(0, records_completed);
+	assert_equals(2, sess->pub_window_cnt);
+
+	first->finished = axl_true;
+	vortex_mutex_lock(&sess->wait_lock);
+	jaln_pub_feeder_report_finished_no_lock(sess);
+	vortex_mutex_unlock(&sess->wait_lock);
+	assert_equals(2, records_completed);
+	assert_string_equals("first", completed_nonces[0]);
+	assert_string_equals("second", completed_nonces[1]);
+	assert_equals(0, sess->pub_window_cnt);
+	assert_false(first->finished);
+	assert_false(second->finished);
+}
@@ -377,6 +377,63 @@ void test_pub_notify_digests_works_when_peer_has_missing_dgst()
 	axl_list_free(dgst_resp_infos);
 }
 
+void test_pub_notify_digests_leaves_unmatched_dgsts_in_order()
+{
+	axlList *dgst_resp_infos = NULL;
+	int dgst_val = 0xf005;
+	axl_list_prepend(calc_dgsts, jaln_digest_info_create("nonce0", (uint8_t*)&dgst_val, sizeof(dgst_val)));
+	axl_list_append(calc_dgsts, jaln_digest_info_create("nonce5", (uint8_t*)&dgst_val, sizeof(dgst_val)));
+	axl_list_append(calc_dgsts, jaln_digest_info_create("nonce6", (uint8_t*)&dgst_val, sizeof(dgst_val)));
+	jaln_pub_notify_digests_and_create_digest_response(sess, calc_dgsts, peer_dgsts, &dgst_resp_infos);
+	assert_not_equals((void*) NULL, dgst_resp_infos);
+	assert_equals(3, axl_list_length(calc_dgsts));
+	struct jaln_digest_info *di = (struct jaln_digest_info*) axl_list_get_nth(calc_dgsts, 0);
+	assert_string_equals("nonce0", di->nonce);
+	di = (struct jaln_digest_info*) axl_list_get_nth(calc_dgsts, 1);
+	assert_string_equals("nonce5", di->nonce);
+	di = (struct jaln_digest_info*) axl_list_get_nth(calc_dgsts, 2);
+	assert_string_equals("nonce6", di->nonce);
+	axl_list_free(dgst_resp_infos);
+}
+
+void test_pub_notify_digests_only_matches_first_duplicate_nonce()
+{
+	axlList *dgst_resp_infos = NULL;
+	int dgst_val = 0xf001;
+	axl_list_append(calc_dgsts, jaln_digest_info_create("nonce1", (uint8_t*)&dgst_val, sizeof(dgst_val)));
+	jaln_pub_notify_digests_and_create_digest_response(sess, calc_dgsts, peer_dgsts, &dgst_resp_infos);
+	assert_not_equals((void*) NULL, dgst_resp_infos);
+	assert_equals(4, peer_digest_call_cnt);
+	assert_equals(1, axl_list_length(calc_dgsts));
+	struct jaln_digest_info *di = (struct jaln_digest_info*) axl_list_get_nth(calc_dgsts, 0);
+	assert_string_equals("nonce1", di->nonce);
+	axl_list_free(dgst_resp_infos);
+}
+
+void test_pub_notify_digests_sets_status_for_each_peer_dgst()
+{
+	axlList *dgst_resp_infos = NULL;
+	jaln_pub_notify_digests_and_create_digest_response(sess, calc_dgsts, peer_dgsts, &dgst_resp_infos);
+	assert_not_equals((void*) NULL, dgst_resp_infos);
+	assert_equals(4, axl_list_length(dgst_resp_infos));
+
+	// peer_dgsts is nonce4, nonce3, nonce2, nonce1, and only nonce3
+	// differs from the calculated value.
+	struct jaln_digest_resp_info *ri = (struct jaln_digest_resp_info*) axl_list_get_nth(dgst_resp_infos, 0);
+	assert_string_equals("nonce4", ri->nonce);
+	assert_equals(JALN_DIGEST_STATUS_CONFIRMED, ri->status);
+	ri = (struct jaln_digest_resp_info*) axl_list_get_nth(dgst_resp_infos, 1);
+	assert_string_equals("nonce3", ri->nonce);
+	assert_equals(JALN_DIGEST_STATUS_INVALID, ri->status);
+	ri = (struct jaln_digest_resp_info*) axl_list_get_nth(dgst_resp_infos, 2);
+	assert_string_equals("nonce2", ri->nonce);
+	assert_equals(JALN_DIGEST_STATUS_CONFIRMED, ri->status);
+	ri = (struct jaln_digest_resp_info*) axl_list_get_nth(dgst_resp_infos, 3);
+	assert_string_equals("nonce1", ri->nonce);
+	assert_equals(JALN_DIGEST_STATUS_CONFIRMED, ri->status);
+	axl_list_free(dgst_resp_infos);
+}
+
 void test_pub_handle_sync_works()
 {
 	assert_equals(JAL_OK, jaln_publisher_handle_sync(sess, (VortexChannel*) 0xbadf00d, (VortexFrame*) 0xdeadbeef, 1));
@@ -47,12 +47,18 @@ static char *nonce = NULL;
 static uint8_t *dgst_buf = NULL;
 static uint64_t dgst_len;
 static axl_bool cond_signal_called;
+static axl_bool cond_broadcast_called;
 
 void fake_cond_signal(__attribute__((unused)) VortexCond *cond)
 {
 	cond_signal_called = axl_true;
 }
 
+void fake_cond_broadcast(__attribute__((unused)) VortexCond *cond)
+{
+	cond_broadcast_called = axl_true;
+}
+
 void fake_create_sub_digest_channel_thread_no_lock(__attribute__((unused)) jaln_session *session)
 {
 	return;
@@ -138,6 +144,7 @@ void setup()
 	dgst_buf[2] = 0xb;
 	dgst_buf[3] = 0x0;
 	cond_signal_called = axl_false;
+	cond_broadcast_called = axl_false;
 
 	replace_function(vortex_thread_create, fake_vortex_thread_create);
 	replace_function(jaln_create_sub_digest_channel_thread_no_lock, fake_create_sub_digest_channel_thread_no_lock);
@@ -454,6 +461,25 @@ void test_notify_close_for_dgst_channel_unrefs_session_and_clears_rec_info()
 	assert_equals(1, sess->ref_cnt);
 }
 
+void test_notify_close_wakes_subscriber_digest_thread()
+{
+	replace_function(vortex_cond_broadcast, fake_cond_broadcast);
+	jaln_session_ref(sess);
+	sess->role = JALN_ROLE_SUBSCRIBER;
+	sess->sub_data = sub_data;
+	sub_data = NULL;
+
+	sess->rec_chan = (VortexChannel*) 0xbadf00d;
+	sess->rec_chan_num = 3;
+	sess->dgst_chan = (VortexChannel*) 0xdeadbeef;
+	sess->dgst_chan_num = 5;
+
+	jaln_session_notify_close((VortexConnection*) 0xbadf00d,
+			sess->rec_chan_num, axl_true, NULL, NULL, sess);
+	assert_true(cond_broadcast_called);
+	assert_true(sess->closing);
+}
+
 void test_notify_close_does_nothing_with_bad_channel()
 {
 	sess->rec_chan = (VortexChannel*) 0xbadf00d;
@@ -548,7 +574,7 @@ void test_on_close_channel_does_nothing_with_bad_channel()
 void test_add_to_dgst_list_works()
 {
 	assert_equals(0, axl_list_length(sess->dgst_list));
-	assert_equals(JAL_OK, jaln_session_add_to_dgst_list(sess, nonce, dgst_buf, dgst_len));
+	assert_equals(JAL_OK, jaln_session_add_to_dgst_list(sess, nonce, dgst_buf, dgst_len, 0));
 	assert_equals(1, axl_list_length(sess->dgst_list));
 	struct jaln_digest_info *di = axl_list_get_first(sess->dgst_list);
 	assert_not_equals((void*) NULL, di);
@@ -563,7 +589,7 @@ void test_add_to_dgst_list_signals_for_subscriber()
 	assert_equals(0, axl_list_length(sess->dgst_list));
 	sess->dgst_list_max = 1;
 	sess->role = JALN_ROLE_SUBSCRIBER;
-	assert_equals(JAL_OK, jaln_session_add_to_dgst_list(sess, nonce, dgst_buf, dgst_len));
+	assert_equals(JAL_OK, jaln_session_add_to_dgst_list(sess, nonce, dgst_buf, dgst_len, 0));
 	assert_true(cond_signal_called);
 }
 
@@ -573,20 +599,115 @@ void test_add_to_dgst_list_does_not_signal_for_publisher()
 	assert_equals(0, axl_list_length(sess->dgst_list));
 	sess->dgst_list_max = 1;
 	sess->role = JALN_ROLE_PUBLISHER;
-	assert_equals(JAL_OK, jaln_session_add_to_dgst_list(sess, nonce, dgst_buf, dgst_len));
+	assert_equals(JAL_OK, jaln_session_add_to_dgst_list(sess, nonce, dgst_buf, dgst_len, 0));
+	assert_false(cond_signal_called);
+}
+
+void test_add_to_dgst_list_does_not_signal_below_thresholds()
+{
+	replace_function(vortex_cond_signal, fake_cond_signal);
+	sess->dgst_list_max = 10;
+	sess->dgst_max_bytes = 1000;
+	sess->role = JALN_ROLE_SUBSCRIBER;
+	assert_equals(JAL_OK, jaln_session_add_to_dgst_list(sess, nonce, dgst_buf, dgst_len, 100));
+	assert_equals(JAL_OK, jaln_session_add_to_dgst_list(sess, nonce, dgst_buf, dgst_len, 200));
+	assert_false(cond_signal_called);
+	assert_false(sess->dgst_flush_pending);
+	assert_equals(2, axl_list_length(sess->dgst_list));
+	assert_equals(300, sess->dgst_list_bytes);
+}
+
+void test_add_to_dgst_list_signals_when_byte_limit_reached()
+{
+	replace_function(vortex_cond_signal, fake_cond_signal);
+	sess->dgst_list_max = 10;
+	sess->dgst_max_bytes = 1000;
+	sess->role = JALN_ROLE_SUBSCRIBER;
+	assert_equals(JAL_OK, jaln_session_add_to_dgst_list(sess, nonce, dgst_buf, dgst_len, 600));
 	assert_false(cond_signal_called);
+	assert_equals(JAL_OK, jaln_session_add_to_dgst_list(sess, nonce, dgst_buf, dgst_len, 600));
+	assert_true(cond_signal_called);
+	assert_true(sess->dgst_flush_pending);
+}
+
+void test_update_dgst_thresh_uses_max_when_not_adaptive()
+{
+	struct timeval now = { 100, 0 };
+	sess->dgst_list_max = 50;
+	sess->dgst_list_thresh = 1;
+	jaln_session_update_dgst_thresh_no_lock(sess, &now);
+	assert_equals(50, sess->dgst_list_thresh);
+	assert_equals(100, sess->dgst_last_add.tv_sec);
+}
+
+void test_update_dgst_thresh_follows_record_rate()
+{
+	struct timeval now = { 100, 0 };
+	sess->dgst_adaptive = axl_true;
+	sess->dgst_list_max = 100;
+	sess->dgst_timeout = 1000000;
+
+	// 1 record per second is well below what fits in half the timeout.
+	jaln_session_update_dgst_thresh_no_lock(sess, &now);
+	now.tv_sec = 101;
+	jaln_session_update_dgst_thresh_no_lock(sess, &now);
+	assert_equals(1, sess->dgst_list_thresh);
+
+	// 100 records per second is 50 records in half the timeout.
+	sess->dgst_rec_rate = 0;
+	now.tv_usec = 10000;
+	jaln_session_update_dgst_thresh_no_lock(sess, &now);
+	assert_equals(50, sess->dgst_list_thresh);
+
+	// Much faster than that is capped at the maximum.
+	now.tv_usec += 10;
+	jaln_session_update_dgst_thresh_no_lock(sess, &now);
+	assert_equals(100, sess->dgst_list_thresh);
+}
+
+void test_take_dgst_list_resets_batch()
+{
+	sess->role = JALN_ROLE_SUBSCRIBER;
+	sess->dgst_list_max = 10;
+	assert_equals(JAL_OK, jaln_session_add_to_dgst_list(sess, nonce, dgst_buf, dgst_len, 100));
+	sess->dgst_flush_pending = axl_true;
+
+	axlList *dgst_list = jaln_session_take_dgst_list_no_lock(sess);
+	assert_not_equals((void*) NULL, dgst_list);
+	assert_equals(1, axl_list_length(dgst_list));
+	assert_equals(0, axl_list_length(sess->dgst_list));
+	assert_equals(0, sess->dgst_list_bytes);
+	assert_false(sess->dgst_flush_pending);
+	axl_list_free(dgst_list);
+}
+
+void test_dgst_wait_time_counts_down_from_oldest_dgst()
+{
+	struct timeval now = { 100, 0 };
+	sess->dgst_timeout = 1000000;
+	assert_equals(1000000, jaln_session_dgst_wait_time_no_lock(sess, &now));
+
+	sess->role = JALN_ROLE_SUBSCRIBER;
+	sess->dgst_list_max = 10;
+	assert_equals(JAL_OK, jaln_session_add_to_dgst_list(sess, nonce, dgst_buf, dgst_len, 100));
+	sess->dgst_list_oldest = now;
+
+	now.tv_usec = 250000;
+	assert_equals(750000, jaln_session_dgst_wait_time_no_lock(sess, &now));
+	now.tv_sec = 101;
+	assert_equals(0, jaln_session_dgst_wait_time_no_lock(sess, &now));
 }
 
 void test_add_to_dgst_fails_with_bad_input()
 {
 	assert_equals(0, axl_list_length(sess->dgst_list));
-	assert_equals(JAL_E_INVAL, jaln_session_add_to_dgst_list(NULL, nonce, dgst_buf, dgst_len));
+	assert_equals(JAL_E_INVAL, jaln_session_add_to_dgst_list(NULL, nonce, dgst_buf, dgst_len, 0));
 	assert_equals(0, axl_list_length(sess->dgst_list));
-	assert_equals(JAL_E_INVAL, jaln_session_add_to_dgst_list(sess, NULL, dgst_buf, dgst_len));
+	assert_equals(JAL_E_INVAL, jaln_session_add_to_dgst_list(sess, NULL, dgst_buf, dgst_len, 0));
 	assert_equals(0, axl_list_length(sess->dgst_list));
-	assert_equals(JAL_E_INVAL, jaln_session_add_to_dgst_list(sess, nonce, NULL, dgst_len));
+	assert_equals(JAL_E_INVAL, jaln_session_add_to_dgst_list(sess, nonce, NULL, dgst_len, 0));
 	assert_equals(0, axl_list_length(sess->dgst_list));
-	assert_equals(JAL_E_INVAL, jaln_session_add_to_dgst_list(sess, nonce, dgst_buf, 0));
+	assert_equals(JAL_E_INVAL, jaln_session_add_to_dgst_list(sess, nonce, dgst_buf, 0, 0));
 	assert_equals(0, axl_list_length(sess->dgst_list));
 }
 
@@ -667,3 +788,18 @@ void test_session_is_ok_returns_ok_when_vortex_connection_ok_works()
 	sess->rec_chan = (VortexChannel*) 0xbadf00d;
 	assert_equals(JAL_OK, jaln_session_is_ok(sess));
 }
+
+void test_session_get_user_data()
+{
+	jaln_context *ctx = jaln_context_create();
+	ctx->user_data = (void *) 0xbadf00d;
+
+	assert_pointer_equals((void *) NULL, jaln_session_get_user_data(NULL));
+	assert_pointer_equals((void *) NULL, jaln_session_get_user_data(sess));
+
+	sess->jaln_ctx = ctx;
+	assert_pointer_equals((void *) 0xbadf00d, jaln_session_get_user_data(sess));
+
+	sess->jaln_ctx = NULL;
+	jaln_context_destroy(&ctx);
+}
@@ -125,8 +125,58 @@ void fake_vortex_frame_unref(__attribute__((unused)) VortexFrame *frame)
 	return;
 }
 
+static int dgst_msgs_sent;
+static int dgst_msgs_sent_before_close;
+
+axl_bool fake_vortex_channel_send_msg_and_wait_counts(__attribute__((unused)) VortexChannel *channel,
+							__attribute__((unused)) const void *message,
+							__attribute__((unused)) size_t message_size,
+							__attribute__((unused)) int *msg_no,
+							__attribute__((unused)) WaitReplyData *wait_reply)
+{
+	dgst_msgs_sent++;
+	return axl_true;
+}
+
+axl_bool fake_vortex_channel_close_full(__attribute__((unused)) VortexChannel *channel,
+					__attribute__((unused)) VortexOnClosedNotificationFull on_closed,
+					__attribute__((unused)) axlPointer user_data)
+{
+	dgst_msgs_sent_before_close = dgst_msgs_sent;
+	sess->dgst_chan = NULL;
+	return axl_true;
+}
+
+axl_bool fake_vortex_cond_timedwait(__attribute__((unused)) VortexCond *cond,
+				__attribute__((unused)) VortexMutex *mutex,
+				__attribute__((unused)) long microseconds)
+{
+	return axl_true;
+}
+
+static void setup_wait_thread()
+{
+	replace_function(vortex_channel_wait_reply, vortex_channel_wait_reply_always_succeeds);
+	replace_function(vortex_channel_send_msg_and_wait, fake_vortex_channel_send_msg_and_wait_counts);
+	replace_function(vortex_channel_send_msg, vortex_channel_send_msg_always_succeeds);
+	replace_function(jaln_process_digest_resp, fake_jaln_process_digest_resp);
+	replace_function(vortex_frame_unref, fake_vortex_frame_unref);
+	replace_function(vortex_connection_timeout, fake_vortex_connection_timeout);
+	replace_function(vortex_channel_get_ctx, fake_vortex_channel_get_ctx);
+	replace_function(vortex_channel_close_full, fake_vortex_channel_close_full);
+	replace_function(vortex_cond_timedwait, fake_vortex_cond_timedwait);
+
+	int dgst_val = 0xf001;
+	sess->role = JALN_ROLE_SUBSCRIBER;
+	sess->sub_data = jaln_sub_data_create();
+	axl_list_append(sess->dgst_list, jaln_digest_info_create("nonce1", (uint8_t *)&dgst_val, sizeof(dgst_val)));
+}
+
 void setup()
 {
+	dgst_msgs_sent = 0;
+	dgst_msgs_sent_before_close = -1;
+
 	int dgst_val;
 	dgst_list = jaln_digest_info_list_create();
 	ctx = jaln_context_create();
@@ -196,3 +246,26 @@ void test_jaln_send_digest_and_sync_no_lock_succeeds()
 
 	jaln_send_digest_and_sync_no_lock(sess, dgst_list);
 }
+
+void test_dgst_wait_thread_sends_pending_digests_before_closing()
+{
+	setup_wait_thread();
+	sess->closing = axl_true;
+
+	jaln_sub_dgst_wait_thread(sess);
+	assert_equals(1, dgst_msgs_sent_before_close);
+	assert_equals(1, dgst_msgs_sent);
+	assert_equals(0, axl_list_length(sess->dgst_list));
+	assert_equals((void*) NULL, sess->dgst_chan);
+}
+
+void test_dgst_wait_thread_drops_pending_digests_when_errored()
+{
+	setup_wait_thread();
+	sess->errored = axl_true;
+
+	jaln_sub_dgst_wait_thread(sess);
+	assert_equals(0, dgst_msgs_sent_before_close);
+	assert_equals(0, dgst_msgs_sent);
+	assert_equals((void*) NULL, sess->dgst_chan);
+}
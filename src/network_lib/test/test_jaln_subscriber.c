@@ -368,6 +368,22 @@ void test_jaln_configure_sub_session_no_lock_succeeds()
 	jaln_session_destroy(&session);
 }
 
+void test_jaln_configure_sub_session_no_lock_copies_digest_batching()
+{
+	jaln_sub_data_destroy(&session->sub_data);
+	session->ch_info->type = JALN_RTYPE_LOG;
+	session->jaln_ctx = jaln_context_create();
+	assert_equals(JAL_OK, jaln_set_digest_batching(session->jaln_ctx, 500, 1024, 2000, 1));
+
+	assert_equals(JAL_OK,
+		jaln_configure_sub_session_no_lock(chan, session));
+	assert_equals(500, session->dgst_list_max);
+	assert_equals(500, session->dgst_list_thresh);
+	assert_equals(1024, session->dgst_max_bytes);
+	assert_equals(2000000, session->dgst_timeout);
+	assert_true(session->dgst_adaptive);
+}
+
 void test_jaln_configure_sub_session_no_lock_fails_bad_input()
 {	// Pre-conditions
 	assert_not_equals(session->rec_chan, chan);
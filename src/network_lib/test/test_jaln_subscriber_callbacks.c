@@ -218,6 +218,24 @@ void test_subscriber_callbacks_is_valid_returns_false_when_missing_on_log()
 	assert_equals(0, ret);
 }
 
+void test_subscriber_callbacks_is_valid_returns_true_with_on_audit_chunk_instead_of_on_audit()
+{
+	int ret;
+	sub_cbs->on_audit = NULL;
+	sub_cbs->on_audit_chunk = dummy_on_journal;
+	ret = jaln_subscriber_callbacks_is_valid(sub_cbs);
+	assert_equals(1, ret);
+}
+
+void test_subscriber_callbacks_is_valid_returns_true_with_on_log_chunk_instead_of_on_log()
+{
+	int ret;
+	sub_cbs->on_log = NULL;
+	sub_cbs->on_log_chunk = dummy_on_journal;
+	ret = jaln_subscriber_callbacks_is_valid(sub_cbs);
+	assert_equals(1, ret);
+}
+
 void test_subscriber_callbacks_is_valid_returns_false_when_missing_on_journal()
 {
 	int ret;
@@ -31,6 +31,7 @@
 #include <jalop/jaln_network.h>
 #include <jalop/jaln_network_types.h>
 #include <test-dept.h>
+#include <limits.h>
 #include <string.h>
 #include <assert.h>
 #include <vortex.h>
@@ -120,6 +121,20 @@ int dummy_on_journal(
 	return JAL_OK;
 }
 
+int failing_on_payload_chunk(
+		__attribute__((unused)) jaln_session *sess,
+		__attribute__((unused)) const struct jaln_channel_info *ch_info,
+		__attribute__((unused)) const char *nonce,
+		__attribute__((unused)) const uint8_t *buffer,
+		__attribute__((unused)) const uint32_t cnt,
+		__attribute__((unused)) const uint64_t offset,
+		__attribute__((unused)) const int more,
+		__attribute__((unused)) void *user_data)
+{
+	journal_cb_cnt += 1;
+	return JAL_E_INVAL;
+}
+
 int dummy_notify_digest(
 		__attribute__((unused)) jaln_session *sess,
 		__attribute__((unused)) const struct jaln_channel_info *ch_info,
@@ -186,7 +201,8 @@ enum jal_status fake_jaln_add_to_dgst_list(
 		__attribute__((unused)) jaln_session *sess,
 		__attribute__((unused)) char *nonce,
 		__attribute__((unused)) uint8_t *dgst_buf,
-		__attribute__((unused)) uint64_t dgst_len)
+		__attribute__((unused)) uint64_t dgst_len,
+		__attribute__((unused)) uint64_t rec_sz)
 {
 	return JAL_OK;
 }
@@ -784,6 +800,75 @@ void test_wait_for_journal_payload_fails_when_next_state_fails()
 
 }
 
+void test_wait_for_audit_payload_chunks_hands_payload_to_on_audit_chunk()
+{
+	session->sub_data->sm = jaln_sub_state_create_audit_chunk_machine();
+	jaln_sub_state_reset(session);
+	session->jaln_ctx->sub_callbacks->on_audit_chunk = dummy_on_journal;
+	session->sub_data->sm->wait_for_payload_break->frame_handler = fake_handler;
+
+	session->sub_data->sm->payload_sz = EXPECTED_SYS_META_SZ;
+
+	journal_off = 0;
+	journal_sz = EXPECTED_SYS_META_SZ;
+	journal_buf = jal_malloc(EXPECTED_SYS_META_SZ);
+
+	replace_function(vortex_frame_get_payload, sys_meta_get_payload_first_half);
+	replace_function(vortex_frame_get_payload_size, sys_meta_get_payload_sz_first_half);
+
+	more = axl_true;
+	assert_equals(axl_true, jaln_sub_wait_for_audit_payload_chunks(session, frame, 0, more));
+
+	frame_off = EXPECTED_SYS_META_SZ - (EXPECTED_SYS_META_SZ / 2);
+	replace_function(vortex_frame_get_payload, sys_meta_get_payload_second_half);
+	replace_function(vortex_frame_get_payload_size, sys_meta_get_payload_sz_second_half);
+
+	more = axl_false;
+	assert_equals(axl_true, jaln_sub_wait_for_audit_payload_chunks(session, frame, 0, more));
+
+	assert_equals(2, journal_cb_cnt);
+	assert_equals(0, memcmp(journal_buf, EXPECTED_SYS_META, EXPECTED_SYS_META_SZ));
+	assert_equals((void*) NULL, session->sub_data->sm->payload_buf);
+}
+
+void test_wait_for_audit_payload_chunks_fails_when_on_audit_chunk_fails()
+{
+	session->sub_data->sm = jaln_sub_state_create_audit_chunk_machine();
+	jaln_sub_state_reset(session);
+	session->jaln_ctx->sub_callbacks->on_audit_chunk = failing_on_payload_chunk;
+	session->sub_data->sm->wait_for_payload_break->frame_handler = fake_handler;
+
+	session->sub_data->sm->payload_sz = EXPECTED_SYS_META_SZ;
+
+	replace_function(vortex_frame_get_payload, sys_meta_get_payload_first_half);
+	replace_function(vortex_frame_get_payload_size, sys_meta_get_payload_sz_first_half);
+
+	more = axl_true;
+	assert_equals(axl_false, jaln_sub_wait_for_audit_payload_chunks(session, frame, 0, more));
+	assert_equals(1, journal_cb_cnt);
+	assert_true(session->errored);
+	assert_equals(session->sub_data->sm->error_state, session->sub_data->sm->curr_state);
+}
+
+void test_wait_for_log_payload_chunks_fails_when_on_log_chunk_fails()
+{
+	session->sub_data->sm = jaln_sub_state_create_log_chunk_machine();
+	jaln_sub_state_reset(session);
+	session->jaln_ctx->sub_callbacks->on_log_chunk = failing_on_payload_chunk;
+	session->sub_data->sm->wait_for_payload_break->frame_handler = fake_handler;
+
+	session->sub_data->sm->payload_sz = EXPECTED_SYS_META_SZ;
+
+	replace_function(vortex_frame_get_payload, sys_meta_get_payload_first_half);
+	replace_function(vortex_frame_get_payload_size, sys_meta_get_payload_sz_first_half);
+
+	more = axl_true;
+	assert_equals(axl_false, jaln_sub_wait_for_log_payload_chunks(session, frame, 0, more));
+	assert_equals(1, journal_cb_cnt);
+	assert_true(session->errored);
+	assert_equals(session->sub_data->sm->error_state, session->sub_data->sm->curr_state);
+}
+
 void test_copy_buf_works_for_exact_copy()
 {
 	uint8_t *dst = jal_calloc(EXPECTED_PAYLOAD_SZ, sizeof(uint8_t));
@@ -1041,3 +1126,103 @@ void test_jaln_create_journal_machine()
 	assert_not_equals((void*) NULL, sm->record_complete->name);
 	assert_equals((void*)jaln_sub_journal_record_complete, sm->record_complete->frame_handler);
 }
+
+void test_jaln_create_audit_chunk_machine()
+{
+	struct jaln_sub_state_machine *sm =
+		jaln_sub_state_create_audit_chunk_machine();
+
+	assert_not_equals((void*) NULL, sm);
+	assert_true(sm->payload_chunks);
+	assert_not_equals((void*) NULL, sm->wait_for_payload);
+	assert_not_equals((void*) NULL, sm->wait_for_payload->name);
+	assert_equals((void*)jaln_sub_wait_for_audit_payload_chunks, sm->wait_for_payload->frame_handler);
+
+	assert_not_equals((void*) NULL, sm->record_complete);
+	assert_not_equals((void*) NULL, sm->record_complete->name);
+	assert_equals((void*)jaln_sub_audit_chunks_record_complete, sm->record_complete->frame_handler);
+	jaln_sub_state_machine_destroy(&sm);
+}
+
+void test_jaln_create_log_chunk_machine()
+{
+	struct jaln_sub_state_machine *sm =
+		jaln_sub_state_create_log_chunk_machine();
+
+	assert_not_equals((void*) NULL, sm);
+	assert_true(sm->payload_chunks);
+	assert_not_equals((void*) NULL, sm->wait_for_payload);
+	assert_not_equals((void*) NULL, sm->wait_for_payload->name);
+	assert_equals((void*)jaln_sub_wait_for_log_payload_chunks, sm->wait_for_payload->frame_handler);
+
+	assert_not_equals((void*) NULL, sm->record_complete);
+	assert_not_equals((void*) NULL, sm->record_complete->name);
+	assert_equals((void*)jaln_sub_log_chunks_record_complete, sm->record_complete->frame_handler);
+	jaln_sub_state_machine_destroy(&sm);
+}
+
+void test_append_data_grows_buffer()
+{
+	struct jaln_sub_state_machine *sm = jaln_sub_state_create_audit_machine();
+	uint8_t data[1000];
+	int i;
+	memset(data, 'a', sizeof(data));
+
+	for (i = 0; i < 100; i++) {
+		assert_true(jaln_sub_state_append_data(sm, data, sizeof(data)));
+	}
+	assert_equals(100 * sizeof(data), sm->mime_buf_len);
+	assert_true(sm->mime_buf_sz >= sm->mime_buf_len);
+	assert_equals('a', sm->mime_buf[sm->mime_buf_len - 1]);
+
+	jaln_sub_state_clear_cached_frames(sm);
+	assert_equals(0, sm->mime_buf_len);
+	assert_not_equals((void*) NULL, sm->mime_buf);
+	jaln_sub_state_machine_destroy(&sm);
+}
+
+void test_append_data_fails_with_bad_input()
+{
+	struct jaln_sub_state_machine *sm = jaln_sub_state_create_audit_machine();
+	assert_false(jaln_sub_state_append_data(NULL, (uint8_t*) "a", 1));
+	assert_false(jaln_sub_state_append_data(sm, NULL, 1));
+	assert_false(jaln_sub_state_append_data(sm, (uint8_t*) "a", (uint64_t) INT_MAX + 1));
+	assert_equals(0, sm->mime_buf_len);
+	jaln_sub_state_machine_destroy(&sm);
+}
+
+void test_mime_headers_complete_when_split_across_frames()
+{
+	struct jaln_sub_state_machine *sm = jaln_sub_state_create_audit_machine();
+	const char *hdrs = MSG_TYPE_HDR ": " AUDIT_MSG_TYPE "\r\n" MSG_NONCE_HDR ": " EXPECTED_NONCE "\r\n\r\nsys meta";
+	size_t i;
+
+	// Feed the headers one byte at a time, the end is only found once
+	// the empty line is complete.
+	for (i = 0; i < strlen(hdrs); i++) {
+		assert_true(jaln_sub_state_append_data(sm, (const uint8_t*) hdrs + i, 1));
+		if (jaln_sub_state_mime_headers_complete(sm)) {
+			break;
+		}
+	}
+	assert_equals(strstr(hdrs, "\r\n\r\n") + 3 - hdrs, (long) i);
+	jaln_sub_state_machine_destroy(&sm);
+}
+
+void test_mime_headers_complete_with_lf_and_no_headers()
+{
+	struct jaln_sub_state_machine *sm = jaln_sub_state_create_audit_machine();
+	const char *hdrs = MSG_TYPE_HDR ": " AUDIT_MSG_TYPE "\n";
+
+	assert_true(jaln_sub_state_append_data(sm, (const uint8_t*) hdrs, strlen(hdrs)));
+	assert_false(jaln_sub_state_mime_headers_complete(sm));
+	assert_true(jaln_sub_state_append_data(sm, (const uint8_t*) "\n", 1));
+	assert_true(jaln_sub_state_mime_headers_complete(sm));
+
+	jaln_sub_state_clear_cached_frames(sm);
+	assert_true(jaln_sub_state_append_data(sm, (const uint8_t*) "\r", 1));
+	assert_false(jaln_sub_state_mime_headers_complete(sm));
+	assert_true(jaln_sub_state_append_data(sm, (const uint8_t*) "\nBREAK", 6));
+	assert_true(jaln_sub_state_mime_headers_complete(sm));
+	jaln_sub_state_machine_destroy(&sm);
+}
@@ -37,7 +37,9 @@
 #include <unistd.h>
 #include <jalop/jaln_network.h>
 #include <jalop/jal_version.h>
+#include "jal_alloc.h"
 #include "jaldb_context.hpp"
+#include "jalu_bench.h"
 #include "jalu_daemonize.h"
 #include "jsub_db_layer.hpp"
 #include "jsub_callbacks.hpp"
@@ -54,6 +56,14 @@
 #define MODE "mode"
 #define PENDING_DIGEST_MAX "pending_digest_max"
 #define PENDING_DIGEST_TIMEOUT "pending_digest_timeout"
+#define PENDING_DIGEST_MAX_BYTES "pending_digest_max_bytes"
+#define PENDING_DIGEST_ADAPTIVE "pending_digest_adaptive"
+#define JOURNAL_CHECKPOINT_BYTES "journal_checkpoint_bytes"
+#define JOURNAL_CHECKPOINT_TIMEOUT "journal_checkpoint_timeout"
+#define PAYLOAD_MEMORY_LIMIT "payload_memory_limit"
+#define DB_GROUP_COMMIT_RECORDS "db_group_commit_records"
+#define DB_GROUP_COMMIT_USEC "db_group_commit_usec"
+#define DB_GROUP_COMMIT_USEC_DEFAULT 1000
 #define DB_ROOT "db_root"
 #define SCHEMAS_ROOT "schemas_root"
 #define MAX_PORT_LENGTH 10
@@ -73,6 +83,7 @@
 volatile sig_atomic_t timer_keep_going = 1;
 volatile bool global_quit = false;
 jaldb_context *jsub_db_ctx = NULL;
+static struct jsub_peer **peers = NULL;
 
 struct global_config_t {
 	const char *private_key;
@@ -81,10 +92,18 @@ struct global_config_t {
 	const char *session_timeout;
 	config_setting_t *data_class;	/* Array */
 	long long int port;
-	const char *host;
+	config_setting_t *host;		/* String or list */
+	int num_hosts;
 	const char *mode;
 	long long int pending_digest_max;
 	long long int pending_digest_timeout;
+	long long int pending_digest_max_bytes;
+	int pending_digest_adaptive;
+	long long int journal_checkpoint_bytes;
+	long long int journal_checkpoint_timeout;
+	long long int payload_memory_limit;
+	long long int db_group_commit_records;
+	long long int db_group_commit_usec;
 	int len_data_class;
 	const char *db_root;
 	const char *schemas_root;
@@ -95,6 +114,7 @@ struct global_args_t {
 	int debug_flag;		/* --debug option */
 	char *config_path;	/* --config option */
 	bool enable_tls;	/* --disable_tls option */
+	bool report;		/* --report option */
 } global_args;
 
 enum jal_subscribe_status {
@@ -108,10 +128,13 @@ static void init_global_config(void);
 static void free_global_args(void);
 static void print_config(void);
 static int set_global_config(config_t *config);
+static const char *get_host(int i);
+static bool all_peers_closed(void);
 static void *timer_do_work(void *ptr);
 static void *subscriber_do_work(void *ptr);
 static unsigned int get_seconds_from_timeout(char *session_timeout);
 static void catch_alarm(int sig);
+static void report_records(const struct timespec *start);
 
 static void sig_handler(__attribute__((unused)) int sig)
 {
@@ -147,11 +170,12 @@ err_out:
 int main(int argc, char **argv)
 {
 	int rc = 0;
-	pthread_t thread_timer, thread_subscriber;
-	int rc_timer, rc_subscriber;
+	pthread_t thread_timer;
+	pthread_t *thread_subscribers = NULL;
+	int num_subscribers = 0;
+	struct timespec start;
 	config_t config;
 	config_init(&config);
-	jsub_is_conn_closed = false; // Externed in jsub_callbacks
 
 	rc = setup_signals();
 	if (0 != rc) {
@@ -189,30 +213,87 @@ int main(int argc, char **argv)
 		}
 		goto out;
 	}
-	jsub_flush_stale_data(jsub_db_ctx, global_config.host, global_config.data_classes, global_args.debug_flag);
+	// Records from every publisher go into the same database, so batch
+	// the commits of the subscriber threads when asked to.
+	if (global_config.db_group_commit_records > 1) {
+		if (JALDB_OK != jaldb_enable_group_commit(jsub_db_ctx,
+				global_config.db_group_commit_records,
+				global_config.db_group_commit_usec)) {
+			if (global_args.debug_flag) {
+				DEBUG_LOG("Failed to enable group commit!");
+			}
+			goto out;
+		}
+	}
+	jsub_set_journal_checkpoint(global_config.journal_checkpoint_bytes,
+				global_config.journal_checkpoint_timeout);
+	jsub_set_payload_memory_limit(global_config.payload_memory_limit);
+	peers = (struct jsub_peer **) jal_calloc(global_config.num_hosts, sizeof(*peers));
+	for (int i = 0; i < global_config.num_hosts; i++) {
+		jsub_flush_stale_data(jsub_db_ctx, get_host(i), global_config.data_classes, global_args.debug_flag);
+		peers[i] = jsub_peer_create(get_host(i));
+	}
 	if (global_args.debug_flag) {
 		DEBUG_LOG("DBLayer Setup Success!");
 	}
 	/* Handler for SIGALRM signals */
 	signal(SIGALRM, catch_alarm);
-	rc_timer = pthread_create(
+	if (0 != pthread_create(
 				&thread_timer,
 				NULL,
 				timer_do_work,
-				(void *) global_config.session_timeout);
-	rc_subscriber = pthread_create(
-				&thread_subscriber,
+				(void *) global_config.session_timeout)) {
+		if (global_args.debug_flag) {
+			DEBUG_LOG("Failed to start the session timer!");
+		}
+		rc = -1;
+		goto out;
+	}
+	// One subscriber thread, with its own connection, for each publisher.
+	thread_subscribers = (pthread_t *) jal_calloc(global_config.num_hosts, sizeof(*thread_subscribers));
+	jalu_bench_start(&start);
+	for (num_subscribers = 0; num_subscribers < global_config.num_hosts; num_subscribers++) {
+		if (0 != pthread_create(
+				&thread_subscribers[num_subscribers],
 				NULL,
 				subscriber_do_work,
-				(void *) &global_config);
+				(void *) peers[num_subscribers])) {
+			if (global_args.debug_flag) {
+				DEBUG_LOG("Failed to start the subscriber for %s!",
+					peers[num_subscribers]->host);
+			}
+			// Fail startup rather than run with only some of the
+			// publishers: stop the subscribers already started, and
+			// close the others so the timer does not wait for them.
+			global_quit = true;
+			for (int i = num_subscribers; i < global_config.num_hosts; i++) {
+				peers[i]->closed = true;
+			}
+			rc = -1;
+			break;
+		}
+	}
 
 	pthread_join(thread_timer, NULL);
-	pthread_join(thread_subscriber, NULL);
+	for (int i = 0; i < num_subscribers; i++) {
+		pthread_join(thread_subscribers[i], NULL);
+	}
 	if (global_args.debug_flag) {
 		DEBUG_LOG("Threads joined!");
 	}
+	if (global_args.report && 0 == rc) {
+		report_records(&start);
+	}
 out:
 	free_global_args();
+	free(thread_subscribers);
+	if (peers) {
+		for (int i = 0; i < global_config.num_hosts; i++) {
+			jsub_peer_destroy(&peers[i]);
+		}
+		free(peers);
+		peers = NULL;
+	}
 	jsub_teardown_db_layer(&jsub_db_ctx);
 	config_destroy(&config);
 	if (global_args.debug_flag) {
@@ -230,18 +311,20 @@ int process_options(int argc, char **argv)
 	int opt = 0;
 	int long_index = 0;
 
-	static const char *opt_string = "c:dvs";
+	static const char *opt_string = "c:dvsr";
 	static const struct option long_options[] = {
 		{"config", required_argument, NULL,'c'}, /* --config or -c */
 		{"debug", no_argument, NULL, 'd'}, /* --debug or -d */
 		{"version", no_argument, NULL, 'v'}, /* --version or -v */
 		{"disable-tls", no_argument, NULL, 's'}, /* --disable-tls or -s */
+		{"report", no_argument, NULL, 'r'}, /* --report or -r */
 		{0, 0, 0, 0} /* terminating -0 item */
 	};
 
 	global_args.debug_flag = DEBUG_MODE_OFF;
 	global_args.config_path = NULL;
 	global_args.enable_tls = true;
+	global_args.report = false;
 
 	opt = getopt_long(argc, argv, opt_string, long_options, &long_index);
 
@@ -260,6 +343,9 @@ int process_options(int argc, char **argv)
 			case 's':
 				global_args.enable_tls = false;
 				break;
+			case 'r':
+				global_args.report = true;
+				break;
 			case 0:
 				break;
 			default:
@@ -276,7 +362,7 @@ int process_options(int argc, char **argv)
 
 __attribute__((noreturn)) void usage()
 {
-        fprintf(stderr, "Usage: jal_subscribe -c, --config <config_directory> [-d, --debug] [-s, --disable-tls] [-v, --version]\n");
+        fprintf(stderr, "Usage: jal_subscribe -c, --config <config_directory> [-d, --debug] [-s, --disable-tls] [-r, --report] [-v, --version]\n");
         exit(1);
 }
 
@@ -313,10 +399,18 @@ void init_global_config(void)
 	global_config.session_timeout = NULL;
 	global_config.data_class = NULL;
 	global_config.host = NULL;
+	global_config.num_hosts = 0;
 	global_config.mode = NULL;
 	global_config.db_root = NULL;
 	global_config.schemas_root = NULL;
 	global_config.data_classes = 0;
+	global_config.pending_digest_max_bytes = 0;
+	global_config.pending_digest_adaptive = 0;
+	global_config.journal_checkpoint_bytes = JSUB_JOURNAL_CHECKPOINT_BYTES_DEFAULT;
+	global_config.journal_checkpoint_timeout = JSUB_JOURNAL_CHECKPOINT_TIMEOUT_DEFAULT;
+	global_config.payload_memory_limit = JSUB_PAYLOAD_MEMORY_LIMIT_DEFAULT;
+	global_config.db_group_commit_records = 0;
+	global_config.db_group_commit_usec = DB_GROUP_COMMIT_USEC_DEFAULT;
 }
 
 void free_global_args(void)
@@ -339,10 +433,19 @@ void print_config(void)
 		//DEBUG_LOG("DATA CLASS:\t\t%s\n", global_config.data_class);
 		DEBUG_LOG("DATA CLASS LENGTH:\t%d", global_config.len_data_class);
 		DEBUG_LOG("PORT:\t\t\t%lld", global_config.port);
-		DEBUG_LOG("HOST:\t\t\t%s", global_config.host);
+		for (int i = 0; i < global_config.num_hosts; i++) {
+			DEBUG_LOG("HOST:\t\t\t%s", get_host(i));
+		}
 		DEBUG_LOG("MODE:\t\t\t%s", global_config.mode);
 		DEBUG_LOG("PENDING DIGEST MAX:\t%lld", global_config.pending_digest_max);
 		DEBUG_LOG("PENDING DIGEST TIMEOUT:\t%lld", global_config.pending_digest_timeout);
+		DEBUG_LOG("PENDING DIGEST MAX BYTES:\t%lld", global_config.pending_digest_max_bytes);
+		DEBUG_LOG("PENDING DIGEST ADAPTIVE:\t%s", global_config.pending_digest_adaptive ? "true" : "false");
+		DEBUG_LOG("JOURNAL CHECKPOINT BYTES:\t%lld", global_config.journal_checkpoint_bytes);
+		DEBUG_LOG("JOURNAL CHECKPOINT TIMEOUT:\t%lld", global_config.journal_checkpoint_timeout);
+		DEBUG_LOG("PAYLOAD MEMORY LIMIT:\t%lld", global_config.payload_memory_limit);
+		DEBUG_LOG("DB GROUP COMMIT RECORDS:\t%lld", global_config.db_group_commit_records);
+		DEBUG_LOG("DB GROUP COMMIT USEC:\t%lld", global_config.db_group_commit_usec);
 		DEBUG_LOG("DB ROOT:\t\t%s\n", global_config.db_root);
 		DEBUG_LOG("SCHEMAS ROOT:\t\t%s\n", global_config.schemas_root);
 		DEBUG_LOG("\n===\nEND CONFIG VALUES:\n===");
@@ -395,14 +498,37 @@ int set_global_config(config_t *config)
 		rc = JAL_E_CONFIG_LOAD;
 		goto out;
 	}
-	rc = config_lookup_string(config, HOST, &global_config.host);
-	if (rc == CONFIG_FALSE){
+	// Either a single publisher, or a list of them.
+	global_config.host = config_lookup(config, HOST);
+	if (!global_config.host) {
 		if (global_args.debug_flag) {
 			DEBUG_LOG("Missing setting for '%s'", HOST);
 		}
 		rc = JAL_E_CONFIG_LOAD;
 		goto out;
 	}
+	if (CONFIG_TYPE_STRING == config_setting_type(global_config.host)) {
+		global_config.num_hosts = 1;
+	} else if (config_setting_is_array(global_config.host) ||
+			config_setting_is_list(global_config.host)) {
+		global_config.num_hosts = config_setting_length(global_config.host);
+	}
+	if (0 == global_config.num_hosts) {
+		if (global_args.debug_flag) {
+			DEBUG_LOG("Expected '%s' to be a string or a list of strings", HOST);
+		}
+		rc = JAL_E_CONFIG_LOAD;
+		goto out;
+	}
+	for (int i = 0; i < global_config.num_hosts; i++) {
+		if (!get_host(i)) {
+			if (global_args.debug_flag) {
+				DEBUG_LOG("Expected '%s' to be a string or a list of strings", HOST);
+			}
+			rc = JAL_E_CONFIG_LOAD;
+			goto out;
+		}
+	}
 	rc = config_lookup_string(config, MODE, &global_config.mode);
 	if (rc == CONFIG_FALSE){
 		if (global_args.debug_flag) {
@@ -427,6 +553,46 @@ int set_global_config(config_t *config)
 		rc = JAL_E_CONFIG_LOAD;
 		goto out;
 	}
+	// The byte limit and adaptive batching are optional.
+	config_lookup_int64(config, PENDING_DIGEST_MAX_BYTES, &global_config.pending_digest_max_bytes);
+	config_lookup_bool(config, PENDING_DIGEST_ADAPTIVE, &global_config.pending_digest_adaptive);
+	if ((0 >= global_config.pending_digest_max) || (0 >= global_config.pending_digest_timeout) ||
+			(0 > global_config.pending_digest_max_bytes)) {
+		if (global_args.debug_flag) {
+			DEBUG_LOG("Invalid pending digest settings");
+		}
+		rc = JAL_E_CONFIG_LOAD;
+		goto out;
+	}
+	// How often to store the resume offset of a journal record is optional.
+	config_lookup_int64(config, JOURNAL_CHECKPOINT_BYTES, &global_config.journal_checkpoint_bytes);
+	config_lookup_int64(config, JOURNAL_CHECKPOINT_TIMEOUT, &global_config.journal_checkpoint_timeout);
+	if ((0 > global_config.journal_checkpoint_bytes) || (0 > global_config.journal_checkpoint_timeout)) {
+		if (global_args.debug_flag) {
+			DEBUG_LOG("Invalid journal checkpoint settings");
+		}
+		rc = JAL_E_CONFIG_LOAD;
+		goto out;
+	}
+	// The largest audit or log payload kept in memory is optional.
+	config_lookup_int64(config, PAYLOAD_MEMORY_LIMIT, &global_config.payload_memory_limit);
+	if (0 > global_config.payload_memory_limit) {
+		if (global_args.debug_flag) {
+			DEBUG_LOG("Invalid payload memory limit");
+		}
+		rc = JAL_E_CONFIG_LOAD;
+		goto out;
+	}
+	// Group commit is optional.
+	config_lookup_int64(config, DB_GROUP_COMMIT_RECORDS, &global_config.db_group_commit_records);
+	config_lookup_int64(config, DB_GROUP_COMMIT_USEC, &global_config.db_group_commit_usec);
+	if ((0 > global_config.db_group_commit_records) || (0 > global_config.db_group_commit_usec)) {
+		if (global_args.debug_flag) {
+			DEBUG_LOG("Invalid group commit settings");
+		}
+		rc = JAL_E_CONFIG_LOAD;
+		goto out;
+	}
 	global_config.data_class = config_lookup(config, DATA_CLASS);	// Array
 	if (!global_config.data_class) {
 		if (global_args.debug_flag) {
@@ -486,6 +652,50 @@ out:
 	return rc;
 }
 
+const char *get_host(int i)
+{
+	if (CONFIG_TYPE_STRING == config_setting_type(global_config.host)) {
+		return config_setting_get_string(global_config.host);
+	}
+	return config_setting_get_string_elem(global_config.host, i);
+}
+
+void report_records(const struct timespec *start)
+{
+	struct timespec now;
+	struct timespec last = *start;
+	uint64_t total = 0;
+
+	// Each publisher is timed until its connection closed, and all of
+	// them together until the last one closed.
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (int i = 0; i < global_config.num_hosts; i++) {
+		struct timespec end = peers[i]->closed_time;
+		if (0 == end.tv_sec && 0 == end.tv_nsec) {
+			end = now;
+		}
+		if (0 < jalu_bench_diff(&last, &end)) {
+			last = end;
+		}
+		total += peers[i]->records;
+		jalu_bench_report(peers[i]->host, (long) peers[i]->records, "records",
+				jalu_bench_diff(start, &end), NULL);
+	}
+	jalu_bench_report("total", (long) total, "records",
+			jalu_bench_diff(start, &last), " from %d publishers",
+			global_config.num_hosts);
+}
+
+bool all_peers_closed(void)
+{
+	for (int i = 0; i < global_config.num_hosts; i++) {
+		if (!peers[i]->closed) {
+			return false;
+		}
+	}
+	return true;
+}
+
 void *timer_do_work(void *ptr)
 {
 	// If ptr is NULL or seconds is Zero,
@@ -507,7 +717,7 @@ void *timer_do_work(void *ptr)
 			alarm(seconds);
 
 			while(timer_keep_going
-				&& !jsub_is_conn_closed){
+				&& !all_peers_closed()){
 				sleep(1); // Sleep for 1 second
 			}
 			if (global_args.debug_flag) {
@@ -565,8 +775,7 @@ void *subscriber_do_work(void *ptr)
 	char port[MAX_PORT_LENGTH];
 	int ret = sprintf(port, "%lld", global_config.port);
 	struct jaln_connection *conn = NULL;
-	struct global_config_t *cfg = (struct global_config_t *) ptr;
-	cfg = cfg;
+	struct jsub_peer *peer = (struct jsub_peer *) ptr;
 	jaln_context *net_ctx = jaln_context_create();
 	struct jal_digest_ctx *dc1 = jal_sha256_ctx_create();
 	enum jal_status err;
@@ -579,6 +788,17 @@ void *subscriber_do_work(void *ptr)
 		goto err;
 	}
 	jaln_register_digest_algorithm(net_ctx, dc1);
+	err = jaln_set_digest_batching(net_ctx,
+				global_config.pending_digest_max,
+				global_config.pending_digest_max_bytes,
+				global_config.pending_digest_timeout * 1000,
+				global_config.pending_digest_adaptive);
+	if (JAL_OK != err) {
+		if (global_args.debug_flag) {
+			DEBUG_LOG("Error configuring digest batching! Quitting.");
+		}
+		goto err;
+	}
 	if (global_args.enable_tls) {
 		err = jaln_register_tls(net_ctx,
 					global_config.private_key,
@@ -607,20 +827,22 @@ void *subscriber_do_work(void *ptr)
 		DEBUG_LOG("Bad mode specification in config file! Quitting.");
 		goto err;
 	}
+	// The peer is the user data, so the callbacks keep the records
+	// received from this publisher apart from the others.
 	conn = jaln_subscribe(
 				net_ctx,
-				global_config.host,
+				peer->host,
 				port,
 				global_config.data_classes,
 				mode,
-				jsub_db_ctx);
+				peer);
 	if (!conn){
 		if (global_args.debug_flag) {
-			DEBUG_LOG("conn null, quitting!");
+			DEBUG_LOG("conn null for %s, quitting!", peer->host);
 		}
 		goto err;
 	}
-	while(!jsub_is_conn_closed){
+	while(!peer->closed){
 		if (global_quit) {
 			if (global_args.debug_flag) {
 				DEBUG_LOG("Subscribe thread ending!");
@@ -636,7 +858,7 @@ void *subscriber_do_work(void *ptr)
 		sleep(1);
 	}
 err:
-	timer_keep_going = false;
+	peer->closed = true;
 	err = jaln_shutdown(conn);
 	if (JAL_OK != err) {
 		if (global_args.debug_flag) {
@@ -45,6 +45,7 @@
 
 #include "jal_base64_internal.h"
 #include "jaldb_context.hpp"
+#include "jaldb_delivery.h"
 #include "jalns_strings.h"
 #include "jalu_daemonize.h"
 #include "jalu_config.h"
@@ -110,7 +111,9 @@ struct peer_config_t {
 	enum jaln_record_type sub_allow;
 };
 struct session_ctx_t {
-	struct jaldb_record *rec;
+	struct jaldb_record *rec;	// The record about to be sent.
+	axlList *in_flight;		// Records sent, oldest first, that the network library is still using.
+	jaldb_record_waiter *waiter;
 };
 
 struct global_config_t {
@@ -127,6 +130,7 @@ struct global_config_t {
 	long long int pending_digest_max;
 	long long int pending_digest_timeout;
 	long long int poll_time;
+	long long int send_window;
 } global_config;
 
 struct global_args_t {
@@ -203,6 +207,51 @@ enum jaln_connect_error on_connect_request(
 	return JALN_CE_UNAUTHORIZED_MODE;
 }
 
+static void session_ctx_destroy_rec(axlPointer ptr)
+{
+	struct jaldb_record *rec = (struct jaldb_record *) ptr;
+	jaldb_destroy_record(&rec);
+}
+
+static struct session_ctx_t *session_ctx_create(void)
+{
+	struct session_ctx_t *ctx = (struct session_ctx_t*) calloc(1, sizeof(*ctx));
+	if (!ctx) {
+		return NULL;
+	}
+	ctx->in_flight = axl_list_new(axl_list_always_return_1, session_ctx_destroy_rec);
+	if (!ctx->in_flight) {
+		free(ctx);
+		return NULL;
+	}
+	return ctx;
+}
+
+static void session_ctx_destroy(axlPointer ptr)
+{
+	struct session_ctx_t *ctx = (struct session_ctx_t *) ptr;
+	jaldb_record_waiter_destroy(&ctx->waiter);
+	jaldb_destroy_record(&ctx->rec);
+	axl_list_free(ctx->in_flight);
+	free(ctx);
+}
+
+/*
+ * Hand the current record of the session over to the network library. With
+ * a send window larger than 1, the next record is fetched before this one is
+ * complete, so the record is queued until pub_on_record_complete is called
+ * for it. The record is returned so the caller can use it as feeder data.
+ */
+static struct jaldb_record *session_ctx_start_send(struct session_ctx_t *ctx, pthread_mutex_t *sub_lock)
+{
+	pthread_mutex_lock(sub_lock);
+	struct jaldb_record *rec = ctx->rec;
+	ctx->rec = NULL;
+	axl_list_append(ctx->in_flight, rec);
+	pthread_mutex_unlock(sub_lock);
+	return rec;
+}
+
 void on_channel_close(
 		const struct jaln_channel_info *ch_info,
 		__attribute__((unused)) void *user_data)
@@ -273,13 +322,13 @@ enum jal_status pub_on_journal_resume(
 		pthread_mutex_unlock(&gs_journal_sub_lock);
 		return JAL_E_INVAL;
 	}
-	ctx = (struct session_ctx_t*) calloc(1, sizeof(*ctx));
+	ctx = session_ctx_create();
 	if (!ctx) {
 		DEBUG_LOG_SUB_SESSION(ch_info, "Failed to create session context");
 		pthread_mutex_unlock(&gs_journal_sub_lock);
 		return JAL_E_NO_MEM;
 	}
-	axl_hash_insert_full(gs_journal_subs, strdup(ch_info->hostname), free, ctx, free);
+	axl_hash_insert_full(gs_journal_subs, strdup(ch_info->hostname), free, ctx, session_ctx_destroy);
 	pthread_mutex_unlock(&gs_journal_sub_lock);
 	ctx->rec = NULL;
 	enum jaldb_status db_ret = JALDB_E_INVAL;
@@ -299,6 +348,41 @@ enum jal_status pub_on_journal_resume(
 	return JAL_OK;
 }
 
+/*
+ * Read a payload stored on disk into memory. The audit and log records are
+ * sent from a buffer, but the subscriber stores a large one in a file, the
+ * same way as a journal record.
+ */
+static enum jaldb_status pub_load_segment(struct jaldb_segment *seg)
+{
+	enum jaldb_status ret = jaldb_open_segment_for_read(db_ctx, seg);
+	uint8_t *buf = NULL;
+	uint64_t off = 0;
+	if (JALDB_OK != ret) {
+		goto out;
+	}
+	buf = (uint8_t *) jal_malloc(seg->length ? seg->length : 1);
+	while (off < seg->length) {
+		ssize_t bytes_read = pread64(seg->fd, buf + off, seg->length - off, off);
+		if (0 > bytes_read && EINTR == errno) {
+			continue;
+		}
+		if (0 >= bytes_read) {
+			free(buf);
+			ret = JALDB_E_UNKNOWN;
+			goto out;
+		}
+		off += bytes_read;
+	}
+	close(seg->fd);
+	seg->fd = -1;
+	free(seg->payload);
+	seg->payload = buf;
+	seg->on_disk = 0;
+out:
+	return ret;
+}
+
 enum jaldb_status pub_get_next_record(
 			jaln_session *sess,
 			const struct jaln_channel_info *ch_info,
@@ -329,13 +413,21 @@ enum jaldb_status pub_get_next_record(
 		// Make a copy to match behavior of jaldb_next_*_record functions
 		*nonce = jal_strdup(ctx->rec->network_nonce);
 		ret = JALDB_OK;
+		if (!*timestamp) {
+			ret = jaldb_delivery_mark_sent(db_ctx, db_type, ch_info->hostname, *nonce);
+		}
 	} else {
+		// Create the waiter before the first lookup so a record inserted
+		// between a failed lookup and the wait still wakes this thread.
+		if (!ctx->waiter) {
+			ctx->waiter = jaldb_record_waiter_create(db_ctx);
+		}
 		while (JALDB_E_NOT_FOUND == ret) {
 			// Have to use timestamp since sess->mode is internal to the network library
 			if (!*timestamp) {
 				// Archive mode
 				DEBUG_LOG_SUB_SESSION(ch_info, "Looking for a record in Archive Mode");
-				ret = jaldb_next_unsynced_record(db_ctx, db_type, nonce, &(ctx->rec));
+				ret = jaldb_delivery_next_record(db_ctx, db_type, ch_info->hostname, nonce, &(ctx->rec));
 			} else {
 				// Live mode
 				DEBUG_LOG_SUB_SESSION(ch_info, "Looking for a record in Live Mode, timestamp: %s",*timestamp);
@@ -347,8 +439,11 @@ enum jaldb_status pub_get_next_record(
 			}
 
 			if (JALDB_E_NOT_FOUND == ret) {
-				sleep(global_config.poll_time);
-
+				if (ctx->waiter) {
+					jaldb_wait_for_record(ctx->waiter, global_config.poll_time * 1000);
+				} else {
+					sleep(global_config.poll_time);
+				}
 			}
 			if (exiting || JAL_OK != jaln_session_is_ok(sess)) {
 				ret = JALDB_E_NETWORK_DISCONNECTED;
@@ -387,7 +482,15 @@ enum jaldb_status pub_get_next_record(
 	*payload_len = 0;
 	if (rec->payload) {
 		*payload_len = rec->payload->length;
-		if (rec->payload->on_disk) {
+		if (rec->payload->on_disk && JALDB_RTYPE_JOURNAL != db_type) {
+			ret = pub_load_segment(rec->payload);
+			if (JALDB_OK != ret) {
+				DEBUG_LOG_SUB_SESSION(ch_info, "Failed to read the payload from disk");
+				ret = JALDB_E_INVAL;
+				goto out;
+			}
+			*payload_buf = rec->payload->payload;
+		} else if (rec->payload->on_disk) {
 			ret = jaldb_open_segment_for_read(db_ctx, rec->payload);
 			if (JALDB_OK != ret) {
 				ret = JALDB_E_INVAL;
@@ -443,7 +546,7 @@ enum jal_status pub_send_records_feeder(
 
 	ctx = (struct session_ctx_t *) axl_hash_get(hash, ch_info->hostname);
 	if (!ctx) {
-		ctx = (struct session_ctx_t*) calloc(1, sizeof(*ctx));
+		ctx = session_ctx_create();
 		if (!ctx) {
 			DEBUG_LOG_SUB_SESSION(ch_info, "Failed to allocate context");
 			pthread_mutex_unlock(sub_lock);
@@ -452,14 +555,15 @@ enum jal_status pub_send_records_feeder(
 		}
 		DEBUG_LOG_SUB_SESSION(ch_info, "Inserting new session");
 
-		axl_hash_insert_full(hash, strdup(ch_info->hostname), free, ctx, free);
+		axl_hash_insert_full(hash, strdup(ch_info->hostname), free, ctx, session_ctx_destroy);
 	}
 
 	DEBUG_LOG_SUB_SESSION(ch_info, "Verifying previously sent records.");
-	// Only need to clear sent flags for archive mode connection
+	// Only need to resend records this subscriber never synced for an
+	// archive mode connection. Other subscribers are tracked separately.
 	// Have to use timestamp since sess->mode is internal to the network library
 	if (!*timestamp) {
-		db_ret = jaldb_mark_unsynced_records_unsent(db_ctx, db_type);
+		db_ret = jaldb_delivery_reset(db_ctx, db_type, ch_info->hostname);
 		if (JALDB_OK != db_ret) {
 			DEBUG_LOG_SUB_SESSION(ch_info, "Failed to verify records.");
 			ret = JAL_E_INVAL;
@@ -470,7 +574,6 @@ enum jal_status pub_send_records_feeder(
 
 	pthread_mutex_unlock(sub_lock);
 
-	feeder.feeder_data = ctx;
 	feeder.get_bytes = pub_get_bytes;
 
 	do {
@@ -504,26 +607,15 @@ enum jal_status pub_send_records_feeder(
 			goto out;
 		}
 
+		// The network library may still be reading this record's
+		// payload after the next one is fetched.
+		feeder.feeder_data = session_ctx_start_send(ctx, sub_lock);
 		ret = send(sess, nonce, sys_meta_buf, sys_meta_len,
 				app_meta_buf, app_meta_len, payload_len, &feeder);
 		if (JAL_OK != ret) {
 			DEBUG_LOG_SUB_SESSION(ch_info, "Failed to send record (%d)", ret);
 			goto out;
 		}
-		// Have to use timestamp since sess->mode is internal to the network library
-		if (!*timestamp) {
-			//Archive mode
-			pthread_mutex_lock(sub_lock);
-			db_ret = jaldb_mark_sent(db_ctx, db_type, nonce, 1);
-			pthread_mutex_unlock(sub_lock);
-			if (JALDB_OK != db_ret) {
-				DEBUG_LOG_SUB_SESSION(ch_info, "Failed to mark %s as sent: %d", nonce, db_ret);
-				ret = JAL_E_INVAL_NONCE;
-				goto out;
-			} else {
-				DEBUG_LOG_SUB_SESSION(ch_info, "Marked %s as sent", nonce);
-			}
-		}
 
 		free(nonce);
 		nonce = NULL;
@@ -581,7 +673,7 @@ enum jal_status pub_send_records(
 		goto out;
 	}
 
-	ctx = (struct session_ctx_t*) calloc(1, sizeof(*ctx));
+	ctx = session_ctx_create();
 	if (!ctx) {
 		DEBUG_LOG_SUB_SESSION(ch_info, "Failed to allocate context");
 		pthread_mutex_unlock(sub_lock);
@@ -591,13 +683,14 @@ enum jal_status pub_send_records(
 
 	DEBUG_LOG_SUB_SESSION(ch_info, "Inserting new session");
 
-	axl_hash_insert_full(hash, strdup(ch_info->hostname), free, ctx, free);
+	axl_hash_insert_full(hash, strdup(ch_info->hostname), free, ctx, session_ctx_destroy);
 
 	DEBUG_LOG_SUB_SESSION(ch_info, "Verifying previously sent records.");
-	// Only need to clear sent flags for archive mode connection
+	// Only need to resend records this subscriber never synced for an
+	// archive mode connection. Other subscribers are tracked separately.
 	// Have to use timestamp since sess->mode is internal to the network library
 	if (!*timestamp) {
-		db_ret = jaldb_mark_unsynced_records_unsent(db_ctx, db_type);
+		db_ret = jaldb_delivery_reset(db_ctx, db_type, ch_info->hostname);
 		if (JALDB_OK != db_ret) {
 			DEBUG_LOG_SUB_SESSION(ch_info, "Failed to verify records.");
 			ret = JAL_E_INVAL;
@@ -639,26 +732,13 @@ enum jal_status pub_send_records(
 			goto out;
 		}
 
+		session_ctx_start_send(ctx, sub_lock);
 		ret = send(sess, nonce, sys_meta_buf, sys_meta_len,
 				app_meta_buf, app_meta_len, payload_buf, payload_len);
 		if (JAL_OK != ret) {
 			DEBUG_LOG_SUB_SESSION(ch_info, "Failed to send record (%d)", ret);
 			goto out;
 		}
-		// Have to use timestamp since sess->mode is internal to the network library
-		if (!*timestamp) {
-			//Archive mode
-			pthread_mutex_lock(sub_lock);
-			db_ret = jaldb_mark_sent(db_ctx, db_type, nonce, 1);
-			pthread_mutex_unlock(sub_lock);
-			if (JALDB_OK != db_ret) {
-				DEBUG_LOG_SUB_SESSION(ch_info, "Failed to mark %s as sent", nonce);
-				ret = JAL_E_INVAL_NONCE;
-				goto out;
-			} else {
-				DEBUG_LOG_SUB_SESSION(ch_info, "Marked %s as sent", nonce);
-			}
-		}
 
 		free(nonce);
 		nonce = NULL;
@@ -895,13 +975,15 @@ enum jal_status pub_on_record_complete(
 
 	pthread_mutex_lock(sub_lock);
 	struct session_ctx_t *ctx = (struct session_ctx_t*)axl_hash_get(hash, ch_info->hostname);
-	pthread_mutex_unlock(sub_lock);
 	if (!ctx) {
+		pthread_mutex_unlock(sub_lock);
 		DEBUG_LOG_SUB_SESSION(ch_info, "Couldn't find session context");
 		return JAL_E_INVAL;
 	}
 
-	jaldb_destroy_record(&ctx->rec);
+	// Records are completed in the order they were sent.
+	axl_list_remove_first(ctx->in_flight);
+	pthread_mutex_unlock(sub_lock);
 	return JAL_OK;
 }
 
@@ -941,7 +1023,8 @@ void pub_sync(
 
 	if (mode == JALN_ARCHIVE_MODE) {
 		pthread_mutex_lock(sub_lock);
-		jaldb_ret = jaldb_mark_synced(db_ctx, db_type, nonce);
+		// This also flags the record as synced for the purge tools.
+		jaldb_ret = jaldb_delivery_mark_synced(db_ctx, db_type, ch_info->hostname, nonce);
 		pthread_mutex_unlock(sub_lock);
 		if (JALDB_OK != jaldb_ret) {
 			DEBUG_LOG_SUB_SESSION(ch_info, "Failed to mark %s as synced: %d", nonce, jaldb_ret);
@@ -1018,7 +1101,7 @@ void pub_peer_digest(
 
 error:
 	// The digests do not match. We need to mark the record as unsent so it can be sent again by the publisher.
-	db_ret = jaldb_mark_sent(db_ctx, db_type, nonce, 0);
+	db_ret = jaldb_delivery_mark_unsent(db_ctx, db_type, ch_info->hostname, nonce);
 
 	if (JALDB_OK != db_ret) {
 		DEBUG_LOG_SUB_SESSION(ch_info, "Error: Failed to update record as unsent %s. Return code: %d", nonce, db_ret);
@@ -1154,6 +1237,11 @@ int main(int argc, char **argv)
 	// The jaln_context owns the digest algorithm, so don't keep a
 	// reference to it.
 	dctx = NULL;
+	if (JAL_OK != jaln_set_send_window(jctx, (int) global_config.send_window)) {
+		DEBUG_LOG("Failed to set the send window");
+		rc = -1;
+		goto out;
+	}
 	if (global_args.enable_tls) {
 		jaln_ret = jaln_register_tls(jctx, global_config.private_key, global_config.public_cert,
 				global_config.remote_cert_dir);
@@ -1324,6 +1412,7 @@ out:
 void init_global_config(void)
 {
 	memset(&global_config, 0, sizeof(global_config));
+	global_config.send_window = 1;
 	global_config.peers = axl_hash_new(axl_hash_string, axl_hash_equal_string);
 }
 
@@ -1388,6 +1477,7 @@ void print_config(void)
 	printf("PENDING DIGEST MAX:\t%lld\n", global_config.pending_digest_max);
 	printf("PENDING DIGEST TIMEOUT:\t%lld\n", global_config.pending_digest_timeout);
 	printf("POLL TIME:\t%lld\n", global_config.poll_time);
+	printf("SEND WINDOW:\t\t%lld\n", global_config.send_window);
 	printf("DB ROOT:\t\t%s\n", global_config.db_root);
 	printf("SCHEMAS ROOT:\t\t%s\n", global_config.schemas_root);
 	if (global_config.pid_file) {
@@ -1477,6 +1567,15 @@ enum jald_status set_global_config(config_t *config)
 		return JALD_E_CONFIG_LOAD;
 	}
 
+	// send_window is optional
+	if (config_setting_get_member(root, JALNS_SEND_WINDOW)) {
+		rc = config_setting_lookup_int64(root, JALNS_SEND_WINDOW, &global_config.send_window);
+		if (CONFIG_FALSE == rc || global_config.send_window <= 0 || global_config.send_window > INT_MAX) {
+			CONFIG_ERROR(root, JALNS_SEND_WINDOW, "expected positive integer value");
+			return JALD_E_CONFIG_LOAD;
+		}
+	}
+
 	// db_root is optional
 	rc = jalu_config_lookup_string(root, JALNS_DB_ROOT, &global_config.db_root, false);
 	if (0 == rc) {
@@ -1661,20 +1760,19 @@ static enum jal_status pub_get_bytes(const uint64_t offset, uint8_t * const buff
 	// TODO: this may need to support reading from buffers stored in RAM,
 	// rather than disk.
 #define ERRNO_STR_LEN 128
-	off64_t err;
-	struct session_ctx_t *ctx = (struct session_ctx_t*) feeder_data;
-	errno = 0;
-	err = lseek64(ctx->rec->payload->fd, offset, SEEK_SET);
-	int my_errno = errno;
-	if (-1 == err) {
-		char buf[ERRNO_STR_LEN];
-		strerror_r(my_errno, buf, ERRNO_STR_LEN);
-		DEBUG_LOG("Failed to seek, errno %s\n", buf);
-		return JAL_E_INVAL;
-	}
+	struct jaldb_record *rec = (struct jaldb_record*) feeder_data;
 	size_t to_read = *size;
-	ssize_t bytes_read = read(ctx->rec->payload->fd, buffer, to_read);
+	ssize_t bytes_read;
+	// Read at the 64-bit offset in one call, the feeder asks for the
+	// payload in frame sized pieces and keeps the digest going itself.
+	do {
+		bytes_read = pread64(rec->payload->fd, buffer, to_read, offset);
+	} while (bytes_read < 0 && EINTR == errno);
 	if (bytes_read < 0) {
+		char buf[ERRNO_STR_LEN];
+		int my_errno = errno;
+		strerror_r(my_errno, buf, ERRNO_STR_LEN);
+		DEBUG_LOG("Failed to read journal payload, errno %s\n", buf);
 		return JAL_E_INVAL;
 	}
 	*size = bytes_read;
@@ -48,6 +48,7 @@ extern "C" {
 #define JALNS_PRIVATE_KEY "private_key"
 #define JALNS_PUBLIC_CERT "public_cert"
 #define JALNS_PUBLISH_ALLOW "publish_allow"
+#define JALNS_SEND_WINDOW "send_window"
 #define JALNS_SUBSCRIBE_ALLOW "subscribe_allow"
 #define JALNS_REMOTE_CERT_DIR "remote_cert_dir"
 #define JALNS_PID_FILE "pid_file"
@@ -34,6 +34,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <inttypes.h>
 #include "jsub_callbacks.hpp"
 #include "jsub_db_layer.hpp"
 #include "jal_alloc.h"
@@ -53,33 +54,61 @@
 
 #define JSUB_INITIAL_NONCE "0"
 
-volatile bool jsub_is_conn_closed = false;
 volatile int jsub_debug = 0;
-static struct jaln_subscriber_callbacks *sub_cbs =  NULL;
-static struct jaln_connection_callbacks *cb = NULL;
-
-// Journal buffers
-static uint8_t *journal_sys_meta_buf = NULL;
-static uint32_t journal_sys_meta_size = 0;
-static uint8_t *journal_app_meta_buf = NULL;
-static uint32_t journal_app_meta_size = 0;
-static uint64_t journal_payload_size = 0;
-
-// Audit buffers
-static uint8_t *audit_sys_meta_buf = NULL;
-static uint32_t audit_sys_meta_size = 0;
-static uint8_t *audit_app_meta_buf = NULL;
-static uint32_t audit_app_meta_size = 0;
-
-// Log buffers
-static uint8_t *log_sys_meta_buf = NULL;
-static uint32_t log_sys_meta_size = 0;
-static uint8_t *log_app_meta_buf = NULL;
-static uint32_t log_app_meta_size = 0;
-
-// Journal path and fd
-static char *db_payload_path = NULL;
-static int db_payload_fd = -1;
+
+// Settings copied into each new jsub_peer
+static uint64_t journal_checkpoint_bytes = JSUB_JOURNAL_CHECKPOINT_BYTES_DEFAULT;
+static time_t journal_checkpoint_secs = JSUB_JOURNAL_CHECKPOINT_TIMEOUT_DEFAULT;
+static size_t payload_memory_limit = JSUB_PAYLOAD_MEMORY_LIMIT_DEFAULT;
+
+void jsub_set_journal_checkpoint(uint64_t max_bytes, time_t max_secs)
+{
+	journal_checkpoint_bytes = max_bytes;
+	journal_checkpoint_secs = max_secs;
+}
+
+void jsub_set_payload_memory_limit(size_t max_bytes)
+{
+	payload_memory_limit = max_bytes;
+}
+
+struct jsub_peer *jsub_peer_create(const char *host)
+{
+	struct jsub_peer *peer = (struct jsub_peer *) jal_calloc(1, sizeof(*peer));
+	peer->host = jal_strdup(host);
+	peer->closed = false;
+	peer->audit_spool.mem_max = payload_memory_limit;
+	peer->audit_spool.fd = -1;
+	peer->log_spool.mem_max = payload_memory_limit;
+	peer->log_spool.fd = -1;
+	peer->db_payload_fd = -1;
+	peer->journal_checkpoint.max_bytes = journal_checkpoint_bytes;
+	peer->journal_checkpoint.max_secs = journal_checkpoint_secs;
+	return peer;
+}
+
+void jsub_peer_destroy(struct jsub_peer **peer)
+{
+	if (!peer || !*peer) {
+		return;
+	}
+	struct jsub_peer *p = *peer;
+	if (-1 != p->db_payload_fd) {
+		close(p->db_payload_fd);
+	}
+	jsub_payload_spool_end(jsub_db_ctx, &p->audit_spool);
+	jsub_payload_spool_end(jsub_db_ctx, &p->log_spool);
+	free(p->journal_sys_meta_buf);
+	free(p->journal_app_meta_buf);
+	free(p->audit_sys_meta_buf);
+	free(p->audit_app_meta_buf);
+	free(p->log_sys_meta_buf);
+	free(p->log_app_meta_buf);
+	free(p->db_payload_path);
+	free(p->host);
+	free(p);
+	*peer = NULL;
+}
 
 enum jaln_connect_error jsub_connect_request_handler(
 		const struct jaln_connect_request *req,
@@ -107,13 +136,15 @@ void jsub_on_channel_close(
 
 void jsub_on_connection_close(
 		const struct jaln_connection *jal_conn,
-		__attribute__((unused)) void *user_data)
+		void *user_data)
 {
+	struct jsub_peer *peer = (struct jsub_peer *) user_data;
 	if (jsub_debug) {
 		DEBUG_LOG("ON_CONNECTION_CLOSED");
-		DEBUG_LOG("conn_info: %p", jal_conn);
+		DEBUG_LOG("conn_info: %p host: %s", jal_conn, peer->host);
 	}
-	jsub_is_conn_closed = true;
+	clock_gettime(CLOCK_MONOTONIC, &peer->closed_time);
+	peer->closed = true;
 }
 
 void jsub_connect_ack(
@@ -135,23 +166,25 @@ void jsub_connect_ack(
 
 void jsub_connect_nack(
 	const struct jaln_connect_nack *nack,
-	__attribute__((unused)) void *user_data)
+	void *user_data)
 {
+	struct jsub_peer *peer = (struct jsub_peer *) user_data;
 	if (jsub_debug) {
 		DEBUG_LOG("CONNECT_NACK");
-		DEBUG_LOG("ack: %p", nack);
+		DEBUG_LOG("ack: %p host: %s", nack, peer->host);
 	}
-	jsub_is_conn_closed = true;
+	peer->closed = true;
 }
 
 int jsub_get_subscribe_request(
-		__attribute__((unused)) jaln_session *session,
+		jaln_session *session,
 		const struct jaln_channel_info *ch_info,
 		enum jaln_record_type type,
 		char **nonce,
 		uint64_t *offset)
 {
 	int ret = 0;
+	struct jsub_peer *peer = (struct jsub_peer *) jaln_session_get_user_data(session);
 	enum jaldb_rec_type rec_type;
 	if (jsub_debug) {
 		DEBUG_LOG("GET_SUBSCRIBE_REQUEST");
@@ -181,20 +214,35 @@ int jsub_get_subscribe_request(
 		ret = jsub_get_journal_resume(jsub_db_ctx,
 					ch_info->hostname,
 					nonce,
-					&db_payload_path, *offset);
+					&peer->db_payload_path, *offset);
 		if (0 != ret) {
 			// Default
 			*offset = 0;
-			db_payload_path = NULL;
+			peer->db_payload_path = NULL;
 		} else {
-			jal_asprintf(&full_payload_path, "%s/%s", jsub_db_ctx->journal_root, db_payload_path);
+			jal_asprintf(&full_payload_path, "%s/%s", jsub_db_ctx->journal_root, peer->db_payload_path);
 			nonce_out = *nonce;
-			db_payload_fd = open(full_payload_path, O_RDWR | O_APPEND);
-			if (0 > db_payload_fd) {
+			peer->db_payload_fd = open(full_payload_path, O_RDWR | O_APPEND);
+			if (0 > peer->db_payload_fd) {
 				DEBUG_LOG("Failed to open journal payload for resume: %s", strerror(errno));
 			}
-			DEBUG_LOG("Opened payload resume file: %d\n", db_payload_fd);
+			DEBUG_LOG("Opened payload resume file: %d\n", peer->db_payload_fd);
 			free(full_payload_path);
+			// The resume data is only stored every so often, so the
+			// file may hold more than the offset says. Cut it back to
+			// the checkpoint and have the publisher send the rest.
+			if (JAL_OK != jsub_prepare_journal_resume(peer->db_payload_fd, offset)) {
+				DEBUG_LOG("Failed to prepare journal payload for resume, starting over");
+				if (0 <= peer->db_payload_fd) {
+					close(peer->db_payload_fd);
+					peer->db_payload_fd = -1;
+				}
+				free(peer->db_payload_path);
+				peer->db_payload_path = NULL;
+				*offset = 0;
+			}
+			peer->journal_payload_size = *offset;
+			jsub_reset_journal_checkpoint(&peer->journal_checkpoint, *offset);
 		}
 		if ((0 != ret) && jsub_debug) {
 			DEBUG_LOG("failed to retrieve a journal resume for host: %s",
@@ -227,6 +275,7 @@ int jsub_on_record_info(
 		const uint32_t application_metadata_size,
 		void *user_data)
 {
+	struct jsub_peer *peer = (struct jsub_peer *) user_data;
 	if (jsub_debug) {
 		DEBUG_LOG("ON_RECORD INFO");
 		DEBUG_LOG("ch info:%p type:%d rec_info: %p headers: %p smb: %p sms:%d amb:%p ams:%d ud:%p\n",
@@ -239,22 +288,24 @@ int jsub_on_record_info(
 	
 	switch (type) {
 	case JALN_RTYPE_JOURNAL:
-		journal_sys_meta_size = system_metadata_size;
-		journal_sys_meta_buf = (uint8_t *) jal_memdup((char *)system_metadata_buffer, system_metadata_size);
-		journal_app_meta_size = application_metadata_size;
-		journal_app_meta_buf = (uint8_t *) jal_memdup((char *)application_metadata_buffer, application_metadata_size);
+		peer->journal_sys_meta_size = system_metadata_size;
+		peer->journal_sys_meta_buf = (uint8_t *) jal_memdup((char *)system_metadata_buffer, system_metadata_size);
+		peer->journal_app_meta_size = application_metadata_size;
+		peer->journal_app_meta_buf = (uint8_t *) jal_memdup((char *)application_metadata_buffer, application_metadata_size);
 		break;
 	case JALN_RTYPE_AUDIT:
-		audit_sys_meta_size = system_metadata_size;
-		audit_sys_meta_buf = (uint8_t *) jal_memdup((char *)system_metadata_buffer, system_metadata_size);
-		audit_app_meta_size = application_metadata_size;
-		audit_app_meta_buf = (uint8_t *) jal_memdup((char *)application_metadata_buffer, application_metadata_size);
+		peer->audit_sys_meta_size = system_metadata_size;
+		peer->audit_sys_meta_buf = (uint8_t *) jal_memdup((char *)system_metadata_buffer, system_metadata_size);
+		peer->audit_app_meta_size = application_metadata_size;
+		peer->audit_app_meta_buf = (uint8_t *) jal_memdup((char *)application_metadata_buffer, application_metadata_size);
+		jsub_payload_spool_begin(&peer->audit_spool, record_info->payload_len);
 		break;
 	case JALN_RTYPE_LOG:
-		log_sys_meta_size = system_metadata_size;
-		log_sys_meta_buf = (uint8_t *) jal_memdup((char *)system_metadata_buffer, system_metadata_size);
-		log_app_meta_size = application_metadata_size;
-		log_app_meta_buf = (uint8_t *) jal_memdup((char *)application_metadata_buffer, application_metadata_size);
+		peer->log_sys_meta_size = system_metadata_size;
+		peer->log_sys_meta_buf = (uint8_t *) jal_memdup((char *)system_metadata_buffer, system_metadata_size);
+		peer->log_app_meta_size = application_metadata_size;
+		peer->log_app_meta_buf = (uint8_t *) jal_memdup((char *)application_metadata_buffer, application_metadata_size);
+		jsub_payload_spool_begin(&peer->log_spool, record_info->payload_len);
 		break;
 	default:
 		break;
@@ -271,15 +322,16 @@ int jsub_on_audit(
 		const uint32_t cnt,
 		void *user_data)
 {
+	struct jsub_peer *peer = (struct jsub_peer *) user_data;
 	if (jsub_debug) {
 		DEBUG_LOG("ON_AUDIT");
 		DEBUG_LOG("ch info:%p nonce:%s buf: %p cnt:%d ud:%p\n",
 			ch_info, nonce, buffer, cnt, user_data);
 	}
 	// Insert audit into temp container
-	return jsub_insert_audit(jsub_db_ctx, ch_info->hostname, audit_sys_meta_buf,
-				 audit_sys_meta_size, audit_app_meta_buf,
-				 audit_app_meta_size, (uint8_t *)buffer, cnt,
+	return jsub_insert_audit(jsub_db_ctx, ch_info->hostname, peer->audit_sys_meta_buf,
+				 peer->audit_sys_meta_size, peer->audit_app_meta_buf,
+				 peer->audit_app_meta_size, (uint8_t *)buffer, cnt,
 				 (char *)nonce, jsub_debug);
 }
 
@@ -291,6 +343,7 @@ int jsub_on_log(
 		const uint32_t cnt,
 		void *user_data)
 {
+	struct jsub_peer *peer = (struct jsub_peer *) user_data;
 	if (jsub_debug) {
 		DEBUG_LOG("ON_LOG");
 		DEBUG_LOG("ch info:%p nonce:%s buf: %p cnt:%d ud:%p\n",
@@ -298,22 +351,100 @@ int jsub_on_log(
 	}
 
 	// Insert log into temp container
-	return jsub_insert_log(jsub_db_ctx, ch_info->hostname, log_sys_meta_buf,
-				log_sys_meta_size, log_app_meta_buf,
-				log_app_meta_size, (uint8_t *)buffer, cnt,
+	return jsub_insert_log(jsub_db_ctx, ch_info->hostname, peer->log_sys_meta_buf,
+				peer->log_sys_meta_size, peer->log_app_meta_buf,
+				peer->log_app_meta_size, (uint8_t *)buffer, cnt,
 				(char *)nonce, jsub_debug);
 }
 
+/**
+ * Collect the payload of an audit or log record in \p spool as it arrives,
+ * and insert the record once all of it has been received.
+ */
+static int jsub_on_payload_chunk(
+		struct jsub_payload_spool *spool,
+		const struct jaln_channel_info *ch_info,
+		const char *nonce,
+		const uint8_t *buffer,
+		const uint32_t cnt,
+		const int more,
+		uint8_t *sys_meta_buf,
+		uint32_t sys_meta_size,
+		uint8_t *app_meta_buf,
+		uint32_t app_meta_size)
+{
+	int ret = JAL_OK;
+	if (cnt) {
+		ret = jsub_spool_payload(jsub_db_ctx, spool, buffer, cnt, jsub_debug);
+		if (JAL_OK != ret) {
+			return ret;
+		}
+	}
+	if (0 == more) {
+		// Insert the record into the temp container
+		ret = jsub_insert_spooled_record(jsub_db_ctx, ch_info->hostname,
+				sys_meta_buf, sys_meta_size,
+				app_meta_buf, app_meta_size,
+				spool, (char *)nonce, jsub_debug);
+	}
+	return ret;
+}
+
+int jsub_on_audit_chunk(
+		__attribute__((unused)) jaln_session *session,
+		const struct jaln_channel_info *ch_info,
+		const char *nonce,
+		const uint8_t *buffer,
+		const uint32_t cnt,
+		const uint64_t offset,
+		const int more,
+		void *user_data)
+{
+	struct jsub_peer *peer = (struct jsub_peer *) user_data;
+	if (jsub_debug) {
+		DEBUG_LOG("ON_AUDIT_CHUNK");
+		DEBUG_LOG("more: %d offset: %" PRIu64, more, offset);
+		DEBUG_LOG("ch info:%p nonce:%s buf: %p cnt:%d ud:%p\n",
+			ch_info, nonce, buffer, cnt, user_data);
+	}
+	return jsub_on_payload_chunk(&peer->audit_spool, ch_info, nonce, buffer, cnt, more,
+			peer->audit_sys_meta_buf, peer->audit_sys_meta_size,
+			peer->audit_app_meta_buf, peer->audit_app_meta_size);
+}
+
+int jsub_on_log_chunk(
+		__attribute__((unused)) jaln_session *session,
+		const struct jaln_channel_info *ch_info,
+		const char *nonce,
+		const uint8_t *buffer,
+		const uint32_t cnt,
+		const uint64_t offset,
+		const int more,
+		void *user_data)
+{
+	struct jsub_peer *peer = (struct jsub_peer *) user_data;
+	if (jsub_debug) {
+		DEBUG_LOG("ON_LOG_CHUNK");
+		DEBUG_LOG("more: %d offset: %" PRIu64, more, offset);
+		DEBUG_LOG("ch info:%p nonce:%s buf: %p cnt:%d ud:%p\n",
+			ch_info, nonce, buffer, cnt, user_data);
+	}
+	return jsub_on_payload_chunk(&peer->log_spool, ch_info, nonce, buffer, cnt, more,
+			peer->log_sys_meta_buf, peer->log_sys_meta_size,
+			peer->log_app_meta_buf, peer->log_app_meta_size);
+}
+
 int jsub_on_journal(
 		__attribute__((unused)) jaln_session *session,
 		const struct jaln_channel_info *ch_info,
 		const char *nonce,
 		const uint8_t *buffer,
 		const uint32_t cnt,
-		__attribute__((unused)) const uint64_t offset,
+		const uint64_t offset,
 		const int more,
 		void *user_data)
 {
+	struct jsub_peer *peer = (struct jsub_peer *) user_data;
 	if (jsub_debug) {
 		DEBUG_LOG("ON_JOURNAL");
 		DEBUG_LOG("more: %d", more);
@@ -327,13 +458,14 @@ int jsub_on_journal(
 		if (buffer) {
 			int ret = jsub_write_journal(
 					jsub_db_ctx,
-					&db_payload_path,
-					&db_payload_fd,
+					&peer->db_payload_path,
+					&peer->db_payload_fd,
 					(uint8_t *)buffer,
 					cnt,
 					0,
 					ch_info->hostname,
 					nonce,
+					&peer->journal_checkpoint,
 					jsub_debug);
 			if (0 != ret) {
 				return ret;
@@ -344,29 +476,30 @@ int jsub_on_journal(
 		int ret = jsub_insert_journal_metadata(
 					jsub_db_ctx,
 					ch_info->hostname,
-					journal_sys_meta_buf,
-					journal_sys_meta_size,
-					journal_app_meta_buf,
-					journal_app_meta_size,
-					db_payload_path,
-					journal_payload_size,
+					peer->journal_sys_meta_buf,
+					peer->journal_sys_meta_size,
+					peer->journal_app_meta_buf,
+					peer->journal_app_meta_size,
+					peer->db_payload_path,
+					peer->journal_payload_size,
 					(char *)nonce,
 					jsub_debug);
-		journal_payload_size = 0;
+		peer->journal_payload_size = 0;
 		return ret;
 	} else {
 		// There will be more data, append what we've
 		//	received to file on disk.
-		journal_payload_size += cnt;
+		peer->journal_payload_size = offset + cnt;
 		return jsub_write_journal(
 					jsub_db_ctx,
-					&db_payload_path,
-					&db_payload_fd,
+					&peer->db_payload_path,
+					&peer->db_payload_fd,
 					(uint8_t *)buffer,
 					cnt,
-					journal_payload_size,
+					peer->journal_payload_size,
 					ch_info->hostname,
 					nonce,
+					&peer->journal_checkpoint,
 					jsub_debug);
 	}
 	return JAL_OK;
@@ -381,6 +514,10 @@ int jsub_notify_digest(
 		const uint32_t len,
 		const void *user_data)
 {
+	struct jsub_peer *peer = (struct jsub_peer *) user_data;
+	// The digest is calculated once the whole record is received. Each
+	// record type has its own channel, so this may run on several threads.
+	__sync_add_and_fetch(&peer->records, 1);
 	if (jsub_debug) {
 		DEBUG_LOG("NOTIFY_DIGEST");
 		DEBUG_LOG("ch info:%p type:%d nonce:%s dgst:%p, len:%d, ud:%p\n",
@@ -482,6 +619,7 @@ void jsub_message_complete(
 		enum jaln_record_type type,
 		void *user_data)
 {
+	struct jsub_peer *peer = (struct jsub_peer *) user_data;
 	int rc = 0;
 	if (jsub_debug) {
 		DEBUG_LOG("MESSAGE_COMPLETE");
@@ -492,44 +630,46 @@ void jsub_message_complete(
 	switch (type) {
 	case JALN_RTYPE_JOURNAL:
 		// Perform some cleanup?
-		if (-1 != db_payload_fd) {
-			rc = fsync(db_payload_fd);
+		if (-1 != peer->db_payload_fd) {
+			rc = fsync(peer->db_payload_fd);
 			if ((-1 == rc) && jsub_debug) {
 				DEBUG_LOG("payload file sync failed for %s\n",
 					  ch_info->hostname);
 			}
-			rc = close(db_payload_fd);
+			rc = close(peer->db_payload_fd);
 			if ((-1 == rc) && jsub_debug) {
 				DEBUG_LOG("payload file close failed for %s\n",
 					  ch_info->hostname);
 			}
-			db_payload_fd = -1;
+			peer->db_payload_fd = -1;
 		}
 
-		free(journal_sys_meta_buf);
-		free(journal_app_meta_buf);
-		free(db_payload_path);
-		journal_sys_meta_buf = NULL;
-		journal_app_meta_buf = NULL;
-		journal_sys_meta_size = 0;
-		journal_app_meta_size = 0;
-		db_payload_path = NULL;
+		free(peer->journal_sys_meta_buf);
+		free(peer->journal_app_meta_buf);
+		free(peer->db_payload_path);
+		peer->journal_sys_meta_buf = NULL;
+		peer->journal_app_meta_buf = NULL;
+		peer->journal_sys_meta_size = 0;
+		peer->journal_app_meta_size = 0;
+		peer->db_payload_path = NULL;
 		break;
 	case JALN_RTYPE_AUDIT:
-		free(audit_sys_meta_buf);
-		free(audit_app_meta_buf);
-		audit_sys_meta_buf = NULL;
-		audit_app_meta_buf = NULL;
-		audit_sys_meta_size = 0;
-		audit_app_meta_size = 0;
+		free(peer->audit_sys_meta_buf);
+		free(peer->audit_app_meta_buf);
+		peer->audit_sys_meta_buf = NULL;
+		peer->audit_app_meta_buf = NULL;
+		peer->audit_sys_meta_size = 0;
+		peer->audit_app_meta_size = 0;
+		jsub_payload_spool_end(jsub_db_ctx, &peer->audit_spool);
 		break;
 	case JALN_RTYPE_LOG:
-		free(log_sys_meta_buf);
-		free(log_app_meta_buf);
-		log_sys_meta_buf = NULL;
-		log_app_meta_buf = NULL;
-		log_sys_meta_size = 0;
-		log_app_meta_size = 0;
+		free(peer->log_sys_meta_buf);
+		free(peer->log_app_meta_buf);
+		peer->log_sys_meta_buf = NULL;
+		peer->log_app_meta_buf = NULL;
+		peer->log_sys_meta_size = 0;
+		peer->log_app_meta_size = 0;
+		jsub_payload_spool_end(jsub_db_ctx, &peer->log_spool);
 		break;
 	default:
 		break;
@@ -540,22 +680,23 @@ enum jal_status jsub_get_bytes(
 		const uint64_t offset,
 		uint8_t *const buffer,
 		uint64_t *size,
-		__attribute__((unused))void *feeder_data)
+		void *feeder_data)
 {
-	if (-1 == db_payload_fd){
+	struct jsub_peer *peer = (struct jsub_peer *) feeder_data;
+	if (-1 == peer->db_payload_fd){
 		if (jsub_debug) {
 			DEBUG_LOG("get_bytes: bad file descriptor!\n");
 		}
 		return JAL_E_BAD_FD;
 	}
-	int rc = lseek64(db_payload_fd, offset, SEEK_SET);
+	int rc = lseek64(peer->db_payload_fd, offset, SEEK_SET);
 	if (-1 == rc ) {
 		if (jsub_debug) {
 			DEBUG_LOG("get_bytes: seek failed!\n");
 		}
 		return JAL_E_FILE_IO;
 	}
-	ssize_t bytes_read = read(db_payload_fd, buffer, *size);
+	ssize_t bytes_read = read(peer->db_payload_fd, buffer, *size);
 	*size = bytes_read;
 	if (-1 == bytes_read) {
 		if (jsub_debug) {
@@ -600,11 +741,15 @@ void jsub_release_journal_feeder(
 
 enum jal_status jsub_init_subscriber_callbacks(jaln_context *context)
 {
-	sub_cbs = jaln_subscriber_callbacks_create();
+	// Each subscriber thread sets up its own context, so nothing here may
+	// be shared between calls. The context keeps a copy of sub_cbs.
+	struct jaln_subscriber_callbacks *sub_cbs = jaln_subscriber_callbacks_create();
 	sub_cbs->get_subscribe_request = jsub_get_subscribe_request;
 	sub_cbs->on_record_info = jsub_on_record_info;
 	sub_cbs->on_audit = jsub_on_audit;
 	sub_cbs->on_log = jsub_on_log;
+	sub_cbs->on_audit_chunk = jsub_on_audit_chunk;
+	sub_cbs->on_log_chunk = jsub_on_log_chunk;
 	sub_cbs->on_journal = jsub_on_journal;
 	sub_cbs->notify_digest = jsub_notify_digest;
 	sub_cbs->on_digest_response = jsub_on_digest_response;
@@ -619,13 +764,18 @@ enum jal_status jsub_init_subscriber_callbacks(jaln_context *context)
 
 enum jal_status jsub_init_connection_callbacks(jaln_context *context)
 {
-	cb = jaln_connection_callbacks_create();
+	// The context takes ownership of cb once it is registered.
+	struct jaln_connection_callbacks *cb = jaln_connection_callbacks_create();
 	cb->connect_request_handler = jsub_connect_request_handler;
 	cb->on_channel_close = jsub_on_channel_close;
 	cb->on_connection_close = jsub_on_connection_close;
 	cb->connect_ack = jsub_connect_ack;
 	cb->connect_nack = jsub_connect_nack;
-	return jaln_register_connection_callbacks(context, cb);
+	enum jal_status ret = jaln_register_connection_callbacks(context, cb);
+	if (JAL_OK != ret) {
+		jaln_connection_callbacks_destroy(&cb);
+	}
+	return ret;
 }
 
 enum jal_status jsub_callbacks_init(jaln_context *context)
@@ -31,17 +31,100 @@
 #define _JSUB_CALLBACKS_HPP_
 
 #include <stdlib.h>
+#include <time.h>
 #include <jalop/jaln_network_types.h>
 #include <jalop/jaln_subscriber_callbacks.h>
 #include <jalop/jaln_connection_callbacks.h>
 #include <jalop/jaln_network.h>
 #include "jaldb_context.h"
 #include "jaldb_context.hpp"
+#include "jsub_db_layer.hpp"
 
-extern volatile bool jsub_is_conn_closed;
 extern volatile int jsub_debug;
 extern jaldb_context *jsub_db_ctx;
 
+/**
+ * The state of the connection to a single publisher.
+ *
+ * The subscriber connects to each publisher with its own jaln_context and
+ * passes its jsub_peer as the user data, so the callbacks find the record
+ * being received from that publisher without any state shared between
+ * connections. All connections insert into the same jaldb_context.
+ */
+struct jsub_peer {
+	char *host;			//!< The publisher to connect to.
+	volatile bool closed;		//!< Set once the connection is closed or refused.
+
+	// Journal buffers
+	uint8_t *journal_sys_meta_buf;
+	uint32_t journal_sys_meta_size;
+	uint8_t *journal_app_meta_buf;
+	uint32_t journal_app_meta_size;
+	uint64_t journal_payload_size;
+
+	// Audit buffers
+	uint8_t *audit_sys_meta_buf;
+	uint32_t audit_sys_meta_size;
+	uint8_t *audit_app_meta_buf;
+	uint32_t audit_app_meta_size;
+	struct jsub_payload_spool audit_spool;
+
+	// Log buffers
+	uint8_t *log_sys_meta_buf;
+	uint32_t log_sys_meta_size;
+	uint8_t *log_app_meta_buf;
+	uint32_t log_app_meta_size;
+	struct jsub_payload_spool log_spool;
+
+	// Journal path and fd
+	char *db_payload_path;
+	int db_payload_fd;
+	struct jsub_journal_checkpoint journal_checkpoint;
+
+	// Statistics for jal_subscribe --report
+	uint64_t records;		//!< Number of records received.
+	struct timespec closed_time;	//!< When the connection closed, from CLOCK_MONOTONIC.
+};
+
+/**
+ * Create the state for the connection to \p host, using the journal
+ * checkpoint and payload memory limit set with jsub_set_journal_checkpoint()
+ * and jsub_set_payload_memory_limit().
+ *
+ * @param[in] host The publisher to connect to.
+ *
+ * @return The new jsub_peer.
+ */
+struct jsub_peer *jsub_peer_create(const char *host);
+
+/**
+ * Release a jsub_peer and any partially received record it still holds.
+ *
+ * @param[in,out] peer The jsub_peer to destroy, set to NULL.
+ */
+void jsub_peer_destroy(struct jsub_peer **peer);
+
 enum jal_status jsub_callbacks_init(jaln_context *ctx);
 
+/**
+ * Set how often the resume data for a journal record is stored while it is
+ * received, for connections created after this call. See
+ * jsub_journal_checkpoint.
+ *
+ * @param[in] max_bytes The number of bytes to receive between checkpoints,
+ * or 0 to store the resume data after every frame.
+ * @param[in] max_secs The number of seconds between checkpoints, or 0 for no
+ * time limit.
+ */
+void jsub_set_journal_checkpoint(uint64_t max_bytes, time_t max_secs);
+
+/**
+ * Set the size of the largest audit or log payload to keep in memory while
+ * it is received, for connections created after this call. A larger payload
+ * is written to a file as it arrives. See jsub_payload_spool.
+ *
+ * @param[in] max_bytes The size in bytes.
+ */
+void jsub_set_payload_memory_limit(size_t max_bytes);
+
 #endif // _JSUB_CALLBACKS_HPP_
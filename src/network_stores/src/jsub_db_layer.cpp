@@ -29,13 +29,16 @@
 
 #include <jalop/jal_status.h>
 #include <openssl/pem.h>
+#include <errno.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "jsub_db_layer.hpp"
 #include "jaldb_utils.h"
 #include "jaldb_record_xml.h"
 #include "jal_alloc.h"
+#include "jal_asprintf_internal.h"
 #include "jaldb_segment.h"
 
 #define stringify( name ) # name
@@ -212,6 +215,68 @@ out:
 	return ret;
 }
 
+void jsub_reset_journal_checkpoint(struct jsub_journal_checkpoint *checkpoint,
+		uint64_t offset)
+{
+	if (!checkpoint) {
+		return;
+	}
+	checkpoint->last_offset = offset;
+	checkpoint->last_time = offset ? time(NULL) : 0;
+}
+
+int jsub_prepare_journal_resume(int fd, uint64_t *offset)
+{
+	struct stat st;
+	if (0 > fd || !offset || 0 != fstat(fd, &st)) {
+		return JAL_E_FILE_IO;
+	}
+	if ((uint64_t) st.st_size < *offset) {
+		*offset = st.st_size;
+	} else if ((uint64_t) st.st_size > *offset) {
+		if (0 != ftruncate(fd, *offset)) {
+			return JAL_E_FILE_IO;
+		}
+	}
+	return JAL_OK;
+}
+
+bool jsub_journal_checkpoint_due(struct jsub_journal_checkpoint *checkpoint,
+		uint64_t processed_len)
+{
+	if (!checkpoint || 0 == checkpoint->last_time) {
+		// Always store the first one, so the file is known should
+		// the connection drop.
+		return true;
+	}
+	if (processed_len - checkpoint->last_offset >= checkpoint->max_bytes) {
+		return true;
+	}
+	return (0 != checkpoint->max_secs) &&
+		(time(NULL) - checkpoint->last_time >= checkpoint->max_secs);
+}
+
+/**
+ * Write all of \p buf to \p fd.
+ *
+ * @return 0 on success, or -1 with errno set.
+ */
+static int jsub_write_all(int fd, const uint8_t *buf, size_t len)
+{
+	size_t written = 0;
+	while (written < len) {
+		ssize_t bytes_written = write(fd, buf + written, len - written);
+		if (0 > bytes_written) {
+			if (EINTR == errno) {
+				continue;
+			}
+			return -1;
+		}
+		written += bytes_written;
+	}
+	return 0;
+}
+
 int jsub_write_journal(
 		jaldb_context *db_ctx,
 		char **db_payload_path,
@@ -221,10 +286,10 @@ int jsub_write_journal(
 		size_t processed_len,
 		const char *hostname,
 		const char *nonce,
+		struct jsub_journal_checkpoint *checkpoint,
 		int debug)
 {
 	int ret = JAL_OK;
-	int bytes_written;
 	if (!db_payload_path || !buffer || !db_ctx){
 		if (debug) {
 			DEBUG_LOG("Payload, payload_path or db_ctx was NULL!\n");
@@ -236,11 +301,7 @@ int jsub_write_journal(
 		// Path is NULL and FileDescriptor is invalid,
 		//	get a file from the db layer to write the
 		//	journal data to.
-		uuid_t uuid;
-		uuid_generate(uuid);
-		//TODO: This needs to be updated to parse the uuid from the sys metadata
-		ret = jaldb_create_file(db_ctx->journal_root, db_payload_path, db_payload_fd,
-				uuid, JALDB_RTYPE_JOURNAL, JALDB_DTYPE_PAYLOAD);
+		ret = jaldb_create_journal_file(db_ctx, 0, db_payload_path, db_payload_fd);
 		if (ret != JALDB_OK) {
 			if (debug) {
 				DEBUG_LOG("Could not create a file to store journal data\n");
@@ -248,22 +309,38 @@ int jsub_write_journal(
 			ret = JAL_E_FILE_OPEN;
 			goto out;
 		}
+		jsub_reset_journal_checkpoint(checkpoint, 0);
 	}
-	bytes_written = write(*db_payload_fd, buffer, buffer_len);
-	if (0 > bytes_written) {
+	if (0 != jsub_write_all(*db_payload_fd, buffer, buffer_len)) {
 		if (debug) {
 			DEBUG_LOG("An error occurred while writing journal data to file.\n");
 			perror("write()");
 		}
 		ret = JAL_E_FILE_IO;
+		goto out;
 	}
 
-	if (JAL_OK == ret) {
-		if (processed_len) {
-			ret = jsub_store_journal_resume(db_ctx, hostname, nonce, *db_payload_path, processed_len);
-		} else {
-			ret = jsub_clear_journal_resume(db_ctx, hostname);
+	if (!processed_len) {
+		ret = jsub_clear_journal_resume(db_ctx, hostname);
+		jsub_reset_journal_checkpoint(checkpoint, 0);
+		goto out;
+	}
+	if (!jsub_journal_checkpoint_due(checkpoint, processed_len)) {
+		goto out;
+	}
+	// The resume data must never point past what is on disk, since the
+	// data up to the offset is not sent again.
+	if (checkpoint && 0 != fdatasync(*db_payload_fd)) {
+		if (debug) {
+			DEBUG_LOG("Failed to sync journal data to disk.\n");
 		}
+		ret = JAL_E_FILE_IO;
+		goto out;
+	}
+	ret = jsub_store_journal_resume(db_ctx, hostname, nonce, *db_payload_path, processed_len);
+	if (JAL_OK == ret && checkpoint) {
+		checkpoint->last_offset = processed_len;
+		checkpoint->last_time = time(NULL);
 	}
 out:
 	return ret;
@@ -335,6 +412,155 @@ out:
 	return ret;
 }
 
+void jsub_payload_spool_begin(struct jsub_payload_spool *spool,
+		uint64_t expected_len)
+{
+	spool->expected_len = expected_len;
+	spool->len = 0;
+	spool->failed = 0;
+}
+
+int jsub_spool_payload(
+		jaldb_context *db_ctx,
+		struct jsub_payload_spool *spool,
+		const uint8_t *buffer,
+		size_t buffer_len,
+		int debug)
+{
+	int ret = JAL_OK;
+	if (!db_ctx || !spool || (!buffer && buffer_len)) {
+		ret = JAL_E_INVAL_PARAM;
+		goto out;
+	}
+	if (spool->failed) {
+		ret = JAL_E_FILE_IO;
+		goto out;
+	}
+	if (-1 == spool->fd && (spool->expected_len > spool->mem_max ||
+			spool->len + buffer_len > spool->mem_max)) {
+		// Too large to keep in memory, move what was received so far
+		// to a file with room for the whole payload.
+		uint64_t reserve = spool->expected_len;
+		if (reserve < spool->len + buffer_len) {
+			reserve = spool->len + buffer_len;
+		}
+		if (JALDB_OK != jaldb_create_journal_file(db_ctx, reserve, &spool->path, &spool->fd)) {
+			if (debug) {
+				DEBUG_LOG("Could not create a file to store the payload\n");
+			}
+			ret = JAL_E_FILE_OPEN;
+			goto err;
+		}
+		if (spool->len && 0 != jsub_write_all(spool->fd, spool->buf, spool->len)) {
+			ret = JAL_E_FILE_IO;
+			goto err;
+		}
+		free(spool->buf);
+		spool->buf = NULL;
+		spool->buf_size = 0;
+	}
+	if (-1 != spool->fd) {
+		if (0 != jsub_write_all(spool->fd, buffer, buffer_len)) {
+			ret = JAL_E_FILE_IO;
+			goto err;
+		}
+	} else if (buffer_len) {
+		if (spool->len + buffer_len > spool->buf_size) {
+			// The length of the payload is known up front, so this
+			// normally happens once per record.
+			spool->buf_size = spool->len + buffer_len;
+			if (spool->buf_size < spool->expected_len) {
+				spool->buf_size = spool->expected_len;
+			}
+			spool->buf = (uint8_t *) jal_realloc(spool->buf, spool->buf_size);
+		}
+		memcpy(spool->buf + spool->len, buffer, buffer_len);
+	}
+	spool->len += buffer_len;
+	goto out;
+err:
+	if (debug && JAL_E_FILE_IO == ret) {
+		DEBUG_LOG("An error occurred while writing the payload to file.\n");
+		perror("write()");
+	}
+	spool->failed = 1;
+out:
+	return ret;
+}
+
+int jsub_insert_spooled_record(
+		jaldb_context *db_ctx,
+		char *c_source,
+		uint8_t *sys_meta,
+		size_t sys_len,
+		uint8_t *app_meta,
+		size_t app_len,
+		struct jsub_payload_spool *spool,
+		char *nonce_in,
+		int debug)
+{
+	int ret;
+	if (!db_ctx || !spool) {
+		ret = JAL_E_INVAL_PARAM;
+		goto out;
+	}
+	if (spool->failed) {
+		ret = JAL_E_FILE_IO;
+		goto out;
+	}
+	if (-1 == spool->fd) {
+		// The record type comes from the system metadata, and the DB
+		// layer checks that an audit record has a payload, so this
+		// also works for audit records.
+		ret = jsub_insert_log(db_ctx, c_source, sys_meta, sys_len,
+				app_meta, app_len, spool->buf, spool->len, nonce_in, debug);
+		goto out;
+	}
+	if (0 != fdatasync(spool->fd)) {
+		if (debug) {
+			DEBUG_LOG("Failed to sync the payload to disk.\n");
+		}
+		ret = JAL_E_FILE_IO;
+		goto out;
+	}
+	ret = jsub_insert_journal_metadata(db_ctx, c_source, sys_meta, sys_len,
+			app_meta, app_len, spool->path, spool->len, nonce_in, debug);
+	if (JALDB_OK == ret) {
+		// The file belongs to the record now.
+		free(spool->path);
+		spool->path = NULL;
+	}
+out:
+	return ret;
+}
+
+void jsub_payload_spool_end(jaldb_context *db_ctx,
+		struct jsub_payload_spool *spool)
+{
+	if (!spool) {
+		return;
+	}
+	if (-1 != spool->fd) {
+		close(spool->fd);
+		spool->fd = -1;
+	}
+	if (spool->path && db_ctx) {
+		char *full_path = NULL;
+		if (-1 != jal_asprintf(&full_path, "%s/%s", db_ctx->journal_root, spool->path)) {
+			unlink(full_path);
+		}
+		free(full_path);
+	}
+	free(spool->path);
+	spool->path = NULL;
+	free(spool->buf);
+	spool->buf = NULL;
+	spool->buf_size = 0;
+	spool->len = 0;
+	spool->expected_len = 0;
+	spool->failed = 0;
+}
+
 int jsub_store_journal_resume(
 		jaldb_context *db_ctx,
 		const char *remote_host,
@@ -31,6 +31,7 @@
 #define _JSUB_DB_LAYER_HPP_
 
 #include <string>
+#include <time.h>
 #include <openssl/pem.h>
 #include <jalop/jaln_network_types.h>
 #include "jaldb_status.h"
@@ -208,6 +209,60 @@ int jsub_transfer_journal(
 		std::string &tmp_nonce,
 		std::string &perm_nonce);
 
+/** The default number of journal bytes to receive between resume checkpoints. */
+#define JSUB_JOURNAL_CHECKPOINT_BYTES_DEFAULT (8 * 1024 * 1024)
+
+/** The default number of seconds between resume checkpoints. */
+#define JSUB_JOURNAL_CHECKPOINT_TIMEOUT_DEFAULT 5
+
+/**
+ * Decides how often the resume data for the journal record being received
+ * is stored. Storing it is a database transaction, so instead of doing so
+ * for every frame it is done once \p max_bytes were written or \p max_secs
+ * passed since the last checkpoint, after the payload file is synced.
+ */
+struct jsub_journal_checkpoint {
+	uint64_t max_bytes;    //!< Bytes to write between checkpoints, 0 to store one after every write.
+	time_t max_secs;       //!< Seconds between checkpoints, 0 for no time limit.
+	uint64_t last_offset;  //!< The offset stored by the last checkpoint.
+	time_t last_time;      //!< When the last checkpoint was stored, or 0 if none was for this record.
+};
+
+/**
+ * Reset \p checkpoint for a record that was received up to \p offset.
+ *
+ * @param[in,out] checkpoint The checkpoint state to reset.
+ * @param[in] offset The offset the resume data was stored at, or 0 for a new
+ * record.
+ */
+void jsub_reset_journal_checkpoint(struct jsub_journal_checkpoint *checkpoint,
+		uint64_t offset);
+
+/**
+ * Decide whether the resume data should be stored after writing up to
+ * \p processed_len bytes.
+ *
+ * @param[in] checkpoint The checkpoint state, or NULL to store it every time.
+ * @param[in] processed_len The number of payload bytes written so far.
+ *
+ * @return true if the resume data should be stored now.
+ */
+bool jsub_journal_checkpoint_due(struct jsub_journal_checkpoint *checkpoint,
+		uint64_t processed_len);
+
+/**
+ * Prepare a journal file for resuming at \p offset, as stored by the last
+ * checkpoint. Anything written after the checkpoint is cut off, since the
+ * publisher sends it again. If the file is shorter than \p offset, the
+ * offset is moved back to the end of the file.
+ *
+ * @param[in] fd The journal file, opened for writing.
+ * @param[in,out] offset The offset to resume at.
+ *
+ * @return JAL_OK on success, or JAL_E_FILE_IO on error.
+ */
+int jsub_prepare_journal_resume(int fd, uint64_t *offset);
+
 /**
  * Write journal buffer data to a file.
  * @param[in] db_ctx The database context.
@@ -221,6 +276,8 @@ int jsub_transfer_journal(
  * data should be cleared
  * @param[in] hostname The \p hostname we are receiving the journal from.
  * @param[in] nonce The \p nonce of the record we are receiving.
+ * @param[in,out] checkpoint Decides when the resume data is stored. If NULL,
+ * it is stored after every write.
  * @param[in] debug A flag indicating whether or not debug
  *	information is written to stdout. 0 False, 1 True.
  *
@@ -237,8 +294,102 @@ int jsub_write_journal(
 		size_t proccessed_len,
 		const char *hostname,
 		const char *nonce,
+		struct jsub_journal_checkpoint *checkpoint,
 		int debug);
 
+/** The default size of the largest audit or log payload kept in memory. */
+#define JSUB_PAYLOAD_MEMORY_LIMIT_DEFAULT (1024 * 1024)
+
+/**
+ * Collects the payload of the audit or log record being received. A payload
+ * of up to \p mem_max bytes is kept in memory. A larger one is written to a
+ * file in the journal directory of the database as it arrives, and the
+ * record refers to the file, the same way as for a journal record, so memory
+ * use does not grow with the size of the record.
+ */
+struct jsub_payload_spool {
+	size_t mem_max;          //!< The largest payload to keep in memory.
+	uint64_t expected_len;   //!< The length of the payload, from the record's headers.
+	uint8_t *buf;            //!< The payload, while it is kept in memory.
+	size_t buf_size;         //!< The size of \p buf.
+	uint64_t len;            //!< The number of payload bytes received so far.
+	char *path;              //!< The file holding the payload, relative to the journal root, or NULL.
+	int fd;                  //!< The open payload file, or -1.
+	int failed;              //!< Set once storing the payload failed, the record is then not inserted.
+};
+
+/**
+ * Start collecting the payload of a new record.
+ *
+ * @param[in,out] spool The spool, which must not hold a payload.
+ * @param[in] expected_len The length of the payload.
+ */
+void jsub_payload_spool_begin(struct jsub_payload_spool *spool,
+		uint64_t expected_len);
+
+/**
+ * Add the next block of a payload to \p spool. Once the payload is known to
+ * be larger than jsub_payload_spool::mem_max, it is written to a new file
+ * from the database, starting with what was kept in memory so far.
+ *
+ * @param[in] db_ctx The database context.
+ * @param[in,out] spool The spool.
+ * @param[in] buffer The data to add.
+ * @param[in] buffer_len The length of \p buffer.
+ * @param[in] debug A flag indicating whether or not debug
+ *	information is written to stdout. 0 False, 1 True.
+ *
+ * @return JAL_OK on success, or a JAL error code. After an error, the spool
+ * fails until jsub_payload_spool_end() is called.
+ */
+int jsub_spool_payload(
+		jaldb_context *db_ctx,
+		struct jsub_payload_spool *spool,
+		const uint8_t *buffer,
+		size_t buffer_len,
+		int debug);
+
+/**
+ * Insert a record with the payload collected in \p spool into the temporary
+ * database container. If the payload is in a file, the file is synced and
+ * belongs to the record from then on.
+ *
+ * @param[in] db_ctx The database context.
+ * @param[in] c_source The name of the source of the record.
+ * @param[in] sys_meta The system metadata to insert.
+ * @param[in] sys_len The length of \p sys_meta.
+ * @param[in] app_meta The application metadata to insert.
+ * @param[in] app_len The length of \p app_meta.
+ * @param[in,out] spool The payload of the record.
+ * @param[in] nonce_in The nonce to use for inserting the record.
+ * @param[in] debug A flag to denote if debugging information should be
+ *			printed to stderr.
+ *
+ * @return
+ *  - JALDB_OK if the function succeeds or a JAL error code if the function
+ * fails.
+ */
+int jsub_insert_spooled_record(
+		jaldb_context *db_ctx,
+		char *c_source,
+		uint8_t *sys_meta,
+		size_t sys_len,
+		uint8_t *app_meta,
+		size_t app_len,
+		struct jsub_payload_spool *spool,
+		char *nonce_in,
+		int debug);
+
+/**
+ * Release the payload collected in \p spool. A payload file that was not
+ * handed to a record is removed.
+ *
+ * @param[in] db_ctx The database context.
+ * @param[in,out] spool The spool to reset.
+ */
+void jsub_payload_spool_end(jaldb_context *db_ctx,
+		struct jsub_payload_spool *spool);
+
 /**
  * Stores the last confirmed nonce for a record type to
  * the temp database.
@@ -0,0 +1,215 @@
+/**
+* @file test_jsub_callbacks.cpp This file contains functions to test
+* jsub_callbacks.cpp.
+*
+* @section LICENSE
+*
+* Source code in 3rd-party is licensed and owned by their respective
+* copyright holders.
+*
+* All other source code is copyright Tresys Technology and licensed as below.
+*
+ * Copyright (c) 2011-2013 Tresys Technology LLC, Columbia, Maryland, USA
+*
+* This software was developed by Tresys Technology LLC
+* with U.S. Government sponsorship.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*    http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+// The test-dept code doesn't work very well in C++ when __STRICT_ANSI__ is
+// not defined. It tries to use some gcc extensions that don't work well with
+// C++.
+
+#ifndef __STRICT_ANSI__
+#define __STRICT_ANSI__
+#endif
+
+extern "C" {
+#include <test-dept.h>
+}
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <jalop/jal_status.h>
+
+#include "jal_alloc.h"
+#include "jsub_callbacks.hpp"
+#include "jaldb_context.hpp"
+
+#define OTHER_DB_ROOT "./jsub_cb_testdb/"
+#define OTHER_SCHEMA_ROOT "./schemas/"
+#define PAYLOAD "This Is Some Text!\n"
+#define HOST "127.0.0.2"
+#define NUM_CONTEXTS 16
+
+// Defined by jal_subscribe.cpp in the subscriber.
+jaldb_context *jsub_db_ctx = NULL;
+
+extern "C" void setup()
+{
+	struct stat st;
+	if (stat(OTHER_DB_ROOT, &st) != 0) {
+		mkdir(OTHER_DB_ROOT, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+	}
+	else {
+		struct dirent *d;
+		DIR *dir;
+		char buf[256];
+		dir = opendir(OTHER_DB_ROOT);
+		while ((d = readdir(dir)) != NULL) {
+			sprintf(buf, "%s/%s", OTHER_DB_ROOT, d->d_name);
+			remove(buf);
+		}
+		closedir(dir);
+	}
+	jsub_db_ctx = jsub_setup_db_layer(OTHER_DB_ROOT, OTHER_SCHEMA_ROOT);
+	jsub_set_journal_checkpoint(JSUB_JOURNAL_CHECKPOINT_BYTES_DEFAULT,
+			JSUB_JOURNAL_CHECKPOINT_TIMEOUT_DEFAULT);
+	jsub_set_payload_memory_limit(JSUB_PAYLOAD_MEMORY_LIMIT_DEFAULT);
+}
+
+extern "C" void teardown()
+{
+	jsub_teardown_db_layer(&jsub_db_ctx);
+}
+
+extern "C" void test_peer_create_works()
+{
+	char host[] = HOST;
+	jsub_set_journal_checkpoint(100, 7);
+	jsub_set_payload_memory_limit(64);
+
+	struct jsub_peer *peer = jsub_peer_create(host);
+	assert_not_equals((void *) NULL, peer);
+	assert_string_equals(HOST, peer->host);
+	assert_not_equals((void *) host, peer->host);
+	assert_false(peer->closed);
+
+	assert_pointer_equals((void *) NULL, peer->journal_sys_meta_buf);
+	assert_pointer_equals((void *) NULL, peer->audit_sys_meta_buf);
+	assert_pointer_equals((void *) NULL, peer->log_sys_meta_buf);
+	assert_pointer_equals((void *) NULL, peer->db_payload_path);
+	assert_equals(-1, peer->db_payload_fd);
+
+	assert_equals(64, peer->audit_spool.mem_max);
+	assert_equals(-1, peer->audit_spool.fd);
+	assert_equals(64, peer->log_spool.mem_max);
+	assert_equals(-1, peer->log_spool.fd);
+
+	assert_equals(100, peer->journal_checkpoint.max_bytes);
+	assert_equals(7, peer->journal_checkpoint.max_secs);
+	assert_equals(0, peer->journal_checkpoint.last_time);
+
+	jsub_peer_destroy(&peer);
+	assert_pointer_equals((void *) NULL, peer);
+}
+
+extern "C" void test_peer_create_keeps_settings_of_existing_peers()
+{
+	struct jsub_peer *first = jsub_peer_create(HOST);
+	jsub_set_journal_checkpoint(100, 7);
+	jsub_set_payload_memory_limit(64);
+	struct jsub_peer *second = jsub_peer_create("127.0.0.3");
+
+	assert_string_equals(HOST, first->host);
+	assert_equals(JSUB_PAYLOAD_MEMORY_LIMIT_DEFAULT, first->audit_spool.mem_max);
+	assert_equals(JSUB_JOURNAL_CHECKPOINT_BYTES_DEFAULT,
+			first->journal_checkpoint.max_bytes);
+	assert_string_equals("127.0.0.3", second->host);
+	assert_equals(64, second->audit_spool.mem_max);
+	assert_equals(100, second->journal_checkpoint.max_bytes);
+
+	jsub_peer_destroy(&first);
+	jsub_peer_destroy(&second);
+}
+
+extern "C" void test_peer_destroy_releases_partial_record()
+{
+	size_t payload_len = strlen(PAYLOAD);
+	char *spool_path = NULL;
+	struct stat st;
+	jsub_set_payload_memory_limit(8);
+	struct jsub_peer *peer = jsub_peer_create(HOST);
+
+	peer->journal_sys_meta_buf = (uint8_t *) jal_malloc(payload_len);
+	peer->journal_app_meta_buf = (uint8_t *) jal_malloc(payload_len);
+	peer->audit_sys_meta_buf = (uint8_t *) jal_malloc(payload_len);
+	peer->log_app_meta_buf = (uint8_t *) jal_malloc(payload_len);
+	assert_equals(JALDB_OK, jaldb_create_journal_file(jsub_db_ctx, 0,
+			&peer->db_payload_path, &peer->db_payload_fd));
+
+	// An audit payload too large to keep in memory went to a file.
+	jsub_payload_spool_begin(&peer->audit_spool, 0);
+	assert_equals(JAL_OK, jsub_spool_payload(jsub_db_ctx, &peer->audit_spool,
+			(uint8_t *) PAYLOAD, payload_len, 0));
+	assert_true(0 <= peer->audit_spool.fd);
+	assert_true(0 < asprintf(&spool_path, "%s/%s", jsub_db_ctx->journal_root,
+			peer->audit_spool.path));
+	assert_equals(0, stat(spool_path, &st));
+
+	// The record was never inserted, so its payload file goes away.
+	jsub_peer_destroy(&peer);
+	assert_pointer_equals((void *) NULL, peer);
+	assert_true(0 != stat(spool_path, &st));
+	free(spool_path);
+}
+
+extern "C" void test_peer_destroy_with_null_does_not_crash()
+{
+	struct jsub_peer *peer = NULL;
+	jsub_peer_destroy(NULL);
+	jsub_peer_destroy(&peer);
+	assert_pointer_equals((void *) NULL, peer);
+}
+
+static pthread_barrier_t init_barrier;
+
+static void *init_callbacks(void *ptr)
+{
+	enum jal_status *ret = (enum jal_status *) ptr;
+	jaln_context *ctx = jaln_context_create();
+	pthread_barrier_wait(&init_barrier);
+	*ret = jsub_callbacks_init(ctx);
+	if (JAL_OK == *ret) {
+		// Both sets of callbacks were registered, so a second
+		// registration is refused.
+		*ret = (JAL_E_INVAL == jsub_callbacks_init(ctx)) ? JAL_OK : JAL_E_INVAL;
+	}
+	jaln_context_destroy(&ctx);
+	return NULL;
+}
+
+extern "C" void test_callbacks_init_works_for_contexts_set_up_at_once()
+{
+	pthread_t threads[NUM_CONTEXTS];
+	enum jal_status rets[NUM_CONTEXTS];
+	// Each subscriber thread sets up its own context, all of them at
+	// about the same time.
+	for (int round = 0; round < 10; round++) {
+		assert_equals(0, pthread_barrier_init(&init_barrier, NULL, NUM_CONTEXTS));
+		for (int i = 0; i < NUM_CONTEXTS; i++) {
+			rets[i] = JAL_E_INVAL;
+			assert_equals(0, pthread_create(&threads[i], NULL, init_callbacks, &rets[i]));
+		}
+		for (int i = 0; i < NUM_CONTEXTS; i++) {
+			pthread_join(threads[i], NULL);
+			assert_equals(JAL_OK, rets[i]);
+		}
+		pthread_barrier_destroy(&init_barrier);
+	}
+}
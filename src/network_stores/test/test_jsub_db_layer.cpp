@@ -40,7 +40,11 @@ extern "C" {
 }
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <jalop/jal_status.h>
 
 #include "jsub_db_layer.hpp"
 #include "jaldb_context.hpp"
@@ -100,3 +104,200 @@ extern "C" void test_write_journal_works()
 	assert_equals(0, rc);
 }
 */
+
+static int create_payload_file(const char *path)
+{
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, S_IRUSR | S_IWUSR);
+	assert_true(0 <= fd);
+	assert_equals((ssize_t) strlen(PAYLOAD), write(fd, PAYLOAD, strlen(PAYLOAD)));
+	return fd;
+}
+
+extern "C" void test_prepare_journal_resume_cuts_off_data_after_checkpoint()
+{
+	int fd = create_payload_file(OTHER_DB_ROOT "resume_payload");
+	uint64_t offset = 4;
+	struct stat st;
+
+	assert_equals(JAL_OK, jsub_prepare_journal_resume(fd, &offset));
+	assert_equals(4, offset);
+	assert_equals(0, fstat(fd, &st));
+	assert_equals(4, st.st_size);
+
+	// New data is appended right after the checkpoint.
+	assert_equals(1, write(fd, "x", 1));
+	assert_equals(0, fstat(fd, &st));
+	assert_equals(5, st.st_size);
+	close(fd);
+}
+
+extern "C" void test_prepare_journal_resume_moves_offset_back_for_short_file()
+{
+	int fd = create_payload_file(OTHER_DB_ROOT "resume_payload");
+	uint64_t offset = strlen(PAYLOAD) + 10;
+
+	assert_equals(JAL_OK, jsub_prepare_journal_resume(fd, &offset));
+	assert_equals(strlen(PAYLOAD), offset);
+	close(fd);
+}
+
+extern "C" void test_prepare_journal_resume_fails_with_bad_fd()
+{
+	uint64_t offset = 4;
+	assert_equals(JAL_E_FILE_IO, jsub_prepare_journal_resume(-1, &offset));
+	assert_equals(4, offset);
+}
+
+extern "C" void test_reset_journal_checkpoint()
+{
+	struct jsub_journal_checkpoint checkpoint;
+	checkpoint.max_bytes = 10;
+	checkpoint.max_secs = 1;
+	checkpoint.last_offset = 1;
+	checkpoint.last_time = 1;
+
+	jsub_reset_journal_checkpoint(&checkpoint, 0);
+	assert_equals(0, checkpoint.last_offset);
+	assert_equals(0, checkpoint.last_time);
+	assert_equals(10, checkpoint.max_bytes);
+
+	jsub_reset_journal_checkpoint(&checkpoint, 42);
+	assert_equals(42, checkpoint.last_offset);
+	assert_true(0 != checkpoint.last_time);
+}
+
+extern "C" void test_journal_checkpoint_due_for_first_write()
+{
+	struct jsub_journal_checkpoint checkpoint;
+	checkpoint.max_bytes = 100;
+	checkpoint.max_secs = 0;
+	jsub_reset_journal_checkpoint(&checkpoint, 0);
+
+	assert_true(jsub_journal_checkpoint_due(&checkpoint, 1));
+	assert_true(jsub_journal_checkpoint_due(NULL, 1));
+}
+
+extern "C" void test_journal_checkpoint_due_after_max_bytes()
+{
+	struct jsub_journal_checkpoint checkpoint;
+	checkpoint.max_bytes = 100;
+	checkpoint.max_secs = 0;
+	jsub_reset_journal_checkpoint(&checkpoint, 50);
+
+	assert_false(jsub_journal_checkpoint_due(&checkpoint, 51));
+	assert_false(jsub_journal_checkpoint_due(&checkpoint, 149));
+	assert_true(jsub_journal_checkpoint_due(&checkpoint, 150));
+	assert_true(jsub_journal_checkpoint_due(&checkpoint, 500));
+}
+
+extern "C" void test_journal_checkpoint_due_after_max_secs()
+{
+	struct jsub_journal_checkpoint checkpoint;
+	checkpoint.max_bytes = 100;
+	checkpoint.max_secs = 5;
+	jsub_reset_journal_checkpoint(&checkpoint, 50);
+
+	assert_false(jsub_journal_checkpoint_due(&checkpoint, 51));
+
+	checkpoint.last_time = time(NULL) - 5;
+	assert_true(jsub_journal_checkpoint_due(&checkpoint, 51));
+}
+
+extern "C" void test_journal_checkpoint_due_for_every_write_with_zero_max_bytes()
+{
+	struct jsub_journal_checkpoint checkpoint;
+	checkpoint.max_bytes = 0;
+	checkpoint.max_secs = 0;
+	jsub_reset_journal_checkpoint(&checkpoint, 50);
+
+	assert_true(jsub_journal_checkpoint_due(&checkpoint, 50));
+	assert_true(jsub_journal_checkpoint_due(&checkpoint, 51));
+}
+
+static void init_spool(struct jsub_payload_spool *spool, size_t mem_max)
+{
+	memset(spool, 0, sizeof(*spool));
+	spool->mem_max = mem_max;
+	spool->fd = -1;
+}
+
+extern "C" void test_spool_payload_keeps_small_payload_in_memory()
+{
+	struct jsub_payload_spool spool;
+	size_t payload_len = strlen(PAYLOAD);
+	init_spool(&spool, 64);
+
+	jsub_payload_spool_begin(&spool, payload_len);
+	assert_equals(JAL_OK, jsub_spool_payload(db_ctx, &spool, (uint8_t *) PAYLOAD, 4, 0));
+	assert_equals(JAL_OK, jsub_spool_payload(db_ctx, &spool, (uint8_t *) PAYLOAD + 4,
+			payload_len - 4, 0));
+	assert_equals(payload_len, spool.len);
+	assert_equals(-1, spool.fd);
+	assert_pointer_equals((void *) NULL, spool.path);
+	assert_equals(0, memcmp(PAYLOAD, spool.buf, payload_len));
+
+	jsub_payload_spool_end(db_ctx, &spool);
+	assert_pointer_equals((void *) NULL, spool.buf);
+	assert_equals(0, spool.len);
+}
+
+extern "C" void test_spool_payload_moves_large_payload_to_file()
+{
+	struct jsub_payload_spool spool;
+	size_t payload_len = strlen(PAYLOAD);
+	char *full_path = NULL;
+	char buf[64];
+	struct stat st;
+	init_spool(&spool, 8);
+
+	// The length is not known up front, so the payload starts out in memory.
+	jsub_payload_spool_begin(&spool, 0);
+	assert_equals(JAL_OK, jsub_spool_payload(db_ctx, &spool, (uint8_t *) PAYLOAD, 4, 0));
+	assert_equals(-1, spool.fd);
+	assert_equals(JAL_OK, jsub_spool_payload(db_ctx, &spool, (uint8_t *) PAYLOAD + 4,
+			payload_len - 4, 0));
+	assert_true(0 <= spool.fd);
+	assert_pointer_equals((void *) NULL, spool.buf);
+	assert_equals(payload_len, spool.len);
+
+	assert_true(0 < asprintf(&full_path, "%s/%s", db_ctx->journal_root, spool.path));
+	int fd = open(full_path, O_RDONLY);
+	assert_true(0 <= fd);
+	assert_equals((ssize_t) payload_len, read(fd, buf, sizeof(buf)));
+	assert_equals(0, memcmp(PAYLOAD, buf, payload_len));
+	close(fd);
+
+	// The record was never inserted, so the file goes away.
+	jsub_payload_spool_end(db_ctx, &spool);
+	assert_equals(-1, spool.fd);
+	assert_pointer_equals((void *) NULL, spool.path);
+	assert_true(0 != stat(full_path, &st));
+	free(full_path);
+}
+
+extern "C" void test_spool_payload_writes_known_large_payload_to_file()
+{
+	struct jsub_payload_spool spool;
+	size_t payload_len = strlen(PAYLOAD);
+	init_spool(&spool, 8);
+
+	jsub_payload_spool_begin(&spool, payload_len);
+	assert_equals(JAL_OK, jsub_spool_payload(db_ctx, &spool, (uint8_t *) PAYLOAD, 4, 0));
+	assert_true(0 <= spool.fd);
+	assert_pointer_equals((void *) NULL, spool.buf);
+	jsub_payload_spool_end(db_ctx, &spool);
+}
+
+extern "C" void test_insert_spooled_record_fails_after_spool_failed()
+{
+	struct jsub_payload_spool spool;
+	init_spool(&spool, 8);
+	jsub_payload_spool_begin(&spool, 0);
+	spool.failed = 1;
+
+	assert_equals(JAL_E_FILE_IO, jsub_spool_payload(db_ctx, &spool, (uint8_t *) PAYLOAD, 4, 0));
+	assert_equals(JAL_E_FILE_IO, jsub_insert_spooled_record(db_ctx, NULL,
+			(uint8_t *) PAYLOAD, 4, NULL, 0, &spool, (char *) "1", 0));
+	jsub_payload_spool_end(db_ctx, &spool);
+	assert_equals(0, spool.failed);
+}
@@ -159,6 +159,123 @@ enum jal_status jalp_context_load_pem_cert(jalp_context *ctx,
 enum jal_status jalp_context_set_digest_callbacks(jalp_context *ctx,
 		const struct jal_digest_ctx *digest_ctx);
 
+/**
+ * What to do with a record when the queue of an asynchronous context is full.
+ */
+enum jalp_async_overflow {
+	/** Wait until the background thread makes room in the queue. */
+	JALP_ASYNC_BLOCK,
+	/** Discard the new record and return JAL_E_QUEUE_FULL. */
+	JALP_ASYNC_DROP_NEWEST,
+	/**
+	 * Append the record to a spill file. The background thread sends the
+	 * records in the spill file, in order, once the queue is empty.
+	 */
+	JALP_ASYNC_SPILL,
+};
+
+/**
+ * The number of buckets in the latency histogram of #jalp_async_stats.
+ */
+#define JALP_ASYNC_LATENCY_BUCKETS 24
+
+/**
+ * Statistics of an asynchronous context.
+ */
+struct jalp_async_stats {
+	uint64_t queued;   /**< Records accepted, including those written to the spill file. */
+	uint64_t sent;     /**< Records sent to the JALoP Local Store. */
+	uint64_t failed;   /**< Records discarded because they could not be sent. */
+	uint64_t dropped;  /**< Records discarded because the queue was full. */
+	uint64_t spilled;  /**< Records written to the spill file. */
+	uint64_t batches;  /**< Messages sent that carried more than one record. */
+	/**
+	 * The time between accepting and sending records, as a histogram. The
+	 * first bucket counts records sent within 1 microsecond, and bucket i
+	 * records that took from 2^(i-1) up to 2^i microseconds. The last bucket
+	 * also counts everything that took longer.
+	 */
+	uint64_t latency_usec[JALP_ASYNC_LATENCY_BUCKETS];
+};
+
+/**
+ * Switch a context to asynchronous mode.
+ *
+ * By default, jalp_log(), jalp_audit() and jalp_journal() send each record
+ * to the JALoP Local Store before they return. In asynchronous mode they put
+ * the record in a queue instead, and a background thread sends it. The
+ * functions still report errors in the record itself, but not errors sending
+ * it; those are counted in the #jalp_async_stats of the context.
+ *
+ * Records that pass a file descriptor (jalp_journal_fd() and
+ * jalp_journal_path()) are still sent right away, after the records already
+ * in the queue.
+ *
+ * The context is still not thread safe; it must be guarded if it is shared
+ * between threads. Asynchronous mode can't be turned off again; destroying
+ * the context sends any queued records first.
+ *
+ * @param[in] ctx The context.
+ * @param[in] queue_len The maximum number of records in the queue. This is
+ * rounded up to a power of 2, and at least 2. Pass 0 for the default of 1024.
+ * @param[in] overflow What to do when the queue is full.
+ * @param[in] spill_path The file to use for JALP_ASYNC_SPILL. It is created
+ * or truncated. This must be NULL for the other policies.
+ *
+ * @return JAL_OK on success, JAL_E_INVAL if the arguments are invalid,
+ * JAL_E_INITIALIZED if the context is already asynchronous, or
+ * JAL_E_FILE_OPEN if the spill file can't be opened.
+ */
+enum jal_status jalp_context_enable_async(jalp_context *ctx,
+		size_t queue_len,
+		enum jalp_async_overflow overflow,
+		const char *spill_path);
+
+/**
+ * The largest number of records jalp_context_set_async_batch() accepts.
+ */
+#define JALP_ASYNC_MAX_BATCH 512
+
+/**
+ * Let the background thread of an asynchronous context send up to
+ * \p max_records queued log and audit records as a single batch message,
+ * which the JALoP Local Store inserts in a single transaction. This is off by
+ * default, i.e. \p max_records is 1, since a batch is a message of version 2
+ * of the local store protocol, which older local stores reject.
+ *
+ * A batch only holds records that are already queued, the background thread
+ * never waits for more. Journal records are always sent on their own.
+ *
+ * @param[in] ctx The context.
+ * @param[in] max_records The most records to send in one message, from 1 to
+ * JALP_ASYNC_MAX_BATCH.
+ *
+ * @return JAL_OK on success, or JAL_E_INVAL if \p ctx isn't asynchronous
+ * or \p max_records is out of range.
+ */
+enum jal_status jalp_context_set_async_batch(jalp_context *ctx, size_t max_records);
+
+/**
+ * Wait until all records queued on an asynchronous context were sent, or
+ * failed to send. This returns right away for a synchronous context.
+ *
+ * @param[in] ctx The context.
+ *
+ * @return JAL_OK on success, or JAL_E_INVAL if \p ctx is NULL.
+ */
+enum jal_status jalp_context_flush(jalp_context *ctx);
+
+/**
+ * Get the statistics of an asynchronous context.
+ *
+ * @param[in] ctx The context.
+ * @param[out] stats The statistics.
+ *
+ * @return JAL_OK on success, or JAL_E_INVAL if \p ctx isn't asynchronous.
+ */
+enum jal_status jalp_context_get_async_stats(jalp_context *ctx,
+		struct jalp_async_stats *stats);
+
 
 /** @} */
 
@@ -27,6 +27,7 @@
  * limitations under the License.
  */
 
+#include <stdio.h>
 #include <uuid/uuid.h>
 
 #include <libxml/tree.h>
@@ -34,6 +35,7 @@
 #include <jalop/jalp_app_metadata.h>
 #include <jalop/jal_status.h>
 #include <jalop/jal_namespaces.h>
+#include <jalop/jal_digest.h>
 #include "jalp_app_metadata_xml.h"
 #include "jal_xml_utils.h"
 #include "jal_asprintf_internal.h"
@@ -50,6 +52,11 @@ static const char *UUIDDASH = "UUID-";
 #define EVENTID "EventID"
 #define CUSTOM "Custom"
 #define	JID "JID"
+#define MANIFEST "Manifest"
+
+/* A writer that grew past this while writing a large document gives the
+ * memory back before it is reused. */
+#define JALP_APP_META_WRITER_MAX_KEEP (64 * 1024)
 
 enum jal_status jalp_app_metadata_to_elem(
 		struct jalp_app_metadata *app_meta,
@@ -157,3 +164,94 @@ err_out:
 	xmlFreeNodeList(app_meta_elem);
 	return ret;
 }
+
+int jalp_app_metadata_can_write_xml(const struct jalp_app_metadata *app_meta,
+		const struct jalp_context_t *ctx)
+{
+	if (!app_meta || !ctx) {
+		return 0;
+	}
+	if (ctx->signing_key || app_meta->file_metadata) {
+		return 0;
+	}
+	return app_meta->type != JALP_METADATA_CUSTOM;
+}
+
+enum jal_status jalp_app_metadata_write_xml(
+		const struct jalp_app_metadata *app_meta,
+		const struct jalp_context_t *ctx,
+		const uint8_t *digest,
+		uint64_t digest_len,
+		int audit_transforms,
+		struct jal_xml_writer *writer)
+{
+	if (!app_meta || !ctx || !writer || (digest && !ctx->digest_ctx)) {
+		return JAL_E_XML_CONVERSION;
+	}
+
+	enum jal_status ret;
+	uuid_t jid;
+	char str_jid[JAL_UUID_STR_LEN + 1];
+	char ncname_jid[JAL_UUID_STR_LEN + sizeof("UUID-")];
+
+	if (writer->size > JALP_APP_META_WRITER_MAX_KEEP) {
+		jal_xml_writer_free(writer);
+	} else {
+		jal_xml_writer_reset(writer);
+	}
+
+	uuid_generate(jid);
+	uuid_unparse(jid, str_jid);
+	snprintf(ncname_jid, sizeof(ncname_jid), "%s%s", UUIDDASH, str_jid);
+
+	jal_xml_write_str(writer, JAL_XML_DECLARATION);
+	jal_xml_write_start_tag(writer, 0, APPLICATIONMETADATA, JAL_APP_META_TYPES_NAMESPACE_URI);
+	jal_xml_write_attr(writer, JID, ncname_jid);
+	jal_xml_write_str(writer, ">\n");
+
+	if (app_meta->event_id) {
+		jal_xml_write_text_element(writer, 1, EVENTID, NULL, app_meta->event_id);
+	}
+
+	switch(app_meta->type) {
+		case(JALP_METADATA_SYSLOG):
+			ret = jalp_syslog_metadata_write_xml(app_meta->sys, ctx, writer, 1);
+			if (ret != JAL_OK) {
+				goto err_out;
+			}
+			break;
+		case(JALP_METADATA_LOGGER):
+			ret = jalp_logger_metadata_write_xml(app_meta->log, ctx, writer, 1);
+			if (ret != JAL_OK) {
+				goto err_out;
+			}
+			break;
+		case(JALP_METADATA_NONE):
+			//adds an empty custom element in this case
+			jal_xml_write_text_element(writer, 1, CUSTOM, NULL, NULL);
+			break;
+		default:
+			ret = JAL_E_INVAL_APP_METADATA;
+			goto err_out;
+	}
+
+	if (digest) {
+		jal_xml_write_start_tag(writer, 1, MANIFEST, JAL_XMLDSIG_URI);
+		jal_xml_write_str(writer, ">\n");
+		ret = jal_xml_write_reference(writer, 2, JAL_PAYLOAD_URI,
+				ctx->digest_ctx->algorithm_uri, digest, digest_len,
+				audit_transforms);
+		if (ret != JAL_OK) {
+			goto err_out;
+		}
+		jal_xml_write_end_tag(writer, 1, MANIFEST);
+	}
+
+	jal_xml_write_end_tag(writer, 0, APPLICATIONMETADATA);
+
+	return JAL_OK;
+
+err_out:
+	jal_xml_writer_reset(writer);
+	return ret;
+}
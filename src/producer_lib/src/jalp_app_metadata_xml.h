@@ -38,6 +38,7 @@ extern "C" {
 
 #include <jalop/jalp_app_metadata.h>
 #include <jalop/jal_status.h>
+#include "jal_xml_writer.h"
 #include "jalp_context_internal.h"
 
 /**
@@ -56,6 +57,47 @@ enum jal_status jalp_app_metadata_to_elem(
 		xmlDocPtr doc,
 		xmlNodePtr *elem);
 
+/**
+ * Check whether jalp_app_metadata_write_xml() can produce the application
+ * metadata document for \p app_meta. Custom XML and journal file metadata
+ * are only supported through jalp_app_metadata_to_elem(), and signing the
+ * document requires a DOM as well.
+ *
+ * @param[in] app_meta The application metadata to send.
+ * @param[in] ctx The jalp_context that will send it.
+ * @return non-zero if the document can be written without a DOM, 0 otherwise.
+ */
+int jalp_app_metadata_can_write_xml(const struct jalp_app_metadata *app_meta,
+		const struct jalp_context_t *ctx);
+
+/**
+ * Write the complete application metadata document for \p app_meta into
+ * \p writer, without building a DOM. The output is the same as serializing
+ * the document built with jalp_app_metadata_to_elem() and, if \p digest is
+ * given, a Manifest with a reference to the payload.
+ *
+ * Any previous contents of \p writer are discarded.
+ *
+ * @param[in] app_meta The struct to write. jalp_app_metadata_can_write_xml()
+ * must return non-zero for it.
+ * @param[in] ctx The jalp_context
+ * @param[in] digest The digest of the payload, or NULL to leave out the
+ * Manifest.
+ * @param[in] digest_len The length of \p digest.
+ * @param[in] audit_transforms Non-zero to add the transforms used for audit
+ * records to the payload reference.
+ * @param[in] writer The writer to write the document into.
+ * @return JAL_OK on success, JAL_E_XML_CONVERSION on failure.
+ * will also return JAL_E_INVAL_APP_METADATA if given an invalid jalp_app_metadata as input.
+ */
+enum jal_status jalp_app_metadata_write_xml(
+		const struct jalp_app_metadata *app_meta,
+		const struct jalp_context_t *ctx,
+		const uint8_t *digest,
+		uint64_t digest_len,
+		int audit_transforms,
+		struct jal_xml_writer *writer);
+
 /** @} */
 #ifdef __cplusplus
 }
@@ -0,0 +1,81 @@
+/**
+ * @file jalp_async_internal.h This file declares the functions that send
+ * records from a background thread for an asynchronous jalp_context.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _JALP_ASYNC_INTERNAL_H_
+#define _JALP_ASYNC_INTERNAL_H_
+
+#include <stdint.h>
+#include <jalop/jal_status.h>
+#include <jalop/jalp_context.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct jalp_async;
+
+/**
+ * Queue a message for the background thread of an asynchronous context.
+ * The message is copied, so the buffers may be reused as soon as this
+ * returns. The arguments are the same as for jalp_send_buffer(), which must
+ * already have checked them.
+ *
+ * @param[in] async The asynchronous state of the context.
+ * @param[in] message_type The type of the message, except JALP_JOURNAL_FD_MSG.
+ * @param[in] data The record.
+ * @param[in] data_len The length of the record.
+ * @param[in] meta The application metadata document.
+ * @param[in] meta_len The length of the application metadata document.
+ *
+ * @return JAL_OK if the message was queued or spilled, JAL_E_QUEUE_FULL if
+ * it was dropped, or JAL_E_FILE_IO if it could not be written to the spill
+ * file.
+ */
+enum jal_status jalp_async_enqueue(struct jalp_async *async, uint16_t message_type,
+		void *data, uint64_t data_len, void *meta, uint64_t meta_len);
+
+/**
+ * Wait until the background thread has handled every queued message.
+ *
+ * @param[in] async The asynchronous state of the context.
+ */
+void jalp_async_flush(struct jalp_async *async);
+
+/**
+ * Send the queued messages, stop the background thread, and release the
+ * asynchronous state of a context.
+ *
+ * @param[in,out] async The state to destroy. This will be set to NULL.
+ */
+void jalp_async_destroy(struct jalp_async **async);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _JALP_ASYNC_INTERNAL_H_
@@ -60,6 +60,34 @@ enum jal_status jalp_audit(jalp_context *ctx,
 	}
 	
 	if (app_meta) {
+		if (ctx->digest_ctx) {
+			if (!ctx->audit_valid_ctx) {
+				status = jalp_digest_audit_load_schema(ctx->schema_root,
+						&ctx->audit_schema, &ctx->audit_valid_ctx);
+				if (status != JAL_OK) {
+					goto out;
+				}
+			}
+			status = jalp_digest_audit_record_with_schema(ctx->digest_ctx,
+					ctx->audit_valid_ctx, audit_buffer, audit_buffer_size,
+					&digest, &digest_len);
+			if (status != JAL_OK) {
+				goto out;
+			}
+		}
+
+		if (jalp_app_metadata_can_write_xml(app_meta, ctx)) {
+			status = jalp_app_metadata_write_xml(app_meta, ctx,
+					digest, digest_len, 1, &ctx->app_meta_writer);
+			if (status != JAL_OK) {
+				goto out;
+			}
+			status = jalp_send_buffer(ctx, JALP_AUDIT_MSG,
+				(void *) audit_buffer, audit_buffer_size,
+				(void *) ctx->app_meta_writer.buf, ctx->app_meta_writer.len, -1);
+			goto out;
+		}
+
 		doc = xmlNewDoc((xmlChar *)"1.0");
 
 		status = jalp_app_metadata_to_elem(app_meta, ctx, doc, &app_meta_elem);
@@ -69,11 +97,6 @@ enum jal_status jalp_audit(jalp_context *ctx,
 		xmlDocSetRootElement(doc, app_meta_elem);
 
 		if (ctx->digest_ctx) {
-			status = jalp_digest_audit_record(ctx->digest_ctx, ctx->schema_root,
-					audit_buffer, audit_buffer_size, &digest, &digest_len);
-			if (status != JAL_OK) {
-				goto out;
-			}
 			xmlNodePtr reference_elem = NULL;
 			status = jal_create_reference_elem(JAL_PAYLOAD_URI, ctx->digest_ctx->algorithm_uri,
 					digest, digest_len, doc, &reference_elem);
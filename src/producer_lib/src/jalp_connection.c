@@ -34,6 +34,7 @@
 #include <sys/types.h>
 #include <jalop/jal_status.h>
 #include "jal_alloc.h"
+#include "jalp_async_internal.h"
 #include "jalp_connection_internal.h"
 #include "jalp_context_internal.h"
 
@@ -41,7 +42,11 @@ struct jalp_connection_headers *jalp_connection_headers_create(uint16_t message_
 		uint64_t data_len, uint64_t meta_len)
 {
 	struct jalp_connection_headers *connection_headers = jal_malloc(sizeof(*connection_headers));
-	connection_headers->protocol_version = 1;
+	if (message_type == JALP_BATCH_MSG) {
+		connection_headers->protocol_version = JALP_BATCH_PROTOCOL_VERSION;
+	} else {
+		connection_headers->protocol_version = JALP_PROTOCOL_VERSION;
+	}
 	connection_headers->message_type = message_type;
 	connection_headers->data_len = data_len;
 	connection_headers->meta_len = meta_len;
@@ -88,6 +93,11 @@ enum jal_status jalp_connection_fill_out_msghdr(struct iovec *iov,
 	iov[i].iov_len = sizeof(connection_headers->meta_len);
 	i++;
 
+	// the records of a batch are added by the caller
+	if (connection_headers->message_type == JALP_BATCH_MSG) {
+		return JAL_OK;
+	}
+
 	if (connection_headers->message_type != JALP_JOURNAL_FD_MSG) {
 		// log data
 		iov[i].iov_base = data;
@@ -224,6 +234,17 @@ enum jal_status jalp_send_buffer(jalp_context *ctx, uint16_t message_type,
 		goto out;
 	}
 
+	if (ctx->async) {
+		if (message_type != JALP_JOURNAL_FD_MSG) {
+			status = jalp_async_enqueue(ctx->async, message_type,
+					data, data_len, meta, meta_len);
+			goto out;
+		}
+		// A file descriptor can't be queued, so send it right away,
+		// after the records queued before it.
+		jalp_async_flush(ctx->async);
+	}
+
 	// if we are not connected, try to connect
 	if (ctx->socket == -1) {
 		status = jalp_context_connect(ctx);
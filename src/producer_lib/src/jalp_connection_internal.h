@@ -44,6 +44,21 @@ extern "C" {
  */
 #define JALP_BREAK_STR "BREAK"
 
+/**
+ * The version of the protocol used to send a single record.
+ */
+#define JALP_PROTOCOL_VERSION 1
+
+/**
+ * The version of the protocol used to send a batch of records with a
+ * JALP_BATCH_MSG. The headers of the message hold the number of records as
+ * the data length, and the total length of the records as the metadata
+ * length. Each record follows as a complete version 1 log or audit message.
+ * Local stores that only know version 1 close the connection when they
+ * receive one.
+ */
+#define JALP_BATCH_PROTOCOL_VERSION 2
+
 /**
  * Message types used for the message_type member of the
  * jalp_connection_headers structure.
@@ -53,6 +68,7 @@ enum jalp_connection_msg_type {
 	JALP_AUDIT_MSG = 2,
 	JALP_JOURNAL_MSG = 3,
 	JALP_JOURNAL_FD_MSG = 4,
+	JALP_BATCH_MSG = 5,
 };
 
 /**
@@ -60,8 +76,9 @@ enum jalp_connection_msg_type {
  */
 struct jalp_connection_headers {
 	/**
-	 * The version of the JALoP local store protocol.  This will always be 1 for this
-	 * version of JALoP.
+	 * The version of the JALoP local store protocol.  This is
+	 * JALP_BATCH_PROTOCOL_VERSION for a JALP_BATCH_MSG, and
+	 * JALP_PROTOCOL_VERSION for any other message.
 	 */
 	uint16_t protocol_version;
 	/**
@@ -121,6 +138,10 @@ void jalp_connection_headers_destroy(struct jalp_connection_headers **connection
  *
  * @param[in] meta A buffer for the application metadata record.
  *
+ * For a JALP_BATCH_MSG, only the 4 headers are filled out and \p data and
+ * \p meta are ignored; the records of the batch follow in the io vectors
+ * after them.
+ *
  * @return JAL_OK if everything was filled out correctly.  JAL_E_INVAL if
  * \p msgh or \p iov were passed in as NULL.
  */
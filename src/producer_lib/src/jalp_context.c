@@ -67,6 +67,10 @@ void jalp_context_destroy(jalp_context **ctx)
 		return;
 	}
 
+	// send the queued records before disconnecting
+	if ((*ctx)->async) {
+		(*ctx)->async_destroy(&(*ctx)->async);
+	}
 	jalp_context_disconnect(*ctx);
 
 	jal_digest_ctx_destroy(&(*ctx)->digest_ctx);
@@ -75,6 +79,9 @@ void jalp_context_destroy(jalp_context **ctx)
 	free((*ctx)->app_name);
 	RSA_free((*ctx)->signing_key);
 	X509_free((*ctx)->signing_cert);
+	xmlSchemaFreeValidCtxt((*ctx)->audit_valid_ctx);
+	xmlSchemaFree((*ctx)->audit_schema);
+	jal_xml_writer_free(&(*ctx)->app_meta_writer);
 	free((*ctx)->schema_root);
 	free(*ctx);
 	*ctx = NULL;
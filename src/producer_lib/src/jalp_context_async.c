@@ -0,0 +1,682 @@
+/**
+ * @file jalp_context_async.c This file contains the functions that send
+ * records from a background thread for an asynchronous jalp_context.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <jalop/jal_status.h>
+#include <jalop/jalp_context.h>
+
+#include "jal_alloc.h"
+#include "jalp_async_internal.h"
+#include "jalp_connection_internal.h"
+#include "jalp_context_internal.h"
+
+#define JALP_ASYNC_DEFAULT_QUEUE_LEN 1024
+/* How long the background thread, or a blocked caller, sleeps before it
+ * checks the queue again in case a wake up was missed. */
+#define JALP_ASYNC_WAIT_USEC 100000
+/* A batch is closed once it holds this many bytes of records, so the local
+ * store doesn't have to buffer too much of it. */
+#define JALP_ASYNC_MAX_BATCH_BYTES (1024 * 1024)
+
+/**
+ * A serialized message, exactly as it is sent to the local store.
+ */
+struct jalp_async_msg {
+	uint64_t queued_usec; /**< When the message was queued. */
+	uint64_t len;         /**< The length of \p buf. */
+	uint16_t message_type; /**< The type of the message, from #jalp_connection_msg_type. */
+	uint8_t buf[];        /**< The message. */
+};
+
+/**
+ * A slot of the queue. \p seq tells producers and the background thread
+ * whose turn it is to use the slot, see jalp_async_push().
+ */
+struct jalp_async_slot {
+	volatile size_t seq;
+	struct jalp_async_msg *msg;
+};
+
+struct jalp_async {
+	jalp_context *ctx;                /**< The context the messages are sent with. */
+	struct jalp_async_slot *slots;    /**< The queue, a ring of mask + 1 slots. */
+	size_t mask;
+	volatile size_t enqueue_pos;      /**< The next slot producers will fill. */
+	size_t dequeue_pos;               /**< The next slot the background thread takes, only used by that thread. */
+	enum jalp_async_overflow overflow;
+	volatile size_t batch_max;        /**< The most records to send in one message. */
+	volatile uint64_t pending;        /**< Messages queued or spilled, but not handled yet. */
+
+	pthread_t thread;
+	pthread_mutex_t lock;             /**< Protects the condition variables. */
+	pthread_cond_t work_cond;         /**< Signalled when a message is queued. */
+	pthread_cond_t space_cond;        /**< Signalled when a slot is freed. */
+	pthread_cond_t idle_cond;         /**< Signalled when pending drops to 0. */
+	volatile int flusher_waiting;
+	volatile int space_waiters;
+	volatile int stop;
+
+	pthread_mutex_t spill_lock;       /**< Protects the members below. */
+	int spill_fd;
+	volatile int spill_active;        /**< Whether any message is in the spill file. */
+	off_t spill_read;
+	off_t spill_write;
+	uint64_t spill_cnt;
+
+	struct jalp_async_stats stats;    /**< Updated with atomic operations. */
+};
+
+static uint64_t jalp_async_now_usec(void)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (uint64_t) now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static void jalp_async_timed_wait(pthread_cond_t *cond, pthread_mutex_t *lock)
+{
+	struct timespec deadline;
+	uint64_t usec = jalp_async_now_usec() + JALP_ASYNC_WAIT_USEC;
+	deadline.tv_sec = usec / 1000000;
+	deadline.tv_nsec = (usec % 1000000) * 1000;
+	pthread_cond_timedwait(cond, lock, &deadline);
+}
+
+static void jalp_async_broadcast(struct jalp_async *async, pthread_cond_t *cond)
+{
+	pthread_mutex_lock(&async->lock);
+	pthread_cond_broadcast(cond);
+	pthread_mutex_unlock(&async->lock);
+}
+
+static struct jalp_async_msg *jalp_async_msg_create(uint16_t message_type,
+		void *data, uint64_t data_len, void *meta, uint64_t meta_len)
+{
+	struct jalp_connection_headers headers;
+	struct jalp_async_msg *msg;
+	struct iovec iov[8];
+	int iovlen = 8;
+	uint64_t len = 0;
+	uint8_t *cur;
+	int i;
+
+	headers.protocol_version = JALP_PROTOCOL_VERSION;
+	headers.message_type = message_type;
+	headers.data_len = data_len;
+	headers.meta_len = meta_len;
+	jalp_connection_fill_out_msghdr(iov, &headers, data, meta);
+
+	for (i = 0; i < iovlen; i++) {
+		len += iov[i].iov_len;
+	}
+	msg = jal_malloc(sizeof(*msg) + len);
+	msg->len = len;
+	msg->message_type = message_type;
+	cur = msg->buf;
+	for (i = 0; i < iovlen; i++) {
+		memcpy(cur, iov[i].iov_base, iov[i].iov_len);
+		cur += iov[i].iov_len;
+	}
+	msg->queued_usec = jalp_async_now_usec();
+	return msg;
+}
+
+/*
+ * The queue is a bounded multi-producer ring. The sequence number of a slot
+ * is its position when the slot is free for a producer, and the position + 1
+ * once it holds a message. Producers claim a position with a compare and
+ * swap, so they never block each other.
+ */
+static int jalp_async_push(struct jalp_async *async, struct jalp_async_msg *msg)
+{
+	struct jalp_async_slot *slot;
+	size_t pos = async->enqueue_pos;
+
+	for (;;) {
+		slot = &async->slots[pos & async->mask];
+		intptr_t dif = (intptr_t) slot->seq - (intptr_t) pos;
+		if (dif == 0) {
+			size_t prev = __sync_val_compare_and_swap(&async->enqueue_pos, pos, pos + 1);
+			if (prev == pos) {
+				break;
+			}
+			pos = prev;
+		} else if (dif < 0) {
+			// full
+			return 0;
+		} else {
+			pos = async->enqueue_pos;
+		}
+	}
+
+	slot->msg = msg;
+	__sync_synchronize();
+	slot->seq = pos + 1;
+	return 1;
+}
+
+static int jalp_async_queue_empty(struct jalp_async *async)
+{
+	struct jalp_async_slot *slot = &async->slots[async->dequeue_pos & async->mask];
+	return slot->seq != async->dequeue_pos + 1;
+}
+
+static struct jalp_async_msg *jalp_async_pop(struct jalp_async *async)
+{
+	struct jalp_async_slot *slot = &async->slots[async->dequeue_pos & async->mask];
+	struct jalp_async_msg *msg;
+
+	if (slot->seq != async->dequeue_pos + 1) {
+		return NULL;
+	}
+	__sync_synchronize();
+	msg = slot->msg;
+	slot->msg = NULL;
+	__sync_synchronize();
+	slot->seq = async->dequeue_pos + async->mask + 1;
+	async->dequeue_pos++;
+	return msg;
+}
+
+static void jalp_async_wake_flusher(struct jalp_async *async)
+{
+	__sync_synchronize();
+	if (async->flusher_waiting) {
+		jalp_async_broadcast(async, &async->work_cond);
+	}
+}
+
+/*
+ * Mark \p cnt messages as handled, and wake up jalp_async_flush() if there
+ * are none left.
+ */
+static void jalp_async_done(struct jalp_async *async, uint64_t cnt)
+{
+	if (0 == __sync_sub_and_fetch(&async->pending, cnt)) {
+		jalp_async_broadcast(async, &async->idle_cond);
+	}
+}
+
+static enum jal_status jalp_async_spill(struct jalp_async *async, struct jalp_async_msg *msg)
+{
+	enum jal_status ret = JAL_E_FILE_IO;
+	off_t off;
+
+	pthread_mutex_lock(&async->spill_lock);
+	off = async->spill_write;
+	if ((ssize_t) sizeof(*msg) != pwrite(async->spill_fd, msg, sizeof(*msg), off)) {
+		goto out;
+	}
+	off += sizeof(*msg);
+	if ((ssize_t) msg->len != pwrite(async->spill_fd, msg->buf, msg->len, off)) {
+		goto out;
+	}
+	async->spill_write = off + msg->len;
+	async->spill_cnt++;
+	async->spill_active = 1;
+	ret = JAL_OK;
+out:
+	pthread_mutex_unlock(&async->spill_lock);
+	return ret;
+}
+
+/*
+ * Empty the spill file, so producers use the queue again. The caller must
+ * hold the spill lock.
+ */
+static void jalp_async_reset_spill(struct jalp_async *async)
+{
+	if (0 != ftruncate(async->spill_fd, 0)) {
+		// The file is overwritten from the start anyway.
+	}
+	async->spill_read = 0;
+	async->spill_write = 0;
+	async->spill_cnt = 0;
+	async->spill_active = 0;
+}
+
+/*
+ * Take the next message from the spill file.
+ */
+static struct jalp_async_msg *jalp_async_unspill(struct jalp_async *async)
+{
+	struct jalp_async_msg hdr;
+	struct jalp_async_msg *msg = NULL;
+	uint64_t lost;
+
+	pthread_mutex_lock(&async->spill_lock);
+	if (async->spill_read == async->spill_write) {
+		jalp_async_reset_spill(async);
+		pthread_mutex_unlock(&async->spill_lock);
+		return NULL;
+	}
+	if ((ssize_t) sizeof(hdr) != pread(async->spill_fd, &hdr, sizeof(hdr), async->spill_read)) {
+		goto err_out;
+	}
+	msg = jal_malloc(sizeof(*msg) + hdr.len);
+	*msg = hdr;
+	if ((ssize_t) hdr.len != pread(async->spill_fd, msg->buf, hdr.len,
+				async->spill_read + sizeof(hdr))) {
+		goto err_out;
+	}
+	async->spill_read += sizeof(hdr) + hdr.len;
+	async->spill_cnt--;
+	if (async->spill_read == async->spill_write) {
+		jalp_async_reset_spill(async);
+	}
+	pthread_mutex_unlock(&async->spill_lock);
+	return msg;
+
+err_out:
+	// Whatever is left in the file is lost.
+	free(msg);
+	lost = async->spill_cnt;
+	jalp_async_reset_spill(async);
+	pthread_mutex_unlock(&async->spill_lock);
+	__sync_fetch_and_add(&async->stats.failed, lost);
+	jalp_async_done(async, lost);
+	return NULL;
+}
+
+/*
+ * Send \p cnt messages, connecting to the local store first if needed. More
+ * than one message is sent as a single batch. If sending fails, the messages
+ * are sent again, from the start, on a new connection.
+ */
+static enum jal_status jalp_async_send(struct jalp_async *async,
+		struct jalp_async_msg **msgs, size_t cnt)
+{
+	jalp_context *ctx = async->ctx;
+	struct jalp_connection_headers headers;
+	struct msghdr msgh;
+	struct iovec iov[4 + JALP_ASYNC_MAX_BATCH];
+	size_t iovlen;
+	size_t i;
+	int attempt;
+
+	for (attempt = 0; attempt < 2; attempt++) {
+		if (ctx->socket == -1 && JAL_OK != jalp_context_connect(ctx)) {
+			continue;
+		}
+		// jalp_sendmsg() changes the io vectors as it goes, so set them
+		// up again for every attempt.
+		iovlen = 0;
+		if (cnt > 1) {
+			headers.protocol_version = JALP_BATCH_PROTOCOL_VERSION;
+			headers.message_type = JALP_BATCH_MSG;
+			headers.data_len = cnt;
+			headers.meta_len = 0;
+			for (i = 0; i < cnt; i++) {
+				headers.meta_len += msgs[i]->len;
+			}
+			jalp_connection_fill_out_msghdr(iov, &headers, NULL, NULL);
+			iovlen = 4;
+		}
+		for (i = 0; i < cnt; i++) {
+			iov[iovlen].iov_base = msgs[i]->buf;
+			iov[iovlen].iov_len = msgs[i]->len;
+			iovlen++;
+		}
+		memset(&msgh, 0, sizeof(msgh));
+		msgh.msg_iov = iov;
+		msgh.msg_iovlen = iovlen;
+		if (JAL_OK == jalp_sendmsg(ctx, &msgh)) {
+			return JAL_OK;
+		}
+		jalp_context_disconnect(ctx);
+	}
+	return JAL_E_NOT_CONNECTED;
+}
+
+static void jalp_async_record_latency(struct jalp_async *async, uint64_t usec)
+{
+	int bucket = 0;
+	while (usec && bucket < JALP_ASYNC_LATENCY_BUCKETS - 1) {
+		usec >>= 1;
+		bucket++;
+	}
+	__sync_fetch_and_add(&async->stats.latency_usec[bucket], 1);
+}
+
+/*
+ * Take the next message, from the queue or else from the spill file.
+ */
+static struct jalp_async_msg *jalp_async_next(struct jalp_async *async)
+{
+	struct jalp_async_msg *msg = jalp_async_pop(async);
+	if (msg) {
+		__sync_synchronize();
+		if (async->space_waiters) {
+			jalp_async_broadcast(async, &async->space_cond);
+		}
+	} else if (async->spill_active) {
+		msg = jalp_async_unspill(async);
+	}
+	return msg;
+}
+
+static int jalp_async_batchable(const struct jalp_async_msg *msg)
+{
+	return msg->message_type == JALP_LOG_MSG || msg->message_type == JALP_AUDIT_MSG;
+}
+
+static void *jalp_async_flusher(void *arg)
+{
+	struct jalp_async *async = (struct jalp_async *) arg;
+	struct jalp_async_msg *msgs[JALP_ASYNC_MAX_BATCH];
+	// A message taken for a batch it didn't fit in; it starts the next one.
+	struct jalp_async_msg *held = NULL;
+	uint64_t batch_len;
+	uint64_t now;
+	size_t batch_max;
+	size_t cnt;
+	size_t i;
+
+	for (;;) {
+		if (held) {
+			msgs[0] = held;
+			held = NULL;
+		} else {
+			msgs[0] = jalp_async_next(async);
+		}
+
+		if (msgs[0]) {
+			cnt = 1;
+			batch_len = msgs[0]->len;
+			batch_max = async->batch_max;
+			while (cnt < batch_max && jalp_async_batchable(msgs[0])) {
+				held = jalp_async_next(async);
+				if (!held) {
+					break;
+				}
+				if (!jalp_async_batchable(held) ||
+						batch_len + held->len > JALP_ASYNC_MAX_BATCH_BYTES) {
+					break;
+				}
+				batch_len += held->len;
+				msgs[cnt++] = held;
+				held = NULL;
+			}
+
+			if (JAL_OK == jalp_async_send(async, msgs, cnt)) {
+				now = jalp_async_now_usec();
+				for (i = 0; i < cnt; i++) {
+					jalp_async_record_latency(async, now - msgs[i]->queued_usec);
+				}
+				__sync_fetch_and_add(&async->stats.sent, cnt);
+				if (cnt > 1) {
+					__sync_fetch_and_add(&async->stats.batches, 1);
+				}
+			} else {
+				__sync_fetch_and_add(&async->stats.failed, cnt);
+			}
+			for (i = 0; i < cnt; i++) {
+				free(msgs[i]);
+			}
+			jalp_async_done(async, cnt);
+			continue;
+		}
+
+		if (async->stop) {
+			break;
+		}
+
+		pthread_mutex_lock(&async->lock);
+		async->flusher_waiting = 1;
+		__sync_synchronize();
+		if (jalp_async_queue_empty(async) && !async->spill_active && !async->stop) {
+			jalp_async_timed_wait(&async->work_cond, &async->lock);
+		}
+		async->flusher_waiting = 0;
+		pthread_mutex_unlock(&async->lock);
+	}
+	return NULL;
+}
+
+enum jal_status jalp_async_enqueue(struct jalp_async *async, uint16_t message_type,
+		void *data, uint64_t data_len, void *meta, uint64_t meta_len)
+{
+	struct jalp_async_msg *msg;
+	enum jal_status ret = JAL_OK;
+
+	msg = jalp_async_msg_create(message_type, data, data_len, meta, meta_len);
+
+	// Count the message first, so the background thread never sees it
+	// before it is counted.
+	__sync_fetch_and_add(&async->pending, 1);
+
+	// Once messages are spilled, later ones go to the spill file as well,
+	// so they are sent in order.
+	if (async->overflow == JALP_ASYNC_SPILL && async->spill_active) {
+		goto spill;
+	}
+
+	if (jalp_async_push(async, msg)) {
+		goto queued;
+	}
+
+	switch (async->overflow) {
+	case JALP_ASYNC_DROP_NEWEST:
+		__sync_fetch_and_add(&async->stats.dropped, 1);
+		ret = JAL_E_QUEUE_FULL;
+		goto err_out;
+	case JALP_ASYNC_SPILL:
+		goto spill;
+	case JALP_ASYNC_BLOCK:
+	default:
+		pthread_mutex_lock(&async->lock);
+		async->space_waiters++;
+		__sync_synchronize();
+		while (!jalp_async_push(async, msg)) {
+			jalp_async_timed_wait(&async->space_cond, &async->lock);
+		}
+		async->space_waiters--;
+		pthread_mutex_unlock(&async->lock);
+		goto queued;
+	}
+
+spill:
+	ret = jalp_async_spill(async, msg);
+	free(msg);
+	if (JAL_OK != ret) {
+		jalp_async_done(async, 1);
+		return ret;
+	}
+	__sync_fetch_and_add(&async->stats.spilled, 1);
+	__sync_fetch_and_add(&async->stats.queued, 1);
+	jalp_async_wake_flusher(async);
+	return JAL_OK;
+
+queued:
+	__sync_fetch_and_add(&async->stats.queued, 1);
+	jalp_async_wake_flusher(async);
+	return JAL_OK;
+
+err_out:
+	free(msg);
+	jalp_async_done(async, 1);
+	return ret;
+}
+
+void jalp_async_flush(struct jalp_async *async)
+{
+	pthread_mutex_lock(&async->lock);
+	while (0 != __sync_add_and_fetch(&async->pending, 0)) {
+		jalp_async_timed_wait(&async->idle_cond, &async->lock);
+	}
+	pthread_mutex_unlock(&async->lock);
+}
+
+static void jalp_async_free(struct jalp_async **async)
+{
+	struct jalp_async *a = *async;
+
+	if (a->spill_fd != -1) {
+		close(a->spill_fd);
+	}
+	pthread_cond_destroy(&a->work_cond);
+	pthread_cond_destroy(&a->space_cond);
+	pthread_cond_destroy(&a->idle_cond);
+	pthread_mutex_destroy(&a->lock);
+	pthread_mutex_destroy(&a->spill_lock);
+	free(a->slots);
+	free(a);
+	*async = NULL;
+}
+
+void jalp_async_destroy(struct jalp_async **async)
+{
+	if (!async || !*async) {
+		return;
+	}
+
+	(*async)->stop = 1;
+	jalp_async_broadcast(*async, &(*async)->work_cond);
+	pthread_join((*async)->thread, NULL);
+	jalp_async_free(async);
+}
+
+enum jal_status jalp_context_enable_async(jalp_context *ctx,
+		size_t queue_len,
+		enum jalp_async_overflow overflow,
+		const char *spill_path)
+{
+	struct jalp_async *async = NULL;
+	// the sequence numbers need at least two slots to tell a full slot
+	// from an empty one
+	size_t size = 2;
+	size_t i;
+
+	if (!ctx) {
+		return JAL_E_INVAL;
+	}
+	if (ctx->async) {
+		return JAL_E_INITIALIZED;
+	}
+	if (overflow != JALP_ASYNC_BLOCK && overflow != JALP_ASYNC_DROP_NEWEST &&
+			overflow != JALP_ASYNC_SPILL) {
+		return JAL_E_INVAL;
+	}
+	if ((overflow == JALP_ASYNC_SPILL) != (spill_path != NULL)) {
+		return JAL_E_INVAL;
+	}
+
+	if (0 == queue_len) {
+		queue_len = JALP_ASYNC_DEFAULT_QUEUE_LEN;
+	}
+	while (size < queue_len) {
+		size <<= 1;
+		if (0 == size) {
+			return JAL_E_INVAL;
+		}
+	}
+
+	async = jal_calloc(1, sizeof(*async));
+	async->ctx = ctx;
+	async->overflow = overflow;
+	async->batch_max = 1;
+	async->spill_fd = -1;
+	async->mask = size - 1;
+	async->slots = jal_calloc(size, sizeof(*async->slots));
+	for (i = 0; i < size; i++) {
+		async->slots[i].seq = i;
+	}
+	pthread_mutex_init(&async->lock, NULL);
+	pthread_mutex_init(&async->spill_lock, NULL);
+	pthread_cond_init(&async->work_cond, NULL);
+	pthread_cond_init(&async->space_cond, NULL);
+	pthread_cond_init(&async->idle_cond, NULL);
+
+	if (spill_path) {
+		async->spill_fd = open(spill_path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+		if (async->spill_fd == -1) {
+			jalp_async_free(&async);
+			return JAL_E_FILE_OPEN;
+		}
+	}
+
+	if (0 != pthread_create(&async->thread, NULL, jalp_async_flusher, async)) {
+		jalp_async_free(&async);
+		return JAL_E_NO_MEM;
+	}
+
+	ctx->async = async;
+	ctx->async_destroy = jalp_async_destroy;
+	return JAL_OK;
+}
+
+enum jal_status jalp_context_set_async_batch(jalp_context *ctx, size_t max_records)
+{
+	if (!ctx || !ctx->async || 0 == max_records || JALP_ASYNC_MAX_BATCH < max_records) {
+		return JAL_E_INVAL;
+	}
+	ctx->async->batch_max = max_records;
+	return JAL_OK;
+}
+
+enum jal_status jalp_context_flush(jalp_context *ctx)
+{
+	if (!ctx) {
+		return JAL_E_INVAL;
+	}
+	if (ctx->async) {
+		jalp_async_flush(ctx->async);
+	}
+	return JAL_OK;
+}
+
+enum jal_status jalp_context_get_async_stats(jalp_context *ctx,
+		struct jalp_async_stats *stats)
+{
+	int i;
+
+	if (!ctx || !ctx->async || !stats) {
+		return JAL_E_INVAL;
+	}
+
+	struct jalp_async_stats *cur = &ctx->async->stats;
+	stats->queued = __sync_add_and_fetch(&cur->queued, 0);
+	stats->sent = __sync_add_and_fetch(&cur->sent, 0);
+	stats->failed = __sync_add_and_fetch(&cur->failed, 0);
+	stats->dropped = __sync_add_and_fetch(&cur->dropped, 0);
+	stats->spilled = __sync_add_and_fetch(&cur->spilled, 0);
+	stats->batches = __sync_add_and_fetch(&cur->batches, 0);
+	for (i = 0; i < JALP_ASYNC_LATENCY_BUCKETS; i++) {
+		stats->latency_usec[i] = __sync_add_and_fetch(&cur->latency_usec[i], 0);
+	}
+	return JAL_OK;
+}
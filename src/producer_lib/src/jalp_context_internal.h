@@ -30,13 +30,17 @@
 #define _JALP_CONTEXT_INTERNAL_H_
 
 #include <openssl/pem.h>
+#include <libxml/xmlschemas.h>
 
 #include <jalop/jalp_context.h>
+#include "jal_xml_writer.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct jalp_async;
+
 struct jalp_context_t {
 	int socket; /**< The socket used to communicate with the JALoP Local Store */
 	char *path; /**< The path that was originally used to connect to the socket */
@@ -46,6 +50,11 @@ struct jalp_context_t {
 	struct jal_digest_ctx *digest_ctx; /**< The registered callback functions to use when creating a digest */
 	RSA *signing_key; /**< The RSA private key to use when signing application metadata documents */
 	X509 *signing_cert; /**< The certificate used for signing the application metadata */
+	xmlSchemaPtr audit_schema; /**< The compiled JAF schema, loaded on the first call to jalp_audit() */
+	xmlSchemaValidCtxtPtr audit_valid_ctx; /**< Validation context for audit_schema, reused for every audit record */
+	struct jal_xml_writer app_meta_writer; /**< Buffer the application metadata documents are written into, reused for every record */
+	struct jalp_async *async; /**< State of the background thread sending records, NULL unless jalp_context_enable_async() was called */
+	void (*async_destroy)(struct jalp_async **async); /**< Releases \p async, set along with it so this file doesn't depend on the asynchronous code */
 };
 
 /**
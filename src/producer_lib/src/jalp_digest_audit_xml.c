@@ -39,66 +39,124 @@
 #define XML_JAF_SCHEMA "event.xsd" //TODO: what is the canonical name?
 #define JALP_XML_CORE "Core"
 
-enum jal_status jalp_digest_audit_record(const struct jal_digest_ctx *ctx,
-		const char *schema_root,
-		const uint8_t *buffer,
-		const size_t buf_len,
-		uint8_t**digest_value,
-		int *digest_len)
+enum jal_status jalp_digest_audit_load_schema(const char *schema_root,
+		xmlSchemaPtr *schema,
+		xmlSchemaValidCtxtPtr *valid_ctx)
 {
-	if (!ctx || !schema_root || !buffer || (buf_len == 0) || !digest_value
-			|| *digest_value || !digest_len) {
+	if (!schema_root || !schema || *schema || !valid_ctx || *valid_ctx) {
 		return JAL_E_INVAL;
 	}
 
-	enum jal_status ret = JAL_E_XML_PARSE;
-	xmlDocPtr parsed_doc = NULL;
+	enum jal_status ret = JAL_E_XML_SCHEMA;
 	xmlDocPtr schema_doc = NULL;
 	xmlSchemaParserCtxtPtr parser_ctx = NULL;
-	xmlSchemaPtr schema = NULL;
-	xmlSchemaValidCtxtPtr valid_ctx = NULL;
+	xmlSchemaPtr new_schema = NULL;
+	xmlSchemaValidCtxtPtr new_valid_ctx = NULL;
 	char *jafSchema = NULL;
-	
-	jal_asprintf(&jafSchema, "%s/" XML_JAF_SCHEMA, schema_root);
 
-	parsed_doc = xmlParseMemory((const char *)buffer, buf_len);
+	jal_asprintf(&jafSchema, "%s/" XML_JAF_SCHEMA, schema_root);
 
 	schema_doc = xmlReadFile(jafSchema, NULL, XML_PARSE_NONET);
 	if (!schema_doc) {
-		ret = JAL_E_XML_SCHEMA;
 		goto out;
 	}
 
 	parser_ctx = xmlSchemaNewDocParserCtxt(schema_doc);
 	if (!parser_ctx) {
-		ret = JAL_E_XML_SCHEMA;
 		goto out;
 	}
 
-	schema = xmlSchemaParse(parser_ctx);
-	if (!schema) {
-		ret = JAL_E_XML_SCHEMA;
+	new_schema = xmlSchemaParse(parser_ctx);
+	if (!new_schema) {
 		goto out;
 	}
 
-	valid_ctx = xmlSchemaNewValidCtxt(schema);
-	if (!valid_ctx) {
-		ret = JAL_E_XML_SCHEMA;
+	new_valid_ctx = xmlSchemaNewValidCtxt(new_schema);
+	if (!new_valid_ctx) {
+		goto out;
+	}
+
+	*schema = new_schema;
+	*valid_ctx = new_valid_ctx;
+	new_schema = NULL;
+	new_valid_ctx = NULL;
+	ret = JAL_OK;
+out:
+	xmlSchemaFreeValidCtxt(new_valid_ctx);
+	xmlSchemaFree(new_schema);
+	xmlSchemaFreeParserCtxt(parser_ctx);
+	xmlFreeDoc(schema_doc);
+	free(jafSchema);
+	return ret;
+}
+
+void jalp_digest_audit_free_schema(xmlSchemaPtr *schema,
+		xmlSchemaValidCtxtPtr *valid_ctx)
+{
+	if (valid_ctx) {
+		xmlSchemaFreeValidCtxt(*valid_ctx);
+		*valid_ctx = NULL;
+	}
+	if (schema) {
+		xmlSchemaFree(*schema);
+		*schema = NULL;
+	}
+}
+
+enum jal_status jalp_digest_audit_record_with_schema(const struct jal_digest_ctx *ctx,
+		xmlSchemaValidCtxtPtr valid_ctx,
+		const uint8_t *buffer,
+		const size_t buf_len,
+		uint8_t **digest_value,
+		int *digest_len)
+{
+	if (!ctx || !valid_ctx || !buffer || (buf_len == 0) || !digest_value
+			|| *digest_value || !digest_len) {
+		return JAL_E_INVAL;
+	}
+
+	enum jal_status ret = JAL_E_XML_PARSE;
+	xmlDocPtr parsed_doc = NULL;
+
+	parsed_doc = xmlParseMemory((const char *)buffer, buf_len);
+	if (!parsed_doc) {
 		goto out;
 	}
 
 	if (xmlSchemaValidateDoc(valid_ctx, parsed_doc)) {
 		goto out;
 	}
-	
+
 	ret = jal_digest_xml_data(ctx, parsed_doc, digest_value, digest_len);
 out:
-	xmlSchemaFreeValidCtxt(valid_ctx);
-	xmlSchemaFree(schema);
-	xmlSchemaFreeParserCtxt(parser_ctx);
-	xmlFreeDoc(schema_doc);
 	xmlFreeDoc(parsed_doc);
-	free(jafSchema);
 	return ret;
 }
 
+enum jal_status jalp_digest_audit_record(const struct jal_digest_ctx *ctx,
+		const char *schema_root,
+		const uint8_t *buffer,
+		const size_t buf_len,
+		uint8_t**digest_value,
+		int *digest_len)
+{
+	if (!ctx || !schema_root || !buffer || (buf_len == 0) || !digest_value
+			|| *digest_value || !digest_len) {
+		return JAL_E_INVAL;
+	}
+
+	enum jal_status ret;
+	xmlSchemaPtr schema = NULL;
+	xmlSchemaValidCtxtPtr valid_ctx = NULL;
+
+	ret = jalp_digest_audit_load_schema(schema_root, &schema, &valid_ctx);
+	if (ret != JAL_OK) {
+		goto out;
+	}
+
+	ret = jalp_digest_audit_record_with_schema(ctx, valid_ctx, buffer, buf_len,
+			digest_value, digest_len);
+out:
+	jalp_digest_audit_free_schema(&schema, &valid_ctx);
+	return ret;
+}
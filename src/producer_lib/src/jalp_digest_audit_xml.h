@@ -37,10 +37,68 @@ extern "C" {
 #include <jalop/jal_status.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <libxml/xmlschemas.h>
+
+/**
+ * Load and compile the JALoP Audit Format (JAF) Event List XML schema and
+ * create a validation context for it.
+ *
+ * The compiled schema and validation context may be reused for any number of
+ * calls to jalp_digest_audit_record_with_schema(). The validation context is
+ * not thread safe, it must not be used by more than one thread at a time.
+ *
+ * @param[in] schema_root The directory containing the JALoP schemas.
+ * @param[out] schema On success, the compiled schema. Must point to NULL.
+ * @param[out] valid_ctx On success, a validation context for \p schema. Must
+ * point to NULL.
+ *
+ * @return JAL_OK on success, JAL_E_INVAL if any of the parameters are
+ * invalid, or JAL_E_XML_SCHEMA if the schema could not be loaded.
+ */
+enum jal_status jalp_digest_audit_load_schema(const char *schema_root,
+		xmlSchemaPtr *schema,
+		xmlSchemaValidCtxtPtr *valid_ctx);
+
+/**
+ * Release a schema and validation context obtained from
+ * jalp_digest_audit_load_schema().
+ *
+ * @param[in,out] schema The schema to free, set to NULL on return.
+ * @param[in,out] valid_ctx The validation context to free, set to NULL on
+ * return.
+ */
+void jalp_digest_audit_free_schema(xmlSchemaPtr *schema,
+		xmlSchemaValidCtxtPtr *valid_ctx);
+
+/**
+ * Parse a byte buffer as XML, validate it using an already compiled JAF
+ * schema, and digest it.
+ *
+ * @param[in] ctx The digest context to use.
+ * @param[in] valid_ctx A validation context from jalp_digest_audit_load_schema().
+ * @param[in] buffer The audit record.
+ * @param[in] buf_len The size of \p buffer.
+ * @param[out] digest_value On success, the digest of the record. Must point
+ * to NULL.
+ * @param[out] digest_len On success, the length of \p digest_value.
+ *
+ * @return JAL_OK on success, JAL_E_INVAL if any of the parameters are
+ * invalid, or JAL_E_XML_PARSE if the record is not valid.
+ */
+enum jal_status jalp_digest_audit_record_with_schema(const struct jal_digest_ctx *ctx,
+		xmlSchemaValidCtxtPtr valid_ctx,
+		const uint8_t *buffer,
+		const size_t buf_len,
+		uint8_t **digest_value,
+		int *digest_len);
+
 /**
  * Parse a byte buffer as XML and validate it against the JALoP Audit Format
  * (JAF) Event List XML schema.
  *
+ * This loads and compiles the schema on every call; callers that digest more
+ * than one record should use jalp_digest_audit_load_schema() and
+ * jalp_digest_audit_record_with_schema() instead.
  */
 enum jal_status jalp_digest_audit_record(const struct jal_digest_ctx *ctx,
 		const char *schema_root,
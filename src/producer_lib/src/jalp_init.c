@@ -36,6 +36,8 @@
 #include <jalop/jal_status.h>
 #include <jalop/jalp_context.h>
 
+#include "jal_xml_utils.h"
+
 enum jal_status jalp_init()
 {
 	SSL_library_init();
@@ -49,6 +51,7 @@ enum jal_status jalp_init()
 
 void jalp_shutdown()
 {
+	jal_signing_cache_cleanup();
 	EVP_cleanup();
 	CRYPTO_cleanup_all_ex_data();
 	xmlSecCryptoShutdown();
@@ -27,6 +27,7 @@
  * limitations under the License.
  */
 
+#include <stdio.h>
 #include <libxml/tree.h>
 
 #include <jalop/jal_namespaces.h>
@@ -75,3 +76,24 @@ enum jal_status jalp_log_severity_to_elem(
 	return JAL_OK;
 }
 
+enum jal_status jalp_log_severity_write_xml(
+		const struct jalp_log_severity *severity,
+		struct jal_xml_writer *writer,
+		int depth)
+{
+	if (!severity || !writer) {
+		return JAL_E_XML_CONVERSION;
+	}
+
+	char level_val_str[12];
+	snprintf(level_val_str, sizeof(level_val_str), "%d", severity->level_val);
+
+	jal_xml_write_start_tag(writer, depth, JALP_XML_SEVERITY, JAL_APP_META_TYPES_NAMESPACE_URI);
+	if (severity->level_str) {
+		jal_xml_write_attr(writer, JALP_XML_NAME, severity->level_str);
+	}
+	jal_xml_write_close_text(writer, JALP_XML_SEVERITY, level_val_str);
+
+	return JAL_OK;
+}
+
@@ -33,6 +33,7 @@
 
 #include <jalop/jal_namespaces.h>
 #include <jalop/jalp_logger_metadata.h>
+#include "jal_xml_writer.h"
 
 /**
  * Convert a jalp_log_severity struct to a xmlDocPtr element
@@ -48,5 +49,19 @@ enum jal_status jalp_log_severity_to_elem(
 		xmlDocPtr doc,
 		xmlNodePtr *elem);
 
+/**
+ * Write a jalp_log_severity struct as an XML element, the same way
+ * jalp_log_severity_to_elem() creates it.
+ *
+ * @param[in] severity The jalp_log_severity struct to write.
+ * @param[in] writer The writer to append the element to.
+ * @param[in] depth The nesting level of the element.
+ * @return JAL_OK on success, JAL_E_XML_CONVERSION otherwise
+ */
+enum jal_status jalp_log_severity_write_xml(
+		const struct jalp_log_severity *severity,
+		struct jal_xml_writer *writer,
+		int depth);
+
 #endif //_JALP_LOG_SEVERITY_XML_H_
  
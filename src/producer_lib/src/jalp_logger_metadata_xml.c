@@ -29,6 +29,8 @@
 
 #include <libxml/tree.h>
 
+#include <inttypes.h>
+#include <stdio.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -176,3 +178,95 @@ cleanup:
 	}
 	return ret;
 }
+
+enum jal_status jalp_logger_metadata_write_xml(
+		const struct jalp_logger_metadata *logmeta,
+		const struct jalp_context_t *ctx,
+		struct jal_xml_writer *writer,
+		int depth)
+{
+	if (!logmeta || !ctx || !writer) {
+		return JAL_E_XML_CONVERSION;
+	}
+
+	enum jal_status ret;
+	char proc_id_str[24];
+	const int child_depth = depth + 1;
+
+	jal_xml_write_start_tag(writer, depth, JALP_XML_LOGGER, JAL_APP_META_TYPES_NAMESPACE_URI);
+	jal_xml_write_str(writer, ">\n");
+
+	if (logmeta->logger_name) {
+		jal_xml_write_text_element(writer, child_depth, JALP_XML_LOGGER_NAME,
+				NULL, logmeta->logger_name);
+	}
+	if (logmeta->severity) {
+		ret = jalp_log_severity_write_xml(logmeta->severity, writer, child_depth);
+		if (ret != JAL_OK) {
+			return ret;
+		}
+	}
+	if (logmeta->timestamp) {
+		jal_xml_write_text_element(writer, child_depth, JALP_XML_TIMESTAMP,
+				NULL, logmeta->timestamp);
+	} else {
+		char *ftime = jal_get_timestamp();
+		jal_xml_write_text_element(writer, child_depth, JALP_XML_TIMESTAMP,
+				NULL, ftime);
+		free(ftime);
+	}
+	if (ctx->hostname) {
+		jal_xml_write_text_element(writer, child_depth, JALP_XML_HOSTNAME,
+				NULL, ctx->hostname);
+	}
+	if (ctx->app_name) {
+		jal_xml_write_text_element(writer, child_depth, JALP_XML_APPLICATION_NAME,
+				NULL, ctx->app_name);
+	}
+	snprintf(proc_id_str, sizeof(proc_id_str), "%" PRIdMAX, (intmax_t)getpid());
+	jal_xml_write_text_element(writer, child_depth, JALP_XML_PROCESS_ID,
+			NULL, proc_id_str);
+
+	if (logmeta->threadId) {
+		jal_xml_write_text_element(writer, child_depth, JALP_XML_THREAD_ID,
+				NULL, logmeta->threadId);
+	}
+	if (logmeta->message) {
+		jal_xml_write_text_element(writer, child_depth, JALP_XML_MESSAGE,
+				NULL, logmeta->message);
+	}
+	if (logmeta->stack) {
+		struct jalp_stack_frame *curr = logmeta->stack;
+		jal_xml_write_start_tag(writer, child_depth, JALP_XML_LOCATION, NULL);
+		jal_xml_write_str(writer, ">\n");
+		while (curr) {
+			ret = jalp_stack_frame_write_xml(curr, writer, child_depth + 1);
+			if (ret != JAL_OK) {
+				return ret;
+			}
+			curr = curr->next;
+		}
+		jal_xml_write_end_tag(writer, child_depth, JALP_XML_LOCATION);
+	}
+	if (logmeta->nested_diagnostic_context) {
+		jal_xml_write_text_element(writer, child_depth, JALP_XML_NESTED_DIAGNOSTIC_CTX,
+				NULL, logmeta->nested_diagnostic_context);
+	}
+	if (logmeta->mapped_diagnostic_context) {
+		jal_xml_write_text_element(writer, child_depth, JALP_XML_MAPPED_DIAGNOSTIC_CTX,
+				NULL, logmeta->mapped_diagnostic_context);
+	}
+	if (logmeta->sd) {
+		struct jalp_structured_data *curr = logmeta->sd;
+		while (curr) {
+			ret = jalp_structured_data_write_xml(curr, writer, child_depth);
+			if (ret != JAL_OK) {
+				return ret;
+			}
+			curr = curr->next;
+		}
+	}
+	jal_xml_write_end_tag(writer, depth, JALP_XML_LOGGER);
+
+	return JAL_OK;
+}
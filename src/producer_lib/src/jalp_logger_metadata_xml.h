@@ -56,5 +56,22 @@ enum jal_status jalp_logger_metadata_to_elem(
 		xmlDocPtr doc,
 		xmlNodePtr *new_elem);
 
+/**
+ * Write a jalp_logger_metadata struct as an XML element, the same way
+ * jalp_logger_metadata_to_elem() creates it.
+ *
+ * @param[in] logmeta The jalp_logger_metadata struct to write.
+ * @param[in] ctx The JALP context.
+ * @param[in] writer The writer to append the element to.
+ * @param[in] depth The nesting level of the element.
+ *
+ * @return JAL_OK on success, JAL_E_INVAL_* for any invalid structs,
+ * and JAL_E_XML_CONVERSION otherwise.
+ */
+enum jal_status jalp_logger_metadata_write_xml(
+		const struct jalp_logger_metadata *logmeta,
+		const struct jalp_context_t *ctx,
+		struct jal_xml_writer *writer,
+		int depth);
 
 #endif //_JALP_LOGGER_METADATA_XML_H_
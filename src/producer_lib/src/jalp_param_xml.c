@@ -64,3 +64,24 @@ enum jal_status jalp_param_to_elem(const struct jalp_param *param,
 	return JAL_OK;
 }
 
+enum jal_status jalp_param_write_xml(const struct jalp_param *param,
+				const char *elem_name,
+				const char *attr_name,
+				struct jal_xml_writer *writer,
+				int depth)
+{
+	if (!param || !elem_name || !attr_name || !writer) {
+		return JAL_E_XML_CONVERSION;
+	}
+
+	if (!param->key) {
+		return JAL_E_INVAL_PARAM;
+	}
+
+	jal_xml_write_start_tag(writer, depth, elem_name, JAL_APP_META_TYPES_NAMESPACE_URI);
+	jal_xml_write_attr(writer, attr_name, param->key);
+	jal_xml_write_close_text(writer, elem_name, param->value);
+
+	return JAL_OK;
+}
+
@@ -33,6 +33,7 @@
 
 #include <jalop/jal_status.h>
 #include <jalop/jal_namespaces.h>
+#include "jal_xml_writer.h"
 
 /**
  * Convert a jalp_param struct to a xmlDocPtr element for use with
@@ -53,4 +54,23 @@ enum jal_status jalp_param_to_elem(const struct jalp_param *param,
 				xmlDocPtr doc,
 				xmlNodePtr *elem);
 
+/**
+ * Write a jalp_param struct as an XML element, the same way
+ * jalp_param_to_elem() creates it.
+ *
+ * @param[in] param The jalp_param struct to write.
+ * @param[in] elem_name The name of the element.
+ * @param[in] attr_name The name of the attribute that holds the key.
+ * @param[in] writer The writer to append the element to.
+ * @param[in] depth The nesting level of the element.
+ *
+ * @return JAL_OK on success, JAL_E_INVAL_PARAM if the param's key is not defined, and
+ * JAL_E_XML_CONVERSION otherwise.
+ */
+enum jal_status jalp_param_write_xml(const struct jalp_param *param,
+				const char *elem_name,
+				const char *attr_name,
+				struct jal_xml_writer *writer,
+				int depth);
+
 #endif //_JALP_PARAM_XML_H_
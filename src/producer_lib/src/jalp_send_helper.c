@@ -62,6 +62,28 @@ enum jal_status jalp_send_buffer_xml(jalp_context *ctx,
 	}
 
 	if (app_meta) {
+		if (ctx->digest_ctx) {
+			status = jal_digest_buffer(ctx->digest_ctx,
+					buffer, bsize,
+					&digest);
+			if (status != JAL_OK) {
+				goto out;
+			}
+		}
+
+		if (jalp_app_metadata_can_write_xml(app_meta, ctx)) {
+			status = jalp_app_metadata_write_xml(app_meta, ctx,
+					digest, digest ? ctx->digest_ctx->len : 0, 0,
+					&ctx->app_meta_writer);
+			if (status != JAL_OK) {
+				goto out;
+			}
+			status = jalp_send_buffer(ctx, message_type,
+				(void*) buffer, buffer_size,
+				(void*) ctx->app_meta_writer.buf, ctx->app_meta_writer.len, -1);
+			goto out;
+		}
+
 		doc = xmlNewDoc((xmlChar *)"1.0");
 		status = jalp_app_metadata_to_elem(app_meta, ctx, doc, &app_meta_elem);
 		if (status != JAL_OK) {
@@ -70,12 +92,6 @@ enum jal_status jalp_send_buffer_xml(jalp_context *ctx,
 		xmlDocSetRootElement(doc, app_meta_elem);
 
 		if (ctx->digest_ctx) {
-			status = jal_digest_buffer(ctx->digest_ctx,
-					buffer, bsize,
-					&digest);
-			if (status != JAL_OK) {
-				goto out;
-			}
 			xmlNodePtr reference_elem = NULL;
 			status = jal_create_reference_elem(JAL_PAYLOAD_URI, ctx->digest_ctx->algorithm_uri,
 					digest, ctx->digest_ctx->len, doc, &reference_elem);
@@ -28,6 +28,7 @@
  */
 
 #include <inttypes.h>
+#include <stdio.h>
 #include <libxml/tree.h>
 
 #include <jalop/jalp_logger_metadata.h>
@@ -99,3 +100,51 @@ enum jal_status jalp_stack_frame_to_elem(
 	return JAL_OK;
 }
 
+enum jal_status jalp_stack_frame_write_xml(
+		const struct jalp_stack_frame *stack_frame,
+		struct jal_xml_writer *writer,
+		int depth)
+{
+	if (!stack_frame || !writer) {
+		return JAL_E_XML_CONVERSION;
+	}
+	char num_str[24];
+
+	jal_xml_write_start_tag(writer, depth, JALP_XML_STACK_FRAME, JAL_APP_META_TYPES_NAMESPACE_URI);
+	if (stack_frame->depth >= 0) {
+		snprintf(num_str, sizeof(num_str), "%d", stack_frame->depth);
+		jal_xml_write_attr(writer, JALP_XML_DEPTH, num_str);
+	}
+	if (!stack_frame->caller_name && !stack_frame->file_name &&
+			stack_frame->line_number == 0 &&
+			!stack_frame->class_name && !stack_frame->method_name) {
+		jal_xml_write_str(writer, "/>\n");
+		return JAL_OK;
+	}
+	jal_xml_write_str(writer, ">\n");
+
+	if (stack_frame->caller_name) {
+		jal_xml_write_text_element(writer, depth + 1, JALP_XML_CALLER_NAME,
+				NULL, stack_frame->caller_name);
+	}
+	if (stack_frame->file_name) {
+		jal_xml_write_text_element(writer, depth + 1, JALP_XML_FILE_NAME,
+				NULL, stack_frame->file_name);
+	}
+	if (stack_frame->line_number != 0) {
+		snprintf(num_str, sizeof(num_str), "%" PRIu64, stack_frame->line_number);
+		jal_xml_write_text_element(writer, depth + 1, JALP_XML_LINE_NUMBER,
+				NULL, num_str);
+	}
+	if (stack_frame->class_name) {
+		jal_xml_write_text_element(writer, depth + 1, JALP_XML_CLASS_NAME,
+				NULL, stack_frame->class_name);
+	}
+	if (stack_frame->method_name) {
+		jal_xml_write_text_element(writer, depth + 1, JALP_XML_METHOD_NAME,
+				NULL, stack_frame->method_name);
+	}
+	jal_xml_write_end_tag(writer, depth, JALP_XML_STACK_FRAME);
+	return JAL_OK;
+}
+
@@ -33,6 +33,7 @@
 
 #include <jalop/jalp_logger_metadata.h>
 #include <jalop/jal_status.h>
+#include "jal_xml_writer.h"
 
 /**
  * Convert a single jalp_stack_frame struct to a DOMDocument element.
@@ -58,5 +59,22 @@ enum jal_status jalp_stack_frame_to_elem(
 		xmlDocPtr doc,
 		xmlNodePtr *new_elem);
 
+/**
+ * Write a single jalp_stack_frame struct as an XML element, the same way
+ * jalp_stack_frame_to_elem() creates it. As with jalp_stack_frame_to_elem(),
+ * only the first frame in the list is written.
+ *
+ * @param[in] stack_frame The jalp_stack_frame struct to write.
+ * @param[in] writer The writer to append the element to.
+ * @param[in] depth The nesting level of the element.
+ * @return
+ *  - JAL_OK on success
+ *  - JAL_E_XML_CONVERSION if an error occurs
+ */
+enum jal_status jalp_stack_frame_write_xml(
+		const struct jalp_stack_frame *stack_frame,
+		struct jal_xml_writer *writer,
+		int depth);
+
 #endif //_JALP_STACK_FRAME_XML_H_
 
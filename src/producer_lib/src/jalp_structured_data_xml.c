@@ -80,3 +80,32 @@ enum jal_status jalp_structured_data_to_elem(const struct jalp_structured_data *
 	*new_elem = sd_element;
 	return JAL_OK;
 }
+
+enum jal_status jalp_structured_data_write_xml(const struct jalp_structured_data *sd,
+						struct jal_xml_writer *writer,
+						int depth)
+{
+	if (!sd || !writer) {
+		return JAL_E_XML_CONVERSION;
+	}
+	if (!sd->sd_id || !sd->param_list) {
+		return JAL_E_INVAL_STRUCTURED_DATA;
+	}
+	enum jal_status ret;
+	struct jalp_param *curr = sd->param_list;
+
+	jal_xml_write_start_tag(writer, depth, JALP_XML_STRUCTURED_DATA,
+			JAL_APP_META_TYPES_NAMESPACE_URI);
+	jal_xml_write_attr(writer, JALP_XML_SD_ID, sd->sd_id);
+	jal_xml_write_str(writer, ">\n");
+	while (curr) {
+		ret = jalp_param_write_xml(curr, JALP_XML_FIELD, JALP_XML_KEY,
+				writer, depth + 1);
+		if (JAL_OK != ret) {
+			return ret;
+		}
+		curr = curr->next;
+	}
+	jal_xml_write_end_tag(writer, depth, JALP_XML_STRUCTURED_DATA);
+	return JAL_OK;
+}
@@ -33,6 +33,7 @@
 
 #include <jalop/jal_namespaces.h>
 #include <jalop/jalp_structured_data.h>
+#include "jal_xml_writer.h"
 
 /**
  * Convert a jalp_structured_data struct to a xmlDocPtr element
@@ -50,4 +51,19 @@ enum jal_status jalp_structured_data_to_elem(const struct jalp_structured_data *
 						xmlDocPtr doc,
 						xmlNodePtr *new_elem);
 
+/**
+ * Write a jalp_structured_data struct as an XML element, the same way
+ * jalp_structured_data_to_elem() creates it.
+ *
+ * @param[in] sd The jalp_structured_data struct to write.
+ * @param[in] writer The writer to append the element to.
+ * @param[in] depth The nesting level of the element.
+ *
+ * @return JAL_OK on success, JAL_E_INVAL_* for any invalid structures
+ * received, and JAL_E_XML_CONVERSION otherwise.
+ */
+enum jal_status jalp_structured_data_write_xml(const struct jalp_structured_data *sd,
+						struct jal_xml_writer *writer,
+						int depth);
+
 #endif //_JALP_STRUCTURED_DATA_XML_H_
@@ -29,6 +29,7 @@
 
 #include <libxml/tree.h>
 
+#include <stdio.h>
 #include <sys/types.h>
 #include <inttypes.h> /* PRIdMax*/
 #include <unistd.h>
@@ -148,3 +149,71 @@ cleanup:
 	return ret;
 }
 
+enum jal_status jalp_syslog_metadata_write_xml(
+		const struct jalp_syslog_metadata *syslog,
+		const struct jalp_context_t *ctx,
+		struct jal_xml_writer *writer,
+		int depth)
+{
+	if (!syslog || !ctx || !writer) {
+		return JAL_E_XML_CONVERSION;
+	}
+	if (syslog->facility < -1 || syslog->facility > 23 ||
+			syslog->severity < -1 || syslog->severity > 7) {
+		return JAL_E_INVAL_SYSLOG_METADATA;
+	}
+	enum jal_status ret;
+	char num_str[24];
+
+	jal_xml_write_start_tag(writer, depth, JALP_XML_SYSLOG, JAL_APP_META_TYPES_NAMESPACE_URI);
+	snprintf(num_str, sizeof(num_str), "%" PRIdMAX, (intmax_t)getpid());
+	jal_xml_write_attr(writer, JALP_XML_PROCESS_ID, num_str);
+	if (ctx->hostname) {
+		jal_xml_write_attr(writer, JALP_XML_HOSTNAME, ctx->hostname);
+	}
+	if (ctx->app_name) {
+		jal_xml_write_attr(writer, JALP_XML_APPLICATION_NAME, ctx->app_name);
+	}
+	if (syslog->facility >= 0) {
+		snprintf(num_str, sizeof(num_str), "%d", syslog->facility);
+		jal_xml_write_attr(writer, JALP_XML_FACILITY, num_str);
+	}
+	if (syslog->severity >= 0) {
+		snprintf(num_str, sizeof(num_str), "%d", syslog->severity);
+		jal_xml_write_attr(writer, JALP_XML_SEVERITY, num_str);
+	}
+	if (syslog->timestamp) {
+		jal_xml_write_attr(writer, JALP_XML_TIMESTAMP, syslog->timestamp);
+	} else {
+		char *ftime = jal_get_timestamp();
+		jal_xml_write_attr(writer, JALP_XML_TIMESTAMP, ftime);
+		free(ftime);
+	}
+	if (syslog->message_id) {
+		jal_xml_write_attr(writer, JALP_XML_MESSAGE_ID, syslog->message_id);
+	}
+	if (!syslog->entry && !syslog->sd_head) {
+		jal_xml_write_str(writer, "/>\n");
+		return JAL_OK;
+	}
+	jal_xml_write_str(writer, ">\n");
+
+	if (syslog->entry) {
+		jal_xml_write_text_element(writer, depth + 1, JALP_XML_ENTRY,
+				JAL_APP_META_TYPES_NAMESPACE_URI, syslog->entry);
+	}
+	if (syslog->sd_head) {
+		struct jalp_structured_data *curr = syslog->sd_head;
+		while (curr) {
+			ret = jalp_structured_data_write_xml(curr, writer, depth + 1);
+			if (ret != JAL_OK) {
+				return ret;
+			}
+			curr = curr->next;
+		}
+	}
+	jal_xml_write_end_tag(writer, depth, JALP_XML_SYSLOG);
+
+	return JAL_OK;
+}
+
@@ -55,5 +55,24 @@ enum jal_status jalp_syslog_metadata_to_elem(
 		xmlDocPtr doc,
 		xmlNodePtr *new_elem);
 
+/**
+ * Write a jalp_syslog_metadata struct as an XML element, the same way
+ * jalp_syslog_metadata_to_elem() creates it.
+ *
+ * @param[in] syslog The jalp_syslog_metadata struct to write.
+ * @param[in] ctx The JALP context.
+ * @param[in] writer The writer to append the element to.
+ * @param[in] depth The nesting level of the element.
+ *
+ * @return JAL_OK on success, JAL_E_INVAL_SYSLOG_METADATA if the facility or
+ * severity is out of range, JAL_E_INVAL_* for invalid structured data, and
+ * JAL_E_XML_CONVERSION otherwise.
+ */
+enum jal_status jalp_syslog_metadata_write_xml(
+		const struct jalp_syslog_metadata *syslog,
+		const struct jalp_context_t *ctx,
+		struct jal_xml_writer *writer,
+		int depth);
+
 #endif //_JALP_LOG_SEVERITY_XML_H_
 
@@ -35,6 +35,8 @@
 #include <ctype.h>
 #include <uuid/uuid.h>
 #include <jalop/jalp_context.h>
+#include <jalop/jal_digest.h>
+#include <jalop/jal_namespaces.h>
 #include "jalp_app_metadata_xml.h"
 #include "jal_alloc.h"
 #include "jal_asprintf_internal.h"
@@ -54,6 +56,8 @@
 #define FOO_TAG "tag"
 #define JID_ATTR_NAME "JID"
 #define JID_PREFIX "UUID-"
+#define SPECIAL_CHARS "a <b> & \"c\" \xc3\xa9"
+#define MANIFEST_TAG "Manifest"
 
 static xmlDocPtr doc = NULL;
 
@@ -343,3 +347,177 @@ void test_app_metadata_to_elem_fails_with_invalid_journal_meta()
 	assert_not_equals(JAL_OK, ret);
 	assert_equals((void*)NULL, new_elem);
 }
+
+/* Serialize \p elem as the root of the test document, with the JID replaced
+ * by the one in \p written, so the result can be compared to what
+ * jalp_app_metadata_write_xml() wrote. */
+static char *dom_output_with_jid(xmlNodePtr elem, const char *written)
+{
+	xmlChar *out = NULL;
+	size_t out_len = 0;
+	const char *written_jid = strstr(written, JID_ATTR_NAME "=\"" JID_PREFIX);
+	assert_not_equals((void*) NULL, written_jid);
+
+	xmlDocSetRootElement(doc, elem);
+	assert_equals(JAL_OK, jal_xml_output(doc, &out, &out_len));
+	char *jid = strstr((char *)out, JID_ATTR_NAME "=\"" JID_PREFIX);
+	assert_not_equals((void*) NULL, jid);
+	memcpy(jid, written_jid, strlen(JID_ATTR_NAME "=\"" JID_PREFIX) + 36);
+	return (char *)out;
+}
+
+void test_app_metadata_can_write_xml()
+{
+	assert_true(jalp_app_metadata_can_write_xml(app_meta, ctx));
+	app_meta->type = JALP_METADATA_SYSLOG;
+	assert_true(jalp_app_metadata_can_write_xml(app_meta, ctx));
+	app_meta->type = JALP_METADATA_LOGGER;
+	assert_true(jalp_app_metadata_can_write_xml(app_meta, ctx));
+	app_meta->type = JALP_METADATA_CUSTOM;
+	assert_false(jalp_app_metadata_can_write_xml(app_meta, ctx));
+	app_meta->type = JALP_METADATA_NONE;
+
+	app_meta->file_metadata = journal_meta;
+	assert_false(jalp_app_metadata_can_write_xml(app_meta, ctx));
+	app_meta->file_metadata = NULL;
+
+	assert_false(jalp_app_metadata_can_write_xml(NULL, ctx));
+	assert_false(jalp_app_metadata_can_write_xml(app_meta, NULL));
+}
+
+void test_app_metadata_write_xml_fails_with_invalid_input()
+{
+	uint8_t digest[4] = { 1, 2, 3, 4 };
+
+	assert_equals(JAL_E_XML_CONVERSION, jalp_app_metadata_write_xml(NULL, ctx,
+			NULL, 0, 0, &ctx->app_meta_writer));
+	assert_equals(JAL_E_XML_CONVERSION, jalp_app_metadata_write_xml(app_meta, NULL,
+			NULL, 0, 0, &ctx->app_meta_writer));
+	assert_equals(JAL_E_XML_CONVERSION, jalp_app_metadata_write_xml(app_meta, ctx,
+			NULL, 0, 0, NULL));
+	// a digest without a digest context
+	assert_equals(JAL_E_XML_CONVERSION, jalp_app_metadata_write_xml(app_meta, ctx,
+			digest, sizeof(digest), 0, &ctx->app_meta_writer));
+}
+
+void test_app_metadata_write_xml_fails_with_bad_syslog()
+{
+	app_meta->type = JALP_METADATA_SYSLOG;
+	syslog_meta->facility = INT8_MAX;
+	app_meta->sys = syslog_meta;
+	assert_equals(JAL_E_INVAL_SYSLOG_METADATA, jalp_app_metadata_write_xml(app_meta, ctx,
+			NULL, 0, 0, &ctx->app_meta_writer));
+	assert_equals(0, ctx->app_meta_writer.len);
+	app_meta->sys = NULL;
+}
+
+void test_app_metadata_write_xml_matches_to_elem_for_syslog()
+{
+	xmlNodePtr new_elem = NULL;
+	app_meta->type = JALP_METADATA_SYSLOG;
+	app_meta->sys = syslog_meta;
+	syslog_meta->timestamp = jal_strdup("2014-01-01T00:00:00");
+	syslog_meta->message_id = jal_strdup(SPECIAL_CHARS);
+	syslog_meta->entry = jal_strdup(SPECIAL_CHARS);
+	syslog_meta->facility = 1;
+	syslog_meta->severity = 2;
+	syslog_meta->sd_head = jalp_structured_data_append(NULL, "sd_id");
+	syslog_meta->sd_head->param_list = jalp_param_append(NULL, "key", SPECIAL_CHARS);
+
+	assert_equals(JAL_OK, jalp_app_metadata_write_xml(app_meta, ctx,
+			NULL, 0, 0, &ctx->app_meta_writer));
+	assert_equals(JAL_OK, jalp_app_metadata_to_elem(app_meta, ctx, doc, &new_elem));
+	char *expected = dom_output_with_jid(new_elem, ctx->app_meta_writer.buf);
+
+	assert_string_equals(expected, ctx->app_meta_writer.buf);
+	assert_equals(strlen(expected), ctx->app_meta_writer.len);
+	assert_equals(0, validate(doc, __FUNCTION__, TEST_XML_APP_META_TYPES_SCHEMA, 0));
+
+	free(expected);
+	app_meta->sys = NULL;
+}
+
+void test_app_metadata_write_xml_matches_to_elem_for_logger()
+{
+	xmlNodePtr new_elem = NULL;
+	app_meta->type = JALP_METADATA_LOGGER;
+	app_meta->log = logger_meta;
+	logger_meta->logger_name = jal_strdup("logger");
+	logger_meta->timestamp = jal_strdup("2014-01-01T00:00:00");
+	logger_meta->message = jal_strdup("message <with> markup");
+	logger_meta->severity = jalp_log_severity_create();
+	logger_meta->severity->level_val = 3;
+	logger_meta->severity->level_str = jal_strdup(SPECIAL_CHARS);
+	logger_meta->stack = jalp_stack_frame_append(NULL);
+	logger_meta->stack->caller_name = jal_strdup("caller");
+	logger_meta->stack->line_number = 42;
+	logger_meta->stack->depth = 0;
+	jalp_stack_frame_append(logger_meta->stack);
+	logger_meta->sd = jalp_structured_data_append(NULL, "sd_id");
+	logger_meta->sd->param_list = jalp_param_append(NULL, "key", "value");
+
+	assert_equals(JAL_OK, jalp_app_metadata_write_xml(app_meta, ctx,
+			NULL, 0, 0, &ctx->app_meta_writer));
+	assert_equals(JAL_OK, jalp_app_metadata_to_elem(app_meta, ctx, doc, &new_elem));
+	char *expected = dom_output_with_jid(new_elem, ctx->app_meta_writer.buf);
+
+	assert_string_equals(expected, ctx->app_meta_writer.buf);
+	assert_equals(0, validate(doc, __FUNCTION__, TEST_XML_APP_META_TYPES_SCHEMA, 0));
+
+	free(expected);
+	app_meta->log = NULL;
+}
+
+void test_app_metadata_write_xml_escapes_special_characters()
+{
+	free(app_meta->event_id);
+	app_meta->event_id = jal_strdup(SPECIAL_CHARS);
+
+	assert_equals(JAL_OK, jalp_app_metadata_write_xml(app_meta, ctx,
+			NULL, 0, 0, &ctx->app_meta_writer));
+
+	xmlDocPtr written = xmlReadMemory(ctx->app_meta_writer.buf, ctx->app_meta_writer.len,
+			NULL, NULL, XML_PARSE_NONET);
+	assert_not_equals((void*) NULL, written);
+	xmlNodePtr event_id = jal_get_first_element_child(xmlDocGetRootElement(written));
+	assert_tag_equals(EVENT_ID_TAG, event_id);
+	assert_content_equals(SPECIAL_CHARS, event_id);
+	assert_equals(0, validate(written, __FUNCTION__, TEST_XML_APP_META_TYPES_SCHEMA, 0));
+	xmlFreeDoc(written);
+}
+
+void test_app_metadata_write_xml_adds_manifest()
+{
+	uint8_t digest[32];
+	memset(digest, 0xab, sizeof(digest));
+	ctx->digest_ctx = jal_sha256_ctx_create();
+
+	assert_equals(JAL_OK, jalp_app_metadata_write_xml(app_meta, ctx,
+			digest, sizeof(digest), 1, &ctx->app_meta_writer));
+
+	xmlDocPtr written = xmlReadMemory(ctx->app_meta_writer.buf, ctx->app_meta_writer.len,
+			NULL, NULL, XML_PARSE_NONET | XML_PARSE_NOBLANKS);
+	assert_not_equals((void*) NULL, written);
+	xmlNodePtr manifest = xmlLastElementChild(xmlDocGetRootElement(written));
+	assert_tag_equals(MANIFEST_TAG, manifest);
+	assert_string_equals(JAL_XMLDSIG_URI, (char *)manifest->ns->href);
+	xmlNodePtr reference = jal_get_first_element_child(manifest);
+	xmlChar *uri = xmlGetProp(reference, (xmlChar *)"URI");
+	assert_string_equals(JAL_PAYLOAD_URI, (char *)uri);
+	xmlFree(uri);
+	assert_tag_equals("Transforms", jal_get_first_element_child(reference));
+	xmlFreeDoc(written);
+}
+
+void test_app_metadata_write_xml_reuses_buffer()
+{
+	assert_equals(JAL_OK, jalp_app_metadata_write_xml(app_meta, ctx,
+			NULL, 0, 0, &ctx->app_meta_writer));
+	char *buf = ctx->app_meta_writer.buf;
+	size_t len = ctx->app_meta_writer.len;
+
+	assert_equals(JAL_OK, jalp_app_metadata_write_xml(app_meta, ctx,
+			NULL, 0, 0, &ctx->app_meta_writer));
+	assert_pointer_equals(buf, ctx->app_meta_writer.buf);
+	assert_equals(len, ctx->app_meta_writer.len);
+}
@@ -29,6 +29,7 @@
 #include <test-dept.h>
 
 #include <stdint.h>
+#include <string.h>
 #include <uuid/uuid.h>
 #include <ctype.h>
 
@@ -44,6 +45,7 @@
 #include <jalop/jalp_app_metadata.h>
 #include "jal_alloc.h"
 #include "jalp_connection_internal.h"
+#include "jalp_context_internal.h"
 
 jalp_context *ctx;
 static struct jalp_app_metadata *app_meta;
@@ -191,3 +193,35 @@ void test_audit_works_with_good_input()
 	assert_false(meta_len_wrong);
 	assert_false(fd_is_set);
 }
+
+void test_audit_caches_compiled_schema()
+{
+	assert_equals((void*) NULL, ctx->audit_valid_ctx);
+	enum jal_status ret = jalp_audit(ctx, app_meta, buffer, buff_len);
+	assert_equals(JAL_OK, ret);
+	assert_not_equals((void*) NULL, ctx->audit_schema);
+	assert_not_equals((void*) NULL, ctx->audit_valid_ctx);
+
+	xmlSchemaValidCtxtPtr valid_ctx = ctx->audit_valid_ctx;
+	ret = jalp_audit(ctx, app_meta, (uint8_t*)BAD_BUFFER, strlen(BAD_BUFFER));
+	assert_equals(JAL_E_XML_PARSE, ret);
+	ret = jalp_audit(ctx, app_meta, buffer, buff_len);
+	assert_equals(JAL_OK, ret);
+	assert_equals(valid_ctx, ctx->audit_valid_ctx);
+}
+
+void test_audit_writes_app_metadata_without_dom_when_not_signing()
+{
+	RSA_free(ctx->signing_key);
+	ctx->signing_key = NULL;
+	expected_data_len = buff_len;
+	expected_meta_len = 1;
+
+	enum jal_status ret = jalp_audit(ctx, app_meta, buffer, buff_len);
+	assert_equals(JAL_OK, ret);
+	assert_false(meta_is_null);
+	assert_false(meta_len_wrong);
+	assert_not_equals(0, ctx->app_meta_writer.len);
+	assert_not_equals((void*) NULL, strstr(ctx->app_meta_writer.buf, "<Transforms"));
+	assert_not_equals((void*) NULL, strstr(ctx->app_meta_writer.buf, EVENT_ID));
+}
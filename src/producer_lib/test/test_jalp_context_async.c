@@ -0,0 +1,385 @@
+/**
+ * @file test_jalp_context_async.c This file contains tests for the functions that send
+ * records from a background thread for an asynchronous jalp_context.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <test-dept.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <jalop/jal_status.h>
+#include <jalop/jalp_context.h>
+
+#include "jal_alloc.h"
+#include "jalp_async_internal.h"
+#include "jalp_connection_internal.h"
+#include "jalp_context_internal.h"
+
+#define META "some_metadata"
+#define SPILL_PATH "./test_jalp_context_async.spill"
+#define BIG_DATA_LEN (4 * 1024 * 1024)
+
+static jalp_context *ctx;
+static int peer;
+static pthread_t reader;
+static int reader_started;
+
+/* Everything the local store end of the socket received. */
+static uint8_t *received;
+static size_t received_len;
+
+/* Everything that was sent, as the local store should receive it. */
+static uint8_t *expected;
+static size_t expected_len;
+
+static void *read_all(__attribute__((unused)) void *arg)
+{
+	uint8_t buf[4096];
+	ssize_t cnt;
+
+	while ((cnt = read(peer, buf, sizeof(buf))) > 0) {
+		received = jal_realloc(received, received_len + cnt);
+		memcpy(received + received_len, buf, cnt);
+		received_len += cnt;
+	}
+	return NULL;
+}
+
+static void start_reader()
+{
+	assert_equals(0, pthread_create(&reader, NULL, read_all, NULL));
+	reader_started = 1;
+}
+
+static void expect(const void *buf, size_t len)
+{
+	expected = jal_realloc(expected, expected_len + len);
+	memcpy(expected + expected_len, buf, len);
+	expected_len += len;
+}
+
+/* Send a record, and note how the local store should receive it. */
+static enum jal_status send_record(uint16_t type, const char *data, size_t data_len)
+{
+	uint16_t version = 1;
+	uint64_t dlen = data_len;
+	uint64_t mlen = strlen(META);
+
+	enum jal_status ret = jalp_send_buffer(ctx, type, (void *) data, data_len,
+			META, strlen(META), -1);
+	if (JAL_OK == ret) {
+		expect(&version, sizeof(version));
+		expect(&type, sizeof(type));
+		expect(&dlen, sizeof(dlen));
+		expect(&mlen, sizeof(mlen));
+		expect(data, data_len);
+		expect(JALP_BREAK_STR, strlen(JALP_BREAK_STR));
+		expect(META, strlen(META));
+		expect(JALP_BREAK_STR, strlen(JALP_BREAK_STR));
+	}
+	return ret;
+}
+
+static enum jal_status send_log(const char *data, size_t data_len)
+{
+	return send_record(JALP_LOG_MSG, data, data_len);
+}
+
+/*
+ * Note that the records expected from \p off on should arrive as a single
+ * batch message.
+ */
+static void expect_batch(size_t off, uint64_t cnt)
+{
+	uint16_t version = 2;
+	uint16_t type = JALP_BATCH_MSG;
+	uint64_t len = expected_len - off;
+	size_t hdr_len = 2 * sizeof(uint16_t) + 2 * sizeof(uint64_t);
+
+	expected = jal_realloc(expected, expected_len + hdr_len);
+	memmove(expected + off + hdr_len, expected + off, len);
+	memcpy(expected + off, &version, sizeof(version));
+	memcpy(expected + off + 2, &type, sizeof(type));
+	memcpy(expected + off + 4, &cnt, sizeof(cnt));
+	memcpy(expected + off + 12, &len, sizeof(len));
+	expected_len += hdr_len;
+}
+
+/* Send a record the background thread blocks on until the reader starts. */
+static void send_big_log()
+{
+	char *big = jal_malloc(BIG_DATA_LEN);
+	memset(big, 'x', BIG_DATA_LEN);
+	assert_equals(JAL_OK, send_log(big, BIG_DATA_LEN));
+	free(big);
+}
+
+static void finish()
+{
+	if (!reader_started) {
+		start_reader();
+	}
+	jalp_context_destroy(&ctx);
+	pthread_join(reader, NULL);
+	reader_started = 0;
+}
+
+void setup()
+{
+	int sv[2];
+	assert_equals(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+	ctx = jalp_context_create();
+	jalp_context_init(ctx, "/nonexistent/jalop.sock", "host", "app", NULL);
+	ctx->socket = sv[0];
+	peer = sv[1];
+	received = NULL;
+	received_len = 0;
+	expected = NULL;
+	expected_len = 0;
+	reader_started = 0;
+}
+
+void teardown()
+{
+	if (ctx) {
+		finish();
+	}
+	close(peer);
+	free(received);
+	free(expected);
+	unlink(SPILL_PATH);
+}
+
+void test_enable_async_fails_with_bad_input()
+{
+	assert_equals(JAL_E_INVAL, jalp_context_enable_async(NULL, 0, JALP_ASYNC_BLOCK, NULL));
+	assert_equals(JAL_E_INVAL, jalp_context_enable_async(ctx, 0, JALP_ASYNC_SPILL, NULL));
+	assert_equals(JAL_E_INVAL, jalp_context_enable_async(ctx, 0, JALP_ASYNC_BLOCK, SPILL_PATH));
+	assert_equals(JAL_E_INVAL, jalp_context_enable_async(ctx, 0, (enum jalp_async_overflow) 42, NULL));
+	assert_pointer_equals((void *) NULL, ctx->async);
+	assert_equals(JAL_E_FILE_OPEN, jalp_context_enable_async(ctx, 0, JALP_ASYNC_SPILL,
+				"/nonexistent/spill"));
+	assert_pointer_equals((void *) NULL, ctx->async);
+}
+
+void test_enable_async_fails_when_already_async()
+{
+	assert_equals(JAL_OK, jalp_context_enable_async(ctx, 0, JALP_ASYNC_BLOCK, NULL));
+	assert_equals(JAL_E_INITIALIZED, jalp_context_enable_async(ctx, 0, JALP_ASYNC_BLOCK, NULL));
+}
+
+void test_flush_and_stats_with_sync_context()
+{
+	struct jalp_async_stats stats;
+	assert_equals(JAL_E_INVAL, jalp_context_flush(NULL));
+	assert_equals(JAL_OK, jalp_context_flush(ctx));
+	assert_equals(JAL_E_INVAL, jalp_context_get_async_stats(ctx, &stats));
+}
+
+void test_async_sends_records_in_order()
+{
+	struct jalp_async_stats stats;
+	char data[32];
+	uint64_t latency_cnt = 0;
+	int i;
+
+	assert_equals(JAL_OK, jalp_context_enable_async(ctx, 4, JALP_ASYNC_BLOCK, NULL));
+	start_reader();
+	for (i = 0; i < 100; i++) {
+		snprintf(data, sizeof(data), "record %d", i);
+		assert_equals(JAL_OK, send_log(data, strlen(data)));
+	}
+	assert_equals(JAL_OK, jalp_context_flush(ctx));
+
+	assert_equals(JAL_OK, jalp_context_get_async_stats(ctx, &stats));
+	assert_equals(100, stats.queued);
+	assert_equals(100, stats.sent);
+	assert_equals(0, stats.failed);
+	assert_equals(0, stats.dropped);
+	assert_equals(0, stats.spilled);
+	for (i = 0; i < JALP_ASYNC_LATENCY_BUCKETS; i++) {
+		latency_cnt += stats.latency_usec[i];
+	}
+	assert_equals(100, latency_cnt);
+
+	finish();
+	assert_equals(expected_len, received_len);
+	assert_equals(0, memcmp(expected, received, expected_len));
+}
+
+void test_async_drops_newest_when_full()
+{
+	struct jalp_async_stats stats;
+	int dropped = 0;
+	int i;
+
+	assert_equals(JAL_OK, jalp_context_enable_async(ctx, 2, JALP_ASYNC_DROP_NEWEST, NULL));
+	// nothing reads the socket yet, so the background thread is stuck
+	// sending this
+	send_big_log();
+	for (i = 0; i < 10; i++) {
+		enum jal_status ret = send_log("small", strlen("small"));
+		if (JAL_E_QUEUE_FULL == ret) {
+			dropped++;
+		} else {
+			assert_equals(JAL_OK, ret);
+		}
+	}
+	assert_true(dropped >= 7);
+
+	start_reader();
+	assert_equals(JAL_OK, jalp_context_flush(ctx));
+	assert_equals(JAL_OK, jalp_context_get_async_stats(ctx, &stats));
+	assert_equals(dropped, stats.dropped);
+	assert_equals(11 - dropped, stats.sent);
+
+	finish();
+	assert_equals(expected_len, received_len);
+	assert_equals(0, memcmp(expected, received, expected_len));
+}
+
+void test_async_spills_to_file_when_full()
+{
+	struct jalp_async_stats stats;
+	char data[32];
+	int i;
+
+	assert_equals(JAL_OK, jalp_context_enable_async(ctx, 2, JALP_ASYNC_SPILL, SPILL_PATH));
+	send_big_log();
+	for (i = 0; i < 50; i++) {
+		snprintf(data, sizeof(data), "record %d", i);
+		assert_equals(JAL_OK, send_log(data, strlen(data)));
+	}
+
+	assert_equals(JAL_OK, jalp_context_get_async_stats(ctx, &stats));
+	assert_true(stats.spilled >= 47);
+
+	start_reader();
+	assert_equals(JAL_OK, jalp_context_flush(ctx));
+	assert_equals(JAL_OK, jalp_context_get_async_stats(ctx, &stats));
+	assert_equals(51, stats.sent);
+
+	// the spill file is emptied once everything in it was sent
+	FILE *f = fopen(SPILL_PATH, "r");
+	assert_not_equals((void *) NULL, f);
+	fseek(f, 0, SEEK_END);
+	assert_equals(0, ftell(f));
+	fclose(f);
+
+	finish();
+	assert_equals(expected_len, received_len);
+	assert_equals(0, memcmp(expected, received, expected_len));
+}
+
+void test_async_blocks_when_full()
+{
+	struct jalp_async_stats stats;
+	int i;
+
+	assert_equals(JAL_OK, jalp_context_enable_async(ctx, 1, JALP_ASYNC_BLOCK, NULL));
+	start_reader();
+	send_big_log();
+	for (i = 0; i < 20; i++) {
+		assert_equals(JAL_OK, send_log("small", strlen("small")));
+	}
+	assert_equals(JAL_OK, jalp_context_flush(ctx));
+	assert_equals(JAL_OK, jalp_context_get_async_stats(ctx, &stats));
+	assert_equals(21, stats.sent);
+	assert_equals(0, stats.dropped);
+
+	finish();
+	assert_equals(expected_len, received_len);
+	assert_equals(0, memcmp(expected, received, expected_len));
+}
+
+void test_async_counts_failed_records()
+{
+	struct jalp_async_stats stats;
+
+	assert_equals(JAL_OK, jalp_context_enable_async(ctx, 0, JALP_ASYNC_BLOCK, NULL));
+	// the local store went away, and there is none at the path to
+	// reconnect to
+	close(peer);
+	peer = -1;
+	assert_equals(JAL_OK, send_log("small", strlen("small")));
+	assert_equals(JAL_OK, jalp_context_flush(ctx));
+	assert_equals(JAL_OK, jalp_context_get_async_stats(ctx, &stats));
+	assert_equals(0, stats.sent);
+	assert_equals(1, stats.failed);
+}
+
+void test_set_async_batch_fails_with_bad_input()
+{
+	assert_equals(JAL_E_INVAL, jalp_context_set_async_batch(NULL, 8));
+	assert_equals(JAL_E_INVAL, jalp_context_set_async_batch(ctx, 8));
+	assert_equals(JAL_OK, jalp_context_enable_async(ctx, 0, JALP_ASYNC_BLOCK, NULL));
+	assert_equals(JAL_E_INVAL, jalp_context_set_async_batch(ctx, 0));
+	assert_equals(JAL_E_INVAL, jalp_context_set_async_batch(ctx, JALP_ASYNC_MAX_BATCH + 1));
+	assert_equals(JAL_OK, jalp_context_set_async_batch(ctx, JALP_ASYNC_MAX_BATCH));
+}
+
+void test_async_sends_queued_records_as_batches()
+{
+	struct jalp_async_stats stats;
+	size_t off;
+
+	assert_equals(JAL_OK, jalp_context_enable_async(ctx, 16, JALP_ASYNC_BLOCK, NULL));
+	assert_equals(JAL_OK, jalp_context_set_async_batch(ctx, 8));
+	// too large for a batch, and the background thread is stuck sending
+	// it while the rest is queued
+	send_big_log();
+
+	off = expected_len;
+	assert_equals(JAL_OK, send_log("log 1", strlen("log 1")));
+	assert_equals(JAL_OK, send_record(JALP_AUDIT_MSG, "audit 2", strlen("audit 2")));
+	assert_equals(JAL_OK, send_log("log 3", strlen("log 3")));
+	expect_batch(off, 3);
+
+	// journal records are never batched, so they end a batch
+	assert_equals(JAL_OK, send_record(JALP_JOURNAL_MSG, "journal", strlen("journal")));
+
+	off = expected_len;
+	assert_equals(JAL_OK, send_log("log 4", strlen("log 4")));
+	assert_equals(JAL_OK, send_log("log 5", strlen("log 5")));
+	expect_batch(off, 2);
+
+	start_reader();
+	assert_equals(JAL_OK, jalp_context_flush(ctx));
+	assert_equals(JAL_OK, jalp_context_get_async_stats(ctx, &stats));
+	assert_equals(7, stats.sent);
+	assert_equals(2, stats.batches);
+
+	finish();
+	assert_equals(expected_len, received_len);
+	assert_equals(0, memcmp(expected, received, expected_len));
+}
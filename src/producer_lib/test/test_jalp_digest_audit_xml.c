@@ -32,6 +32,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <test-dept.h>
 #include <jalop/jalp_context.h>
 #include <jalop/jal_digest.h>
@@ -238,3 +239,86 @@ void test_jalp_digest_audit_record_returns_inval_with_dgst_ptr_not_null()
 	assert_equals(JAL_E_INVAL, ret);
 	assert_equals(0, dgst_len);
 }
+
+void test_jalp_digest_audit_load_schema_works()
+{
+	xmlSchemaPtr schema = NULL;
+	xmlSchemaValidCtxtPtr valid_ctx = NULL;
+	enum jal_status ret = jalp_digest_audit_load_schema(SCHEMAS_ROOT, &schema, &valid_ctx);
+	assert_equals(JAL_OK, ret);
+	assert_not_equals((void*) NULL, schema);
+	assert_not_equals((void*) NULL, valid_ctx);
+	jalp_digest_audit_free_schema(&schema, &valid_ctx);
+	assert_equals((void*) NULL, schema);
+	assert_equals((void*) NULL, valid_ctx);
+}
+
+void test_jalp_digest_audit_load_schema_returns_schema_err_with_invalid_schema_root()
+{
+	xmlSchemaPtr schema = NULL;
+	xmlSchemaValidCtxtPtr valid_ctx = NULL;
+	enum jal_status ret = jalp_digest_audit_load_schema("/", &schema, &valid_ctx);
+	assert_equals(JAL_E_XML_SCHEMA, ret);
+	assert_equals((void*) NULL, schema);
+	assert_equals((void*) NULL, valid_ctx);
+}
+
+void test_jalp_digest_audit_load_schema_returns_inval_with_bad_input()
+{
+	xmlSchemaPtr schema = NULL;
+	xmlSchemaValidCtxtPtr valid_ctx = NULL;
+	assert_equals(JAL_E_INVAL, jalp_digest_audit_load_schema(NULL, &schema, &valid_ctx));
+	assert_equals(JAL_E_INVAL, jalp_digest_audit_load_schema(SCHEMAS_ROOT, NULL, &valid_ctx));
+	assert_equals(JAL_E_INVAL, jalp_digest_audit_load_schema(SCHEMAS_ROOT, &schema, NULL));
+	assert_equals((void*) NULL, schema);
+	assert_equals((void*) NULL, valid_ctx);
+}
+
+void test_jalp_digest_audit_record_with_schema_reuses_valid_ctx()
+{
+	xmlSchemaPtr schema = NULL;
+	xmlSchemaValidCtxtPtr valid_ctx = NULL;
+	uint8_t *dgst1 = NULL;
+	uint8_t *dgst2 = NULL;
+	int dgst1_len = 0;
+	int dgst2_len = 0;
+	enum jal_status ret = jalp_digest_audit_load_schema(SCHEMAS_ROOT, &schema, &valid_ctx);
+	assert_equals(JAL_OK, ret);
+
+	ret = jalp_digest_audit_record_with_schema(ctx, valid_ctx, buffer, buff_len,
+			&dgst1, &dgst1_len);
+	assert_equals(JAL_OK, ret);
+
+	uint8_t *good_buffer = buffer;
+	long good_len = buff_len;
+	buffer = NULL;
+	setup_bad();
+	uint8_t *bad_dgst = NULL;
+	int bad_dgst_len = 0;
+	ret = jalp_digest_audit_record_with_schema(ctx, valid_ctx, buffer, buff_len,
+			&bad_dgst, &bad_dgst_len);
+	assert_equals(JAL_E_XML_PARSE, ret);
+	assert_equals((void*) NULL, bad_dgst);
+
+	ret = jalp_digest_audit_record_with_schema(ctx, valid_ctx, good_buffer, good_len,
+			&dgst2, &dgst2_len);
+	assert_equals(JAL_OK, ret);
+	assert_equals(dgst1_len, dgst2_len);
+	assert_equals(0, memcmp(dgst1, dgst2, dgst1_len));
+
+	free(good_buffer);
+	free(dgst1);
+	free(dgst2);
+	jalp_digest_audit_free_schema(&schema, &valid_ctx);
+}
+
+void test_jalp_digest_audit_record_with_schema_returns_inval_with_null_valid_ctx()
+{
+	uint8_t *dgst = NULL;
+	int dgst_len = 0;
+	enum jal_status ret = jalp_digest_audit_record_with_schema(ctx, NULL, buffer,
+			buff_len, &dgst, &dgst_len);
+	assert_equals(JAL_E_INVAL, ret);
+	assert_equals((void*) NULL, dgst);
+	assert_equals(0, dgst_len);
+}
@@ -33,6 +33,7 @@
 
 #include <test-dept.h>
 #include <stdint.h>
+#include <string.h>
 #include <uuid/uuid.h>
 #include <ctype.h>
 
@@ -48,6 +49,7 @@
 #include <jalop/jalp_app_metadata.h>
 #include "jal_alloc.h"
 #include "jalp_connection_internal.h"
+#include "jalp_context_internal.h"
 
 #include "xml_test_utils2.h"
 
@@ -207,3 +209,19 @@ void test_journal_works_with_good_input()
 	assert_false(meta_len_wrong);
 	assert_false(fd_is_set);
 }
+
+void test_journal_writes_app_metadata_without_dom_when_not_signing()
+{
+	RSA_free(ctx->signing_key);
+	ctx->signing_key = NULL;
+	expected_data_len = strlen(BUFFER);
+	expected_meta_len = 1;
+
+	enum jal_status ret = jalp_journal(ctx, app_meta, (uint8_t *)BUFFER, strlen(BUFFER));
+	assert_equals(JAL_OK, ret);
+	assert_false(meta_is_null);
+	assert_false(meta_len_wrong);
+	assert_not_equals(0, ctx->app_meta_writer.len);
+	assert_not_equals((void*) NULL, strstr(ctx->app_meta_writer.buf, "<Manifest"));
+	assert_pointer_equals((void*) NULL, strstr(ctx->app_meta_writer.buf, "<Transforms"));
+}
@@ -35,6 +35,7 @@
 #include <string.h>
 #include <unistd.h>
 #include "jal_base64_internal.h"
+#include "jalu_bench.h"
 
 #define DEBUG_LOG(args...) \
 	do { \
@@ -51,9 +52,12 @@
 
 struct thread_data {
 	jaln_session *sess;
-	char *nonce;
 };
 
+// When non-zero, send this many records as fast as possible, report the
+// throughput and exit, instead of sending one record a second forever.
+static long num_records = 0;
+
 uint8_t *m_sys_meta_buf = NULL;
 uint8_t *m_app_meta_buf = NULL;
 uint8_t *m_audit_buf = NULL;
@@ -138,43 +142,50 @@ void *send_journal(__attribute__((unused)) void *args) {
 }
 
 __attribute__((noreturn))
-void *send_audit(void *args) {
-	struct thread_data *data = (struct thread_data *) args;
-	jaln_session *sess = data->sess;
-	char *nonce = data->nonce;
-	enum jal_status ret = JAL_E_INVAL;
-
-	while (1) {
-		ret = __send_record(sess, nonce, m_audit_buf, m_audit_buf_len, &jaln_send_audit);
+void send_records(jaln_session *sess, uint8_t *buf, uint64_t buf_len,
+		enum jal_status (*send)(jaln_session *, char *, uint8_t *,
+					uint64_t, uint8_t *, uint64_t,
+					uint8_t *, uint64_t))
+{
+	static enum jal_status ret = JAL_E_INVAL;
+	char nonce[32];
+	struct timespec start;
+	long sent = 0;
+
+	jalu_bench_start(&start);
+	while (0 == num_records || sent < num_records) {
+		snprintf(nonce, sizeof(nonce), "%ld", sent + 1);
+		ret = __send_record(sess, nonce, buf, buf_len, send);
 		if (JAL_OK != ret) {
-			DEBUG_LOG("Failed to send audit record");
+			DEBUG_LOG("Failed to send record");
 			goto out;
 		}
-		sleep(1);
+		sent++;
+		if (0 == num_records) {
+			sleep(1);
+		}
 	}
 
+	// Wait for the subscriber to take the last records. Exiting closes
+	// the connection, which ends the session on the subscriber as well.
+	ret = jaln_finish(sess);
+	jalu_bench_report("dummy_net_server", sent, "records", jalu_bench_elapsed(&start), NULL);
+	exit((JAL_OK == ret) ? 0 : 1);
+
 out:
 	pthread_exit(&ret);
 }
 
 __attribute__((noreturn))
-void *send_log(void *args) {
+void *send_audit(void *args) {
 	struct thread_data *data = (struct thread_data *) args;
-	jaln_session *sess = data->sess;
-	char *nonce = data->nonce;
-	enum jal_status ret = JAL_E_INVAL;
-
-	while (1) {
-		ret = __send_record(sess, nonce, m_journal_buf, m_journal_buf_len, &jaln_send_audit);
-		if (JAL_OK != ret) {
-			DEBUG_LOG("Failed to send audit record");
-			goto out;
-		}
-		sleep(1);
-	}
+	send_records(data->sess, m_audit_buf, m_audit_buf_len, &jaln_send_audit);
+}
 
-out:
-	pthread_exit(&ret);
+__attribute__((noreturn))
+void *send_log(void *args) {
+	struct thread_data *data = (struct thread_data *) args;
+	send_records(data->sess, m_journal_buf, m_journal_buf_len, &jaln_send_log);
 }
 
 enum jal_status pub_on_subscribe(
@@ -480,8 +491,40 @@ void sub_release_journal_feeder(
        DEBUG_LOG("ch_info: %p, nonce:%s, feeder:%p\n", ch_info, nonce, feeder);
 }
 
-int main()
+static void usage(void)
+{
+	printf("Usage: dummy_net_server [-H host] [-P port] [-n records]\n" \
+		"	-H	The address to listen on (default 0.0.0.0).\n" \
+		"	-P	The port to listen on (default 55555).\n" \
+		"	-n	Send this many records of the type subscribed to as fast as possible,\n" \
+		"		report the throughput and exit.\n");
+}
+
+int main(int argc, char **argv)
 {
+	const char *host = "0.0.0.0";
+	const char *port = "55555";
+	int opt;
+
+	while ((opt = getopt(argc, argv, "H:P:n:h")) != -1) {
+		switch (opt) {
+		case 'H':
+			host = optarg;
+			break;
+		case 'P':
+			port = optarg;
+			break;
+		case 'n':
+			if (jalu_bench_parse_count("number of records", optarg, &num_records)) {
+				return -1;
+			}
+			break;
+		default:
+			usage();
+			return (opt == 'h') ? 0 : -1;
+		}
+	}
+
 	load_test_data();
 
 	jaln_context *net_ctx = jaln_context_create();
@@ -528,7 +571,7 @@ int main()
 	DEBUG_LOG("register conn cbs: %d\n", err);
 	err = jaln_register_publisher_callbacks(net_ctx, pub_cbs);
 	DEBUG_LOG("register pub cbs: %d\n", err);
-	err = jaln_listen(net_ctx, "0.0.0.0", "55555", NULL);
+	err = jaln_listen(net_ctx, host, port, NULL);
 	err = jaln_listener_wait(net_ctx);
 	jaln_context_destroy(&net_ctx);
 	return 0;
@@ -0,0 +1,89 @@
+#!/bin/sh
+#
+# Measure how many records per second jal_subscribe takes in from several
+# publishers at once. For each number of publishers N, this starts N
+# dummy_net_server instances listening on 127.0.0.1 to 127.0.0.N, each
+# sending the same number of log records, and runs jal_subscribe against all
+# of them with --report. Every address in 127.0.0.0/8 is on the loopback
+# interface on Linux, so the publishers can all use the same port.
+#
+# Run from the top of the source tree, after building with scons.
+
+usage()
+{
+	echo "Usage: $0 [-b build_dir] [-n records] [-p \"publisher counts\"] [-g group_commit_records]"
+	echo "	-b	The build directory (default debug)."
+	echo "	-n	The number of records each publisher sends (default 10000)."
+	echo "	-p	The numbers of publishers to measure (default \"1 2 4 8 16 32\")."
+	echo "	-g	Set db_group_commit_records for jal_subscribe (default 0, off)."
+}
+
+BUILD=debug
+RECORDS=10000
+COUNTS="1 2 4 8 16 32"
+GROUP_COMMIT=0
+PORT=55555
+
+while getopts "b:n:p:g:h" opt; do
+	case $opt in
+	b) BUILD=$OPTARG ;;
+	n) RECORDS=$OPTARG ;;
+	p) COUNTS=$OPTARG ;;
+	g) GROUP_COMMIT=$OPTARG ;;
+	h) usage; exit 0 ;;
+	*) usage; exit 1 ;;
+	esac
+done
+
+SERVER=$BUILD/src/utils/dummy_net_server/dummy_net_server
+SUBSCRIBE=$BUILD/bin/jal_subscribe
+for prog in "$SERVER" "$SUBSCRIBE"; do
+	if [ ! -x "$prog" ]; then
+		echo "Error: $prog not found, build the tree first." >&2
+		exit 1
+	fi
+done
+if [ ! -d test-input ] || [ ! -d schemas ]; then
+	echo "Error: run from the top of the source tree." >&2
+	exit 1
+fi
+
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+for n in $COUNTS; do
+	rm -rf "$WORK/db"
+	mkdir "$WORK/db"
+
+	hosts=""
+	pids=""
+	i=1
+	while [ "$i" -le "$n" ]; do
+		"$SERVER" -H "127.0.0.$i" -P "$PORT" -n "$RECORDS" \
+			> "$WORK/server.$i.out" 2> /dev/null &
+		pids="$pids $!"
+		hosts="$hosts${hosts:+, }\"127.0.0.$i\""
+		i=$((i + 1))
+	done
+
+	cat > "$WORK/jal_subscribe.cfg" <<EOF
+db_root = "$WORK/db";
+schemas_root = "./schemas";
+port = ${PORT}L;
+host = [ $hosts ];
+data_class = [ "log" ];
+mode = "archive";
+pending_digest_max = 100L;
+pending_digest_timeout = 1L;
+db_group_commit_records = ${GROUP_COMMIT}L;
+session_timeout = "00:00:00";
+EOF
+
+	# Give the publishers time to start listening.
+	sleep 1
+	echo "$n publishers, $RECORDS records each:"
+	"$SUBSCRIBE" -s -r -c "$WORK/jal_subscribe.cfg" | grep " records in "
+
+	kill $pids 2> /dev/null
+	wait
+done
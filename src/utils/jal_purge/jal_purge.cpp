@@ -71,7 +71,7 @@ static void process_options(int argc, char **argv);
 static void global_args_free();
 static void usage();
 
-extern "C" enum jaldb_iter_status iter_cb(const char *nonce, struct jaldb_record *rec, void *up);
+extern "C" enum jaldb_iter_status iter_cb(const char *nonce, struct jaldb_record_view *rec, void *up);
 
 int main(int argc, char **argv)
 {
@@ -233,7 +233,7 @@ out:
 	return dbret;
 }
 
-extern "C" enum jaldb_iter_status iter_cb(const char *nonce, struct jaldb_record *rec, void *)
+extern "C" enum jaldb_iter_status iter_cb(const char *nonce, struct jaldb_record_view *rec, void *)
 {
 
 	/* Inbound: records should be confirmed. Outbound: records should be synced. */
@@ -254,6 +254,12 @@ extern "C" enum jaldb_iter_status iter_cb(const char *nonce, struct jaldb_record
 	}
 	// If the detail flag is set, output the new detailed format, otherwise use the old format to prevent test harness from breaking
 	if (global_args.detail) {
+		// Only the detailed output needs the timestamp, which the headers
+		// do not carry.
+		if (JALDB_OK != jaldb_record_view_decode(rec)) {
+			fprintf(stderr, "ERROR: Cannot read record: %s\n", nonce);
+			return JALDB_ITER_ABORT;
+		}
 		// Print status of all records whether to be deleted or not
 		if (global_args.del) {
 			printf("%s %s %s %26s %s\n", action_str[record_action], recv_str[int(rec->confirmed)], send_str[int(rec->synced)], rec->timestamp, nonce); 
@@ -0,0 +1,260 @@
+/**
+ * @file jal_sign_bench.c Benchmark for signing records the way the
+ * JALoP local store and producer library do.
+ *
+ * Builds a small system metadata document for each record and signs it with
+ * jal_add_signature_block() from a number of threads at once. Reports the
+ * signed records per second of each thread and of all threads together.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libxml/tree.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <xmlsec/xmlsec.h>
+#include <xmlsec/crypto.h>
+
+#include <jalop/jal_namespaces.h>
+#include <jalop/jal_status.h>
+
+#include "jal_xml_utils.h"
+#include "jalu_bench.h"
+
+#define DEFAULT_RSA_KEY TEST_INPUT_ROOT "rsa_key"
+#define DEFAULT_CERT TEST_INPUT_ROOT "cert"
+#define RECORD_ID "record-id"
+
+struct bench_thread {
+	pthread_t thread;
+	RSA *keys[2];
+	X509 *cert;
+	long records;
+	int alternate;
+	int ret;
+	double secs;
+};
+
+static void print_usage(void)
+{
+	jalu_bench_usage("jal_sign_bench [-k key_file] [-c cert_file | -x] [-n records]\n" \
+	"	[-t threads] [-a]",
+	"	-k, --key=K	The RSA private key to sign with.\n" \
+	"	-c, --cert=C	The certificate to add to the signature.\n" \
+	"	-x, --no-cert	Sign without a certificate.\n" \
+	"	-n, --records=N	Number of records each thread signs; defaults to 1000.\n" \
+	"	-t, --threads=T	Number of threads signing at once; defaults to 1.\n" \
+	"	-a, --alternate	Alternate between two copies of the key, so every\n" \
+	"			record sets up the signing context again.\n");
+}
+
+static xmlDocPtr create_record_doc(void)
+{
+	xmlDocPtr doc = xmlNewDoc((xmlChar *)"1.0");
+	xmlNodePtr root = xmlNewDocNode(doc, NULL, (xmlChar *)"JALRecord", NULL);
+	xmlSetNs(root, xmlNewNs(root, (xmlChar *)JAL_SYS_META_NAMESPACE_URI, NULL));
+	xmlSetProp(root, (xmlChar *)"xml:id", (xmlChar *)RECORD_ID);
+	xmlDocSetRootElement(doc, root);
+
+	xmlNewChild(root, NULL, (xmlChar *)"JALDataType", (xmlChar *)"log");
+	xmlNewChild(root, NULL, (xmlChar *)"RecordID", (xmlChar *)"c8b3d4a0-5e2f-11e3-949a-0800200c9a66");
+	xmlNewChild(root, NULL, (xmlChar *)"Hostname", (xmlChar *)"bench.example.com");
+	xmlNewChild(root, NULL, (xmlChar *)"HostUUID", (xmlChar *)"9c7b1b2e-5e2f-11e3-949a-0800200c9a66");
+	xmlNewChild(root, NULL, (xmlChar *)"Timestamp", (xmlChar *)"2014-01-01T00:00:00.000000");
+	xmlNewChild(root, NULL, (xmlChar *)"ProcessID", (xmlChar *)"1234");
+	xmlNewChild(root, NULL, (xmlChar *)"User", (xmlChar *)"jalop");
+	return doc;
+}
+
+static void *sign_records(void *arg)
+{
+	struct bench_thread *bench = (struct bench_thread *) arg;
+	struct timespec start;
+	long i;
+
+	bench->ret = -1;
+	jalu_bench_start(&start);
+	for (i = 0; i < bench->records; i++) {
+		RSA *key = bench->keys[bench->alternate ? i % 2 : 0];
+		xmlDocPtr doc = create_record_doc();
+		enum jal_status ret = jal_add_signature_block(key, bench->cert, doc, NULL, RECORD_ID);
+		xmlFreeDoc(doc);
+		if (JAL_OK != ret) {
+			fprintf(stderr, "Error: failed to sign the record\n");
+			return NULL;
+		}
+	}
+	bench->secs = jalu_bench_elapsed(&start);
+	bench->ret = 0;
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	static struct option long_options[] = {
+		{"key", required_argument, NULL, 'k'},
+		{"cert", required_argument, NULL, 'c'},
+		{"no-cert", no_argument, NULL, 'x'},
+		{"records", required_argument, NULL, 'n'},
+		{"threads", required_argument, NULL, 't'},
+		{"alternate", no_argument, NULL, 'a'},
+		{"help", no_argument, NULL, 'h'},
+		{0, 0, 0, 0}
+	};
+	const char *key_file = DEFAULT_RSA_KEY;
+	const char *cert_file = DEFAULT_CERT;
+	long records = 1000;
+	long threads = 1;
+	int alternate = 0;
+	struct bench_thread *benches = NULL;
+	RSA *keys[2] = { NULL, NULL };
+	X509 *cert = NULL;
+	FILE *fp = NULL;
+	struct timespec start;
+	double total_secs;
+	char name[32];
+	int ret = -1;
+	int opt;
+	long i;
+
+	while ((opt = getopt_long(argc, argv, "k:c:xn:t:ah", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'k':
+			key_file = optarg;
+			break;
+		case 'c':
+			cert_file = optarg;
+			break;
+		case 'x':
+			cert_file = NULL;
+			break;
+		case 'n':
+			if (jalu_bench_parse_count("number of records", optarg, &records)) {
+				goto out;
+			}
+			break;
+		case 't':
+			if (jalu_bench_parse_count("number of threads", optarg, &threads)) {
+				goto out;
+			}
+			break;
+		case 'a':
+			alternate = 1;
+			break;
+		case 'h':
+			print_usage();
+			ret = 0;
+			goto out;
+		default:
+			print_usage();
+			goto out;
+		}
+	}
+
+	SSL_library_init();
+	xmlSecInit();
+	xmlSecCryptoDLLoadLibrary(BAD_CAST "openssl");
+	xmlSecCryptoAppInit(NULL);
+	xmlSecCryptoInit();
+
+	fp = fopen(key_file, "r");
+	if (!fp) {
+		fprintf(stderr, "Error: failed to open %s\n", key_file);
+		goto out;
+	}
+	keys[0] = PEM_read_RSAPrivateKey(fp, NULL, NULL, NULL);
+	fclose(fp);
+	if (!keys[0]) {
+		fprintf(stderr, "Error: failed to read the key from %s\n", key_file);
+		goto out;
+	}
+	keys[1] = RSAPrivateKey_dup(keys[0]);
+
+	if (cert_file) {
+		fp = fopen(cert_file, "r");
+		if (!fp) {
+			fprintf(stderr, "Error: failed to open %s\n", cert_file);
+			goto out;
+		}
+		cert = PEM_read_X509(fp, NULL, NULL, NULL);
+		fclose(fp);
+		if (!cert) {
+			fprintf(stderr, "Error: failed to read the certificate from %s\n", cert_file);
+			goto out;
+		}
+	}
+
+	benches = calloc(threads, sizeof(*benches));
+	ret = 0;
+	jalu_bench_start(&start);
+	for (i = 0; i < threads; i++) {
+		benches[i].keys[0] = keys[0];
+		benches[i].keys[1] = keys[1];
+		benches[i].cert = cert;
+		benches[i].records = records;
+		benches[i].alternate = alternate;
+		if (0 != pthread_create(&benches[i].thread, NULL, sign_records, &benches[i])) {
+			fprintf(stderr, "Error: failed to create a thread\n");
+			threads = i;
+			ret = -1;
+			break;
+		}
+	}
+	for (i = 0; i < threads; i++) {
+		pthread_join(benches[i].thread, NULL);
+		if (benches[i].ret) {
+			ret = -1;
+		}
+	}
+	total_secs = jalu_bench_elapsed(&start);
+	if (ret) {
+		goto out;
+	}
+
+	printf("Signing %s, %s\n", alternate ? "with alternating keys" : "with one key",
+		cert ? "with a certificate" : "without a certificate");
+	for (i = 0; i < threads; i++) {
+		snprintf(name, sizeof(name), "thread %ld", i);
+		jalu_bench_report(name, benches[i].records, "records", benches[i].secs, NULL);
+	}
+	jalu_bench_report("all threads", records * threads, "records", total_secs, NULL);
+
+	jal_signing_cache_cleanup();
+	xmlSecCryptoShutdown();
+	xmlSecCryptoAppShutdown();
+	xmlSecShutdown();
+out:
+	free(benches);
+	RSA_free(keys[0]);
+	RSA_free(keys[1]);
+	X509_free(cert);
+	return ret;
+}
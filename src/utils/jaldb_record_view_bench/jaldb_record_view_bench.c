@@ -0,0 +1,247 @@
+/**
+ * @file jaldb_record_view_bench.c Micro-benchmark for reading records
+ * stored by the JALoP DB Layer.
+ *
+ * Serializes a record the way it is stored in the DB and then reads it back
+ * repeatedly, once with jaldb_deserialize_record(), which copies every field
+ * into a new jaldb_record, and once through a jaldb_record_view, which points
+ * into the serialized buffer. Reports the time and the number of heap
+ * allocations per record for each.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uuid/uuid.h>
+
+#include "jal_alloc.h"
+#include "jaldb_record.h"
+#include "jaldb_segment.h"
+#include "jaldb_serialize_record.h"
+#include "jalu_bench.h"
+
+#define SYS_META_LEN 2048
+#define APP_META_LEN 512
+
+static long alloc_cnt;
+
+#ifdef __GLIBC__
+/* glibc lets a program replace the allocator, and its own functions (such as
+ * strdup) then call the replacement. Count calls and hand them to glibc. */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+	alloc_cnt++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	alloc_cnt++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	alloc_cnt++;
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+#define HAVE_ALLOC_CNT 1
+#else
+#define HAVE_ALLOC_CNT 0
+#endif
+
+static void print_usage(void)
+{
+	jalu_bench_usage("jaldb_record_view_bench [-n records] [-p payload_size]",
+	"	-n, --records=N	Number of records to read; defaults to 100000.\n" \
+	"	-p, --payload=P	Size of the payload stored in the record; defaults to\n" \
+	"			1024 bytes.\n");
+}
+
+static struct jaldb_segment *create_segment(size_t len, char fill)
+{
+	struct jaldb_segment *seg = jaldb_create_segment();
+	seg->length = len;
+	seg->payload = (uint8_t*) jal_malloc(len);
+	memset(seg->payload, fill, len);
+	return seg;
+}
+
+static struct jaldb_record *create_record(size_t payload_len)
+{
+	struct jaldb_record *rec = jaldb_create_record();
+	rec->version = JALDB_RECORD_VERSION;
+	rec->type = JALDB_RTYPE_LOG;
+	rec->confirmed = 1;
+	rec->have_uid = 1;
+	rec->pid = 1234;
+	rec->uid = 1000;
+	rec->timestamp = jal_strdup("2014-01-01T00:00:00.000000");
+	rec->network_nonce = jal_strdup("c8b3d4a0-5e2f-11e3-949a-0800200c9a66_2014-01-01T00:00:00.000000_1234_5678");
+	rec->source = jal_strdup("jaldb_record_view_bench");
+	rec->sec_lbl = jal_strdup("system_u:system_r:jalop_t:s0");
+	rec->hostname = jal_strdup("bench.example.com");
+	rec->username = jal_strdup("jalop");
+	uuid_generate(rec->host_uuid);
+	uuid_generate(rec->uuid);
+	rec->sys_meta = create_segment(SYS_META_LEN, 's');
+	rec->app_meta = create_segment(APP_META_LEN, 'a');
+	rec->payload = create_segment(payload_len, 'p');
+	return rec;
+}
+
+static void report(const char *name, long records, double secs, long allocs)
+{
+	if (HAVE_ALLOC_CNT) {
+		jalu_bench_report(name, records, "records", secs,
+			", %6.2f allocations/record", (double) allocs / records);
+	} else {
+		jalu_bench_report(name, records, "records", secs, NULL);
+	}
+}
+
+static int run_deserialize(uint8_t *buf, size_t buf_len, long records)
+{
+	struct jaldb_record *rec = NULL;
+	struct timespec start;
+	size_t total = 0;
+	long allocs;
+	long i;
+
+	alloc_cnt = 0;
+	jalu_bench_start(&start);
+	for (i = 0; i < records; i++) {
+		if (JALDB_OK != jaldb_deserialize_record(0, buf, buf_len, &rec)) {
+			fprintf(stderr, "Error: failed to deserialize the record\n");
+			return -1;
+		}
+		total += strlen(rec->timestamp) + rec->payload->length;
+		jaldb_destroy_record(&rec);
+	}
+	allocs = alloc_cnt;
+	report("jaldb_deserialize_record", records, jalu_bench_elapsed(&start), allocs);
+	return total ? 0 : -1;
+}
+
+static int run_view(uint8_t *buf, size_t buf_len, long records, int decode)
+{
+	struct jaldb_record_view view;
+	struct timespec start;
+	size_t total = 0;
+	long allocs;
+	long i;
+
+	alloc_cnt = 0;
+	jalu_bench_start(&start);
+	for (i = 0; i < records; i++) {
+		if (JALDB_OK != jaldb_record_view_init(&view, 0, buf, buf_len)) {
+			fprintf(stderr, "Error: failed to create the record view\n");
+			return -1;
+		}
+		total += view.confirmed;
+		if (decode) {
+			if (JALDB_OK != jaldb_record_view_decode(&view)) {
+				fprintf(stderr, "Error: failed to decode the record view\n");
+				return -1;
+			}
+			total += strlen(view.timestamp) + view.payload.length;
+		}
+	}
+	allocs = alloc_cnt;
+	report(decode ? "view, decoded" : "view, headers only", records, jalu_bench_elapsed(&start), allocs);
+	return total ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+	static struct option long_options[] = {
+		{"records", required_argument, NULL, 'n'},
+		{"payload", required_argument, NULL, 'p'},
+		{"help", no_argument, NULL, 'h'},
+		{0, 0, 0, 0}
+	};
+	long records = 100000;
+	long payload_len = 1024;
+	struct jaldb_record *rec = NULL;
+	uint8_t *buf = NULL;
+	size_t buf_len = 0;
+	int ret = -1;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "n:p:h", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'n':
+			if (jalu_bench_parse_count("number of records", optarg, &records)) {
+				goto out;
+			}
+			break;
+		case 'p':
+			payload_len = strtol(optarg, NULL, 10);
+			if (payload_len < 0) {
+				fprintf(stderr, "Error: invalid payload size: %s\n", optarg);
+				goto out;
+			}
+			break;
+		case 'h':
+			print_usage();
+			ret = 0;
+			goto out;
+		default:
+			print_usage();
+			goto out;
+		}
+	}
+
+	rec = create_record(payload_len);
+	if (JALDB_OK != jaldb_serialize_record(0, rec, &buf, &buf_len)) {
+		fprintf(stderr, "Error: failed to serialize the record\n");
+		goto out;
+	}
+	printf("Record size: %zu bytes (payload %ld bytes)\n", buf_len, payload_len);
+
+	if (run_deserialize(buf, buf_len, records) ||
+			run_view(buf, buf_len, records, 1) ||
+			run_view(buf, buf_len, records, 0)) {
+		goto out;
+	}
+	ret = 0;
+out:
+	jaldb_destroy_record(&rec);
+	free(buf);
+	return ret;
+}
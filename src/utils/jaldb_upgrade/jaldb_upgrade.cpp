@@ -0,0 +1,150 @@
+/**
+ * @file jaldb_upgrade.cpp This file contains the source for jaldb_upgrade
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+#define __STDC_FORMAT_MACROS
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <jalop/jal_version.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jaldb_serialize_record.h"
+#include "jaldb_status.h"
+#include "jaldb_upgrade.h"
+#include "jaldb_utils.h"
+
+static struct global_args_t {
+	char *home;
+	int journal_fanout;
+} global_args;
+
+static void process_options(int argc, char **argv);
+static void global_args_free();
+static void usage();
+
+int main(int argc, char **argv)
+{
+	enum jaldb_status dbret;
+	uint64_t count = 0;
+
+	process_options(argc, argv);
+
+	printf("Upgrading database to layout version %d\n", JALDB_DB_LAYOUT_VERSION);
+	dbret = jaldb_upgrade_db_layout(global_args.home, &count);
+	if (JALDB_OK != dbret) {
+		fprintf(stderr, "Failed to upgrade the database (%d), "
+				"%" PRIu64 " records were updated. "
+				"It is safe to run jaldb_upgrade again.\n", dbret, count);
+		goto out;
+	}
+	printf("Upgraded %" PRIu64 " records\n", count);
+
+	if (global_args.journal_fanout) {
+		printf("Moving journal files into %d levels of directories\n",
+				global_args.journal_fanout);
+		count = 0;
+		dbret = jaldb_upgrade_journal_fanout(global_args.home,
+				global_args.journal_fanout, &count);
+		if (JALDB_OK != dbret) {
+			fprintf(stderr, "Failed to move the journal files (%d), "
+					"%" PRIu64 " files were moved. "
+					"It is safe to run jaldb_upgrade again.\n", dbret, count);
+		} else {
+			printf("Moved %" PRIu64 " journal files\n", count);
+		}
+	}
+
+out:
+	global_args_free();
+	return dbret;
+}
+
+static void process_options(int argc, char **argv)
+{
+	int opt = 0;
+
+	static const char *opt_string = "h:j:n";
+	static const struct option long_options[] = {
+		{"home", required_argument, NULL, 'h'},
+		{"journal-fanout", required_argument, NULL, 'j'},
+		{"version", no_argument, NULL, 'n'},
+		{0, 0, 0, 0}
+	};
+
+	while (EOF != (opt = getopt_long(argc, argv, opt_string, long_options, NULL))) {
+		switch (opt) {
+		case 'h':
+			global_args.home = strdup(optarg);
+			break;
+		case 'j':
+			global_args.journal_fanout = atoi(optarg);
+			if (global_args.journal_fanout < 1 ||
+					global_args.journal_fanout > JALDB_FANOUT_MAX) {
+				goto err_out;
+			}
+			break;
+		case 'n':
+			printf("%s", jal_version_as_string());
+			goto version_out;
+		default:
+			goto err_out;
+		}
+	}
+
+	if (optind < argc) {
+		goto err_out;
+	}
+
+	return;
+err_out:
+	usage();
+version_out:
+	exit(0);
+}
+
+static void global_args_free()
+{
+	free(global_args.home);
+}
+
+__attribute__((noreturn)) static void usage()
+{
+	static const char *usage =
+	"Usage: jaldb_upgrade [options]\n\
+	Upgrade an existing JALoP database to the current layout version and\n\
+	rebuild the secondary indices. All JALoP processes using the database\n\
+	must be stopped first.\n\
+	-h, --home=H		Specify the root of the JALoP database,\n\
+				defaults to /var/lib/jalop/db\n\
+	-j, --journal-fanout=N	Also move the journal files into N levels of\n\
+				directories, from 1 to 4.\n\
+	-n, --version		Output the version information and exit.\n";
+	fprintf(stderr, "%s", usage);
+	exit(-1);
+}
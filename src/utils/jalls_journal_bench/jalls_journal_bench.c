@@ -0,0 +1,234 @@
+/**
+ * @file jalls_journal_bench.c Micro-benchmark for ingesting journal
+ * payloads in the JALoP Local Store.
+ *
+ * Copies a payload to disk in the same sized chunks the local store uses
+ * while running it through a SHA-256 context, and then produces the digest
+ * for the system metadata manifest either by reading the just-written file
+ * back in (as jalls_handle_journal() used to) or by reusing the digest
+ * computed while streaming (as jalls_handle_journal() does now).
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <jalop/jal_status.h>
+#include <jalop/jal_digest.h>
+
+#include "jal_alloc.h"
+#include "jalu_bench.h"
+
+#define JOURNAL_BUF_LEN 8192
+#define DEFAULT_ITERATIONS 100
+#define DEFAULT_REPEAT 1
+#define DEFAULT_PAYLOAD_FILE TEST_INPUT_ROOT "big_payload.txt"
+#define DEFAULT_OUTPUT_DIR "/tmp"
+
+static void print_usage(void)
+{
+	jalu_bench_usage("jalls_journal_bench [-f payload_file] [-r repeat] [-n iterations] [-d dir]",
+	"	-f, --file=F	The payload to ingest.\n" \
+	"	-r, --repeat=R	Number of copies of the payload in each journal record.\n" \
+	"	-n, --iterations=N	Number of records to ingest for each run.\n" \
+	"	-d, --dir=D	Directory to write the journal records to.\n");
+}
+
+/*
+ * Mirror the receive loop in jalls_handle_journal(): copy the payload to
+ * out_fd in JOURNAL_BUF_LEN chunks, digesting each chunk as it is written.
+ */
+static int ingest(struct jal_digest_ctx *dgst_ctx, int in_fd, int out_fd,
+		long repeat, uint8_t *dgst)
+{
+	char buf[JOURNAL_BUF_LEN];
+	size_t dgst_len = dgst_ctx->len;
+	void *instance = dgst_ctx->create();
+	ssize_t bytes_read;
+	int ret = -1;
+	long i;
+
+	if (JAL_OK != dgst_ctx->init(instance)) {
+		goto out;
+	}
+	for (i = 0; i < repeat; i++) {
+		if ((off_t) -1 == lseek(in_fd, 0, SEEK_SET)) {
+			goto out;
+		}
+		while ((bytes_read = read(in_fd, buf, sizeof(buf))) > 0) {
+			if (JAL_OK != dgst_ctx->update(instance, (uint8_t *)buf, bytes_read)) {
+				goto out;
+			}
+			if (write(out_fd, buf, bytes_read) != bytes_read) {
+				goto out;
+			}
+		}
+		if (bytes_read < 0) {
+			goto out;
+		}
+	}
+	if (JAL_OK != dgst_ctx->final(instance, dgst, &dgst_len)) {
+		goto out;
+	}
+	ret = 0;
+out:
+	dgst_ctx->destroy(instance);
+	return ret;
+}
+
+static int run(struct jal_digest_ctx *dgst_ctx, int in_fd, const char *dir,
+		long repeat, long iterations, int reread)
+{
+	char path[4096];
+	uint8_t *dgst = jal_malloc(dgst_ctx->len);
+	uint8_t *manifest_dgst = NULL;
+	int out_fd = -1;
+	int ret = -1;
+	long i;
+
+	for (i = 0; i < iterations; i++) {
+		snprintf(path, sizeof(path), "%s/jalls_journal_bench.XXXXXX", dir);
+		out_fd = mkstemp(path);
+		if (out_fd < 0) {
+			fprintf(stderr, "Error: failed to create a file in %s\n", dir);
+			goto out;
+		}
+		unlink(path);
+		if (ingest(dgst_ctx, in_fd, out_fd, repeat, dgst)) {
+			fprintf(stderr, "Error: failed to ingest the payload\n");
+			goto out;
+		}
+		if (reread) {
+			if (JAL_OK != jal_digest_fd(dgst_ctx, out_fd, &manifest_dgst)) {
+				fprintf(stderr, "Error: failed to digest the journal file\n");
+				goto out;
+			}
+			if (memcmp(manifest_dgst, dgst, dgst_ctx->len)) {
+				fprintf(stderr, "Error: streamed digest does not match the file\n");
+				goto out;
+			}
+			free(manifest_dgst);
+			manifest_dgst = NULL;
+		}
+		close(out_fd);
+		out_fd = -1;
+	}
+	ret = 0;
+out:
+	if (out_fd >= 0) {
+		close(out_fd);
+	}
+	free(manifest_dgst);
+	free(dgst);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	static struct option long_options[] = {
+		{"file", required_argument, NULL, 'f'},
+		{"repeat", required_argument, NULL, 'r'},
+		{"iterations", required_argument, NULL, 'n'},
+		{"dir", required_argument, NULL, 'd'},
+		{"help", no_argument, NULL, 'h'},
+		{0, 0, 0, 0}
+	};
+	const char *payload_file = DEFAULT_PAYLOAD_FILE;
+	const char *dir = DEFAULT_OUTPUT_DIR;
+	long iterations = DEFAULT_ITERATIONS;
+	long repeat = DEFAULT_REPEAT;
+	struct jal_digest_ctx *dgst_ctx = NULL;
+	struct timespec start;
+	double secs;
+	uint64_t bytes;
+	off_t payload_len;
+	int in_fd = -1;
+	int ret = -1;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "f:r:n:d:h", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'f':
+			payload_file = optarg;
+			break;
+		case 'r':
+			if (jalu_bench_parse_count("repeat count", optarg, &repeat)) {
+				return -1;
+			}
+			break;
+		case 'n':
+			if (jalu_bench_parse_count("number of iterations", optarg, &iterations)) {
+				return -1;
+			}
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case 'h':
+			print_usage();
+			return 0;
+		default:
+			print_usage();
+			return -1;
+		}
+	}
+
+	in_fd = open(payload_file, O_RDONLY);
+	if (in_fd < 0 || (payload_len = lseek(in_fd, 0, SEEK_END)) <= 0) {
+		fprintf(stderr, "Error: failed to read %s\n", payload_file);
+		goto out;
+	}
+	bytes = (uint64_t)payload_len * repeat * iterations;
+
+	dgst_ctx = jal_sha256_ctx_create();
+
+	jalu_bench_start(&start);
+	if (run(dgst_ctx, in_fd, dir, repeat, iterations, 1)) {
+		goto out;
+	}
+	secs = jalu_bench_elapsed(&start);
+	jalu_bench_report("stream and re-read", iterations, "records", secs,
+		" (%8.1f MB/s)", (bytes / (1024.0 * 1024.0)) / secs);
+
+	jalu_bench_start(&start);
+	if (run(dgst_ctx, in_fd, dir, repeat, iterations, 0)) {
+		goto out;
+	}
+	secs = jalu_bench_elapsed(&start);
+	jalu_bench_report("single pass", iterations, "records", secs,
+		" (%8.1f MB/s)", (bytes / (1024.0 * 1024.0)) / secs);
+	ret = 0;
+out:
+	jal_digest_ctx_destroy(&dgst_ctx);
+	if (in_fd >= 0) {
+		close(in_fd);
+	}
+	return ret;
+}
@@ -0,0 +1,212 @@
+/**
+ * @file jaln_digest_bench.c Micro-benchmark for matching digest messages
+ * on the publisher side of the JALoP Network Library.
+ *
+ * Builds a list of locally calculated digests and a digest message from
+ * the peer with the same nonces, and times
+ * jaln_pub_notify_digests_and_create_digest_response() over them, once with
+ * the peer reporting the nonces in the order they were sent and once in
+ * reverse order.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jalop/jaln_network.h>
+#include <jalop/jaln_publisher_callbacks.h>
+
+#include "jaln_context.h"
+#include "jaln_digest_info.h"
+#include "jaln_publisher.h"
+#include "jaln_session.h"
+#include "jalu_bench.h"
+
+#define DIGEST_LEN 32
+#define NONCE_LEN 32
+
+static long peer_digest_cnt;
+
+static void print_usage(void)
+{
+	jalu_bench_usage("jaln_digest_bench [-n entries] [-u unmatched]",
+	"	-n, --entries=N	Number of digests in the digest message. Can be given\n" \
+	"			more than once; defaults to 10000 and 100000.\n" \
+	"	-u, --unmatched=U	Number of extra locally calculated digests the peer\n" \
+	"			does not include in the message.\n");
+}
+
+static void peer_digest(
+		__attribute__((unused)) jaln_session *sess,
+		__attribute__((unused)) const struct jaln_channel_info *ch_info,
+		__attribute__((unused)) enum jaln_record_type type,
+		__attribute__((unused)) const char *nonce,
+		__attribute__((unused)) const uint8_t *local_digest,
+		__attribute__((unused)) const uint32_t local_size,
+		__attribute__((unused)) const uint8_t *peer_digest,
+		__attribute__((unused)) const uint32_t peer_size,
+		__attribute__((unused)) void *user_data)
+{
+	peer_digest_cnt++;
+}
+
+static void add_digest(axlList *list, long id)
+{
+	char nonce[NONCE_LEN];
+	uint8_t dgst[DIGEST_LEN];
+
+	snprintf(nonce, sizeof(nonce), "%ld", id);
+	memset(dgst, 0, sizeof(dgst));
+	memcpy(dgst, &id, sizeof(id));
+	axl_list_append(list, jaln_digest_info_create(nonce, dgst, sizeof(dgst)));
+}
+
+static int run(jaln_session *sess, long entries, long unmatched, int reverse)
+{
+	axlList *calc_dgsts = jaln_digest_info_list_create();
+	axlList *peer_dgsts = jaln_digest_info_list_create();
+	axlList *resps = NULL;
+	struct timespec start;
+	double secs;
+	char name[32];
+	int ret = -1;
+	long i;
+
+	// The publisher calculates digests in the order it sends records. The
+	// unmatched entries are the oldest ones, as if the peer never received
+	// them.
+	for (i = 0; i < entries + unmatched; i++) {
+		add_digest(calc_dgsts, i);
+	}
+	for (i = 0; i < entries; i++) {
+		add_digest(peer_dgsts, unmatched + (reverse ? entries - 1 - i : i));
+	}
+
+	peer_digest_cnt = 0;
+	jalu_bench_start(&start);
+	jaln_pub_notify_digests_and_create_digest_response(sess, calc_dgsts, peer_dgsts, &resps);
+	secs = jalu_bench_elapsed(&start);
+
+	if (!resps || axl_list_length(resps) != entries || peer_digest_cnt != entries ||
+			axl_list_length(calc_dgsts) != unmatched) {
+		fprintf(stderr, "Error: unexpected result matching %ld digests\n", entries);
+		goto out;
+	}
+	snprintf(name, sizeof(name), "%s, %ld unmatched",
+		reverse ? "reversed" : "in order", unmatched);
+	jalu_bench_report(name, entries, "digests", secs, NULL);
+	ret = 0;
+out:
+	if (resps) {
+		axl_list_free(resps);
+	}
+	axl_list_free(calc_dgsts);
+	axl_list_free(peer_dgsts);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	static struct option long_options[] = {
+		{"entries", required_argument, NULL, 'n'},
+		{"unmatched", required_argument, NULL, 'u'},
+		{"help", no_argument, NULL, 'h'},
+		{0, 0, 0, 0}
+	};
+	long default_entries[] = { 10000, 100000 };
+	long *entries = NULL;
+	int entries_cnt = 0;
+	long unmatched = 0;
+	jaln_context *ctx = NULL;
+	jaln_session *sess = NULL;
+	int ret = -1;
+	int opt;
+	int i;
+
+	entries = calloc(argc + 1, sizeof(*entries));
+	if (!entries) {
+		return -1;
+	}
+
+	while ((opt = getopt_long(argc, argv, "n:u:h", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'n':
+			if (jalu_bench_parse_count("number of entries", optarg,
+					&entries[entries_cnt])) {
+				goto out;
+			}
+			entries_cnt++;
+			break;
+		case 'u':
+			unmatched = strtol(optarg, NULL, 10);
+			if (unmatched < 0) {
+				fprintf(stderr, "Error: invalid number of unmatched entries: %s\n", optarg);
+				goto out;
+			}
+			break;
+		case 'h':
+			print_usage();
+			ret = 0;
+			goto out;
+		default:
+			print_usage();
+			goto out;
+		}
+	}
+	if (0 == entries_cnt) {
+		entries_cnt = sizeof(default_entries) / sizeof(default_entries[0]);
+		memcpy(entries, default_entries, sizeof(default_entries));
+	}
+
+	ctx = jaln_context_create();
+	sess = jaln_session_create();
+	if (!ctx || !sess) {
+		fprintf(stderr, "Error: failed to create the network context\n");
+		goto out;
+	}
+	ctx->pub_callbacks = jaln_publisher_callbacks_create();
+	ctx->pub_callbacks->peer_digest = peer_digest;
+	sess->jaln_ctx = ctx;
+	sess->ch_info->type = JALN_RTYPE_LOG;
+
+	for (i = 0; i < entries_cnt; i++) {
+		if (run(sess, entries[i], unmatched, 0) ||
+				run(sess, entries[i], unmatched, 1)) {
+			goto out;
+		}
+	}
+	ret = 0;
+out:
+	if (sess) {
+		sess->jaln_ctx = NULL;
+		jaln_session_unref(sess);
+	}
+	jaln_context_destroy(&ctx);
+	free(entries);
+	return ret;
+}
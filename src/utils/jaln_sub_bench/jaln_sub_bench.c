@@ -0,0 +1,308 @@
+/**
+ * @file jaln_sub_bench.c Micro-benchmark for receiving records with the
+ * subscriber state machine of the JALoP Network Library.
+ *
+ * Builds an audit record the way a publisher sends it, splits it into
+ * frames, and times feeding the frames to the subscriber state machine of a
+ * session, as if they arrived from a publisher. The MIME headers may be sent
+ * in much smaller frames than the rest of the record, to measure the cost of
+ * headers that span many frames.
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vortex.h>
+
+#include <jalop/jal_digest.h>
+#include <jalop/jal_status.h>
+#include <jalop/jaln_network.h>
+#include <jalop/jaln_subscriber_callbacks.h>
+
+#include "jal_alloc.h"
+#include "jaln_context.h"
+#include "jaln_message_helpers.h"
+#include "jaln_record_info.h"
+#include "jaln_session.h"
+#include "jaln_subscriber_state_machine.h"
+#include "jalu_bench.h"
+
+#define BREAK_STR "BREAK"
+#define BREAK_LEN (sizeof(BREAK_STR) - 1)
+#define SYS_META "<sys-meta/>"
+#define APP_META "<app-meta/>"
+
+static long audit_bytes;
+static long digest_cnt;
+
+static void print_usage(void)
+{
+	jalu_bench_usage("jaln_sub_bench [-n records] [-s size] [-f frame_size] [-H header_frame_size]",
+	"	-n, --records=N	Number of audit records to receive, defaults to 100.\n" \
+	"	-s, --size=S	Size of each audit record in bytes, defaults to 1 MB.\n" \
+	"	-f, --frame-size=F	Size of the frames, defaults to 4096.\n" \
+	"	-H, --header-frame-size=H	Size of the frames carrying the MIME headers,\n" \
+	"			defaults to the frame size.\n");
+}
+
+static int on_record_info(
+		__attribute__((unused)) jaln_session *sess,
+		__attribute__((unused)) const struct jaln_channel_info *ch_info,
+		__attribute__((unused)) enum jaln_record_type type,
+		__attribute__((unused)) const struct jaln_record_info *record_info,
+		__attribute__((unused)) const struct jaln_mime_header *headers,
+		__attribute__((unused)) const uint8_t *sys_meta,
+		__attribute__((unused)) const uint32_t sys_meta_sz,
+		__attribute__((unused)) const uint8_t *app_meta,
+		__attribute__((unused)) const uint32_t app_meta_sz,
+		__attribute__((unused)) void *user_data)
+{
+	return JAL_OK;
+}
+
+static int on_audit(
+		__attribute__((unused)) jaln_session *sess,
+		__attribute__((unused)) const struct jaln_channel_info *ch_info,
+		__attribute__((unused)) const char *nonce,
+		__attribute__((unused)) const uint8_t *buffer,
+		const uint32_t cnt,
+		__attribute__((unused)) void *user_data)
+{
+	audit_bytes += cnt;
+	return JAL_OK;
+}
+
+static int notify_digest(
+		__attribute__((unused)) jaln_session *sess,
+		__attribute__((unused)) const struct jaln_channel_info *ch_info,
+		__attribute__((unused)) enum jaln_record_type type,
+		__attribute__((unused)) char *nonce,
+		__attribute__((unused)) const uint8_t *digest,
+		__attribute__((unused)) const uint32_t len,
+		__attribute__((unused)) const void *user_data)
+{
+	digest_cnt++;
+	return JAL_OK;
+}
+
+static void message_complete(
+		__attribute__((unused)) jaln_session *sess,
+		__attribute__((unused)) const struct jaln_channel_info *ch_info,
+		__attribute__((unused)) enum jaln_record_type type,
+		__attribute__((unused)) void *user_data)
+{
+}
+
+/**
+ * Build the ANS reply for an audit record of \p size bytes, the headers
+ * followed by the system metadata, application metadata and payload, each
+ * followed by a BREAK.
+ */
+static uint8_t *build_record(long size, uint64_t *headers_len, uint64_t *msg_len)
+{
+	struct jaln_record_info *info = jaln_record_info_create();
+	char *headers = NULL;
+	uint8_t *msg = NULL;
+	uint8_t *pos;
+
+	info->type = JALN_RTYPE_AUDIT;
+	info->nonce = jal_strdup("bench-nonce");
+	info->sys_meta_len = strlen(SYS_META);
+	info->app_meta_len = strlen(APP_META);
+	info->payload_len = size;
+	if (JAL_OK != jaln_create_record_ans_rpy_headers(info, &headers, headers_len)) {
+		goto out;
+	}
+
+	*msg_len = *headers_len + info->sys_meta_len + info->app_meta_len + size + 3 * BREAK_LEN;
+	msg = jal_malloc(*msg_len);
+	pos = msg;
+	memcpy(pos, headers, *headers_len);
+	pos += *headers_len;
+	memcpy(pos, SYS_META BREAK_STR APP_META BREAK_STR, info->sys_meta_len + info->app_meta_len + 2 * BREAK_LEN);
+	pos += info->sys_meta_len + info->app_meta_len + 2 * BREAK_LEN;
+	memset(pos, 'a', size);
+	pos += size;
+	memcpy(pos, BREAK_STR, BREAK_LEN);
+out:
+	free(headers);
+	jaln_record_info_destroy(&info);
+	return msg;
+}
+
+/**
+ * Feed one record to the state machine of \p sess, as ANS frames of at most
+ * \p frame_sz bytes, or \p header_frame_sz bytes while sending the headers.
+ */
+static int feed_record(VortexCtx *v_ctx, jaln_session *sess, const uint8_t *msg,
+		uint64_t headers_len, uint64_t msg_len, long frame_sz, long header_frame_sz,
+		int ansno)
+{
+	uint64_t off = 0;
+	unsigned int seqno = 0;
+
+	while (off < msg_len) {
+		uint64_t len = (off < headers_len) ? (uint64_t) header_frame_sz : (uint64_t) frame_sz;
+		if (len > msg_len - off) {
+			len = msg_len - off;
+		}
+		axl_bool more = (off + len < msg_len);
+		VortexFrame *frame = vortex_frame_create(v_ctx, VORTEX_FRAME_TYPE_ANS, 1, 1,
+				more, seqno, (int) len, ansno, msg + off);
+		if (!frame) {
+			return -1;
+		}
+		axl_bool ok = sess->sub_data->sm->curr_state->frame_handler(sess, frame, 0, more);
+		vortex_frame_unref(frame);
+		if (!ok) {
+			return -1;
+		}
+		off += len;
+		seqno += len;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static struct option long_options[] = {
+		{"records", required_argument, NULL, 'n'},
+		{"size", required_argument, NULL, 's'},
+		{"frame-size", required_argument, NULL, 'f'},
+		{"header-frame-size", required_argument, NULL, 'H'},
+		{"help", no_argument, NULL, 'h'},
+		{0, 0, 0, 0}
+	};
+	long records = 100;
+	long size = 1024 * 1024;
+	long frame_sz = 4096;
+	long header_frame_sz = 0;
+	VortexCtx *v_ctx = NULL;
+	jaln_context *ctx = NULL;
+	jaln_session *sess = NULL;
+	uint8_t *msg = NULL;
+	uint64_t headers_len = 0;
+	uint64_t msg_len = 0;
+	struct timespec start;
+	double secs;
+	char name[64];
+	int ret = -1;
+	int opt;
+	long i;
+
+	while ((opt = getopt_long(argc, argv, "n:s:f:H:h", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'n':
+			if (jalu_bench_parse_count("number of records", optarg, &records)) {
+				goto out;
+			}
+			break;
+		case 's':
+			if (jalu_bench_parse_count("record size", optarg, &size)) {
+				goto out;
+			}
+			break;
+		case 'f':
+			if (jalu_bench_parse_count("frame size", optarg, &frame_sz)) {
+				goto out;
+			}
+			break;
+		case 'H':
+			if (jalu_bench_parse_count("header frame size", optarg, &header_frame_sz)) {
+				goto out;
+			}
+			break;
+		case 'h':
+			print_usage();
+			ret = 0;
+			goto out;
+		default:
+			print_usage();
+			goto out;
+		}
+	}
+	if (0 == header_frame_sz) {
+		header_frame_sz = frame_sz;
+	}
+
+	msg = build_record(size, &headers_len, &msg_len);
+	v_ctx = vortex_ctx_new();
+	ctx = jaln_context_create();
+	sess = jaln_session_create();
+	if (!msg || !v_ctx || !ctx || !sess) {
+		fprintf(stderr, "Error: failed to set up the benchmark\n");
+		goto out;
+	}
+	ctx->sub_callbacks = jaln_subscriber_callbacks_create();
+	ctx->sub_callbacks->on_record_info = on_record_info;
+	ctx->sub_callbacks->on_audit = on_audit;
+	ctx->sub_callbacks->notify_digest = notify_digest;
+	ctx->sub_callbacks->message_complete = message_complete;
+	sess->jaln_ctx = ctx;
+	sess->dgst = jal_sha256_ctx_create();
+	sess->ch_info->type = JALN_RTYPE_AUDIT;
+	sess->role = JALN_ROLE_SUBSCRIBER;
+	sess->sub_data = jaln_sub_data_create();
+	sess->sub_data->sm = jaln_sub_state_create_audit_machine();
+	jaln_sub_state_reset(sess);
+
+	audit_bytes = 0;
+	digest_cnt = 0;
+	jalu_bench_start(&start);
+	for (i = 0; i < records; i++) {
+		if (feed_record(v_ctx, sess, msg, headers_len, msg_len, frame_sz,
+				header_frame_sz, (int) i)) {
+			fprintf(stderr, "Error: the subscriber rejected record %ld\n", i);
+			goto out;
+		}
+	}
+	secs = jalu_bench_elapsed(&start);
+
+	if (digest_cnt != records || audit_bytes != records * size) {
+		fprintf(stderr, "Error: unexpected result receiving %ld records\n", records);
+		goto out;
+	}
+	snprintf(name, sizeof(name), "%ld/%ld byte frames", frame_sz, header_frame_sz);
+	jalu_bench_report(name, records, "records", secs,
+		" (%ld bytes each, %10.1f MB/s)", size,
+		(double) msg_len * records / (1024 * 1024) / secs);
+	ret = 0;
+out:
+	if (sess) {
+		jal_digest_ctx_destroy(&sess->dgst);
+		sess->jaln_ctx = NULL;
+		jaln_session_unref(sess);
+	}
+	jaln_context_destroy(&ctx);
+	if (v_ctx) {
+		vortex_ctx_free(v_ctx);
+	}
+	free(msg);
+	return ret;
+}
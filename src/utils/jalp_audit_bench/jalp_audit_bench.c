@@ -0,0 +1,178 @@
+/**
+ * @file jalp_audit_bench.c Micro-benchmark for validating and digesting
+ * audit records in the JALoP Producer Library.
+ *
+ * Measures how many audit records per second can be validated against the
+ * JAF schema and digested, once compiling the schema for every record (as
+ * jalp_audit() used to) and once reusing a schema compiled up front (as
+ * jalp_audit() does now).
+ *
+ * @section LICENSE
+ *
+ * Source code in 3rd-party is licensed and owned by their respective
+ * copyright holders.
+ *
+ * All other source code is copyright Tresys Technology and licensed as below.
+ *
+ * Copyright (c) 2014 Tresys Technology LLC, Columbia, Maryland, USA
+ *
+ * This software was developed by Tresys Technology LLC
+ * with U.S. Government sponsorship.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <jalop/jal_status.h>
+#include <jalop/jal_digest.h>
+#include <jalop/jalp_context.h>
+
+#include "jal_alloc.h"
+#include "jalp_digest_audit_xml.h"
+#include "jalu_bench.h"
+
+#define DEFAULT_ITERATIONS 1000
+#define DEFAULT_AUDIT_FILE TEST_INPUT_ROOT "good_audit_input.xml"
+
+static void print_usage(void)
+{
+	jalu_bench_usage("jalp_audit_bench [-s schema_root] [-f audit_file] [-n iterations]",
+	"	-s, --schemas=S	Directory containing the JALoP schemas.\n" \
+	"	-f, --file=F	The audit record to validate and digest.\n" \
+	"	-n, --iterations=N	Number of records to process for each run.\n");
+}
+
+static int read_file(const char *path, uint8_t **buf, size_t *buf_len)
+{
+	long len;
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		return -1;
+	}
+	if (fseek(f, 0, SEEK_END) || (len = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET)) {
+		fclose(f);
+		return -1;
+	}
+	*buf = jal_malloc(len);
+	if (fread(*buf, len, 1, f) != 1) {
+		free(*buf);
+		*buf = NULL;
+		fclose(f);
+		return -1;
+	}
+	*buf_len = len;
+	fclose(f);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static struct option long_options[] = {
+		{"schemas", required_argument, NULL, 's'},
+		{"file", required_argument, NULL, 'f'},
+		{"iterations", required_argument, NULL, 'n'},
+		{"help", no_argument, NULL, 'h'},
+		{0, 0, 0, 0}
+	};
+	const char *schema_root = SCHEMAS_ROOT;
+	const char *audit_file = DEFAULT_AUDIT_FILE;
+	long iterations = DEFAULT_ITERATIONS;
+	struct jal_digest_ctx *dgst_ctx = NULL;
+	xmlSchemaPtr schema = NULL;
+	xmlSchemaValidCtxtPtr valid_ctx = NULL;
+	uint8_t *buf = NULL;
+	size_t buf_len = 0;
+	struct timespec start;
+	double secs;
+	enum jal_status jret;
+	int ret = -1;
+	int opt;
+	long i;
+
+	while ((opt = getopt_long(argc, argv, "s:f:n:h", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 's':
+			schema_root = optarg;
+			break;
+		case 'f':
+			audit_file = optarg;
+			break;
+		case 'n':
+			if (jalu_bench_parse_count("number of iterations", optarg, &iterations)) {
+				return -1;
+			}
+			break;
+		case 'h':
+			print_usage();
+			return 0;
+		default:
+			print_usage();
+			return -1;
+		}
+	}
+
+	if (read_file(audit_file, &buf, &buf_len)) {
+		fprintf(stderr, "Error: failed to read %s\n", audit_file);
+		return -1;
+	}
+
+	jalp_init();
+	dgst_ctx = jal_sha256_ctx_create();
+
+	jalu_bench_start(&start);
+	for (i = 0; i < iterations; i++) {
+		uint8_t *dgst = NULL;
+		int dgst_len = 0;
+		jret = jalp_digest_audit_record(dgst_ctx, schema_root, buf, buf_len,
+				&dgst, &dgst_len);
+		free(dgst);
+		if (jret != JAL_OK) {
+			fprintf(stderr, "Error: failed to digest audit record: %d\n", jret);
+			goto out;
+		}
+	}
+	secs = jalu_bench_elapsed(&start);
+	jalu_bench_report("schema per record", iterations, "records", secs,
+		" (%8.1f us/record)", secs * 1000000.0 / iterations);
+
+	jalu_bench_start(&start);
+	jret = jalp_digest_audit_load_schema(schema_root, &schema, &valid_ctx);
+	if (jret != JAL_OK) {
+		fprintf(stderr, "Error: failed to load the schema: %d\n", jret);
+		goto out;
+	}
+	for (i = 0; i < iterations; i++) {
+		uint8_t *dgst = NULL;
+		int dgst_len = 0;
+		jret = jalp_digest_audit_record_with_schema(dgst_ctx, valid_ctx, buf,
+				buf_len, &dgst, &dgst_len);
+		free(dgst);
+		if (jret != JAL_OK) {
+			fprintf(stderr, "Error: failed to digest audit record: %d\n", jret);
+			goto out;
+		}
+	}
+	secs = jalu_bench_elapsed(&start);
+	jalu_bench_report("cached schema", iterations, "records", secs,
+		" (%8.1f us/record)", secs * 1000000.0 / iterations);
+	ret = 0;
+out:
+	jalp_digest_audit_free_schema(&schema, &valid_ctx);
+	jal_digest_ctx_destroy(&dgst_ctx);
+	free(buf);
+	jalp_shutdown();
+	return ret;
+}
@@ -542,6 +542,9 @@ static void print_error(enum jal_status error)
 		case JAL_E_COMM:
 			printf("JAL_E_COMM");
 			break;
+		case JAL_E_QUEUE_FULL:
+			printf("JAL_E_QUEUE_FULL");
+			break;
 		case JAL_OK:
 			break;
 	}
@@ -34,6 +34,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 #include "jal_base64_internal.h"
@@ -48,8 +49,15 @@
 struct thread_data {
 	jaln_session *sess;
 	char *nonce;
+	enum jaln_record_type type;
 };
 
+// When non-zero, send this many records as fast as possible and report the
+// throughput, instead of sending one record a second forever.
+static long num_records = 0;
+static size_t payload_size = 0;
+static int send_window = 1;
+
 enum jaln_connect_error on_connect_request(const struct jaln_connect_request *req,
 		int *selected_encoding, int *selected_digest, void *user_data)
 {
@@ -114,8 +122,14 @@ enum jal_status __send_record(jaln_session *sess, char *nonce,
 	sys_meta_len = strlen("sys_meta_buffer");
 	app_meta_buf = (uint8_t*) strdup("app_meta_buffer");
 	app_meta_len = strlen("app_meta_buffer");
-	payload_buf = (uint8_t*) strdup("payload_buffer");
-	payload_len = strlen("payload_buffer");
+	if (payload_size) {
+		payload_buf = (uint8_t*) malloc(payload_size);
+		memset(payload_buf, 'x', payload_size);
+		payload_len = payload_size;
+	} else {
+		payload_buf = (uint8_t*) strdup("payload_buffer");
+		payload_len = strlen("payload_buffer");
+	}
 
 	enum jal_status ret = send(sess, nonce, sys_meta_buf, sys_meta_len,
 				app_meta_buf, app_meta_len, payload_buf, payload_len);
@@ -134,18 +148,37 @@ __attribute__((noreturn))
 void *send_record(void *args) {
 	struct thread_data *data = (struct thread_data *) args;
 	jaln_session *sess = data->sess;
-	char *nonce = data->nonce;
-	enum jal_status ret = JAL_E_INVAL;
+	static enum jal_status ret = JAL_E_INVAL;
+	char nonce[32];
+	struct timeval start;
+	struct timeval end;
+	long sent = 0;
 
-	while (1) {
-		ret = __send_record(sess, nonce, &jaln_send_audit);\
+	gettimeofday(&start, NULL);
+	while (0 == num_records || sent < num_records) {
+		snprintf(nonce, sizeof(nonce), "%ld", sent + 1);
+		ret = __send_record(sess, nonce,
+				(JALN_RTYPE_AUDIT == data->type) ? &jaln_send_audit : &jaln_send_log);
 		if (JAL_OK != ret) {
-			DEBUG_LOG("Failed to send audit record");
+			DEBUG_LOG("Failed to send record");
 			goto out;
 		}
-		sleep(1);
+		sent++;
+		if (0 == num_records) {
+			sleep(1);
+		}
 	}
 
+	// Wait for the last records in the window to go out.
+	ret = jaln_finish(sess);
+	gettimeofday(&end, NULL);
+	double secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+	size_t rec_size = payload_size ? payload_size : strlen("payload_buffer");
+	printf("window %d: %ld records of %zu bytes in %.3f s: %.1f records/s (%.2f MB/s)\n",
+		send_window, sent, rec_size, secs, sent / secs,
+		(sent * (double)rec_size) / (1024.0 * 1024.0) / secs);
+	exit((JAL_OK == ret) ? 0 : 1);
+
 out:
 	pthread_exit(&ret);
 }
@@ -178,6 +211,7 @@ enum jal_status on_subscribe(
 	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
 
 	data.sess = sess;
+	data.type = type;
 
 	switch (type) {
 	case JALN_RTYPE_JOURNAL:
@@ -298,7 +332,48 @@ void notify_peer_digest(
 	DEBUG_LOG("dgst: %s\n", b64);
 	free(b64);
 }
-int main() {
+static void usage(void)
+{
+	printf("Usage: dummy_push [-H host] [-P port] [-w window] [-n records] [-s payload_size]\n" \
+		"	-H	The host to publish to (default 127.0.0.1).\n" \
+		"	-P	The port to publish to (default 55555).\n" \
+		"	-w	Number of records to keep in flight.\n" \
+		"	-n	Send this many records as fast as possible, report the throughput and exit.\n" \
+		"	-s	Size of the payload of each record, in bytes.\n");
+}
+
+int main(int argc, char **argv) {
+	const char *host = "127.0.0.1";
+	const char *port = "55555";
+	int opt;
+
+	while ((opt = getopt(argc, argv, "H:P:w:n:s:h")) != -1) {
+		switch (opt) {
+		case 'H':
+			host = optarg;
+			break;
+		case 'P':
+			port = optarg;
+			break;
+		case 'w':
+			send_window = atoi(optarg);
+			break;
+		case 'n':
+			num_records = atol(optarg);
+			break;
+		case 's':
+			payload_size = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+			return (opt == 'h') ? 0 : -1;
+		}
+	}
+	if (0 >= send_window || 0 > num_records) {
+		usage();
+		return -1;
+	}
+
 	jaln_context *net_ctx = jaln_context_create();
 	//struct jaln_connection_handlers *connect_handlers = jaln_connection_handlers_create();
 	struct jaln_connection_callbacks ch;
@@ -331,7 +406,9 @@ int main() {
 	DEBUG_LOG("register conn cbs: %d\n", err);
 	err = jaln_register_publisher_callbacks(net_ctx, pub_callbacks);
 	DEBUG_LOG("register pub cbs: %d\n", err);
-	struct jaln_connection *conn = jaln_publish(net_ctx, "127.0.0.1", "55555", JALN_RTYPE_LOG, JALN_ARCHIVE_MODE, NULL);
+	err = jaln_set_send_window(net_ctx, send_window);
+	DEBUG_LOG("set send window: %d\n", err);
+	struct jaln_connection *conn = jaln_publish(net_ctx, host, port, JALN_RTYPE_LOG, JALN_ARCHIVE_MODE, NULL);
 	DEBUG_LOG("got jal con %p\n", conn);
 	sleep(9999);
 	//err = jaln_shutdown(conn);
@@ -26,20 +26,31 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
 */
+#include <getopt.h>
 #include <inttypes.h>
 #include <jalop/jaln_network.h>
 #include <jalop/jaln_subscriber_callbacks.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 #include "jal_base64_internal.h"
 #define DEBUG_LOG(args...) \
 	do { \
+		if (quiet) { \
+			break; \
+		} \
 		fprintf(stderr, "(sub) %s[%d] ", __FILE__, __LINE__); \
 		fprintf(stderr, ##args); \
 		fprintf(stderr, "\n"); \
 	} while(0)
 
+static int quiet;
+static uint64_t records_received;
+static uint64_t bytes_received;
+static uint64_t records_confirmed;
+
 int sub_get_subscribe_request(
 		__attribute__((unused)) jaln_session *session,
 		__attribute__((unused)) const struct jaln_channel_info *ch_info,
@@ -77,6 +88,8 @@ int sub_on_record_info(
 			(char*) application_metadata_buffer);
 	DEBUG_LOG("(%s)payload_sz[%"PRIu64"]", record_info->nonce, 
 			record_info->payload_len);
+	bytes_received += record_info->sys_meta_len + record_info->app_meta_len +
+		record_info->payload_len;
 
 
 	return 0;
@@ -170,6 +183,7 @@ int sub_on_digest_response(
 
 	DEBUG_LOG("ch info:%p type:%d nonce:%s status: %s, ds:%d, ud:%p\n",
 		ch_info, type, nonce, status_str, status, user_data);
+	__sync_fetch_and_add(&records_confirmed, 1);
 	return 0;
 }
 
@@ -181,6 +195,7 @@ void sub_message_complete(
 {
 	DEBUG_LOG("ch info:%p type:%d ud:%p\n",
 		ch_info, type, user_data);
+	records_received++;
 }
 
 int sub_acquire_journal_feeder(
@@ -246,7 +261,64 @@ void on_connect_nack(const struct jaln_connect_nack *nack, void *user_data)
 	DEBUG_LOG("ack: %p", nack);
 }
 
-int main() {
+static void print_usage(void)
+{
+	static const char *usage =
+	"Usage: dummy_sub [-H host] [-P port] [-t seconds] [-m max_records] [-b max_bytes]\n" \
+	"		[-a max_age_ms] [-A] [-q]\n" \
+	"	-H	The host to subscribe to.\n" \
+	"	-P	The port to connect on.\n" \
+	"	-t	How long to stay subscribed.\n" \
+	"	-m	The maximum number of records per 'digest' message.\n" \
+	"	-b	The maximum number of record bytes per 'digest' message.\n" \
+	"	-a	The longest time to hold on to a digest, in milliseconds.\n" \
+	"	-A	Tune the records per 'digest' message from the record rate.\n" \
+	"	-q	Do not log each callback, only print the throughput at the end.\n";
+	printf("%s\n", usage);
+}
+
+int main(int argc, char **argv) {
+	const char *host = "localhost";
+	const char *port = "55555";
+	long seconds = 600;
+	int max_records = 1;
+	long long max_bytes = 0;
+	long max_age_ms = 30 * 60 * 1000;
+	int adaptive = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "H:P:t:m:b:a:Aqh")) != -1) {
+		switch (opt) {
+		case 'H':
+			host = optarg;
+			break;
+		case 'P':
+			port = optarg;
+			break;
+		case 't':
+			seconds = strtol(optarg, NULL, 10);
+			break;
+		case 'm':
+			max_records = atoi(optarg);
+			break;
+		case 'b':
+			max_bytes = strtoll(optarg, NULL, 10);
+			break;
+		case 'a':
+			max_age_ms = strtol(optarg, NULL, 10);
+			break;
+		case 'A':
+			adaptive = 1;
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			print_usage();
+			return (opt == 'h') ? 0 : -1;
+		}
+	}
+
 	jaln_context *net_ctx = jaln_context_create();
 	//struct jaln_connection_handlers *conn_cbs = jaln_connection_handlers_create();
 	struct jaln_connection_callbacks ch;
@@ -277,12 +349,27 @@ int main() {
 	err = jaln_register_encoding(net_ctx, "xml");
 	err = jaln_register_connection_callbacks(net_ctx, conn_cbs);
 	err = jaln_register_subscriber_callbacks(net_ctx, sub_cbs);
+	err = jaln_set_digest_batching(net_ctx, max_records, max_bytes, max_age_ms, adaptive);
+	if (JAL_OK != err) {
+		fprintf(stderr, "Invalid digest batching settings\n");
+		return -1;
+	}
 	//struct jaln_connection *conn = jaln_subscribe(net_ctx, "192.168.246.156", "55555", JALN_RTYPE_LOG, NULL);
-	struct jaln_connection *conn = jaln_subscribe(net_ctx, "localhost", "55555", JALN_RTYPE_LOG, JALN_ARCHIVE_MODE, NULL);
+	struct jaln_connection *conn = jaln_subscribe(net_ctx, host, port, JALN_RTYPE_LOG, JALN_ARCHIVE_MODE, NULL);
 	DEBUG_LOG("got jal con %p\n", conn);
+	struct timeval start;
+	struct timeval end;
+	gettimeofday(&start, NULL);
 	//sleep(120);
 	//err = jaln_disconnect(conn);
-	sleep(600);
+	sleep(seconds);
+	gettimeofday(&end, NULL);
+	double secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+	printf("received %"PRIu64" records (%"PRIu64" bytes), %"PRIu64" confirmed in %.3f s\n",
+		records_received, bytes_received, records_confirmed, secs);
+	printf("%.1f records/s (%.1f MB/s), %.1f confirmed/s\n",
+		records_received / secs, (bytes_received / (1024.0 * 1024.0)) / secs,
+		records_confirmed / secs);
 	//err = jaln_shutdown(conn);
 	//jaln_context_destroy(&net_ctx);
 	return 0;